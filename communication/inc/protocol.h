@@ -17,6 +17,8 @@
 #include "timesyncmanager.h"
 #include "hal_platform.h"
 
+#include <cstddef>
+
 namespace particle
 {
 namespace protocol
@@ -227,6 +229,8 @@ protected:
 					{	return ping();});
 			if (error)
 				return error;
+			timesync_.process(callbacks.millis(), [this]
+					{	return send_time_request_message();});
 		}
 		return NO_ERROR;
 	}
@@ -274,7 +278,7 @@ protected:
 	/**
 	 * Handles the time delivered from the cloud.
 	 */
-	void handle_time_response(uint32_t time);
+	void handle_time_response(uint32_t time, int millis);
 
 	/**
 	 * Copy an initialize a block of memory from a source to a target, where the source may be smaller than the target.
@@ -486,19 +490,49 @@ public:
 			return false;
 		}
 
-		return timesync_.send_request(callbacks.millis(), [&]() {
-			uint8_t token = next_token();
-			Message message;
-			channel.create(message);
-			size_t len = Messages::time_request(message.buf(), 0, token);
-			message.set_length(len);
-			return !channel.send(message);
+		return timesync_.send_request(callbacks.millis(), [this]() {
+			return send_time_request_message();
 		});
 	}
 
+	bool send_time_request_message()
+	{
+		uint8_t token = next_token();
+		Message message;
+		channel.create(message);
+		size_t len = Messages::time_request(message.buf(), 0, token);
+		message.set_length(len);
+		return !channel.send(message);
+	}
+
 	bool time_request_pending() const { return timesync_.is_request_pending(); }
 	system_tick_t time_last_synced(time_t* tm) const { return timesync_.last_sync(*tm); }
 
+	int get_time_sync_quality(time_sync_quality* quality)
+	{
+#define TIME_SYNC_QUALITY_HAS(field) (offsetof(time_sync_quality, field) + sizeof(time_sync_quality::field) <= quality->size)
+		if (!TIME_SYNC_QUALITY_HAS(synced)) {
+			return SYSTEM_ERROR_INVALID_ARGUMENT;
+		}
+		// Only fill the fields that are known to the caller
+		const system_tick_t now = callbacks.millis();
+		quality->synced = (timesync_.sample_count() > 0);
+		if (TIME_SYNC_QUALITY_HAS(drift_known)) {
+			quality->drift_known = timesync_.is_drift_known();
+		}
+		if (TIME_SYNC_QUALITY_HAS(accuracy)) {
+			quality->accuracy = timesync_.accuracy(now);
+		}
+		if (TIME_SYNC_QUALITY_HAS(drift)) {
+			quality->drift = (int32_t)(timesync_.drift_ppm() * 1000);
+		}
+		if (TIME_SYNC_QUALITY_HAS(next_sync)) {
+			quality->next_sync = timesync_.next_sync(now);
+		}
+#undef TIME_SYNC_QUALITY_HAS
+		return 0;
+	}
+
 	bool is_initialized() { return initialized; }
 
 	int presence_announcement(uint8_t* buf, const uint8_t* id)
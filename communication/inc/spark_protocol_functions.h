@@ -93,7 +93,8 @@ struct SparkCallbacks
 	system_tick_t (*millis)();
 
 	/**
-	* Sets the time. Time is given in milliseconds since the epoch, UCT.
+	* Sets the time. Time is given in seconds since the epoch, UCT, and `param` is the
+	* millisecond part of the time.
 	*/
 	void (*set_time)(time_t t, unsigned int param, void* reserved);
 
@@ -353,6 +354,28 @@ typedef struct protocol_status {
  */
 int spark_protocol_get_status(ProtocolFacade* protocol, protocol_status* status, void* reserved);
 
+/**
+ * Time synchronization quality.
+ */
+typedef struct time_sync_quality {
+    uint16_t size; ///< Size of this structure.
+    uint8_t synced; ///< Set to 1 if the time has been received from the cloud.
+    uint8_t drift_known; ///< Set to 1 if the drift of the local clock has been measured.
+    uint32_t accuracy; ///< Estimated error of the current time, in milliseconds.
+    int32_t drift; ///< Drift of the local clock, in parts per billion. Positive if the clock is slow.
+    uint32_t next_sync; ///< Time until the next automatic synchronization, in milliseconds.
+} time_sync_quality;
+
+/**
+ * Get the quality of the time synchronization.
+ *
+ * @param protocol Protocol instance.
+ * @param quality Quality info.
+ * @param reserved This argument should be set to NULL.
+ * @param 0 on success.
+ */
+int spark_protocol_time_sync_quality(ProtocolFacade* protocol, time_sync_quality* quality, void* reserved);
+
 /**
  * Decrypt a buffer using the given public key.
  * @param ciphertext        The ciphertext to decrypt
@@ -26,6 +26,10 @@ namespace particle { namespace protocol {
 
 uint16_t CoAPMessage::message_count = 0;
 
+const system_tick_t CoAPRttEstimator::INITIAL_RTO;
+const system_tick_t CoAPRttEstimator::MIN_RTO;
+const system_tick_t CoAPRttEstimator::MAX_RTO;
+
 bool is_ack_or_reset(const uint8_t* buf, size_t len)
 {
 	if (len<1)
@@ -46,9 +50,12 @@ ProtocolError CoAPMessageStore::send_message(CoAPMessage* msg, Channel& channel)
  */
 bool CoAPMessageStore::retransmit(CoAPMessage* msg, Channel& channel, system_tick_t now)
 {
-	bool retransmit = (msg->prepare_retransmit(now));
+	bool retransmit = (msg->prepare_retransmit(now, rtt));
 	if (retransmit)
 	{
+		if (msg->get_transmit_count() > 1)
+			LOG(TRACE, "Retransmitting message: id=%x, attempt: %u", (unsigned)msg->get_id(),
+					(unsigned)msg->get_transmit_count() - 1);
 		send_message(msg, channel);
 	}
 	return retransmit;
@@ -56,6 +63,7 @@ bool CoAPMessageStore::retransmit(CoAPMessage* msg, Channel& channel, system_tic
 
 void CoAPMessageStore::message_timeout(CoAPMessage& msg, Channel& channel)
 {
+	LOG(TRACE, "Message timed out: id=%x", (unsigned)msg.get_id());
 	msg.notify_timeout();
 	if (msg.is_request()) {
 		g_unacknowledgedMessageCounter++;
@@ -63,6 +71,49 @@ void CoAPMessageStore::message_timeout(CoAPMessage& msg, Channel& channel)
 	}
 }
 
+void CoAPMessageStore::message_acknowledged(const CoAPMessage& msg, system_tick_t time)
+{
+	if (!msg.is_in_flight())
+		return;
+	// The latency includes the retransmissions. The scenario reports parse this message
+	LOG(TRACE, "Message acknowledged: id=%x, latency: %u ms, transmissions: %u", (unsigned)msg.get_id(),
+			(unsigned)(time - msg.get_sent_time()), (unsigned)msg.get_transmit_count());
+	if (rtt.update(time - msg.get_sent_time(), msg.get_transmit_count(), time)) {
+		g_coapRoundTripTime = rtt.srtt();
+		g_coapRetransmissionTimeout = rtt.rto(time);
+		LOG(TRACE, "RTT: %u ms, RTO: %u ms", (unsigned)rtt.srtt(), (unsigned)rtt.rto(time));
+	}
+}
+
+unsigned CoAPMessageStore::in_flight() const
+{
+	unsigned count = 0;
+	for (const CoAPMessage* msg = head; msg != nullptr; msg = msg->get_next()) {
+		if (msg->is_in_flight())
+			++count;
+	}
+	return count;
+}
+
+void CoAPMessageStore::send_deferred(system_tick_t time, Channel& channel)
+{
+	unsigned count = in_flight();
+	while (!max_in_flight || count < max_in_flight)
+	{
+		// Messages are stored most recent first, so the oldest queued message is the last one
+		CoAPMessage* oldest = nullptr;
+		for (CoAPMessage* msg = head; msg != nullptr; msg = msg->get_next()) {
+			if (msg->is_deferred())
+				oldest = msg;
+		}
+		if (!oldest)
+			break;
+		DEBUG("sending deferred message id=%x", oldest->get_id());
+		retransmit(oldest, channel, time);
+		++count;
+	}
+}
+
 /**
  * Process existing messages, resending any unacknowledged requests to the given channel.
  */
@@ -72,7 +123,7 @@ void CoAPMessageStore::process(system_tick_t time, Channel& channel)
 	CoAPMessage* prev = nullptr;
 	while (msg!=nullptr)
 	{
-		if (time_has_passed(time, msg->get_timeout()) && !retransmit(msg, channel, time))
+		if (!msg->is_deferred() && time_has_passed(time, msg->get_timeout()) && !retransmit(msg, channel, time))
 		{
 			remove(msg, prev);
 			message_timeout(*msg, channel);
@@ -85,6 +136,7 @@ void CoAPMessageStore::process(system_tick_t time, Channel& channel)
 			msg = msg->get_next();
 		}
 	}
+	send_deferred(time, channel);
 }
 
 
@@ -92,7 +144,7 @@ void CoAPMessageStore::process(system_tick_t time, Channel& channel)
  * Registers that this message has been sent from the application.
  * Confirmable messages, and ack/reset responses are cached.
  */
-ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time)
+ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time, bool* deferred)
 {
 	if (!msg.has_id())
 		return MISSING_MESSAGE_ID;
@@ -105,8 +157,15 @@ ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time)
 		CoAPMessage* coapmsg = CoAPMessage::create(msg);
 		if (coapmsg==nullptr)
 			return INSUFFICIENT_STORAGE;
-		if (coapType==CoAPType::CON)
-			coapmsg->prepare_retransmit(time);
+		if (coapType==CoAPType::CON) {
+			if (deferred && max_in_flight && in_flight()>=max_in_flight) {
+				// the message is sent from process() once the window opens
+				DEBUG("deferring message id=%x", msg.get_id());
+				*deferred = true;
+			} else {
+				coapmsg->prepare_retransmit(time, rtt);
+			}
+		}
 		else
 			coapmsg->set_expiration(time+CoAPMessage::MAX_TRANSMIT_SPAN);
 		add(*coapmsg);
@@ -135,6 +194,12 @@ ProtocolError CoAPMessageStore::receive(Message& msg, Channel& channel, system_t
 			channel.command(Channel::DISCARD_SESSION, nullptr);
 		}
 		DEBUG("recieved ACK for message id=%x", id);
+		if (msgtype==CoAPType::ACK) {
+			CoAPMessage* msg = from_id(id);
+			if (msg) {
+				message_acknowledged(*msg, time);
+			}
+		}
 		if (!clear_message(id)) {		// message didn't exist, means it's already been acknoweldged or is unknown.
 			msg.set_length(0);
 		}
@@ -20,6 +20,7 @@
 
 #include "message_channel.h"
 #include "coap.h"
+#include "coap_rtt.h"
 #include "timer_hal.h"
 #include "stdlib.h"
 #include "service_debug.h"
@@ -112,6 +113,11 @@ private:
 	 */
 	system_tick_t timeout;
 
+	/**
+	 * The time when this message was transmitted for the first time.
+	 */
+	system_tick_t sent_time;
+
 	/**
 	 * The unique 16-bit ID for this message.
 	 */
@@ -159,12 +165,19 @@ public:
 
 
 	/**
-	 * The number of outstanding messages allowed.
+	 * The number of outstanding messages allowed by RFC 7252.
 	 */
 	static const uint8_t NSTART = 1;
 
+	/**
+	 * The number of confirmable requests that can be awaiting acknowledgement at the same time.
+	 * Further requests are queued and sent once an earlier request is acknowledged or times out.
+	 * The window is wider than NSTART as the device talks to a single well-provisioned server.
+	 */
+	static const uint8_t MAX_IN_FLIGHT = 4;
 
-	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), id(id_), transmit_count(0), delivered(nullptr), data_len(0) {
+
+	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), sent_time(0), id(id_), transmit_count(0), delivered(nullptr), data_len(0) {
 		message_count++;
 	}
 
@@ -198,6 +211,8 @@ public:
 	inline message_id_t get_id() const { return id; }
 	inline void removed() { next = nullptr; }
 	inline system_tick_t get_timeout() const { return timeout; }
+	inline system_tick_t get_sent_time() const { return sent_time; }
+	inline uint8_t get_transmit_count() const { return transmit_count; }
 
 	inline void set_delivered_handler(std::function<void(Delivery)>* handler) { this->delivered = handler; }
 
@@ -217,11 +232,13 @@ public:
 	 * Prepares to retransmit this message after a timeout.
 	 * @return false if the message cannot be retransmitted.
 	 */
-	bool prepare_retransmit(system_tick_t now)
+	bool prepare_retransmit(system_tick_t now, CoAPRttEstimator& rtt)
 	{
 		CoAPType::Enum coapType = CoAP::type(get_data());
 		if (coapType==CoAPType::CON) {
-			timeout = now + transmit_timeout(transmit_count);
+			if (transmit_count==0)
+				sent_time = now;
+			timeout = now + rtt.transmit_timeout(transmit_count, now);
 			transmit_count++;
 			return transmit_count <= MAX_RETRANSMIT+1;
 		}
@@ -230,7 +247,7 @@ public:
 	}
 
 	/**
-	 * Determines the transmit timeout for the given transmission count.
+	 * Determines the transmit timeout for the given transmission count, as defined by RFC 7252.
 	 */
 	static inline system_tick_t transmit_timeout(uint8_t transmit_count)
 	{
@@ -256,6 +273,22 @@ public:
 	const uint8_t* get_data() const { return data; }
 	uint16_t get_data_length() const { return data_len; }
 
+	/**
+	 * Returns true if this is a confirmable message that is queued and hasn't been sent yet.
+	 */
+	bool is_deferred() const
+	{
+		return transmit_count==0 && get_type()==CoAPType::CON;
+	}
+
+	/**
+	 * Returns true if this is a confirmable message that is awaiting acknowledgement.
+	 */
+	bool is_in_flight() const
+	{
+		return transmit_count>0 && transmit_count<=MAX_RETRANSMIT+1 && get_type()==CoAPType::CON;
+	}
+
 	/**
 	 * Sets the time when this message expires.
 	 */
@@ -305,6 +338,16 @@ class CoAPMessageStore
 	 */
 	CoAPMessage* head;
 
+	/**
+	 * Round-trip time estimates used to schedule retransmissions.
+	 */
+	CoAPRttEstimator rtt;
+
+	/**
+	 * The maximum number of confirmable messages awaiting acknowledgement.
+	 */
+	uint8_t max_in_flight;
+
 	/**
 	 * Retrieves the message with the given ID and the previous message.
 	 * If no message exists with the given id, nullptr is returned.
@@ -337,9 +380,18 @@ class CoAPMessageStore
 
 	void message_timeout(CoAPMessage& msg, Channel& channel);
 
+	void message_acknowledged(const CoAPMessage& msg, system_tick_t time);
+
+	/**
+	 * Sends the oldest queued confirmable messages while the in-flight window allows.
+	 */
+	void send_deferred(system_tick_t time, Channel& channel);
+
+	unsigned in_flight() const;
+
 public:
 
-	CoAPMessageStore() : head(nullptr) {}
+	CoAPMessageStore() : head(nullptr), max_in_flight(CoAPMessage::MAX_IN_FLIGHT) {}
 
 	~CoAPMessageStore() {
 		clear();
@@ -352,6 +404,20 @@ public:
 
 	bool has_unacknowledged_requests() const;
 
+	/**
+	 * Sets the maximum number of confirmable messages awaiting acknowledgement.
+	 * 0 disables the limit.
+	 */
+	void set_max_in_flight(uint8_t count)
+	{
+		max_in_flight = count;
+	}
+
+	const CoAPRttEstimator& rtt_estimator() const
+	{
+		return rtt;
+	}
+
 	/**
 	 * Retrieves the current confirmable message that is still
 	 * waiting acknowledgement.
@@ -424,8 +490,12 @@ public:
 	/**
 	 * Registers that this message has been sent from the application.
 	 * Confirmable messages, and ack/reset responses are cached.
+	 *
+	 * @param deferred Set to true if the in-flight window is full and the confirmable message was
+	 *        queued. The store sends the queued message from `process()`, so the caller shouldn't
+	 *        pass it to the channel.
 	 */
-	ProtocolError send(Message& msg, system_tick_t time);
+	ProtocolError send(Message& msg, system_tick_t time, bool* deferred = nullptr);
 
 	/**
 	 * Notifies the message store that a message has been received.
@@ -562,8 +632,9 @@ public:
 
 		// determine the type of message.
 		CoAPMessageStore& store = msg.is_request() ? client : server;
-		ProtocolError error = store.send(msg, millis());
-		if (!error)
+		bool deferred = false;
+		ProtocolError error = store.send(msg, millis(), &deferred);
+		if (!error && !deferred)
 			error = channel::send(msg);
 		return error;
 	}
@@ -635,8 +706,9 @@ public:
 		DEBUG("sending message id=%x synchronously", id);
 		CoAPType::Enum coapType = CoAP::type(msg.buf());
 		const bool had_client_messages = client.has_messages();
-		ProtocolError error = client.send(msg, millis());
-		if (!error)
+		bool deferred = false;
+		ProtocolError error = client.send(msg, millis(), &deferred);
+		if (!error && !deferred)
 			error = delegateChannel.send(msg);
 		if (!error && coapType==CoAPType::CON)
 		{
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_tick_hal.h"
+
+#include <cstdlib>
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * Estimates the round-trip time of confirmable messages and derives the retransmission timeout
+ * as described by the CoCoA draft (draft-ietf-core-cocoa).
+ *
+ * Two RFC 6298 estimators are maintained. The strong estimator is fed with the RTTs of messages
+ * that were acknowledged after their first transmission. The weak estimator is fed with the RTTs
+ * of messages that were acknowledged after one or two retransmissions, measured from the first
+ * transmission. The overall RTO is a weighted average of the RTOs computed by both estimators.
+ *
+ * Until the first measurement, the estimator reproduces the RFC 7252 timeouts.
+ */
+class CoAPRttEstimator
+{
+public:
+	/**
+	 * The RTO used before any measurements are available (ACK_TIMEOUT of RFC 7252).
+	 */
+	static const system_tick_t INITIAL_RTO = 4000;
+
+	static const system_tick_t MIN_RTO = 500;
+	static const system_tick_t MAX_RTO = 60000;
+
+	/**
+	 * Maximum number of transmissions for a message to provide a weak RTT sample.
+	 */
+	static const unsigned MAX_WEAK_TRANSMIT_COUNT = 3;
+
+	CoAPRttEstimator()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		strong = Estimator();
+		weak = Estimator();
+		overall = INITIAL_RTO;
+		updated = 0;
+	}
+
+	/**
+	 * Registers a round-trip time sample.
+	 *
+	 * @param rtt The time elapsed between the first transmission of a message and the reception of
+	 *        its acknowledgement.
+	 * @param transmit_count The number of times the message has been transmitted.
+	 * @param now The current time.
+	 * @return `false` if the sample was ignored.
+	 */
+	bool update(system_tick_t rtt, unsigned transmit_count, system_tick_t now)
+	{
+		if (transmit_count == 1)
+		{
+			const system_tick_t r = strong.update(rtt, 4 /* K */);
+			overall = r / 2 + overall / 2;
+		}
+		else if (transmit_count > 1 && transmit_count <= MAX_WEAK_TRANSMIT_COUNT)
+		{
+			const system_tick_t r = weak.update(rtt, 1 /* K */);
+			overall = r / 4 + overall * 3 / 4;
+		}
+		else
+		{
+			return false;
+		}
+		overall = clamp(overall);
+		updated = now;
+		return true;
+	}
+
+	/**
+	 * Returns the retransmission timeout, aged according to the time elapsed since the last
+	 * measurement.
+	 */
+	system_tick_t rto(system_tick_t now)
+	{
+		if (!has_samples())
+		{
+			return overall;
+		}
+		// A small RTO that hasn't been confirmed for a while is increased towards 1s, and a large
+		// one is decreased towards 2s, so that the estimate doesn't get stuck after a path change
+		if (overall < 1000 && now - updated > 16 * overall)
+		{
+			overall = (1000 + 2 * overall) / 3;
+			updated = now;
+		}
+		else if (overall > 3000 && now - updated > 4 * overall)
+		{
+			overall = (2000 + overall) / 2;
+			updated = now;
+		}
+		return overall;
+	}
+
+	/**
+	 * Returns the timeout to wait for an acknowledgement after the given number of transmissions.
+	 *
+	 * The initial timeout is a random value between RTO and 1.5 * RTO. Each retransmission
+	 * multiplies the timeout by a variable backoff factor, which is larger for small RTOs.
+	 */
+	system_tick_t transmit_timeout(unsigned transmit_count, system_tick_t now)
+	{
+		system_tick_t timeout = rto(now);
+		timeout += ((timeout * (rand() % 256)) >> 9);
+		if (!has_samples())
+		{
+			// Binary exponential backoff of RFC 7252
+			return timeout << transmit_count;
+		}
+		const system_tick_t base = overall;
+		for (unsigned i = 0; i < transmit_count && timeout < MAX_RTO; ++i)
+		{
+			if (base < 1000)
+			{
+				timeout *= 3;
+			}
+			else if (base > 3000)
+			{
+				timeout += timeout / 2;
+			}
+			else
+			{
+				timeout *= 2;
+			}
+		}
+		return (timeout < MAX_RTO) ? timeout : MAX_RTO;
+	}
+
+	bool has_samples() const
+	{
+		return strong.valid || weak.valid;
+	}
+
+	/**
+	 * Returns the smoothed RTT of the strong estimator, or of the weak one if no strong samples
+	 * were collected.
+	 */
+	system_tick_t srtt() const
+	{
+		return strong.valid ? strong.srtt : weak.srtt;
+	}
+
+private:
+	struct Estimator
+	{
+		system_tick_t srtt = 0;
+		system_tick_t rttvar = 0;
+		bool valid = false;
+
+		system_tick_t update(system_tick_t rtt, unsigned k)
+		{
+			if (!valid)
+			{
+				srtt = rtt;
+				rttvar = rtt / 2;
+				valid = true;
+			}
+			else
+			{
+				// RTTVAR = 3/4 * RTTVAR + 1/4 * |SRTT - RTT|, SRTT = 7/8 * SRTT + 1/8 * RTT
+				const system_tick_t delta = (srtt > rtt) ? srtt - rtt : rtt - srtt;
+				rttvar = (3 * rttvar + delta) / 4;
+				srtt = (7 * srtt + rtt) / 8;
+			}
+			return srtt + k * rttvar;
+		}
+	};
+
+	Estimator strong;
+	Estimator weak;
+	system_tick_t overall;
+	system_tick_t updated;
+
+	static system_tick_t clamp(system_tick_t rto)
+	{
+		return (rto < MIN_RTO) ? MIN_RTO : (rto > MAX_RTO) ? MAX_RTO : rto;
+	}
+};
+
+} // namespace protocol
+} // namespace particle
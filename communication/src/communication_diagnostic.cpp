@@ -1,4 +1,8 @@
 #include "communication_diagnostic.h"
+#include "coap_rtt.h"
 
 particle::SimpleIntegerDiagnosticData g_rateLimitedEventsCounter(DIAG_ID_CLOUD_RATE_LIMITED_EVENTS, DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS);
 particle::SimpleIntegerDiagnosticData g_unacknowledgedMessageCounter(DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES, DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES);
+particle::SimpleIntegerDiagnosticData g_coapRoundTripTime(DIAG_ID_CLOUD_ROUND_TRIP_TIME, DIAG_NAME_CLOUD_ROUND_TRIP_TIME);
+particle::SimpleIntegerDiagnosticData g_coapRetransmissionTimeout(DIAG_ID_CLOUD_RETRANSMISSION_TIMEOUT, DIAG_NAME_CLOUD_RETRANSMISSION_TIMEOUT,
+        particle::protocol::CoAPRttEstimator::INITIAL_RTO);
@@ -55,41 +55,79 @@ namespace protocol
 
 	ProtocolError LightSSLMessageChannel::receive(Message& message)
 	{
-		ProtocolError error = NO_ERROR;
-                // NB: use callbacks.receive() to return immediately, rather than blocking_receive()
-		int bytes_received = callbacks.receive(queue, 2, nullptr);
-		if (2 == bytes_received)
+		ProtocolError error = create(message, 0);
+		if (error)
+			return error;
+		message.set_length(0);
+
+		uint8_t* record = nullptr;
+		size_t size = 0;
+		error = reader.next(record, size);
+		if (!error && !size)
 		{
-			size_t packet_size = queue[0] << 8 | queue[1];
-			error = create(message, packet_size);
-			if (!error)
+			// NB: use callbacks.receive() to return immediately, rather than blocking_receive()
+			const int bytes_received = reader.read([this](uint8_t* buf, size_t len) {
+				return callbacks.receive(buf, len, nullptr);
+			});
+			if (bytes_received < 0)
 			{
-				uint8_t* buf = message.buf();
-				if (blocking_receive(buf, packet_size) < 0)
-					error = IO_ERROR_LIGHTSSL_BLOCKING_RECEIVE;
-				else
-				{
-					unsigned char next_iv[16];
-					memcpy(next_iv, buf, 16);
-					mbedtls_aes_setkey_dec(&aes, key, 128);
-					mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_DECRYPT, packet_size, iv_receive, buf, buf);
-					memcpy(iv_receive, next_iv, 16);
-					message.set_length(packet_size-buf[packet_size-1]);
-				}
+				LOG(WARN,"receive error %d", bytes_received);
+				return IO_ERROR_LIGHTSSL_RECEIVE;
 			}
+			error = reader.next(record, size);
 		}
-		else
+		if (error)
 		{
-			error = create(message, 0);
-			message.set_length(0);
-			if (bytes_received<0) {
-				LOG(WARN,"receive error %d", bytes_received);
-				error = IO_ERROR_LIGHTSSL_RECEIVE;
+			LOG(WARN,"invalid record, error %d", error);
+			return error;
+		}
+
+		if (!size)
+		{
+			if (!reader.available())
+			{
+				receive_pending = false;
+				return NO_ERROR;
 			}
+			// A record is partially received
+			const system_tick_t now = callbacks.millis();
+			if (!receive_pending)
+			{
+				receive_pending = true;
+				receive_start = now;
+			}
+			else if (20000 < (now - receive_start))
+			{
+				// timed out, disconnect
+				LOG(WARN,"receive timeout");
+				return IO_ERROR_LIGHTSSL_BLOCKING_RECEIVE;
+			}
+			return NO_ERROR;
 		}
+		receive_pending = false;
+
+		error = decrypt(message, record, size);
+		reader.consume();
 		return error;
 	}
 
+	ProtocolError LightSSLMessageChannel::decrypt(Message& message, const unsigned char* record, size_t length)
+	{
+		uint8_t* buf = message.buf();
+		unsigned char next_iv[16];
+		memcpy(next_iv, record, 16);
+		mbedtls_aes_crypt_cbc(&aes_dec, MBEDTLS_AES_DECRYPT, length, iv_receive, record, buf);
+		memcpy(iv_receive, next_iv, 16);
+		const size_t pad = buf[length - 1];
+		if (pad == 0 || pad > 16)
+		{
+			LOG(WARN,"invalid padding");
+			return DECRYPTION_ERROR;
+		}
+		message.set_length(length - pad);
+		return NO_ERROR;
+	}
+
 
 	ProtocolError LightSSLMessageChannel::set_key(const unsigned char *signed_encrypted_credentials)
 	{
@@ -119,6 +157,8 @@ namespace protocol
 		memcpy(iv_send, credentials + 16, 16);
 		memcpy(iv_receive, credentials + 16, 16);
 		memcpy(salt, credentials + 32, 8);
+		mbedtls_aes_setkey_enc(&aes_enc, key, 128);
+		mbedtls_aes_setkey_dec(&aes_dec, key, 128);
 		if (counter)
 			*counter = *(message_id_t*)salt;
 		if (callbacks.handle_seed)
@@ -143,8 +183,7 @@ namespace protocol
 
 	void LightSSLMessageChannel::encrypt(unsigned char *buf, int length)
 	{
-		mbedtls_aes_setkey_enc(&aes, key, 128);
-		mbedtls_aes_crypt_cbc(&aes, MBEDTLS_AES_ENCRYPT, length, iv_send, buf, buf);
+		mbedtls_aes_crypt_cbc(&aes_enc, MBEDTLS_AES_ENCRYPT, length, iv_send, buf, buf);
 		memcpy(iv_send, buf, 16);
 	}
 
@@ -152,6 +191,8 @@ namespace protocol
 	{
 		LOG_CATEGORY("comm.lightssl.handshake");
 		LOG(INFO,"Started, receive nonce");
+		reader.reset();
+		receive_pending = false;
 		memcpy(queue + 40, device_id, 12);
 		int err = blocking_receive(queue, 40);
 		if (0 > err)
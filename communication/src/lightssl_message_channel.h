@@ -27,6 +27,7 @@
 #include "device_keys.h"
 #include "message_channel.h"
 #include "buffer_message_channel.h"
+#include "lightssl_record_reader.h"
 #include "mbedtls/aes.h"
 
 namespace particle
@@ -62,21 +63,31 @@ private:
 	unsigned char iv_send[16];
 	unsigned char iv_receive[16];
 	unsigned char salt[8];
-	mbedtls_aes_context aes;
+	// Key schedules are computed once per session
+	mbedtls_aes_context aes_enc;
+	mbedtls_aes_context aes_dec;
+
+	LightSSLRecordReader<PROTOCOL_BUFFER_SIZE - 2 - 16> reader;
+	system_tick_t receive_start;
+	bool receive_pending;
 
 	Callbacks callbacks;
 	message_id_t* counter;
 
 public:
 
-	LightSSLMessageChannel()
+	LightSSLMessageChannel() :
+			receive_start(0),
+			receive_pending(false)
 	{
-		mbedtls_aes_init(&aes);
+		mbedtls_aes_init(&aes_enc);
+		mbedtls_aes_init(&aes_dec);
 	}
 
 	~LightSSLMessageChannel()
 	{
-		mbedtls_aes_free(&aes);
+		mbedtls_aes_free(&aes_enc);
+		mbedtls_aes_free(&aes_dec);
 	}
 
 	virtual bool is_unreliable() override;
@@ -91,7 +102,10 @@ public:
 	}
 
 	/**
-	 * Retrieve first the 2 byte length from the stream, which determines
+	 * Reads the available data from the stream and returns the next complete record, if any.
+	 *
+	 * The method doesn't wait for the rest of a record that is only partially received. Records
+	 * that are received together are returned by subsequent calls without reading from the stream.
 	 */
 	ProtocolError receive(Message& message) override;
 
@@ -118,6 +132,7 @@ protected:
 
 	size_t wrap(unsigned char *buf, size_t msglen);
 	void encrypt(unsigned char *buf, int length);
+	ProtocolError decrypt(Message& message, const unsigned char* record, size_t length);
 
 	ProtocolError handshake();
 
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "protocol_defs.h"
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * Incremental parser of the records received over a LightSSL session.
+ *
+ * A record consists of a 2-byte big-endian length followed by the AES-CBC encrypted body. `read()`
+ * appends whatever data the transport has available to an internal buffer and never waits for the
+ * rest of a record. `next()` returns the next complete record, so several records received by a
+ * single read are served one after another without reading from the transport again.
+ *
+ * @tparam max Maximum size of a record body.
+ */
+template<size_t max>
+class LightSSLRecordReader
+{
+public:
+	static const size_t HEADER_SIZE = 2;
+	static const size_t BLOCK_SIZE = 16;
+	static const size_t MAX_BODY_SIZE = max;
+
+	LightSSLRecordReader()
+	{
+		reset();
+	}
+
+	/**
+	 * Discards the buffered data.
+	 */
+	void reset()
+	{
+		head = 0;
+		tail = 0;
+	}
+
+	/**
+	 * Reads the data that is available from the transport.
+	 *
+	 * @param receive Function with the signature `int(uint8_t* buf, size_t size)` that reads up
+	 *        to `size` bytes without blocking.
+	 * @return The number of bytes read, or a negative result of `receive`.
+	 */
+	template<typename ReceiveFn>
+	int read(ReceiveFn receive)
+	{
+		if (head > 0)
+		{
+			// Move the incomplete record to the beginning of the buffer
+			memmove(buffer, buffer + head, tail - head);
+			tail -= head;
+			head = 0;
+		}
+		if (tail == sizeof(buffer))
+		{
+			return 0;
+		}
+		const int n = receive(buffer + tail, sizeof(buffer) - tail);
+		if (n > 0)
+		{
+			tail += n;
+		}
+		return n;
+	}
+
+	/**
+	 * Gets the next complete record.
+	 *
+	 * On success, `body` points to the body of the record, which stays valid until `consume()` or
+	 * `read()` is called. `size` is set to 0 if no complete record is buffered.
+	 */
+	ProtocolError next(uint8_t*& body, size_t& size)
+	{
+		size = 0;
+		if (tail - head < HEADER_SIZE)
+		{
+			return NO_ERROR;
+		}
+		const size_t n = buffer[head] << 8 | buffer[head + 1];
+		if (n > MAX_BODY_SIZE)
+		{
+			return INSUFFICIENT_STORAGE;
+		}
+		if (n == 0 || n % BLOCK_SIZE != 0)
+		{
+			return DECRYPTION_ERROR;
+		}
+		if (tail - head < HEADER_SIZE + n)
+		{
+			return NO_ERROR;
+		}
+		body = buffer + head + HEADER_SIZE;
+		size = n;
+		return NO_ERROR;
+	}
+
+	/**
+	 * Discards the record returned by `next()`.
+	 */
+	void consume()
+	{
+		const size_t n = buffer[head] << 8 | buffer[head + 1];
+		head += HEADER_SIZE + n;
+		if (head == tail)
+		{
+			head = 0;
+			tail = 0;
+		}
+	}
+
+	/**
+	 * Returns the number of buffered bytes.
+	 */
+	size_t available() const
+	{
+		return tail - head;
+	}
+
+private:
+	uint8_t buffer[HEADER_SIZE + max];
+	size_t head;
+	size_t tail;
+};
+
+}}
@@ -143,9 +143,19 @@ ProtocolError Protocol::handle_received_message(Message& message,
 		break;
 
 	case CoAPMessageType::TIME:
+	{
+		// 32-bit timestamp in seconds, optionally followed by a 16-bit millisecond part
+		int millis = -1;
+		if (message.length() >= 12)
+		{
+			millis = queue[10] << 8 | queue[11];
+			if (millis >= 1000)
+				millis = -1;
+		}
 		handle_time_response(
-				queue[6] << 24 | queue[7] << 16 | queue[8] << 8 | queue[9]);
+				queue[6] << 24 | queue[7] << 16 | queue[8] << 8 | queue[9], millis);
 		break;
+	}
 
 	case CoAPMessageType::PING:
 		message.set_length(
@@ -212,14 +222,13 @@ ProtocolError Protocol::handle_key_change(Message& message)
 
 /**
  * Handles the time delivered from the cloud.
+ *
+ * @param time The time in seconds.
+ * @param millis The millisecond part of the time, or -1 if the server provided whole seconds only.
  */
-void Protocol::handle_time_response(uint32_t time)
+void Protocol::handle_time_response(uint32_t time, int millis)
 {
-	// deduct latency
-	//uint32_t latency = last_chunk_millis ? (callbacks.millis()-last_chunk_millis)/2000 : 0;
-	//last_chunk_millis = 0;
-	// todo - compute connection latency
-	timesync_.handle_time_response(time, callbacks.millis(), callbacks.set_time);
+	timesync_.handle_time_response(time, millis, callbacks.millis(), callbacks.set_time);
 }
 
 /**
@@ -237,3 +237,9 @@ int spark_protocol_get_status(ProtocolFacade* protocol, protocol_status* status,
     return protocol->get_status(status);
 }
 
+int spark_protocol_time_sync_quality(ProtocolFacade* protocol, time_sync_quality* quality, void* reserved)
+{
+    ASSERT_ON_SYSTEM_THREAD();
+    return protocol->get_time_sync_quality(quality);
+}
+
@@ -1,27 +1,93 @@
 #pragma once
 
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
 #include "protocol_defs.h"
 #include "service_debug.h"
 
 namespace particle { namespace protocol {
 
+/**
+ * Tracks the time received from the cloud.
+ *
+ * Every response is converted to an estimate of the server time at the moment the response was
+ * received, compensated by half of the request round-trip time. The last few estimates are fitted
+ * with a weighted linear regression against the local millisecond counter, which gives the offset
+ * of the local clock and its drift. Samples with larger round-trip times have a lower weight.
+ *
+ * The drift is used to estimate the accuracy of the local clock and to schedule the next
+ * synchronization before the accumulated error exceeds the target accuracy.
+ */
 class TimeSyncManager
 {
 public:
+    /**
+     * Maximum number of samples used to estimate the drift. The oldest sample is kept until it
+     * reaches `MAX_SAMPLE_AGE`, the others are thinned out as new samples arrive.
+     */
+    static const unsigned MAX_SAMPLES = 8;
+
+    /**
+     * Drift assumed until it has been measured, in parts per million.
+     */
+    static const unsigned DEFAULT_DRIFT_PPM = 100;
+
+    /**
+     * Default target accuracy of the local clock, in milliseconds.
+     */
+    static const system_tick_t DEFAULT_TARGET_ACCURACY = 1000;
+
+    /**
+     * Minimum and maximum interval between two automatic synchronizations, in milliseconds.
+     */
+    static const system_tick_t MIN_SYNC_INTERVAL = 15 * 60 * 1000;
+    static const system_tick_t MAX_SYNC_INTERVAL = 24 * 60 * 60 * 1000;
+
+    /**
+     * Maximum age of the samples used to estimate the drift, in milliseconds.
+     */
+    static const system_tick_t MAX_SAMPLE_AGE = 7 * 24 * 60 * 60 * 1000;
+
+    /**
+     * Time after which a pending request is considered lost, in milliseconds.
+     */
+    static const system_tick_t RESPONSE_TIMEOUT = 60 * 1000;
+
     TimeSyncManager()
         : lastSyncMillis_{0},
           requestSentMillis_{0},
+          firstRequestMillis_{0},
           lastSyncTime_{0},
-          expectingResponse_{false}
+          targetAccuracy_{DEFAULT_TARGET_ACCURACY},
+          expectingResponse_{false},
+          requestUnanswered_{false}
     {
+        clear();
     }
 
     void reset()
     {
         expectingResponse_ = false;
+        requestUnanswered_ = false;
         requestSentMillis_ = 0;
     }
 
+    /**
+     * Discards the collected samples.
+     */
+    void clear()
+    {
+        count_ = 0;
+        head_ = 0;
+        offset_ = 0;
+        offsetError_ = 0;
+        drift_ = 0;
+        driftError_ = 0;
+        nextSyncInterval_ = MIN_SYNC_INTERVAL;
+    }
+
     template <typename Callback>
     bool send_request(system_tick_t mil, Callback send_time_request) {
         if (expectingResponse_) {
@@ -29,21 +95,70 @@ public:
         }
 
         requestSentMillis_ = mil;
+        if (!requestUnanswered_) {
+            firstRequestMillis_ = mil;
+            requestUnanswered_ = true;
+        }
         expectingResponse_ = true;
         LOG(INFO, "Sending TIME request");
         return send_time_request();
     }
 
+    /**
+     * Handles a response from the cloud.
+     *
+     * @param tm Server time in seconds.
+     * @param ms Millisecond part of the server time, or a negative value if the server only
+     *        provides whole seconds.
+     * @param mil Local time at which the response was received.
+     * @param set_time Callback that sets the time. The second argument is the millisecond part of
+     *        the time.
+     */
     template <typename Callback>
-    bool handle_time_response(time_t tm, system_tick_t mil, Callback set_time) {
-        LOG(INFO, "Received TIME response: %lu", (unsigned long)tm);
-        set_time(tm, 0, NULL);
+    bool handle_time_response(time_t tm, int ms, system_tick_t mil, Callback set_time) {
+        system_tick_t rtt = 0;
+        if (requestUnanswered_) {
+            // A request that timed out may still be responded to. If another request was sent in
+            // the meantime, it's not known which one the response is for, so the round-trip time
+            // is measured from the first one. This overestimates the error rather than the precision
+            rtt = mil - firstRequestMillis_;
+        }
+        // The server truncates the time to whole seconds unless it provides the millisecond part
+        int64_t server = (int64_t)tm * 1000 + (ms >= 0 ? ms : 500);
+        const uint32_t resolutionError = (ms >= 0) ? 1 : 500;
+        server += rtt / 2;
+        add_sample(mil, server, rtt / 2 + resolutionError);
+        const int64_t now = server_time(mil);
+        LOG(INFO, "Received TIME response: %lu.%03d, RTT: %u ms, drift: %d ppm", (unsigned long)tm, (ms >= 0) ? ms : 0,
+                (unsigned)rtt, (int)std::lround(drift_ * 1e6));
+        set_time((time_t)(now / 1000), (unsigned)(now % 1000), NULL);
         expectingResponse_ = false;
+        requestUnanswered_ = false;
         lastSyncTime_ = tm;
         lastSyncMillis_ = mil;
+        nextSyncInterval_ = sync_interval();
         return true;
     }
 
+    /**
+     * Requests the time when the next synchronization is due.
+     *
+     * A request that hasn't been responded within `RESPONSE_TIMEOUT` is considered lost.
+     */
+    template <typename Callback>
+    bool process(system_tick_t mil, Callback send_time_request) {
+        if (expectingResponse_) {
+            if (mil - requestSentMillis_ < RESPONSE_TIMEOUT) {
+                return true;
+            }
+            expectingResponse_ = false;
+        }
+        if (!count_ || mil - lastSyncMillis_ < nextSyncInterval_) {
+            return true;
+        }
+        return send_request(mil, send_time_request);
+    }
+
     bool is_request_pending() const {
         return expectingResponse_;
     }
@@ -53,12 +168,203 @@ public:
         return lastSyncMillis_;
     }
 
+    /**
+     * Returns the estimated server time at the specified local time, in milliseconds.
+     */
+    int64_t server_time(system_tick_t mil) const {
+        if (!count_) {
+            return 0;
+        }
+        const Sample& s = samples_[last_index()];
+        const int32_t dt = mil - s.local;
+        const double drift = is_drift_known() ? drift_ : 0;
+        return s.server + dt + (int64_t)std::llround(offset_ + drift * dt);
+    }
+
+    /**
+     * Returns the estimated error of the server time at the specified local time, in milliseconds.
+     */
+    system_tick_t accuracy(system_tick_t mil) const {
+        if (!count_) {
+            return 0;
+        }
+        const double dt = (int32_t)(mil - samples_[last_index()].local);
+        return std::ceil(offsetError_ + std::fabs(dt) * effective_drift());
+    }
+
+    /**
+     * Returns the estimated drift of the local clock, in parts per million.
+     *
+     * A positive value means that the local clock is slow.
+     */
+    double drift_ppm() const {
+        return drift_ * 1e6;
+    }
+
+    /**
+     * Returns `true` if the drift has been measured with sufficient precision.
+     */
+    bool is_drift_known() const {
+        return count_ > 1 && driftError_ * 1e6 <= DEFAULT_DRIFT_PPM / 2;
+    }
+
+    unsigned sample_count() const {
+        return count_;
+    }
+
+    /**
+     * Returns the number of milliseconds until the next automatic synchronization.
+     */
+    system_tick_t next_sync(system_tick_t mil) const {
+        if (!count_) {
+            return 0;
+        }
+        const system_tick_t dt = mil - lastSyncMillis_;
+        return (dt < nextSyncInterval_) ? nextSyncInterval_ - dt : 0;
+    }
+
+    /**
+     * Sets the accuracy that the automatic synchronization aims to maintain, in milliseconds.
+     */
+    void target_accuracy(system_tick_t ms) {
+        targetAccuracy_ = ms;
+        nextSyncInterval_ = sync_interval();
+    }
 
 private:
+    struct Sample {
+        system_tick_t local;
+        int64_t server;
+        uint32_t error; // Maximum error of the server time, in milliseconds
+    };
+
+    Sample samples_[MAX_SAMPLES];
+    unsigned count_;
+    unsigned head_;
+    double offset_; // Correction of the last sample, in milliseconds
+    double offsetError_;
+    double drift_; // Rate of the server clock relative to the local clock, minus 1
+    double driftError_;
+    system_tick_t nextSyncInterval_;
     system_tick_t lastSyncMillis_;
     system_tick_t requestSentMillis_;
+    system_tick_t firstRequestMillis_; // Time of the first request that hasn't been responded to
     time_t lastSyncTime_;
+    system_tick_t targetAccuracy_;
     bool expectingResponse_;
+    bool requestUnanswered_; // Unlike expectingResponse_, not cleared when the request times out
+
+    unsigned last_index() const {
+        return (head_ + count_ - 1) % MAX_SAMPLES;
+    }
+
+    double effective_drift() const {
+        return is_drift_known() ? std::fabs(drift_) + driftError_ : DEFAULT_DRIFT_PPM / 1e6;
+    }
+
+    void add_sample(system_tick_t local, int64_t server, uint32_t error) {
+        if (count_) {
+            // Start over if the sample doesn't agree with the current model, e.g. because the
+            // local clock was stopped or the time was changed on the server
+            const int64_t diff = server - server_time(local);
+            if ((uint64_t)(diff < 0 ? -diff : diff) > (uint64_t)accuracy(local) + error + targetAccuracy_) {
+                LOG(WARN, "Time differs from the estimate by %d ms, discarding %u samples", (int)diff, count_);
+                clear();
+            }
+        }
+        while (count_ > 0 && (system_tick_t)(local - samples_[head_].local) > MAX_SAMPLE_AGE) {
+            head_ = (head_ + 1) % MAX_SAMPLES;
+            --count_;
+        }
+        if (count_ == MAX_SAMPLES) {
+            remove_closest_sample();
+        }
+        Sample& s = samples_[(head_ + count_) % MAX_SAMPLES];
+        s.local = local;
+        s.server = server;
+        s.error = error ? error : 1;
+        ++count_;
+        update_model();
+    }
+
+    // Removes the sample that is closest to its predecessor, keeping the oldest one. This makes
+    // the samples span a longer period of time, which improves the precision of the drift
+    void remove_closest_sample() {
+        unsigned index = 1;
+        system_tick_t minGap = (system_tick_t)-1;
+        for (unsigned i = 1; i < count_ - 1; ++i) {
+            const system_tick_t gap = samples_[(head_ + i) % MAX_SAMPLES].local -
+                    samples_[(head_ + i - 1) % MAX_SAMPLES].local;
+            if (gap < minGap) {
+                minGap = gap;
+                index = i;
+            }
+        }
+        for (unsigned i = index; i < count_ - 1; ++i) {
+            samples_[(head_ + i) % MAX_SAMPLES] = samples_[(head_ + i + 1) % MAX_SAMPLES];
+        }
+        --count_;
+    }
+
+    // Fits the offsets of the samples relative to the last sample with a weighted linear
+    // regression. Each sample is weighted by the inverse square of its error
+    void update_model() {
+        const Sample& last = samples_[last_index()];
+        double sw = 0, sx = 0, sy = 0;
+        for (unsigned i = 0; i < count_; ++i) {
+            const Sample& s = samples_[(head_ + i) % MAX_SAMPLES];
+            const double w = 1.0 / ((double)s.error * s.error);
+            const double x = (int32_t)(s.local - last.local);
+            const double y = (double)(s.server - last.server) - x;
+            sw += w;
+            sx += w * x;
+            sy += w * y;
+        }
+        const double mx = sx / sw;
+        const double my = sy / sw;
+        double sxx = 0, sxy = 0;
+        for (unsigned i = 0; i < count_; ++i) {
+            const Sample& s = samples_[(head_ + i) % MAX_SAMPLES];
+            const double w = 1.0 / ((double)s.error * s.error);
+            const double x = (int32_t)(s.local - last.local) - mx;
+            const double y = (double)(s.server - last.server) - (int32_t)(s.local - last.local) - my;
+            sxx += w * x * x;
+            sxy += w * x * y;
+        }
+        if (count_ > 1 && sxx > 0) {
+            drift_ = sxy / sxx;
+            driftError_ = 1.0 / std::sqrt(sxx);
+        } else {
+            drift_ = 0;
+            driftError_ = 0;
+        }
+        // Value of the fitted line at the last sample
+        offset_ = my - drift_ * mx;
+        offsetError_ = std::sqrt(1.0 / sw + mx * mx * driftError_ * driftError_);
+        if (!is_drift_known() || offsetError_ > last.error) {
+            // Use the last sample alone until the drift is known
+            offset_ = 0;
+            offsetError_ = last.error;
+        }
+    }
+
+    system_tick_t sync_interval() const {
+        if (!count_) {
+            return MIN_SYNC_INTERVAL;
+        }
+        const double margin = (double)targetAccuracy_ - offsetError_;
+        if (margin <= 0) {
+            return MIN_SYNC_INTERVAL;
+        }
+        const double interval = margin / effective_drift();
+        if (interval >= MAX_SYNC_INTERVAL) {
+            return MAX_SYNC_INTERVAL;
+        }
+        if (interval <= MIN_SYNC_INTERVAL) {
+            return MIN_SYNC_INTERVAL;
+        }
+        return (system_tick_t)interval;
+    }
 };
 
 
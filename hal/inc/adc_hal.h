@@ -29,9 +29,35 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "pinmap_hal.h"
+#include <stddef.h>
 
 /* Exported types ------------------------------------------------------------*/
 
+/**
+ * Callback invoked in the interrupt context when a sample buffer is full.
+ *
+ * @param buffer Filled buffer. Samples of all channels are interleaved.
+ * @param samples Number of samples in the buffer.
+ * @param context Callback context.
+ * @return Buffer to fill after the one currently being filled. Returning the filled buffer
+ *         itself discards its samples.
+ */
+typedef int16_t* (*HAL_ADC_Stream_Callback)(int16_t* buffer, size_t samples, void* context);
+
+typedef struct HAL_ADC_Stream_Config {
+    uint16_t size;
+    uint16_t version;
+
+    const pin_t* pins; // Channels sampled on each tick, in this order
+    uint8_t pin_count;
+    uint8_t reserved[3];
+    uint32_t sample_rate; // Ticks per second
+    int16_t* buffers[2]; // Buffers filled one after the other
+    size_t buffer_samples; // Size of each buffer in samples, a multiple of `pin_count`
+    HAL_ADC_Stream_Callback callback;
+    void* context;
+} HAL_ADC_Stream_Config;
+
 /* Exported constants --------------------------------------------------------*/
 
 /* Exported macros -----------------------------------------------------------*/
@@ -43,9 +69,23 @@ extern "C" {
 #endif
 
 void HAL_ADC_Set_Sample_Time(uint8_t ADC_SampleTime);
+/**
+ * Performs a single conversion on the specified pin and returns the result.
+ *
+ * The ADC is owned by the stream while it is running (see `HAL_ADC_Stream_Start()`), and this
+ * function returns 0 without sampling the pin in that case.
+ */
 int32_t HAL_ADC_Read(pin_t pin);
 void HAL_ADC_DMA_Init();
 
+/**
+ * Starts continuous timer-triggered sampling of several channels.
+ *
+ * Returns `SYSTEM_ERROR_INVALID_STATE` if any of the pins is used by another peripheral.
+ */
+int HAL_ADC_Stream_Start(const HAL_ADC_Stream_Config* config, void* reserved);
+void HAL_ADC_Stream_Stop(void* reserved);
+
 #ifdef __cplusplus
 }
 #endif
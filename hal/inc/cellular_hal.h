@@ -206,6 +206,16 @@ cellular_result_t cellular_imsi_to_network_provider(void* reserved);
  */
 CellularNetProvData cellular_network_provider_data_get(void* reserved);
 
+/**
+ * Copies the APN of the cellular network provider currently set to a buffer.
+ *
+ * @param apn Destination buffer. The copied APN is always null-terminated.
+ * @param size Size of the buffer.
+ * @return Length of the APN, which may be larger than the number of copied characters, or a
+ *         negative error code.
+ */
+int cellular_network_provider_apn_get(char* apn, size_t size, void* reserved);
+
 /**
  * Acquires the modem lock.
  */
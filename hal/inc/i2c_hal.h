@@ -77,6 +77,33 @@ typedef struct HAL_I2C_Transmission_Config {
     uint32_t flags;
 } HAL_I2C_Transmission_Config;
 
+/**
+ * Completion callback of an asynchronous transfer. The callback is invoked in the interrupt context.
+ *
+ * @param error 0 on success, `SYSTEM_ERROR_NOT_FOUND` if the address was not acknowledged,
+ *        or `SYSTEM_ERROR_IO` if the data was not acknowledged.
+ */
+typedef void (*HAL_I2C_Transfer_Callback)(int error, void* context);
+
+/**
+ * Asynchronous master transfer. When both buffers are set, the data is written and then read
+ * back after a repeated start condition.
+ */
+typedef struct HAL_I2C_Transfer_Config {
+    uint16_t size;
+    uint16_t version;
+
+    uint8_t address;
+    uint8_t reserved[3];
+    const uint8_t* tx_buffer; // Must be located in RAM on platforms with EasyDMA
+    uint32_t tx_length;
+    uint8_t* rx_buffer;
+    uint32_t rx_length;
+    uint32_t flags; // HAL_I2C_Transmission_Flag
+    HAL_I2C_Transfer_Callback callback;
+    void* context;
+} HAL_I2C_Transfer_Config;
+
 /* Exported constants --------------------------------------------------------*/
 
 /* Exported macros -----------------------------------------------------------*/
@@ -100,6 +127,13 @@ void HAL_I2C_End(HAL_I2C_Interface i2c, void* reserved);
 uint32_t HAL_I2C_Request_Data(HAL_I2C_Interface i2c, uint8_t address, uint8_t quantity, uint8_t stop, void* reserved);
 int32_t HAL_I2C_Request_Data_Ex(HAL_I2C_Interface i2c, const HAL_I2C_Transmission_Config* config, void* reserved);
 void HAL_I2C_Begin_Transmission(HAL_I2C_Interface i2c, uint8_t address, const HAL_I2C_Transmission_Config* config);
+/**
+ * Sends the data buffered since `HAL_I2C_Begin_Transmission()`.
+ *
+ * @return 0 on success, 1 if the transfer couldn't be started, 2 if the address was not
+ *         acknowledged, 3 if the data was not acknowledged, or 5 if the bus was held by an
+ *         asynchronous transfer for longer than the timeout.
+ */
 uint8_t HAL_I2C_End_Transmission(HAL_I2C_Interface i2c, uint8_t stop, void* reserved);
 uint32_t HAL_I2C_Write_Data(HAL_I2C_Interface i2c, uint8_t data, void* reserved);
 int32_t HAL_I2C_Available_Data(HAL_I2C_Interface i2c, void* reserved);
@@ -114,6 +148,18 @@ uint8_t HAL_I2C_Reset(HAL_I2C_Interface i2c, uint32_t reserved, void* reserve1);
 int32_t HAL_I2C_Acquire(HAL_I2C_Interface i2c, void* reserved);
 int32_t HAL_I2C_Release(HAL_I2C_Interface i2c, void* reserved);
 
+/**
+ * Starts an asynchronous master transfer. This function can be called from an interrupt handler.
+ *
+ * @return 0 if the transfer has been started, or `SYSTEM_ERROR_BUSY` if another transfer is in progress.
+ */
+int HAL_I2C_Transfer_Async(HAL_I2C_Interface i2c, const HAL_I2C_Transfer_Config* config, void* reserved);
+/**
+ * Aborts the current asynchronous transfer. The completion callback is not invoked after this
+ * function returns.
+ */
+void HAL_I2C_Transfer_Cancel(HAL_I2C_Interface i2c, void* reserved);
+
 void HAL_I2C_Set_Speed_v1(uint32_t speed);
 void HAL_I2C_Enable_DMA_Mode_v1(bool enable);
 void HAL_I2C_Stretch_Clock_v1(bool stretch);
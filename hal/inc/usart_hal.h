@@ -167,6 +167,20 @@ void HAL_USART_BeginConfig(HAL_USART_Serial serial, uint32_t baud, uint32_t conf
 uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data);
 void HAL_USART_Send_Break(HAL_USART_Serial serial, void* reserved);
 uint8_t HAL_USART_Break_Detected(HAL_USART_Serial serial);
+/**
+ * Returns the received data that is stored contiguously at the front of the receive buffer,
+ * without removing it. The data stays valid until it is consumed. This function doesn't block.
+ *
+ * @return Number of bytes available at `data`, or a negative result code if the platform doesn't
+ *         support direct access to the receive buffer.
+ */
+int32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data, void* reserved);
+/**
+ * Removes up to `size` bytes from the front of the receive buffer.
+ *
+ * @return Number of bytes removed, or a negative result code.
+ */
+int32_t HAL_USART_Consume_Buffer(HAL_USART_Serial serial, size_t size, void* reserved);
 
 ssize_t HAL_USART_Write(HAL_USART_Serial serial, const void* buffer, size_t size, size_t elementSize);
 ssize_t HAL_USART_Read(HAL_USART_Serial serial, void* buffer, size_t size, size_t elementSize);
@@ -30,6 +30,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 /* Exported types ------------------------------------------------------------*/
 
 /* Exported constants --------------------------------------------------------*/
@@ -212,6 +213,33 @@ void HAL_USB_USART_Flush_Data(HAL_USB_USART_Serial serial);
 bool HAL_USB_USART_Is_Enabled(HAL_USB_USART_Serial serial);
 bool HAL_USB_USART_Is_Connected(HAL_USB_USART_Serial serial);
 int32_t HAL_USB_USART_LineCoding_BitRate_Handler(void (*handler)(uint32_t bitRate), void* reserved);
+/**
+ * Copies as much data as fits into the transmit buffer. This function doesn't block.
+ *
+ * @return Number of bytes queued, or a negative result code if the port is not open or the
+ *         platform doesn't support bulk transfers.
+ */
+int32_t HAL_USB_USART_Send_Buffer(HAL_USB_USART_Serial serial, const uint8_t* data, size_t size, void* reserved);
+/**
+ * Reads up to `size` bytes from the receive buffer. This function doesn't block.
+ *
+ * @return Number of bytes read, or a negative result code.
+ */
+int32_t HAL_USB_USART_Receive_Buffer(HAL_USB_USART_Serial serial, uint8_t* data, size_t size, void* reserved);
+/**
+ * Returns the received data that is stored contiguously at the front of the receive buffer,
+ * without removing it. The data stays valid until it is consumed. This function doesn't block.
+ *
+ * @return Number of bytes available at `data`, or a negative result code if the platform doesn't
+ *         support direct access to the receive buffer.
+ */
+int32_t HAL_USB_USART_Peek_Buffer(HAL_USB_USART_Serial serial, const uint8_t** data, void* reserved);
+/**
+ * Removes up to `size` bytes from the front of the receive buffer.
+ *
+ * @return Number of bytes removed, or a negative result code.
+ */
+int32_t HAL_USB_USART_Consume_Buffer(HAL_USB_USART_Serial serial, size_t size, void* reserved);
 #endif
 
 #ifdef USB_HID_ENABLE
@@ -22,6 +22,8 @@
 #include "system_error.h"
 #include "logging.h"
 
+#include "timer_hal.h"
+
 #include "lwiplock.h"
 #include "lwip_util.h"
 
@@ -128,8 +130,24 @@ struct Record { // RFC 1035, 4.1.3
 // Maximum size of a UDP message
 const size_t MAX_MESSAGE_SIZE = 512; // RFC 1035, 2.3.4
 
-// Value of the TTL field sent in all response messages
-const uint32_t DEFAULT_TTL = 0; // Do not cache (RFC 1035, 4.1.3)
+// Maximum number of resolved names kept in the answer cache
+const size_t CACHE_MAX_ENTRIES = 16;
+
+// Time in milliseconds for which a resolved address is cached. LwIP's DNS client doesn't provide
+// the TTL of the upstream answer, so the cache uses a fixed lifetime that is shorter than the TTL
+// of most records
+const system_tick_t CACHE_TTL = 60000;
+
+// Time in milliseconds for which a NXDOMAIN error is cached
+const system_tick_t CACHE_NEGATIVE_TTL = 10000;
+
+// LwIP's DNS client reports a NXDOMAIN response, a response without an address and a timeout in
+// the same way. A timeout is reported only after the query has been retransmitted to the same
+// server DNS_MAX_RETRIES - 1 times, so an error reported earlier than that is an actual answer
+const system_tick_t UPSTREAM_ANSWER_MAX_DELAY = (DNS_MAX_RETRIES - 1) * DNS_TMR_INTERVAL;
+
+// Interval in milliseconds at which the cache statistics are logged
+const system_tick_t STATS_LOG_INTERVAL = 5 * 60 * 1000;
 
 // Timeout for select() in milliseconds
 const unsigned SOCKET_RECV_TIMEOUT = 1000;
@@ -193,7 +211,7 @@ ssize_t writeRecord(char* data, size_t size, const Record& r) {
     Record rr = {};
     rr.type = lwip_htons(r.type);
     rr.cls = lwip_htons(r.cls);
-    rr.ttl = lwip_htons(r.ttl);
+    rr.ttl = lwip_htonl(r.ttl);
     rr.rdlength = lwip_htons(r.rdlength);
     memcpy(data, &rr, sizeof(Record));
     return sizeof(Record);
@@ -300,11 +318,21 @@ uint16_t systemToDnsError(int error) {
 
 } // particle::net::
 
+struct Dns64::Query {
+    sockaddr_in6 srcAddr;
+    Header h;
+    Question q;
+};
+
 struct Dns64::Context {
+    // The cache is accessed only with the lwIP core lock held. The lock is recursive, so it can be
+    // taken in the DNS callback as well
+    Dns64Cache<ip_addr_t, Query> cache;
     ip6_addr_t prefix;
     int sock;
 
     Context() :
+            cache(CACHE_MAX_ENTRIES, CACHE_TTL, CACHE_NEGATIVE_TTL),
             sock(-1) {
     }
 
@@ -315,12 +343,13 @@ struct Dns64::Context {
     }
 };
 
-struct Dns64::Query {
+// Upstream lookup shared by all queries for the same name and type
+struct Dns64::Lookup {
     std::weak_ptr<Context> ctx;
-    sockaddr_in6 srcAddr;
-    Header h;
-    Question q;
-    uint16_t type;
+    CString name;
+    uint16_t qtype; // Requested type
+    uint16_t type; // Type of the address being resolved
+    system_tick_t startTime; // Time when the address was requested from lwIP
 };
 
 int Dns64::init(if_t iface, const ip6_addr_t& prefix, uint16_t port) {
@@ -375,10 +404,17 @@ int Dns64::run() {
         destroy();
         return socketToSystemError(errno);
     }
+    const auto now = HAL_Timer_Get_Milli_Seconds();
+    if (now - lastStatsTime_ >= STATS_LOG_INTERVAL) {
+        const auto s = stats();
+        const unsigned total = s.hits + s.misses + s.coalesced;
+        LOG(TRACE, "Cache hits: %u, misses: %u, coalesced: %u, evictions: %u, hit rate: %u%%", s.hits, s.misses,
+                s.coalesced, s.evictions, total ? (s.hits + s.coalesced) * 100 / total : 0);
+        lastStatsTime_ = now;
+    }
     if (r == 0) {
         return 0;
     }
-    const LwipTcpIpCoreLock lock;
     sockaddr_in6 srcAddr = {};
     socklen_t addrSize = sizeof(srcAddr);
     const ssize_t n = sock_recvfrom(ctx_->sock, buf_.get(), MAX_MESSAGE_SIZE, 0, (sockaddr*)&srcAddr, &addrSize);
@@ -398,34 +434,55 @@ int Dns64::run() {
 }
 
 int Dns64::processQuery(char* data, size_t size, const sockaddr_in6& srcAddr) {
-    // Allocate a query object
-    std::unique_ptr<Query> q(new(std::nothrow) Query());
-    if (!q) {
-        return SYSTEM_ERROR_NO_MEMORY;
-    }
-    q->srcAddr = srcAddr;
-    q->ctx = ctx_;
+    Query q = {};
+    q.srcAddr = srcAddr;
     // Parse the query
     const char* name = nullptr;
-    int ret = parseQuery(data, size, q.get(), &name);
+    int ret = parseQuery(data, size, &q, &name);
     if (ret == 0) {
-        // Perform a DNS lookup
-        q->type = q->q.qtype; // Try getting an address of the requested type first
         ip_addr_t addr = {};
-        ret = getHostByName(name, &addr, q.get());
-        if (ret == GetHostByNameResult::DONE) {
-            ret = sendResponse(addr, name, *q, ctx_.get());
-            if (ret < 0) {
-                LOG_DEBUG(ERROR, "Unable to send response: %d", ret);
+        int error = 0;
+        system_tick_t ttl = 0;
+        LwipTcpIpCoreLock lock;
+        ret = ctx_->cache.lookup(name, q.q.qtype, q, HAL_Timer_Get_Milli_Seconds(), &addr, &error, &ttl);
+        lock.unlock();
+        if (ret == Dns64Cache<ip_addr_t, Query>::CACHED) {
+            DEBUG("Found cached answer: %s", name);
+            if (error < 0) {
+                ret = error;
+            } else {
+                ret = sendResponse(addr, ttl / 1000, name, q, ctx_.get());
+                if (ret < 0) {
+                    LOG_DEBUG(ERROR, "Unable to send response: %d", ret);
+                }
             }
-        } else if (ret == GetHostByNameResult::PENDING) {
-            q.release(); // The query is being processed asynchronously
-        } else {
-            LOG_DEBUG(ERROR, "Unable to resolve hostname: %d", ret);
+        } else if (ret == Dns64Cache<ip_addr_t, Query>::STARTED) {
+            // Perform a DNS lookup
+            std::unique_ptr<Lookup> lookup(new(std::nothrow) Lookup());
+            if (!lookup || !(lookup->name = name)) {
+                completeLookup(name, q.q.qtype, nullptr, SYSTEM_ERROR_NO_MEMORY, ctx_.get());
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+            lookup->ctx = ctx_;
+            lookup->qtype = q.q.qtype;
+            lookup->type = q.q.qtype; // Try getting an address of the requested type first
+            ret = getHostByName(&addr, lookup.get());
+            if (ret == GetHostByNameResult::DONE) {
+                completeLookup(lookup->name, lookup->qtype, &addr, 0, ctx_.get());
+            } else if (ret == GetHostByNameResult::PENDING) {
+                lookup.release(); // The lookup is being processed asynchronously
+            } else {
+                LOG_DEBUG(ERROR, "Unable to resolve hostname: %d", ret);
+                completeLookup(lookup->name, lookup->qtype, nullptr, ret, ctx_.get());
+            }
+            ret = 0;
+        } else if (ret == Dns64Cache<ip_addr_t, Query>::QUEUED) {
+            DEBUG("Lookup is in progress: %s", name);
+            ret = 0;
         }
     }
     if (ret < 0) {
-        const int r = sendErrorResponse(ret, name, *q, ctx_.get());
+        const int r = sendErrorResponse(ret, name, q, ctx_.get());
         if (r < 0) {
             LOG_DEBUG(WARN, "Unable to send error response: %d", r);
         }
@@ -466,7 +523,7 @@ int Dns64::parseQuery(char* data, size_t size, Query* q, const char** name) {
     return 0;
 }
 
-int Dns64::sendResponse(const ip_addr_t& addr, const char* name, const Query& q, Context* ctx) {
+int Dns64::sendResponse(const ip_addr_t& addr, uint32_t ttl, const char* name, const Query& q, Context* ctx) {
     ip_addr_t raddr = {}; // Resolved address
     if (q.q.qtype == Type::AAAA && IP_IS_V4(&addr)) {
         const auto addr6 = transformAddress(*ip_2_ip4(&addr), ctx->prefix);
@@ -503,7 +560,7 @@ int Dns64::sendResponse(const ip_addr_t& addr, const char* name, const Query& q,
     Record r = {};
     r.type = IP_IS_V6(&raddr) ? Type::AAAA : Type::A;
     r.cls = Class::IN;
-    r.ttl = DEFAULT_TTL;
+    r.ttl = ttl;
     r.rdlength = addrSize;
     data += CHECK(writeRecord(data, end - data, r));
     if (end - data < (ptrdiff_t)addrSize) {
@@ -546,10 +603,11 @@ int Dns64::sendErrorResponse(int error, const char* name, const Query& q, Contex
     return 0;
 }
 
-int Dns64::getHostByName(const char* name, ip_addr_t* addr, Query* q) {
-    const uint8_t addrType = (q->type == Type::A) ? LWIP_DNS_ADDRTYPE_IPV4 : LWIP_DNS_ADDRTYPE_IPV6;
+int Dns64::getHostByName(ip_addr_t* addr, Lookup* lookup) {
+    const uint8_t addrType = (lookup->type == Type::A) ? LWIP_DNS_ADDRTYPE_IPV4 : LWIP_DNS_ADDRTYPE_IPV6;
+    lookup->startTime = HAL_Timer_Get_Milli_Seconds();
     LwipTcpIpCoreLock lock; // LwIP's DNS client API is not thread-safe
-    const auto lwipRet = dns_gethostbyname_addrtype(name, addr, Dns64::dnsCallback, q, addrType);
+    const auto lwipRet = dns_gethostbyname_addrtype(lookup->name, addr, Dns64::dnsCallback, lookup, addrType);
     lock.unlock();
     if (lwipRet == ERR_INPROGRESS) {
         return GetHostByNameResult::PENDING;
@@ -559,42 +617,70 @@ int Dns64::getHostByName(const char* name, ip_addr_t* addr, Query* q) {
     return GetHostByNameResult::DONE;
 }
 
-void Dns64::dnsCallback(const char* name, const ip_addr_t* addr, void* data) {
-    DEBUG("dns_found_callback: name: %s, address: %s", name ? name : "NULL", addr ? IPADDR_NTOA(addr) : "NULL");
-    std::unique_ptr<Query> q(static_cast<Query*>(data));
-    if (!name) {
+void Dns64::completeLookup(const char* name, uint16_t qtype, const ip_addr_t* addr, int error, Context* ctx) {
+    spark::Vector<Query> queries;
+    LwipTcpIpCoreLock lock;
+    const int r = ctx->cache.complete(name, qtype, addr ? *addr : ip_addr_t(), error,
+            HAL_Timer_Get_Milli_Seconds(), &queries);
+    lock.unlock();
+    if (r < 0) {
+        LOG_DEBUG(ERROR, "Unable to complete lookup: %d", r);
         return;
     }
-    const auto ctx = q->ctx.lock();
+    // Respond to all queries waiting for this lookup
+    for (const auto& q: queries) {
+        int ret = error;
+        if (ret == 0) {
+            ret = sendResponse(*addr, CACHE_TTL / 1000, name, q, ctx);
+            if (ret < 0) {
+                LOG_DEBUG(ERROR, "Unable to send response: %d", ret);
+            }
+        }
+        if (ret < 0) {
+            ret = sendErrorResponse(ret, name, q, ctx);
+            if (ret < 0) {
+                LOG_DEBUG(WARN, "Unable to send error response: %d", ret);
+            }
+        }
+    }
+}
+
+void Dns64::dnsCallback(const char* name, const ip_addr_t* addr, void* data) {
+    DEBUG("dns_found_callback: name: %s, address: %s", name ? name : "NULL", addr ? IPADDR_NTOA(addr) : "NULL");
+    std::unique_ptr<Lookup> lookup(static_cast<Lookup*>(data));
+    const auto ctx = lookup->ctx.lock();
     if (!ctx) {
         return;
     }
-    int ret = 0;
+    // Use the name stored in the lookup object, so that the cache entry gets completed even if
+    // lwIP doesn't provide the name
     if (addr) {
-        ret = sendResponse(*addr, name, *q, ctx.get());
-    } else if (q->type == Type::AAAA) {
-        q->type = Type::A; // Try getting an IPv4 address
+        completeLookup(lookup->name, lookup->qtype, addr, 0, ctx.get());
+    } else if (name && lookup->type == Type::AAAA) {
+        lookup->type = Type::A; // Try getting an IPv4 address
         ip_addr_t addr = {};
-        ret = getHostByName(name, &addr, q.get());
+        const int ret = getHostByName(&addr, lookup.get());
         if (ret == GetHostByNameResult::DONE) {
-            ret = sendResponse(addr, name, *q, ctx.get());
-            if (ret < 0) {
-                LOG_DEBUG(ERROR, "Unable to send response: %d", ret);
-            }
+            completeLookup(lookup->name, lookup->qtype, &addr, 0, ctx.get());
         } else if (ret == GetHostByNameResult::PENDING) {
-            q.release(); // The query is being processed asynchronously
+            lookup.release(); // The lookup is being processed asynchronously
         } else {
             LOG_DEBUG(ERROR, "Unable to resolve hostname: %d", ret);
+            completeLookup(lookup->name, lookup->qtype, nullptr, ret, ctx.get());
         }
     } else {
-        ret = SYSTEM_ERROR_NOT_FOUND;
+        // Only an actual answer is cached as a negative one, a lost packet shouldn't block the name
+        const bool answered = name && HAL_Timer_Get_Milli_Seconds() - lookup->startTime < UPSTREAM_ANSWER_MAX_DELAY;
+        completeLookup(lookup->name, lookup->qtype, nullptr, answered ? SYSTEM_ERROR_NOT_FOUND : SYSTEM_ERROR_NETWORK, ctx.get());
     }
-    if (ret < 0) {
-        ret = sendErrorResponse(ret, name, *q, ctx.get());
-        if (ret < 0) {
-            LOG_DEBUG(WARN, "Unable to send error response: %d", ret);
-        }
+}
+
+Dns64CacheStats Dns64::stats() const {
+    if (!ctx_) {
+        return Dns64CacheStats();
     }
+    const LwipTcpIpCoreLock lock;
+    return ctx_->cache.stats();
 }
 
 } // particle::net
@@ -20,6 +20,7 @@
 #include "ifapi.h"
 
 #include "runnable.h"
+#include "dns64_cache.h"
 
 #include "lwip/ip_addr.h"
 
@@ -41,6 +42,13 @@ public:
 
     int run() override;
 
+    /**
+     * Returns statistics of the answer cache.
+     *
+     * This method acquires the lwIP core lock.
+     */
+    Dns64CacheStats stats() const;
+
 private:
     enum GetHostByNameResult {
         DONE,
@@ -49,17 +57,20 @@ private:
 
     struct Context;
     struct Query;
+    struct Lookup;
 
     std::shared_ptr<Context> ctx_;
     std::unique_ptr<char[]> buf_;
+    system_tick_t lastStatsTime_ = 0;
 
     int processQuery(char* data, size_t size, const sockaddr_in6& srcAddr);
     static int parseQuery(char* data, size_t size, Query* q, const char** name);
 
-    static int sendResponse(const ip_addr_t& addr, const char* name, const Query& q, Context* ctx);
+    static int sendResponse(const ip_addr_t& addr, uint32_t ttl, const char* name, const Query& q, Context* ctx);
     static int sendErrorResponse(int error, const char* name, const Query& q, Context* ctx);
 
-    static int getHostByName(const char* name, ip_addr_t* addr, Query* q);
+    static int getHostByName(ip_addr_t* addr, Lookup* lookup);
+    static void completeLookup(const char* name, uint16_t qtype, const ip_addr_t* addr, int error, Context* ctx);
 
     static void dnsCallback(const char* name, const ip_addr_t* addr, void* data);
 };
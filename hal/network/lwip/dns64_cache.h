@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_tick_hal.h"
+#include "system_error.h"
+
+#include "spark_wiring_vector.h"
+#include "c_string.h"
+
+#include <strings.h>
+
+namespace particle {
+
+namespace net {
+
+struct Dns64CacheStats {
+    unsigned hits; // Queries answered from the cache
+    unsigned misses; // Queries that required an upstream lookup
+    unsigned coalesced; // Queries attached to an upstream lookup in progress
+    unsigned evictions; // Entries evicted before their expiration
+};
+
+/**
+ * Cache of resolved addresses and in-flight lookups.
+ *
+ * Identical queries received while an upstream lookup is in progress are queued to that lookup
+ * instead of starting a new one. Successful results and NXDOMAIN errors are cached for the
+ * specified time; other errors are never cached.
+ *
+ * This class is not thread-safe.
+ */
+template<typename AddrT, typename WaiterT>
+class Dns64Cache {
+public:
+    enum LookupResult {
+        CACHED = 0, // The result is available in the cache
+        STARTED = 1, // A new upstream lookup needs to be performed
+        QUEUED = 2 // The waiter has been queued to a lookup in progress
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param maxEntries Maximum number of completed entries.
+     * @param ttl Time in milliseconds for which a resolved address is cached.
+     * @param negativeTtl Time in milliseconds for which a NXDOMAIN error is cached.
+     */
+    Dns64Cache(size_t maxEntries, system_tick_t ttl, system_tick_t negativeTtl);
+
+    /**
+     * Looks up a cached result or registers a waiter for the result.
+     *
+     * @param name Host name.
+     * @param type Query type.
+     * @param waiter Waiter object. Only used if the result is not available in the cache.
+     * @param now Current time in milliseconds.
+     * @param addr[out] Resolved address.
+     * @param error[out] Cached error code, or 0 if the address was resolved successfully.
+     * @param ttl[out] Remaining lifetime of the cached entry in milliseconds.
+     * @return One of the `LookupResult` values or a negative error code.
+     */
+    int lookup(const char* name, uint16_t type, const WaiterT& waiter, system_tick_t now, AddrT* addr, int* error,
+            system_tick_t* ttl);
+
+    /**
+     * Completes an upstream lookup.
+     *
+     * @param name Host name.
+     * @param type Query type.
+     * @param addr Resolved address. Ignored if `error` is not 0.
+     * @param error Error code, or 0 if the address was resolved successfully.
+     * @param now Current time in milliseconds.
+     * @param waiters[out] Waiters that need to be notified about the result.
+     * @return 0 on success, or a negative error code.
+     */
+    int complete(const char* name, uint16_t type, const AddrT& addr, int error, system_tick_t now,
+            spark::Vector<WaiterT>* waiters);
+
+    void clear();
+
+    const Dns64CacheStats& stats() const;
+
+private:
+    struct Entry {
+        CString name;
+        spark::Vector<WaiterT> waiters;
+        AddrT addr;
+        system_tick_t time; // Time when the entry was last completed
+        system_tick_t ttl;
+        int error;
+        uint16_t type;
+        bool pending;
+    };
+
+    spark::Vector<Entry> entries_;
+    Dns64CacheStats stats_;
+    size_t maxEntries_;
+    system_tick_t ttl_;
+    system_tick_t negativeTtl_;
+
+    int find(const char* name, uint16_t type, system_tick_t now);
+    int makeRoom(system_tick_t now);
+};
+
+template<typename AddrT, typename WaiterT>
+inline Dns64Cache<AddrT, WaiterT>::Dns64Cache(size_t maxEntries, system_tick_t ttl, system_tick_t negativeTtl) :
+        stats_(),
+        maxEntries_(maxEntries),
+        ttl_(ttl),
+        negativeTtl_(negativeTtl) {
+}
+
+template<typename AddrT, typename WaiterT>
+int Dns64Cache<AddrT, WaiterT>::lookup(const char* name, uint16_t type, const WaiterT& waiter, system_tick_t now,
+        AddrT* addr, int* error, system_tick_t* ttl) {
+    int i = find(name, type, now);
+    if (i >= 0) {
+        auto& e = entries_.at(i);
+        if (!e.pending) {
+            *addr = e.addr;
+            *error = e.error;
+            *ttl = e.ttl - (now - e.time);
+            ++stats_.hits;
+            return LookupResult::CACHED;
+        }
+        if (!e.waiters.append(waiter)) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        ++stats_.coalesced;
+        return LookupResult::QUEUED;
+    }
+    Entry e = {};
+    e.name = name;
+    e.type = type;
+    e.pending = true;
+    if (!e.name || !e.waiters.append(waiter)) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    makeRoom(now);
+    if (!entries_.append(std::move(e))) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    ++stats_.misses;
+    return LookupResult::STARTED;
+}
+
+template<typename AddrT, typename WaiterT>
+int Dns64Cache<AddrT, WaiterT>::complete(const char* name, uint16_t type, const AddrT& addr, int error,
+        system_tick_t now, spark::Vector<WaiterT>* waiters) {
+    int i = find(name, type, now);
+    if (i < 0 || !entries_.at(i).pending) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    auto& e = entries_.at(i);
+    *waiters = std::move(e.waiters);
+    e.waiters = spark::Vector<WaiterT>();
+    if (error == 0 || error == SYSTEM_ERROR_NOT_FOUND) {
+        e.addr = addr;
+        e.error = error;
+        e.time = now;
+        e.ttl = (error == 0) ? ttl_ : negativeTtl_;
+        e.pending = false;
+    } else {
+        entries_.removeAt(i);
+    }
+    return 0;
+}
+
+template<typename AddrT, typename WaiterT>
+inline void Dns64Cache<AddrT, WaiterT>::clear() {
+    entries_.clear();
+}
+
+template<typename AddrT, typename WaiterT>
+inline const Dns64CacheStats& Dns64Cache<AddrT, WaiterT>::stats() const {
+    return stats_;
+}
+
+template<typename AddrT, typename WaiterT>
+int Dns64Cache<AddrT, WaiterT>::find(const char* name, uint16_t type, system_tick_t now) {
+    for (int i = 0; i < entries_.size(); ++i) {
+        const auto& e = entries_.at(i);
+        if (!e.pending && now - e.time >= e.ttl) {
+            continue; // Expired
+        }
+        if (e.type == type && strcasecmp(e.name, name) == 0) {
+            return i;
+        }
+    }
+    return SYSTEM_ERROR_NOT_FOUND;
+}
+
+template<typename AddrT, typename WaiterT>
+int Dns64Cache<AddrT, WaiterT>::makeRoom(system_tick_t now) {
+    // Remove expired entries and count the completed ones
+    size_t count = 0;
+    int oldest = -1;
+    for (int i = 0; i < entries_.size();) {
+        const auto& e = entries_.at(i);
+        if (!e.pending) {
+            if (now - e.time >= e.ttl) {
+                entries_.removeAt(i);
+                continue;
+            }
+            if (oldest < 0 || now - e.time > now - entries_.at(oldest).time) {
+                oldest = i;
+            }
+            ++count;
+        }
+        ++i;
+    }
+    // Evict the oldest completed entry if necessary. Entries with pending lookups are never evicted
+    if (count >= maxEntries_ && oldest >= 0) {
+        entries_.removeAt(oldest);
+        ++stats_.evictions;
+    }
+    return 0;
+}
+
+} // particle::net
+
+} // particle
@@ -35,6 +35,7 @@
 #include "cellular_enums_hal.h"
 
 #include <limits>
+#include <cstring>
 
 namespace {
 
@@ -597,7 +598,33 @@ int cellular_imsi_to_network_provider(void* reserved) {
 }
 
 CellularNetProvData cellular_network_provider_data_get(void* reserved) {
-    return CellularNetProvData();
+    CellularNetProvData data = {};
+    const auto mgr = cellularNetworkManager();
+    if (mgr) {
+        // Settings of the carrier that was used for the last connection attempt. The APN is not
+        // returned since the settings are replaced on every connection attempt, see
+        // cellular_network_provider_apn_get()
+        const NcpClientLock lock(mgr->ncpClient());
+        data.apn = "";
+        data.keepalive = mgr->networkConfig().keepAlive();
+    }
+    return data;
+}
+
+int cellular_network_provider_apn_get(char* apn, size_t size, void* reserved) {
+    CHECK_TRUE(apn || !size, SYSTEM_ERROR_INVALID_ARGUMENT);
+    const auto mgr = cellularNetworkManager();
+    CHECK_TRUE(mgr, SYSTEM_ERROR_UNKNOWN);
+    const NcpClientLock lock(mgr->ncpClient());
+    const auto& conf = mgr->networkConfig();
+    const char* const src = conf.hasApn() ? conf.apn() : "";
+    const size_t n = strlen(src);
+    if (size > 0) {
+        const size_t len = std::min(n, size - 1);
+        memcpy(apn, src, len);
+        apn[len] = '\0';
+    }
+    return n;
 }
 
 int cellular_lock(void* reserved) {
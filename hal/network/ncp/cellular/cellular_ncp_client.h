@@ -36,6 +36,13 @@ struct CellularNcpAuthEvent: CellularNcpEvent {
 
 class CellularNcpClientConfig: public NcpClientConfig {
 public:
+    /**
+     * Default maximum age of the cached signal quality in milliseconds.
+     *
+     * @see `signalMaxAge()`
+     */
+    static const unsigned DEFAULT_SIGNAL_MAX_AGE = 10000;
+
     CellularNcpClientConfig();
 
     CellularNcpClientConfig& simType(SimType type);
@@ -44,9 +51,19 @@ public:
     CellularNcpClientConfig& ncpIdentifier(PlatformNCPIdentifier ident);
     PlatformNCPIdentifier ncpIdentifier() const;
 
+    /**
+     * Set the maximum age of the signal quality and operator information that can be reported
+     * without querying the modem.
+     *
+     * @param age Age in milliseconds. 0 disables the caching.
+     */
+    CellularNcpClientConfig& signalMaxAge(unsigned age);
+    unsigned signalMaxAge() const;
+
 private:
     SimType simType_;
     PlatformNCPIdentifier ident_;
+    unsigned signalMaxAge_;
 };
 
 enum class UbloxSaraUmnoprof {
@@ -125,13 +142,15 @@ public:
     virtual int getCellularGlobalIdentity(CellularGlobalIdentity* cgi) = 0;
     virtual int getIccid(char* buf, size_t size) = 0;
     virtual int getImei(char* buf, size_t size) = 0;
+    virtual int getImsi(char* buf, size_t size) = 0;
     virtual int getSignalQuality(CellularSignalQuality* qual) = 0;
     virtual int setRegistrationTimeout(unsigned timeout) = 0;
 };
 
 inline CellularNcpClientConfig::CellularNcpClientConfig() :
         simType_(SimType::INTERNAL),
-        ident_(PLATFORM_NCP_UNKNOWN) {
+        ident_(PLATFORM_NCP_UNKNOWN),
+        signalMaxAge_(DEFAULT_SIGNAL_MAX_AGE) {
 }
 
 inline CellularNcpClientConfig& CellularNcpClientConfig::simType(SimType type) {
@@ -153,6 +172,15 @@ inline PlatformNCPIdentifier CellularNcpClientConfig::ncpIdentifier() const {
     return ident_;
 }
 
+inline CellularNcpClientConfig& CellularNcpClientConfig::signalMaxAge(unsigned age) {
+    signalMaxAge_ = age;
+    return *this;
+}
+
+inline unsigned CellularNcpClientConfig::signalMaxAge() const {
+    return signalMaxAge_;
+}
+
 // CellularSignalQuality
 
 inline CellularSignalQuality& CellularSignalQuality::accessTechnology(const CellularAccessTechnology& act) {
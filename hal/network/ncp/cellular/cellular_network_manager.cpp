@@ -18,6 +18,7 @@
 #include "cellular_network_manager.h"
 
 #include "cellular_ncp_client.h"
+#include "network_config_db.h"
 
 #include "file_util.h"
 #include "scope_guard.h"
@@ -39,6 +40,35 @@ namespace {
 using namespace control::common;
 
 const auto CONFIG_FILE = "/sys/cellular_config.bin";
+const auto NETWORK_CONFIG_DB_FILE = "/sys/network_config_db.bin";
+
+// Carrier database stored on the filesystem. The caller must hold the filesystem lock
+class FileNetworkConfigDbSource: public NetworkConfigDbSource {
+public:
+    FileNetworkConfigDbSource(filesystem_t* fs, lfs_file_t* file, size_t size) :
+            fs_(fs),
+            file_(file),
+            size_(size) {
+    }
+
+    int read(size_t offset, void* data, size_t size) const override {
+        CHECK_TRUE(offset <= size_ && size <= size_ - offset, SYSTEM_ERROR_OUT_OF_RANGE);
+        int r = lfs_file_seek(&fs_->instance, file_, offset, LFS_SEEK_SET);
+        CHECK_TRUE(r >= 0, SYSTEM_ERROR_FILE);
+        r = lfs_file_read(&fs_->instance, file_, data, size);
+        CHECK_TRUE(r == (int)size, SYSTEM_ERROR_FILE);
+        return 0;
+    }
+
+    size_t size() const override {
+        return size_;
+    }
+
+private:
+    filesystem_t* fs_;
+    lfs_file_t* file_;
+    size_t size_;
+};
 
 struct CellularConfig {
     CellularNetworkConfig intSimConf;
@@ -105,6 +135,38 @@ int loadConfig(CellularConfig* conf) {
     return 0;
 }
 
+// Looks up the network settings in the carrier database stored on the filesystem, which can be
+// updated independently of the firmware, and falls back to the built-in database
+int findNetworkConfigForImsi(const char* imsi, CellularNetworkConfig* conf) {
+    const auto fs = filesystem_get_instance(nullptr);
+    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
+    {
+        fs::FsLock lock(fs);
+        CHECK(filesystem_mount(fs));
+        lfs_info info = {};
+        if (lfs_stat(&fs->instance, NETWORK_CONFIG_DB_FILE, &info) == LFS_ERR_OK && info.type == LFS_TYPE_REG) {
+            lfs_file_t file = {};
+            CHECK(openFile(&file, NETWORK_CONFIG_DB_FILE, LFS_O_RDONLY));
+            SCOPE_GUARD({
+                lfs_file_close(&fs->instance, &file);
+            });
+            const FileNetworkConfigDbSource db(fs, &file, info.size);
+            int r = validateNetworkConfigDb(db);
+            if (r < 0) {
+                LOG(ERROR, "Invalid carrier database: %s (%d)", NETWORK_CONFIG_DB_FILE, r);
+            } else {
+                r = findNetworkConfig(db, imsi, strlen(imsi), conf);
+                if (r != SYSTEM_ERROR_NOT_FOUND) {
+                    return r;
+                }
+            }
+        }
+    }
+    *conf = networkConfigForImsi(imsi, strlen(imsi));
+    CHECK_TRUE(conf->isValid(), SYSTEM_ERROR_NOT_FOUND);
+    return 0;
+}
+
 int saveConfig(const CellularConfig& conf) {
     // Get filesystem instance
     const auto fs = filesystem_get_instance(nullptr);
@@ -179,11 +241,30 @@ CellularNetworkManager::~CellularNetworkManager() {
 int CellularNetworkManager::connect() {
     CellularConfig c;
     CHECK(loadConfig(&c));
-    const CellularNetworkConfig* conf = &c.intSimConf;
-    if (c.activeSim == SimType::EXTERNAL) {
-        conf = &c.extSimConf;
+    auto conf = std::move((c.activeSim == SimType::EXTERNAL) ? c.extSimConf : c.intSimConf);
+    // The IMSI can only be retrieved once the NCP is up
+    CHECK(client_->on());
+    // Look up the carrier settings based on IMSI. If the IMSI cannot be retrieved at this point,
+    // the NCP client will fall back to the built-in database
+    char imsi[32] = {};
+    if (client_->getImsi(imsi, sizeof(imsi)) >= 0) {
+        CellularNetworkConfig dbConf;
+        if (findNetworkConfigForImsi(imsi, &dbConf) == 0) {
+            if (conf.isValid()) {
+                // Keep the user-provided credentials but use the carrier-specific hints
+                dbConf.apn(conf.apn()).user(conf.user()).password(conf.password());
+            }
+            conf = std::move(dbConf);
+        }
+    } else {
+        LOG(WARN, "Unable to get IMSI");
+    }
+    {
+        // networkConfig() may be called from other threads while holding the NCP client lock
+        const NcpClientLock lock(client_);
+        netConf_ = std::move(conf);
     }
-    CHECK(client_->connect(*conf));
+    CHECK(client_->connect(netConf_));
     return 0;
 }
 
@@ -18,6 +18,9 @@
 #pragma once
 
 #include "c_string.h"
+#include "net_hal.h"
+
+#include <cstdint>
 
 namespace particle {
 
@@ -29,6 +32,11 @@ enum class SimType {
     EXTERNAL = 2
 };
 
+enum CellularPowerSavingHint {
+    CELLULAR_POWER_SAVING_HINT_PSM = 0x01, // Network supports PSM
+    CELLULAR_POWER_SAVING_HINT_EDRX = 0x02 // Network supports eDRX
+};
+
 class CellularNetworkConfig {
 public:
     CellularNetworkConfig();
@@ -45,12 +53,31 @@ public:
     const char* password() const;
     bool hasPassword() const;
 
+    // Carrier-specific hints that can be used to speed up network registration
+    CellularNetworkConfig& accessTechnology(hal_net_access_tech_t rat);
+    hal_net_access_tech_t accessTechnology() const;
+
+    // Bit N-1 corresponds to band N
+    CellularNetworkConfig& bands(uint64_t mask);
+    uint64_t bands() const;
+
+    // Cloud keepalive interval in seconds, 0 if not specified
+    CellularNetworkConfig& keepAlive(unsigned interval);
+    unsigned keepAlive() const;
+
+    CellularNetworkConfig& powerSavingHints(unsigned hints);
+    unsigned powerSavingHints() const;
+
     bool isValid() const;
 
 private:
     CString apn_;
     CString user_;
     CString pwd_;
+    uint64_t bands_;
+    hal_net_access_tech_t rat_;
+    unsigned keepAlive_;
+    unsigned psHints_;
 };
 
 class CellularNetworkManager {
@@ -61,6 +88,8 @@ public:
     int connect();
 
     CellularNcpClient* ncpClient() const;
+    // The returned settings are replaced by connect(). Hold the NCP client lock while accessing them
+    const CellularNetworkConfig& networkConfig() const;
 
     static int setNetworkConfig(SimType sim, CellularNetworkConfig conf);
     static int getNetworkConfig(SimType sim, CellularNetworkConfig* conf);
@@ -72,9 +101,14 @@ public:
 
 private:
     CellularNcpClient* client_;
+    CellularNetworkConfig netConf_;
 };
 
-inline CellularNetworkConfig::CellularNetworkConfig() {
+inline CellularNetworkConfig::CellularNetworkConfig() :
+        bands_(0),
+        rat_(NET_ACCESS_TECHNOLOGY_UNKNOWN),
+        keepAlive_(0),
+        psHints_(0) {
 }
 
 inline CellularNetworkConfig& CellularNetworkConfig::apn(const char* apn) {
@@ -116,6 +150,42 @@ inline bool CellularNetworkConfig::hasPassword() const {
     return pwd_ && *pwd_;
 }
 
+inline CellularNetworkConfig& CellularNetworkConfig::accessTechnology(hal_net_access_tech_t rat) {
+    rat_ = rat;
+    return *this;
+}
+
+inline hal_net_access_tech_t CellularNetworkConfig::accessTechnology() const {
+    return rat_;
+}
+
+inline CellularNetworkConfig& CellularNetworkConfig::bands(uint64_t mask) {
+    bands_ = mask;
+    return *this;
+}
+
+inline uint64_t CellularNetworkConfig::bands() const {
+    return bands_;
+}
+
+inline CellularNetworkConfig& CellularNetworkConfig::keepAlive(unsigned interval) {
+    keepAlive_ = interval;
+    return *this;
+}
+
+inline unsigned CellularNetworkConfig::keepAlive() const {
+    return keepAlive_;
+}
+
+inline CellularNetworkConfig& CellularNetworkConfig::powerSavingHints(unsigned hints) {
+    psHints_ = hints;
+    return *this;
+}
+
+inline unsigned CellularNetworkConfig::powerSavingHints() const {
+    return psHints_;
+}
+
 inline bool CellularNetworkConfig::isValid() const {
     return (apn_ && user_ && pwd_);
 }
@@ -124,4 +194,8 @@ inline CellularNcpClient* CellularNetworkManager::ncpClient() const {
     return client_;
 }
 
+inline const CellularNetworkConfig& CellularNetworkManager::networkConfig() const {
+    return netConf_;
+}
+
 } // particle
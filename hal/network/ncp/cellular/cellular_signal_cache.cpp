@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cellular_signal_cache.h"
+
+#include "at_parser.h"
+#include "at_command.h"
+#include "at_response.h"
+
+#include "platform_ncp.h"
+#include "timer_hal.h"
+#include "system_error.h"
+#include "check.h"
+
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define CHECK_PARSER(_expr) \
+        ({ \
+            const auto _r = _expr; \
+            if (_r < 0) { \
+                this->parserError_ = _r; \
+                return _r; \
+            } \
+            _r; \
+        })
+
+#define CHECK_PARSER_OK(_expr) \
+        do { \
+            const auto _r = _expr; \
+            if (_r < 0) { \
+                this->parserError_ = _r; \
+                return _r; \
+            } \
+            if (_r != ::particle::AtResponse::OK) { \
+                return SYSTEM_ERROR_AT_NOT_OK; \
+            } \
+        } while (false)
+
+// Same as CHECK_PARSER() but for use in the static URC handlers
+#define CHECK_PARSER_URC(_expr) \
+        ({ \
+            const auto _r = _expr; \
+            if (_r < 0) { \
+                self->parserError_ = _r; \
+                return _r; \
+            } \
+            _r; \
+        })
+
+namespace particle {
+
+namespace {
+
+inline system_tick_t millis() {
+    return HAL_Timer_Get_Milli_Seconds();
+}
+
+// Number of AT commands sent to query the operator (AT+COPS?) and, once after initialization,
+// to select its numeric format (AT+COPS=3,2)
+const size_t OPERATOR_QUERY_COMMAND_COUNT = 2;
+
+} // unnamed
+
+CellularSignalCache::CellularSignalCache() :
+        parser_(nullptr),
+        handler_(nullptr),
+        handlerData_(nullptr),
+        cgi_(),
+        act_(CellularAccessTechnology::NONE),
+        stats_(),
+        maxAge_(CellularNcpClientConfig::DEFAULT_SIGNAL_MAX_AGE),
+        signalTime_(0),
+        operatorTime_(0),
+        ncpId_(PLATFORM_NCP_UNKNOWN),
+        parserError_(0),
+        signalValid_(false),
+        operatorValid_(false),
+        operatorFormatSet_(false),
+        demand_(false),
+        registered_() {
+}
+
+int CellularSignalCache::init(AtParser* parser, int ncpId, RegistrationHandler handler, void* data) {
+    parser_ = parser;
+    ncpId_ = ncpId;
+    handler_ = handler;
+    handlerData_ = data;
+    cgi_ = CellularGlobalIdentity();
+    operatorFormatSet_ = false;
+    std::fill(registered_, registered_ + sizeof(registered_) / sizeof(registered_[0]), false);
+    invalidate();
+    // NOTE: These URC handlers need to take care of both the URCs and direct responses to the commands.
+    // See CH28408
+    CHECK(parser_->addUrcHandler("+CREG", [](AtResponseReader* reader, const char* prefix, void* data) -> int {
+        return registrationUrcHandler(CellularRegistrationType::CREG, "+CREG", reader, data);
+    }, this));
+    CHECK(parser_->addUrcHandler("+CGREG", [](AtResponseReader* reader, const char* prefix, void* data) -> int {
+        return registrationUrcHandler(CellularRegistrationType::CGREG, "+CGREG", reader, data);
+    }, this));
+    CHECK(parser_->addUrcHandler("+CEREG", [](AtResponseReader* reader, const char* prefix, void* data) -> int {
+        return registrationUrcHandler(CellularRegistrationType::CEREG, "+CEREG", reader, data);
+    }, this));
+    return 0;
+}
+
+int CellularSignalCache::getSignalQuality(CellularSignalQuality* qual) {
+    CHECK_TRUE(qual, SYSTEM_ERROR_INVALID_ARGUMENT);
+    parserError_ = 0;
+    if (isFresh(signalValid_, signalTime_)) {
+        ++stats_.hits;
+        stats_.commandsSaved += OPERATOR_QUERY_COMMAND_COUNT + signalCommandCount();
+        demand_ = true;
+    } else {
+        ++stats_.misses;
+        CHECK(querySignal());
+    }
+    *qual = qual_;
+    return 0;
+}
+
+int CellularSignalCache::getCellularGlobalIdentity(CellularGlobalIdentity* cgi) {
+    CHECK_TRUE(cgi, SYSTEM_ERROR_INVALID_ARGUMENT);
+    parserError_ = 0;
+    if (isFresh(operatorValid_, operatorTime_)) {
+        ++stats_.hits;
+        stats_.commandsSaved += OPERATOR_QUERY_COMMAND_COUNT;
+        demand_ = true;
+    } else {
+        ++stats_.misses;
+        CHECK(queryOperator());
+    }
+    switch (cgi->version)
+    {
+    case CGI_VERSION_1:
+    default:
+    {
+        // Confirm user is expecting the correct amount of data
+        CHECK_TRUE((cgi->size >= sizeof(cgi_)), SYSTEM_ERROR_INVALID_ARGUMENT);
+
+        *cgi = cgi_;
+        cgi->size = sizeof(cgi_);
+        cgi->version = CGI_VERSION_1;
+        break;
+    }
+    }
+    return 0;
+}
+
+int CellularSignalCache::refresh() {
+    parserError_ = 0;
+    if (!demand_ || !signalValid_) {
+        return 0;
+    }
+    // Query the modem when three quarters of the maximum age have passed, so that the readers
+    // polling the snapshot don't have to wait for the modem
+    if (millis() - signalTime_ < maxAge_ - maxAge_ / 4) {
+        return 0;
+    }
+    ++stats_.refreshes;
+    CHECK(querySignal());
+    return 0;
+}
+
+void CellularSignalCache::invalidate() {
+    signalValid_ = false;
+    operatorValid_ = false;
+    demand_ = false;
+}
+
+int CellularSignalCache::querySignal() {
+    demand_ = false;
+    CHECK(queryOperator());
+
+    CellularSignalQuality qual;
+    qual.accessTechnology(act_);
+
+    // Min and max RSRQ index values multiplied by 100
+    // Min: -19.5 and max: -3
+    const int min_rsrq_mul_by_100 = -1950;
+    const int max_rsrq_mul_by_100 = -300;
+
+    if (ncpId_ == PLATFORM_NCP_SARA_R410) {
+        int rsrp;
+        int rsrq_n;
+        unsigned long rsrq_f;
+
+        // Default to 255 in case RSRP/Q are not found
+        qual.strength(255);
+        qual.quality(255);
+
+        // Set UCGED to mode 5 for RSRP/RSRQ values on R410M
+        CHECK_PARSER_OK(execCommand("AT+UCGED=5"));
+        ++stats_.commandsSent;
+        auto resp = parser_->sendCommand("AT+UCGED?");
+
+        int val;
+        unsigned long val2;
+        while (resp.hasNextLine()) {
+            char type = 0;
+            const int r = CHECK_PARSER(resp.scanf("+RSR%c: %*d,%*d,\"%d.%lu\"", &type, &val, &val2));
+            if (r >= 2) {
+                if (type == 'P') {
+                    rsrp = val;
+                    if (rsrp < -141 && rsrp >= -200) {
+                        qual.strength(0);
+                    } else if (rsrp >= -44 && rsrp <=0) {
+                        qual.strength(97);
+                    } else if (rsrp >= -141 && rsrp < -44) {
+                        qual.strength(rsrp + 140);
+                    } else {
+                        // If RSRP is not in the expected range
+                        qual.strength(255);
+                    }
+                } else if (type == 'Q' && r == 3) {
+                    rsrq_n = val;
+                    rsrq_f = val2;
+                    int rsrq_mul_100 = rsrq_n * 100 - rsrq_f;
+                    if (rsrq_mul_100 < min_rsrq_mul_by_100 && rsrq_mul_100 >= -2000) {
+                        qual.quality(0);
+                    } else if (rsrq_mul_100 >= max_rsrq_mul_by_100 && rsrq_mul_100 <=0) {
+                        qual.quality(34);
+                    } else if (rsrq_mul_100 >= min_rsrq_mul_by_100 && rsrq_mul_100 < max_rsrq_mul_by_100) {
+                        qual.quality((rsrq_mul_100 + 2000)/50);
+                    } else {
+                        // If RSRQ is not in the expected range
+                        qual.quality(255);
+                    }
+                }
+            }
+        }
+
+        const int r = CHECK_PARSER(resp.readResult());
+        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+
+    } else {
+        int rxlev, rxqual;
+        ++stats_.commandsSent;
+        auto resp = parser_->sendCommand("AT+CSQ");
+        int r = CHECK_PARSER(resp.scanf("+CSQ: %d,%d", &rxlev, &rxqual));
+        CHECK_TRUE(r == 2, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+        r = CHECK_PARSER(resp.readResult());
+        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+
+        // Fixup values
+        switch (qual.strengthUnits()) {
+            case CellularStrengthUnits::RXLEV: {
+                qual.strength((rxlev != 99) ? (2 * rxlev) : rxlev);
+                break;
+            }
+            case CellularStrengthUnits::RSCP: {
+                qual.strength((rxlev != 99) ? (3 + 2 * rxlev) : 255);
+                break;
+            }
+            case CellularStrengthUnits::RSRP: {
+                qual.strength((rxlev != 99) ? (rxlev * 97) / 31 : 255);
+                break;
+            }
+            default: {
+                // Do nothing
+                break;
+            }
+        }
+
+        if (qual.accessTechnology() == CellularAccessTechnology::GSM_EDGE) {
+            qual.qualityUnits(CellularQualityUnits::MEAN_BEP);
+        }
+
+        switch (qual.qualityUnits()) {
+            case CellularQualityUnits::RXQUAL:
+            case CellularQualityUnits::MEAN_BEP: {
+                qual.quality(rxqual);
+                break;
+            }
+            case CellularQualityUnits::ECN0: {
+                qual.quality((rxqual != 99) ? std::min((7 + (7 - rxqual) * 6), 44) : 255);
+                break;
+            }
+            case CellularQualityUnits::RSRQ: {
+                qual.quality((rxqual != 99) ? (rxqual * 34) / 7 : 255);
+                break;
+            }
+            default: {
+                // Do nothing
+                break;
+            }
+        }
+    }
+
+    qual_ = qual;
+    signalTime_ = millis();
+    signalValid_ = true;
+    return 0;
+}
+
+int CellularSignalCache::queryOperator() {
+    int act;
+    char mobileCountryCode[4] = {0};
+    char mobileNetworkCode[4] = {0};
+
+    if (!operatorFormatSet_) {
+        // Reformat the operator string to be numeric
+        // (allows the capture of `mcc` and `mnc`)
+        CHECK_PARSER_OK(execCommand("AT+COPS=3,2"));
+        operatorFormatSet_ = true;
+    } else {
+        ++stats_.commandsSaved;
+    }
+
+    ++stats_.commandsSent;
+    auto resp = parser_->sendCommand("AT+COPS?");
+    const int n = CHECK_PARSER(resp.scanf("+COPS: %*d,%*d,\"%3[0-9]%3[0-9]\",%d", mobileCountryCode,
+                                          mobileNetworkCode, &act));
+    const int r = CHECK_PARSER(resp.readResult());
+    if (n != 3) {
+        // The modem may have reverted to the default format, e.g. after a reset
+        operatorFormatSet_ = false;
+        return SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED;
+    }
+    CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+
+    // Preserve digit format data
+    const int mnc_digits = ::strnlen(mobileNetworkCode, sizeof(mobileNetworkCode));
+    CHECK_TRUE((2 == mnc_digits || 3 == mnc_digits), SYSTEM_ERROR_BAD_DATA);
+
+    switch (static_cast<CellularAccessTechnology>(act)) {
+        case CellularAccessTechnology::NONE:
+        case CellularAccessTechnology::GSM:
+        case CellularAccessTechnology::GSM_COMPACT:
+        case CellularAccessTechnology::UTRAN:
+        case CellularAccessTechnology::GSM_EDGE:
+        case CellularAccessTechnology::UTRAN_HSDPA:
+        case CellularAccessTechnology::UTRAN_HSUPA:
+        case CellularAccessTechnology::UTRAN_HSDPA_HSUPA:
+        case CellularAccessTechnology::LTE:
+        case CellularAccessTechnology::EC_GSM_IOT:
+        case CellularAccessTechnology::E_UTRAN: {
+            break;
+        }
+        default: {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+    }
+
+    if (2 == mnc_digits) {
+        cgi_.cgi_flags |= CGI_FLAG_TWO_DIGIT_MNC;
+    } else {
+        cgi_.cgi_flags &= ~CGI_FLAG_TWO_DIGIT_MNC;
+    }
+
+    // `atoi` returns zero on error, which is an invalid `mcc` and `mnc`
+    cgi_.mobile_country_code = static_cast<uint16_t>(::atoi(mobileCountryCode));
+    cgi_.mobile_network_code = static_cast<uint16_t>(::atoi(mobileNetworkCode));
+
+    act_ = static_cast<CellularAccessTechnology>(act);
+    operatorTime_ = millis();
+    operatorValid_ = true;
+    return 0;
+}
+
+int CellularSignalCache::execCommand(const char* cmd) {
+    ++stats_.commandsSent;
+    return parser_->execCommand(cmd);
+}
+
+bool CellularSignalCache::isFresh(bool valid, system_tick_t time) const {
+    return valid && millis() - time < maxAge_;
+}
+
+size_t CellularSignalCache::signalCommandCount() const {
+    // AT+UCGED=5 and AT+UCGED? on R410, AT+CSQ otherwise
+    return (ncpId_ == PLATFORM_NCP_SARA_R410) ? 2 : 1;
+}
+
+void CellularSignalCache::registrationUpdated(CellularRegistrationType type, bool registered, int fields,
+        unsigned lac, unsigned ci) {
+    using LacType = decltype(CellularGlobalIdentity::location_area_code);
+    using CidType = decltype(CellularGlobalIdentity::cell_id);
+
+    ++stats_.registrationUpdates;
+    // Cellular Global Identity (partial)
+    const auto newLac = fields >= 2 ? static_cast<LacType>(lac) : std::numeric_limits<LacType>::max();
+    const auto newCi = fields >= 3 ? static_cast<CidType>(ci) : std::numeric_limits<CidType>::max();
+    bool& reg = registered_[(int)type];
+    if (reg != registered || cgi_.location_area_code != newLac || cgi_.cell_id != newCi) {
+        // The operator, access technology and signal quality may have changed as well
+        reg = registered;
+        invalidate();
+    }
+    cgi_.location_area_code = newLac;
+    cgi_.cell_id = newCi;
+    if (handler_) {
+        handler_(type, registered, handlerData_);
+    }
+}
+
+// +CREG: <stat>[,<lac>,<ci>[,<AcTStatus>]]
+// n={0,1} +CGREG: <stat>
+// n=2     +CGREG: <stat>[,<lac>,<ci>[,<AcT>,<rac>]]
+// +CEREG: <stat>[,[<tac>],[<ci>],[<AcT>][,<cause_type>,<reject_cause>[,[<Active_Time>],[<Periodic_TAU>]]]]
+int CellularSignalCache::registrationUrcHandler(CellularRegistrationType type, const char* prefix,
+        AtResponseReader* reader, void* data) {
+    const auto self = (CellularSignalCache*)data;
+    unsigned int val[4] = {};
+    char atResponse[64] = {};
+    // Take a copy of AT response for multi-pass scanning
+    CHECK_PARSER_URC(reader->readLine(atResponse, sizeof(atResponse)));
+    const size_t prefixLen = strlen(prefix);
+    CHECK_TRUE(strncmp(atResponse, prefix, prefixLen) == 0 && atResponse[prefixLen] == ':',
+            SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+    const char* const args = atResponse + prefixLen + 1;
+    // Parse response ignoring mode (replicate URC response)
+    int r = ::sscanf(args, " %*u,%u,\"%x\",\"%x\",%u", &val[0], &val[1], &val[2], &val[3]);
+    // Reparse URC as direct response
+    if (0 >= r) {
+        r = CHECK(::sscanf(args, " %u,\"%x\",\"%x\",%u", &val[0], &val[1], &val[2], &val[3]));
+    }
+    CHECK_TRUE(r >= 1, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+    // Home network or roaming
+    const bool registered = (val[0] == 1 || val[0] == 5);
+    self->registrationUpdated(type, registered, r, val[1], val[2]);
+    return 0;
+}
+
+} // particle
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "cellular_ncp_client.h"
+
+#include "system_tick_hal.h"
+
+#include <cstdint>
+
+namespace particle {
+
+class AtParser;
+class AtResponseReader;
+
+/**
+ * Network registration status reported by the modem.
+ */
+enum class CellularRegistrationType {
+    CREG = 0, ///< Circuit switched (`+CREG`)
+    CGREG = 1, ///< GPRS (`+CGREG`)
+    CEREG = 2 ///< EPS (`+CEREG`)
+};
+
+/**
+ * Signal cache counters.
+ */
+struct CellularSignalCacheStats {
+    uint32_t hits; // Requests served from the cache
+    uint32_t misses; // Requests that had to query the modem
+    uint32_t refreshes; // Background refreshes
+    uint32_t registrationUpdates; // Registration URCs and responses
+    uint32_t commandsSent; // AT commands sent to the modem
+    uint32_t commandsSaved; // AT commands that would have been sent without the cache
+};
+
+/**
+ * Snapshot of the operator, signal quality and registration state of a u-blox modem.
+ *
+ * The registration state and the serving cell are updated from the `+CREG`, `+CGREG` and
+ * `+CEREG` URCs. The operator and signal quality are queried from the modem when they are
+ * older than `maxAge()` or when a registration URC reports a different cell, and are served
+ * from the snapshot otherwise. While the snapshot is being read regularly, `refresh()` updates
+ * it in the background before it expires.
+ *
+ * The class is not thread-safe.
+ */
+class CellularSignalCache {
+public:
+    typedef void(*RegistrationHandler)(CellularRegistrationType type, bool registered, void* data);
+
+    CellularSignalCache();
+
+    /**
+     * Registers the URC handlers and discards the snapshot.
+     *
+     * The handler is called every time the modem reports the registration state.
+     */
+    int init(AtParser* parser, int ncpId, RegistrationHandler handler, void* data);
+
+    void maxAge(system_tick_t age);
+    system_tick_t maxAge() const;
+
+    int getSignalQuality(CellularSignalQuality* qual);
+    int getCellularGlobalIdentity(CellularGlobalIdentity* cgi);
+
+    /**
+     * Queries the modem if the snapshot has been read since the last query and is about to expire.
+     *
+     * This method is meant to be called periodically from the event loop.
+     */
+    int refresh();
+
+    void invalidate();
+
+    /**
+     * Returns the parser error that caused the last operation to fail, or 0.
+     */
+    int parserError() const;
+
+    CellularSignalCacheStats stats() const;
+    void resetStats();
+
+private:
+    AtParser* parser_;
+    RegistrationHandler handler_;
+    void* handlerData_;
+    CellularGlobalIdentity cgi_;
+    CellularSignalQuality qual_;
+    CellularAccessTechnology act_;
+    CellularSignalCacheStats stats_;
+    system_tick_t maxAge_;
+    system_tick_t signalTime_;
+    system_tick_t operatorTime_;
+    int ncpId_;
+    int parserError_;
+    bool signalValid_;
+    bool operatorValid_;
+    bool operatorFormatSet_;
+    bool demand_;
+    bool registered_[3];
+
+    int querySignal();
+    int queryOperator();
+    int execCommand(const char* cmd);
+    bool isFresh(bool valid, system_tick_t time) const;
+    size_t signalCommandCount() const;
+    void registrationUpdated(CellularRegistrationType type, bool registered, int fields, unsigned lac, unsigned ci);
+
+    static int registrationUrcHandler(CellularRegistrationType type, const char* prefix, AtResponseReader* reader, void* data);
+};
+
+inline void CellularSignalCache::maxAge(system_tick_t age) {
+    maxAge_ = age;
+}
+
+inline system_tick_t CellularSignalCache::maxAge() const {
+    return maxAge_;
+}
+
+inline int CellularSignalCache::parserError() const {
+    return parserError_;
+}
+
+inline CellularSignalCacheStats CellularSignalCache::stats() const {
+    return stats_;
+}
+
+inline void CellularSignalCache::resetStats() {
+    stats_ = CellularSignalCacheStats();
+}
+
+} // particle
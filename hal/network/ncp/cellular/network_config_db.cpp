@@ -19,49 +19,150 @@
 
 #include "cellular_network_manager.h"
 
+#include "system_error.h"
+#include "check.h"
+
+#include <algorithm>
 #include <cstring>
 
 namespace particle {
 
 namespace {
 
-struct NetworkConfig {
-    const char* mcc;
-    const char* mnc;
-    const char* apn;
-    const char* user;
-    const char* password;
-};
+// Generated by tools/network_config_db.py
+#include "network_config_db_data.inc"
 
-const NetworkConfig NETWORK_CONFIG[] = {
-    { "214", "07", "spark.telefonica.com", "", "" }, // Telefonica
-    { "310", "410", "10569.mcs", "", "" }, // Kore/AT&T
-    { "204", "04", "vfd1.korem2m.com", "kore", "kore" } // Kore/Vodafone
-};
+const size_t MCC_SIZE = 3;
+const size_t MAX_STRING_SIZE = 64;
 
-const size_t NETWORK_CONFIG_SIZE = sizeof(NETWORK_CONFIG) / sizeof(NETWORK_CONFIG[0]);
+uint32_t updateCrc32(uint32_t crc, const uint8_t* data, size_t size) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (unsigned j = 0; j < 8; ++j) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
 
-const size_t MCC_SIZE = 3;
+int parseDigits(const char* str, size_t count, unsigned* val) {
+    unsigned v = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char c = str[i];
+        if (c < '0' || c > '9') {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        v = v * 10 + (c - '0');
+    }
+    *val = v;
+    return 0;
+}
+
+int readString(const NetworkConfigDbSource& db, const NetworkConfigDbHeader& header, uint16_t offs, CString* str) {
+    const size_t stringsOffs = sizeof(NetworkConfigDbHeader) + header.entryCount * sizeof(NetworkConfigDbEntry);
+    CHECK_TRUE(offs < header.stringsSize, SYSTEM_ERROR_BAD_DATA);
+    char buf[MAX_STRING_SIZE] = {};
+    const size_t n = std::min<size_t>(header.stringsSize - offs, sizeof(buf));
+    CHECK(db.read(stringsOffs + offs, buf, n));
+    const auto end = (const char*)memchr(buf, '\0', n);
+    CHECK_TRUE(end, SYSTEM_ERROR_BAD_DATA);
+    *str = CString(buf, end - buf);
+    return 0;
+}
+
+// Returns the index of the matching entry or SYSTEM_ERROR_NOT_FOUND
+int findEntry(const NetworkConfigDbSource& db, const NetworkConfigDbHeader& header, uint32_t plmn,
+        NetworkConfigDbEntry* entry) {
+    size_t first = 0;
+    size_t last = header.entryCount;
+    while (first < last) {
+        const size_t mid = first + (last - first) / 2;
+        CHECK(db.read(sizeof(NetworkConfigDbHeader) + mid * sizeof(NetworkConfigDbEntry), entry, sizeof(NetworkConfigDbEntry)));
+        if (entry->plmn == plmn) {
+            return mid;
+        }
+        if (entry->plmn < plmn) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return SYSTEM_ERROR_NOT_FOUND;
+}
 
 } // unnamed
 
-CellularNetworkConfig networkConfigForImsi(const char* imsi, size_t size) {
-    if (size < MCC_SIZE) {
-        return CellularNetworkConfig();
+MemoryNetworkConfigDbSource::MemoryNetworkConfigDbSource(const uint8_t* data, size_t size) :
+        data_(data),
+        size_(size) {
+}
+
+int MemoryNetworkConfigDbSource::read(size_t offset, void* data, size_t size) const {
+    CHECK_TRUE(offset <= size_ && size <= size_ - offset, SYSTEM_ERROR_OUT_OF_RANGE);
+    memcpy(data, data_ + offset, size);
+    return 0;
+}
+
+size_t MemoryNetworkConfigDbSource::size() const {
+    return size_;
+}
+
+int validateNetworkConfigDb(const NetworkConfigDbSource& db) {
+    NetworkConfigDbHeader header = {};
+    CHECK(db.read(0, &header, sizeof(header)));
+    CHECK_TRUE(header.magic == NETWORK_CONFIG_DB_MAGIC, SYSTEM_ERROR_BAD_DATA);
+    CHECK_TRUE(header.version == NETWORK_CONFIG_DB_VERSION, SYSTEM_ERROR_NOT_SUPPORTED);
+    const size_t size = sizeof(header) + header.entryCount * sizeof(NetworkConfigDbEntry) + header.stringsSize;
+    CHECK_TRUE(size == db.size(), SYSTEM_ERROR_BAD_DATA);
+    uint32_t crc = 0;
+    uint8_t buf[64];
+    for (size_t offs = sizeof(header); offs < size;) {
+        const size_t n = std::min(size - offs, sizeof(buf));
+        CHECK(db.read(offs, buf, n));
+        crc = updateCrc32(crc, buf, n);
+        offs += n;
     }
-    for (size_t i = 0; i < NETWORK_CONFIG_SIZE; ++i) {
-        const NetworkConfig& conf = NETWORK_CONFIG[i];
-        if (strncmp(imsi, conf.mcc, MCC_SIZE) == 0) {
-            const size_t mncSize = strlen(conf.mnc);
-            if (size < MCC_SIZE + mncSize) {
-                return CellularNetworkConfig();
-            }
-            if (strncmp(imsi + MCC_SIZE, conf.mnc, mncSize) == 0) {
-                return CellularNetworkConfig().apn(conf.apn).user(conf.user).password(conf.password);
-            }
+    CHECK_TRUE(crc == header.crc32, SYSTEM_ERROR_BAD_DATA);
+    return 0;
+}
+
+int findNetworkConfig(const NetworkConfigDbSource& db, const char* imsi, size_t size, CellularNetworkConfig* conf) {
+    unsigned mcc = 0;
+    CHECK_TRUE(size >= MCC_SIZE, SYSTEM_ERROR_NOT_FOUND);
+    CHECK(parseDigits(imsi, MCC_SIZE, &mcc));
+    NetworkConfigDbHeader header = {};
+    CHECK(db.read(0, &header, sizeof(header)));
+    NetworkConfigDbEntry entry = {};
+    int r = SYSTEM_ERROR_NOT_FOUND;
+    // A given MCC uses either 2- or 3-digit MNCs, so it's safe to try both lengths
+    for (unsigned mncDigits = 3; mncDigits >= 2 && r == SYSTEM_ERROR_NOT_FOUND; --mncDigits) {
+        unsigned mnc = 0;
+        if (size < MCC_SIZE + mncDigits || parseDigits(imsi + MCC_SIZE, mncDigits, &mnc) < 0) {
+            continue;
         }
+        r = findEntry(db, header, networkConfigDbPlmn(mcc, mnc, mncDigits), &entry);
+    }
+    CHECK(r);
+    CString apn, user, pwd;
+    CHECK(readString(db, header, entry.apn, &apn));
+    CHECK(readString(db, header, entry.user, &user));
+    CHECK(readString(db, header, entry.password, &pwd));
+    *conf = CellularNetworkConfig().apn(apn).user(user).password(pwd)
+            .accessTechnology((hal_net_access_tech_t)entry.rat)
+            .bands(entry.bands)
+            .keepAlive(entry.keepAlive)
+            .powerSavingHints(entry.powerSavingHints);
+    return 0;
+}
+
+CellularNetworkConfig networkConfigForImsi(const char* imsi, size_t size) {
+    const MemoryNetworkConfigDbSource db(NETWORK_CONFIG_DB_DATA, sizeof(NETWORK_CONFIG_DB_DATA));
+    CellularNetworkConfig conf;
+    if (findNetworkConfig(db, imsi, size, &conf) < 0) {
+        return CellularNetworkConfig();
     }
-    return CellularNetworkConfig();
+    return conf;
 }
 
 } // particle
@@ -18,11 +18,95 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 namespace particle {
 
 class CellularNetworkConfig;
 
+/**
+ * Carrier database format.
+ *
+ * The database consists of a header, an array of fixed-size entries sorted by their PLMN key and
+ * a table of null-terminated strings referenced by the entries. All fields are little endian.
+ * The database is generated from a CSV file by the `tools/network_config_db.py` script.
+ */
+const uint32_t NETWORK_CONFIG_DB_MAGIC = 0x42444e43; // "CNDB"
+const uint16_t NETWORK_CONFIG_DB_VERSION = 1;
+
+struct __attribute__((packed)) NetworkConfigDbHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entryCount;
+    uint32_t stringsSize;
+    uint32_t crc32; // CRC-32 of the entries and strings
+};
+
+struct __attribute__((packed)) NetworkConfigDbEntry {
+    uint32_t plmn; // See networkConfigDbPlmn()
+    uint16_t apn; // Offsets in the string table
+    uint16_t user;
+    uint16_t password;
+    uint8_t rat; // hal_net_access_tech_t
+    uint8_t powerSavingHints; // CellularPowerSavingHint flags
+    uint16_t keepAlive; // Seconds
+    uint16_t reserved;
+    uint64_t bands; // Bit N-1 corresponds to band N
+};
+
+static_assert(sizeof(NetworkConfigDbHeader) == 16, "Unexpected size of NetworkConfigDbHeader");
+static_assert(sizeof(NetworkConfigDbEntry) == 24, "Unexpected size of NetworkConfigDbEntry");
+
+/**
+ * Readable storage of a carrier database.
+ */
+class NetworkConfigDbSource {
+public:
+    virtual ~NetworkConfigDbSource() = default;
+
+    virtual int read(size_t offset, void* data, size_t size) const = 0;
+    virtual size_t size() const = 0;
+};
+
+/**
+ * Carrier database stored in memory-mapped flash.
+ */
+class MemoryNetworkConfigDbSource: public NetworkConfigDbSource {
+public:
+    MemoryNetworkConfigDbSource(const uint8_t* data, size_t size);
+
+    int read(size_t offset, void* data, size_t size) const override;
+    size_t size() const override;
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+/**
+ * Returns a packed PLMN key. Keys of a database are sorted in ascending order, which makes them
+ * ordered by MCC first.
+ */
+inline uint32_t networkConfigDbPlmn(unsigned mcc, unsigned mnc, unsigned mncDigits) {
+    return ((uint32_t)mcc << 12) | ((uint32_t)(mncDigits & 0x03) << 10) | (mnc & 0x03ff);
+}
+
+/**
+ * Validates the header and the checksum of a carrier database.
+ */
+int validateNetworkConfigDb(const NetworkConfigDbSource& db);
+
+/**
+ * Looks up the network settings for the specified IMSI. Both 2- and 3-digit MNCs are supported.
+ *
+ * Returns 0 on success, `SYSTEM_ERROR_NOT_FOUND` if there's no matching entry, or another
+ * negative error code on failure.
+ */
+int findNetworkConfig(const NetworkConfigDbSource& db, const char* imsi, size_t size, CellularNetworkConfig* conf);
+
+/**
+ * Looks up the network settings for the specified IMSI in the built-in database.
+ */
 CellularNetworkConfig networkConfigForImsi(const char* imsi, size_t size);
 
 } // particle
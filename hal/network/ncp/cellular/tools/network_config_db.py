@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation, either
+# version 3 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, see <http://www.gnu.org/licenses/>.
+#
+
+# Generates a carrier database from a CSV file. See network_config_db.h for the format description.
+#
+# Usage:
+#   network_config_db.py network_config_db.csv --inc ../network_config_db_data.inc
+#   network_config_db.py network_config_db.csv --bin network_config_db.bin
+#
+# The binary file can be written to /sys/network_config_db.bin on the device's filesystem, in which
+# case it takes precedence over the built-in database.
+
+import argparse
+import csv
+import struct
+import sys
+import zlib
+
+MAGIC = 0x42444e43 # "CNDB"
+VERSION = 1
+
+HEADER_FORMAT = '<IHHII'
+ENTRY_FORMAT = '<IHHHBBHHQ'
+
+# hal_net_access_tech_t
+RAT = {
+    'default': 0,
+    'gsm': 2,
+    'umts': 4,
+    'lte': 6,
+    'lte_cat_m1': 8,
+    'lte_cat_nb1': 9
+}
+
+# CellularPowerSavingHint
+POWER_SAVING = {
+    'psm': 0x01,
+    'edrx': 0x02
+}
+
+MAX_STRING_SIZE = 63
+
+def plmn_key(mcc, mnc):
+    if len(mcc) != 3 or not mcc.isdigit():
+        raise ValueError('Invalid MCC: {}'.format(mcc))
+    if len(mnc) not in (2, 3) or not mnc.isdigit():
+        raise ValueError('Invalid MNC: {}'.format(mnc))
+    return (int(mcc) << 12) | (len(mnc) << 10) | int(mnc)
+
+class StringTable:
+    def __init__(self):
+        self.data = bytearray()
+        self.offsets = {}
+
+    def add(self, s):
+        if len(s) > MAX_STRING_SIZE:
+            raise ValueError('String is too long: {}'.format(s))
+        offs = self.offsets.get(s)
+        if offs is None:
+            offs = len(self.data)
+            self.data += s.encode('ascii') + b'\0'
+            self.offsets[s] = offs
+        return offs
+
+def parse_flags(s, names):
+    flags = 0
+    for name in s.split():
+        flags |= names[name.lower()]
+    return flags
+
+def parse_bands(s):
+    mask = 0
+    for band in s.split():
+        n = int(band)
+        if n < 1 or n > 64:
+            raise ValueError('Invalid band: {}'.format(band))
+        mask |= 1 << (n - 1)
+    return mask
+
+def load_csv(path):
+    entries = {}
+    strings = StringTable()
+    with open(path, newline='') as f:
+        rows = csv.reader(row for row in f if row.strip() and not row.startswith('#'))
+        for row in rows:
+            row = [c.strip() for c in row] + [''] * (10 - len(row))
+            mcc, mnc, apn, user, pwd, rat, bands, keepalive, ps = row[:9]
+            key = plmn_key(mcc, mnc)
+            if key in entries:
+                raise ValueError('Duplicate entry: {}{}'.format(mcc, mnc))
+            entries[key] = struct.pack(ENTRY_FORMAT, key, strings.add(apn), strings.add(user), strings.add(pwd),
+                    RAT[(rat or 'default').lower()], parse_flags(ps, POWER_SAVING), int(keepalive or 0), 0,
+                    parse_bands(bands))
+    if len(entries) > 0xffff or len(strings.data) > 0xffff:
+        raise ValueError('Database is too large')
+    data = b''.join(entries[k] for k in sorted(entries)) + bytes(strings.data)
+    header = struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(entries), len(strings.data), zlib.crc32(data) & 0xffffffff)
+    return header + data
+
+def write_inc(path, db):
+    with open(path, 'w') as f:
+        f.write('// This file is generated by tools/network_config_db.py, do not edit\n\n')
+        f.write('const uint8_t NETWORK_CONFIG_DB_DATA[] __attribute__((aligned(4))) = {\n')
+        for i in range(0, len(db), 12):
+            f.write('    ' + ' '.join('0x{:02x},'.format(b) for b in db[i:i + 12]) + '\n')
+        f.write('};\n')
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate a carrier database')
+    parser.add_argument('csv', help='source CSV file')
+    parser.add_argument('--inc', help='generate a C++ source file with the built-in database')
+    parser.add_argument('--bin', help='generate a binary database file')
+    args = parser.parse_args()
+    if not args.inc and not args.bin:
+        parser.error('No output file specified')
+    db = load_csv(args.csv)
+    if args.inc:
+        write_inc(args.inc, db)
+    if args.bin:
+        with open(args.bin, 'wb') as f:
+            f.write(db)
+
+if __name__ == '__main__':
+    try:
+        main()
+    except (ValueError, KeyError, IOError) as e:
+        sys.stderr.write('Error: {}\n'.format(e))
+        sys.exit(1)
@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "wifi_network_manager.h"
+
+#include "system_error.h"
+#include "system_tick_hal.h"
+
+#include "spark_wiring_vector.h"
+
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+namespace particle {
+
+namespace detail {
+
+/**
+ * Write-through cache of the configured networks and the connection logic of `WifiNetworkManager`.
+ *
+ * The list of networks is kept in the most recently used order. Connecting to a network first
+ * tries the access point that was used last time, and scans for the available access points only
+ * if that fails.
+ *
+ * The backend provides the following methods:
+ *
+ * - `int load(spark::Vector<WifiNetworkConfig>* networks)`: loads the list of networks
+ * - `int save(const spark::Vector<WifiNetworkConfig>& networks)`: saves the list of networks
+ * - `system_tick_t millis()`
+ * - `void lock()` and `void unlock()`: protect the cache. The cache is not locked while the
+ *   client is connecting or scanning
+ *
+ * The client provides the `connect()`, `scan()` and `getNetworkInfo()` methods of `WifiNcpClient`.
+ */
+template<typename BackendT>
+class WifiNetworkCache {
+public:
+    // Signal strength, in dBm, that an access point loses in the ranking for each recent failure
+    // of its network
+    static const int FAILURE_PENALTY = 10;
+    static const unsigned MAX_PENALIZED_FAILURES = 3;
+
+    // Maximum number of scan results that are considered
+    static const int MAX_SCAN_RESULTS = 20;
+
+    template<typename... ArgsT>
+    explicit WifiNetworkCache(ArgsT&&... args) :
+            backend_(std::forward<ArgsT>(args)...),
+            loaded_(false) {
+    }
+
+    /**
+     * Connects to a configured network. If `ssid` is null, connects to any configured network.
+     */
+    template<typename ClientT>
+    int connect(ClientT* client, const char* ssid) {
+        // Copy the settings, so that the cache can be used while the client is busy
+        spark::Vector<WifiNetworkConfig> networks;
+        spark::Vector<WifiNetworkStats> stats;
+        backend_.lock();
+        int r = load();
+        if (r == 0) {
+            if (ssid) {
+                const int index = indexOf(ssid);
+                if (index >= 0) {
+                    r = (networks.append(configs_.at(index)) && stats.append(stats_.at(index))) ? 0 :
+                            SYSTEM_ERROR_NO_MEMORY;
+                }
+            } else {
+                networks = configs_;
+                stats = stats_;
+                if (networks.size() != configs_.size() || stats.size() != stats_.size()) {
+                    r = SYSTEM_ERROR_NO_MEMORY;
+                }
+            }
+        }
+        backend_.unlock();
+        if (r < 0) {
+            return r;
+        }
+        if (networks.isEmpty()) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        // Try the access point of the most recently used network first
+        const WifiNetworkConfig& last = networks.first();
+        if (last.bssid() != INVALID_MAC_ADDRESS) {
+            const system_tick_t t = backend_.millis();
+            r = client->connect(last.ssid(), last.bssid(), last.security(), last.credentials());
+            if (r == 0) {
+                WifiNetworkInfo info;
+                info.bssid(last.bssid());
+                client->getNetworkInfo(&info);
+                connected(last.ssid(), info.bssid(), last.security(), info.channel(), info.rssi(), t, true);
+                return 0;
+            }
+            failed(last.ssid(), true);
+        }
+        // Scan for the access points and try them in the order of their rank. A typical scan fits
+        // in the inline storage of the vectors and doesn't allocate memory for them
+        ScanResults aps;
+        r = client->scan([](WifiScanResult result, void* data) -> int {
+            const auto aps = (ScanResults*)data;
+            if (aps->size() < MAX_SCAN_RESULTS && !aps->append(std::move(result))) {
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+            return 0;
+        }, &aps);
+        if (r < 0) {
+            return r;
+        }
+        spark::SmallVector<Candidate, MAX_CONFIGURED_WIFI_NETWORK_COUNT> candidates;
+        for (int i = 0; i < aps.size(); ++i) {
+            const int index = indexOf(aps.at(i).ssid(), networks);
+            if (index >= 0 && !candidates.append(Candidate{ i, index, score(aps.at(i), stats.at(index)) })) {
+                return SYSTEM_ERROR_NO_MEMORY;
+            }
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [&stats](const Candidate& c1, const Candidate& c2) {
+            if (c1.score != c2.score) {
+                return c1.score > c2.score;
+            }
+            return latency(stats.at(c1.network)) < latency(stats.at(c2.network));
+        });
+        for (const Candidate& c: candidates) {
+            const WifiScanResult& ap = aps.at(c.ap);
+            const WifiNetworkConfig& network = networks.at(c.network);
+            const system_tick_t t = backend_.millis();
+            r = client->connect(network.ssid(), ap.bssid(), network.security(), network.credentials());
+            if (r == 0) {
+                connected(network.ssid(), ap.bssid(), ap.security(), ap.channel(), ap.rssi(), t, false);
+                return 0;
+            }
+            failed(network.ssid(), false);
+        }
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+
+    int setNetworkConfig(WifiNetworkConfig conf) {
+        if (!conf.ssid()) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        backend_.lock();
+        int r = load();
+        if (r == 0) {
+            int index = indexOf(conf.ssid());
+            if (index < 0) {
+                // Add a new network or replace the last network in the list
+                if (configs_.size() < (int)MAX_CONFIGURED_WIFI_NETWORK_COUNT &&
+                        (!configs_.resize(configs_.size() + 1) || !stats_.resize(configs_.size()))) {
+                    r = SYSTEM_ERROR_NO_MEMORY;
+                    loaded_ = false;
+                } else {
+                    index = configs_.size() - 1;
+                    stats_[index] = WifiNetworkStats();
+                }
+            }
+            if (r == 0) {
+                configs_[index] = std::move(conf);
+                r = save();
+            }
+        }
+        backend_.unlock();
+        return r;
+    }
+
+    int getNetworkConfig(const char* ssid, WifiNetworkConfig* conf) {
+        if (!ssid || !conf) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        backend_.lock();
+        int r = load();
+        if (r == 0) {
+            const int index = indexOf(ssid);
+            if (index < 0) {
+                r = SYSTEM_ERROR_NOT_FOUND;
+            } else {
+                *conf = configs_.at(index);
+            }
+        }
+        backend_.unlock();
+        return r;
+    }
+
+    int getNetworkConfig(WifiNetworkManager::GetNetworkConfigCallback callback, void* data) {
+        spark::Vector<WifiNetworkConfig> networks;
+        backend_.lock();
+        int r = load();
+        if (r == 0) {
+            networks = configs_;
+            if (networks.size() != configs_.size()) {
+                r = SYSTEM_ERROR_NO_MEMORY;
+            }
+        }
+        backend_.unlock();
+        if (r < 0) {
+            return r;
+        }
+        // The callback is invoked without holding the lock
+        for (int i = 0; i < networks.size(); ++i) {
+            r = callback(std::move(networks[i]), data);
+            if (r < 0) {
+                return r;
+            }
+        }
+        return 0;
+    }
+
+    int getNetworkStats(const char* ssid, WifiNetworkStats* stats) {
+        if (!ssid || !stats) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        backend_.lock();
+        int r = load();
+        if (r == 0) {
+            const int index = indexOf(ssid);
+            if (index < 0) {
+                r = SYSTEM_ERROR_NOT_FOUND;
+            } else {
+                *stats = stats_.at(index);
+            }
+        }
+        backend_.unlock();
+        return r;
+    }
+
+    void removeNetworkConfig(const char* ssid) {
+        if (!ssid) {
+            return;
+        }
+        backend_.lock();
+        if (load() == 0) {
+            const int index = indexOf(ssid);
+            if (index >= 0) {
+                configs_.removeAt(index);
+                stats_.removeAt(index);
+                save();
+            }
+        }
+        backend_.unlock();
+    }
+
+    void clearNetworkConfig() {
+        backend_.lock();
+        configs_.clear();
+        stats_.clear();
+        loaded_ = true;
+        save();
+        backend_.unlock();
+    }
+
+    bool hasNetworkConfig() {
+        backend_.lock();
+        const bool has = (load() == 0 && !configs_.isEmpty());
+        backend_.unlock();
+        return has;
+    }
+
+    /**
+     * Discards the cached settings. They are loaded again on the next access.
+     */
+    void invalidate() {
+        backend_.lock();
+        loaded_ = false;
+        backend_.unlock();
+    }
+
+    BackendT& backend() {
+        return backend_;
+    }
+
+private:
+    struct Candidate {
+        int ap; // Index of the scan result
+        int network; // Index of the network settings
+        int score;
+    };
+
+    // Scan results collected when connecting to a network
+    typedef spark::SmallVector<WifiScanResult, 10> ScanResults;
+
+    // Network settings and their statistics, in the same order
+    spark::Vector<WifiNetworkConfig> configs_;
+    spark::Vector<WifiNetworkStats> stats_;
+    mutable BackendT backend_;
+    bool loaded_;
+
+    // Called with the cache locked
+    int load() {
+        if (loaded_) {
+            return 0;
+        }
+        spark::Vector<WifiNetworkConfig> configs;
+        const int r = backend_.load(&configs);
+        if (r < 0) {
+            return r;
+        }
+        // Keep the statistics of the networks that were cached before
+        spark::Vector<WifiNetworkStats> stats;
+        if (!stats.resize(configs.size())) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        for (int i = 0; i < configs.size(); ++i) {
+            const int index = indexOf(configs.at(i).ssid());
+            if (index >= 0 && index < stats_.size()) {
+                stats[i] = stats_.at(index);
+            }
+        }
+        configs_ = std::move(configs);
+        stats_ = std::move(stats);
+        loaded_ = true;
+        return 0;
+    }
+
+    // Called with the cache locked
+    int save() {
+        const int r = backend_.save(configs_);
+        if (r < 0) {
+            // Reload the settings on the next access
+            loaded_ = false;
+        }
+        return r;
+    }
+
+    // Updates the settings and statistics of a network after a successful connection
+    void connected(const char* ssid, const MacAddress& bssid, WifiSecurity sec, int channel, int rssi,
+            system_tick_t startTime, bool direct) {
+        const uint32_t latency = backend_.millis() - startTime;
+        backend_.lock();
+        if (load() == 0) {
+            const int index = indexOf(ssid);
+            if (index >= 0) {
+                WifiNetworkStats& st = stats_[index];
+                ++st.connections;
+                if (direct) {
+                    ++st.directConnections;
+                }
+                st.consecutiveFailures = 0;
+                st.lastLatency = latency;
+                st.avgLatency = st.avgLatency ? (st.avgLatency * 3 + latency) / 4 : latency;
+                st.channel = channel;
+                st.rssi = rssi;
+                bool update = false;
+                WifiNetworkConfig& conf = configs_[index];
+                if (conf.bssid() != bssid && bssid != INVALID_MAC_ADDRESS) {
+                    conf.bssid(bssid);
+                    update = true;
+                }
+                if (conf.security() != sec) {
+                    conf.security(sec);
+                    update = true;
+                }
+                if (index != 0) {
+                    // Move the network to the beginning of the list
+                    configs_.prepend(configs_.takeAt(index));
+                    stats_.prepend(stats_.takeAt(index));
+                    update = true;
+                }
+                if (update) {
+                    save();
+                }
+            }
+        }
+        backend_.unlock();
+    }
+
+    void failed(const char* ssid, bool direct) {
+        backend_.lock();
+        if (load() == 0) {
+            const int index = indexOf(ssid);
+            if (index >= 0) {
+                WifiNetworkStats& st = stats_[index];
+                if (direct) {
+                    // The access point may have changed, which is not a failure of the network
+                    ++st.directFailures;
+                } else {
+                    ++st.failures;
+                    ++st.consecutiveFailures;
+                }
+            }
+        }
+        backend_.unlock();
+    }
+
+    int indexOf(const char* ssid) const {
+        return indexOf(ssid, configs_);
+    }
+
+    static int indexOf(const char* ssid, const spark::Vector<WifiNetworkConfig>& networks) {
+        for (int i = 0; i < networks.size(); ++i) {
+            if (strcmp(ssid, networks.at(i).ssid()) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    static int score(const WifiScanResult& ap, const WifiNetworkStats& stats) {
+        return ap.rssi() - FAILURE_PENALTY * (int)std::min(stats.consecutiveFailures, (uint32_t)MAX_PENALIZED_FAILURES);
+    }
+
+    static uint32_t latency(const WifiNetworkStats& stats) {
+        // Networks that were never connected to are ranked after the known ones
+        return stats.connections ? stats.avgLatency : (uint32_t)-1;
+    }
+};
+
+} // particle::detail
+
+} // particle
@@ -16,6 +16,7 @@
  */
 
 #include "wifi_network_manager.h"
+#include "wifi_network_cache.h"
 
 #include "wifi_ncp_client.h"
 
@@ -23,10 +24,11 @@
 #include "logging.h"
 #include "scope_guard.h"
 #include "check.h"
+#include "timer_hal.h"
 
 #include "spark_wiring_vector.h"
 
-#include <algorithm>
+#include <mutex>
 
 // FIXME: Move nanopb utilities to a common header file
 #include "../../../system/src/control/common.h"
@@ -161,20 +163,34 @@ int saveConfig(const Vector<WifiNetworkConfig>& networks) {
     return 0;
 }
 
-int networkIndexForSsid(const char* ssid, const Vector<WifiNetworkConfig>& networks) {
-    for (int i = 0; i < networks.size(); ++i) {
-        if (strcmp(ssid, networks.at(i).ssid()) == 0) {
-            return i;
-        }
+// Backend of the network cache. The settings are stored in a file
+class WifiConfigFile {
+public:
+    int load(Vector<WifiNetworkConfig>* networks) {
+        return loadConfig(networks);
     }
-    return -1;
-}
 
-void sortByRssi(Vector<WifiScanResult>* scanResults) {
-    std::sort(scanResults->begin(), scanResults->end(), [](const WifiScanResult& ap1, const WifiScanResult& ap2) {
-        return (ap1.rssi() > ap2.rssi()); // In descending order
-    });
-}
+    int save(const Vector<WifiNetworkConfig>& networks) {
+        return saveConfig(networks);
+    }
+
+    system_tick_t millis() {
+        return HAL_Timer_Get_Milli_Seconds();
+    }
+
+    void lock() {
+        mutex_.lock();
+    }
+
+    void unlock() {
+        mutex_.unlock();
+    }
+
+private:
+    std::mutex mutex_;
+};
+
+detail::WifiNetworkCache<WifiConfigFile> g_networkCache;
 
 } // unnamed
 
@@ -186,160 +202,35 @@ WifiNetworkManager::~WifiNetworkManager() {
 }
 
 int WifiNetworkManager::connect(const char* ssid) {
-    // Get known networks
-    Vector<WifiNetworkConfig> networks;
-    CHECK(loadConfig(&networks));
-    int index = 0;
-    if (ssid) {
-        // Find network with the given SSID
-        for (; index < networks.size(); ++index) {
-            if (strcmp(networks.at(index).ssid(), ssid) == 0) {
-                break;
-            }
-        }
-    }
-    if (index == networks.size()) {
-        return SYSTEM_ERROR_NOT_FOUND;
-    }
-    // Connect to the network
-    bool updateConfig = false;
-    auto network = &networks.at(index);
-    // Always perform a network scan for now, because ESP32 doesn't support 802.11v/k/r
-#if 0
-    int r = client_->connect(network->ssid(), network->bssid(), network->security(), network->credentials());
-#else
-    int r = SYSTEM_ERROR_INTERNAL;
-#endif
-    if (r < 0) {
-        // Perform network scan
-        Vector<WifiScanResult> scanResults;
-        CHECK_TRUE(scanResults.reserve(10), SYSTEM_ERROR_NO_MEMORY);
-        CHECK(client_->scan([](WifiScanResult result, void* data) -> int {
-            auto scanResults = (Vector<WifiScanResult>*)data;
-            CHECK_TRUE(scanResults->append(std::move(result)), SYSTEM_ERROR_NO_MEMORY);
-            return 0;
-        }, &scanResults));
-        // Sort discovered networks by RSSI
-        sortByRssi(&scanResults);
-        // Try to connect to any known network among the discovered ones
-        bool connected = false;
-        for (const auto& ap: scanResults) {
-            if (!ssid) {
-                index = 0;
-                for (; index < networks.size(); ++index) {
-                    network = &networks.at(index);
-                    if (strcmp(network->ssid(), ap.ssid()) == 0) {
-                        break;
-                    }
-                }
-                if (index == networks.size()) {
-                    continue;
-                }
-            } else if (strcmp(ssid, ap.ssid()) != 0) {
-                continue;
-            }
-            r = client_->connect(network->ssid(), ap.bssid(), network->security(), network->credentials());
-            if (r == 0) {
-                if (network->bssid() != ap.bssid()) {
-                    // Update BSSID
-                    network->bssid(ap.bssid());
-                    updateConfig = true;
-                }
-                connected = true;
-                break;
-            }
-        }
-        if (!connected) {
-            return SYSTEM_ERROR_NOT_FOUND;
-        }
-    } else if (network->bssid() == INVALID_MAC_ADDRESS) {
-        // Update BSSID
-        WifiNetworkInfo info;
-        r = client_->getNetworkInfo(&info);
-        if (r == 0) {
-            network->bssid(info.bssid());
-            updateConfig = true;
-        }
-    }
-    if (index != 0) {
-        // Move the network to the beginning of the list
-        auto network = networks.takeAt(index);
-        networks.prepend(std::move(network));
-        updateConfig = true;
-    }
-    if (updateConfig) {
-        saveConfig(networks);
-    }
-    return 0;
+    return g_networkCache.connect(client_, ssid);
 }
 
 int WifiNetworkManager::setNetworkConfig(WifiNetworkConfig conf) {
-    CHECK_TRUE(conf.ssid(), SYSTEM_ERROR_INVALID_ARGUMENT);
-    Vector<WifiNetworkConfig> networks;
-    CHECK(loadConfig(&networks));
-    int index = networkIndexForSsid(conf.ssid(), networks);
-    if (index < 0) {
-        // Add a new network or replace the last network in the list
-        if (networks.size() < (int)MAX_CONFIGURED_WIFI_NETWORK_COUNT) {
-            CHECK_TRUE(networks.resize(networks.size() + 1), SYSTEM_ERROR_NO_MEMORY);
-        }
-        index = networks.size() - 1;
-    }
-    networks[index] = std::move(conf);
-    CHECK(saveConfig(networks));
-    return 0;
+    return g_networkCache.setNetworkConfig(std::move(conf));
 }
 
 int WifiNetworkManager::getNetworkConfig(const char* ssid, WifiNetworkConfig* conf) {
-    // TODO: Cache the list of networks
-    CHECK_TRUE(ssid, SYSTEM_ERROR_INVALID_ARGUMENT);
-    Vector<WifiNetworkConfig> networks;
-    CHECK(loadConfig(&networks));
-    const int index = networkIndexForSsid(ssid, networks);
-    if (index < 0) {
-        return SYSTEM_ERROR_NOT_FOUND;
-    }
-    *conf = std::move(networks[index]);
-    return 0;
+    return g_networkCache.getNetworkConfig(ssid, conf);
 }
 
 int WifiNetworkManager::getNetworkConfig(GetNetworkConfigCallback callback, void* data) {
-    Vector<WifiNetworkConfig> networks;
-    CHECK(loadConfig(&networks));
-    for (int i = 0; i < networks.size(); ++i) {
-        const int ret = callback(std::move(networks[i]), data);
-        if (ret < 0) {
-            return ret;
-        }
-    }
-    return 0;
+    return g_networkCache.getNetworkConfig(callback, data);
 }
 
 void WifiNetworkManager::removeNetworkConfig(const char* ssid) {
-    Vector<WifiNetworkConfig> networks;
-    if (loadConfig(&networks) < 0) {
-        return;
-    }
-    const int index = networkIndexForSsid(ssid, networks);
-    if (index < 0) {
-        return;
-    }
-    networks.removeAt(index);
-    saveConfig(networks);
+    g_networkCache.removeNetworkConfig(ssid);
 }
 
 void WifiNetworkManager::clearNetworkConfig() {
-    Vector<WifiNetworkConfig> networks;
-    saveConfig(networks);
+    g_networkCache.clearNetworkConfig();
 }
 
 bool WifiNetworkManager::hasNetworkConfig() {
-    Vector<WifiNetworkConfig> networks;
-    const int r = loadConfig(&networks);
-    if (r < 0) {
-        return false;
-    }
-    return !networks.isEmpty();
+    return g_networkCache.hasNetworkConfig();
+}
+
+int WifiNetworkManager::getNetworkStats(const char* ssid, WifiNetworkStats* stats) {
+    return g_networkCache.getNetworkStats(ssid, stats);
 }
 
 } // particle
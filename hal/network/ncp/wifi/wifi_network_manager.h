@@ -138,6 +138,21 @@ private:
 
 typedef int(*WifiScanCallback)(WifiScanResult result, void* data);
 
+/**
+ * Connection statistics of a configured network. The statistics are not persisted.
+ */
+struct WifiNetworkStats {
+    uint32_t connections; // Successful connection attempts
+    uint32_t failures; // Failed connection attempts after a scan
+    uint32_t consecutiveFailures; // Failed attempts since the last successful one
+    uint32_t directConnections; // Connections to the last used access point made without a scan
+    uint32_t directFailures; // Failed attempts to connect to the last used access point
+    uint32_t lastLatency; // Duration of the last successful attempt, in milliseconds
+    uint32_t avgLatency; // Moving average of the duration of the successful attempts
+    int channel; // Channel of the last used access point
+    int rssi; // Signal strength of the last used access point
+};
+
 class WifiNetworkManager {
 public:
     typedef int(*GetNetworkConfigCallback)(WifiNetworkConfig conf, void* data);
@@ -154,6 +169,7 @@ public:
     static void removeNetworkConfig(const char* ssid);
     static void clearNetworkConfig();
     static bool hasNetworkConfig();
+    static int getNetworkStats(const char* ssid, WifiNetworkStats* stats);
 
     WifiNcpClient* ncpClient() const;
 
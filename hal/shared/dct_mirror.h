@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_tick_hal.h"
+#include "system_error.h"
+
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * DCT mirror counters.
+ */
+struct DctMirrorStats {
+    uint32_t reads; // Reads served from RAM
+    uint32_t writes; // Writes that changed the data
+    uint32_t unchangedWrites; // Writes that didn't change the data and were not committed
+    uint32_t loads; // Times the data was loaded from the storage
+    uint32_t commits; // Writes to the storage
+    uint32_t committedBytes; // Bytes written to the storage
+    system_tick_t loadTime; // Time spent loading the data, in milliseconds
+    system_tick_t lastCommitTime; // Duration of the last commit
+    system_tick_t maxCommitTime; // Longest commit
+    system_tick_t totalCommitTime; // Time spent committing the data
+};
+
+namespace detail {
+
+/**
+ * RAM copy of the DCT.
+ *
+ * The data is loaded from the storage on first access and all reads are served from RAM. Writes
+ * update the copy and extend the dirty range, which is then written to the storage in a single
+ * commit: immediately, or when the outermost update started with `beginUpdate()` ends. Writes
+ * that don't change the data are not committed at all.
+ *
+ * If a commit fails, the copy is discarded and is loaded again on next access, so that it never
+ * diverges from the storage.
+ *
+ * The backend provides the following methods:
+ *
+ * - `int load(uint8_t* data, size_t size)`: reads the entire DCT, initializing the storage if
+ *   necessary
+ * - `int store(size_t offset, const uint8_t* data, size_t size)`: writes a range of the DCT and
+ *   commits it atomically
+ * - `system_tick_t millis()`: returns the current time
+ *
+ * The class is not thread-safe.
+ */
+template<typename BackendT, size_t Size>
+class DctMirror {
+public:
+    static const size_t SIZE = Size;
+
+    template<typename... ArgsT>
+    explicit DctMirror(ArgsT&&... args) :
+            backend_(std::forward<ArgsT>(args)...),
+            stats_(),
+            dirtyBegin_(Size),
+            dirtyEnd_(0),
+            updates_(0),
+            loaded_(false) {
+    }
+
+    int read(size_t offset, uint8_t* data, size_t size) {
+        if (offset > Size || size > Size - offset) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        const int ret = load();
+        if (ret < 0) {
+            return ret;
+        }
+        memcpy(data, data_ + offset, size);
+        ++stats_.reads;
+        return 0;
+    }
+
+    int write(size_t offset, const uint8_t* data, size_t size) {
+        if (offset > Size || size > Size - offset) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        const int ret = load();
+        if (ret < 0) {
+            return ret;
+        }
+        if (memcmp(data_ + offset, data, size) == 0) {
+            ++stats_.unchangedWrites;
+            return 0;
+        }
+        memcpy(data_ + offset, data, size);
+        markDirty(offset, size);
+        ++stats_.writes;
+        return updates_ ? 0 : flush();
+    }
+
+    int fill(uint8_t value) {
+        const int ret = load();
+        if (ret < 0) {
+            return ret;
+        }
+        memset(data_, value, Size);
+        markDirty(0, Size);
+        return updates_ ? 0 : flush();
+    }
+
+    /**
+     * Defers the commits until the matching `endUpdate()`.
+     *
+     * Updates can be nested.
+     */
+    void beginUpdate() {
+        ++updates_;
+    }
+
+    /**
+     * Commits the changes made since the outermost `beginUpdate()`.
+     */
+    int endUpdate() {
+        if (updates_ > 0 && --updates_ > 0) {
+            return 0;
+        }
+        return flush();
+    }
+
+    int flush() {
+        if (dirtyBegin_ >= dirtyEnd_) {
+            return 0;
+        }
+        const size_t offs = dirtyBegin_;
+        const size_t size = dirtyEnd_ - dirtyBegin_;
+        dirtyBegin_ = Size;
+        dirtyEnd_ = 0;
+        const auto t = backend_.millis();
+        const int ret = backend_.store(offs, data_ + offs, size);
+        if (ret < 0) {
+            // Load the data again on next access
+            loaded_ = false;
+            return ret;
+        }
+        const auto dt = backend_.millis() - t;
+        ++stats_.commits;
+        stats_.committedBytes += size;
+        stats_.lastCommitTime = dt;
+        stats_.maxCommitTime = std::max(stats_.maxCommitTime, dt);
+        stats_.totalCommitTime += dt;
+        return 0;
+    }
+
+    bool dirty() const {
+        return dirtyBegin_ < dirtyEnd_;
+    }
+
+    DctMirrorStats stats() const {
+        return stats_;
+    }
+
+    void resetStats() {
+        stats_ = DctMirrorStats();
+    }
+
+    BackendT* backend() {
+        return &backend_;
+    }
+
+private:
+    BackendT backend_;
+    DctMirrorStats stats_;
+    uint8_t data_[Size];
+    size_t dirtyBegin_;
+    size_t dirtyEnd_;
+    unsigned updates_;
+    bool loaded_;
+
+    int load() {
+        if (loaded_) {
+            return 0;
+        }
+        const auto t = backend_.millis();
+        const int ret = backend_.load(data_, Size);
+        if (ret < 0) {
+            return ret;
+        }
+        dirtyBegin_ = Size;
+        dirtyEnd_ = 0;
+        loaded_ = true;
+        ++stats_.loads;
+        stats_.loadTime += backend_.millis() - t;
+        return 0;
+    }
+
+    void markDirty(size_t offset, size_t size) {
+        dirtyBegin_ = std::min(dirtyBegin_, offset);
+        dirtyEnd_ = std::max(dirtyEnd_, offset + size);
+    }
+};
+
+} // particle::detail
+
+} // particle
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_tick_hal.h"
+#include "system_error.h"
+
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * OTA pipeline counters.
+ */
+struct OtaFlashPipelineStats {
+    uint32_t chunks; // Chunks accepted by `update()`
+    uint32_t bytes; // Bytes accepted by `update()`
+    uint32_t erases; // Sectors erased
+    uint32_t erasesAhead; // Sectors erased before any data was queued for them
+    uint32_t writes; // Program operations
+    uint32_t waits; // Times `update()` had to wait for a free slot
+    system_tick_t waitTime; // Time spent waiting for a free slot, in milliseconds
+    system_tick_t eraseTime; // Time spent erasing
+    system_tick_t writeTime; // Time spent programming
+};
+
+namespace detail {
+
+/**
+ * Staging area of an OTA update in flash.
+ *
+ * `update()` copies incoming chunks into a small write-behind queue and returns immediately. A
+ * worker thread calls `process()` to program the queued chunks and to erase the sectors that
+ * precede and follow them, so that the next chunks can usually be programmed without waiting for
+ * an erase. When the queue is full, `update()` blocks until the worker frees a slot.
+ *
+ * The CRC-32 of the image is computed incrementally while the chunks are being programmed, as long
+ * as they arrive in order.
+ *
+ * The backend provides the following methods:
+ *
+ * - `int erase(uintptr_t addr)`: erases the sector at the specified address
+ * - `int write(uintptr_t addr, const uint8_t* data, size_t size)`: programs the flash
+ * - `size_t sectorSize()`: returns the size of a sector
+ * - `void lock()` and `void unlock()`: protect the state shared with the worker thread
+ * - `void notifyWorker()` and `void notifyProducer()`: wake up the worker thread or a thread
+ *   waiting in `update()` or `end()`. A notification that is sent while nobody is waiting
+ *   must not be lost
+ * - `void waitProducer(system_tick_t timeout)`: blocks until `notifyProducer()` is called
+ * - `system_tick_t millis()`: returns the current time
+ *
+ * `process()` must only be called from one thread at a time.
+ */
+template<typename BackendT, size_t SlotSize = 512, size_t SlotCount = 8>
+class OtaFlashPipeline {
+public:
+    static const size_t SLOT_SIZE = SlotSize;
+    static const size_t SLOT_COUNT = SlotCount;
+    static const unsigned DEFAULT_ERASE_AHEAD = 2;
+    static const system_tick_t DEFAULT_TIMEOUT = 10000;
+
+    template<typename... ArgsT>
+    explicit OtaFlashPipeline(ArgsT&&... args) :
+            backend_(std::forward<ArgsT>(args)...),
+            stats_(),
+            begin_(0),
+            end_(0),
+            erased_(0),
+            queued_(0),
+            crcOffs_(0),
+            crc_(0),
+            timeout_(DEFAULT_TIMEOUT),
+            head_(0),
+            count_(0),
+            eraseAhead_(DEFAULT_ERASE_AHEAD),
+            error_(0),
+            busy_(false),
+            active_(false) {
+    }
+
+    /**
+     * Starts an update of the specified region of the flash.
+     *
+     * Any data that is still queued from a previous update is discarded.
+     */
+    int begin(uintptr_t addr, size_t size) {
+        cancel();
+        lock();
+        const size_t sectorSize = backend_.sectorSize();
+        begin_ = addr;
+        end_ = addr + size;
+        erased_ = addr - addr % sectorSize;
+        queued_ = addr;
+        crcOffs_ = addr;
+        crc_ = 0;
+        error_ = 0;
+        active_ = true;
+        unlock();
+        backend_.notifyWorker();
+        return 0;
+    }
+
+    /**
+     * Queues a chunk of data for programming.
+     *
+     * Blocks while the queue is full. Returns the error of a previous operation if the worker
+     * failed to erase or program the flash.
+     */
+    int update(uintptr_t addr, const uint8_t* data, size_t size) {
+        lock();
+        if (!active_) {
+            unlock();
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        if (addr < begin_ || addr > end_ || size > end_ - addr) {
+            unlock();
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        ++stats_.chunks;
+        stats_.bytes += size;
+        while (size > 0 && !error_) {
+            if (count_ == SlotCount) {
+                const int ret = waitProducer([this]() {
+                    return count_ < SlotCount;
+                });
+                ++stats_.waits;
+                if (ret < 0) {
+                    unlock();
+                    return ret;
+                }
+                continue;
+            }
+            Slot& s = slots_[(head_ + count_) % SlotCount];
+            const size_t n = std::min(size, SlotSize);
+            memcpy(s.data, data, n);
+            s.addr = addr;
+            s.size = n;
+            ++count_;
+            queued_ = std::max(queued_, addr + n);
+            addr += n;
+            data += n;
+            size -= n;
+            backend_.notifyWorker();
+        }
+        const int ret = error_;
+        unlock();
+        return ret;
+    }
+
+    /**
+     * Waits until all queued data is programmed and finishes the update.
+     */
+    int end() {
+        lock();
+        if (!active_) {
+            unlock();
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        int ret = waitProducer([this]() {
+            return count_ == 0 && !busy_;
+        });
+        if (ret == 0) {
+            ret = error_;
+        }
+        active_ = false;
+        unlock();
+        return ret;
+    }
+
+    /**
+     * Discards the queued data and stops the update.
+     */
+    void cancel() {
+        lock();
+        head_ = 0;
+        count_ = 0;
+        active_ = false;
+        // Let the worker finish the operation that is in progress
+        waitProducer([this]() {
+            return !busy_;
+        });
+        unlock();
+    }
+
+    /**
+     * Performs one erase or program operation.
+     *
+     * Returns `false` if there's nothing to do.
+     */
+    bool process() {
+        lock();
+        if (!active_ || error_) {
+            unlock();
+            return false;
+        }
+        const size_t sectorSize = backend_.sectorSize();
+        uintptr_t addr = erased_;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        if (count_ > 0) {
+            const Slot& s = slots_[head_];
+            if (s.addr + s.size <= erased_) {
+                addr = s.addr;
+                data = s.data;
+                size = s.size;
+            }
+        } else if (erased_ >= end_ || erased_ >= queued_ + eraseAhead_ * sectorSize) {
+            unlock();
+            return false;
+        }
+        const bool ahead = !data && erased_ >= queued_;
+        busy_ = true;
+        unlock();
+        const auto t1 = backend_.millis();
+        const int ret = data ? backend_.write(addr, data, size) : backend_.erase(addr);
+        const auto dt = backend_.millis() - t1;
+        lock();
+        busy_ = false;
+        if (ret < 0) {
+            error_ = ret;
+            head_ = 0;
+            count_ = 0;
+        } else if (data) {
+            if (count_ > 0) { // Unless the update was cancelled
+                updateCrc(addr, data, size);
+                head_ = (head_ + 1) % SlotCount;
+                --count_;
+            }
+            ++stats_.writes;
+            stats_.writeTime += dt;
+        } else {
+            erased_ += sectorSize;
+            ++stats_.erases;
+            if (ahead) {
+                ++stats_.erasesAhead;
+            }
+            stats_.eraseTime += dt;
+        }
+        unlock();
+        backend_.notifyProducer();
+        return true;
+    }
+
+    /**
+     * Returns the CRC-32 of the image programmed so far.
+     *
+     * Returns an error if the chunks didn't arrive in order.
+     */
+    int crc32(uint32_t* crc, size_t* size = nullptr) {
+        lock();
+        const bool contiguous = (crcOffs_ != INVALID_OFFSET);
+        if (contiguous) {
+            *crc = crc_;
+            if (size) {
+                *size = crcOffs_ - begin_;
+            }
+        }
+        unlock();
+        return contiguous ? 0 : SYSTEM_ERROR_NOT_FOUND;
+    }
+
+    void eraseAhead(unsigned sectors) {
+        lock();
+        eraseAhead_ = sectors;
+        unlock();
+    }
+
+    void timeout(system_tick_t timeout) {
+        timeout_ = timeout;
+    }
+
+    bool active() {
+        lock();
+        const bool active = active_;
+        unlock();
+        return active;
+    }
+
+    OtaFlashPipelineStats stats() {
+        lock();
+        const auto st = stats_;
+        unlock();
+        return st;
+    }
+
+    void resetStats() {
+        lock();
+        stats_ = OtaFlashPipelineStats();
+        unlock();
+    }
+
+    BackendT* backend() {
+        return &backend_;
+    }
+
+private:
+    static const uintptr_t INVALID_OFFSET = (uintptr_t)-1;
+
+    struct Slot {
+        uint8_t data[SlotSize];
+        uintptr_t addr;
+        size_t size;
+    };
+
+    BackendT backend_;
+    Slot slots_[SlotCount];
+    OtaFlashPipelineStats stats_;
+    uintptr_t begin_;
+    uintptr_t end_;
+    uintptr_t erased_; // End of the erased region
+    uintptr_t queued_; // End of the queued data
+    uintptr_t crcOffs_;
+    uint32_t crc_;
+    system_tick_t timeout_;
+    size_t head_;
+    size_t count_;
+    unsigned eraseAhead_;
+    int error_;
+    bool busy_;
+    bool active_;
+
+    // Called with the lock held
+    template<typename F>
+    int waitProducer(F done) {
+        const auto t1 = backend_.millis();
+        auto t = t1;
+        while (!done()) {
+            if (t - t1 >= timeout_) {
+                return SYSTEM_ERROR_TIMEOUT;
+            }
+            unlock();
+            backend_.waitProducer(timeout_ - (t - t1));
+            lock();
+            t = backend_.millis();
+        }
+        stats_.waitTime += t - t1;
+        return 0;
+    }
+
+    void updateCrc(uintptr_t addr, const uint8_t* data, size_t size) {
+        if (addr != crcOffs_) {
+            // Resent chunks don't break the sequence
+            if (crcOffs_ != INVALID_OFFSET && addr + size > crcOffs_) {
+                crcOffs_ = INVALID_OFFSET;
+            }
+            return;
+        }
+        uint32_t crc = ~crc_;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= data[i];
+            for (unsigned j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+            }
+        }
+        crc_ = ~crc;
+        crcOffs_ += size;
+    }
+
+    void lock() {
+        backend_.lock();
+    }
+
+    void unlock() {
+        backend_.unlock();
+    }
+};
+
+} // particle::detail
+
+} // particle
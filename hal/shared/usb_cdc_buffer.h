@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * USB CDC buffer counters.
+ */
+struct UsbCdcBufferStats {
+    uint32_t txBytes; // Bytes transmitted
+    uint32_t txTransfers; // IN transfers started
+    uint32_t txPackets; // IN packets, including zero-length ones
+    uint32_t txBounced; // IN packets copied across the end of the ring
+    uint32_t rxBytes; // Bytes received
+    uint32_t rxTransfers; // OUT transfers completed
+    uint32_t rxBounced; // OUT packets copied across the end of the ring
+    uint32_t rxStalls; // Times the OUT endpoint was left unarmed because the ring was full
+};
+
+namespace detail {
+
+/**
+ * Transmit and receive rings of a CDC data interface.
+ *
+ * Written data is copied once into the transmit ring and is sent directly from the ring, in
+ * transfers of up to half the ring size made of full-size packets. Received packets are stored
+ * directly in the receive ring. A packet that would cross the end of a ring goes through a
+ * packet-sized bounce buffer instead.
+ *
+ * The ring sizes must be powers of two and at least `MIN_BUFFER_SIZE` bytes, which is twice the
+ * packet size.
+ *
+ * The endpoint provides the following methods:
+ *
+ * - `int transmit(const uint8_t* data, size_t size)`: starts an IN transfer. A zero size requests
+ *   a zero-length packet. `txDone()` is called when the transfer completes
+ * - `int receive(uint8_t* data, size_t size)`: starts an OUT transfer of up to `size` bytes, which
+ *   is a multiple of the packet size. Returns 0 if the transfer is pending, in which case `rxDone()`
+ *   is called when it completes, or the number of bytes that were received immediately
+ * - `int lock()` and `void unlock(int state)`: mask and unmask the endpoint interrupts
+ *
+ * The application side methods must not be called concurrently with each other. `txDone()` and
+ * `rxDone()` are called in the interrupt context.
+ */
+template<typename EndpointT, size_t PacketSize = 64>
+class UsbCdcBuffer {
+public:
+    static const size_t PACKET_SIZE = PacketSize;
+    static const size_t MIN_BUFFER_SIZE = PacketSize * 2;
+
+    template<typename... ArgsT>
+    explicit UsbCdcBuffer(ArgsT&&... args) :
+            endpoint_(std::forward<ArgsT>(args)...),
+            txBuf_(nullptr),
+            rxBuf_(nullptr),
+            txSize_(0),
+            rxSize_(0),
+            txHead_(0),
+            txTail_(0),
+            rxHead_(0),
+            rxTail_(0),
+            txInFlight_(0),
+            rxArmedBounce_(false),
+            txBusy_(false),
+            rxBusy_(false),
+            txZlp_(false),
+            rxStalled_(false),
+            open_(false),
+            stats_() {
+    }
+
+    int init(uint8_t* rxBuf, size_t rxSize, uint8_t* txBuf, size_t txSize) {
+        if (!rxBuf || !txBuf || !isValidSize(rxSize) || !isValidSize(txSize)) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        const int state = endpoint_.lock();
+        rxBuf_ = rxBuf;
+        rxSize_ = rxSize;
+        txBuf_ = txBuf;
+        txSize_ = txSize;
+        resetState();
+        endpoint_.unlock(state);
+        return 0;
+    }
+
+    /**
+     * Called when the host opens the port. Discards the buffered data and arms the OUT endpoint.
+     */
+    void open() {
+        const int state = endpoint_.lock();
+        if (txBuf_) {
+            resetState();
+            open_ = true;
+            armRx();
+        }
+        endpoint_.unlock(state);
+    }
+
+    /**
+     * Called when the host closes the port.
+     */
+    void close() {
+        const int state = endpoint_.lock();
+        open_ = false;
+        endpoint_.unlock(state);
+    }
+
+    /**
+     * Copies as much data as fits into the transmit ring and starts a transfer if the IN endpoint
+     * is idle.
+     *
+     * @return Number of bytes queued.
+     */
+    size_t write(const uint8_t* data, size_t size) {
+        if (!open_) {
+            return 0;
+        }
+        const uint32_t head = txHead_;
+        size = std::min(size, txSize_ - (size_t)(head - txTail_));
+        if (size) {
+            copyToRing(txBuf_, txSize_, head, data, size);
+            txHead_ = head + size;
+            const int state = endpoint_.lock();
+            transmitNext();
+            endpoint_.unlock(state);
+        }
+        return size;
+    }
+
+    /**
+     * Copies received data out of the receive ring and rearms the OUT endpoint if it was stalled.
+     *
+     * @return Number of bytes read.
+     */
+    size_t read(uint8_t* data, size_t size) {
+        const uint32_t tail = rxTail_;
+        size = std::min(size, (size_t)(rxHead_ - tail));
+        if (size) {
+            copyFromRing(rxBuf_, rxSize_, tail, data, size);
+            rxTail_ = tail + size;
+            resumeRx();
+        }
+        return size;
+    }
+
+    /**
+     * Returns the next received byte without removing it, or -1 if there's no data.
+     */
+    int peek() const {
+        const uint32_t tail = rxTail_;
+        if (rxHead_ == tail) {
+            return -1;
+        }
+        return rxBuf_[tail & (rxSize_ - 1)];
+    }
+
+    /**
+     * Returns the received data that is stored contiguously at the front of the receive ring,
+     * without removing it. The data stays valid until it is consumed or the ring is reset.
+     *
+     * @return Number of bytes available at `data`.
+     */
+    size_t peekBuffer(const uint8_t** data) const {
+        const uint32_t tail = rxTail_;
+        const size_t offs = tail & (rxSize_ - 1);
+        *data = rxBuf_ + offs;
+        return std::min((size_t)(rxHead_ - tail), rxSize_ - offs);
+    }
+
+    /**
+     * Removes received data from the front of the receive ring and rearms the OUT endpoint if it
+     * was stalled.
+     *
+     * @return Number of bytes removed.
+     */
+    size_t consume(size_t size) {
+        const uint32_t tail = rxTail_;
+        size = std::min(size, (size_t)(rxHead_ - tail));
+        if (size) {
+            rxTail_ = tail + size;
+            resumeRx();
+        }
+        return size;
+    }
+
+    size_t available() const {
+        return rxHead_ - rxTail_;
+    }
+
+    size_t availableForWrite() const {
+        return txSize_ - (size_t)(txHead_ - txTail_);
+    }
+
+    /**
+     * Discards the received data.
+     */
+    void flushRx() {
+        rxTail_ = (uint32_t)rxHead_;
+        resumeRx();
+    }
+
+    /**
+     * Discards the data that is not being transmitted yet.
+     */
+    void flushTx() {
+        const int state = endpoint_.lock();
+        txHead_ = txTail_ + txInFlight_;
+        endpoint_.unlock(state);
+    }
+
+    bool isOpen() const {
+        return open_;
+    }
+
+    bool isTransmitting() const {
+        return txBusy_;
+    }
+
+    // Completion of an IN transfer
+    void txDone() {
+        txTail_ += txInFlight_;
+        txInFlight_ = 0;
+        txBusy_ = false;
+        transmitNext();
+    }
+
+    // Completion of an OUT transfer
+    void rxDone(size_t size) {
+        rxBusy_ = false;
+        completeRx(size);
+        armRx();
+    }
+
+    UsbCdcBufferStats stats() const {
+        const int state = endpoint_.lock();
+        const UsbCdcBufferStats st = stats_;
+        endpoint_.unlock(state);
+        return st;
+    }
+
+    void resetStats() {
+        const int state = endpoint_.lock();
+        stats_ = UsbCdcBufferStats();
+        endpoint_.unlock(state);
+    }
+
+    EndpointT& endpoint() {
+        return endpoint_;
+    }
+
+private:
+    mutable EndpointT endpoint_;
+    uint8_t* txBuf_;
+    uint8_t* rxBuf_;
+    size_t txSize_;
+    size_t rxSize_;
+    // Free-running positions. The head of each ring is advanced by its producer and the tail by
+    // its consumer
+    std::atomic<uint32_t> txHead_;
+    std::atomic<uint32_t> txTail_;
+    std::atomic<uint32_t> rxHead_;
+    std::atomic<uint32_t> rxTail_;
+    size_t txInFlight_;
+    bool rxArmedBounce_;
+    volatile bool txBusy_;
+    volatile bool rxBusy_;
+    bool txZlp_;
+    bool rxStalled_;
+    volatile bool open_;
+    uint8_t txBounce_[PacketSize];
+    uint8_t rxBounce_[PacketSize];
+    UsbCdcBufferStats stats_;
+
+    // Called with the endpoint interrupts masked or in the interrupt context
+    void transmitNext() {
+        if (!open_ || txBusy_) {
+            return;
+        }
+        const uint32_t tail = txTail_;
+        const size_t avail = txHead_ - tail;
+        if (!avail) {
+            if (txZlp_) {
+                // The host doesn't complete a read that ends with a full-size packet until it
+                // receives a short one
+                txZlp_ = false;
+                startTx(nullptr, 0);
+            }
+            return;
+        }
+        const size_t offs = tail & (txSize_ - 1);
+        const size_t contig = std::min(avail, txSize_ - offs);
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        if (contig < PacketSize && avail > contig) {
+            size = std::min(avail, PacketSize);
+            copyFromRing(txBuf_, txSize_, tail, txBounce_, size);
+            data = txBounce_;
+            ++stats_.txBounced;
+        } else {
+            size = std::min(contig, txSize_ / 2);
+            if (size > PacketSize) {
+                // The remainder is sent with the data written in the meantime
+                size -= size % PacketSize;
+            }
+            data = txBuf_ + offs;
+        }
+        txZlp_ = (size % PacketSize == 0);
+        startTx(data, size);
+    }
+
+    void startTx(const uint8_t* data, size_t size) {
+        txBusy_ = true; // The completion may be reported before transmit() returns
+        txInFlight_ = size;
+        if (endpoint_.transmit(data, size) < 0) {
+            txBusy_ = false;
+            txInFlight_ = 0;
+            return;
+        }
+        ++stats_.txTransfers;
+        stats_.txPackets += size ? (size + PacketSize - 1) / PacketSize : 1;
+        stats_.txBytes += size;
+    }
+
+    // Called with the endpoint interrupts masked or in the interrupt context
+    void armRx() {
+        while (open_ && !rxBusy_) {
+            const uint32_t head = rxHead_;
+            const size_t space = rxSize_ - (size_t)(head - rxTail_);
+            if (space < PacketSize) {
+                if (!rxStalled_) {
+                    rxStalled_ = true;
+                    ++stats_.rxStalls;
+                }
+                return;
+            }
+            rxStalled_ = false;
+            const size_t offs = head & (rxSize_ - 1);
+            const size_t contig = std::min(space, rxSize_ - offs);
+            uint8_t* data = nullptr;
+            size_t size = 0;
+            if (contig < PacketSize) {
+                data = rxBounce_;
+                size = PacketSize;
+                rxArmedBounce_ = true;
+            } else {
+                data = rxBuf_ + offs;
+                size = std::min(contig, rxSize_ / 2);
+                size -= size % PacketSize;
+                rxArmedBounce_ = false;
+            }
+            rxBusy_ = true;
+            const int r = endpoint_.receive(data, size);
+            if (r == 0) {
+                return;
+            }
+            rxBusy_ = false;
+            if (r < 0) {
+                return;
+            }
+            completeRx(r);
+        }
+    }
+
+    void completeRx(size_t size) {
+        const uint32_t head = rxHead_;
+        if (rxArmedBounce_) {
+            copyToRing(rxBuf_, rxSize_, head, rxBounce_, size);
+            if (size) {
+                ++stats_.rxBounced;
+            }
+        }
+        rxHead_ = head + size;
+        ++stats_.rxTransfers;
+        stats_.rxBytes += size;
+    }
+
+    void resumeRx() {
+        if (!rxBusy_) {
+            const int state = endpoint_.lock();
+            armRx();
+            endpoint_.unlock(state);
+        }
+    }
+
+    void resetState() {
+        txHead_ = 0;
+        txTail_ = 0;
+        rxHead_ = 0;
+        rxTail_ = 0;
+        txInFlight_ = 0;
+        txBusy_ = false;
+        rxBusy_ = false;
+        txZlp_ = false;
+        rxStalled_ = false;
+    }
+
+    static bool isValidSize(size_t size) {
+        return size >= MIN_BUFFER_SIZE && (size & (size - 1)) == 0;
+    }
+
+    static void copyToRing(uint8_t* ring, size_t ringSize, uint32_t pos, const uint8_t* data, size_t size) {
+        const size_t offs = pos & (ringSize - 1);
+        const size_t n = std::min(size, ringSize - offs);
+        memcpy(ring + offs, data, n);
+        memcpy(ring, data + n, size - n);
+    }
+
+    static void copyFromRing(const uint8_t* ring, size_t ringSize, uint32_t pos, uint8_t* data, size_t size) {
+        const size_t offs = pos & (ringSize - 1);
+        const size_t n = std::min(size, ringSize - offs);
+        memcpy(data, ring + offs, n);
+        memcpy(data + n, ring, size - n);
+    }
+};
+
+} // particle::detail
+
+} // particle
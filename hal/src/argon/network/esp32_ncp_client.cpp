@@ -110,7 +110,7 @@ int Esp32NcpClient::init(const NcpClientConfig& conf) {
     // Initialize muxed channel stream
     decltype(muxerAtStream_) muxStrm(new(std::nothrow) decltype(muxerAtStream_)::element_type(&muxer_, ESP32_NCP_AT_CHANNEL));
     CHECK_TRUE(muxStrm, SYSTEM_ERROR_NO_MEMORY);
-    CHECK(muxStrm->init(ESP32_NCP_AT_CHANNEL_RX_BUFFER_SIZE));
+    CHECK(muxStrm->init(ESP32_NCP_AT_CHANNEL_RX_BUFFER_SIZE, ESP32_NCP_MAX_MUXER_FRAME_SIZE));
     CHECK(initParser(serial.get()));
     serial_ = std::move(serial);
     muxerAtStream_ = std::move(muxStrm);
@@ -137,7 +137,7 @@ int QuectelNcpClient::init(const NcpClientConfig& conf) {
     // Initialize muxed channel stream
     decltype(muxerAtStream_) muxStrm(new (std::nothrow) decltype(muxerAtStream_)::element_type(&muxer_, QUECTEL_NCP_AT_CHANNEL));
     CHECK_TRUE(muxStrm, SYSTEM_ERROR_NO_MEMORY);
-    CHECK(muxStrm->init(QUECTEL_NCP_AT_CHANNEL_RX_BUFFER_SIZE));
+    CHECK(muxStrm->init(QUECTEL_NCP_AT_CHANNEL_RX_BUFFER_SIZE, QUECTEL_NCP_MAX_MUXER_FRAME_SIZE));
     CHECK(initParser(serial.get()));
     serial_ = std::move(serial);
     muxerAtStream_ = std::move(muxStrm);
@@ -424,6 +424,15 @@ int QuectelNcpClient::getImei(char* buf, size_t size) {
     return n;
 }
 
+int QuectelNcpClient::getImsi(char* buf, size_t size) {
+    const NcpClientLock lock(this);
+    CHECK(checkParser());
+    auto resp = parser_.sendCommand("AT+CIMI");
+    const size_t n = CHECK_PARSER(resp.readLine(buf, size));
+    CHECK_PARSER_OK(resp.readResult());
+    return n;
+}
+
 int QuectelNcpClient::queryAndParseAtCops(CellularSignalQuality* qual) {
     int act;
     char mobileCountryCode[4] = {0};
@@ -62,6 +62,7 @@ public:
     virtual int getCellularGlobalIdentity(CellularGlobalIdentity* cgi) override;
     virtual int getIccid(char* buf, size_t size) override;
     virtual int getImei(char* buf, size_t size) override;
+    virtual int getImsi(char* buf, size_t size) override;
     virtual int getSignalQuality(CellularSignalQuality* qual) override;
     virtual int setRegistrationTimeout(unsigned timeout) override;
 
@@ -33,12 +33,12 @@
 #include "core_hal.h"
 
 #include "stream_util.h"
+#include "file_util.h"
 
 #include "spark_wiring_interrupts.h"
 #include "spark_wiring_vector.h"
 
 #include <algorithm>
-#include <limits>
 
 #undef LOG_COMPILE_TIME_LEVEL
 #define LOG_COMPILE_TIME_LEVEL LOG_LEVEL_ALL
@@ -65,16 +65,6 @@
             } \
         } while (false)
 
-#define CHECK_PARSER_URC(_expr) \
-        ({ \
-            const auto _r = _expr; \
-            if (_r < 0) { \
-                self->parserError(_r); \
-                return _r; \
-            } \
-            _r; \
-        })
-
 namespace particle {
 
 namespace {
@@ -101,6 +91,73 @@ const auto UBLOX_NCP_SIM_SELECT_PIN = 23;
 const unsigned REGISTRATION_CHECK_INTERVAL = 15 * 1000;
 const unsigned REGISTRATION_TIMEOUT = 5 * 60 * 1000;
 
+// Arguments of the AT+UBANDMASK or AT+URAT command that was in effect before the carrier hints
+// were applied. The file exists only while the modem is configured according to the hints
+const auto NETWORK_HINTS_BACKUP_FILE = "/sys/ncp_hints_backup.txt";
+
+// The standard library used on the device doesn't support 64-bit integers in printf()/scanf()
+void formatBandMask(uint64_t mask, char* buf, size_t size) {
+    char tmp[21] = {};
+    size_t n = 0;
+    do {
+        tmp[n++] = '0' + (mask % 10);
+        mask /= 10;
+    } while (mask && n < sizeof(tmp) - 1);
+    size_t i = 0;
+    for (; i < n && i < size - 1; ++i) {
+        buf[i] = tmp[n - i - 1];
+    }
+    buf[i] = '\0';
+}
+
+int loadNetworkHintsBackup(char* buf, size_t size) {
+    const auto fs = filesystem_get_instance(nullptr);
+    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
+    fs::FsLock lock(fs);
+    CHECK(filesystem_mount(fs));
+    lfs_info info = {};
+    if (lfs_stat(&fs->instance, NETWORK_HINTS_BACKUP_FILE, &info) != LFS_ERR_OK) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    lfs_file_t file = {};
+    CHECK(openFile(&file, NETWORK_HINTS_BACKUP_FILE, LFS_O_RDONLY));
+    SCOPE_GUARD({
+        lfs_file_close(&fs->instance, &file);
+    });
+    const int r = lfs_file_read(&fs->instance, &file, buf, size - 1);
+    CHECK_TRUE(r > 0, SYSTEM_ERROR_FILE);
+    buf[r] = '\0';
+    return 0;
+}
+
+int saveNetworkHintsBackup(const char* setting) {
+    const auto fs = filesystem_get_instance(nullptr);
+    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
+    fs::FsLock lock(fs);
+    CHECK(filesystem_mount(fs));
+    lfs_file_t file = {};
+    CHECK(openFile(&file, NETWORK_HINTS_BACKUP_FILE, LFS_O_WRONLY));
+    SCOPE_GUARD({
+        lfs_file_close(&fs->instance, &file);
+    });
+    int r = lfs_file_truncate(&fs->instance, &file, 0);
+    CHECK_TRUE(r == LFS_ERR_OK, SYSTEM_ERROR_FILE);
+    const size_t n = strlen(setting);
+    r = lfs_file_write(&fs->instance, &file, setting, n);
+    CHECK_TRUE(r == (int)n, SYSTEM_ERROR_FILE);
+    return 0;
+}
+
+int removeNetworkHintsBackup() {
+    const auto fs = filesystem_get_instance(nullptr);
+    CHECK_TRUE(fs, SYSTEM_ERROR_FILE);
+    fs::FsLock lock(fs);
+    CHECK(filesystem_mount(fs));
+    const int r = lfs_remove(&fs->instance, NETWORK_HINTS_BACKUP_FILE);
+    CHECK_TRUE(r == LFS_ERR_OK || r == LFS_ERR_NOENT, SYSTEM_ERROR_FILE);
+    return 0;
+}
+
 } // anonymous
 
 SaraNcpClient::SaraNcpClient() {
@@ -127,7 +184,7 @@ int SaraNcpClient::init(const NcpClientConfig& conf) {
     // Initialize muxed channel stream
     decltype(muxerAtStream_) muxStrm(new(std::nothrow) decltype(muxerAtStream_)::element_type(&muxer_, UBLOX_NCP_AT_CHANNEL));
     CHECK_TRUE(muxStrm, SYSTEM_ERROR_NO_MEMORY);
-    CHECK(muxStrm->init(UBLOX_NCP_AT_CHANNEL_RX_BUFFER_SIZE));
+    CHECK(muxStrm->init(UBLOX_NCP_AT_CHANNEL_RX_BUFFER_SIZE, UBLOX_NCP_MAX_MUXER_FRAME_SIZE));
     CHECK(initParser(serial.get()));
     serial_ = std::move(serial);
     muxerAtStream_ = std::move(muxStrm);
@@ -164,94 +221,24 @@ int SaraNcpClient::initParser(Stream* stream) {
     parser_.destroy();
     CHECK(parser_.init(std::move(parserConf)));
 
-    // NOTE: These URC handlers need to take care of both the URCs and direct responses to the commands.
-    // See CH28408
-
-    using LacType = decltype(CellularGlobalIdentity::location_area_code);
-    using CidType = decltype(CellularGlobalIdentity::cell_id);
-
-    // +CREG: <stat>[,<lac>,<ci>[,<AcTStatus>]]
-    CHECK(parser_.addUrcHandler("+CREG", [](AtResponseReader* reader, const char* prefix, void* data) -> int {
-        const auto self = (SaraNcpClient*)data;
-        unsigned int val[4] = {};
-        char atResponse[64] = {};
-        // Take a copy of AT response for multi-pass scanning
-        CHECK_PARSER_URC(reader->readLine(atResponse, sizeof(atResponse)));
-        // Parse response ignoring mode (replicate URC response)
-        int r = ::sscanf(atResponse, "+CREG: %*u,%u,\"%x\",\"%x\",%u", &val[0], &val[1], &val[2], &val[3]);
-        // Reparse URC as direct response
-        if (0 >= r) {
-            r = CHECK_PARSER_URC(
-                ::sscanf(atResponse, "+CREG: %u,\"%x\",\"%x\",%u", &val[0], &val[1], &val[2], &val[3]));
-        }
-        CHECK_TRUE(r >= 1, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
-        // Home network or roaming
-        if (val[0] == 1 || val[0] == 5) {
-            self->creg_ = RegistrationState::Registered;
-        } else {
-            self->creg_ = RegistrationState::NotRegistered;
-        }
-        self->checkRegistrationState();
-        // Cellular Global Identity (partial)
-        self->cgi_.location_area_code = r >= 2 ? static_cast<LacType>(val[1]) : std::numeric_limits<LacType>::max();
-        self->cgi_.cell_id = r >= 3 ? static_cast<CidType>(val[2]) : std::numeric_limits<CidType>::max();
-        return 0;
-    }, this));
-    // n={0,1} +CGREG: <stat>
-    // n=2     +CGREG: <stat>[,<lac>,<ci>[,<AcT>,<rac>]]
-    CHECK(parser_.addUrcHandler("+CGREG", [](AtResponseReader* reader, const char* prefix, void* data) -> int {
-        const auto self = (SaraNcpClient*)data;
-        unsigned int val[4] = {};
-        char atResponse[64] = {};
-        // Take a copy of AT response for multi-pass scanning
-        CHECK_PARSER_URC(reader->readLine(atResponse, sizeof(atResponse)));
-        // Parse response ignoring mode (replicate URC response)
-        int r = ::sscanf(atResponse, "+CGREG: %*u,%u,\"%x\",\"%x\",%u,\"%*x\"", &val[0], &val[1], &val[2], &val[3]);
-        // Reparse URC as direct response
-        if (0 >= r) {
-            r = CHECK_PARSER_URC(
-                ::sscanf(atResponse, "+CGREG: %u,\"%x\",\"%x\",%u,\"%*x\"", &val[0], &val[1], &val[2], &val[3]));
-        }
-        CHECK_TRUE(r >= 1, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
-        // Home network or roaming
-        if (val[0] == 1 || val[0] == 5) {
-            self->cgreg_ = RegistrationState::Registered;
-        } else {
-            self->cgreg_ = RegistrationState::NotRegistered;
-        }
-        self->checkRegistrationState();
-        // Cellular Global Identity (partial)
-        self->cgi_.location_area_code = r >= 2 ? static_cast<LacType>(val[1]) : std::numeric_limits<LacType>::max();
-        self->cgi_.cell_id = r >= 3 ? static_cast<CidType>(val[2]) : std::numeric_limits<CidType>::max();
-        return 0;
-    }, this));
-    // +CEREG: <stat>[,[<tac>],[<ci>],[<AcT>][,<cause_type>,<reject_cause>[,[<Active_Time>],[<Periodic_TAU>]]]]
-    CHECK(parser_.addUrcHandler("+CEREG", [](AtResponseReader* reader, const char* prefix, void* data) -> int {
+    CHECK(signalCache_.init(&parser_, conf_.ncpIdentifier(), [](CellularRegistrationType type, bool registered, void* data) {
         const auto self = (SaraNcpClient*)data;
-        unsigned int val[4] = {};
-        char atResponse[64] = {};
-        // Take a copy of AT response for multi-pass scanning
-        CHECK_PARSER_URC(reader->readLine(atResponse, sizeof(atResponse)));
-        // Parse response ignoring mode (replicate URC response)
-        int r = ::sscanf(atResponse, "+CEREG: %*u,%u,\"%x\",\"%x\",%u", &val[0], &val[1], &val[2], &val[3]);
-        // Reparse URC as direct response
-        if (0 >= r) {
-            r = CHECK_PARSER_URC(
-                ::sscanf(atResponse, "+CEREG: %u,\"%x\",\"%x\",%u", &val[0], &val[1], &val[2], &val[3]));
-        }
-        CHECK_TRUE(r >= 1, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
         // Home network or roaming
-        if (val[0] == 1 || val[0] == 5) {
-            self->cereg_ = RegistrationState::Registered;
-        } else {
-            self->cereg_ = RegistrationState::NotRegistered;
+        const auto state = registered ? RegistrationState::Registered : RegistrationState::NotRegistered;
+        switch (type) {
+        case CellularRegistrationType::CREG:
+            self->creg_ = state;
+            break;
+        case CellularRegistrationType::CGREG:
+            self->cgreg_ = state;
+            break;
+        case CellularRegistrationType::CEREG:
+            self->cereg_ = state;
+            break;
         }
         self->checkRegistrationState();
-        // Cellular Global Identity (partial)
-        self->cgi_.location_area_code = r >= 2 ? static_cast<LacType>(val[1]) : std::numeric_limits<LacType>::max();
-        self->cgi_.cell_id = r >= 3 ? static_cast<CidType>(val[2]) : std::numeric_limits<CidType>::max();
-        return 0;
     }, this));
+    signalCache_.maxAge(conf_.signalMaxAge());
     return 0;
 }
 
@@ -382,6 +369,7 @@ int SaraNcpClient::connect(const CellularNetworkConfig& conf) {
 
     resetRegistrationState();
     CHECK(configureApn(conf));
+    CHECK(configureNetworkHints());
     CHECK(registerNet());
 
     checkRegistrationState();
@@ -409,68 +397,22 @@ int SaraNcpClient::getIccid(char* buf, size_t size) {
     return n;
 }
 
-int SaraNcpClient::getImei(char* buf, size_t size) {
+int SaraNcpClient::getImsi(char* buf, size_t size) {
     const NcpClientLock lock(this);
     CHECK(checkParser());
-    auto resp = parser_.sendCommand("AT+CGSN");
+    auto resp = parser_.sendCommand("AT+CIMI");
     const size_t n = CHECK_PARSER(resp.readLine(buf, size));
     CHECK_PARSER_OK(resp.readResult());
     return n;
 }
 
-int SaraNcpClient::queryAndParseAtCops(CellularSignalQuality* qual) {
-    int act;
-    char mobileCountryCode[4] = {0};
-    char mobileNetworkCode[4] = {0};
-
-    // Reformat the operator string to be numeric
-    // (allows the capture of `mcc` and `mnc`)
-    int r = CHECK_PARSER(parser_.execCommand("AT+COPS=3,2"));
-    CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
-
-    auto resp = parser_.sendCommand("AT+COPS?");
-    r = CHECK_PARSER(resp.scanf("+COPS: %*d,%*d,\"%3[0-9]%3[0-9]\",%d", mobileCountryCode,
-                                    mobileNetworkCode, &act));
-    CHECK_TRUE(r == 3, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
-    r = CHECK_PARSER(resp.readResult());
-    CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
-
-    // Preserve digit format data
-    const int mnc_digits = ::strnlen(mobileNetworkCode, sizeof(mobileNetworkCode));
-    CHECK_TRUE((2 == mnc_digits || 3 == mnc_digits), SYSTEM_ERROR_BAD_DATA);
-    if (2 == mnc_digits) {
-        cgi_.cgi_flags |= CGI_FLAG_TWO_DIGIT_MNC;
-    } else {
-        cgi_.cgi_flags &= ~CGI_FLAG_TWO_DIGIT_MNC;
-    }
-
-    // `atoi` returns zero on error, which is an invalid `mcc` and `mnc`
-    cgi_.mobile_country_code = static_cast<uint16_t>(::atoi(mobileCountryCode));
-    cgi_.mobile_network_code = static_cast<uint16_t>(::atoi(mobileNetworkCode));
-
-    switch (static_cast<CellularAccessTechnology>(act)) {
-        case CellularAccessTechnology::NONE:
-        case CellularAccessTechnology::GSM:
-        case CellularAccessTechnology::GSM_COMPACT:
-        case CellularAccessTechnology::UTRAN:
-        case CellularAccessTechnology::GSM_EDGE:
-        case CellularAccessTechnology::UTRAN_HSDPA:
-        case CellularAccessTechnology::UTRAN_HSUPA:
-        case CellularAccessTechnology::UTRAN_HSDPA_HSUPA:
-        case CellularAccessTechnology::LTE:
-        case CellularAccessTechnology::EC_GSM_IOT:
-        case CellularAccessTechnology::E_UTRAN: {
-            break;
-        }
-        default: {
-            return SYSTEM_ERROR_BAD_DATA;
-        }
-    }
-    if (qual) {
-        qual->accessTechnology(static_cast<CellularAccessTechnology>(act));
-    }
-
-    return SYSTEM_ERROR_NONE;
+int SaraNcpClient::getImei(char* buf, size_t size) {
+    const NcpClientLock lock(this);
+    CHECK(checkParser());
+    auto resp = parser_.sendCommand("AT+CGSN");
+    const size_t n = CHECK_PARSER(resp.readLine(buf, size));
+    CHECK_PARSER_OK(resp.readResult());
+    return n;
 }
 
 int SaraNcpClient::getCellularGlobalIdentity(CellularGlobalIdentity* cgi) {
@@ -478,24 +420,7 @@ int SaraNcpClient::getCellularGlobalIdentity(CellularGlobalIdentity* cgi) {
     CHECK_TRUE(connState_ != NcpConnectionState::DISCONNECTED, SYSTEM_ERROR_INVALID_STATE);
     CHECK_TRUE(cgi, SYSTEM_ERROR_INVALID_ARGUMENT);
     CHECK(checkParser());
-    CHECK(queryAndParseAtCops(nullptr));
-
-    switch (cgi->version)
-    {
-    case CGI_VERSION_1:
-    default:
-    {
-        // Confirm user is expecting the correct amount of data
-        CHECK_TRUE((cgi->size >= sizeof(cgi_)), SYSTEM_ERROR_INVALID_ARGUMENT);
-
-        *cgi = cgi_;
-        cgi->size = sizeof(cgi_);
-        cgi->version = CGI_VERSION_1;
-        break;
-    }
-    }
-
-    return SYSTEM_ERROR_NONE;
+    return checkSignalCache(signalCache_.getCellularGlobalIdentity(cgi));
 }
 
 int SaraNcpClient::getSignalQuality(CellularSignalQuality* qual) {
@@ -503,119 +428,15 @@ int SaraNcpClient::getSignalQuality(CellularSignalQuality* qual) {
     CHECK_TRUE(connState_ != NcpConnectionState::DISCONNECTED, SYSTEM_ERROR_INVALID_STATE);
     CHECK_TRUE(qual, SYSTEM_ERROR_INVALID_ARGUMENT);
     CHECK(checkParser());
-    CHECK(queryAndParseAtCops(qual));
-
-    // Min and max RSRQ index values multiplied by 100
-    // Min: -19.5 and max: -3
-    const int min_rsrq_mul_by_100 = -1950;
-    const int max_rsrq_mul_by_100 = -300;
-
-    if (ncpId() == PLATFORM_NCP_SARA_R410) {
-        int rsrp;
-        int rsrq_n;
-        unsigned long rsrq_f;
-
-        // Default to 255 in case RSRP/Q are not found
-        qual->strength(255);
-        qual->quality(255);
-
-        // Set UCGED to mode 5 for RSRP/RSRQ values on R410M
-        CHECK_PARSER_OK(parser_.execCommand("AT+UCGED=5"));
-        auto resp = parser_.sendCommand("AT+UCGED?");
-
-        int val;
-        unsigned long val2;
-        while (resp.hasNextLine()) {
-            char type = 0;
-            const int r = CHECK_PARSER(resp.scanf("+RSR%c: %*d,%*d,\"%d.%lu\"", &type, &val, &val2));
-            if (r >= 2) {
-                if (type == 'P') {
-                    rsrp = val;
-                    if (rsrp < -141 && rsrp >= -200) {
-                        qual->strength(0);
-                    } else if (rsrp >= -44 && rsrp <=0) {
-                        qual->strength(97);
-                    } else if (rsrp >= -141 && rsrp < -44) {
-                        qual->strength(rsrp + 140);
-                    } else {
-                        // If RSRP is not in the expected range
-                        qual->strength(255);
-                    }
-                } else if (type == 'Q' && r == 3) {
-                    rsrq_n = val;
-                    rsrq_f = val2;
-                    int rsrq_mul_100 = rsrq_n * 100 - rsrq_f;
-                    if (rsrq_mul_100 < min_rsrq_mul_by_100 && rsrq_mul_100 >= -2000) {
-                        qual->quality(0);
-                    } else if (rsrq_mul_100 >= max_rsrq_mul_by_100 && rsrq_mul_100 <=0) {
-                        qual->quality(34);
-                    } else if (rsrq_mul_100 >= min_rsrq_mul_by_100 && rsrq_mul_100 < max_rsrq_mul_by_100) {
-                        qual->quality((rsrq_mul_100 + 2000)/50);
-                    } else {
-                        // If RSRQ is not in the expected range
-                        qual->quality(255);
-                    }
-                }
-            }
-        }
-
-        const int r = CHECK_PARSER(resp.readResult());
-        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
-
-    } else {
-        int rxlev, rxqual;
-        auto resp = parser_.sendCommand("AT+CSQ");
-        int r = CHECK_PARSER(resp.scanf("+CSQ: %d,%d", &rxlev, &rxqual));
-        CHECK_TRUE(r == 2, SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
-        r = CHECK_PARSER(resp.readResult());
-        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
-
-        // Fixup values
-        switch (qual->strengthUnits()) {
-            case CellularStrengthUnits::RXLEV: {
-                qual->strength((rxlev != 99) ? (2 * rxlev) : rxlev);
-                break;
-            }
-            case CellularStrengthUnits::RSCP: {
-                qual->strength((rxlev != 99) ? (3 + 2 * rxlev) : 255);
-                break;
-            }
-            case CellularStrengthUnits::RSRP: {
-                qual->strength((rxlev != 99) ? (rxlev * 97) / 31 : 255);
-                break;
-            }
-            default: {
-                // Do nothing
-                break;
-            }
-        }
-
-        if (qual->accessTechnology() == CellularAccessTechnology::GSM_EDGE) {
-            qual->qualityUnits(CellularQualityUnits::MEAN_BEP);
-        }
+    return checkSignalCache(signalCache_.getSignalQuality(qual));
+}
 
-        switch (qual->qualityUnits()) {
-            case CellularQualityUnits::RXQUAL:
-            case CellularQualityUnits::MEAN_BEP: {
-                qual->quality(rxqual);
-                break;
-            }
-            case CellularQualityUnits::ECN0: {
-                qual->quality((rxqual != 99) ? std::min((7 + (7 - rxqual) * 6), 44) : 255);
-                break;
-            }
-            case CellularQualityUnits::RSRQ: {
-                qual->quality((rxqual != 99) ? (rxqual * 34) / 7 : 255);
-                break;
-            }
-            default: {
-                // Do nothing
-                break;
-            }
-        }
+int SaraNcpClient::checkSignalCache(int ret) {
+    const int err = signalCache_.parserError();
+    if (err < 0) {
+        parserError(err);
     }
-
-    return 0;
+    return ret;
 }
 
 int SaraNcpClient::checkParser() {
@@ -994,10 +815,7 @@ int SaraNcpClient::configureApn(const CellularNetworkConfig& conf) {
     if (!netConf_.isValid()) {
         // Look for network settings based on IMSI
         char buf[32] = {};
-        auto resp = parser_.sendCommand("AT+CIMI");
-        CHECK_PARSER(resp.readLine(buf, sizeof(buf)));
-        const int r = CHECK_PARSER(resp.readResult());
-        CHECK_TRUE(r == AtResponse::OK, SYSTEM_ERROR_AT_NOT_OK);
+        CHECK(getImsi(buf, sizeof(buf)));
         netConf_ = networkConfigForImsi(buf, strlen(buf));
     }
     // FIXME: for now IPv4 context only
@@ -1009,6 +827,114 @@ int SaraNcpClient::configureApn(const CellularNetworkConfig& conf) {
     return 0;
 }
 
+int SaraNcpClient::configureNetworkHints() {
+    // The settings below are persistent. The setting that was in effect before the hints were
+    // applied is backed up and restored when the current carrier has no hints, so that the modem
+    // doesn't stay locked to the bands or the radio access technology of a previously used SIM
+    // card. A setting that was never changed by this code is left as is
+    char backup[32] = {};
+    int r = loadNetworkHintsBackup(backup, sizeof(backup));
+    if (r < 0 && r != SYSTEM_ERROR_NOT_FOUND) {
+        LOG(ERROR, "Unable to load network hints backup: %d", r);
+        return 0; // Not critical
+    }
+    const bool hasBackup = (r == 0);
+    if (ncpId() == PLATFORM_NCP_SARA_R410) {
+        // Restrict the LTE Cat M1 band search to the bands used by the carrier. This setting takes
+        // effect after the next modem reset
+        const uint64_t bands = netConf_.bands();
+        if (!bands && !hasBackup) {
+            return 0;
+        }
+        auto resp = parser_.sendCommand("AT+UBANDMASK?");
+        unsigned rat = 0;
+        char curMask[21] = {};
+        r = CHECK_PARSER(resp.scanf("+UBANDMASK: %u,%20[0-9]", &rat, curMask));
+        CHECK_PARSER_OK(resp.readResult());
+        if (r != 2 || rat != 0) { // 0: LTE Cat M1
+            return 0;
+        }
+        char mask[21] = {};
+        if (bands) {
+            formatBandMask(bands, mask, sizeof(mask));
+        } else {
+            memcpy(mask, backup, std::min(sizeof(mask) - 1, strlen(backup)));
+        }
+        if (strcmp(mask, curMask) != 0) {
+            if (bands && !hasBackup) {
+                r = saveNetworkHintsBackup(curMask);
+                if (r < 0) {
+                    // Do not change the setting if it can't be restored later
+                    LOG(ERROR, "Unable to save network hints backup: %d", r);
+                    return 0;
+                }
+            }
+            LOG(TRACE, "Updating LTE Cat M1 band mask: %s -> %s", curMask, mask);
+            CHECK_PARSER_OK(parser_.execCommand("AT+UBANDMASK=0,%s", mask));
+        }
+        if (!bands) {
+            // The original setting has been restored
+            CHECK(removeNetworkHintsBackup());
+        }
+    } else if (ncpId() == PLATFORM_NCP_SARA_U201) {
+        // Skip the search on a radio access technology that is not used by the carrier
+        int act = -1;
+        switch (netConf_.accessTechnology()) {
+        case NET_ACCESS_TECHNOLOGY_GSM:
+            act = 0; // GSM only
+            break;
+        case NET_ACCESS_TECHNOLOGY_UMTS:
+            act = 2; // UMTS only
+            break;
+        default:
+            break;
+        }
+        if (act < 0 && !hasBackup) {
+            return 0;
+        }
+        auto resp = parser_.sendCommand("AT+URAT?");
+        int selectAct = -1;
+        int preferAct = -1;
+        r = CHECK_PARSER(resp.scanf("+URAT: %d,%d", &selectAct, &preferAct));
+        CHECK_PARSER_OK(resp.readResult());
+        if (r < 1) {
+            return 0;
+        }
+        char curAct[16] = {};
+        if (r == 2) {
+            snprintf(curAct, sizeof(curAct), "%d,%d", selectAct, preferAct);
+        } else {
+            snprintf(curAct, sizeof(curAct), "%d", selectAct);
+        }
+        char newAct[16] = {};
+        if (act >= 0) {
+            snprintf(newAct, sizeof(newAct), "%d", act);
+        } else {
+            memcpy(newAct, backup, std::min(sizeof(newAct) - 1, strlen(backup)));
+        }
+        const bool changed = (act >= 0) ? (selectAct != act) : (strcmp(newAct, curAct) != 0);
+        if (changed) {
+            if (act >= 0 && !hasBackup) {
+                r = saveNetworkHintsBackup(curAct);
+                if (r < 0) {
+                    // Do not change the setting if it can't be restored later
+                    LOG(ERROR, "Unable to save network hints backup: %d", r);
+                    return 0;
+                }
+            }
+            LOG(TRACE, "Updating radio access technology: %s -> %s", curAct, newAct);
+            // Disconnect before making changes to URAT
+            CHECK_PARSER_OK(parser_.execCommand("AT+COPS=2,2"));
+            CHECK_PARSER_OK(parser_.execCommand("AT+URAT=%s", newAct));
+        }
+        if (act < 0) {
+            // The original setting has been restored
+            CHECK(removeNetworkHintsBackup());
+        }
+    }
+    return 0;
+}
+
 int SaraNcpClient::setRegistrationTimeout(unsigned timeout) {
     registrationTimeout_ = std::max(timeout, REGISTRATION_TIMEOUT);
     return 0;
@@ -1084,6 +1010,7 @@ void SaraNcpClient::connectionState(NcpConnectionState state) {
     }
     LOG(TRACE, "NCP connection state changed: %d", (int)state);
     connState_ = state;
+    signalCache_.invalidate();
 
     if (connState_ == NcpConnectionState::CONNECTED) {
         // Open data channel
@@ -1178,7 +1105,11 @@ void SaraNcpClient::checkRegistrationState() {
 int SaraNcpClient::processEventsImpl() {
     CHECK_TRUE(ncpState_ == NcpState::ON, SYSTEM_ERROR_INVALID_STATE);
     parser_.processUrc(); // Ignore errors
+    checkSignalCache(0); // Check for a parser error in the registration URC handlers
     checkRegistrationState();
+    if (connState_ == NcpConnectionState::CONNECTED) {
+        checkSignalCache(signalCache_.refresh()); // Ignore errors
+    }
     if (connState_ != NcpConnectionState::CONNECTING ||
             millis() - regCheckTime_ < REGISTRATION_CHECK_INTERVAL) {
         return 0;
@@ -20,6 +20,7 @@
 #include <cstdlib>
 
 #include "network/ncp/cellular/cellular_ncp_client.h"
+#include "network/ncp/cellular/cellular_signal_cache.h"
 #include "platform_ncp.h"
 
 #include "at_parser.h"
@@ -62,6 +63,7 @@ public:
     virtual int getCellularGlobalIdentity(CellularGlobalIdentity* cgi) override;
     virtual int getIccid(char* buf, size_t size) override;
     virtual int getImei(char* buf, size_t size) override;
+    virtual int getImsi(char* buf, size_t size) override;
     virtual int getSignalQuality(CellularSignalQuality* qual) override;
     virtual int setRegistrationTimeout(unsigned timeout) override;
 
@@ -78,7 +80,7 @@ private:
     gsm0710::Muxer<particle::Stream, StaticRecursiveMutex> muxer_;
     std::unique_ptr<particle::MuxerChannelStream<decltype(muxer_)> > muxerAtStream_;
     CellularNetworkConfig netConf_;
-    CellularGlobalIdentity cgi_ = {};
+    CellularSignalCache signalCache_;
 
     enum class RegistrationState {
         NotRegistered = 0,
@@ -95,7 +97,6 @@ private:
     bool memoryIssuePresent_ = false;
     unsigned registrationTimeout_;
 
-    int queryAndParseAtCops(CellularSignalQuality* qual);
     int initParser(Stream* stream);
     int checkParser();
     int waitReady();
@@ -104,6 +105,7 @@ private:
     int selectSimCard();
     int checkSimCard();
     int configureApn(const CellularNetworkConfig& conf);
+    int configureNetworkHints();
     int registerNet();
     int changeBaudRate(unsigned int baud);
     static int muxChannelStateCb(uint8_t channel, decltype(muxer_)::ChannelState oldState,
@@ -113,6 +115,7 @@ private:
     void parserError(int error);
     void resetRegistrationState();
     void checkRegistrationState();
+    int checkSignalCache(int ret);
     int processEventsImpl();
 
     int modemInit() const;
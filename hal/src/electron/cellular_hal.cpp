@@ -6,6 +6,9 @@
 #include "cellular_internal.h"
 #include "system_error.h"
 
+#include <algorithm>
+#include <cstring>
+
 #define CHECK_SUCCESS(x) { if (!(x)) return -1; }
 
 static CellularCredentials cellularCredentials;
@@ -421,6 +424,21 @@ CellularNetProvData cellular_network_provider_data_get(void* reserved)
     return CELLULAR_NET_PROVIDER_DATA[cellularNetProv];
 }
 
+int cellular_network_provider_apn_get(char* apn, size_t size, void* reserved)
+{
+    if (!apn && size) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    const char* const src = CELLULAR_NET_PROVIDER_DATA[cellularNetProv].apn;
+    const size_t n = strlen(src);
+    if (size > 0) {
+        const size_t len = std::min(n, size - 1);
+        memcpy(apn, src, len);
+        apn[len] = '\0';
+    }
+    return n;
+}
+
 int cellular_lock(void* reserved)
 {
     electronMDM.lock();
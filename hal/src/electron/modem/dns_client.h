@@ -21,6 +21,26 @@
 
 namespace particle {
 
+/**
+ * Statistics of the DNS client.
+ */
+struct DnsStats {
+    // The first bucket of the latency histogram counts the names resolved in less than
+    // `LATENCY_BUCKET_BASE` milliseconds, and every next bucket covers twice as long a time. The
+    // last bucket counts the remaining names
+    static const unsigned LATENCY_BUCKET_COUNT = 8;
+    static const unsigned LATENCY_BUCKET_BASE = 50;
+    static const unsigned MAX_SERVERS = 2;
+
+    unsigned latency[LATENCY_BUCKET_COUNT]; // Histogram of the resolution latency
+    unsigned answers[MAX_SERVERS]; // Number of names resolved by each server
+    unsigned retransmissions; // Number of retransmitted queries
+    unsigned timeouts; // Number of lookups that timed out
+    unsigned errors; // Number of lookups that failed for other reasons
+};
+
 int getHostByName(const char* name, MDM_IP* addr);
 
+int getDnsStats(DnsStats* stats);
+
 } // namespace particle
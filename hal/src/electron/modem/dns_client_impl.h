@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The message parsing code is based on LwIP's DNS client implementation
+
+/*
+ * Port to lwIP from uIP
+ * by Jim Pettinato April 2007
+ *
+ * security fixes and more by Simon Goldschmidt
+ *
+ * uIP version Copyright (c) 2002-2003, Adam Dunkels.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "dns_client.h"
+
+#include "system_error.h"
+#include "system_tick_hal.h"
+#include "endian_util.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <cstring>
+#include <cstdio>
+
+namespace particle {
+
+namespace detail {
+
+const uint16_t DNS_SERVER_PORT = 53;
+// Maximum host name length
+const size_t DNS_MAX_NAME_LENGTH = 255;
+// Buffer size
+const size_t DNS_BUFFER_SIZE = 512; // See RFC 1035 – 4.2.1. UDP usage
+
+// DNS protocol flags
+const unsigned DNS_FLAG1_RD = 0x01;
+const unsigned DNS_FLAG1_RESPONSE = 0x80;
+const unsigned DNS_FLAG2_ERR_MASK = 0x0f;
+const unsigned DNS_FLAG2_ERR_NAME = 0x03;
+
+// TYPE and CLASS fields
+const unsigned DNS_RRTYPE_A = 1; // A host address
+const unsigned DNS_RRCLASS_IN = 1; // The Internet
+
+struct DnsHeader {
+  uint16_t id;
+  uint8_t flags1;
+  uint8_t flags2;
+  uint16_t numquestions;
+  uint16_t numanswers;
+  uint16_t numauthrr;
+  uint16_t numextrarr;
+} __attribute__((packed));
+
+struct DnsTypeClass {
+  uint16_t type;
+  uint16_t cls;
+} __attribute__((packed));
+
+struct DnsAnswer {
+    uint16_t type;
+    uint16_t cls;
+    uint32_t ttl;
+    uint16_t len;
+} __attribute__((packed));
+
+inline int dnsCompareName(const char* name, const char* data, size_t size) {
+    size_t offs = 0;
+    uint8_t n = 0;
+    do {
+        if (offs >= size) {
+            return -1;
+        }
+        n = data[offs++];
+        // See RFC 1035 - 4.1.4. Message compression
+        if ((n & 0xc0) == 0xc0) {
+            // Compressed name: cannot be equal since we don't send them
+            return -1;
+        } else {
+            // Not compressed name
+            while (n > 0) {
+                if (offs >= size) {
+                    return -1;
+                }
+                const char c = data[offs];
+                if (*name != c) {
+                    return -1;
+                }
+                ++offs;
+                ++name;
+                --n;
+            }
+            ++name;
+        }
+        if (offs >= size) {
+            return -1;
+        }
+        n = data[offs];
+    } while (n != 0);
+    return offs + 1;
+}
+
+inline int dnsSkipName(const char* data, size_t size) {
+    size_t offs = 0;
+    uint8_t n = 0;
+    do {
+        if (offs >= size) {
+            return -1;
+        }
+        n = data[offs++];
+        // See RFC 1035 - 4.1.4. Message compression
+        if ((n & 0xc0) == 0xc0) {
+            // Compressed name: since we only want to skip it (not check it), stop here
+            break;
+        } else {
+            // Not compressed name
+            offs += n;
+            if (offs >= size) {
+                return -1;
+            }
+        }
+        if (offs >= size) {
+            return -1;
+        }
+        n = data[offs];
+    } while (n != 0);
+    return offs + 1;
+}
+
+// Encodes a query for the A record of the host name. Returns the size of the query
+inline int dnsEncodeQuery(uint16_t id, const char* name, char* buf, size_t size) {
+    const size_t packetSize = sizeof(DnsHeader) + strlen(name) + 2 + sizeof(DnsTypeClass);
+    if (packetSize > size) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    // Fill the header section
+    DnsHeader hdr = {};
+    hdr.id = nativeToBigEndian(id);
+    hdr.flags1 = DNS_FLAG1_RD; // Recursion Desired
+    hdr.numquestions = nativeToBigEndian((uint16_t)1);
+    memcpy(buf, &hdr, sizeof(hdr));
+    // Fill the question section
+    name = name - 1;
+    size_t offs = sizeof(DnsHeader);
+    do {
+        ++name;
+        const char* namePart = name;
+        size_t n = 0;
+        for (; *name != '.' && *name != '\0'; ++name) {
+            ++n;
+        }
+        buf[offs] = n;
+        memcpy(buf + offs + 1, namePart, name - namePart);
+        offs += n + 1;
+    } while (*name != '\0');
+    buf[offs] = '\0';
+    ++offs;
+    DnsTypeClass tc = {};
+    tc.type = nativeToBigEndian((uint16_t)DNS_RRTYPE_A);
+    tc.cls = nativeToBigEndian((uint16_t)DNS_RRCLASS_IN);
+    memcpy(buf + offs, &tc, sizeof(DnsTypeClass));
+    return packetSize;
+}
+
+// Parses a response to the query for the A record of the host name. Returns 0 if the address is
+// found, SYSTEM_ERROR_NOT_FOUND if the name doesn't have an address or other result code if the
+// server failed to resolve the name
+inline int dnsParseResponse(const char* name, const char* data, size_t packetSize, MDM_IP* addr) {
+    if (packetSize < sizeof(DnsHeader)) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    DnsHeader hdr = {};
+    memcpy(&hdr, data, sizeof(DnsHeader));
+    // Check for errors
+    if ((hdr.flags2 & DNS_FLAG2_ERR_MASK) == DNS_FLAG2_ERR_NAME) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    if (hdr.flags2 & DNS_FLAG2_ERR_MASK) {
+        return SYSTEM_ERROR_UNKNOWN;
+    }
+    hdr.numquestions = bigEndianToNative(hdr.numquestions);
+    if (!(hdr.flags1 & DNS_FLAG1_RESPONSE) || hdr.numquestions != 1) {
+        return SYSTEM_ERROR_BAD_DATA; // Unexpected response data
+    }
+    // Check if the question section matches the query
+    size_t offs = sizeof(DnsHeader);
+    int ret = dnsCompareName(name, data + offs, packetSize - offs);
+    if (ret < 0) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    offs += ret;
+    if (packetSize - offs < sizeof(DnsTypeClass)) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    DnsTypeClass tc = {};
+    memcpy(&tc, data + offs, sizeof(DnsTypeClass));
+    tc.cls = bigEndianToNative(tc.cls);
+    tc.type = bigEndianToNative(tc.type);
+    if (tc.cls != DNS_RRCLASS_IN || tc.type != DNS_RRTYPE_A) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    offs += sizeof(DnsTypeClass);
+    // Process the answer section
+    uint16_t nanswers = bigEndianToNative(hdr.numanswers);
+    while (nanswers > 0 && offs < packetSize) {
+        // Skip resource record's host name
+        int ret = dnsSkipName(data + offs, packetSize - offs);
+        if (ret < 0) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        offs += ret;
+        if (packetSize - offs < sizeof(DnsAnswer)) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        DnsAnswer answer = {};
+        memcpy(&answer, data + offs, sizeof(DnsAnswer));
+        offs += sizeof(DnsAnswer);
+        answer.cls = bigEndianToNative(answer.cls);
+        answer.type = bigEndianToNative(answer.type);
+        answer.len = bigEndianToNative(answer.len);
+        if (answer.cls == DNS_RRCLASS_IN && answer.type == DNS_RRTYPE_A && answer.len == 4) {
+            if (packetSize - offs < 4) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            uint32_t a = 0;
+            memcpy(&a, data + offs, 4);
+            *addr = bigEndianToNative(a);
+            return 0;
+        }
+        // Skip this answer
+        offs += answer.len;
+        --nanswers;
+    }
+    return SYSTEM_ERROR_NOT_FOUND;
+}
+
+/**
+ * DNS client that resolves host names to IPv4 addresses.
+ *
+ * Every query is sent to all configured servers at once and the first answer wins. A query that
+ * hasn't been answered is retransmitted with an exponential backoff until the lookup times out.
+ *
+ * Several lookups can be in flight at the same time. The responses are matched to the queries by
+ * their IDs: whichever lookup receives the pending packets from the socket completes the queries
+ * of the other lookups as well.
+ *
+ * The backend provides the following methods:
+ *
+ * - `int open()` and `void close()`: open and close the UDP socket. Opening the socket that is
+ *   already open is a no-op
+ * - `int sendTo(MDM_IP addr, int port, const char* data, size_t size)`
+ * - `int recvFrom(MDM_IP* addr, int* port, char* data, size_t size)`: returns 0 if there's no data
+ *   to read
+ * - `int waitReadable(system_tick_t timeout)`: waits until the socket has data to read. Returns a
+ *   positive value if there's data to read, 0 on timeout or a negative result code on error
+ * - `system_tick_t millis()`
+ * - `uint32_t random()`
+ * - `void lock()` and `void unlock()`: protect the client. The client is not locked while it's
+ *   waiting for data
+ */
+template<typename BackendT>
+class DnsClient {
+public:
+    static const unsigned MAX_SERVERS = DnsStats::MAX_SERVERS;
+
+    // Maximum number of lookups in flight
+    static const unsigned MAX_QUERIES = 4;
+
+    // Time after which an unanswered query is retransmitted for the first time, in milliseconds
+    static const system_tick_t INITIAL_RETRANSMIT_TIMEOUT = 1000;
+
+    // Maximum duration of a lookup, in milliseconds
+    static const system_tick_t LOOKUP_TIMEOUT = 10000;
+
+    // Maximum time the socket is waited on at once, in milliseconds
+    static const system_tick_t MAX_WAIT_TIME = 100;
+
+    // Number of times the socket is reopened if a query can't be sent
+    static const unsigned MAX_SEND_RETRIES = 1;
+
+    template<typename... ArgsT>
+    explicit DnsClient(ArgsT&&... args) :
+            backend_(std::forward<ArgsT>(args)...),
+            servers_{ IPADR(8, 8, 8, 8), IPADR(8, 8, 4, 4) },
+            serverCount_(MAX_SERVERS) {
+        for (Query& q: queries_) {
+            q.active = false;
+        }
+        memset(&stats_, 0, sizeof(stats_));
+    }
+
+    void setServers(const MDM_IP* servers, unsigned count) {
+        backend_.lock();
+        serverCount_ = (count < MAX_SERVERS) ? count : MAX_SERVERS;
+        std::copy(servers, servers + serverCount_, servers_);
+        backend_.unlock();
+    }
+
+    int getHostByName(const char* name, MDM_IP* addr) {
+        if (!name || !addr || !name[0]) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        if (strlen(name) > DNS_MAX_NAME_LENGTH) {
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        if (strcmp(name, "localhost") == 0) {
+            *addr = IPADR(127, 0, 0, 1);
+            return 0;
+        }
+        unsigned a = 0, b = 0, c = 0, d = 0;
+        if (sscanf(name, "%u.%u.%u.%u", &a, &b, &c, &d) == 4) {
+            *addr = IPADR(a, b, c, d);
+            return 0;
+        }
+        const std::unique_ptr<char[]> buf(new(std::nothrow) char[DNS_BUFFER_SIZE]);
+        if (!buf) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        backend_.lock();
+        Query* const q = allocQuery(name);
+        if (!q) {
+            backend_.unlock();
+            return SYSTEM_ERROR_LIMIT_EXCEEDED;
+        }
+        const system_tick_t start = backend_.millis();
+        system_tick_t sent = start;
+        system_tick_t retransmitTimeout = INITIAL_RETRANSMIT_TIMEOUT;
+        int r = backend_.open();
+        if (r >= 0) {
+            r = sendQuery(q, buf.get());
+        }
+        while (r >= 0 && !q->done) {
+            const system_tick_t now = backend_.millis();
+            if (now - start >= LOOKUP_TIMEOUT) {
+                r = SYSTEM_ERROR_TIMEOUT;
+                break;
+            }
+            if (now - sent >= retransmitTimeout) {
+                r = sendQuery(q, buf.get());
+                sent = now;
+                retransmitTimeout *= 2;
+                ++stats_.retransmissions;
+                continue;
+            }
+            system_tick_t waitTime = std::min(retransmitTimeout - (now - sent), LOOKUP_TIMEOUT - (now - start));
+            if (waitTime > MAX_WAIT_TIME) {
+                waitTime = MAX_WAIT_TIME;
+            }
+            backend_.unlock();
+            r = backend_.waitReadable(waitTime);
+            backend_.lock();
+            if (r > 0) {
+                r = receive(buf.get());
+            }
+        }
+        if (q->done) {
+            r = q->error;
+        }
+        if (r == 0) {
+            *addr = q->addr;
+            ++stats_.latency[latencyBucket(backend_.millis() - start)];
+            ++stats_.answers[q->server];
+        } else if (r == SYSTEM_ERROR_TIMEOUT) {
+            ++stats_.timeouts;
+        } else {
+            ++stats_.errors;
+        }
+        q->active = false;
+        backend_.unlock();
+        return r;
+    }
+
+    DnsStats stats() const {
+        backend_.lock();
+        const DnsStats stats = stats_;
+        backend_.unlock();
+        return stats;
+    }
+
+    void resetStats() {
+        backend_.lock();
+        memset(&stats_, 0, sizeof(stats_));
+        backend_.unlock();
+    }
+
+    BackendT& backend() {
+        return backend_;
+    }
+
+private:
+    struct Query {
+        const char* name;
+        MDM_IP addr;
+        int error;
+        unsigned failedServers; // Bitmask of the servers that failed to resolve the name
+        unsigned server; // Index of the server that resolved the name
+        uint16_t id;
+        bool active;
+        bool done;
+    };
+
+    mutable BackendT backend_;
+    Query queries_[MAX_QUERIES];
+    MDM_IP servers_[MAX_SERVERS];
+    unsigned serverCount_;
+    DnsStats stats_;
+
+    Query* allocQuery(const char* name) {
+        Query* q = nullptr;
+        for (Query& query: queries_) {
+            if (!query.active) {
+                q = &query;
+                break;
+            }
+        }
+        if (!q) {
+            return nullptr;
+        }
+        // Use a random ID that is not used by other lookups
+        do {
+            q->id = backend_.random();
+        } while (findQuery(q->id));
+        q->name = name;
+        q->addr = NOIP;
+        q->error = 0;
+        q->failedServers = 0;
+        q->server = 0;
+        q->active = true;
+        q->done = false;
+        return q;
+    }
+
+    Query* findQuery(uint16_t id) {
+        for (Query& q: queries_) {
+            if (q.active && !q.done && q.id == id) {
+                return &q;
+            }
+        }
+        return nullptr;
+    }
+
+    int sendQuery(Query* q, char* buf) {
+        const int size = dnsEncodeQuery(q->id, q->name, buf, DNS_BUFFER_SIZE);
+        if (size < 0) {
+            return size;
+        }
+        unsigned retries = 0;
+        for (;;) {
+            int r = 0;
+            bool sent = false;
+            for (unsigned i = 0; i < serverCount_; ++i) {
+                if (q->failedServers & (1 << i)) {
+                    continue;
+                }
+                r = backend_.sendTo(servers_[i], DNS_SERVER_PORT, buf, size);
+                if (r >= 0) {
+                    sent = true;
+                }
+            }
+            if (sent) {
+                return 0;
+            }
+            backend_.close();
+            if (retries >= MAX_SEND_RETRIES) {
+                return r;
+            }
+            r = backend_.open();
+            if (r < 0) {
+                return r;
+            }
+            ++retries;
+        }
+    }
+
+    // Reads the pending packets and completes the queries they respond to
+    int receive(char* buf) {
+        for (;;) {
+            MDM_IP addr = NOIP;
+            int port = 0;
+            const int r = backend_.recvFrom(&addr, &port, buf, DNS_BUFFER_SIZE);
+            if (r <= 0) {
+                return r;
+            }
+            const size_t size = r;
+            if (size > DNS_BUFFER_SIZE || size < sizeof(DnsHeader)) {
+                continue; // Ignore packet
+            }
+            unsigned server = 0;
+            while (server < serverCount_ && servers_[server] != addr) {
+                ++server;
+            }
+            if (server == serverCount_) {
+                continue; // Ignore packet
+            }
+            DnsHeader hdr = {};
+            memcpy(&hdr, buf, sizeof(DnsHeader));
+            Query* const q = findQuery(bigEndianToNative(hdr.id));
+            if (!q || (q->failedServers & (1 << server))) {
+                continue; // Late or unexpected response
+            }
+            MDM_IP a = NOIP;
+            const int ret = dnsParseResponse(q->name, buf, size, &a);
+            if (ret == SYSTEM_ERROR_BAD_DATA) {
+                continue; // Ignore malformed packet
+            }
+            if (ret == 0 || ret == SYSTEM_ERROR_NOT_FOUND) {
+                // The first answer wins
+                q->addr = a;
+                q->error = ret;
+                q->server = server;
+                q->done = true;
+            } else {
+                // Wait for the other servers unless all of them have failed
+                q->failedServers |= (1 << server);
+                if (q->failedServers == (1u << serverCount_) - 1) {
+                    q->error = ret;
+                    q->done = true;
+                }
+            }
+        }
+    }
+
+    static unsigned latencyBucket(system_tick_t t) {
+        unsigned i = 0;
+        system_tick_t limit = DnsStats::LATENCY_BUCKET_BASE;
+        while (i < DnsStats::LATENCY_BUCKET_COUNT - 1 && t >= limit) {
+            ++i;
+            limit *= 2;
+        }
+        return i;
+    }
+};
+
+} // namespace detail
+
+} // namespace particle
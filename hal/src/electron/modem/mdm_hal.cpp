@@ -2264,7 +2264,6 @@ bool MDMParser::detach(void)
 MDM_IP MDMParser::gethostbyname(const char* host)
 {
     MDM_IP ip = NOIP;
-    LOCK();
     // We've seen SARA U2XX modems stuck returning potentially cached DNS lookup results
     // for longer than records' TTL despite the fact that DNS records have been modified.
     // The only thing that caused AT+UDNSRN to correctly re-resolve in those particular
@@ -2272,8 +2271,11 @@ MDM_IP MDMParser::gethostbyname(const char* host)
     // In order to remove this layer of uncertainty with AT+UDNSRN we are using our own DNS
     // client on all Gen 2 cellular devices now, whereas previously we've only used it for LTE
     // SARA R4 devices where AT+UDNSRN was not supported (see below).
+    // The DNS client locks the modem for each operation on its socket rather than for
+    // the whole lookup, so that several lookups can be in flight at the same time.
     particle::getHostByName(host, &ip);
 #if 0
+    LOCK();
     if (_dev.dev == DEV_SARA_R410) {
         // Current uBlox firmware (L0.0.00.00.05.05) doesn't support +UDNSRN command, so we have to
         // use our own DNS client
@@ -2289,8 +2291,8 @@ MDM_IP MDMParser::gethostbyname(const char* host)
             }
         }
     }
-#endif // 0
     UNLOCK();
+#endif // 0
     return ip;
 }
 
@@ -2833,6 +2835,31 @@ int MDMParser::socketReadable(int socket)
     return pending;
 }
 
+int MDMParser::socketWaitReadable(int socket, system_tick_t timeout_ms)
+{
+    int pending = MDM_SOCKET_ERROR;
+    if (_cancel_all_operations)
+            return MDM_SOCKET_ERROR;
+    LOCK();
+    if (ISSOCKET(socket) && _sockets[socket].connected) {
+        // Process the unsolicited commands until the modem reports incoming data
+        // for this socket (+UUSORF/+UUSORD) or the socket gets closed
+        if (_sockets[socket].pending <= 0)
+            waitFinalResp(_cbSocketPending, &_sockets[socket], timeout_ms);
+        if (_sockets[socket].connected)
+           pending = _sockets[socket].pending;
+    }
+    UNLOCK();
+    return pending;
+}
+
+int MDMParser::_cbSocketPending(int type, const char* buf, int len, SockCtrl* sock)
+{
+    if (sock->pending > 0 || !sock->connected)
+        return RESP_OK;
+    return WAIT;
+}
+
 int MDMParser::_cbUSORD(int type, const char* buf, int len, USORDparam* param)
 {
 #ifndef SOCKET_HEX_MODE
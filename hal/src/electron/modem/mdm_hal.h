@@ -259,6 +259,13 @@ public:
     */
     int socketReadable(int socket);
 
+    /** Wait until this socket has data pending for reading
+        \param socket the socket handle
+        \param timeout_ms the maximum time to wait
+        \return the number of bytes pending (0 on timeout) or SOCKET_ERROR on failure
+    */
+    int socketWaitReadable(int socket, system_tick_t timeout_ms);
+
     /** Read this socket
         \param socket the socket handle
         \param buf the buffer to read into
@@ -612,6 +619,7 @@ protected:
         volatile int pending;
         volatile bool open;
     } SockCtrl;
+    static int _cbSocketPending(int type, const char* buf, int len, SockCtrl* sock);
     // LISA-C has 6 TCP and 6 UDP sockets
     // LISA-U and SARA-G have 7 sockets
     SockCtrl _sockets[7];
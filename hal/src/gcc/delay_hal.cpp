@@ -19,16 +19,15 @@
 #include "delay_hal.h"
 #include "timer_hal.h"
 
-#include "boost_posix_time_wrap.h"
-#include "boost_thread_wrap.h"
+#include "simulation.h"
 
 void HAL_Delay_Milliseconds(uint32_t millis)
 {
-    boost::this_thread::sleep(boost::posix_time::milliseconds(millis));
+    particle::simulation::delay((uint64_t)millis * 1000);
 }
 
 void HAL_Delay_Microseconds(uint32_t micros)
 {
-    boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    particle::simulation::delay(micros);
 }
 
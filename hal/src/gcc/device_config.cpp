@@ -95,6 +95,17 @@ public:
             ("server_key,sk", po::value<string>(&config.server_key)->default_value("server_key.der"), "the filename containing the server public key")
             ("state,s", po::value<string>(&config.periph_directory)->default_value("state"), "the directory where device state and peripherals is stored")
 			("protocol,p", po::value<ProtocolFactory>(&config.protocol)->default_value(PROTOCOL_LIGHTSSL), "the cloud communication protocol to use")
+			("virtual_time", po::bool_switch(&config.simulation.virtualTime), "run on a virtual clock that advances only when the device waits")
+			("seed", po::value<uint32_t>(&config.simulation.seed)->default_value(0), "seed of the random number generator (0 - use a hardware source)")
+			("duration", po::value<uint32_t>(&config.simulation.duration)->default_value(0), "simulated time in seconds after which the device exits (0 - run forever)")
+			("net_loss", po::value<double>(&config.impairment.loss)->default_value(0.0), "probability of a UDP datagram being dropped (0-1)")
+			("net_duplication", po::value<double>(&config.impairment.duplication)->default_value(0.0), "probability of a UDP datagram being duplicated (0-1)")
+			("net_reordering", po::value<double>(&config.impairment.reordering)->default_value(0.0), "probability of a UDP datagram bypassing the latency (0-1)")
+			("net_latency", po::value<unsigned>(&config.impairment.latency)->default_value(0), "one-way UDP latency in milliseconds")
+			("net_jitter", po::value<unsigned>(&config.impairment.jitter)->default_value(0), "maximum deviation of the UDP latency in milliseconds")
+			("net_bandwidth", po::value<unsigned>(&config.impairment.bandwidth)->default_value(0), "UDP bandwidth in bytes per second in each direction (0 - unlimited)")
+			("net_nat_rebinding", po::value<unsigned>(&config.impairment.natRebinding)->default_value(0), "interval in seconds at which the local UDP port changes (0 - never)")
+			("net_trace", po::value<string>(&config.impairment.trace), "CSV file to which UDP datagram events are written")
 			;
 
         command_line_options.add(program_options).add(device_options);
@@ -201,5 +212,9 @@ void DeviceConfig::read(Configuration& configuration)
     setLoggerLevel(LoggerOutputLevel(NO_LOG_LEVEL-configuration.log_level));
 
     this->protocol = configuration.protocol;
+
+    particle::simulation::init(configuration.simulation);
+    configuration.impairment.seed = configuration.simulation.seed;
+    particle::simulation::initNetworkImpairment(configuration.impairment);
 }
 
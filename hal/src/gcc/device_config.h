@@ -22,6 +22,8 @@
 #include <stdexcept>
 #include <cstring>
 #include "filesystem.h"
+#include "simulation.h"
+#include "network_impairment.h"
 #include "spark_protocol_functions.h"
 
 extern const char* DEVICE_ID;
@@ -53,6 +55,8 @@ struct Configuration
     std::string periph_directory;
     uint16_t log_level = 0;
     ProtocolFactory protocol = PROTOCOL_LIGHTSSL;
+    particle::simulation::Config simulation;
+    particle::simulation::ImpairmentConfig impairment;
 };
 
 
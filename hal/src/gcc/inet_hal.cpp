@@ -2,6 +2,7 @@
 #include "inet_hal.h"
 
 #include "device_globals.h"
+#include "simulation.h"
 
 namespace ip = boost::asio::ip;
 
@@ -9,6 +10,7 @@ int inet_gethostbyname(const char* hostname, uint16_t hostnameLen, HAL_IPAddress
         network_interface_t nif, void* reserved)
 {
     out_ip_addr->ipv4 = 0;
+    particle::simulation::NetworkWait wait;
     ip::tcp::resolver resolver(device_io_service);
     ip::tcp::resolver::query query(hostname, "");
     for(ip::tcp::resolver::iterator i = resolver.resolve(query);
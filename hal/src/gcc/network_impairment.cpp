@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network_impairment.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace particle {
+
+namespace simulation {
+
+namespace {
+
+const char* const DIRECTION_NAMES[] = { "out", "in" };
+
+std::unique_ptr<NetworkImpairment> g_impairment;
+
+} // unnamed
+
+NetworkImpairment::NetworkImpairment(const ImpairmentConfig& conf) :
+        conf_(conf),
+        rng_(conf.seed ? conf.seed : std::random_device()()) {
+    if (!conf_.trace.empty()) {
+        trace_.open(conf_.trace.c_str(), std::ios::out | std::ios::trunc);
+        trace_ << "time_us,socket,direction,event,size,latency_us" << std::endl;
+    }
+}
+
+bool NetworkImpairment::isEnabled() const {
+    return conf_.loss > 0 || conf_.duplication > 0 || conf_.reordering > 0 || conf_.latency || conf_.jitter ||
+            conf_.bandwidth || conf_.natRebinding || trace_.is_open();
+}
+
+void NetworkImpairment::send(int sock, const void* data, size_t size, uint32_t addr, uint16_t port, uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enqueue(sock, OUTGOING, data, size, addr, port, now);
+}
+
+bool NetworkImpairment::nextOutgoing(int sock, uint64_t now, Datagram* d) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dequeue(sock, OUTGOING, now, d);
+}
+
+void NetworkImpairment::receive(int sock, const void* data, size_t size, uint32_t addr, uint16_t port, uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enqueue(sock, INCOMING, data, size, addr, port, now);
+}
+
+bool NetworkImpairment::nextIncoming(int sock, uint64_t now, Datagram* d) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dequeue(sock, INCOMING, now, d);
+}
+
+bool NetworkImpairment::checkRebinding(int sock, uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& s = socks_[sock];
+    if (!s.bound) {
+        s.boundTime = now;
+        s.bound = true;
+        return false;
+    }
+    if (!conf_.natRebinding || now - s.boundTime < (uint64_t)conf_.natRebinding * 1000000) {
+        return false;
+    }
+    s.boundTime = now;
+    // Datagrams in flight to the old port are lost
+    const auto dropped = s.paths[INCOMING].queue.size();
+    s.paths[INCOMING].queue.clear();
+    trace(now, sock, INCOMING, "rebind", dropped);
+    return true;
+}
+
+void NetworkImpairment::reset(int sock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    socks_.erase(sock);
+}
+
+std::vector<int> NetworkImpairment::sockets() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<int> socks;
+    for (const auto& s: socks_) {
+        socks.push_back(s.first);
+    }
+    return socks;
+}
+
+void NetworkImpairment::enqueue(int sock, Direction dir, const void* data, size_t size, uint32_t addr, uint16_t port,
+        uint64_t now) {
+    if (chance(conf_.loss)) {
+        trace(now, sock, dir, "drop", size);
+        return;
+    }
+    auto& path = socks_[sock].paths[dir];
+    const unsigned copies = chance(conf_.duplication) ? 2 : 1;
+    for (unsigned i = 0; i < copies; ++i) {
+        // Serialization delay of a bandwidth-limited link
+        uint64_t t = std::max(now, path.busyUntil);
+        if (conf_.bandwidth) {
+            t += (uint64_t)size * 1000000 / conf_.bandwidth;
+        }
+        path.busyUntil = t;
+        if (!chance(conf_.reordering)) {
+            t += delay();
+        }
+        Datagram d;
+        d.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+        d.addr = addr;
+        d.port = port;
+        d.sentTime = now;
+        d.dueTime = t;
+        // Keep the queue sorted by due time, preserving the order of datagrams that are due at the same time
+        const auto it = std::upper_bound(path.queue.begin(), path.queue.end(), t, [](uint64_t t, const Datagram& d) {
+            return t < d.dueTime;
+        });
+        path.queue.insert(it, std::move(d));
+        trace(now, sock, dir, (i == 0) ? "send" : "duplicate", size);
+    }
+}
+
+bool NetworkImpairment::dequeue(int sock, Direction dir, uint64_t now, Datagram* d) {
+    const auto it = socks_.find(sock);
+    if (it == socks_.end()) {
+        return false;
+    }
+    auto& queue = it->second.paths[dir].queue;
+    if (queue.empty() || queue.front().dueTime > now) {
+        return false;
+    }
+    *d = std::move(queue.front());
+    queue.pop_front();
+    trace(now, sock, dir, "deliver", d->data.size(), now - d->sentTime);
+    return true;
+}
+
+uint64_t NetworkImpairment::delay() {
+    int64_t ms = conf_.latency;
+    if (conf_.jitter) {
+        std::uniform_int_distribution<int> dist(-(int)conf_.jitter, conf_.jitter);
+        ms += dist(rng_);
+    }
+    return (ms > 0) ? ms * 1000 : 0;
+}
+
+bool NetworkImpairment::chance(double probability) {
+    if (probability <= 0) {
+        return false;
+    }
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    return dist(rng_) < probability;
+}
+
+void NetworkImpairment::trace(uint64_t now, int sock, Direction dir, const char* event, size_t size, uint64_t latency) {
+    if (trace_.is_open()) {
+        trace_ << now << ',' << sock << ',' << DIRECTION_NAMES[dir] << ',' << event << ',' << size << ',' << latency << '\n';
+    }
+}
+
+NetworkImpairment* networkImpairment() {
+    return g_impairment.get();
+}
+
+void initNetworkImpairment(const ImpairmentConfig& conf) {
+    g_impairment.reset(new NetworkImpairment(conf));
+    if (!g_impairment->isEnabled()) {
+        g_impairment.reset();
+    }
+}
+
+} // particle::simulation
+
+} // particle
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <fstream>
+#include <random>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+namespace simulation {
+
+/**
+ * Network impairment settings.
+ */
+struct ImpairmentConfig {
+    double loss = 0.0; // Probability of a datagram being dropped
+    double duplication = 0.0; // Probability of a datagram being delivered twice
+    double reordering = 0.0; // Probability of a datagram bypassing the latency queue
+    unsigned latency = 0; // One-way delay in milliseconds
+    unsigned jitter = 0; // Maximum random deviation of the delay in milliseconds
+    unsigned bandwidth = 0; // Bytes per second in each direction, or 0 if unlimited
+    unsigned natRebinding = 0; // Interval in seconds at which the local UDP port changes, or 0
+    uint32_t seed = 0; // Seed of the random number generator
+    std::string trace; // Name of a CSV file to which datagram events are written
+};
+
+/**
+ * UDP datagram in flight.
+ */
+struct Datagram {
+    std::vector<uint8_t> data;
+    uint32_t addr; // IPv4 address of the remote host, in host byte order
+    uint16_t port; // Port of the remote host
+    uint64_t sentTime; // Time when the datagram was sent, in microseconds
+    uint64_t dueTime; // Time when the datagram is delivered, in microseconds
+};
+
+/**
+ * Emulates an impaired network path between the virtual device and its UDP peers.
+ *
+ * Outgoing datagrams are passed to `send()` and the socket layer transmits the datagrams
+ * returned by `nextOutgoing()` once they are due. Datagrams received from the real network are
+ * passed to `receive()` and handed over to the application by `nextIncoming()`. The time is
+ * provided by the caller, so that the emulator can run on the virtual clock.
+ *
+ * The methods of this class can be called from different threads.
+ */
+class NetworkImpairment {
+public:
+    enum Direction {
+        OUTGOING = 0,
+        INCOMING = 1
+    };
+
+    explicit NetworkImpairment(const ImpairmentConfig& conf);
+
+    bool isEnabled() const;
+
+    void send(int sock, const void* data, size_t size, uint32_t addr, uint16_t port, uint64_t now);
+    bool nextOutgoing(int sock, uint64_t now, Datagram* d);
+
+    void receive(int sock, const void* data, size_t size, uint32_t addr, uint16_t port, uint64_t now);
+    bool nextIncoming(int sock, uint64_t now, Datagram* d);
+
+    /**
+     * Returns `true` if the socket needs to be rebound to a new local port.
+     */
+    bool checkRebinding(int sock, uint64_t now);
+
+    /**
+     * Discards all datagrams of a socket. This method is called when the socket is closed.
+     */
+    void reset(int sock);
+
+    /**
+     * Returns the sockets that have been passed to the emulator and haven't been reset.
+     */
+    std::vector<int> sockets();
+
+private:
+    struct Path {
+        std::deque<Datagram> queue; // Sorted by due time
+        uint64_t busyUntil = 0; // Time when the link becomes idle
+    };
+
+    struct Socket {
+        Path paths[2];
+        uint64_t boundTime = 0;
+        bool bound = false;
+    };
+
+    ImpairmentConfig conf_;
+    std::mutex mutex_; // Protects the socket queues, the random number generator and the trace file
+    std::map<int, Socket> socks_;
+    std::mt19937 rng_;
+    std::ofstream trace_;
+
+    void enqueue(int sock, Direction dir, const void* data, size_t size, uint32_t addr, uint16_t port, uint64_t now);
+    bool dequeue(int sock, Direction dir, uint64_t now, Datagram* d);
+    uint64_t delay();
+    bool chance(double probability);
+    void trace(uint64_t now, int sock, Direction dir, const char* event, size_t size, uint64_t latency = 0);
+};
+
+/**
+ * Returns the instance used by the socket HAL.
+ */
+NetworkImpairment* networkImpairment();
+
+/**
+ * Configures the instance used by the socket HAL.
+ */
+void initNetworkImpairment(const ImpairmentConfig& conf);
+
+} // particle::simulation
+
+} // particle
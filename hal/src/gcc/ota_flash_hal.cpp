@@ -6,6 +6,14 @@
 #include "core_hal.h"
 #include "filesystem.h"
 #include "bytes2hexbuf.h"
+#include "ota_flash_pipeline.h"
+#include "simulation.h"
+#include "timer_hal.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 
 void HAL_System_Info(hal_system_info_t* info, bool create, void* reserved)
 {
@@ -31,19 +39,141 @@ uint16_t HAL_OTA_ChunkSize()
 
 FILE* output_file;
 
+namespace {
+
+// Typical timings of the external SPI flash used by the Gen 3 devices
+const size_t SIMULATED_FLASH_SECTOR_SIZE = 4096;
+const size_t SIMULATED_FLASH_PAGE_SIZE = 256;
+const uint64_t SIMULATED_FLASH_ERASE_TIME = 45000; // Microseconds per sector
+const uint64_t SIMULATED_FLASH_PROGRAM_TIME = 700; // Microseconds per page
+
+class Semaphore {
+public:
+    Semaphore() :
+            given_(false) {
+    }
+
+    void give() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            given_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    void take(system_tick_t timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout), [this]() { return given_; });
+        given_ = false;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool given_;
+};
+
+// Stages the OTA data in output.bin, with the erase and program latencies of a NOR flash
+class SimulatedFlashBackend {
+public:
+    int erase(uintptr_t addr) {
+        particle::simulation::delay(SIMULATED_FLASH_ERASE_TIME);
+        const std::vector<uint8_t> buf(SIMULATED_FLASH_SECTOR_SIZE, 0xff);
+        return writeFile(addr - addr % SIMULATED_FLASH_SECTOR_SIZE, buf.data(), buf.size());
+    }
+
+    int write(uintptr_t addr, const uint8_t* data, size_t size) {
+        DEBUG("flash write %d %d", (int)addr, (int)size);
+        const size_t pages = (size + SIMULATED_FLASH_PAGE_SIZE - 1) / SIMULATED_FLASH_PAGE_SIZE;
+        particle::simulation::delay(pages * SIMULATED_FLASH_PROGRAM_TIME);
+        return writeFile(addr, data, size);
+    }
+
+    size_t sectorSize() {
+        return SIMULATED_FLASH_SECTOR_SIZE;
+    }
+
+    void lock() {
+        mutex_.lock();
+    }
+
+    void unlock() {
+        mutex_.unlock();
+    }
+
+    void notifyWorker() {
+        worker_.give();
+    }
+
+    void waitWorker(system_tick_t timeout) {
+        worker_.take(timeout);
+    }
+
+    void notifyProducer() {
+        producer_.give();
+    }
+
+    void waitProducer(system_tick_t timeout) {
+        producer_.take(timeout);
+    }
+
+    system_tick_t millis() {
+        return HAL_Timer_Get_Milli_Seconds();
+    }
+
+private:
+    std::mutex mutex_;
+    Semaphore worker_;
+    Semaphore producer_;
+
+    int writeFile(uintptr_t addr, const uint8_t* data, size_t size) {
+        if (!output_file || fseek(output_file, addr, SEEK_SET) != 0 || fwrite(data, size, 1, output_file) != 1) {
+            return SYSTEM_ERROR_IO;
+        }
+        return 0;
+    }
+};
+
+typedef particle::detail::OtaFlashPipeline<SimulatedFlashBackend> OtaFlashPipeline;
+
+bool startOtaPipelineThread(OtaFlashPipeline* pipeline) {
+    std::thread([pipeline]() {
+        for (;;) {
+            if (!pipeline->process()) {
+                pipeline->backend()->waitWorker(1000);
+            }
+        }
+    }).detach();
+    return true;
+}
+
+OtaFlashPipeline& otaPipeline() {
+    static OtaFlashPipeline pipeline;
+    static const bool started = startOtaPipelineThread(&pipeline);
+    (void)started;
+    return pipeline;
+}
+
+} // namespace
+
 bool HAL_FLASH_Begin(uint32_t sFLASH_Address, uint32_t fileSize, void* reserved)
 {
+    auto& pipeline = otaPipeline();
+    pipeline.cancel();
+    if (output_file) {
+        fclose(output_file);
+    }
     output_file = fopen("output.bin", "wb");
+    if (!output_file) {
+        return false;
+    }
     DEBUG("flash started");
-    return output_file;
+    return pipeline.begin(sFLASH_Address, fileSize) == 0;
 }
 
 int HAL_FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t length, void* reserved)
 {
-	DEBUG("flash write %d %d", address, length);
-	fseek(output_file, address, SEEK_SET);
-    fwrite(pBuffer, length, 1, output_file);
-    return 0;
+    return otaPipeline().update(address, pBuffer, length);
 }
 
 int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_validation_flags_t flags, void* reserved)
@@ -53,9 +183,17 @@ int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_vali
 
  hal_update_complete_t HAL_FLASH_End(hal_module_t* mod)
 {
-	 fclose(output_file);
-	 output_file = NULL;
-     return HAL_UPDATE_APPLIED;
+    auto& pipeline = otaPipeline();
+    const int ret = pipeline.active() ? pipeline.end() : 0;
+    const auto st = pipeline.stats();
+    DEBUG("OTA pipeline: %u erases (%u ahead), %u writes, producer waited %u ms", (unsigned)st.erases,
+            (unsigned)st.erasesAhead, (unsigned)st.writes, (unsigned)st.waitTime);
+    pipeline.resetStats();
+    if (output_file) {
+        fclose(output_file);
+        output_file = NULL;
+    }
+    return (ret == 0) ? HAL_UPDATE_APPLIED : HAL_UPDATE_ERROR;
 }
 
 hal_update_complete_t HAL_FLASH_ApplyPendingUpdate(hal_module_t* module, bool dryRun, void* reserved)
@@ -1,5 +1,6 @@
 
 #include "rng_hal.h"
+#include "simulation.h"
 #include <boost/random/random_device.hpp>
 
 using namespace boost::random;
@@ -12,5 +13,9 @@ void HAL_RNG_Configuration(void)
 
 uint32_t HAL_RNG_GetRandomNumber(void)
 {
+	uint32_t value = 0;
+	if (particle::simulation::random(&value)) {
+		return value; // Reproducible sequence
+	}
 	return rng();
 }
@@ -1,5 +1,6 @@
 
 #include "rtc_hal.h"
+#include "simulation.h"
 
 
 #include "boost_posix_time_wrap.h"
@@ -20,8 +21,17 @@ time_t to_time_t(boost::posix_time::ptime t)
 }
 #endif
 
+namespace {
+
+const auto start = boost::posix_time::microsec_clock::universal_time();
+
+} // namespace
+
 time_t HAL_RTC_Get_UnixTime(void)
 {
+    if (particle::simulation::isVirtualTime()) {
+        return to_time_t(start) + particle::simulation::micros() / 1000000;
+    }
     auto now = boost::posix_time::microsec_clock::universal_time();
     return to_time_t(now);
 }
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation, either
+# version 3 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, see <http://www.gnu.org/licenses/>.
+
+# Summarizes a datagram trace written by the network impairment layer of the virtual device
+# (see the `net_trace` option). Reports the number of datagrams dropped and duplicated, the delay
+# injected by the impairment layer and the protocol overhead per payload byte.
+#
+# If the device log is given, also reports the CoAP message latency, from the first transmission
+# of a confirmable message to its acknowledgement, and the number of retransmissions. The log has
+# to include the trace messages of the `comm.coap` category (`--verbosity 70`).
+
+import argparse
+import csv
+import re
+import sys
+
+PERCENTILES = (50, 90, 99)
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    k = (len(values) - 1) * p / 100.0
+    i = int(k)
+    j = min(i + 1, len(values) - 1)
+    return values[i] + (values[j] - values[i]) * (k - i)
+
+def load(path):
+    stats = {}
+    duration = 0
+    with open(path) as f:
+        for row in csv.DictReader(f):
+            d = stats.setdefault(row['direction'], {
+                'send': 0, 'duplicate': 0, 'drop': 0, 'deliver': 0, 'rebind': 0,
+                'bytes': 0, 'latency': []
+            })
+            event = row['event']
+            size = int(row['size'])
+            d[event] += 1
+            if event in ('send', 'duplicate', 'drop'):
+                d['bytes'] += size
+            if event == 'deliver':
+                d['latency'].append(int(row['latency_us']) / 1000.0)
+            duration = max(duration, int(row['time_us']))
+    return stats, duration
+
+ACK_RE = re.compile(r'Message acknowledged: id=[0-9a-f]+, latency: (\d+) ms, transmissions: (\d+)')
+RETRANSMIT_RE = re.compile(r'Retransmitting message: id=[0-9a-f]+')
+TIMEOUT_RE = re.compile(r'Message timed out: id=[0-9a-f]+')
+
+def load_device_log(path):
+    stats = {'acknowledged': 0, 'retransmitted': 0, 'retransmissions': 0, 'timeouts': 0, 'latency': []}
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = ACK_RE.search(line)
+            if m:
+                stats['acknowledged'] += 1
+                stats['latency'].append(int(m.group(1)))
+                if int(m.group(2)) > 1:
+                    stats['retransmitted'] += 1
+            elif RETRANSMIT_RE.search(line):
+                stats['retransmissions'] += 1
+            elif TIMEOUT_RE.search(line):
+                stats['timeouts'] += 1
+    return stats
+
+def format_percentiles(values):
+    return ', '.join('p%d=%.1f' % (p, percentile(values, p)) for p in PERCENTILES)
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('trace', help='CSV trace file')
+    parser.add_argument('--name', default=None, help='scenario name')
+    parser.add_argument('--payload-bytes', type=int, default=0,
+            help='number of application payload bytes exchanged during the scenario')
+    parser.add_argument('--device-log', default=None,
+            help='log of the virtual device, used for the CoAP message statistics')
+    args = parser.parse_args()
+
+    stats, duration = load(args.trace)
+    if args.name:
+        print('Scenario: %s' % args.name)
+    print('Duration: %.1f s' % (duration / 1000000.0))
+    total = 0
+    for direction in ('out', 'in'):
+        d = stats.get(direction)
+        if not d:
+            continue
+        total += d['bytes']
+        print('[%s] datagrams: %d, duplicated: %d, dropped: %d, delivered: %d, bytes: %d' % (direction,
+                d['send'] + d['drop'], d['duplicate'], d['drop'], d['deliver'], d['bytes']))
+        print('[%s] injected delay per datagram (ms): %s' % (direction, format_percentiles(d['latency'])))
+        if d['rebind']:
+            print('[%s] NAT rebindings: %d' % (direction, d['rebind']))
+    print('Bytes on air: %d' % total)
+    if args.payload_bytes:
+        print('Overhead per payload byte: %.2f' % ((total - args.payload_bytes) / float(args.payload_bytes)))
+    if args.device_log:
+        c = load_device_log(args.device_log)
+        print('CoAP messages acknowledged: %d, retransmitted: %d, timed out: %d, retransmissions: %d' % (
+                c['acknowledged'], c['retransmitted'], c['timeouts'], c['retransmissions']))
+        print('CoAP message latency (ms): %s' % format_percentiles(c['latency']))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,48 @@
+#!/bin/bash
+#
+# Runs the virtual device under a set of network conditions and prints a report for each of them.
+#
+# Usage: run_scenarios.sh <device executable> <payload bytes> [device options...]
+#
+# The device runs on the virtual clock for $DURATION simulated seconds (1 hour by default) with
+# the UDP protocol. <payload bytes> is the amount of application data the firmware exchanges with
+# the cloud during that time; it's used to compute the protocol overhead. The CoAP message latency
+# and the retransmissions are taken from the device log, which is written with all trace messages.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 <device executable> <payload bytes> [device options...]" >&2
+  exit 1
+fi
+
+device=$1
+payload=$2
+shift 2
+
+this_dir=$(cd "$(dirname "$0")" && pwd)
+duration=${DURATION:-3600}
+seed=${SEED:-1}
+out_dir=${OUT_DIR:-scenario_traces}
+mkdir -p "$out_dir"
+
+# name|impairment options
+scenarios=(
+  "baseline|"
+  "lte_m1|--net_latency 150 --net_jitter 50 --net_loss 0.01 --net_bandwidth 40000"
+  "nb_iot|--net_latency 1500 --net_jitter 500 --net_loss 0.03 --net_bandwidth 2000"
+  "lossy|--net_latency 100 --net_jitter 20 --net_loss 0.1 --net_duplication 0.02 --net_reordering 0.05"
+  "nat_rebinding|--net_latency 100 --net_nat_rebinding 120"
+)
+
+for s in "${scenarios[@]}"; do
+  name=${s%%|*}
+  opts=${s#*|}
+  trace="$out_dir/$name.csv"
+  log="$out_dir/$name.log"
+  "$device" --protocol udp --virtual_time --seed "$seed" --duration "$duration" --verbosity 70 \
+      --net_trace "$trace" $opts "$@" > "$log" 2>&1 || true
+  python3 "$this_dir/impairment_report.py" "$trace" --name "$name" --payload-bytes "$payload" \
+      --device-log "$log"
+  echo
+done
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simulation.h"
+#include "virtual_clock.h"
+
+#include "boost_posix_time_wrap.h"
+#include "boost_thread_wrap.h"
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstdlib>
+
+namespace particle {
+
+namespace simulation {
+
+namespace {
+
+const auto start = boost::posix_time::microsec_clock::universal_time();
+
+Config g_conf;
+
+// Not destroyed on exit, since other threads may still be sleeping on it
+VirtualClock* const g_clock = new VirtualClock();
+std::thread::id g_mainThread;
+
+std::atomic<uint64_t> g_wakeups(0);
+std::atomic<uint64_t> g_delays(0);
+std::atomic<uint64_t> g_bytesSent(0);
+std::atomic<uint64_t> g_bytesReceived(0);
+
+boost::random::mt19937 g_rng;
+std::mutex g_rngMutex;
+
+uint64_t perHour(uint64_t value, uint64_t us) {
+    if (!us) {
+        return 0;
+    }
+    return (uint64_t)((double)value * 3600000000.0 / us);
+}
+
+void finish() {
+    if (std::this_thread::get_id() != g_mainThread) {
+        // Let the main thread exit the process
+        for (;;) {
+            boost::this_thread::sleep(boost::posix_time::hours(1));
+        }
+    }
+    std::cout << "Simulation finished" << std::endl;
+    std::exit(0); // Statistics are printed by the exit handler
+}
+
+void exitHandler() {
+    printStats();
+}
+
+} // unnamed
+
+void init(const Config& conf) {
+    g_conf = conf;
+    g_mainThread = std::this_thread::get_id();
+    if (conf.virtualTime) {
+        // The clock waits for the application thread to sleep before advancing
+        g_clock->addThread();
+        g_clock->limit((uint64_t)conf.duration * 1000000);
+    }
+    if (conf.seed) {
+        g_rng.seed(conf.seed);
+    }
+    if (conf.virtualTime || conf.duration) {
+        std::atexit(exitHandler);
+    }
+}
+
+bool isVirtualTime() {
+    return g_conf.virtualTime;
+}
+
+uint64_t micros() {
+    if (g_conf.virtualTime) {
+        const auto t = g_clock->now();
+        if (g_clock->limitReached() && std::this_thread::get_id() == g_mainThread) {
+            finish();
+        }
+        return t;
+    }
+    const auto now = boost::posix_time::microsec_clock::universal_time();
+    return (now - start).total_microseconds();
+}
+
+void delay(uint64_t us) {
+    ++g_delays;
+    if (g_conf.virtualTime) {
+        if (!g_clock->sleep(us)) {
+            finish();
+        }
+    } else {
+        boost::this_thread::sleep(boost::posix_time::microseconds(us));
+        if (g_conf.duration && micros() >= (uint64_t)g_conf.duration * 1000000) {
+            finish();
+        }
+    }
+}
+
+bool random(uint32_t* value) {
+    if (!g_conf.seed) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_rngMutex);
+    *value = g_rng();
+    return true;
+}
+
+NetworkWait::NetworkWait() {
+    if (g_conf.virtualTime) {
+        g_clock->beginExternalWait();
+    }
+}
+
+NetworkWait::~NetworkWait() {
+    if (g_conf.virtualTime) {
+        g_clock->endExternalWait();
+    }
+}
+
+void countWakeup() {
+    ++g_wakeups;
+}
+
+void countSent(size_t size) {
+    g_bytesSent += size;
+}
+
+void countReceived(size_t size) {
+    g_bytesReceived += size;
+}
+
+Stats stats() {
+    Stats s = {};
+    if (g_conf.virtualTime) {
+        s.elapsedMicros = g_clock->peek();
+    } else {
+        s.elapsedMicros = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+    }
+    s.wakeups = g_wakeups;
+    s.delays = g_delays;
+    s.bytesSent = g_bytesSent;
+    s.bytesReceived = g_bytesReceived;
+    if (g_conf.virtualTime) {
+        s.idleAdvances = g_clock->idleAdvances();
+    }
+    return s;
+}
+
+void printStats() {
+    const auto s = stats();
+    const auto us = s.elapsedMicros;
+    std::cout << boost::format("Simulated time: %.3f s (%s clock)") % (us / 1000000.0) %
+            (g_conf.virtualTime ? "virtual" : "wall") << std::endl;
+    std::cout << boost::format("Wakeups: %u (%u/h)") % s.wakeups % perHour(s.wakeups, us) << std::endl;
+    std::cout << boost::format("Delays: %u (%u/h)") % s.delays % perHour(s.delays, us) << std::endl;
+    std::cout << boost::format("Bytes sent: %u (%u/h)") % s.bytesSent % perHour(s.bytesSent, us) << std::endl;
+    std::cout << boost::format("Bytes received: %u (%u/h)") % s.bytesReceived % perHour(s.bytesReceived, us) << std::endl;
+    if (g_conf.virtualTime) {
+        std::cout << boost::format("Idle clock advances: %u") % s.idleAdvances << std::endl;
+    }
+}
+
+} // particle::simulation
+
+} // particle
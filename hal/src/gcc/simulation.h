@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+namespace simulation {
+
+/**
+ * Simulation settings of the virtual device.
+ */
+struct Config {
+    bool virtualTime = false; // Run on a virtual clock instead of the wall clock
+    uint32_t seed = 0; // Seed of the random number generator, or 0 to use a hardware source
+    uint32_t duration = 0; // Simulated time in seconds after which the device exits, or 0
+};
+
+/**
+ * Counters collected during a simulation.
+ */
+struct Stats {
+    uint64_t elapsedMicros; // Simulated time
+    uint64_t wakeups; // Number of times the device woke up from sleep
+    uint64_t delays; // Number of delay calls
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    uint64_t idleAdvances; // Number of times the virtual clock advanced after waiting on the wall clock
+};
+
+/**
+ * Initializes the simulation.
+ *
+ * In the virtual time mode, the clock doesn't advance on its own. Delays, sleep and other calls
+ * that would normally block advance the clock by the requested amount of time and return
+ * immediately, so that hours of device time can be simulated in seconds. Blocking calls to the
+ * real network take no virtual time. The virtual clock is deterministic as long as the application
+ * doesn't depend on the timing of the real network and the clock never had to advance after an
+ * idle timeout (see `Stats::idleAdvances`).
+ */
+void init(const Config& conf);
+
+/**
+ * Returns `true` if the device runs on the virtual clock.
+ */
+bool isVirtualTime();
+
+/**
+ * Returns the number of microseconds passed since the start of the simulation.
+ */
+uint64_t micros();
+
+/**
+ * Advances the virtual clock by the specified number of microseconds, or blocks the calling
+ * thread for that amount of time if the virtual time mode is disabled.
+ */
+void delay(uint64_t us);
+
+/**
+ * Generates a random number if the simulation uses a fixed seed.
+ *
+ * Returns `false` if the random number generator is not seeded.
+ */
+bool random(uint32_t* value);
+
+/**
+ * Stops the virtual clock while the calling thread is blocked on the real network.
+ */
+class NetworkWait {
+public:
+    NetworkWait();
+    ~NetworkWait();
+
+    NetworkWait(const NetworkWait&) = delete;
+    NetworkWait& operator=(const NetworkWait&) = delete;
+};
+
+void countWakeup();
+void countSent(size_t size);
+void countReceived(size_t size);
+
+/**
+ * Returns the simulation counters.
+ */
+Stats stats();
+
+/**
+ * Prints the simulation counters and their hourly rates.
+ */
+void printStats();
+
+} // particle::simulation
+
+} // particle
@@ -17,11 +17,49 @@
 
 #include "sleep_hal.h"
 #include "system_error.h"
+#include "check.h"
+#include "simulation.h"
+
+#include <cstdlib>
+
+using namespace particle;
+
+namespace {
+
+// Returns the RTC wakeup source of the configuration, or nullptr
+const hal_wakeup_source_rtc_t* rtcWakeupSource(const hal_sleep_config_t* config) {
+    for (auto s = config->wakeup_sources; s; s = s->next) {
+        if (s->type == HAL_WAKEUP_SOURCE_TYPE_RTC) {
+            return reinterpret_cast<const hal_wakeup_source_rtc_t*>(s);
+        }
+    }
+    return nullptr;
+}
+
+} // unnamed
 
 int hal_sleep_enter(const hal_sleep_config_t* config, hal_wakeup_source_base_t** wakeup_source, void* reserved) {
-    return SYSTEM_ERROR_NOT_SUPPORTED;
+    CHECK(hal_sleep_validate_config(config, nullptr));
+    const auto rtc = rtcWakeupSource(config);
+    // Only the RTC can wake the virtual device up, so sleeping is as simple as advancing the clock
+    simulation::delay((uint64_t)rtc->ms * 1000);
+    simulation::countWakeup();
+    if (wakeup_source) {
+        const auto source = (hal_wakeup_source_rtc_t*)malloc(sizeof(hal_wakeup_source_rtc_t));
+        CHECK_TRUE(source, SYSTEM_ERROR_NO_MEMORY);
+        *source = *rtc;
+        source->base.next = nullptr;
+        *wakeup_source = reinterpret_cast<hal_wakeup_source_base_t*>(source);
+    }
+    return 0;
 }
 
 int hal_sleep_validate_config(const hal_sleep_config_t* config, void* reserved) {
-    return SYSTEM_ERROR_NOT_SUPPORTED;
+    CHECK_TRUE(config, SYSTEM_ERROR_INVALID_ARGUMENT);
+    // Sleep is only supported in the virtual time mode, where it doesn't block the process
+    CHECK_TRUE(simulation::isVirtualTime(), SYSTEM_ERROR_NOT_SUPPORTED);
+    CHECK_TRUE(config->mode == HAL_SLEEP_MODE_STOP || config->mode == HAL_SLEEP_MODE_ULTRA_LOW_POWER,
+            SYSTEM_ERROR_NOT_SUPPORTED);
+    CHECK_TRUE(rtcWakeupSource(config), SYSTEM_ERROR_NOT_SUPPORTED);
+    return 0;
 }
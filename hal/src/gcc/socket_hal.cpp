@@ -29,6 +29,8 @@
 #include "socket_hal.h"
 #include "inet_hal.h"
 #include "core_msg.h"
+#include "simulation.h"
+#include "network_impairment.h"
 #include <vector>
 
 #pragma GCC diagnostic ignored "-Wunused-variable"
@@ -44,6 +46,9 @@
 
 namespace ip = boost::asio::ip;
 
+using particle::simulation::NetworkImpairment;
+using particle::simulation::Datagram;
+
 const sock_handle_t SOCKET_COUNT = sock_handle_t(8);
 const sock_handle_t SOCKET_MAX =  SOCKET_COUNT*2;
 const sock_handle_t SOCKET_INVALID = (sock_handle_t)-1;
@@ -262,6 +267,7 @@ int32_t socket_connect(sock_handle_t sd, const sockaddr_t *addr, long addrlen)
     ip::address_v4::bytes_type address = {{ dest[0], dest[1], dest[2], dest[3] }};
     ip::tcp::endpoint endpoint(boost::asio::ip::address_v4(address),port);
 
+    particle::simulation::NetworkWait wait;
     handle.connect(endpoint, ec);
     bool open = handle.is_open();
     return ec.value();
@@ -291,6 +297,8 @@ sock_result_t socket_receive(sock_handle_t sd, void* buffer, socklen_t len, syst
             } else {
                 DEBUG("socket receive error: %d %s, read=%d", ec.value(), ec.message().c_str(), available);
             }
+        } else {
+            particle::simulation::countReceived(result);
         }
     }
     return result;
@@ -303,7 +311,9 @@ sock_result_t socket_send(sock_handle_t sd, const void* buffer, socklen_t len)
         return -1;
     try
     {
+        particle::simulation::NetworkWait wait;
         sock_result_t result = write(socket, boost::asio::buffer(buffer, len));
+        particle::simulation::countSent(result);
         return result;
     }
     catch (const boost::system::system_error& e)
@@ -324,22 +334,103 @@ sock_result_t socket_create_nonblocking_server(sock_handle_t sock, uint16_t port
     return 0;
 }
 
-sock_result_t socket_receivefrom(sock_handle_t sock, void* buffer, socklen_t bufLen, uint32_t flags, sockaddr_t* addr, socklen_t* addrsize)
+void set_sockaddr(sockaddr_t* addr, socklen_t* addrsize, uint32_t ip, uint16_t port)
 {
-	ip::udp::endpoint endpoint;
-	auto& socket = udp_from(sock);
-
-	int count = socket.receive_from(boost::asio::buffer(buffer, bufLen), endpoint, 0, ec);
 	if (addr && addrsize && *addrsize>=6u) {
-		uint16_t port = endpoint.port();
 		addr->sa_data[0] = port >> 8;
 		addr->sa_data[1] = port & 0xFF;
-		uint32_t ip = endpoint.address().to_v4().to_ulong();
 		addr->sa_data[2] = (ip >> 24) & 0xFF;
 		addr->sa_data[3] = (ip >> 16) & 0xFF;
 		addr->sa_data[4] = (ip >> 8) & 0xFF;
 		addr->sa_data[5] = (ip >> 0) & 0xFF;
 	}
+}
+
+int rebind_udp(ip::udp::socket& socket)
+{
+	// Reopen the socket on a new ephemeral port, which is what a peer observes when a NAT
+	// binding changes
+	socket.close(ec);
+	socket.open(ip::udp::v4(), ec);
+	if (!ec) {
+		socket.bind(ip::udp::endpoint(ip::udp::v4(), 0), ec);
+	}
+	if (!ec) {
+		socket.non_blocking(true, ec);
+	}
+	if (!ec) {
+		DEBUG("rebound to port %d", socket.local_endpoint().port());
+	}
+	return ec.value();
+}
+
+/**
+ * Moves datagrams between the real socket and the queues of the impairment layer.
+ */
+void process_impaired_udp(sock_handle_t sd, NetworkImpairment* impairment)
+{
+	auto& socket = udp_from(sd);
+	const auto now = particle::simulation::micros();
+	if (impairment->checkRebinding(sd, now) && rebind_udp(socket)) {
+		return;
+	}
+	Datagram d;
+	while (impairment->nextOutgoing(sd, now, &d)) {
+		ip::udp::endpoint endpoint(ip::address_v4(d.addr), d.port);
+		socket.send_to(boost::asio::buffer(d.data), endpoint, 0, ec);
+	}
+	uint8_t buf[2048];
+	for (;;) {
+		ip::udp::endpoint endpoint;
+		const size_t count = socket.receive_from(boost::asio::buffer(buf), endpoint, 0, ec);
+		if (ec) {
+			break;
+		}
+		impairment->receive(sd, buf, count, endpoint.address().to_v4().to_ulong(), endpoint.port(), now);
+	}
+}
+
+/**
+ * Moves the datagrams of the socket being used and of all other impaired sockets, so that delayed
+ * datagrams are sent when they are due even if the application doesn't use their socket anymore.
+ */
+void process_all_impaired_udp(sock_handle_t sd, NetworkImpairment* impairment)
+{
+	process_impaired_udp(sd, impairment);
+	for (const int other: impairment->sockets()) {
+		if (other != sd && udp_from(other).is_open()) {
+			process_impaired_udp(other, impairment);
+		}
+	}
+}
+
+sock_result_t socket_receivefrom_impaired(sock_handle_t sock, void* buffer, socklen_t bufLen, sockaddr_t* addr, socklen_t* addrsize,
+		NetworkImpairment* impairment)
+{
+	if (!udp_from(sock).is_open())
+		return -1;
+	process_all_impaired_udp(sock, impairment);
+	Datagram d;
+	if (!impairment->nextIncoming(sock, particle::simulation::micros(), &d))
+		return 0;
+	const size_t count = std::min<size_t>(d.data.size(), bufLen);
+	memcpy(buffer, d.data.data(), count);
+	set_sockaddr(addr, addrsize, d.addr, d.port);
+	particle::simulation::countReceived(count);
+	return count;
+}
+
+sock_result_t socket_receivefrom(sock_handle_t sock, void* buffer, socklen_t bufLen, uint32_t flags, sockaddr_t* addr, socklen_t* addrsize)
+{
+	const auto impairment = particle::simulation::networkImpairment();
+	if (impairment)
+		return socket_receivefrom_impaired(sock, buffer, bufLen, addr, addrsize, impairment);
+
+	ip::udp::endpoint endpoint;
+	auto& socket = udp_from(sock);
+
+	int count = socket.receive_from(boost::asio::buffer(buffer, bufLen), endpoint, 0, ec);
+	set_sockaddr(addr, addrsize, endpoint.address().to_v4().to_ulong(), endpoint.port());
 
 	sock_handle_t result = ec.value();
 
@@ -347,9 +438,10 @@ sock_result_t socket_receivefrom(sock_handle_t sock, void* buffer, socklen_t buf
         return 0;
     if (result==boost::asio::error::try_again)
 	   return 0;
-	if (!result)
+	if (!result) {
 		DEBUG("count: %d", count);
-	else
+		particle::simulation::countReceived(count);
+	} else
 		DEBUG("result: %d %s", ec.value(), ec.message().c_str());
 
 	return result ? result : count;
@@ -365,11 +457,24 @@ sock_result_t socket_sendto(sock_handle_t sd, const void* buffer, socklen_t len,
     ip::udp::endpoint endpoint(boost::asio::ip::address_v4(address),port);
 
 	auto& socket = udp_from(sd);
+
+	const auto impairment = particle::simulation::networkImpairment();
+	if (impairment) {
+		if (!socket.is_open())
+			return -1;
+		impairment->send(sd, buffer, len, endpoint.address().to_v4().to_ulong(), port, particle::simulation::micros());
+		particle::simulation::countSent(len);
+		process_all_impaired_udp(sd, impairment);
+		return len;
+	}
+
 	int count = socket.send_to(boost::asio::buffer(buffer, len), endpoint, 0, ec);
 
 	sock_handle_t result = ec.value();
     if (result == boost::asio::error::would_block)
         return 0;
+    if (!result)
+        particle::simulation::countSent(count);
 
     return result ? result : count;
 }
@@ -402,6 +507,9 @@ sock_result_t socket_close(sock_handle_t socket)
     		auto& s = udp_from(socket);
     		s.shutdown(boost::asio::ip::udp::socket::shutdown_both, ec);
     		udp_from(socket).close();
+    		const auto impairment = particle::simulation::networkImpairment();
+    		if (impairment)
+    			impairment->reset(socket);
     }
     else
     {
@@ -1,17 +1,11 @@
 #include "timer_hal.h"
-#include "boost_posix_time_wrap.h"
+#include "simulation.h"
 
-namespace {
-
-const auto start = boost::posix_time::microsec_clock::universal_time();
-
-} // namespace
+using namespace particle;
 
 system_tick_t HAL_Timer_Get_Micro_Seconds(void)
 {
-    auto now = boost::posix_time::microsec_clock::universal_time();
-    auto diff = now - start;
-    return diff.total_microseconds();
+    return simulation::micros();
 }
 
 system_tick_t HAL_Timer_Get_Milli_Seconds(void)
@@ -21,6 +15,10 @@ system_tick_t HAL_Timer_Get_Milli_Seconds(void)
 
 uint64_t hal_timer_millis(void* reserved)
 {
-    const auto now = boost::posix_time::microsec_clock::universal_time();
-    return (now - start).total_milliseconds();
+    return simulation::micros() / 1000;
+}
+
+uint64_t hal_timer_micros(void* reserved)
+{
+    return simulation::micros();
 }
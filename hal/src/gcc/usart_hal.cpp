@@ -1,6 +1,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "usart_hal.h"
 #include "socket_hal.h"
+#include "system_error.h"
 
 struct Usart {
     virtual void init(Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer)=0;
@@ -248,4 +249,14 @@ void HAL_USART_Send_Break(HAL_USART_Serial serial, void* reserved)
 uint8_t HAL_USART_Break_Detected(HAL_USART_Serial serial)
 {
   return 0;
+}
+
+int32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data, void* reserved)
+{
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USART_Consume_Buffer(HAL_USART_Serial serial, size_t size, void* reserved)
+{
+  return SYSTEM_ERROR_NOT_SUPPORTED;
 }
\ No newline at end of file
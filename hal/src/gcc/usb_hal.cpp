@@ -25,6 +25,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "usb_hal.h"
+#include "system_error.h"
 #include <stdint.h>
 #include <iostream>
 #include <stdio.h>
@@ -169,6 +170,26 @@ void HAL_USB_USART_Flush_Data(HAL_USB_USART_Serial serial)
   USB_USART_Flush_Data();
 }
 
+int32_t HAL_USB_USART_Send_Buffer(HAL_USB_USART_Serial serial, const uint8_t* data, size_t size, void* reserved)
+{
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USB_USART_Receive_Buffer(HAL_USB_USART_Serial serial, uint8_t* data, size_t size, void* reserved)
+{
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USB_USART_Peek_Buffer(HAL_USB_USART_Serial serial, const uint8_t** data, void* reserved)
+{
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USB_USART_Consume_Buffer(HAL_USB_USART_Serial serial, size_t size, void* reserved)
+{
+  return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
 bool HAL_USB_USART_Is_Enabled(HAL_USB_USART_Serial serial)
 {
   return true;
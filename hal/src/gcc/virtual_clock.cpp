@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "virtual_clock.h"
+
+#include <algorithm>
+
+namespace particle {
+
+namespace simulation {
+
+namespace {
+
+// Number of times the calling thread has read the clock since it last slept
+thread_local unsigned g_polls = 0;
+
+} // unnamed
+
+const unsigned VirtualClock::POLL_LIMIT;
+const uint64_t VirtualClock::POLL_DELAY;
+const unsigned VirtualClock::DEFAULT_IDLE_TIMEOUT;
+
+VirtualClock::VirtualClock() :
+        idleTimeout_(DEFAULT_IDLE_TIMEOUT),
+        now_(0),
+        limit_(0),
+        idleAdvances_(0),
+        sleeping_(0),
+        external_(0) {
+}
+
+uint64_t VirtualClock::now() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (++g_polls >= POLL_LIMIT) {
+        sleep(lock, POLL_DELAY);
+    }
+    return now_;
+}
+
+uint64_t VirtualClock::peek() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return now_;
+}
+
+bool VirtualClock::sleep(uint64_t us) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return sleep(lock, us);
+}
+
+bool VirtualClock::sleep(std::unique_lock<std::mutex>& lock, uint64_t us) {
+    g_polls = 0;
+    const uint64_t deadline = now_ + us;
+    const auto it = deadlines_.insert(deadline);
+    const bool registered = threads_.count(std::this_thread::get_id());
+    if (registered) {
+        ++sleeping_;
+    }
+    while (now_ < deadline && !(limit_ && now_ >= limit_)) {
+        if (external_ > 0) {
+            // Blocking calls to the real network take no virtual time
+            cond_.wait(lock);
+            continue;
+        }
+        if (sleeping_ >= threads_.size() && *deadlines_.begin() > now_) {
+            // All registered threads are sleeping and the threads that were due have woken up
+            advance();
+            continue;
+        }
+        const auto t = now_;
+        if (cond_.wait_for(lock, idleTimeout_) == std::cv_status::timeout && now_ == t && !external_) {
+            // Some registered thread is blocked on something else
+            ++idleAdvances_;
+            advance();
+        }
+    }
+    if (registered) {
+        --sleeping_;
+    }
+    deadlines_.erase(it);
+    cond_.notify_all();
+    return now_ >= deadline;
+}
+
+void VirtualClock::advance() {
+    uint64_t t = *deadlines_.begin();
+    if (limit_) {
+        t = std::min(t, limit_);
+    }
+    if (t > now_) {
+        now_ = t;
+        cond_.notify_all();
+    }
+}
+
+void VirtualClock::addThread() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.insert(std::this_thread::get_id());
+}
+
+void VirtualClock::removeThread() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.erase(std::this_thread::get_id());
+    // The remaining threads may all be sleeping now
+    cond_.notify_all();
+}
+
+void VirtualClock::beginExternalWait() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++external_;
+}
+
+void VirtualClock::endExternalWait() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --external_;
+    cond_.notify_all();
+}
+
+void VirtualClock::limit(uint64_t us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = us;
+    cond_.notify_all();
+}
+
+bool VirtualClock::limitReached() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_ && now_ >= limit_;
+}
+
+void VirtualClock::idleTimeout(unsigned ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idleTimeout_ = std::chrono::milliseconds(ms);
+}
+
+uint64_t VirtualClock::idleAdvances() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idleAdvances_;
+}
+
+} // particle::simulation
+
+} // particle
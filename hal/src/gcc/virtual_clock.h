@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+namespace particle {
+
+namespace simulation {
+
+/**
+ * Clock that advances only when the simulated threads wait.
+ *
+ * A thread calling `sleep()` is blocked until the clock reaches its deadline. The clock advances
+ * to the earliest deadline of the sleeping threads once all registered threads are sleeping, so
+ * that concurrent sleeps overlap the same way they would on the wall clock. Threads that are not
+ * registered can sleep as well, but the clock doesn't wait for them to sleep before advancing.
+ *
+ * Calls that block on the real network are marked with `beginExternalWait()` and `endExternalWait()`.
+ * The clock doesn't advance during such a call, so the call takes no virtual time regardless of how
+ * long it takes on the wall clock.
+ *
+ * A registered thread that is blocked on anything else, e.g. a mutex held by a sleeping thread, would
+ * stop the clock for everyone. As a fallback, the clock also advances if it hasn't been advanced for
+ * the idle timeout of wall time while some threads are sleeping. Such advances depend on the wall
+ * clock and are counted, so that a run that relied on them can be told apart from a reproducible one.
+ *
+ * A thread that reads the clock `POLL_LIMIT` times in a row without sleeping is considered to be
+ * busy-waiting on the clock and is put to sleep for `POLL_DELAY` microseconds.
+ *
+ * If a limit is set, the clock stops there. Sleeps that end after the limit return `false` once
+ * the clock reaches the limit.
+ */
+class VirtualClock {
+public:
+    static const unsigned POLL_LIMIT = 100;
+    static const uint64_t POLL_DELAY = 100;
+    static const unsigned DEFAULT_IDLE_TIMEOUT = 100; // Milliseconds
+
+    VirtualClock();
+
+    /**
+     * Returns the current time in microseconds.
+     */
+    uint64_t now();
+
+    /**
+     * Returns the current time without counting it as a read by a busy-waiting thread.
+     */
+    uint64_t peek();
+
+    /**
+     * Blocks the calling thread for the specified number of microseconds of virtual time.
+     *
+     * Returns `false` if the clock reached the limit before the end of the sleep.
+     */
+    bool sleep(uint64_t us);
+
+    /**
+     * Makes the clock wait for the calling thread to sleep before it advances.
+     */
+    void addThread();
+    void removeThread();
+
+    /**
+     * Stops the clock while the calling thread is blocked outside of the clock.
+     */
+    void beginExternalWait();
+    void endExternalWait();
+
+    void limit(uint64_t us);
+    bool limitReached();
+
+    void idleTimeout(unsigned ms);
+
+    /**
+     * Returns the number of times the clock advanced after the idle timeout.
+     */
+    uint64_t idleAdvances();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::multiset<uint64_t> deadlines_; // Deadlines of the sleeping threads
+    std::set<std::thread::id> threads_; // Registered threads
+    std::chrono::milliseconds idleTimeout_;
+    uint64_t now_;
+    uint64_t limit_;
+    uint64_t idleAdvances_;
+    unsigned sleeping_; // Number of registered threads that are sleeping
+    unsigned external_; // Number of threads that are blocked outside of the clock
+
+    bool sleep(std::unique_lock<std::mutex>& lock, uint64_t us);
+    void advance();
+};
+
+} // particle::simulation
+
+} // particle
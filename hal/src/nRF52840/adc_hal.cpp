@@ -17,11 +17,28 @@
 
 #include "nrfx.h"
 #include "nrfx_saadc.h"
+#include "nrf_timer.h"
+#include "nrf_ppi.h"
 #include "adc_hal.h"
 #include "pinmap_impl.h"
+#include "system_error.h"
+
+// See PLATFORM_PPI_CHANNELS_USED and PLATFORM_TIMERS_USED in nrfx_glue.h
+#define ADC_STREAM_TIMER                NRFX_CONCAT_2(NRF_TIMER, PLATFORM_ADC_STREAM_TIMER)
+#define ADC_STREAM_TIMER_FREQUENCY      16000000
+#define ADC_STREAM_PPI_CHANNEL          ((nrf_ppi_channel_t)PLATFORM_ADC_STREAM_PPI_CHANNEL)
+// Acquisition and conversion time of a single channel
+#define ADC_STREAM_CHANNEL_TIME_US      12
+#define ADC_STREAM_MAX_BUFFER_SAMPLES   0x7fff
 
 static volatile bool m_adc_initiated = false;
 
+static struct {
+    HAL_ADC_Stream_Callback callback;
+    void* context;
+    volatile bool running;
+} m_adc_stream = {};
+
 static const nrfx_saadc_config_t saadc_config = 
 {
     .resolution         = NRF_SAADC_RESOLUTION_12BIT,
@@ -34,6 +51,54 @@ static void analog_in_event_handler(nrfx_saadc_evt_t const *p_event)
     (void) p_event;
 }
 
+static bool adc_channel_input(uint16_t pin, nrf_saadc_input_t* input)
+{
+    Hal_Pin_Info *PIN_MAP = HAL_Pin_Map();
+
+    switch (PIN_MAP[pin].adc_channel)
+    {
+        case 0: *input = NRF_SAADC_INPUT_AIN0; break;
+        case 1: *input = NRF_SAADC_INPUT_AIN1; break;
+        case 2: *input = NRF_SAADC_INPUT_AIN2; break;
+        case 3: *input = NRF_SAADC_INPUT_AIN3; break;
+        case 4: *input = NRF_SAADC_INPUT_AIN4; break;
+        case 5: *input = NRF_SAADC_INPUT_AIN5; break;
+        case 6: *input = NRF_SAADC_INPUT_AIN6; break;
+        case 7: *input = NRF_SAADC_INPUT_AIN7; break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static nrf_saadc_channel_config_t adc_channel_config(nrf_saadc_input_t input)
+{
+    //Single ended, negative input to ADC shorted to GND.
+    nrf_saadc_channel_config_t channel_config = {
+        .resistor_p = NRF_SAADC_RESISTOR_DISABLED,
+        .resistor_n = NRF_SAADC_RESISTOR_DISABLED,
+        .gain       = NRF_SAADC_GAIN1_4,
+        .reference  = NRF_SAADC_REFERENCE_VDD4,
+        .acq_time   = NRF_SAADC_ACQTIME_10US,
+        .mode       = NRF_SAADC_MODE_SINGLE_ENDED,
+        .burst      = NRF_SAADC_BURST_DISABLED,
+        .pin_p      = input,
+        .pin_n      = NRF_SAADC_INPUT_DISABLED
+    };
+    return channel_config;
+}
+
+static void adc_stream_event_handler(nrfx_saadc_evt_t const *p_event)
+{
+    if (p_event->type != NRFX_SAADC_EVT_DONE || !m_adc_stream.running)
+    {
+        return;
+    }
+    // The other buffer is being filled by now, queue the one after it
+    int16_t* next = m_adc_stream.callback(p_event->data.done.p_buffer, p_event->data.done.size, m_adc_stream.context);
+    nrfx_saadc_buffer_convert(next, p_event->data.done.size);
+}
+
 void HAL_ADC_Set_Sample_Time(uint8_t ADC_SampleTime)
 {
     // deprecated
@@ -46,6 +111,11 @@ void HAL_ADC_Set_Sample_Time(uint8_t ADC_SampleTime)
  */
 int32_t HAL_ADC_Read(uint16_t pin)
 {
+    if (m_adc_stream.running)
+    {
+        return 0;
+    }
+
     if (!m_adc_initiated)
     {
         m_adc_initiated = true;
@@ -57,18 +127,9 @@ int32_t HAL_ADC_Read(uint16_t pin)
     nrf_saadc_input_t nrf_adc_channel;
     Hal_Pin_Info *PIN_MAP = HAL_Pin_Map();
 
-    switch (PIN_MAP[pin].adc_channel)
+    if (!adc_channel_input(pin, &nrf_adc_channel))
     {
-        case 0: nrf_adc_channel = NRF_SAADC_INPUT_AIN0; break;
-        case 1: nrf_adc_channel = NRF_SAADC_INPUT_AIN1; break;
-        case 2: nrf_adc_channel = NRF_SAADC_INPUT_AIN2; break;
-        case 3: nrf_adc_channel = NRF_SAADC_INPUT_AIN3; break;
-        case 4: nrf_adc_channel = NRF_SAADC_INPUT_AIN4; break;
-        case 5: nrf_adc_channel = NRF_SAADC_INPUT_AIN5; break;
-        case 6: nrf_adc_channel = NRF_SAADC_INPUT_AIN6; break;
-        case 7: nrf_adc_channel = NRF_SAADC_INPUT_AIN7; break;
-        default:
-            return 0;
+        return 0;
     }
 
     if (PIN_MAP[pin].pin_func != PF_NONE && PIN_MAP[pin].pin_func != PF_DIO)
@@ -76,18 +137,7 @@ int32_t HAL_ADC_Read(uint16_t pin)
         return 0;
     }
 
-     //Single ended, negative input to ADC shorted to GND.
-    nrf_saadc_channel_config_t channel_config = {                                                   
-        .resistor_p = NRF_SAADC_RESISTOR_DISABLED,      \
-        .resistor_n = NRF_SAADC_RESISTOR_DISABLED,      \
-        .gain       = NRF_SAADC_GAIN1_4,                \
-        .reference  = NRF_SAADC_REFERENCE_VDD4,         \
-        .acq_time   = NRF_SAADC_ACQTIME_10US,           \
-        .mode       = NRF_SAADC_MODE_SINGLE_ENDED,      \
-        .burst      = NRF_SAADC_BURST_DISABLED,         \
-        .pin_p      = (nrf_saadc_input_t)(nrf_adc_channel),       \
-        .pin_n      = NRF_SAADC_INPUT_DISABLED          \
-    };
+    nrf_saadc_channel_config_t channel_config = adc_channel_config(nrf_adc_channel);
 
     ret_code = nrfx_saadc_channel_init(PIN_MAP[pin].adc_channel, &channel_config);
     if (ret_code)
@@ -125,3 +175,97 @@ void HAL_ADC_DMA_Init()
     uint32_t err_code = nrfx_saadc_init(&saadc_config, analog_in_event_handler);
     SPARK_ASSERT(err_code == NRF_SUCCESS);
 }
+
+int HAL_ADC_Stream_Start(const HAL_ADC_Stream_Config* config, void* reserved)
+{
+    if (!config || !config->pins || !config->pin_count || config->pin_count > NRF_SAADC_CHANNEL_COUNT ||
+            !config->sample_rate || config->sample_rate > ADC_STREAM_TIMER_FREQUENCY ||
+            !config->buffers[0] || !config->buffers[1] || !config->callback ||
+            !config->buffer_samples || config->buffer_samples % config->pin_count ||
+            config->buffer_samples > ADC_STREAM_MAX_BUFFER_SAMPLES)
+    {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    // The whole scan has to complete before the next tick
+    if ((uint64_t)config->sample_rate * config->pin_count * ADC_STREAM_CHANNEL_TIME_US > 1000000)
+    {
+        return SYSTEM_ERROR_OUT_OF_RANGE;
+    }
+    if (m_adc_stream.running)
+    {
+        return SYSTEM_ERROR_BUSY;
+    }
+
+    nrf_saadc_input_t inputs[NRF_SAADC_CHANNEL_COUNT];
+    Hal_Pin_Info *PIN_MAP = HAL_Pin_Map();
+    for (uint8_t i = 0; i < config->pin_count; i++)
+    {
+        if (config->pins[i] >= TOTAL_PINS || !adc_channel_input(config->pins[i], &inputs[i]))
+        {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        // Same as in HAL_ADC_Read(), don't sample pins used by another peripheral
+        if (PIN_MAP[config->pins[i]].pin_func != PF_NONE && PIN_MAP[config->pins[i]].pin_func != PF_DIO)
+        {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+    }
+
+    // Reinitialize the driver in the non-blocking mode
+    if (m_adc_initiated)
+    {
+        nrfx_saadc_uninit();
+        m_adc_initiated = false;
+    }
+    if (nrfx_saadc_init(&saadc_config, adc_stream_event_handler) != NRFX_SUCCESS)
+    {
+        return SYSTEM_ERROR_INTERNAL;
+    }
+    for (uint8_t i = 0; i < config->pin_count; i++)
+    {
+        nrf_saadc_channel_config_t channel_config = adc_channel_config(inputs[i]);
+        if (nrfx_saadc_channel_init(i, &channel_config) != NRFX_SUCCESS)
+        {
+            nrfx_saadc_uninit();
+            return SYSTEM_ERROR_INTERNAL;
+        }
+    }
+
+    m_adc_stream.callback = config->callback;
+    m_adc_stream.context = config->context;
+    m_adc_stream.running = true;
+
+    // Both buffers are queued, so that EasyDMA switches to the second one without CPU involvement
+    nrfx_saadc_buffer_convert(config->buffers[0], config->buffer_samples);
+    nrfx_saadc_buffer_convert(config->buffers[1], config->buffer_samples);
+
+    // Each timer tick triggers the SAMPLE task through PPI, which scans all enabled channels
+    nrf_timer_mode_set(ADC_STREAM_TIMER, NRF_TIMER_MODE_TIMER);
+    nrf_timer_bit_width_set(ADC_STREAM_TIMER, NRF_TIMER_BIT_WIDTH_32);
+    nrf_timer_frequency_set(ADC_STREAM_TIMER, NRF_TIMER_FREQ_16MHz);
+    nrf_timer_cc_write(ADC_STREAM_TIMER, NRF_TIMER_CC_CHANNEL0, ADC_STREAM_TIMER_FREQUENCY / config->sample_rate);
+    nrf_timer_shorts_enable(ADC_STREAM_TIMER, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK);
+    nrf_ppi_channel_endpoint_setup(ADC_STREAM_PPI_CHANNEL,
+            (uint32_t)nrf_timer_event_address_get(ADC_STREAM_TIMER, NRF_TIMER_EVENT_COMPARE0),
+            nrfx_saadc_sample_task_get());
+    nrf_ppi_channel_enable(ADC_STREAM_PPI_CHANNEL);
+    nrf_timer_task_trigger(ADC_STREAM_TIMER, NRF_TIMER_TASK_CLEAR);
+    nrf_timer_task_trigger(ADC_STREAM_TIMER, NRF_TIMER_TASK_START);
+
+    return SYSTEM_ERROR_NONE;
+}
+
+void HAL_ADC_Stream_Stop(void* reserved)
+{
+    if (!m_adc_stream.running)
+    {
+        return;
+    }
+    nrf_timer_task_trigger(ADC_STREAM_TIMER, NRF_TIMER_TASK_STOP);
+    nrf_timer_task_trigger(ADC_STREAM_TIMER, NRF_TIMER_TASK_SHUTDOWN);
+    nrf_timer_shorts_disable(ADC_STREAM_TIMER, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK);
+    nrf_ppi_channel_disable(ADC_STREAM_PPI_CHANNEL);
+    m_adc_stream.running = false;
+    // HAL_ADC_Read() initializes the driver again in the blocking mode
+    nrfx_saadc_uninit();
+}
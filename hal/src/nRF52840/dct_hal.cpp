@@ -17,7 +17,8 @@
 
 #include "dct_hal.h"
 #include "dcd_flash_impl.h"
-#include "scope_guard.h"
+#include "dct_mirror.h"
+#include "module_info.h"
 #include "system_error.h"
 #include "service_debug.h"
 
@@ -26,10 +27,16 @@
 #include <algorithm>
 #include <mutex>
 
+#if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
+#include "timer_hal.h"
+#endif
+
 namespace {
 
 using namespace particle::fs;
 
+// Backend of the DCT mirror. The file is kept open, and every commit is a single write followed by a sync.
+// The bootloader uses the file directly, see below
 class DcdFile {
 public:
     DcdFile() {
@@ -40,87 +47,90 @@ public:
         deinit();
     }
 
-    ssize_t read(size_t offset, uint8_t* buffer, size_t size) {
+    int load(uint8_t* data, size_t size) {
         FsLock lk(fs_);
-        open(LFS_O_RDONLY);
-        ssize_t r = seek(offset);
+        lfs_soff_t r = lfs_file_seek(lfs(), &file_, 0, LFS_SEEK_SET);
+        if (r < 0) {
+            return SYSTEM_ERROR_FILE;
+        }
+        r = lfs_file_read(lfs(), &file_, data, size);
         if (r < 0) {
-            close();
-            return r;
+            LOG_DEBUG(ERROR, "Failed to read DCD: %d", (int)r);
+            return SYSTEM_ERROR_FILE;
         }
-        r = lfs_file_read(lfs(), &file_, buffer, size);
-        close();
-        return r;
+        // Fill the missing part for compatibility with raw flash DCD
+        memset(data + r, 0xff, size - r);
+        return 0;
     }
 
-    ssize_t write(size_t offset, const uint8_t* buffer, size_t size) {
+    int store(size_t offset, const uint8_t* data, size_t size) {
         FsLock lk(fs_);
-
-        open(LFS_O_WRONLY);
-
-        ssize_t r = seek(offset);
-        if (r < 0) {
-            close();
-            return r;
+        lfs_soff_t r = lfs_file_seek(lfs(), &file_, offset, LFS_SEEK_SET);
+        if (r >= 0) {
+            r = lfs_file_write(lfs(), &file_, data, size);
+            if (r >= 0) {
+                r = lfs_file_sync(lfs(), &file_);
+            }
         }
-
-        r = lfs_file_write(lfs(), &file_, buffer, size);
         if (r < 0) {
-            /* Error */
-            LOG_DEBUG(ERROR, "Failed to write to DCD: %d", r);
+            LOG_DEBUG(ERROR, "Failed to write to DCD: %d", (int)r);
+            return SYSTEM_ERROR_FILE;
         }
-
-        close();
-
-        return r;
+        return 0;
     }
 
-    bool clear() {
-        FsLock lk(fs_);
-        if (!open(LFS_O_WRONLY)) {
-            return false;
+    int read(size_t offset, uint8_t* data, size_t size) {
+        if (offset > sizeof(application_dct_t) || size > sizeof(application_dct_t) - offset) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
         }
-        SCOPE_GUARD({
-            close();
-        });
-        char buf[128];
-        memset(buf, 0xff, sizeof(buf));
-        const lfs_ssize_t size = lfs_file_size(lfs(), &file_);
-        if (size < 0) {
-            return false;
+        FsLock lk(fs_);
+        lfs_soff_t r = lfs_file_seek(lfs(), &file_, offset, LFS_SEEK_SET);
+        if (r >= 0) {
+            r = lfs_file_read(lfs(), &file_, data, size);
         }
-        size_t offs = 0;
-        while (offs < (size_t)size) {
-            const size_t n = std::min(sizeof(buf), (size_t)size - offs);
-            const lfs_ssize_t r = lfs_file_write(lfs(), &file_, buf, n);
-            if (r != (lfs_ssize_t)n) {
-                return false;
-            }
-            offs += n;
+        if (r < 0) {
+            LOG_DEBUG(ERROR, "Failed to read DCD: %d", (int)r);
+            return SYSTEM_ERROR_FILE;
         }
-        return true;
+        // Fill the missing part for compatibility with raw flash DCD
+        memset(data + r, 0xff, size - r);
+        return 0;
     }
 
-
-private:
-
-    bool open(int flags) {
-        open_ = lfs_file_open(lfs(), &file_, path_, flags) == 0;
-        return open_;
+    int write(size_t offset, const uint8_t* data, size_t size) {
+        if (offset > sizeof(application_dct_t) || size > sizeof(application_dct_t) - offset) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        return store(offset, data, size);
     }
 
-    bool close() {
-        if (!open_) {
-            return false;
+    int fill(uint8_t value) {
+        FsLock lk(fs_);
+        uint8_t tmp[64];
+        memset(tmp, value, sizeof(tmp));
+        lfs_soff_t r = lfs_file_seek(lfs(), &file_, 0, LFS_SEEK_SET);
+        for (size_t offset = 0; r >= 0 && offset < sizeof(application_dct_t); offset += r) {
+            r = lfs_file_write(lfs(), &file_, tmp, std::min(sizeof(tmp), sizeof(application_dct_t) - offset));
+        }
+        if (r >= 0) {
+            r = lfs_file_sync(lfs(), &file_);
+        }
+        if (r < 0) {
+            LOG_DEBUG(ERROR, "Failed to write to DCD: %d", (int)r);
+            return SYSTEM_ERROR_FILE;
         }
-        open_ = false;
-        return lfs_file_close(lfs(), &file_) == 0;
+        return 0;
     }
 
-    ssize_t seek(size_t offset) {
-        return lfs_file_seek(lfs(), &file_, offset, LFS_SEEK_SET);
+    system_tick_t millis() {
+#if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
+        return HAL_Timer_Get_Milli_Seconds();
+#else
+        return 0; // The bootloader has no millisecond timer
+#endif
     }
 
+private:
     void init() {
         fs_ = filesystem_get_instance(nullptr);
         SPARK_ASSERT(fs_);
@@ -144,20 +154,20 @@ private:
             flags |= LFS_O_CREAT;
         }
 
-        SPARK_ASSERT(open(flags));
+        SPARK_ASSERT(lfs_file_open(lfs(), &file_, path_, flags) == 0);
 
         if (flags & LFS_O_CREAT) {
             LOG_DEBUG(INFO, "Initializing empty DCT");
             /* Fill with 0xff for compatibility with raw flash DCD */
-            uint8_t tmp = 0xff;
+            uint8_t tmp[64];
+            memset(tmp, 0xff, sizeof(tmp));
             for (unsigned offset = 0; offset < sizeof(application_dct_t);) {
-                r = lfs_file_write(lfs(), &file_, &tmp, sizeof(tmp));
+                r = lfs_file_write(lfs(), &file_, tmp, std::min(sizeof(tmp), sizeof(application_dct_t) - offset));
                 SPARK_ASSERT(r > 0);
                 offset += r;
             }
+            SPARK_ASSERT(lfs_file_sync(lfs(), &file_) == 0);
         }
-
-        SPARK_ASSERT(close());
     }
 
     void deinit() {
@@ -173,12 +183,21 @@ private:
 
     filesystem_t* fs_;
     lfs_file_t file_;
-    bool open_ = false;
     static constexpr const char* path_ = "/sys/dct.bin";
 };
 
-DcdFile& dcd() {
-    static DcdFile dcd;
+#if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
+// The mirror keeps a copy of application_dct_t in RAM, which is about 8.5 KB (half of it is the EAP
+// CA certificate). In exchange, reads don't touch the filesystem, and the system reads the DCT
+// many times during startup and when connecting to the cloud
+typedef particle::detail::DctMirror<DcdFile, sizeof(application_dct_t)> Dcd;
+#else
+// The bootloader reads the DCT only a few times and can't afford the RAM copy
+typedef DcdFile Dcd;
+#endif
+
+Dcd& dcd() {
+    static Dcd dcd;
     return dcd;
 }
 
@@ -190,11 +209,10 @@ const void* dct_read_app_data(uint32_t offset) {
 }
 
 int dct_read_app_data_copy(uint32_t offset, void* ptr, size_t size) {
-    int result = -1;
     dct_lock(0);
-    result = dcd().read(offset, (uint8_t*)ptr, size);
+    const int result = dcd().read(offset, (uint8_t*)ptr, size);
     dct_unlock(0);
-    return result > 0 ? 0 : result;
+    return result;
 }
 
 const void* dct_read_app_data_lock(uint32_t offset) {
@@ -211,12 +229,36 @@ int dct_write_app_data(const void* data, uint32_t offset, uint32_t size) {
     dct_lock(1);
     const int result = dcd().write(offset, (const uint8_t*)data, size);
     dct_unlock(1);
-    return result > 0 ? 0 : result;
+    return result;
 }
 
 int dct_clear() {
-    dct_lock(0);
-    const bool ok = dcd().clear();
-    dct_unlock(0);
-    return (ok ? 0 : SYSTEM_ERROR_UNKNOWN);
+    dct_lock(1);
+    const int result = dcd().fill(0xff);
+    dct_unlock(1);
+    return result;
+}
+
+int dct_begin_update() {
+#if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
+    // The lock is held until the matching dct_end_update(), so that other threads can't commit
+    // a part of the update or have their own writes deferred
+    dct_lock(1);
+    dcd().beginUpdate();
+#endif
+    return 0;
+}
+
+int dct_end_update() {
+    int result = 0;
+#if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
+    dct_lock(1);
+    result = dcd().endUpdate();
+    const auto st = dcd().stats();
+    dct_unlock(1); // Acquired in dct_begin_update()
+    LOG_DEBUG(TRACE, "DCT: %u reads, %u writes (%u unchanged), %u commits (%u bytes, max %u ms), %u loads",
+            (unsigned)st.reads, (unsigned)st.writes, (unsigned)st.unchangedWrites, (unsigned)st.commits,
+            (unsigned)st.committedBytes, (unsigned)st.maxCommitTime, (unsigned)st.loads);
+#endif
+    return result;
 }
@@ -39,6 +39,19 @@ int dct_unlock(int write);
 
 int dct_clear();
 
+/**
+ * Defers the commits of the DCT writes until the matching `dct_end_update()`, so that several
+ * writes in a row are stored to the filesystem at once. Updates can be nested. The DCT lock is
+ * held for the duration of the update, so other threads can't access the DCT in the meantime.
+ */
+int dct_begin_update();
+
+/**
+ * Commits the DCT writes made since the outermost `dct_begin_update()`. Returns an error if the
+ * writes couldn't be stored.
+ */
+int dct_end_update();
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
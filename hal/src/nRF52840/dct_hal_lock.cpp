@@ -23,7 +23,10 @@ namespace {
 
 #ifdef DEBUG_BUILD
 #define DCT_LOCK_TIMEOUT 30000
+// Writing is not allowed while the DCT is locked for reading. A write lock can be nested, e.g.
+// while an update started by dct_begin_update() is in progress
 int dctLockCounter = 0;
+int dctReadLockCounter = 0;
 #else
 #define DCT_LOCK_TIMEOUT 0 // Wait indefinitely
 #endif
@@ -38,7 +41,10 @@ int dct_lock(int write) {
     SPARK_ASSERT(ok);
 #ifdef DEBUG_BUILD
     ++dctLockCounter;
-    SPARK_ASSERT(dctLockCounter == 1 || !write);
+    if (!write) {
+        ++dctReadLockCounter;
+    }
+    SPARK_ASSERT(dctReadLockCounter == 0 || !write);
 #endif
     return !ok;
 }
@@ -49,7 +55,10 @@ int dct_unlock(int write) {
     SPARK_ASSERT(ok);
 #ifdef DEBUG_BUILD
     --dctLockCounter;
-    SPARK_ASSERT(dctLockCounter == 0 || !write);
+    if (!write) {
+        --dctReadLockCounter;
+    }
+    SPARK_ASSERT(dctReadLockCounter == 0 || !write);
 #endif
     return !ok;
 }
@@ -24,23 +24,79 @@
 #include "check.h"
 #include "logging.h"
 #include "system_error.h"
+#include "service_debug.h"
 #include "concurrent_hal.h"
+#include "timer_hal.h"
 #include <memory>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
 
 namespace particle {
 
 namespace detail {
-const auto MUXER_CHANNEL_SUSPEND_THRESHOLD = 3; // 1/3
-const auto MUXER_CHANNEL_RESUME_THRESHOLD = 2; // 1/2
+const auto MUXER_CHANNEL_HEADROOM_FRAMES = 2; // Frames that may arrive after the channel is suspended
+const auto MUXER_CHANNEL_LOW_WATERMARK = 2; // Resume the channel when less than 1/2 of the high watermark is used
+const auto MUXER_CHANNEL_HELD_FRAMES = 2; // Frames that may be held in addition to the headroom
 } // detail
 
+/**
+ * Muxer channel stream counters.
+ */
+struct MuxerChannelStreamStats {
+    uint32_t rxBytes; // Bytes received from the muxer
+    uint32_t directBytes; // Bytes passed to the data handler without buffering
+    uint32_t dropped; // Bytes discarded because they exceeded the held data limit or no memory could be allocated
+    uint32_t overflows; // Times a frame didn't fit into the buffer and had to be held
+    uint32_t maxHeld; // Largest amount of data held outside of the buffer
+    uint32_t suspends; // Times the channel was suspended
+    uint32_t maxSuspendTime; // Longest time the channel was suspended, in milliseconds
+    uint32_t totalSuspendTime; // Total time the channel was suspended, in milliseconds
+};
+
+/**
+ * Stream over a muxer channel.
+ *
+ * The channel is suspended when the received data reaches the high watermark and resumed once
+ * the reader has drained the buffer below the low watermark. The space above the high watermark
+ * is the headroom for the frames that the other end sends before it processes the flow control
+ * request, and should be at least as large as the maximum frame size. The muxer thread is shared
+ * by all channels and never waits for the reader to free up the buffer: data that doesn't fit into
+ * the buffer is held in a separately allocated overflow buffer, and all data received on the channel
+ * after it is appended there until the reader has drained it. The channel stays suspended while any
+ * data is held. The amount of held data is limited to the headroom plus a few maximum-sized frames,
+ * so that a modem that ignores the flow control can't exhaust the heap shared with other channels;
+ * data above the limit, or data for which the overflow buffer can't be allocated, is dropped.
+ *
+ * The suspend and resume requests are sent to the muxer without holding any of the stream's locks,
+ * as the muxer thread holds the muxer lock while it delivers data to the stream.
+ *
+ * If a data handler is set, received frames are passed to it directly while the buffer is empty,
+ * and only the data not consumed by the handler is copied into the buffer.
+ */
 template <typename MuxerT>
 class MuxerChannelStream : virtual public Stream {
 public:
+    /**
+     * Data handler. Returns the number of bytes consumed, or a negative result code.
+     */
+    typedef int (*DataHandler)(const uint8_t* data, size_t size, void* ctx);
+
     MuxerChannelStream(MuxerT* muxer, uint8_t channel);
     virtual ~MuxerChannelStream();
 
-    int init(size_t rxBufSize);
+    /**
+     * Initializes the stream.
+     *
+     * @param rxBufSize Size of the receive buffer.
+     * @param maxFrameSize Maximum size of a muxer frame.
+     * @param highWatermark Amount of buffered data at which the channel is suspended. If 0, the
+     *        channel is suspended when less than two maximum-sized frames fit into the buffer.
+     * @param lowWatermark Amount of buffered data at which the channel is resumed. If 0, the
+     *        channel is resumed when less than half of the high watermark is used.
+     */
+    int init(size_t rxBufSize, size_t maxFrameSize, size_t highWatermark = 0, size_t lowWatermark = 0);
 
     static int channelDataCb(const uint8_t* data, size_t size, void* ctx);
 
@@ -58,25 +114,53 @@ public:
     void enabled(bool enabled);
     bool enabled() const;
 
+    void dataHandler(DataHandler handler, void* ctx);
+
+    bool suspended() const;
+
+    MuxerChannelStreamStats stats() const;
+    void resetStats();
+
 private:
     void suspend();
     void resume();
+    size_t putData(const char* data, size_t size);
+    size_t holdData(const char* data, size_t size);
+    void updateFlow();
+    void moveHeldData();
+    ssize_t rxData() const;
 
 private:
     MuxerT* muxer_;
     uint8_t channel_;
     size_t rxBufSize_ = 0;
+    size_t highWatermark_ = 0;
+    size_t lowWatermark_ = 0;
     std::unique_ptr<particle::services::RingBuffer<char> > rxBuf_;
     std::unique_ptr<char[]> rxBufData_;
+    std::unique_ptr<char[]> heldData_; // Data that didn't fit into rxBuf_
+    size_t heldSize_ = 0;
+    size_t heldCapacity_ = 0;
+    size_t heldLimit_ = 0;
     os_semaphore_t sem_ = nullptr;
-    volatile bool flow_ = false;
+    DataHandler handler_ = nullptr;
+    void* handlerCtx_ = nullptr;
+    MuxerChannelStreamStats stats_ = {};
+    system_tick_t suspendTime_ = 0;
+    mutable std::mutex statsMutex_; // Protects stats_ and suspendTime_, which are updated by the muxer and reader threads
+    mutable std::mutex rxMutex_; // Protects rxBuf_ and the held data, which are written by the muxer thread and read by the reader thread
+    std::mutex flowMutex_; // Protects the flow control state below
+    std::atomic<bool> flow_; // Whether the channel should be suspended
+    bool flowSent_ = false; // Flow control state last requested from the muxer
+    bool flowSending_ = false; // Set while some thread is sending a request to the muxer
     volatile bool enabled_ = true;
 };
 
 template <typename MuxerT>
 inline MuxerChannelStream<MuxerT>::MuxerChannelStream(MuxerT* muxer, uint8_t channel)
         : muxer_(muxer),
-          channel_(channel) {
+          channel_(channel),
+          flow_(false) {
 
 }
 
@@ -89,7 +173,21 @@ inline MuxerChannelStream<MuxerT>::~MuxerChannelStream() {
 }
 
 template <typename MuxerT>
-inline int MuxerChannelStream<MuxerT>::init(size_t rxBufSize) {
+inline int MuxerChannelStream<MuxerT>::init(size_t rxBufSize, size_t maxFrameSize, size_t highWatermark,
+        size_t lowWatermark) {
+    if (!highWatermark) {
+        // The buffer needs to hold the frame that crosses the watermark and the one that the other
+        // end may send before it processes the flow control request
+        const size_t headroom = maxFrameSize * detail::MUXER_CHANNEL_HEADROOM_FRAMES;
+        SPARK_ASSERT(rxBufSize > headroom);
+        highWatermark = rxBufSize - headroom;
+    }
+    if (!lowWatermark) {
+        lowWatermark = highWatermark / detail::MUXER_CHANNEL_LOW_WATERMARK;
+    }
+    CHECK_TRUE(rxBufSize > 0 && highWatermark <= rxBufSize && lowWatermark < highWatermark,
+            SYSTEM_ERROR_INVALID_ARGUMENT);
+
     if (rxBufSize != rxBufSize_ || !rxBufData_) {
         rxBufSize_ = rxBufSize;
         rxBufData_.reset(new (std::nothrow) char[rxBufSize]);
@@ -105,35 +203,163 @@ inline int MuxerChannelStream<MuxerT>::init(size_t rxBufSize) {
         CHECK_TRUE(os_semaphore_create(&sem_, 1, 0) == 0, SYSTEM_ERROR_NO_MEMORY);
     }
 
+    highWatermark_ = highWatermark;
+    lowWatermark_ = lowWatermark;
+    flow_ = false;
+    flowSent_ = false;
+    flowSending_ = false;
     rxBuf_->init(rxBufData_.get(), rxBufSize_);
+    heldData_.reset();
+    heldSize_ = 0;
+    heldCapacity_ = 0;
+    heldLimit_ = rxBufSize - highWatermark + maxFrameSize * detail::MUXER_CHANNEL_HELD_FRAMES;
     return 0;
 }
 
 template <typename MuxerT>
 inline int MuxerChannelStream<MuxerT>::channelDataCb(const uint8_t* data, size_t size, void* ctx) {
     auto self = (MuxerChannelStream<MuxerT>*)ctx;
-    auto wasEmpty = self->rxBuf_->empty();
-    auto r = self->rxBuf_->put((const char*)data, size);
-    if (r == SYSTEM_ERROR_TOO_LARGE) {
-        LOG_DEBUG(WARN, "No space in muxer channel stream rx buffer while trying to put %d bytes (%d available)",
-                (int)size, self->rxBuf_->space());
+    const size_t rxBytes = size;
+    size_t directBytes = 0;
+    size_t heldBytes = 0;
+    if (self->handler_ && self->rxData() == 0) {
+        // Nothing is buffered, so the data can be passed to the handler without breaking the order
+        const int r = self->handler_(data, size, self->handlerCtx_);
+        if (r > 0) {
+            directBytes = std::min((size_t)r, size);
+            data += directBytes;
+            size -= directBytes;
+        }
     }
-    self->suspend();
-    if (wasEmpty) {
-        os_semaphore_give(self->sem_, false);
+    if (size > 0) {
+        // Don't wait for the reader here, as that would stall the other channels
+        const size_t n = self->putData((const char*)data, size);
+        if (n < size) {
+            heldBytes = self->holdData((const char*)data + n, size - n);
+            if (heldBytes < size - n) {
+                LOG_DEBUG(WARN, "Unable to hold muxer channel stream data, dropping %d bytes", (int)(size - n - heldBytes));
+            }
+        }
+        size -= n;
+    }
+    std::lock_guard<std::mutex> lock(self->statsMutex_);
+    self->stats_.rxBytes += rxBytes;
+    self->stats_.directBytes += directBytes;
+    if (size > 0) {
+        self->stats_.dropped += size - heldBytes;
+        ++self->stats_.overflows;
+    }
+    if (heldBytes > 0) {
+        std::lock_guard<std::mutex> rxLock(self->rxMutex_);
+        self->stats_.maxHeld = std::max(self->stats_.maxHeld, (uint32_t)self->heldSize_);
     }
     return 0;
 }
 
+template <typename MuxerT>
+inline size_t MuxerChannelStream<MuxerT>::putData(const char* data, size_t size) {
+    size_t n = 0;
+    bool wasEmpty = false;
+    {
+        std::lock_guard<std::mutex> lock(rxMutex_);
+        const ssize_t space = rxBuf_->space();
+        if (space <= 0 || heldSize_ > 0) {
+            // Keep the order of the data: everything goes after the held data
+            return 0;
+        }
+        n = std::min((size_t)space, size);
+        wasEmpty = rxBuf_->empty();
+        rxBuf_->put(data, n);
+    }
+    suspend();
+    if (wasEmpty) {
+        os_semaphore_give(sem_, false);
+    }
+    return n;
+}
+
+template <typename MuxerT>
+inline size_t MuxerChannelStream<MuxerT>::holdData(const char* data, size_t size) {
+    bool wasEmpty = false;
+    {
+        std::lock_guard<std::mutex> lock(rxMutex_);
+        size = std::min(size, heldLimit_ - heldSize_);
+        if (!size) {
+            return 0;
+        }
+        if (heldSize_ + size > heldCapacity_) {
+            const size_t capacity = std::min(std::max(heldSize_ + size, heldCapacity_ * 2), heldLimit_);
+            std::unique_ptr<char[]> buf(new (std::nothrow) char[capacity]);
+            if (!buf) {
+                return 0;
+            }
+            if (heldSize_ > 0) {
+                memcpy(buf.get(), heldData_.get(), heldSize_);
+            }
+            heldData_ = std::move(buf);
+            heldCapacity_ = capacity;
+        }
+        memcpy(heldData_.get() + heldSize_, data, size);
+        heldSize_ += size;
+        wasEmpty = rxBuf_->empty();
+    }
+    // The buffer is normally full at this point, but a small buffer may have no room above the
+    // high watermark
+    suspend();
+    if (wasEmpty) {
+        os_semaphore_give(sem_, false);
+    }
+    return size;
+}
+
+template <typename MuxerT>
+inline void MuxerChannelStream<MuxerT>::moveHeldData() {
+    // Called with rxMutex_ locked
+    if (!heldSize_) {
+        return;
+    }
+    const ssize_t space = rxBuf_->space();
+    if (space <= 0) {
+        return;
+    }
+    const size_t n = std::min((size_t)space, heldSize_);
+    rxBuf_->put(heldData_.get(), n);
+    heldSize_ -= n;
+    if (heldSize_ > 0) {
+        memmove(heldData_.get(), heldData_.get() + n, heldSize_);
+    } else {
+        // Overflows are rare, don't keep the memory around
+        heldData_.reset();
+        heldCapacity_ = 0;
+    }
+}
+
 template <typename MuxerT>
 inline int MuxerChannelStream<MuxerT>::read(char* data, size_t size) {
     if (!enabled_) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
-    size_t canRead = CHECK(rxBuf_->data());
-    size_t willRead = std::min(canRead, size);
-    auto r = rxBuf_->get(data, willRead);
-    resume();
+    ssize_t r = 0;
+    {
+        std::lock_guard<std::mutex> lock(rxMutex_);
+        while (size > 0) {
+            const size_t canRead = CHECK(rxBuf_->data());
+            const size_t willRead = std::min(canRead, size);
+            if (!willRead) {
+                break;
+            }
+            const ssize_t n = CHECK(rxBuf_->get(data, willRead));
+            if (data) {
+                data += n;
+            }
+            size -= n;
+            r += n;
+            moveHeldData();
+        }
+    }
+    if (r > 0) {
+        resume();
+    }
     return r;
 }
 
@@ -142,6 +368,8 @@ inline int MuxerChannelStream<MuxerT>::peek(char* data, size_t size) {
     if (!enabled_) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
+    std::lock_guard<std::mutex> lock(rxMutex_);
+    moveHeldData();
     size_t canPeek = CHECK(rxBuf_->data());
     size_t willPeek = std::min(canPeek, size);
     return rxBuf_->peek(data, willPeek);
@@ -157,7 +385,7 @@ inline int MuxerChannelStream<MuxerT>::availForRead() {
     if (!enabled_) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
-    return rxBuf_->data();
+    return rxData();
 }
 
 template <typename MuxerT>
@@ -230,26 +458,79 @@ inline int MuxerChannelStream<MuxerT>::waitEvent(unsigned flags, unsigned timeou
 
 template <typename MuxerT>
 inline void MuxerChannelStream<MuxerT>::suspend() {
-    ssize_t space = rxBuf_->space();
-    if (space < 0) {
-        return;
-    }
-    if (!flow_ && (size_t)space <= (rxBufSize_ / detail::MUXER_CHANNEL_SUSPEND_THRESHOLD)) {
-        muxer_->suspendChannel(channel_);
-        flow_ = true;
+    // The flag is set before the amount of buffered data is checked, so that a reader that has
+    // drained the buffer either sees the flag and resumes the channel afterwards, or is seen here
+    // as having drained it
+    {
+        std::lock_guard<std::mutex> flowLock(flowMutex_);
+        if (flow_.exchange(true)) {
+            return;
+        }
+        const ssize_t data = rxData();
+        if (data < 0 || (size_t)data < highWatermark_) {
+            flow_ = false;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        suspendTime_ = HAL_Timer_Get_Milli_Seconds();
+        ++stats_.suspends;
     }
+    updateFlow();
 }
 
 template <typename MuxerT>
 inline void MuxerChannelStream<MuxerT>::resume() {
-    ssize_t space = rxBuf_->space();
-    if (space < 0) {
+    if (!flow_) {
         return;
     }
-    if (flow_ && (size_t)space >= (rxBufSize_ / detail::MUXER_CHANNEL_RESUME_THRESHOLD)) {
-        muxer_->resumeChannel(channel_);
+    {
+        std::lock_guard<std::mutex> flowLock(flowMutex_);
+        const ssize_t data = rxData();
+        if (data < 0 || (size_t)data > lowWatermark_ || !flow_) {
+            return;
+        }
         flow_ = false;
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        const uint32_t t = HAL_Timer_Get_Milli_Seconds() - suspendTime_;
+        stats_.totalSuspendTime += t;
+        stats_.maxSuspendTime = std::max(stats_.maxSuspendTime, t);
     }
+    updateFlow();
+}
+
+template <typename MuxerT>
+inline void MuxerChannelStream<MuxerT>::updateFlow() {
+    // The muxer thread holds the muxer lock while it delivers data to the stream, so the muxer is
+    // never called with flowMutex_ locked. Only one thread sends requests at a time, and it keeps
+    // sending them until the muxer's state matches the latest decision, so that the requests made
+    // by the muxer and reader threads can't be reordered
+    std::unique_lock<std::mutex> lock(flowMutex_);
+    if (flowSending_) {
+        return;
+    }
+    flowSending_ = true;
+    while (flowSent_ != flow_) {
+        const bool suspend = flow_;
+        lock.unlock();
+        if (suspend) {
+            muxer_->suspendChannel(channel_);
+        } else {
+            muxer_->resumeChannel(channel_);
+        }
+        lock.lock();
+        flowSent_ = suspend;
+    }
+    flowSending_ = false;
+}
+
+template <typename MuxerT>
+inline ssize_t MuxerChannelStream<MuxerT>::rxData() const {
+    std::lock_guard<std::mutex> lock(rxMutex_);
+    const ssize_t n = rxBuf_->data();
+    if (n < 0) {
+        return n;
+    }
+    return n + heldSize_;
 }
 
 template <typename MuxerT>
@@ -266,6 +547,29 @@ inline bool MuxerChannelStream<MuxerT>::enabled() const {
     return enabled_;
 }
 
+template <typename MuxerT>
+inline void MuxerChannelStream<MuxerT>::dataHandler(DataHandler handler, void* ctx) {
+    handler_ = handler;
+    handlerCtx_ = ctx;
+}
+
+template <typename MuxerT>
+inline bool MuxerChannelStream<MuxerT>::suspended() const {
+    return flow_;
+}
+
+template <typename MuxerT>
+inline MuxerChannelStreamStats MuxerChannelStream<MuxerT>::stats() const {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return stats_;
+}
+
+template <typename MuxerT>
+inline void MuxerChannelStream<MuxerT>::resetStats() {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    stats_ = MuxerChannelStreamStats();
+}
+
 } // particle
 
 #endif // GSM0710_MUXER_CHANNEL_STREAM_H
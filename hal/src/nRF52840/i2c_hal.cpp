@@ -93,6 +93,10 @@ typedef struct {
     void (*callback_on_receive)(int);
 
     HAL_I2C_Transmission_Config transfer_config;
+
+    // Asynchronous transfer
+    volatile HAL_I2C_Transfer_Callback async_callback;
+    void*                       async_context;
 } nrf5x_i2c_info_t;
 
 static void twis0_handler(nrfx_twis_evt_t const * p_event);
@@ -170,29 +174,55 @@ static void twis1_handler(nrfx_twis_evt_t const * p_event) {
 
 static void twim_handler(nrfx_twim_evt_t const * p_event, void * p_context) {
     uint32_t inst_num = (uint32_t)p_context;
+    transfer_state_t state = TRANSFER_STATE_IDLE;
+    int error = SYSTEM_ERROR_NONE;
 
     switch (p_event->type) {
         case NRFX_TWIM_EVT_DONE: {
             // LOG_DEBUG(TRACE, "NRFX_TWIM_EVT_DONE");
-            m_i2c_map[inst_num].transfer_state = TRANSFER_STATE_IDLE;
             break;
         }
         case NRFX_TWIM_EVT_ADDRESS_NACK: {
             LOG_DEBUG(TRACE, "NRFX_TWIM_EVT_ADDRESS_NACK");
-            m_i2c_map[inst_num].transfer_state = TRANSFER_STATE_ERROR_ADDRESS;
+            state = TRANSFER_STATE_ERROR_ADDRESS;
+            error = SYSTEM_ERROR_NOT_FOUND;
             break;
         }
-            break;
         case NRFX_TWIM_EVT_DATA_NACK: {
             LOG_DEBUG(TRACE, "NRFX_TWIM_EVT_DATA_NACK");
-            m_i2c_map[inst_num].transfer_state = TRANSFER_STATE_ERROR_DATA;
+            state = TRANSFER_STATE_ERROR_DATA;
+            error = SYSTEM_ERROR_IO;
             break;
         }
         default:
-            break;
+            return;
+    }
+
+    const HAL_I2C_Transfer_Callback callback = m_i2c_map[inst_num].async_callback;
+    if (callback) {
+        m_i2c_map[inst_num].async_callback = nullptr;
+        m_i2c_map[inst_num].transfer_state = TRANSFER_STATE_IDLE;
+        callback(error, m_i2c_map[inst_num].async_context);
+    } else {
+        m_i2c_map[inst_num].transfer_state = state;
     }
 }
 
+// Marks the bus as busy unless an asynchronous transfer is in progress
+static bool twi_try_claim(HAL_I2C_Interface i2c) {
+    int32_t state = HAL_disable_irq();
+    const bool ok = (m_i2c_map[i2c].transfer_state != TRANSFER_STATE_BUSY);
+    if (ok) {
+        m_i2c_map[i2c].transfer_state = TRANSFER_STATE_BUSY;
+    }
+    HAL_enable_irq(state);
+    return ok;
+}
+
+static bool twi_claim(HAL_I2C_Interface i2c, system_tick_t timeout_ms) {
+    return WAIT_TIMED(timeout_ms, !twi_try_claim(i2c));
+}
+
 static int twi_uninit(HAL_I2C_Interface i2c) {
     if (!m_i2c_map[i2c].enabled) {
         return -1;
@@ -385,7 +415,10 @@ int32_t HAL_I2C_Request_Data_Ex(HAL_I2C_Interface i2c, const HAL_I2C_Transmissio
         quantity = m_i2c_map[i2c].rx_buf_size;
     }
 
-    m_i2c_map[i2c].transfer_state = TRANSFER_STATE_BUSY;
+    if (!twi_claim(i2c, config->timeout_ms)) {
+        quantity = 0;
+        goto ret_busy;
+    }
     err_code = nrfx_twim_rx(m_i2c_map[i2c].master, config->address, (uint8_t *)m_i2c_map[i2c].rx_buf, quantity);
     if (err_code) {
         // FIXME: There is a bug in nrfx_twim driver, if we call nrfx_twim_rx repeatedly and quickly,
@@ -410,6 +443,7 @@ int32_t HAL_I2C_Request_Data_Ex(HAL_I2C_Interface i2c, const HAL_I2C_Transmissio
 
 ret:
     m_i2c_map[i2c].transfer_state = TRANSFER_STATE_IDLE;
+ret_busy:
     m_i2c_map[i2c].rx_index_head = 0;
     m_i2c_map[i2c].rx_index_tail = quantity;
     HAL_I2C_Release(i2c, NULL);
@@ -435,7 +469,10 @@ uint8_t HAL_I2C_End_Transmission(HAL_I2C_Interface i2c, uint8_t stop, void* rese
         stop = m_i2c_map[i2c].transfer_config.flags & HAL_I2C_TRANSMISSION_FLAG_STOP;
     }
 
-    m_i2c_map[i2c].transfer_state = TRANSFER_STATE_BUSY;
+    if (!twi_claim(i2c, m_i2c_map[i2c].transfer_config.timeout_ms)) {
+        ret_code = 5; // Timed out waiting for the bus
+        goto ret_busy;
+    }
     err_code = nrfx_twim_tx(m_i2c_map[i2c].master, m_i2c_map[i2c].address, (uint8_t *)m_i2c_map[i2c].tx_buf,
                                     m_i2c_map[i2c].tx_index_tail, !stop);
     if (err_code) {
@@ -455,6 +492,7 @@ uint8_t HAL_I2C_End_Transmission(HAL_I2C_Interface i2c, uint8_t stop, void* rese
 
 ret:
     m_i2c_map[i2c].transfer_state = TRANSFER_STATE_IDLE;
+ret_busy:
     m_i2c_map[i2c].tx_index_head = 0;
     m_i2c_map[i2c].tx_index_tail = 0;
     HAL_I2C_Release(i2c, NULL);
@@ -568,6 +606,59 @@ uint8_t HAL_I2C_Reset(HAL_I2C_Interface i2c, uint32_t reserved, void* reserved1)
     return 1;
 }
 
+int HAL_I2C_Transfer_Async(HAL_I2C_Interface i2c, const HAL_I2C_Transfer_Config* config, void* reserved) {
+    if (i2c >= TOTAL_I2C || !config || !config->callback ||
+            (!config->tx_length && !config->rx_length)) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    if (!m_i2c_map[i2c].enabled || m_i2c_map[i2c].mode != I2C_MODE_MASTER) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    if (!twi_try_claim(i2c)) {
+        return SYSTEM_ERROR_BUSY;
+    }
+    m_i2c_map[i2c].async_context = config->context;
+    m_i2c_map[i2c].async_callback = config->callback;
+
+    // TWIM performs the write, the repeated start and the read with EasyDMA without CPU involvement
+    nrfx_twim_xfer_desc_t desc;
+    uint32_t flags = 0;
+    if (config->tx_length && config->rx_length) {
+        desc = NRFX_TWIM_XFER_DESC_TXRX(config->address, (uint8_t*)config->tx_buffer, config->tx_length,
+                config->rx_buffer, config->rx_length);
+    } else if (config->tx_length) {
+        desc = NRFX_TWIM_XFER_DESC_TX(config->address, (uint8_t*)config->tx_buffer, config->tx_length);
+        if (!(config->flags & HAL_I2C_TRANSMISSION_FLAG_STOP)) {
+            flags = NRFX_TWIM_FLAG_TX_NO_STOP;
+        }
+    } else {
+        desc = NRFX_TWIM_XFER_DESC_RX(config->address, config->rx_buffer, config->rx_length);
+    }
+    const nrfx_err_t err = nrfx_twim_xfer(m_i2c_map[i2c].master, &desc, flags);
+    if (err != NRFX_SUCCESS) {
+        m_i2c_map[i2c].async_callback = nullptr;
+        m_i2c_map[i2c].transfer_state = TRANSFER_STATE_IDLE;
+        return (err == NRFX_ERROR_BUSY) ? SYSTEM_ERROR_BUSY : SYSTEM_ERROR_IO;
+    }
+    return SYSTEM_ERROR_NONE;
+}
+
+void HAL_I2C_Transfer_Cancel(HAL_I2C_Interface i2c, void* reserved) {
+    if (i2c >= TOTAL_I2C) {
+        return;
+    }
+    int32_t state = HAL_disable_irq();
+    const bool pending = m_i2c_map[i2c].async_callback;
+    m_i2c_map[i2c].async_callback = nullptr;
+    HAL_enable_irq(state);
+    if (pending) {
+        // nrfx_twim has no way to abort a transfer, so the peripheral is reinitialized
+        twi_uninit(i2c);
+        twi_init(i2c);
+        m_i2c_map[i2c].transfer_state = TRANSFER_STATE_IDLE;
+    }
+}
+
 int32_t HAL_I2C_Acquire(HAL_I2C_Interface i2c, void* reserved)
 {
     if (!HAL_IsISR()) {
@@ -43,13 +43,137 @@
 #include "deviceid_hal.h"
 #include <memory>
 #include "platform_radio_stack.h"
+#include "ota_flash_pipeline.h"
+#include "exflash_hal.h"
+#include "concurrent_hal.h"
+#include "timer_hal.h"
+#include "hw_config.h"
 
 #define OTA_CHUNK_SIZE                 (512)
+#define OTA_PIPELINE_SLOT_COUNT        (8)
 #define BOOTLOADER_RANDOM_BACKOFF_MIN  (200)
 #define BOOTLOADER_RANDOM_BACKOFF_MAX  (1000)
 
 static hal_update_complete_t flash_bootloader(hal_module_t* mod, uint32_t moduleLength);
 
+#ifdef USE_SERIAL_FLASH
+
+namespace {
+
+// External flash backend of the OTA pipeline
+class OtaFlashBackend {
+public:
+    OtaFlashBackend() :
+            mutex_(nullptr),
+            workerSem_(nullptr),
+            producerSem_(nullptr) {
+        SPARK_ASSERT(os_mutex_create(&mutex_) == 0);
+        SPARK_ASSERT(os_semaphore_create(&workerSem_, 1, 0) == 0);
+        SPARK_ASSERT(os_semaphore_create(&producerSem_, 1, 0) == 0);
+    }
+
+    int erase(uintptr_t addr) {
+        return (hal_exflash_erase_sector(addr, 1) == 0) ? 0 : SYSTEM_ERROR_IO;
+    }
+
+    int write(uintptr_t addr, const uint8_t* data, size_t size) {
+        return (hal_exflash_write(addr, data, size) == 0) ? 0 : SYSTEM_ERROR_IO;
+    }
+
+    size_t sectorSize() {
+        return sFLASH_PAGESIZE;
+    }
+
+    void lock() {
+        os_mutex_lock(mutex_);
+    }
+
+    void unlock() {
+        os_mutex_unlock(mutex_);
+    }
+
+    void notifyWorker() {
+        os_semaphore_give(workerSem_, false);
+    }
+
+    void waitWorker(system_tick_t timeout) {
+        os_semaphore_take(workerSem_, timeout, false);
+    }
+
+    void notifyProducer() {
+        os_semaphore_give(producerSem_, false);
+    }
+
+    void waitProducer(system_tick_t timeout) {
+        os_semaphore_take(producerSem_, timeout, false);
+    }
+
+    system_tick_t millis() {
+        return HAL_Timer_Get_Milli_Seconds();
+    }
+
+private:
+    os_mutex_t mutex_;
+    os_semaphore_t workerSem_;
+    os_semaphore_t producerSem_;
+};
+
+typedef particle::detail::OtaFlashPipeline<OtaFlashBackend, OTA_CHUNK_SIZE, OTA_PIPELINE_SLOT_COUNT> OtaFlashPipeline;
+
+OtaFlashPipeline* otaPipeline = nullptr;
+os_thread_t otaThread = nullptr;
+int otaPipelineError = 0;
+
+void otaPipelineThread(void* data) {
+    const auto pipeline = static_cast<OtaFlashPipeline*>(data);
+    for (;;) {
+        if (!pipeline->process()) {
+            pipeline->backend()->waitWorker(CONCURRENT_WAIT_FOREVER);
+        }
+    }
+}
+
+int startOtaPipeline(uint32_t address, uint32_t length) {
+    if (!otaPipeline) {
+        std::unique_ptr<OtaFlashPipeline> pipeline(new(std::nothrow) OtaFlashPipeline());
+        if (!pipeline) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        if (os_thread_create(&otaThread, "ota", OS_THREAD_PRIORITY_DEFAULT, otaPipelineThread, pipeline.get(),
+                OS_THREAD_STACK_SIZE_DEFAULT) != 0) {
+            otaThread = nullptr;
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        otaPipeline = pipeline.release();
+    }
+    otaPipelineError = 0;
+    return otaPipeline->begin(address, length);
+}
+
+// Waits until all received chunks are written to the flash
+int finishOtaPipeline() {
+    if (otaPipeline && otaPipeline->active()) {
+        otaPipelineError = otaPipeline->end();
+        const auto st = otaPipeline->stats();
+        // The CRC is only logged: fetch_module() still verifies the module CRC by reading the image back
+        // from the flash, which also catches errors introduced while programming it
+        uint32_t crc = 0;
+        size_t size = 0;
+        if (otaPipeline->crc32(&crc, &size) == 0) {
+            LOG(INFO, "OTA image staged: %u bytes, CRC32 %08x", (unsigned)size, (unsigned)crc);
+        }
+        LOG_DEBUG(TRACE, "OTA pipeline: %u erases (%u ahead, %u ms), %u writes (%u ms), %u waits (%u ms)",
+                (unsigned)st.erases, (unsigned)st.erasesAhead, (unsigned)st.eraseTime, (unsigned)st.writes,
+                (unsigned)st.writeTime, (unsigned)st.waits, (unsigned)st.waitTime);
+        otaPipeline->resetStats();
+    }
+    return otaPipelineError;
+}
+
+} // namespace
+
+#endif // defined(USE_SERIAL_FLASH)
+
 inline bool matches_mcu(uint8_t bounds_mcu, uint8_t actual_mcu) {
 	return bounds_mcu==HAL_PLATFORM_MCU_ANY || actual_mcu==HAL_PLATFORM_MCU_ANY || (bounds_mcu==actual_mcu);
 }
@@ -332,12 +456,28 @@ uint16_t HAL_OTA_ChunkSize()
 
 bool HAL_FLASH_Begin(uint32_t address, uint32_t length, void* reserved)
 {
+#ifdef USE_SERIAL_FLASH
+    // The sectors are erased by the OTA pipeline as the data arrives
+    system_flags.OTA_FLASHED_Status_SysFlag = 0x0000;
+    Save_SystemFlags();
+    const int ret = startOtaPipeline(address, length);
+    if (ret < 0) {
+        LOG(WARN, "OTA pipeline is not available: %d", ret);
+        FLASH_Begin(address, length);
+    }
+#else
     FLASH_Begin(address, length);
+#endif
     return true;
 }
 
 int HAL_FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t length, void* reserved)
 {
+#ifdef USE_SERIAL_FLASH
+    if (otaPipeline && otaPipeline->active()) {
+        return otaPipeline->update(address, pBuffer, length);
+    }
+#endif
     return FLASH_Update(pBuffer, address, length);
 }
 
@@ -383,6 +523,15 @@ int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_vali
 {
     hal_module_t module;
 
+#ifdef USE_SERIAL_FLASH
+    if (finishOtaPipeline() < 0) {
+        if (mod) {
+            memset(mod, 0, sizeof(hal_module_t));
+        }
+        return 1;
+    }
+#endif
+
     bool module_fetched = fetch_module(&module, &module_ota, userDepsOptional, flags);
 
     if (mod) 
@@ -527,13 +676,20 @@ int HAL_FLASH_Read_CorePrivateKey(uint8_t *keyBuffer, private_key_generation_t*
 #endif
         if (!error) 
         {
+            // The private and public keys are committed together
+            dct_begin_update();
             if (udp)
                 dct_write_app_data(keyBuffer, DCT_ALT_DEVICE_PRIVATE_KEY_OFFSET, DCT_ALT_DEVICE_PRIVATE_KEY_SIZE);
             else
                 dct_write_app_data(keyBuffer, DCT_DEVICE_PRIVATE_KEY_OFFSET, EXTERNAL_FLASH_CORE_PRIVATE_KEY_LENGTH);
 			// refetch and rewrite public key to ensure it is valid
 			fetch_device_public_key_ex();
-            generated = true;
+            error = dct_end_update();
+            if (error) {
+                LOG(ERROR, "Failed to store device key: %d", error);
+            } else {
+                generated = true;
+            }
         }
         hal_notify_event(HAL_EVENT_GENERATE_DEVICE_KEY, HAL_EVENT_FLAG_STOP, nullptr);
     }
@@ -549,6 +705,7 @@ uint16_t HAL_Set_Claim_Code(const char* code)
     }
     else // clear code
     {
+        dct_begin_update();
         char c = '\0';
         dct_write_app_data(&c, DCT_CLAIM_CODE_OFFSET, 1);
         // now flag as claimed
@@ -559,6 +716,11 @@ uint16_t HAL_Set_Claim_Code(const char* code)
         {
             dct_write_app_data(&c, DCT_DEVICE_CLAIMED_OFFSET, 1);
         }
+        const int result = dct_end_update();
+        if (result) {
+            LOG(ERROR, "Failed to clear claim code: %d", result);
+            return result;
+        }
     }
     return 0;
 }
@@ -614,6 +776,7 @@ int HAL_Set_System_Config(hal_system_config_t config_item, const void* data, uns
     unsigned offset = 0;
     unsigned length = -1;
 
+    dct_begin_update();
     switch (config_item)
     {
     case SYSTEM_CONFIG_DEVICE_KEY:
@@ -643,6 +806,11 @@ int HAL_Set_System_Config(hal_system_config_t config_item, const void* data, uns
 
     if (length>=0)
         dct_write_app_data(data, offset, length>data_length ? data_length : length);
+    const int result = dct_end_update();
+    if (result) {
+        LOG(ERROR, "Failed to store system config: %d", result);
+        return result;
+    }
 
     return length;
 }
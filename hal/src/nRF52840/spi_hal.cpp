@@ -154,11 +154,12 @@ static inline uint8_t get_nrf_pin_num(uint8_t pin) {
     return NRF_GPIO_PIN_MAP(PIN_MAP[pin].gpio_port, PIN_MAP[pin].gpio_pin);
 }
 
+static const nrf_spim_mode_t nrf_spim_mode[4] = {NRF_SPIM_MODE_0, NRF_SPIM_MODE_1, NRF_SPIM_MODE_2, NRF_SPIM_MODE_3};
+
 static void spi_init(HAL_SPI_Interface spi, SPI_Mode mode) {
     uint32_t err_code;
 
     if (mode == SPI_MODE_MASTER) {
-        static const nrf_spim_mode_t nrf_spim_mode[4] = {NRF_SPIM_MODE_0, NRF_SPIM_MODE_1, NRF_SPIM_MODE_2, NRF_SPIM_MODE_3};
         nrfx_spim_config_t spim_config = NRFX_SPIM_DEFAULT_CONFIG;
         spim_config.sck_pin      = get_nrf_pin_num(m_spi_map[spi].sck_pin);
         spim_config.mosi_pin     = get_nrf_pin_num(m_spi_map[spi].mosi_pin);
@@ -486,6 +487,24 @@ int32_t HAL_SPI_DMA_Transfer_Status(HAL_SPI_Interface spi, HAL_SPI_TransferStatu
     return transfer_length;
 }
 
+static void spi_master_set_settings(HAL_SPI_Interface spi) {
+    // Only the clock and mode registers are updated, as on the other platforms, so that this
+    // function can be called from the SPIM event handler between two transfers
+    NRF_SPIM_Type* spim = m_spi_map[spi].master->p_reg;
+    nrf_spim_disable(spim);
+    nrf_spim_frequency_set(spim, get_nrf_spi_frequency(spi, m_spi_map[spi].clock));
+    nrf_spim_configure(spim, nrf_spim_mode[m_spi_map[spi].data_mode],
+            (m_spi_map[spi].bit_order == MSBFIRST) ? NRF_SPIM_BIT_ORDER_MSB_FIRST : NRF_SPIM_BIT_ORDER_LSB_FIRST);
+    // Idle level of the clock line, which depends on the clock polarity
+    const uint8_t sck_pin = get_nrf_pin_num(m_spi_map[spi].sck_pin);
+    if (m_spi_map[spi].data_mode <= SPI_MODE1) {
+        nrf_gpio_pin_clear(sck_pin);
+    } else {
+        nrf_gpio_pin_set(sck_pin);
+    }
+    nrf_spim_enable(spim);
+}
+
 int32_t HAL_SPI_Set_Settings(HAL_SPI_Interface spi, uint8_t set_default, uint8_t clockdiv, uint8_t order, uint8_t mode, void* reserved) {
     if (set_default) {
         m_spi_map[spi].data_mode = DEFAULT_DATA_MODE;
@@ -498,8 +517,12 @@ int32_t HAL_SPI_Set_Settings(HAL_SPI_Interface spi, uint8_t set_default, uint8_t
     }
 
     if (m_spi_map[spi].enabled) {
-        spi_uninit(spi);
-        spi_init(spi, m_spi_map[spi].spi_mode);
+        if (m_spi_map[spi].spi_mode == SPI_MODE_MASTER && !set_default) {
+            spi_master_set_settings(spi);
+        } else {
+            spi_uninit(spi);
+            spi_init(spi, m_spi_map[spi].spi_mode);
+        }
     }
 
     return 0;
@@ -277,6 +277,29 @@ public:
         return d;
     }
 
+    ssize_t peekBuffer(const uint8_t** ptr) {
+        // Commits the data received so far
+        CHECK(data());
+        RxLock lk(uarte_);
+        const size_t n = rxBuffer_.consumable();
+        *ptr = rxBuffer_.consume(n);
+        rxBuffer_.consumeCommit(0, n);
+        return n;
+    }
+
+    ssize_t consume(size_t size) {
+        const size_t n = std::min((size_t)CHECK(data()), size);
+        ssize_t r = 0;
+        if (n > 0) {
+            RxLock lk(uarte_);
+            r = CHECK(rxBuffer_.get(nullptr, n));
+        }
+        if (!receiving_) {
+            startReceiver();
+        }
+        return r;
+    }
+
     ssize_t space() {
         CHECK_TRUE(isEnabled(), SYSTEM_ERROR_INVALID_STATE);
         TxLock lk(uarte_);
@@ -739,6 +762,16 @@ ssize_t HAL_USART_Peek(HAL_USART_Serial serial, void* buffer, size_t size, size_
     return usart->peek((uint8_t*)buffer, size);
 }
 
+int32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data, void* reserved) {
+    auto usart = CHECK_TRUE_RETURN(getInstance(serial), SYSTEM_ERROR_NOT_FOUND);
+    return usart->peekBuffer(data);
+}
+
+int32_t HAL_USART_Consume_Buffer(HAL_USART_Serial serial, size_t size, void* reserved) {
+    auto usart = CHECK_TRUE_RETURN(getInstance(serial), SYSTEM_ERROR_NOT_FOUND);
+    return usart->consume(size);
+}
+
 int32_t HAL_USART_Read_Data(HAL_USART_Serial serial) {
     auto usart = CHECK_TRUE_RETURN(getInstance(serial), SYSTEM_ERROR_NOT_FOUND);
     uint8_t c;
@@ -100,6 +100,22 @@ void HAL_USB_USART_Flush_Data(HAL_USB_USART_Serial serial) {
     usb_uart_flush_tx_data();
 }
 
+int32_t HAL_USB_USART_Send_Buffer(HAL_USB_USART_Serial serial, const uint8_t* data, size_t size, void* reserved) {
+    return usb_uart_write(data, size);
+}
+
+int32_t HAL_USB_USART_Receive_Buffer(HAL_USB_USART_Serial serial, uint8_t* data, size_t size, void* reserved) {
+    return usb_uart_read(data, size);
+}
+
+int32_t HAL_USB_USART_Peek_Buffer(HAL_USB_USART_Serial serial, const uint8_t** data, void* reserved) {
+    return usb_uart_peek_buffer(data);
+}
+
+int32_t HAL_USB_USART_Consume_Buffer(HAL_USB_USART_Serial serial, size_t size, void* reserved) {
+    return usb_uart_consume(size);
+}
+
 bool HAL_USB_USART_Is_Enabled(HAL_USB_USART_Serial serial) {
     return usb_hal_is_enabled();
 }
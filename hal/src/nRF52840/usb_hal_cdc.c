@@ -34,7 +34,6 @@
 #include "app_usbd_string_desc.h"
 #include "app_usbd_cdc_acm.h"
 #include "app_usbd_serial_num.h"
-#include "app_fifo.h"
 #include "usb_hal_cdc.h"
 #include "deviceid_hal.h"
 #include "bytes2hexbuf.h"
@@ -75,13 +74,7 @@ typedef struct {
     volatile HAL_USB_State  state;
     usb_mode_t              mode;
 
-    app_fifo_t              rx_fifo;
-    app_fifo_t              tx_fifo;
-
     volatile bool           com_opened;
-    volatile bool           transmitting;
-    volatile uint32_t       rx_data_size;
-    volatile bool           rx_done;
 
     void (*bit_rate_changed_handler)(uint32_t bitRate);
     HAL_USB_State_Callback  state_callback[MAX_USB_STATE_CB_NUM];
@@ -92,12 +85,6 @@ typedef struct {
 
 static usb_instance_t m_usb_instance = {0};
 
-// Rx buffer length must by multiple of NRF_DRV_USBD_EPSIZE.
-#define READ_SIZE       (NRF_DRV_USBD_EPSIZE * 2)
-static char m_rx_buffer[READ_SIZE];
-#define SEND_SIZE       NRF_DRV_USBD_EPSIZE
-static char             m_tx_buffer[SEND_SIZE];
-
 static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
                                     app_usbd_cdc_acm_user_event_t event);
 /**
@@ -113,22 +100,6 @@ APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
                             APP_USBD_CDC_COMM_PROTOCOL_AT_V250
 );
 
-#define FIFO_LENGTH(p_fifo)     fifo_length(p_fifo)  /**< Macro for calculating the FIFO length. */
-#define IS_FIFO_FULL(p_fifo)    fifo_full(p_fifo)
-static __INLINE uint32_t fifo_length(app_fifo_t * p_fifo) {
-    uint32_t tmp = p_fifo->read_pos;
-    return p_fifo->write_pos - tmp;
-}
-static __INLINE bool fifo_full(app_fifo_t * p_fifo) {
-    return (FIFO_LENGTH(p_fifo) > p_fifo->buf_size_mask);
-}
-
-static void reset_rx_tx_state(void) {
-    m_usb_instance.rx_done = false;
-    m_usb_instance.rx_data_size = 0;
-    m_usb_instance.transmitting = false;
-}
-
 static void set_usb_state(HAL_USB_State state) {
     if (m_usb_instance.state != state) {
 #ifdef DEBUG_BUILD
@@ -162,7 +133,6 @@ static void set_usb_state(HAL_USB_State state) {
 static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
                                     app_usbd_cdc_acm_user_event_t event)
 {
-    // static bool io_pending = false;
     app_usbd_cdc_acm_t const *cdc_acm_class = app_usbd_cdc_acm_class_get(p_inst);
 
     switch (event) {
@@ -173,71 +143,27 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             break;
         }
         case APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN: {
-            // reset buffer state
+            // Discard the buffered data and setup the first transfer
             m_usb_instance.com_opened = true;
-            reset_rx_tx_state();
-            app_fifo_flush(&m_usb_instance.tx_fifo);
-            app_fifo_flush(&m_usb_instance.rx_fifo);
-
-            // Setup first transfer.
-            (void)app_usbd_cdc_acm_read_any(cdc_acm_class, m_rx_buffer, READ_SIZE);
-            // TODO: do we need delay?
-            // nrf_delay_ms(10);
+            usb_cdc_buffer_open();
 
             LOG_DEBUG(TRACE, "com open!");
             break;
         }
         case APP_USBD_CDC_ACM_USER_EVT_PORT_CLOSE:{
             m_usb_instance.com_opened = false;
-            LOG_DEBUG(TRACE, "com close! %d", FIFO_LENGTH(&m_usb_instance.tx_fifo));
+            usb_cdc_buffer_close();
+            LOG_DEBUG(TRACE, "com close!");
             break;
         }
         case APP_USBD_CDC_ACM_USER_EVT_TX_DONE: {
-            uint8_t data = 0;
-            uint16_t size = 0;
-
-            if (m_usb_instance.com_opened == false) {
-                m_usb_instance.transmitting = false;
-                LOG_DEBUG(TRACE, "tx done, but com close! %d", FIFO_LENGTH(&m_usb_instance.tx_fifo));
-
-                return;
-            }
-
-            while ((size < SEND_SIZE) && (app_fifo_get(&m_usb_instance.tx_fifo, &data) == NRF_SUCCESS)) {
-                m_tx_buffer[size++] = data;
-            }
-
-            if (size == 0) {
-                m_usb_instance.transmitting = false;
-            } else {
-                m_usb_instance.transmitting = true;  // app_usbd_cdc_acm_write() cause interrupt before return!
-                uint32_t ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, m_tx_buffer, size);
-                if (ret != NRF_SUCCESS) {
-                    m_usb_instance.transmitting = false;
-                    LOG_DEBUG(ERROR, "ERROR: send data FAILED!");
-                }
-            }
+            usb_cdc_buffer_tx_done();
             break;
         }
         case APP_USBD_CDC_ACM_USER_EVT_RX_DONE: {
-            m_usb_instance.rx_done = true;
-            m_usb_instance.rx_data_size = app_usbd_cdc_acm_rx_size(cdc_acm_class);
-
-            LOG_DEBUG(TRACE, "rx size: %d", m_usb_instance.rx_data_size);
-
-            if (FIFO_LENGTH(&m_usb_instance.rx_fifo) + m_usb_instance.rx_data_size <= m_usb_instance.rx_fifo.buf_size_mask) {
-                // Receive data into buffer
-                for (int i = 0; i < m_usb_instance.rx_data_size; i++) {
-                    SPARK_ASSERT(app_fifo_put(&m_usb_instance.rx_fifo, m_rx_buffer[i]) == NRF_SUCCESS);
-                }
-
-                // Reset receive status
-                m_usb_instance.rx_done = false;
-                m_usb_instance.rx_data_size = 0;
-
-                // Setup next transfer.
-                app_usbd_cdc_acm_read_any(cdc_acm_class, m_rx_buffer, READ_SIZE);
-            }
+            size_t size = app_usbd_cdc_acm_rx_size(cdc_acm_class);
+            LOG_DEBUG(TRACE, "rx size: %d", size);
+            usb_cdc_buffer_rx_done(size);
             break;
         }
         default:
@@ -291,7 +217,7 @@ static void usbd_user_ev_handler(app_usbd_event_type_t event)
         case APP_USBD_EVT_STARTED: {
             // triggered by app_usbd_start()
             m_usb_instance.com_opened = false;
-            reset_rx_tx_state();
+            usb_cdc_buffer_close();
             set_usb_state(nrf_usb_state_to_hal_usb_state(app_usbd_core_state_get()));
             break;
         }
@@ -378,14 +304,10 @@ int usb_uart_init(uint8_t *rx_buf, uint16_t rx_buf_size, uint8_t *tx_buf, uint16
         return 0;
     }
 
-    if (app_fifo_init(&m_usb_instance.rx_fifo, rx_buf, rx_buf_size)) {
+    if (usb_cdc_buffer_init(rx_buf, rx_buf_size, tx_buf, tx_buf_size) != 0) {
         return  -1;
     }
 
-    if (app_fifo_init(&m_usb_instance.tx_fifo, tx_buf, tx_buf_size)) {
-        return  -2;
-    }
-
     app_usbd_class_inst_t const * class_cdc_acm = app_usbd_cdc_acm_class_inst_get(&m_app_cdc_acm);
     ret = app_usbd_class_append(class_cdc_acm);
     SPARK_ASSERT(ret == NRF_SUCCESS);
@@ -412,48 +334,46 @@ int usb_uart_init(uint8_t *rx_buf, uint16_t rx_buf_size, uint8_t *tx_buf, uint16
     return 0;
 }
 
-int usb_uart_send(uint8_t data[], uint16_t size) {
+bool usb_uart_can_send(void) {
     if (m_usb_instance.state != HAL_USB_STATE_CONFIGURED || !m_usb_instance.com_opened) {
-        return -1;
+        return false;
     }
 
+    // Waiting for space in the transmit buffer is not possible with the USB interrupts masked
 #ifdef SOFTDEVICE_PRESENT
     if (nrf_nvic_state.__cr_flag || __get_PRIMASK() || __get_BASEPRI() >= USBD_CONFIG_IRQ_PRIORITY) {
 #else
     if ((__get_PRIMASK() & 1)) {
 #endif // SOFTDEVICE_PRESENT
-        return -1;
+        return false;
     }
 
-    for (int i = 0; i < size; i++) {
-        // wait until tx fifo is available
-        while (IS_FIFO_FULL(&m_usb_instance.tx_fifo));
-        SPARK_ASSERT(app_fifo_put(&m_usb_instance.tx_fifo, data[i]) == NRF_SUCCESS);
+    return true;
+}
+
+int usb_cdc_transmit(const uint8_t* data, size_t size) {
+    // app_usbd_cdc_acm_write() may report the completion before it returns
+    uint32_t ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, data, size);
+    if (ret != NRF_SUCCESS) {
+        LOG_DEBUG(ERROR, "ERROR: send data FAILED!");
+        return SYSTEM_ERROR_IO;
     }
+    return 0;
+}
 
-    uint32_t ret;
-    uint16_t pre_send_size = 0;
-    uint8_t  pre_send_data = 0;
-
-    // trigger first transmitting
-    if (!m_usb_instance.transmitting) {
-        while ((pre_send_size < SEND_SIZE) &&
-               (app_fifo_get(&m_usb_instance.tx_fifo, &pre_send_data) == NRF_SUCCESS))
-        {
-            m_tx_buffer[pre_send_size++] = pre_send_data;
-        }
+int usb_cdc_receive(uint8_t* data, size_t size) {
+    app_usbd_class_inst_t const * class_cdc_inst = app_usbd_cdc_acm_class_inst_get(&m_app_cdc_acm);
+    app_usbd_cdc_acm_t const *cdc_acm_class = app_usbd_cdc_acm_class_get(class_cdc_inst);
 
-        m_usb_instance.transmitting = true; // app_usbd_cdc_acm_write() cause interrupt before return!
-        ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, m_tx_buffer, pre_send_size);
-        if (ret != NRF_SUCCESS) {
-            m_usb_instance.transmitting = false;
-            pre_send_size = 0;
-            LOG_DEBUG(ERROR, "ERROR: send data FAILED!");
-        }
+    uint32_t ret = app_usbd_cdc_acm_read_any(cdc_acm_class, data, size);
+    if (ret == NRF_ERROR_IO_PENDING) {
+        return 0;
     }
-
-    // NOTE: we only care and report about how many bytes were actually put into the transmit buffer
-    return size;
+    if (ret == NRF_SUCCESS) {
+        // The data has been received already
+        return app_usbd_cdc_acm_rx_size(cdc_acm_class);
+    }
+    return SYSTEM_ERROR_IO;
 }
 
 void usb_uart_set_baudrate(uint32_t baudrate) {
@@ -513,56 +433,6 @@ void usb_hal_detach(void) {
     set_usb_state(HAL_USB_STATE_DISABLED);
 }
 
-int usb_uart_available_rx_data(void) {
-    return FIFO_LENGTH(&m_usb_instance.rx_fifo) + m_usb_instance.rx_data_size;
-}
-
-uint8_t usb_uart_get_rx_data(void) {
-    if (m_usb_instance.rx_done) {
-        if (FIFO_LENGTH(&m_usb_instance.rx_fifo) + m_usb_instance.rx_data_size <= m_usb_instance.rx_fifo.buf_size_mask) {
-            for (int i = 0; i < m_usb_instance.rx_data_size; i++) {
-                SPARK_ASSERT(app_fifo_put(&m_usb_instance.rx_fifo, m_rx_buffer[i]) == NRF_SUCCESS);
-            }
-
-            app_usbd_class_inst_t const * class_cdc_inst = app_usbd_cdc_acm_class_inst_get(&m_app_cdc_acm);
-            app_usbd_cdc_acm_t const *cdc_acm_class = app_usbd_cdc_acm_class_get(class_cdc_inst);
-
-            m_usb_instance.rx_done = false;
-            m_usb_instance.rx_data_size = 0;
-
-            // Setup next transfer.
-            app_usbd_cdc_acm_read_any(cdc_acm_class, m_rx_buffer, READ_SIZE);
-        }
-    }
-
-    uint8_t data = 0;
-    if (FIFO_LENGTH(&m_usb_instance.rx_fifo)) {
-        SPARK_ASSERT(app_fifo_get(&m_usb_instance.rx_fifo, &data) == NRF_SUCCESS);
-    }
-
-    return data;
-}
-
-uint8_t usb_uart_peek_rx_data(uint8_t index) {
-    uint8_t data = 0;
-    if (app_fifo_peek(&m_usb_instance.rx_fifo, index, &data)) {
-        return 0;
-    }
-    return data;
-}
-
-void usb_uart_flush_rx_data(void) {
-    app_fifo_flush(&m_usb_instance.rx_fifo);
-}
-
-void usb_uart_flush_tx_data(void) {
-    app_fifo_flush(&m_usb_instance.tx_fifo);
-}
-
-int usb_uart_available_tx_data(void) {
-    return m_usb_instance.tx_fifo.buf_size_mask - FIFO_LENGTH(&m_usb_instance.tx_fifo) + 1;
-}
-
 bool usb_hal_is_enabled(void) {
     return m_usb_instance.initialized;
 }
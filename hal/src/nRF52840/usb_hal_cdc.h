@@ -2,6 +2,7 @@
 #define  _USB_HAL_CDC_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "usb_hal.h"
 
 #ifdef __cplusplus
@@ -13,6 +14,11 @@ bool usb_hal_is_enabled(void);
 int usb_uart_init(uint8_t *rx_buf, uint16_t rx_buf_size, uint8_t *tx_buf, uint16_t tx_buf_size);
 HAL_USB_State usb_hal_get_state();
 int usb_uart_send(uint8_t data[], uint16_t size);
+int usb_uart_write(const uint8_t* data, size_t size);
+int usb_uart_read(uint8_t* data, size_t size);
+int usb_uart_peek_buffer(const uint8_t** data);
+int usb_uart_consume(size_t size);
+bool usb_uart_can_send(void);
 int usb_uart_available_data(void);
 
 void usb_uart_set_baudrate(uint32_t baudrate);
@@ -30,6 +36,17 @@ bool usb_hal_is_connected(void);
 void usb_hal_set_bit_rate_changed_handler(void (*handler)(uint32_t bitRate));
 int usb_hal_set_state_change_callback(HAL_USB_State_Callback cb, void* context, void* reserved);
 
+// Endpoint transfers used by the CDC buffer (usb_hal_cdc_buffer.cpp)
+int usb_cdc_transmit(const uint8_t* data, size_t size);
+int usb_cdc_receive(uint8_t* data, size_t size);
+
+// CDC buffer events
+int usb_cdc_buffer_init(uint8_t* rx_buf, size_t rx_buf_size, uint8_t* tx_buf, size_t tx_buf_size);
+void usb_cdc_buffer_open(void);
+void usb_cdc_buffer_close(void);
+void usb_cdc_buffer_tx_done(void);
+void usb_cdc_buffer_rx_done(size_t size);
+
 #ifdef __cplusplus
 }
 #endif
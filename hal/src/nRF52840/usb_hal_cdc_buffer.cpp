@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "usb_hal_cdc.h"
+#include "usb_cdc_buffer.h"
+#include "interrupts_hal.h"
+#include "logging.h"
+#include "nrf_drv_usbd.h"
+
+namespace {
+
+using namespace particle;
+
+class UsbCdcEndpoint {
+public:
+    int transmit(const uint8_t* data, size_t size) {
+        return usb_cdc_transmit(data, size);
+    }
+
+    int receive(uint8_t* data, size_t size) {
+        return usb_cdc_receive(data, size);
+    }
+
+    int lock() {
+        return HAL_disable_irq();
+    }
+
+    void unlock(int state) {
+        HAL_enable_irq(state);
+    }
+};
+
+// EasyDMA transfers data directly from and to the rings
+detail::UsbCdcBuffer<UsbCdcEndpoint, NRF_DRV_USBD_EPSIZE> g_cdcBuffer;
+
+} // unnamed
+
+int usb_cdc_buffer_init(uint8_t* rx_buf, size_t rx_buf_size, uint8_t* tx_buf, size_t tx_buf_size) {
+    const int r = g_cdcBuffer.init(rx_buf, rx_buf_size, tx_buf, tx_buf_size);
+    if (r < 0) {
+        // HAL_USB_USART_Init() has no way to report the error
+        LOG(ERROR, "Invalid USB serial buffer sizes: RX %u, TX %u; both must be powers of two and at least %u bytes",
+                (unsigned)rx_buf_size, (unsigned)tx_buf_size, (unsigned)decltype(g_cdcBuffer)::MIN_BUFFER_SIZE);
+    }
+    return r;
+}
+
+void usb_cdc_buffer_open(void) {
+    g_cdcBuffer.open();
+}
+
+void usb_cdc_buffer_close(void) {
+    g_cdcBuffer.close();
+}
+
+void usb_cdc_buffer_tx_done(void) {
+    g_cdcBuffer.txDone();
+}
+
+void usb_cdc_buffer_rx_done(size_t size) {
+    g_cdcBuffer.rxDone(size);
+}
+
+int usb_uart_send(uint8_t data[], uint16_t size) {
+    if (!usb_uart_can_send()) {
+        return -1;
+    }
+    for (size_t offs = 0; offs < size;) {
+        // Wait until the transmit buffer is available
+        offs += g_cdcBuffer.write(data + offs, size - offs);
+        if (!g_cdcBuffer.isOpen()) {
+            return -1;
+        }
+    }
+    // NOTE: we only care and report about how many bytes were actually put into the transmit buffer
+    return size;
+}
+
+int usb_uart_write(const uint8_t* data, size_t size) {
+    if (!usb_uart_can_send()) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    return g_cdcBuffer.write(data, size);
+}
+
+int usb_uart_read(uint8_t* data, size_t size) {
+    return g_cdcBuffer.read(data, size);
+}
+
+int usb_uart_peek_buffer(const uint8_t** data) {
+    return g_cdcBuffer.peekBuffer(data);
+}
+
+int usb_uart_consume(size_t size) {
+    return g_cdcBuffer.consume(size);
+}
+
+int usb_uart_available_rx_data(void) {
+    return g_cdcBuffer.available();
+}
+
+uint8_t usb_uart_get_rx_data(void) {
+    uint8_t data = 0;
+    g_cdcBuffer.read(&data, 1);
+    return data;
+}
+
+uint8_t usb_uart_peek_rx_data(uint8_t index) {
+    if (index != 0) {
+        return 0;
+    }
+    return std::max(0, g_cdcBuffer.peek());
+}
+
+void usb_uart_flush_rx_data(void) {
+    g_cdcBuffer.flushRx();
+}
+
+void usb_uart_flush_tx_data(void) {
+    g_cdcBuffer.flushTx();
+}
+
+int usb_uart_available_tx_data(void) {
+    return g_cdcBuffer.availableForWrite();
+}
@@ -18,8 +18,8 @@
 #ifndef USB_SETTINGS_H_
 #define USB_SETTINGS_H_
 
-#define USB_TX_BUFFER_SIZE              256
-#define USB_RX_BUFFER_SIZE              256
+#define USB_TX_BUFFER_SIZE              1024 /* Must be a power of two */
+#define USB_RX_BUFFER_SIZE              256  /* Must be a power of two */
 
 #define USB_SERIAL_USERSPACE_BUFFERS    1
 
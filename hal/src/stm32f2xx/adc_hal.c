@@ -25,6 +25,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "adc_hal.h"
+#include "system_error.h"
 #include "gpio_hal.h"
 #include "pinmap_hal.h"
 #include "pinmap_impl.h"
@@ -223,3 +224,12 @@ void HAL_ADC_DMA_Init()
     ADC_InitStructure.ADC_NbrOfConversion = 1;
     ADC_Init(ADC2, &ADC_InitStructure);
 }
+
+int HAL_ADC_Stream_Start(const HAL_ADC_Stream_Config* config, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+void HAL_ADC_Stream_Stop(void* reserved)
+{
+}
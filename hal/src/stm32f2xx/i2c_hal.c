@@ -1210,6 +1210,15 @@ int32_t HAL_I2C_Release(HAL_I2C_Interface i2c, void* reserved)
     return -1;
 }
 
+int HAL_I2C_Transfer_Async(HAL_I2C_Interface i2c, const HAL_I2C_Transfer_Config* config, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+void HAL_I2C_Transfer_Cancel(HAL_I2C_Interface i2c, void* reserved)
+{
+}
+
 // On the Photon/P1 the I2C interface selector was added after the first release.
 // So these compatibility functions are needed for older firmware
 
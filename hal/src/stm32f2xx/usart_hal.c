@@ -28,6 +28,7 @@
 #include "pinmap_hal.h"
 #include "pinmap_impl.h"
 #include "gpio_hal.h"
+#include "system_error.h"
 #include "stm32f2xx.h"
 #include <string.h>
 #include "interrupts_hal.h"
@@ -662,6 +663,17 @@ uint8_t HAL_USART_Break_Detected(HAL_USART_Serial serial)
 	return 0;
 }
 
+int32_t HAL_USART_Peek_Buffer(HAL_USART_Serial serial, const uint8_t** data, void* reserved)
+{
+	// The receive buffer holds 16-bit elements
+	return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USART_Consume_Buffer(HAL_USART_Serial serial, size_t size, void* reserved)
+{
+	return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
 // Shared Interrupt Handler for USART2/Serial1 and USART1/Serial2
 // WARNING: This function MUST remain reentrance compliant -- no local static variables etc.
 static void HAL_USART_Handler(HAL_USART_Serial serial)
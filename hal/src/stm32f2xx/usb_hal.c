@@ -44,6 +44,7 @@
 #include "usbd_desc_device.h"
 #include <stdlib.h>
 #include "ringbuf_helper.h"
+#include "system_error.h"
 
 LOG_SOURCE_CATEGORY("usb.hal")
 
@@ -549,6 +550,26 @@ void HAL_USB_USART_Flush_Data(HAL_USB_USART_Serial serial)
     while(usbUsartMap[serial].data->tx_state == 1);
 }
 
+int32_t HAL_USB_USART_Send_Buffer(HAL_USB_USART_Serial serial, const uint8_t* data, size_t size, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USB_USART_Receive_Buffer(HAL_USB_USART_Serial serial, uint8_t* data, size_t size, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USB_USART_Peek_Buffer(HAL_USB_USART_Serial serial, const uint8_t** data, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int32_t HAL_USB_USART_Consume_Buffer(HAL_USB_USART_Serial serial, size_t size, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
 bool HAL_USB_USART_Is_Enabled(HAL_USB_USART_Serial serial)
 {
     return usbUsartMap[serial].registered;
@@ -24,6 +24,7 @@
  */
 
 #include "adc_hal.h"
+#include "system_error.h"
 
 void HAL_ADC_Set_Sample_Time(uint8_t ADC_SampleTime)
 {
@@ -45,3 +46,12 @@ int32_t HAL_ADC_Read(uint16_t pin)
 void HAL_ADC_DMA_Init()
 {
 }
+
+int HAL_ADC_Stream_Start(const HAL_ADC_Stream_Config* config, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+void HAL_ADC_Stream_Stop(void* reserved)
+{
+}
@@ -148,3 +148,12 @@ int32_t HAL_I2C_Release(HAL_I2C_Interface i2c, void* reserved)
 {
     return SYSTEM_ERROR_NOT_SUPPORTED;
 }
+
+int HAL_I2C_Transfer_Async(HAL_I2C_Interface i2c, const HAL_I2C_Transfer_Config* config, void* reserved)
+{
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+void HAL_I2C_Transfer_Cancel(HAL_I2C_Interface i2c, void* reserved)
+{
+}
@@ -317,10 +317,22 @@ typedef ret_code_t nrfx_err_t;
 //------------------------------------------------------------------------------
 
 #include <sdk_resources.h>
+
+/**
+ * @brief PPI channels and TIMER instances used by the HAL directly, without the nrfx drivers.
+ */
+#define PLATFORM_USART_TIMER_MASK       ((1 << 2) | (1 << 3))   // TIMER2, TIMER3: UARTE receive counters
+#define PLATFORM_USART_PPI_CHANNEL_MASK ((1 << 4) | (1 << 5))   // Channels 4, 5: UARTE RXDRDY -> TIMER COUNT
+#define PLATFORM_ADC_STREAM_TIMER       4                       // TIMER4: SAADC sample clock
+#define PLATFORM_ADC_STREAM_PPI_CHANNEL 6                       // Channel 6: TIMER4 COMPARE0 -> SAADC SAMPLE
+
+#define PLATFORM_TIMERS_USED        (PLATFORM_USART_TIMER_MASK | (1 << PLATFORM_ADC_STREAM_TIMER))
+#define PLATFORM_PPI_CHANNELS_USED  (PLATFORM_USART_PPI_CHANNEL_MASK | (1 << PLATFORM_ADC_STREAM_PPI_CHANNEL))
+
 /**
  * @brief Bitmask defining PPI channels reserved to be used outside of nrfx.
  */
-#define NRFX_PPI_CHANNELS_USED  NRF_PPI_CHANNELS_USED
+#define NRFX_PPI_CHANNELS_USED  (NRF_PPI_CHANNELS_USED | PLATFORM_PPI_CHANNELS_USED)
 
 /**
  * @brief Bitmask defining PPI groups reserved to be used outside of nrfx.
@@ -335,7 +347,7 @@ typedef ret_code_t nrfx_err_t;
 /**
  * @brief Bitmask defining TIMER instances reserved to be used outside of nrfx.
  */
-#define NRFX_TIMERS_USED        NRF_TIMERS_USED
+#define NRFX_TIMERS_USED        (NRF_TIMERS_USED | PLATFORM_TIMERS_USED)
 
 /** @} */
 
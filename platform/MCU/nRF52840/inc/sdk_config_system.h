@@ -122,7 +122,8 @@
 #define NRFX_SPIS3_ENABLED      0
 
 #define NRFX_TIMER2_ENABLED     1
-#define NRFX_TIMER4_ENABLED     1
+// TIMER4 is reserved for the ADC stream, see PLATFORM_ADC_STREAM_TIMER
+#define NRFX_TIMER4_ENABLED     0
 
 #define USBD_ENABLED                            1
 #define USBD_CONFIG_IRQ_PRIORITY                APP_IRQ_PRIORITY_LOW
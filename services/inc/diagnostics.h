@@ -55,9 +55,12 @@
 #define DIAG_NAME_CLOUD_DISCONNECTION_REASON "cloud:dconnrsn"
 #define DIAG_NAME_CLOUD_REPEATED_MESSAGES "coap:resend"
 #define DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES "coap:unack"
+#define DIAG_NAME_CLOUD_ROUND_TRIP_TIME "coap:rtt"
+#define DIAG_NAME_CLOUD_RETRANSMISSION_TIMEOUT "coap:rto"
 #define DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS "pub:limit"
 #define DIAG_NAME_SYSTEM_TOTAL_RAM "sys:tram"
 #define DIAG_NAME_SYSTEM_USED_RAM "sys:uram"
+#define DIAG_NAME_SYSTEM_BOOT_TIME "sys:boot"
 
 #ifdef __cplusplus
 extern "C" {
@@ -100,9 +103,12 @@ typedef enum diag_id {
     DIAG_ID_CLOUD_DISCONNECTION_REASON = 30, // cloud:dconnrsn
     DIAG_ID_CLOUD_REPEATED_MESSAGES = 21, // coap:resend
     DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES = 22, // coap:unack
+    DIAG_ID_CLOUD_ROUND_TRIP_TIME = 44, // coap:rtt
+    DIAG_ID_CLOUD_RETRANSMISSION_TIMEOUT = 45, // coap:rto
     DIAG_ID_CLOUD_RATE_LIMITED_EVENTS = 20, // pub:throttle
     DIAG_ID_SYSTEM_TOTAL_RAM = 25, // sys:tram
     DIAG_ID_SYSTEM_USED_RAM = 26, // sys:uram
+    DIAG_ID_SYSTEM_BOOT_TIME = 46, // sys:boot
     DIAG_ID_USER = 32768 // Base value for application-specific source IDs
 } diag_id;
 
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <cstring>
+
+namespace particle {
+
+/**
+ * Returns the number of days between 1970-01-01 and the specified date of the proleptic Gregorian
+ * calendar.
+ *
+ * @param year Year.
+ * @param month Month (1-12).
+ * @param day Day of the month (1-31).
+ */
+inline int32_t daysFromCivil(int32_t year, unsigned month, unsigned day) {
+    // See http://howardhinnant.github.io/date_algorithms.html
+    year -= (month <= 2);
+    const int32_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = (unsigned)(year - era * 400); // [0, 399]
+    const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1; // [0, 365]
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy; // [0, 146096]
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+/**
+ * Converts the number of days since 1970-01-01 to a date of the proleptic Gregorian calendar.
+ */
+inline void civilFromDays(int32_t days, int32_t* year, unsigned* month, unsigned* day) {
+    days += 719468;
+    const int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = (unsigned)(days - era * 146097); // [0, 146096]
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100); // [0, 365]
+    const unsigned mp = (5 * doy + 2) / 153; // [0, 11]
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int32_t)yoe + era * 400 + (*month <= 2);
+}
+
+inline bool isLeapYear(int32_t year) {
+    return (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0);
+}
+
+/**
+ * Converts the Unix time to the calendar time in UTC.
+ *
+ * This function is an equivalent of `gmtime_r()` that doesn't depend on the time zone settings of
+ * the C library and is safe to call from different threads.
+ */
+inline struct tm* unixTimeToCalendar(int64_t time, struct tm* tm) {
+    int64_t days = time / 86400;
+    int32_t secs = (int32_t)(time % 86400);
+    if (secs < 0) {
+        secs += 86400;
+        --days;
+    }
+    int32_t year = 0;
+    unsigned month = 0, day = 0;
+    civilFromDays((int32_t)days, &year, &month, &day);
+    tm->tm_sec = secs % 60;
+    tm->tm_min = secs / 60 % 60;
+    tm->tm_hour = secs / 3600;
+    tm->tm_mday = day;
+    tm->tm_mon = month - 1;
+    tm->tm_year = year - 1900;
+    tm->tm_wday = (int)((days % 7 + 11) % 7); // 1970-01-01 was a Thursday
+    tm->tm_yday = (int)(days - daysFromCivil(year, 1, 1));
+    tm->tm_isdst = 0;
+    return tm;
+}
+
+/**
+ * Converts the calendar time in UTC to the Unix time.
+ *
+ * This function is an equivalent of `timegm()`. The month can be out of range; the day of the
+ * month, hours, minutes and seconds can be out of range in either direction. `tm_wday`, `tm_yday`
+ * and `tm_isdst` are ignored.
+ */
+inline int64_t calendarToUnixTime(const struct tm& tm) {
+    int32_t year = tm.tm_year + 1900 + tm.tm_mon / 12;
+    int month = tm.tm_mon % 12;
+    if (month < 0) {
+        month += 12;
+        --year;
+    }
+    const int64_t days = daysFromCivil(year, month + 1, 1) + (int64_t)tm.tm_mday - 1;
+    return days * 86400 + (int64_t)tm.tm_hour * 3600 + (int64_t)tm.tm_min * 60 + tm.tm_sec;
+}
+
+namespace detail {
+
+const char* const TIME_WEEKDAYS[] = { "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday" };
+const char* const TIME_MONTHS[] = { "January", "February", "March", "April", "May", "June", "July", "August", "September",
+        "October", "November", "December" };
+
+const char TIME_FORMAT_ISO8601[] = "%Y-%m-%dT%H:%M:%S%z";
+
+// Output buffer that keeps track of the remaining space
+class TimeWriter {
+public:
+    TimeWriter(char* buf, size_t size) :
+            buf_(buf),
+            size_(size),
+            len_(0),
+            ok_(size > 0) {
+    }
+
+    void put(char c) {
+        if (len_ + 1 < size_) {
+            buf_[len_++] = c;
+        } else {
+            ok_ = false;
+        }
+    }
+
+    void put(const char* str, size_t n) {
+        if (len_ + n < size_) {
+            std::memcpy(buf_ + len_, str, n);
+            len_ += n;
+        } else {
+            ok_ = false;
+        }
+    }
+
+    // Writes a zero-padded or space-padded decimal number
+    void number(unsigned val, unsigned width, char pad = '0') {
+        char d[10];
+        unsigned n = 0;
+        do {
+            d[n++] = '0' + val % 10;
+            val /= 10;
+        } while (val > 0 && n < sizeof(d));
+        while (n < width) {
+            d[n++] = pad;
+        }
+        while (n > 0) {
+            put(d[--n]);
+        }
+    }
+
+    void year(int year) {
+        if (year < 0) {
+            put('-');
+            year = -year;
+        }
+        number(year, 4);
+    }
+
+    void utcOffset(int offs) {
+        if (!offs) {
+            put('Z');
+            return;
+        }
+        put(offs < 0 ? '-' : '+');
+        if (offs < 0) {
+            offs = -offs;
+        }
+        number(offs / 3600, 2);
+        put(':');
+        number(offs / 60 % 60, 2);
+    }
+
+    size_t finish() {
+        if (!ok_) {
+            if (size_ > 0) {
+                buf_[0] = '\0';
+            }
+            return 0;
+        }
+        buf_[len_] = '\0';
+        return len_;
+    }
+
+    char* end() const {
+        return buf_ + len_;
+    }
+
+    size_t available() const {
+        return size_ - len_;
+    }
+
+    void advance(size_t n) {
+        len_ += n;
+    }
+
+    void fail() {
+        ok_ = false;
+    }
+
+private:
+    char* buf_;
+    size_t size_;
+    size_t len_;
+    bool ok_;
+};
+
+inline char* putTwoDigits(char* p, unsigned val) {
+    p[0] = '0' + val / 10;
+    p[1] = '0' + val % 10;
+    return p + 2;
+}
+
+inline unsigned hour12(const struct tm& tm) {
+    const unsigned h = tm.tm_hour % 12;
+    return h ? h : 12;
+}
+
+inline void iso8601(const struct tm& tm, int utcOffset, TimeWriter* w) {
+    w->year(tm.tm_year + 1900);
+    w->put('-');
+    w->number(tm.tm_mon + 1, 2);
+    w->put('-');
+    w->number(tm.tm_mday, 2);
+    w->put('T');
+    w->number(tm.tm_hour, 2);
+    w->put(':');
+    w->number(tm.tm_min, 2);
+    w->put(':');
+    w->number(tm.tm_sec, 2);
+    w->utcOffset(utcOffset);
+}
+
+} // particle::detail
+
+/**
+ * Formats the calendar time in the ISO 8601/RFC 3339 format (`YYYY-MM-DDThh:mm:ss+hh:mm`).
+ *
+ * @see `formatTime()`
+ */
+inline size_t formatTimeIso8601(const struct tm& tm, int utcOffset, char* buf, size_t size) {
+    const int year = tm.tm_year + 1900;
+    if (size > 25 && year >= 0 && year <= 9999 && utcOffset > -100 * 3600 && utcOffset < 100 * 3600) {
+        // Fixed-width output
+        char* p = buf;
+        p = detail::putTwoDigits(p, year / 100);
+        p = detail::putTwoDigits(p, year % 100);
+        *p++ = '-';
+        p = detail::putTwoDigits(p, tm.tm_mon + 1);
+        *p++ = '-';
+        p = detail::putTwoDigits(p, tm.tm_mday);
+        *p++ = 'T';
+        p = detail::putTwoDigits(p, tm.tm_hour);
+        *p++ = ':';
+        p = detail::putTwoDigits(p, tm.tm_min);
+        *p++ = ':';
+        p = detail::putTwoDigits(p, tm.tm_sec);
+        if (utcOffset) {
+            const unsigned offs = (utcOffset < 0) ? -utcOffset : utcOffset;
+            *p++ = (utcOffset < 0) ? '-' : '+';
+            p = detail::putTwoDigits(p, offs / 3600);
+            *p++ = ':';
+            p = detail::putTwoDigits(p, offs / 60 % 60);
+        } else {
+            *p++ = 'Z';
+        }
+        *p = '\0';
+        return p - buf;
+    }
+    detail::TimeWriter w(buf, size);
+    detail::iso8601(tm, utcOffset, &w);
+    return w.finish();
+}
+
+/**
+ * Formats the calendar time in the format of `asctime()` without the trailing newline.
+ *
+ * @see `formatTime()`
+ */
+inline size_t formatTimeAsctime(const struct tm& tm, char* buf, size_t size) {
+    detail::TimeWriter w(buf, size);
+    w.put(detail::TIME_WEEKDAYS[tm.tm_wday % 7], 3);
+    w.put(' ');
+    w.put(detail::TIME_MONTHS[tm.tm_mon % 12], 3);
+    w.put(' ');
+    w.number(tm.tm_mday, 2, ' ');
+    w.put(' ');
+    w.number(tm.tm_hour, 2);
+    w.put(':');
+    w.number(tm.tm_min, 2);
+    w.put(':');
+    w.number(tm.tm_sec, 2);
+    w.put(' ');
+    w.year(tm.tm_year + 1900);
+    return w.finish();
+}
+
+/**
+ * Formats the calendar time.
+ *
+ * The format string uses the conversion specifiers of `strftime()`. `%z` is replaced with the
+ * specified UTC offset in the `+hh:mm` format, or `Z` if the offset is 0. The ISO 8601/RFC 3339
+ * format (`%Y-%m-%dT%H:%M:%S%z`) and the most common specifiers are formatted without calling
+ * `strftime()`.
+ *
+ * @param tm Calendar time.
+ * @param utcOffset UTC offset in seconds.
+ * @param format Format string.
+ * @param buf Destination buffer.
+ * @param size Buffer size.
+ * @return Length of the formatted string, or 0 if the buffer is too small.
+ */
+inline size_t formatTime(const struct tm& tm, int utcOffset, const char* format, char* buf, size_t size) {
+    if (!std::strcmp(format, detail::TIME_FORMAT_ISO8601)) {
+        return formatTimeIso8601(tm, utcOffset, buf, size);
+    }
+    detail::TimeWriter w(buf, size);
+    for (const char* p = format; *p; ++p) {
+        if (*p != '%' || !p[1]) {
+            w.put(*p);
+            continue;
+        }
+        const char c = *++p;
+        switch (c) {
+        case 'Y':
+            w.year(tm.tm_year + 1900);
+            break;
+        case 'y':
+            w.number((tm.tm_year + 1900) % 100, 2);
+            break;
+        case 'm':
+            w.number(tm.tm_mon + 1, 2);
+            break;
+        case 'd':
+            w.number(tm.tm_mday, 2);
+            break;
+        case 'e':
+            w.number(tm.tm_mday, 2, ' ');
+            break;
+        case 'H':
+            w.number(tm.tm_hour, 2);
+            break;
+        case 'I':
+            w.number(detail::hour12(tm), 2);
+            break;
+        case 'M':
+            w.number(tm.tm_min, 2);
+            break;
+        case 'S':
+            w.number(tm.tm_sec, 2);
+            break;
+        case 'j':
+            w.number(tm.tm_yday + 1, 3);
+            break;
+        case 'p':
+            w.put(tm.tm_hour < 12 ? "AM" : "PM", 2);
+            break;
+        case 'a':
+            w.put(detail::TIME_WEEKDAYS[tm.tm_wday % 7], 3);
+            break;
+        case 'A': {
+            const char* s = detail::TIME_WEEKDAYS[tm.tm_wday % 7];
+            w.put(s, std::strlen(s));
+            break;
+        }
+        case 'b':
+        case 'h':
+            w.put(detail::TIME_MONTHS[tm.tm_mon % 12], 3);
+            break;
+        case 'B': {
+            const char* s = detail::TIME_MONTHS[tm.tm_mon % 12];
+            w.put(s, std::strlen(s));
+            break;
+        }
+        case 'F':
+            w.year(tm.tm_year + 1900);
+            w.put('-');
+            w.number(tm.tm_mon + 1, 2);
+            w.put('-');
+            w.number(tm.tm_mday, 2);
+            break;
+        case 'T':
+            w.number(tm.tm_hour, 2);
+            w.put(':');
+            w.number(tm.tm_min, 2);
+            w.put(':');
+            w.number(tm.tm_sec, 2);
+            break;
+        case 'z':
+            w.utcOffset(utcOffset);
+            break;
+        case '%':
+            w.put('%');
+            break;
+        default: {
+            // Let the C library handle the rest of the specifiers
+            const char spec[] = { '%', c, '\0' };
+            const size_t avail = w.available();
+            const size_t n = avail ? std::strftime(w.end(), avail, spec, &tm) : 0;
+            if (n > 0) {
+                w.advance(n);
+            } else if (avail < 64) {
+                // strftime() returns 0 for an empty result too, which is only plausible if there
+                // was enough space
+                w.fail();
+            }
+            break;
+        }
+        }
+    }
+    return w.finish();
+}
+
+} // particle
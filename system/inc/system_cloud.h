@@ -263,6 +263,7 @@ void spark_unsubscribe(void *reserved);
 bool spark_sync_time(void *reserved);
 bool spark_sync_time_pending(void* reserved);
 system_tick_t spark_sync_time_last(time_t* tm, void* reserved);
+int spark_sync_time_quality(time_sync_quality* quality, void* reserved);
 
 
 void spark_process(void);
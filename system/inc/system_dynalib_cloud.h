@@ -51,6 +51,7 @@ DYNALIB_FN(13, system_cloud, spark_sync_time_last, system_tick_t(time_t*, void*)
 DYNALIB_FN(14, system_cloud, spark_set_connection_property, int(unsigned, unsigned, particle::protocol::connection_properties_t*, void*))
 DYNALIB_FN(15, system_cloud, spark_set_random_seed_from_cloud_handler, int(void (*handler)(unsigned int), void*))
 DYNALIB_FN(16, system_cloud, spark_publish_vitals, int(system_tick_t, void*))
+DYNALIB_FN(17, system_cloud, spark_sync_time_quality, int(time_sync_quality*, void*))
 
 DYNALIB_END(system_cloud)
 
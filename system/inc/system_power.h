@@ -45,10 +45,36 @@ typedef enum {
     POWER_SOURCE_BATTERY = 5
 } power_source_t;
 
+/**
+ * Cached readings of the fuel gauge and PMIC.
+ */
+typedef struct system_power_telemetry {
+    uint16_t size;
+    uint16_t version;
+    system_tick_t timestamp; // Time the readings were sampled, in milliseconds
+    uint16_t vcell; // VCELL register of the fuel gauge
+    uint16_t soc; // SOC register of the fuel gauge
+    uint16_t charge_voltage; // Charge termination voltage, in millivolts
+    uint8_t pmic_status; // System status register of the PMIC
+    uint8_t pmic_fault; // Fault register of the PMIC, as of the last PMIC interrupt
+} system_power_telemetry;
+
 void system_power_management_init();
 void system_power_management_sleep(bool sleep = true);
 int system_power_management_set_config(const hal_power_config* conf, void* reserved);
 
+/**
+ * Returns cached fuel gauge and PMIC readings. The chips are sampled if the cached readings are
+ * older than `max_age` milliseconds.
+ */
+int system_power_management_get_telemetry(system_power_telemetry* telemetry, system_tick_t max_age, void* reserved);
+
+/**
+ * Sets the period at which the power manager samples the fuel gauge and PMIC, in milliseconds.
+ * If the period is 0, the chips are only sampled on demand and on PMIC interrupts.
+ */
+int system_power_management_set_telemetry_period(system_tick_t period, void* reserved);
+
 #ifdef __cplusplus
 }
 
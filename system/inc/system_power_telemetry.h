@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_power.h"
+#include "system_error.h"
+
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+namespace particle { namespace power {
+
+/**
+ * Telemetry cache counters.
+ */
+struct PowerTelemetryStats {
+    uint32_t samples; // Number of times the chips were sampled
+    uint32_t hits; // Requests served from the cache
+    uint32_t errors; // Failed samples
+};
+
+namespace detail {
+
+/**
+ * Cache of the fuel gauge (MAX17043) and PMIC (BQ24195) readings.
+ *
+ * The backend provides the following methods:
+ *
+ * - `int readFuelGauge(uint8_t reg, uint16_t* value)`: reads a 16-bit register of the fuel gauge
+ * - `int readPmic(uint8_t reg, uint8_t* value)`: reads a register of the PMIC
+ * - `system_tick_t millis()`
+ * - `void lock()` and `void unlock()`: protect the cache. The cache is never locked while the bus
+ *   is being accessed, so that the cache can be updated by a thread holding the bus lock
+ */
+template<typename BackendT>
+class PowerTelemetryCache {
+public:
+    static const uint8_t FUEL_GAUGE_VCELL_REGISTER = 0x02;
+    static const uint8_t FUEL_GAUGE_SOC_REGISTER = 0x04;
+    static const uint8_t PMIC_CHARGE_VOLTAGE_REGISTER = 0x04;
+    static const uint8_t PMIC_SYSTEM_STATUS_REGISTER = 0x08;
+
+    template<typename... ArgsT>
+    explicit PowerTelemetryCache(ArgsT&&... args) :
+            backend_(std::forward<ArgsT>(args)...),
+            data_(),
+            stats_(),
+            period_(0),
+            valid_(false) {
+        data_.size = sizeof(data_);
+    }
+
+    /**
+     * Returns the cached readings, sampling the chips if the readings are older than `maxAge`
+     * milliseconds.
+     */
+    int get(system_power_telemetry* telemetry, system_tick_t maxAge) {
+        if (!telemetry) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        backend_.lock();
+        const bool fresh = isFresh(maxAge);
+        if (fresh) {
+            ++stats_.hits;
+            copyTo(telemetry);
+        }
+        backend_.unlock();
+        if (fresh) {
+            return 0;
+        }
+        return sample(telemetry);
+    }
+
+    /**
+     * Samples the chips and updates the cache.
+     *
+     * The PMIC fault register is not read here: reading it clears the latched faults, which are
+     * handled by the power manager.
+     */
+    int sample(system_power_telemetry* telemetry = nullptr) {
+        uint16_t vcell = 0;
+        uint16_t soc = 0;
+        uint8_t status = 0;
+        uint8_t chargeVoltage = 0;
+        int r = backend_.readFuelGauge(FUEL_GAUGE_VCELL_REGISTER, &vcell);
+        if (r == 0) {
+            r = backend_.readFuelGauge(FUEL_GAUGE_SOC_REGISTER, &soc);
+        }
+        if (r == 0) {
+            r = backend_.readPmic(PMIC_SYSTEM_STATUS_REGISTER, &status);
+        }
+        if (r == 0) {
+            r = backend_.readPmic(PMIC_CHARGE_VOLTAGE_REGISTER, &chargeVoltage);
+        }
+        const system_tick_t now = backend_.millis();
+        backend_.lock();
+        if (r < 0) {
+            ++stats_.errors;
+        } else {
+            ++stats_.samples;
+            data_.timestamp = now;
+            data_.vcell = vcell;
+            data_.soc = soc;
+            data_.pmic_status = status;
+            data_.charge_voltage = chargeVoltageValue(chargeVoltage);
+            valid_ = true;
+            if (telemetry) {
+                copyTo(telemetry);
+            }
+        }
+        backend_.unlock();
+        return r;
+    }
+
+    /**
+     * Samples the chips if the sampling period has elapsed.
+     *
+     * @return `true` if the chips were sampled.
+     */
+    bool poll() {
+        backend_.lock();
+        const bool due = period_ && !isFresh(period_ - 1);
+        backend_.unlock();
+        if (!due) {
+            return false;
+        }
+        sample();
+        return true;
+    }
+
+    /**
+     * Stores the PMIC registers read by the power manager.
+     */
+    void updatePmic(uint8_t status, uint8_t fault) {
+        backend_.lock();
+        data_.pmic_status = status;
+        data_.pmic_fault = fault;
+        backend_.unlock();
+    }
+
+    /**
+     * Discards the cached readings, e.g. after waking up from sleep.
+     */
+    void invalidate() {
+        backend_.lock();
+        valid_ = false;
+        backend_.unlock();
+    }
+
+    void period(system_tick_t period) {
+        backend_.lock();
+        period_ = period;
+        backend_.unlock();
+    }
+
+    system_tick_t period() const {
+        return period_;
+    }
+
+    PowerTelemetryStats stats() const {
+        backend_.lock();
+        const PowerTelemetryStats st = stats_;
+        backend_.unlock();
+        return st;
+    }
+
+    void resetStats() {
+        backend_.lock();
+        stats_ = PowerTelemetryStats();
+        backend_.unlock();
+    }
+
+    BackendT& backend() {
+        return backend_;
+    }
+
+    // Converts the charge voltage register of the PMIC to millivolts
+    static uint16_t chargeVoltageValue(uint8_t reg) {
+        return 3504 + (reg >> 2) * 16;
+    }
+
+private:
+    mutable BackendT backend_;
+    system_power_telemetry data_;
+    PowerTelemetryStats stats_;
+    system_tick_t period_;
+    bool valid_;
+
+    bool isFresh(system_tick_t maxAge) const {
+        return valid_ && (system_tick_t)(backend_.millis() - data_.timestamp) <= maxAge;
+    }
+
+    void copyTo(system_power_telemetry* telemetry) const {
+        // Newer versions of the structure may be larger than the caller's one
+        const size_t size = std::min<size_t>(telemetry->size ? telemetry->size : sizeof(data_), sizeof(data_));
+        memcpy(telemetry, &data_, size);
+        telemetry->size = size;
+    }
+};
+
+} // particle::power::detail
+
+} } // particle::power
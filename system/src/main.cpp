@@ -40,6 +40,7 @@
 #include "system_user.h"
 #include "system_update.h"
 #include "system_commands.h"
+#include "system_boot.h"
 #include "core_hal.h"
 #include "delay_hal.h"
 #include "syshealth_hal.h"
@@ -698,30 +699,39 @@ RunTimeInfoDiagnosticData g_usedRamDiagData(DIAG_ID_SYSTEM_USED_RAM, DIAG_NAME_S
     }
 );
 
-} // namespace
+SimpleIntegerDiagnosticData g_bootTimeDiagData(DIAG_ID_SYSTEM_BOOT_TIME, DIAG_NAME_SYSTEM_BOOT_TIME);
 
-/*******************************************************************************
- * Function Name  : main.
- * Description    : main routine.
- * Input          : None.
- * Output         : None.
- * Return         : None.
- *******************************************************************************/
-void app_setup_and_loop(void)
-{
-    system_part2_post_init();
-    HAL_Core_Init();
-    main_thread_current(NULL);
-    // We have running firmware, otherwise we wouldn't have gotten here
-    DECLARE_SYS_HEALTH(ENTERED_Main);
+bool isSystemThreaded() {
+    return system_thread_get_state(NULL) != spark::feature::DISABLED && (system_mode() != SAFE_MODE);
+}
 
-    LED_SIGNAL_START(NETWORK_OFF, BACKGROUND);
+// Boot stages, in the order in which they run on the devices
+enum BootStageIndex {
+    BOOT_FACTORY_RESET,
+    BOOT_POWER,
+    BOOT_DIAGNOSTICS,
+    BOOT_FILESYSTEM,
+    BOOT_RADIO_ANTENNA,
+    BOOT_BLE,
+    BOOT_NETIF,
+    BOOT_OPENTHREAD,
+    BOOT_SYSTEM_CONTROL,
+    BOOT_SAFE_MODE,
+    BOOT_USB,
+    BOOT_PENDING_UPDATE,
+    BOOT_NETWORK
+};
 
+void bootFactoryReset() {
     // Reset all persistent settings to factory defaults if necessary
     resetSettingsToFactoryDefaultsIfNeeded();
+}
 
+void bootPower() {
     system_power_management_init();
+}
 
+void bootDiagnostics() {
     // Start the diagnostics service
     diag_command(DIAG_SERVICE_CMD_START, nullptr, nullptr);
 
@@ -729,10 +739,6 @@ void app_setup_and_loop(void)
     String s = spark_deviceID();
     INFO("Device %s started", s.c_str());
 
-#if HAL_PLATFORM_FILESYSTEM
-    filesystem_dump_info(filesystem_get_instance(nullptr));
-#endif /* HAL_PLATFORM_FILESYSTEM */
-
     if (LOG_ENABLED(TRACE)) {
         int reason = RESET_REASON_NONE;
         uint32_t data = 0;
@@ -740,30 +746,50 @@ void app_setup_and_loop(void)
             LOG(TRACE, "Last reset reason: %d (data: 0x%02x)", reason, (unsigned)data); // TODO: Use LOG_ATTR()
         }
     }
+}
+
+void bootFilesystem() {
+#if HAL_PLATFORM_FILESYSTEM
+    filesystem_dump_info(filesystem_get_instance(nullptr));
+#endif /* HAL_PLATFORM_FILESYSTEM */
+}
 
+void bootRadioAntenna() {
 #if HAL_PLATFORM_RADIO_STACK
     initRadioAntenna();
 #endif
+}
 
+void bootBle() {
 #if HAL_PLATFORM_BLE
     // FIXME: Move BLE and Thread initialization to an appropriate place
     SPARK_ASSERT(hal_ble_stack_init(nullptr) == SYSTEM_ERROR_NONE);
 #endif // HAL_PLATFORM_BLE
+}
 
+void bootNetif() {
 #if HAL_PLATFORM_LWIP
     if_init();
 #endif /* HAL_PLATFORM_LWIP */
+}
 
+void bootOpenThread() {
 #if HAL_PLATFORM_OPENTHREAD
     system::threadInit();
 #endif /* HAL_PLATFORM_OPENTHREAD */
+}
 
+void bootSystemControl() {
 #if SYSTEM_CONTROL_ENABLED
     system::SystemControl::instance()->init();
 #endif // SYSTEM_CONTROL_ENABLED
+}
 
+void bootSafeMode() {
     manage_safe_mode();
+}
 
+void bootUsb() {
 #if defined(USB_CDC_ENABLE) || defined(USB_HID_ENABLE)
     HAL_USB_Init();
 #endif
@@ -771,10 +797,9 @@ void app_setup_and_loop(void)
 #if defined (START_DFU_FLASHER_SERIAL_SPEED) || defined (START_YMODEM_FLASHER_SERIAL_SPEED)
     USB_USART_LineCoding_BitRate_Handler(system_lineCodingBitRateHandler);
 #endif
+}
 
-    bool threaded = system_thread_get_state(NULL) != spark::feature::DISABLED &&
-      (system_mode()!=SAFE_MODE);
-
+void bootPendingUpdate() {
     // Checks for bootloader update applied from DFU to OTA region + special OTA flag of 0xA5
     // In that case, HAL_UPDATE_APPLIED is returned and a reset is required to ensure we don't
     // remain in Safe Mode due to bootloader dependency checks.  HAL_UPDATE_APPLIED_PENDING_RESTART won't
@@ -785,8 +810,64 @@ void app_setup_and_loop(void)
         HAL_Delay_Milliseconds(100);
         HAL_Core_System_Reset_Ex(RESET_REASON_UPDATE, 0, nullptr);
     }
+}
+
+void bootNetwork() {
+    Network_Setup(isSystemThreaded());    // todo - why does this come before system thread initialization?
+}
+
+using particle::system::BootStage;
+using particle::system::bootDep;
+
+// Everything depends on the settings being reset first
+const uint32_t BOOT_SETTINGS = bootDep(BOOT_FACTORY_RESET);
+
+// Stages that touch the radio stack, the system mode or the network manager stay on the main
+// thread. Some of the dependencies are not obvious: USB has to be initialized after the safe mode
+// check, and a pending update may reset the device, so it runs once all other initialization is
+// done. The table order is the order in which the stages run when there are no workers
+const BootStage g_bootStages[] = {
+    { "factory_reset", bootFactoryReset, 0, BootStage::MAIN_THREAD },
+    { "power", bootPower, BOOT_SETTINGS, 0 },
+    { "diagnostics", bootDiagnostics, BOOT_SETTINGS, BootStage::MAIN_THREAD },
+    { "filesystem", bootFilesystem, BOOT_SETTINGS, 0 },
+    { "radio_antenna", bootRadioAntenna, BOOT_SETTINGS, BootStage::MAIN_THREAD },
+    { "ble", bootBle, BOOT_SETTINGS | bootDep(BOOT_RADIO_ANTENNA), BootStage::MAIN_THREAD },
+    { "netif", bootNetif, BOOT_SETTINGS, 0 },
+    { "openthread", bootOpenThread, bootDep(BOOT_RADIO_ANTENNA) | bootDep(BOOT_NETIF), BootStage::MAIN_THREAD },
+    { "system_control", bootSystemControl, bootDep(BOOT_BLE), BootStage::MAIN_THREAD },
+    { "safe_mode", bootSafeMode, bootDep(BOOT_DIAGNOSTICS) | bootDep(BOOT_SYSTEM_CONTROL), BootStage::MAIN_THREAD },
+    { "usb", bootUsb, bootDep(BOOT_SAFE_MODE), 0 },
+    { "pending_update", bootPendingUpdate, bootDep(BOOT_POWER) | bootDep(BOOT_FILESYSTEM) |
+            bootDep(BOOT_OPENTHREAD) | bootDep(BOOT_USB), BootStage::MAIN_THREAD },
+    { "network", bootNetwork, bootDep(BOOT_PENDING_UPDATE), BootStage::MAIN_THREAD }
+};
+
+} // namespace
+
+/*******************************************************************************
+ * Function Name  : main.
+ * Description    : main routine.
+ * Input          : None.
+ * Output         : None.
+ * Return         : None.
+ *******************************************************************************/
+void app_setup_and_loop(void)
+{
+    system_part2_post_init();
+    HAL_Core_Init();
+    main_thread_current(NULL);
+    // We have running firmware, otherwise we wouldn't have gotten here
+    DECLARE_SYS_HEALTH(ENTERED_Main);
+
+    LED_SIGNAL_START(NETWORK_OFF, BACKGROUND);
+
+    system::BootSequence boot(g_bootStages, sizeof(g_bootStages) / sizeof(g_bootStages[0]));
+    SPARK_ASSERT(boot.run() == 0);
+    g_bootTimeDiagData = boot.endTime() / 1000;
+    boot.logTimings();
 
-    Network_Setup(threaded);    // todo - why does this come before system thread initialization?
+    const bool threaded = isSystemThreaded();
 
 #if PLATFORM_THREADING
     if (threaded)
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "logging.h"
+LOG_SOURCE_CATEGORY("sys.boot");
+
+#include "system_boot.h"
+
+#include "timer_hal.h"
+#include "concurrent_hal.h"
+#include "system_error.h"
+
+namespace particle {
+
+namespace system {
+
+namespace {
+
+uint32_t stageMask(size_t count) {
+    return (count < 32) ? (((uint32_t)1 << count) - 1) : 0xffffffff;
+}
+
+#if PLATFORM_THREADING
+
+const unsigned MAX_WORKERS = 4;
+
+struct Worker {
+    BootSequence* seq;
+    size_t stage;
+    os_queue_t queue;
+    os_thread_t thread;
+};
+
+#endif // PLATFORM_THREADING
+
+} // unnamed
+
+BootSequence::BootSequence(const BootStage* stages, size_t count) :
+        stages_(stages),
+        count_(count),
+        timings_(),
+        endTime_(0) {
+}
+
+int BootSequence::run(unsigned maxWorkers) {
+    if (count_ > MAX_STAGES) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    int ret = 0;
+#if PLATFORM_THREADING
+    if (maxWorkers > 0) {
+        ret = runConcurrent(maxWorkers);
+    } else
+#endif
+    {
+        ret = runSequential();
+    }
+    endTime_ = HAL_Timer_Get_Micro_Seconds();
+    return ret;
+}
+
+void BootSequence::logTimings() const {
+    for (size_t i = 0; i < count_; ++i) {
+        LOG(INFO, "Boot stage %s: %u us (%u-%u us)", stages_[i].name,
+                (unsigned)(timings_[i].end - timings_[i].start), (unsigned)timings_[i].start,
+                (unsigned)timings_[i].end);
+    }
+    LOG(INFO, "Boot completed at %u us", (unsigned)endTime_);
+}
+
+void BootSequence::runStage(size_t stage) {
+    auto& t = timings_[stage];
+    t.start = HAL_Timer_Get_Micro_Seconds();
+    if (stages_[stage].func) {
+        stages_[stage].func();
+    }
+    t.end = HAL_Timer_Get_Micro_Seconds();
+}
+
+int BootSequence::runSequential() {
+    const uint32_t all = stageMask(count_);
+    uint32_t done = 0;
+    while (done != all) {
+        bool progress = false;
+        // Stages run in the order of the table as long as their dependencies allow
+        for (size_t i = 0; i < count_; ++i) {
+            const uint32_t deps = stages_[i].deps;
+            if (!(done & bootDep(i)) && (deps & done) == deps) {
+                runStage(i);
+                done |= bootDep(i);
+                progress = true;
+            }
+        }
+        if (!progress) {
+            LOG(ERROR, "Boot stages have unsatisfiable dependencies");
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+    }
+    return 0;
+}
+
+#if PLATFORM_THREADING
+
+int BootSequence::runConcurrent(unsigned maxWorkers) {
+    if (maxWorkers > MAX_WORKERS) {
+        maxWorkers = MAX_WORKERS;
+    }
+    os_queue_t queue = nullptr;
+    if (os_queue_create(&queue, sizeof(Worker*), MAX_WORKERS, nullptr) != 0) {
+        return runSequential();
+    }
+    Worker workers[MAX_WORKERS] = {};
+    const uint32_t all = stageMask(count_);
+    uint32_t started = 0;
+    uint32_t done = 0;
+    unsigned running = 0;
+    int ret = 0;
+    const auto finish = [&](Worker* w) {
+        os_thread_join(w->thread);
+        os_thread_cleanup(w->thread);
+        w->thread = OS_THREAD_INVALID_HANDLE;
+        done |= bootDep(w->stage);
+        --running;
+    };
+    while (done != all) {
+        // Collect completed workers
+        Worker* w = nullptr;
+        while (running > 0 && os_queue_take(queue, &w, 0, nullptr) == 0) {
+            finish(w);
+        }
+        if (done == all) {
+            break;
+        }
+        // Offload ready stages to the workers, and run the first ready stage that can't be
+        // offloaded on this thread
+        int inlineStage = -1;
+        for (size_t i = 0; i < count_; ++i) {
+            const uint32_t deps = stages_[i].deps;
+            if ((started & bootDep(i)) || (deps & done) != deps) {
+                continue;
+            }
+            if (!(stages_[i].flags & BootStage::MAIN_THREAD) && running < maxWorkers) {
+                Worker* free = nullptr;
+                for (auto& w: workers) {
+                    if (w.thread == OS_THREAD_INVALID_HANDLE) {
+                        free = &w;
+                        break;
+                    }
+                }
+                free->seq = this;
+                free->stage = i;
+                free->queue = queue;
+                if (os_thread_create(&free->thread, "boot", OS_THREAD_PRIORITY_DEFAULT, workerThread, free,
+                        SYSTEM_BOOT_WORKER_STACK_SIZE) == 0) {
+                    started |= bootDep(i);
+                    ++running;
+                    continue;
+                }
+                free->thread = OS_THREAD_INVALID_HANDLE;
+            }
+            if (inlineStage < 0) {
+                inlineStage = i;
+            }
+        }
+        if (inlineStage >= 0) {
+            started |= bootDep(inlineStage);
+            runStage(inlineStage);
+            done |= bootDep(inlineStage);
+            continue;
+        }
+        if (running == 0) {
+            LOG(ERROR, "Boot stages have unsatisfiable dependencies");
+            ret = SYSTEM_ERROR_INVALID_STATE;
+            break;
+        }
+        // Wait for a worker to complete
+        if (os_queue_take(queue, &w, CONCURRENT_WAIT_FOREVER, nullptr) == 0) {
+            finish(w);
+        }
+    }
+    os_queue_destroy(queue, nullptr);
+    return ret;
+}
+
+void BootSequence::workerThread(void* data) {
+    const auto w = static_cast<Worker*>(data);
+    w->seq->runStage(w->stage);
+    os_queue_put(w->queue, &w, CONCURRENT_WAIT_FOREVER, nullptr);
+    os_thread_exit(nullptr);
+}
+
+#endif // PLATFORM_THREADING
+
+} // particle::system
+
+} // particle
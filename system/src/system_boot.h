@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Independent stages run concurrently only on the virtual platform for now, where the HAL
+// initialization routines are host code. On the devices, the stages run one by one in the order
+// of the table
+#ifndef SYSTEM_BOOT_MAX_WORKERS
+#if PLATFORM_THREADING && PLATFORM_ID == 20 // mesh-virtual
+#define SYSTEM_BOOT_MAX_WORKERS 2
+#else
+#define SYSTEM_BOOT_MAX_WORKERS 0
+#endif
+#endif
+
+#ifndef SYSTEM_BOOT_WORKER_STACK_SIZE
+#define SYSTEM_BOOT_WORKER_STACK_SIZE (3 * 1024)
+#endif
+
+namespace particle {
+
+namespace system {
+
+/**
+ * Returns the dependency mask for a stage index.
+ */
+constexpr uint32_t bootDep(unsigned stage) {
+    return (uint32_t)1 << stage;
+}
+
+/**
+ * Boot stage.
+ */
+struct BootStage {
+    enum Flag {
+        MAIN_THREAD = 0x01 // The stage has to run on the thread that runs the sequence
+    };
+
+    const char* name;
+    void (*func)();
+    uint32_t deps; // Indices of the stages that need to complete first, see `bootDep()`
+    unsigned flags;
+};
+
+/**
+ * Timestamps of a boot stage, in microseconds since the device started.
+ */
+struct BootStageTiming {
+    uint32_t start;
+    uint32_t end;
+};
+
+/**
+ * Runs a set of boot stages in an order that satisfies their dependencies.
+ *
+ * Stages that are not bound to the main thread are offloaded to worker threads once their
+ * dependencies complete, so that independent stages waiting on peripherals overlap. Without
+ * threading, or with no workers, the stages run one by one in dependency order.
+ */
+class BootSequence {
+public:
+    static const size_t MAX_STAGES = 32;
+
+    BootSequence(const BootStage* stages, size_t count);
+
+    /**
+     * Runs all stages and returns when they have completed.
+     *
+     * @param maxWorkers Maximum number of stages running concurrently on worker threads.
+     * @return 0 on success, or an error code if the stages have unsatisfiable dependencies.
+     */
+    int run(unsigned maxWorkers = SYSTEM_BOOT_MAX_WORKERS);
+
+    const BootStageTiming& timing(size_t stage) const {
+        return timings_[stage];
+    }
+
+    /**
+     * Returns the time when the last stage completed, in microseconds since the device started.
+     */
+    uint32_t endTime() const {
+        return endTime_;
+    }
+
+    /**
+     * Logs the timestamps of all stages.
+     */
+    void logTimings() const;
+
+private:
+    const BootStage* stages_;
+    size_t count_;
+    BootStageTiming timings_[MAX_STAGES];
+    uint32_t endTime_;
+
+    void runStage(size_t stage);
+    int runSequential();
+#if PLATFORM_THREADING
+    int runConcurrent(unsigned maxWorkers);
+
+    static void workerThread(void* data);
+#endif
+};
+
+} // particle::system
+
+} // particle
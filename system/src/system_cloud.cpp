@@ -144,6 +144,12 @@ system_tick_t spark_sync_time_last(time_t* tm, void* reserved)
     return spark_protocol_time_last_synced(sp, tm, nullptr);
 }
 
+int spark_sync_time_quality(time_sync_quality* quality, void* reserved)
+{
+    SYSTEM_THREAD_CONTEXT_SYNC(spark_sync_time_quality(quality, reserved));
+    return spark_protocol_time_sync_quality(sp, quality, nullptr);
+}
+
 /**
  * Convert from the API flags to the communications lib flags
  * The event visibility flag (public/private) is encoded differently. The other flags map directly.
@@ -521,6 +521,10 @@ uint32_t compute_cloud_state_checksum(SparkAppStateSelector::Enum stateSelector,
 
 void system_set_time(time_t time, unsigned param, void*)
 {
+    // The RTC has a resolution of one second, round to the nearest second
+    if (param >= 500) {
+        ++time;
+    }
     HAL_RTC_Set_UnixTime(time);
     system_notify_event(time_changed, time_changed_sync);
 }
@@ -11,6 +11,13 @@
 
 namespace particle { namespace power {
 
+namespace {
+
+// Vitals are published at most every few seconds, so a slightly older reading is acceptable
+const system_tick_t BATTERY_CHARGE_MAX_AGE = 5000;
+
+} // unnamed
+
 BatteryChargeDiagnosticData::BatteryChargeDiagnosticData(uint16_t id, const char* name) :
     AbstractIntegerDiagnosticData(id, name) {
 }
@@ -20,10 +27,18 @@ int BatteryChargeDiagnosticData::get(IntType& val) {
     if (g_batteryState == BATTERY_STATE_DISCONNECTED || g_batteryState == BATTERY_STATE_UNKNOWN) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
-    FuelGauge fuel(true);
-    // Call begin here just in case to initialize I2C if needed
-    fuel.begin();
-    float soc = fuel.getNormalizedSoC();
+    float soc = 0.0f;
+    system_power_telemetry telemetry = {};
+    telemetry.size = sizeof(telemetry);
+    if (PowerManager::instance()->getTelemetry(&telemetry, BATTERY_CHARGE_MAX_AGE) == 0) {
+        soc = ::detail::_getNormalizedSoC(::detail::_getSoC(telemetry.soc >> 8, telemetry.soc & 0xff),
+                telemetry.charge_voltage);
+    } else {
+        FuelGauge fuel(true);
+        // Call begin here just in case to initialize I2C if needed
+        fuel.begin();
+        soc = fuel.getNormalizedSoC();
+    }
     val = particle::FixedPointUQ<8, 8>(soc);
     return SYSTEM_ERROR_NONE;
 }
@@ -50,6 +65,14 @@ int system_power_management_set_config(const hal_power_config* conf, void* reser
     return PowerManager::instance()->setConfig(conf);
 }
 
+int system_power_management_get_telemetry(system_power_telemetry* telemetry, system_tick_t max_age, void* reserved) {
+    return PowerManager::instance()->getTelemetry(telemetry, max_age);
+}
+
+int system_power_management_set_telemetry_period(system_tick_t period, void* reserved) {
+    return PowerManager::instance()->setTelemetryPeriod(period);
+}
+
 #else /* !HAL_PLATFORM_POWER_MANAGEMENT */
 
 void system_power_management_init() {
@@ -62,4 +85,12 @@ int system_power_management_set_config(const hal_power_config* conf, void* reser
     return SYSTEM_ERROR_NOT_SUPPORTED;
 }
 
+int system_power_management_get_telemetry(system_power_telemetry* telemetry, system_tick_t max_age, void* reserved) {
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
+int system_power_management_set_telemetry_period(system_tick_t period, void* reserved) {
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
 #endif /* HAL_PLATFORM_POWER_MANAGEMENT */
@@ -26,6 +26,8 @@ LOG_SOURCE_CATEGORY("sys.power");
 #include "debug.h"
 #include "spark_wiring_platform.h"
 #include "pinmap_hal.h"
+#include "i2c_hal.h"
+#include "timer_hal.h"
 
 #if (HAL_PLATFORM_PMIC_BQ24195 && HAL_PLATFORM_FUELGAUGE_MAX17043)
 
@@ -41,6 +43,7 @@ constexpr system_tick_t DEFAULT_FAULT_SUPPRESSION_PERIOD = 60000;
 
 constexpr system_tick_t DEFAULT_QUEUE_WAIT = 1000;
 constexpr system_tick_t DEFAULT_WATCHDOG_TIMEOUT = 60000;
+constexpr system_tick_t DEFAULT_TELEMETRY_PERIOD = 10000;
 
 constexpr hal_power_config defaultPowerConfig = {
   .flags = 0,
@@ -79,6 +82,22 @@ uint16_t mapInputCurrentLimit(uint16_t value) {
   return prev;
 }
 
+int readI2cRegister(HAL_I2C_Interface i2c, uint8_t address, uint8_t reg, uint8_t* data, size_t size) {
+  HAL_I2C_Acquire(i2c, nullptr);
+  int ret = SYSTEM_ERROR_IO;
+  HAL_I2C_Begin_Transmission(i2c, address, nullptr);
+  HAL_I2C_Write_Data(i2c, reg, nullptr);
+  if (HAL_I2C_End_Transmission(i2c, true, nullptr) == 0 &&
+      HAL_I2C_Request_Data(i2c, address, size, true, nullptr) == size) {
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = HAL_I2C_Read_Data(i2c, nullptr);
+    }
+    ret = 0;
+  }
+  HAL_I2C_Release(i2c, nullptr);
+  return ret;
+}
+
 template <typename T>
 bool isValid(T v) {
   T zero, ff;
@@ -95,9 +114,38 @@ bool isValid(T v) {
 
 volatile bool PowerManager::update_ = true;
 
+PowerTelemetryBackend::PowerTelemetryBackend() {
+  os_mutex_create(&mutex_);
+  SPARK_ASSERT(mutex_ != nullptr);
+}
+
+int PowerTelemetryBackend::readFuelGauge(uint8_t reg, uint16_t* value) {
+  uint8_t data[2] = {};
+  CHECK(readI2cRegister(HAL_PLATFORM_FUELGAUGE_MAX17043_I2C, MAX17043_ADDRESS, reg, data, sizeof(data)));
+  *value = ((uint16_t)data[0] << 8) | data[1];
+  return 0;
+}
+
+int PowerTelemetryBackend::readPmic(uint8_t reg, uint8_t* value) {
+  return readI2cRegister(HAL_PLATFORM_PMIC_BQ24195_I2C, PMIC_ADDRESS, reg, value, 1);
+}
+
+system_tick_t PowerTelemetryBackend::millis() {
+  return hal_timer_millis(nullptr);
+}
+
+void PowerTelemetryBackend::lock() {
+  os_mutex_lock(mutex_);
+}
+
+void PowerTelemetryBackend::unlock() {
+  os_mutex_unlock(mutex_);
+}
+
 PowerManager::PowerManager() {
   os_queue_create(&queue_, sizeof(Event), 1, nullptr);
   SPARK_ASSERT(queue_ != nullptr);
+  telemetry_.period(DEFAULT_TELEMETRY_PERIOD);
 }
 
 PowerManager* PowerManager::instance() {
@@ -143,6 +191,7 @@ void PowerManager::sleep(bool s) {
       initDefault();
       update();
       gauge.wakeup();
+      telemetry_.invalidate();
     }
   }
 }
@@ -165,6 +214,7 @@ void PowerManager::handleUpdate() {
   const uint8_t curFault = power.getFault();
   const uint8_t status = power.getSystemStatus();
   const uint8_t misc = power.readOpControlRegister();
+  telemetry_.updatePmic(status, curFault);
 
   // Watchdog fault
   if ((curFault) & 0x80) {
@@ -314,6 +364,7 @@ void PowerManager::loop(void* arg) {
 #if HAL_PLATFORM_POWER_WORKAROUND_USB_HOST_VIN_SOURCE
     HAL_USB_Set_State_Change_Callback(usbStateChangeHandler, (void*)self, nullptr);
 #endif
+    self->telemetryEnabled_ = true;
   }
 
   Event ev;
@@ -332,6 +383,8 @@ void PowerManager::loop(void* arg) {
     }
     self->handlePossibleFaultLoop();
     self->checkWatchdog();
+    // The sampling period is rounded up to the queue wait timeout
+    self->telemetry_.poll();
   }
 
 exit:
@@ -400,6 +453,7 @@ void PowerManager::handleStateChange(battery_state_t from, battery_state_t to, b
       // When going from DISCONNECTED state to any other state quick start fuel gauge
       FuelGauge fuel;
       fuel.quickStart();
+      telemetry_.invalidate();
 
       initDefault();
     }
@@ -559,6 +613,7 @@ bool PowerManager::detect() {
 
 void PowerManager::deinit() {
   LOG(WARN, "Disabling system power manager");
+  telemetryEnabled_ = false;
 #if HAL_PLATFORM_POWER_MANAGEMENT_OPTIONAL
   if (detect_) {
 #else
@@ -588,6 +643,18 @@ int PowerManager::setConfig(const hal_power_config* conf) {
   return ret;
 }
 
+int PowerManager::getTelemetry(system_power_telemetry* telemetry, system_tick_t maxAge) {
+  if (!telemetryEnabled_) {
+    return SYSTEM_ERROR_INVALID_STATE;
+  }
+  return telemetry_.get(telemetry, maxAge);
+}
+
+int PowerManager::setTelemetryPeriod(system_tick_t period) {
+  telemetry_.period(period);
+  return 0;
+}
+
 void PowerManager::loadConfig() {
   // Ignore errors since we are anyway sanitizing the config and setting some sane defaults
   config_.size = sizeof(config_);
@@ -22,9 +22,24 @@
 #include "hal_platform.h"
 #include "usb_hal.h"
 #include "power_hal.h"
+#include "system_power_telemetry.h"
 
 namespace particle { namespace power {
 
+class PowerTelemetryBackend {
+public:
+  PowerTelemetryBackend();
+
+  int readFuelGauge(uint8_t reg, uint16_t* value);
+  int readPmic(uint8_t reg, uint8_t* value);
+  system_tick_t millis();
+  void lock();
+  void unlock();
+
+private:
+  os_mutex_t mutex_ = nullptr;
+};
+
 class PowerManager {
 public:
   static PowerManager* instance();
@@ -32,6 +47,8 @@ public:
   void init();
   void sleep(bool s = true);
   int setConfig(const hal_power_config* conf);
+  int getTelemetry(system_power_telemetry* telemetry, system_tick_t maxAge);
+  int setTelemetryPeriod(system_tick_t period);
 
 protected:
   PowerManager();
@@ -78,6 +95,8 @@ private:
 #endif // HAL_PLATFORM_POWER_MANAGEMENT_OPTIONAL
 
   hal_power_config config_ = {};
+  detail::PowerTelemetryCache<PowerTelemetryBackend> telemetry_;
+  volatile bool telemetryEnabled_ = false;
 };
 
 
@@ -274,7 +274,12 @@ void establish_cloud_connection()
         conn_prop.keepalive_source = particle::protocol::KeepAliveSource::SYSTEM;
         spark_set_connection_property(particle::protocol::Connection::PING, (provider_data.keepalive * 1000), &conn_prop, nullptr);
         spark_cloud_udp_port_set(provider_data.port);
-#endif // PLATFORM_ID==PLATFORM_ELECTRON_PRODUCTION
+#elif PLATFORM_ID == PLATFORM_BORON || PLATFORM_ID == PLATFORM_BSOM || PLATFORM_ID == PLATFORM_B5SOM
+        // Use the keepalive interval of the current carrier if it's known
+        const CellularNetProvData provider_data = cellular_network_provider_data_get(NULL);
+        system_cloud_set_inet_family_keepalive(AF_INET, (provider_data.keepalive > 0) ?
+                provider_data.keepalive * 1000 : HAL_PLATFORM_CELLULAR_CLOUD_KEEPALIVE_INTERVAL, 0);
+#endif // PLATFORM_ID == PLATFORM_BORON || PLATFORM_ID == PLATFORM_BSOM || PLATFORM_ID == PLATFORM_B5SOM
 
         INFO("Cloud: connecting");
         const auto diag = CloudDiagnostics::instance();
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cellular_signal_cache.h"
+
+#include "at_parser.h"
+#include "at_response.h"
+#include "stream.h"
+#include "timer_hal.h"
+#include "system_error.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <limits>
+#include <cstring>
+
+#undef WARN
+#undef INFO
+#include "catch2/catch.hpp"
+
+using namespace particle;
+
+namespace {
+
+system_tick_t g_millis = 0;
+
+// Stream that replies to the commands with scripted responses
+class ScriptedStream: public Stream {
+public:
+    void reply(const std::string& cmd, const std::string& resp) {
+        replies_[cmd] = resp;
+    }
+
+    void urc(const std::string& line) {
+        rx_ += line + "\r\n";
+    }
+
+    const std::vector<std::string>& commands() const {
+        return cmds_;
+    }
+
+    void clearCommands() {
+        cmds_.clear();
+    }
+
+    // Makes the reads fail with the given error after the given number of bytes is read
+    void readError(int err, size_t after) {
+        readErr_ = err;
+        readErrAfter_ = after;
+    }
+
+    int read(char* data, size_t size) override {
+        if (readErr_ < 0) {
+            if (!readErrAfter_) {
+                return readErr_;
+            }
+            size = std::min(size, readErrAfter_);
+            readErrAfter_ -= size;
+        }
+        const size_t n = std::min(size, rx_.size());
+        memcpy(data, rx_.data(), n);
+        rx_.erase(0, n);
+        return n;
+    }
+
+    int peek(char* data, size_t size) override {
+        const size_t n = std::min(size, rx_.size());
+        memcpy(data, rx_.data(), n);
+        return n;
+    }
+
+    int skip(size_t size) override {
+        const size_t n = std::min(size, rx_.size());
+        rx_.erase(0, n);
+        return n;
+    }
+
+    int availForRead() override {
+        return rx_.size();
+    }
+
+    int write(const char* data, size_t size) override {
+        tx_.append(data, size);
+        size_t pos = 0;
+        while ((pos = tx_.find("\r\n")) != std::string::npos) {
+            const auto cmd = tx_.substr(0, pos);
+            tx_.erase(0, pos + 2);
+            cmds_.push_back(cmd);
+            const auto it = replies_.find(cmd);
+            if (it != replies_.end()) {
+                rx_ += it->second;
+            } else {
+                rx_ += "\r\nERROR\r\n";
+            }
+        }
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return 1024;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        if ((flags & WRITABLE) || ((flags & READABLE) && !rx_.empty())) {
+            return flags;
+        }
+        return SYSTEM_ERROR_TIMEOUT;
+    }
+
+private:
+    std::map<std::string, std::string> replies_;
+    std::vector<std::string> cmds_;
+    std::string rx_;
+    std::string tx_;
+    int readErr_ = 0;
+    size_t readErrAfter_ = 0;
+};
+
+struct Registration {
+    std::vector<std::pair<CellularRegistrationType, bool> > updates;
+
+    static void handler(CellularRegistrationType type, bool registered, void* data) {
+        static_cast<Registration*>(data)->updates.push_back(std::make_pair(type, registered));
+    }
+};
+
+void scriptSaraU201(ScriptedStream* strm) {
+    strm->reply("AT+COPS=3,2", "\r\nOK\r\n");
+    strm->reply("AT+COPS?", "\r\n+COPS: 0,2,\"310410\",2\r\n\r\nOK\r\n");
+    strm->reply("AT+CSQ", "\r\n+CSQ: 20,3\r\n\r\nOK\r\n");
+}
+
+void scriptSaraR410(ScriptedStream* strm) {
+    strm->reply("AT+COPS=3,2", "\r\nOK\r\n");
+    strm->reply("AT+COPS?", "\r\n+COPS: 0,0,\"31026\",7\r\n\r\nOK\r\n");
+    strm->reply("AT+UCGED=5", "\r\nOK\r\n");
+    strm->reply("AT+UCGED?", "\r\n+RSRP: 123,5110,\"-097.20\",\r\n+RSRQ: 123,5110,\"-10.80\",\r\n\r\nOK\r\n");
+}
+
+} // unnamed
+
+extern "C" system_tick_t HAL_Timer_Get_Milli_Seconds() {
+    return g_millis;
+}
+
+TEST_CASE("CellularSignalCache") {
+    g_millis = 1000;
+    ScriptedStream strm;
+    AtParser parser;
+    REQUIRE(parser.init(AtParserConfig().stream(&strm).commandTerminator(AtCommandTerminator::CRLF)
+            .echoEnabled(false).logEnabled(false)) == 0);
+    Registration reg;
+    CellularSignalCache cache;
+
+    SECTION("serves the signal quality from the snapshot until it expires") {
+        scriptSaraU201(&strm);
+        REQUIRE(cache.init(&parser, PLATFORM_NCP_SARA_U201, Registration::handler, &reg) == 0);
+        CellularSignalQuality qual;
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        CHECK(strm.commands() == std::vector<std::string>({ "AT+COPS=3,2", "AT+COPS?", "AT+CSQ" }));
+        CHECK(qual.accessTechnology() == CellularAccessTechnology::UTRAN);
+        CHECK(qual.strength() == 43);
+        CHECK(qual.quality() == 31);
+        strm.clearCommands();
+        g_millis += cache.maxAge() - 1;
+        CellularSignalQuality qual2;
+        REQUIRE(cache.getSignalQuality(&qual2) == 0);
+        CHECK(strm.commands().empty());
+        CHECK(qual2.strength() == qual.strength());
+        CHECK(qual2.quality() == qual.quality());
+        g_millis += 1;
+        REQUIRE(cache.getSignalQuality(&qual2) == 0);
+        // The operator format is only selected once
+        CHECK(strm.commands() == std::vector<std::string>({ "AT+COPS?", "AT+CSQ" }));
+        const auto st = cache.stats();
+        CHECK(st.hits == 1);
+        CHECK(st.misses == 2);
+        CHECK(st.commandsSent == 5);
+        CHECK(st.commandsSaved == 4); // AT+COPS=3,2, AT+COPS? and AT+CSQ, and then AT+COPS=3,2
+    }
+
+    SECTION("selects the operator format again if the modem reports the operator in another format") {
+        scriptSaraU201(&strm);
+        REQUIRE(cache.init(&parser, PLATFORM_NCP_SARA_U201, Registration::handler, &reg) == 0);
+        CellularSignalQuality qual;
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        strm.reply("AT+COPS?", "\r\n+COPS: 0,0,\"AT&T\",2\r\n\r\nOK\r\n");
+        g_millis += cache.maxAge();
+        CHECK(cache.getSignalQuality(&qual) == SYSTEM_ERROR_AT_RESPONSE_UNEXPECTED);
+        scriptSaraU201(&strm);
+        strm.clearCommands();
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        CHECK(strm.commands() == std::vector<std::string>({ "AT+COPS=3,2", "AT+COPS?", "AT+CSQ" }));
+    }
+
+    SECTION("parses the RSRP and RSRQ reported by SARA-R410") {
+        scriptSaraR410(&strm);
+        REQUIRE(cache.init(&parser, PLATFORM_NCP_SARA_R410, Registration::handler, &reg) == 0);
+        CellularSignalQuality qual;
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        CHECK(qual.accessTechnology() == CellularAccessTechnology::LTE);
+        CHECK(qual.strength() == 43);
+        CHECK(qual.quality() == 18);
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        CHECK(cache.stats().commandsSaved == 4);
+    }
+
+    SECTION("updates the registration state and the cell from the URCs") {
+        scriptSaraR410(&strm);
+        REQUIRE(cache.init(&parser, PLATFORM_NCP_SARA_R410, Registration::handler, &reg) == 0);
+        strm.urc("+CEREG: 5,\"2B5A\",\"0A1B2C3D\",7");
+        REQUIRE(parser.processUrc() == 1);
+        REQUIRE(reg.updates.size() == 1);
+        CHECK(reg.updates[0].first == CellularRegistrationType::CEREG);
+        CHECK(reg.updates[0].second);
+        CellularGlobalIdentity cgi = {};
+        cgi.size = sizeof(cgi);
+        cgi.version = CGI_VERSION_1;
+        REQUIRE(cache.getCellularGlobalIdentity(&cgi) == 0);
+        CHECK(cgi.mobile_country_code == 310);
+        CHECK(cgi.mobile_network_code == 26);
+        CHECK((cgi.cgi_flags & CGI_FLAG_TWO_DIGIT_MNC));
+        CHECK(cgi.location_area_code == 0x2b5a);
+        CHECK(cgi.cell_id == 0x0a1b2c3d);
+        strm.clearCommands();
+        // The direct response to a query has the mode field
+        strm.reply("AT+CEREG?", "\r\n+CEREG: 2,5,\"2B5A\",\"0A1B2C3E\",7\r\n\r\nOK\r\n");
+        REQUIRE(parser.execCommand("AT+CEREG?") == AtResponse::OK);
+        REQUIRE(reg.updates.size() == 2);
+        REQUIRE(cache.getCellularGlobalIdentity(&cgi) == 0);
+        CHECK(cgi.cell_id == 0x0a1b2c3e);
+        // The operator is queried again after a handover
+        CHECK(strm.commands() == std::vector<std::string>({ "AT+CEREG?", "AT+COPS?" }));
+        strm.clearCommands();
+        strm.urc("+CEREG: 5,\"2B5A\",\"0A1B2C3E\",7");
+        REQUIRE(parser.processUrc() == 1);
+        REQUIRE(cache.getCellularGlobalIdentity(&cgi) == 0);
+        CHECK(strm.commands().empty());
+        CHECK(cache.stats().registrationUpdates == 3);
+        strm.urc("+CEREG: 2");
+        REQUIRE(parser.processUrc() == 1);
+        CHECK_FALSE(reg.updates.back().second);
+        REQUIRE(cache.getCellularGlobalIdentity(&cgi) == 0);
+        CHECK(cgi.location_area_code == std::numeric_limits<decltype(cgi.location_area_code)>::max());
+        CHECK(strm.commands() == std::vector<std::string>({ "AT+COPS?" }));
+    }
+
+    SECTION("refreshes the snapshot in the background while it is being read") {
+        scriptSaraU201(&strm);
+        REQUIRE(cache.init(&parser, PLATFORM_NCP_SARA_U201, Registration::handler, &reg) == 0);
+        CellularSignalQuality qual;
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        strm.clearCommands();
+        // Nobody has read the snapshot since it was updated
+        g_millis += cache.maxAge();
+        REQUIRE(cache.refresh() == 0);
+        CHECK(strm.commands().empty());
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        strm.clearCommands();
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        g_millis += cache.maxAge() / 2;
+        REQUIRE(cache.refresh() == 0);
+        CHECK(strm.commands().empty());
+        g_millis += cache.maxAge() / 4;
+        REQUIRE(cache.refresh() == 0);
+        CHECK(strm.commands() == std::vector<std::string>({ "AT+COPS?", "AT+CSQ" }));
+        strm.clearCommands();
+        g_millis += cache.maxAge() / 2;
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        CHECK(strm.commands().empty());
+        CHECK(cache.stats().refreshes == 1);
+    }
+
+    SECTION("reports errors of the modem and doesn't cache them") {
+        strm.reply("AT+COPS=3,2", "\r\nOK\r\n");
+        strm.reply("AT+COPS?", "\r\n+COPS: 0,2,\"310410\",15\r\n\r\nOK\r\n");
+        REQUIRE(cache.init(&parser, PLATFORM_NCP_SARA_U201, Registration::handler, &reg) == 0);
+        CellularSignalQuality qual;
+        CHECK(cache.getSignalQuality(&qual) == SYSTEM_ERROR_BAD_DATA);
+        CHECK(cache.parserError() == 0);
+        scriptSaraU201(&strm);
+        REQUIRE(cache.getSignalQuality(&qual) == 0);
+        CHECK(cache.stats().misses == 2);
+    }
+
+    SECTION("reports errors of the stream in the registration URC handlers") {
+        REQUIRE(cache.init(&parser, PLATFORM_NCP_SARA_R410, Registration::handler, &reg) == 0);
+        strm.urc("+CEREG: 5,\"2B5A\",\"0A1B2C3D\",7");
+        // The line fails to be read after the URC prefix is recognized
+        strm.readError(SYSTEM_ERROR_IO, strlen("+CEREG:"));
+        parser.processUrc();
+        CHECK(reg.updates.empty());
+        CHECK(cache.parserError() == SYSTEM_ERROR_IO);
+    }
+}
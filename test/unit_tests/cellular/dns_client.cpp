@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "modem/dns_client_impl.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+const MDM_IP SERVER1 = IPADR(8, 8, 8, 8);
+const MDM_IP SERVER2 = IPADR(8, 8, 4, 4);
+
+// Simulated network with a virtual clock. The modem reports incoming data as soon as a packet
+// arrives
+class FakeBackend {
+public:
+    struct Server {
+        MDM_IP addr;
+        system_tick_t rtt; // Minimum round-trip time
+        system_tick_t jitter; // Maximum additional delay
+        double dropRate;
+        int rcode;
+    };
+
+    struct Packet {
+        system_tick_t time; // Arrival time
+        MDM_IP src;
+        int port;
+        std::string data;
+    };
+
+    std::vector<Server> servers;
+    std::vector<Packet> packets;
+    std::vector<system_tick_t> sendTimes;
+    std::function<void()> onWait;
+    std::mt19937 rand;
+    system_tick_t now;
+    int lockCount;
+    int openCount;
+    int sendError;
+
+    FakeBackend() :
+            rand(1),
+            now(1000),
+            lockCount(0),
+            openCount(0),
+            sendError(0) {
+    }
+
+    void addServer(MDM_IP addr, system_tick_t rtt, system_tick_t jitter = 0, double dropRate = 0, int rcode = 0) {
+        servers.push_back({ addr, rtt, jitter, dropRate, rcode });
+    }
+
+    void inject(MDM_IP src, std::string data, system_tick_t delay = 0) {
+        packets.push_back({ now + delay, src, 53, std::move(data) });
+    }
+
+    int open() {
+        ++openCount;
+        return 0;
+    }
+
+    void close() {
+    }
+
+    int sendTo(MDM_IP addr, int port, const char* data, size_t size) {
+        if (sendError) {
+            return sendError;
+        }
+        CHECK(port == 53);
+        sendTimes.push_back(now);
+        for (const Server& s: servers) {
+            if (s.addr != addr) {
+                continue;
+            }
+            if (std::uniform_real_distribution<double>(0, 1)(rand) < s.dropRate) {
+                break;
+            }
+            const system_tick_t delay = s.rtt + std::uniform_int_distribution<system_tick_t>(0, s.jitter)(rand);
+            packets.push_back({ now + delay, addr, port, makeResponse(std::string(data, size), s.rcode,
+                    addressOf(std::string(data, size))) });
+            break;
+        }
+        return size;
+    }
+
+    int recvFrom(MDM_IP* addr, int* port, char* data, size_t size) {
+        auto it = nextPacket();
+        if (it == packets.end() || it->time > now) {
+            return 0;
+        }
+        const size_t n = std::min(size, it->data.size());
+        memcpy(data, it->data.data(), n);
+        *addr = it->src;
+        *port = it->port;
+        packets.erase(it);
+        return n;
+    }
+
+    int waitReadable(system_tick_t timeout) {
+        CHECK(lockCount == 0);
+        CHECK(timeout <= 100);
+        if (onWait) {
+            const auto f = std::move(onWait);
+            onWait = nullptr;
+            f();
+        }
+        auto it = nextPacket();
+        if (it != packets.end() && it->time <= now + timeout) {
+            now = std::max(now, it->time);
+            return 1;
+        }
+        now += timeout;
+        return 0;
+    }
+
+    system_tick_t millis() const {
+        return now;
+    }
+
+    uint32_t random() {
+        return rand();
+    }
+
+    void lock() {
+        CHECK(lockCount == 0);
+        ++lockCount;
+    }
+
+    void unlock() {
+        --lockCount;
+    }
+
+    static MDM_IP addressOf(const std::string& query) {
+        // The address is derived from the host name
+        return IPADR(10, 0, query.size() & 0xff, (uint8_t)query.at(13));
+    }
+
+    static std::string makeResponse(const std::string& query, int rcode, MDM_IP addr) {
+        std::string d = query;
+        d[2] |= 0x80; // QR
+        d[3] = rcode;
+        d[7] = (rcode == 0) ? 1 : 0; // ANCOUNT
+        if (rcode == 0) {
+            const char answer[] = { '\xc0', '\x0c', 0, 1, 0, 1, 0, 0, 0x0e, 0x10, 0, 4,
+                    (char)(addr >> 24), (char)(addr >> 16), (char)(addr >> 8), (char)addr };
+            d.append(answer, sizeof(answer));
+        }
+        return d;
+    }
+
+private:
+    std::vector<Packet>::iterator nextPacket() {
+        return std::min_element(packets.begin(), packets.end(), [](const Packet& a, const Packet& b) {
+            return a.time < b.time;
+        });
+    }
+};
+
+typedef detail::DnsClient<FakeBackend> DnsClient;
+
+MDM_IP expectedAddress(const char* name) {
+    char buf[512];
+    const int n = detail::dnsEncodeQuery(0, name, buf, sizeof(buf));
+    REQUIRE(n > 0);
+    return FakeBackend::addressOf(std::string(buf, n));
+}
+
+// Previous implementation: a single server that is polled every 200 ms with a linear backoff
+int legacyGetHostByName(FakeBackend& b, const char* name, MDM_IP* addr) {
+    char buf[512];
+    for (unsigned retries = 0; retries <= 3; ++retries) {
+        const uint16_t id = b.random();
+        const int n = detail::dnsEncodeQuery(id, name, buf, sizeof(buf));
+        b.sendTo(SERVER1, 53, buf, n);
+        const system_tick_t start = b.now;
+        do {
+            b.now += 200;
+            MDM_IP src = NOIP;
+            int port = 0;
+            int r = 0;
+            while ((r = b.recvFrom(&src, &port, buf, sizeof(buf))) > 0) {
+                detail::DnsHeader hdr = {};
+                memcpy(&hdr, buf, sizeof(hdr));
+                if (bigEndianToNative(hdr.id) == id && detail::dnsParseResponse(name, buf, r, addr) == 0) {
+                    return 0;
+                }
+            }
+        } while (b.now - start < (retries + 1) * 1000);
+    }
+    return SYSTEM_ERROR_TIMEOUT;
+}
+
+} // namespace
+
+TEST_CASE("DnsClient") {
+    DnsClient client;
+    FakeBackend& b = client.backend();
+    const system_tick_t initialTimeout = DnsClient::INITIAL_RETRANSMIT_TIMEOUT;
+    const system_tick_t lookupTimeout = DnsClient::LOOKUP_TIMEOUT;
+
+    SECTION("resolves a host name") {
+        b.addServer(SERVER1, 150);
+        b.addServer(SERVER2, 300);
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("device.spark.io", &addr) == 0);
+        CHECK(addr == expectedAddress("device.spark.io"));
+        CHECK(b.sendTimes.size() == 2); // One query per server
+        const DnsStats stats = client.stats();
+        CHECK(stats.answers[0] == 1);
+        CHECK(stats.answers[1] == 0);
+        CHECK(stats.latency[2] == 1); // 100..200 ms
+        CHECK(stats.retransmissions == 0);
+        CHECK(b.lockCount == 0);
+    }
+
+    SECTION("returns as soon as the response arrives") {
+        b.addServer(SERVER1, 237);
+        b.addServer(SERVER2, 5000);
+        const system_tick_t start = b.now;
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("api.particle.io", &addr) == 0);
+        CHECK(b.now - start == 237);
+    }
+
+    SECTION("uses the answer of the fastest server") {
+        b.addServer(SERVER1, 900);
+        b.addServer(SERVER2, 120);
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("udp.particle.io", &addr) == 0);
+        CHECK(addr == expectedAddress("udp.particle.io"));
+        const DnsStats stats = client.stats();
+        CHECK(stats.answers[0] == 0);
+        CHECK(stats.answers[1] == 1);
+        // The late answer of the other server is ignored by the next lookup
+        b.servers[1].rtt = 2000;
+        CHECK(client.getHostByName("other.particle.io", &addr) == 0);
+        CHECK(addr == expectedAddress("other.particle.io"));
+        CHECK(client.stats().answers[0] == 1);
+    }
+
+    SECTION("falls back to the second server if the first one doesn't respond") {
+        b.addServer(SERVER1, 100, 0, 1.0);
+        b.addServer(SERVER2, 400);
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("device.spark.io", &addr) == 0);
+        CHECK(client.stats().answers[1] == 1);
+    }
+
+    SECTION("waits for the other server if one of them fails") {
+        b.addServer(SERVER1, 100, 0, 0, 2 /* SERVFAIL */);
+        b.addServer(SERVER2, 400);
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("device.spark.io", &addr) == 0);
+        CHECK(addr == expectedAddress("device.spark.io"));
+        b.servers[1].rcode = 5; // REFUSED
+        CHECK(client.getHostByName("device.spark.io", &addr) == SYSTEM_ERROR_UNKNOWN);
+        CHECK(client.stats().errors == 1);
+    }
+
+    SECTION("reports a nonexistent name without waiting for the other server") {
+        b.addServer(SERVER1, 100, 0, 0, 3 /* NXDOMAIN */);
+        b.addServer(SERVER2, 3000);
+        const system_tick_t start = b.now;
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("nonexistent.particle.io", &addr) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(addr == NOIP);
+        CHECK(b.now - start == 100);
+    }
+
+    SECTION("retransmits the query with an exponential backoff") {
+        b.addServer(SERVER1, 100, 0, 1.0);
+        b.addServer(SERVER2, 100, 0, 1.0);
+        const system_tick_t start = b.now;
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("device.spark.io", &addr) == SYSTEM_ERROR_TIMEOUT);
+        CHECK(b.now - start == lookupTimeout);
+        REQUIRE(b.sendTimes.size() == 8);
+        for (size_t i = 0; i < b.sendTimes.size(); i += 2) {
+            CHECK(b.sendTimes[i] == b.sendTimes[i + 1]);
+            CHECK(b.sendTimes[i] - start == initialTimeout * ((1 << (i / 2)) - 1));
+        }
+        const DnsStats stats = client.stats();
+        CHECK(stats.retransmissions == 3);
+        CHECK(stats.timeouts == 1);
+        // A retransmitted query is answered
+        b.servers[0].dropRate = 0;
+        b.servers[0].rtt = 3500;
+        CHECK(client.getHostByName("device.spark.io", &addr) == 0);
+        CHECK(client.stats().retransmissions == 5);
+    }
+
+    SECTION("ignores unexpected packets") {
+        b.addServer(SERVER1, 300);
+        char buf[512];
+        const int n = detail::dnsEncodeQuery(1234, "device.spark.io", buf, sizeof(buf));
+        const std::string query(buf, n);
+        // Unknown ID
+        b.inject(SERVER1, FakeBackend::makeResponse(query, 0, IPADR(1, 2, 3, 4)), 10);
+        // Unknown source. The client uses the first random number as the ID
+        std::string spoofed = FakeBackend::makeResponse(query, 0, IPADR(1, 2, 3, 4));
+        const uint16_t id = nativeToBigEndian((uint16_t)std::mt19937(1)());
+        memcpy(&spoofed[0], &id, sizeof(id));
+        b.inject(IPADR(6, 6, 6, 6), spoofed, 20);
+        // Truncated and malformed packets
+        b.inject(SERVER1, std::string(5, '\0'), 30);
+        b.inject(SERVER1, spoofed.substr(0, spoofed.size() - 3), 40);
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("device.spark.io", &addr) == 0);
+        CHECK(addr == expectedAddress("device.spark.io"));
+    }
+
+    SECTION("resolves several names at the same time") {
+        b.addServer(SERVER1, 500);
+        b.addServer(SERVER2, 700);
+        MDM_IP addr1 = NOIP, addr2 = NOIP;
+        system_tick_t nestedEnd = 0;
+        // Another lookup is started while the first one is waiting for the response
+        b.onWait = [&]() {
+            b.servers[0].rtt = 100;
+            CHECK(client.getHostByName("second.particle.io", &addr2) == 0);
+            nestedEnd = b.now;
+        };
+        const system_tick_t start = b.now;
+        CHECK(client.getHostByName("first.particle.io", &addr1) == 0);
+        CHECK(addr1 == expectedAddress("first.particle.io"));
+        CHECK(addr2 == expectedAddress("second.particle.io"));
+        CHECK(nestedEnd - start == 100);
+        // The response to the first query was received by the nested lookup, or after it
+        CHECK(b.now - start == 500);
+        CHECK(b.packets.size() == 2); // Late answers of the second server
+    }
+
+    SECTION("limits the number of lookups in flight") {
+        b.addServer(SERVER1, 200);
+        unsigned depth = 1;
+        int result = 0;
+        std::function<void()> nest;
+        nest = [&]() {
+            MDM_IP addr = NOIP;
+            if (depth < DnsClient::MAX_QUERIES) {
+                ++depth;
+                b.onWait = nest;
+                CHECK(client.getHostByName("device.spark.io", &addr) == 0);
+            } else {
+                result = client.getHostByName("device.spark.io", &addr);
+            }
+        };
+        b.onWait = nest;
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("device.spark.io", &addr) == 0);
+        CHECK(result == SYSTEM_ERROR_LIMIT_EXCEEDED);
+    }
+
+    SECTION("handles local names and addresses") {
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("localhost", &addr) == 0);
+        CHECK(addr == IPADR(127, 0, 0, 1));
+        CHECK(client.getHostByName("192.168.1.20", &addr) == 0);
+        CHECK(addr == IPADR(192, 168, 1, 20));
+        CHECK(client.getHostByName("", &addr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(client.getHostByName(std::string(256, 'a').c_str(), &addr) == SYSTEM_ERROR_TOO_LARGE);
+        CHECK(b.sendTimes.empty());
+    }
+
+    SECTION("reports a send error") {
+        b.addServer(SERVER1, 100);
+        b.sendError = -1;
+        MDM_IP addr = NOIP;
+        CHECK(client.getHostByName("device.spark.io", &addr) == -1);
+        CHECK(b.openCount == 2); // The socket is reopened once
+        CHECK(client.stats().errors == 1);
+    }
+}
+
+TEST_CASE("DNS client benchmark") {
+    // Cellular network: 80..480 ms to the servers, 5% packet loss
+    const int count = 2000;
+    const char* const names[] = { "device.spark.io", "api.particle.io", "udp.particle.io" };
+    std::vector<system_tick_t> legacy, parallel;
+    unsigned legacyTimeouts = 0, timeouts = 0;
+
+    FakeBackend lb;
+    lb.addServer(SERVER1, 80, 400, 0.05);
+    for (int i = 0; i < count; ++i) {
+        MDM_IP addr = NOIP;
+        const system_tick_t start = lb.now;
+        if (legacyGetHostByName(lb, names[i % 3], &addr) == 0) {
+            legacy.push_back(lb.now - start);
+        } else {
+            ++legacyTimeouts;
+        }
+        lb.packets.clear();
+    }
+
+    DnsClient client;
+    FakeBackend& b = client.backend();
+    b.addServer(SERVER1, 80, 400, 0.05);
+    b.addServer(SERVER2, 80, 400, 0.05);
+    for (int i = 0; i < count; ++i) {
+        MDM_IP addr = NOIP;
+        const system_tick_t start = b.now;
+        if (client.getHostByName(names[i % 3], &addr) == 0) {
+            CHECK(addr == expectedAddress(names[i % 3]));
+            parallel.push_back(b.now - start);
+        } else {
+            ++timeouts;
+        }
+        b.packets.clear();
+    }
+
+    const auto summary = [](std::vector<system_tick_t> v) {
+        std::sort(v.begin(), v.end());
+        double sum = 0;
+        for (const auto t: v) {
+            sum += t;
+        }
+        return "mean " + std::to_string((int)(sum / v.size())) + " ms, median " + std::to_string(v[v.size() / 2]) +
+                " ms, p95 " + std::to_string(v[v.size() * 95 / 100]) + " ms, max " + std::to_string(v.back()) + " ms";
+    };
+    CHECK(timeouts <= legacyTimeouts);
+    WARN("Single server, 200 ms polling: " << summary(legacy) << ", " << legacyTimeouts << " timeouts");
+    WARN("Two servers, URC wakeup: " << summary(parallel) << ", " << timeouts << " timeouts");
+    const DnsStats stats = client.stats();
+    std::string histogram;
+    system_tick_t limit = DnsStats::LATENCY_BUCKET_BASE;
+    for (unsigned i = 0; i < DnsStats::LATENCY_BUCKET_COUNT; ++i, limit *= 2) {
+        histogram += ((i < DnsStats::LATENCY_BUCKET_COUNT - 1) ? "<" + std::to_string(limit) : "rest") + ": " +
+                std::to_string(stats.latency[i]) + ", ";
+    }
+    WARN("Latency histogram: " << histogram << "retransmissions: " << stats.retransmissions);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network_config_db.h"
+#include "cellular_network_manager.h"
+
+#include "system_error.h"
+
+#include <boost/crc.hpp>
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "catch2/catch.hpp"
+
+using namespace particle;
+
+namespace {
+
+struct TestEntry {
+    unsigned mcc;
+    unsigned mnc;
+    unsigned mncDigits;
+    std::string apn;
+    uint64_t bands;
+};
+
+// Entries are expected to be sorted
+std::vector<uint8_t> makeDb(const std::vector<TestEntry>& entries) {
+    std::string strings;
+    std::vector<uint8_t> data;
+    for (const auto& e: entries) {
+        NetworkConfigDbEntry entry = {};
+        entry.plmn = networkConfigDbPlmn(e.mcc, e.mnc, e.mncDigits);
+        entry.apn = strings.size();
+        strings.append(e.apn).push_back('\0');
+        entry.user = strings.size();
+        entry.password = strings.size();
+        strings.push_back('\0');
+        entry.rat = NET_ACCESS_TECHNOLOGY_LTE_CAT_M1;
+        entry.keepAlive = 600;
+        entry.bands = e.bands;
+        const auto p = (const uint8_t*)&entry;
+        data.insert(data.end(), p, p + sizeof(entry));
+    }
+    data.insert(data.end(), strings.begin(), strings.end());
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    NetworkConfigDbHeader header = {};
+    header.magic = NETWORK_CONFIG_DB_MAGIC;
+    header.version = NETWORK_CONFIG_DB_VERSION;
+    header.entryCount = entries.size();
+    header.stringsSize = strings.size();
+    header.crc32 = crc.checksum();
+    const auto p = (const uint8_t*)&header;
+    data.insert(data.begin(), p, p + sizeof(header));
+    return data;
+}
+
+} // namespace
+
+TEST_CASE("networkConfigForImsi()") {
+    SECTION("finds the built-in settings for known carriers") {
+        auto conf = networkConfigForImsi("204040000000000", 15);
+        CHECK(conf.isValid());
+        CHECK(strcmp(conf.apn(), "vfd1.korem2m.com") == 0);
+        CHECK(strcmp(conf.user(), "kore") == 0);
+        CHECK(strcmp(conf.password(), "kore") == 0);
+        conf = networkConfigForImsi("214075555555555", 15);
+        CHECK(strcmp(conf.apn(), "spark.telefonica.com") == 0);
+        CHECK(!conf.hasUser());
+        CHECK(!conf.hasPassword());
+        conf = networkConfigForImsi("310410999999999", 15);
+        CHECK(strcmp(conf.apn(), "10569.mcs") == 0);
+        CHECK(conf.bands() == ((1 << 1) | (1 << 3) | (1 << 11)));
+        CHECK(conf.keepAlive() == 23 * 60);
+    }
+    SECTION("returns invalid settings for unknown carriers") {
+        CHECK(!networkConfigForImsi("310260000000000", 15).isValid());
+        CHECK(!networkConfigForImsi("31041", 5).isValid());
+        CHECK(!networkConfigForImsi("21", 2).isValid());
+        CHECK(!networkConfigForImsi("abc410000000000", 15).isValid());
+    }
+}
+
+TEST_CASE("findNetworkConfig()") {
+    std::vector<TestEntry> entries;
+    for (unsigned mcc = 200; mcc < 400; mcc += 7) {
+        entries.push_back({ mcc, mcc % 100, 2, "apn" + std::to_string(mcc) + "2", mcc });
+        entries.push_back({ mcc, mcc % 1000, 3, "apn" + std::to_string(mcc) + "3", mcc + 1 });
+    }
+    const auto data = makeDb(entries);
+    const MemoryNetworkConfigDbSource db(data.data(), data.size());
+    REQUIRE(validateNetworkConfigDb(db) == 0);
+
+    SECTION("finds every entry of the database") {
+        for (const auto& e: entries) {
+            char imsi[16] = {};
+            snprintf(imsi, sizeof(imsi), (e.mncDigits == 2) ? "%03u%02u12345678" : "%03u%03u1234567", e.mcc, e.mnc);
+            CellularNetworkConfig conf;
+            REQUIRE(findNetworkConfig(db, imsi, strlen(imsi), &conf) == 0);
+            CHECK(conf.apn() == e.apn);
+            CHECK(conf.bands() == e.bands);
+            CHECK(conf.accessTechnology() == NET_ACCESS_TECHNOLOGY_LTE_CAT_M1);
+            CHECK(conf.keepAlive() == 600);
+        }
+    }
+    SECTION("falls back to a 2-digit MNC") {
+        CellularNetworkConfig conf;
+        REQUIRE(findNetworkConfig(db, "20000999", 8, &conf) == 0);
+        CHECK(std::string(conf.apn()) == "apn2002");
+    }
+    SECTION("reports missing entries") {
+        CellularNetworkConfig conf;
+        CHECK(findNetworkConfig(db, "201001234567890", 15, &conf) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(findNetworkConfig(db, "999991234567890", 15, &conf) == SYSTEM_ERROR_NOT_FOUND);
+    }
+    SECTION("detects a corrupted database") {
+        auto corrupted = data;
+        corrupted[corrupted.size() - 2] ^= 0x01;
+        CHECK(validateNetworkConfigDb(MemoryNetworkConfigDbSource(corrupted.data(), corrupted.size())) == SYSTEM_ERROR_BAD_DATA);
+        CHECK(validateNetworkConfigDb(MemoryNetworkConfigDbSource(data.data(), data.size() - 1)) == SYSTEM_ERROR_BAD_DATA);
+    }
+}
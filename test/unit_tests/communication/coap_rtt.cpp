@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "coap_channel.h"
+#include "coap_rtt.h"
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+#include <random>
+
+using namespace particle::protocol;
+
+namespace {
+
+class TestChannel: public Channel {
+public:
+    std::vector<message_id_t> sent;
+
+    ProtocolError receive(Message& msg) override {
+        msg.set_length(0);
+        return NO_ERROR;
+    }
+
+    ProtocolError send(Message& msg) override {
+        sent.push_back(msg.get_id());
+        return NO_ERROR;
+    }
+
+    ProtocolError command(Command cmd, void* arg) override {
+        return NO_ERROR;
+    }
+};
+
+void sendConfirmable(CoAPMessageStore& store, message_id_t id, system_tick_t time, bool* deferred) {
+    uint8_t buf[] = { 0x40, 0, (uint8_t)(id >> 8), (uint8_t)(id & 0xff) };
+    Message m(buf, sizeof(buf), sizeof(buf));
+    m.decode_id();
+    REQUIRE(store.send(m, time, deferred) == NO_ERROR);
+}
+
+void receiveAck(CoAPMessageStore& store, Channel& channel, message_id_t id, system_tick_t time) {
+    uint8_t buf[] = { 0x60, 0, (uint8_t)(id >> 8), (uint8_t)(id & 0xff) };
+    Message m(buf, sizeof(buf), sizeof(buf));
+    REQUIRE(store.receive(m, channel, time) == NO_ERROR);
+}
+
+// Returns the average time it takes to get a message acknowledged over a lossy link
+template<typename TimeoutFn>
+double averageDeliveryTime(system_tick_t rttMillis, double loss, TimeoutFn timeout, CoAPRttEstimator* rtt = nullptr) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    const unsigned count = 1000;
+    system_tick_t now = 0;
+    uint64_t total = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        const system_tick_t start = now;
+        for (unsigned n = 0; n <= CoAPMessage::MAX_RETRANSMIT; ++n) {
+            // Either the request or the acknowledgement can be lost
+            if (dist(rng) >= loss && dist(rng) >= loss) {
+                now += rttMillis;
+                if (rtt) {
+                    rtt->update(now - start, n + 1, now);
+                }
+                break;
+            }
+            now += timeout(n, now);
+        }
+        total += now - start;
+        now += 1000;
+    }
+    return (double)total / count;
+}
+
+} // unnamed
+
+TEST_CASE("CoAPRttEstimator") {
+    CoAPRttEstimator rtt;
+
+    SECTION("uses the RFC 7252 timeouts until the first measurement") {
+        CHECK_FALSE(rtt.has_samples());
+        CHECK(rtt.rto(0) == CoAPRttEstimator::INITIAL_RTO);
+        for (unsigned i = 0; i < CoAPMessage::MAX_RETRANSMIT; ++i) {
+            for (unsigned j = 0; j < 100; ++j) {
+                const system_tick_t t = rtt.transmit_timeout(i, 0);
+                CHECK(t >= (CoAPRttEstimator::INITIAL_RTO << i));
+                CHECK(t < (CoAPRttEstimator::INITIAL_RTO << i) * 3 / 2);
+            }
+        }
+    }
+
+    SECTION("converges to the measured RTT of a fast link") {
+        for (unsigned i = 0; i < 20; ++i) {
+            CHECK(rtt.update(100, 1, i * 100));
+        }
+        CHECK(rtt.has_samples());
+        CHECK(rtt.srtt() == 100);
+        CHECK(rtt.rto(2000) < 1000);
+        CHECK(rtt.rto(2000) >= CoAPRttEstimator::MIN_RTO);
+    }
+
+    SECTION("uses a backoff factor of 3 for small RTOs") {
+        for (unsigned i = 0; i < 20; ++i) {
+            rtt.update(100, 1, 0);
+        }
+        const system_tick_t rto = rtt.rto(0);
+        REQUIRE(rto < 1000);
+        const system_tick_t t = rtt.transmit_timeout(2, 0);
+        CHECK(t >= rto * 9);
+        CHECK(t < rto * 9 * 3 / 2);
+    }
+
+    SECTION("uses a backoff factor of 1.5 for large RTOs") {
+        for (unsigned i = 0; i < 20; ++i) {
+            rtt.update(5000, 1, 0);
+        }
+        const system_tick_t rto = rtt.rto(0);
+        REQUIRE(rto > 3000);
+        const system_tick_t t = rtt.transmit_timeout(1, 0);
+        CHECK(t >= rto * 3 / 2);
+        CHECK(t < rto * 3 / 2 * 3 / 2 + 1);
+    }
+
+    SECTION("weak samples have a smaller weight than strong ones") {
+        CoAPRttEstimator strong;
+        strong.update(10000, 1, 0);
+        rtt.update(10000, 2, 0);
+        CHECK(rtt.rto(0) < strong.rto(0));
+        CHECK(rtt.rto(0) > CoAPRttEstimator::INITIAL_RTO);
+    }
+
+    SECTION("ignores samples of messages retransmitted more than twice") {
+        CHECK_FALSE(rtt.update(1000, 4, 0));
+        CHECK_FALSE(rtt.has_samples());
+    }
+
+    SECTION("limits the RTO and the backoff") {
+        rtt.update(100000, 1, 0);
+        CHECK(rtt.rto(0) == CoAPRttEstimator::MAX_RTO);
+        CHECK(rtt.transmit_timeout(3, 0) == CoAPRttEstimator::MAX_RTO);
+    }
+
+    SECTION("ages a small RTO towards 1 second") {
+        for (unsigned i = 0; i < 20; ++i) {
+            rtt.update(100, 1, 0);
+        }
+        const system_tick_t rto = rtt.rto(0);
+        CHECK(rtt.rto(rto * 16 + 1) > rto);
+    }
+
+    SECTION("ages a large RTO towards 2 seconds") {
+        for (unsigned i = 0; i < 20; ++i) {
+            rtt.update(5000, 1, 0);
+        }
+        const system_tick_t rto = rtt.rto(0);
+        CHECK(rtt.rto(rto * 4 + 1) < rto);
+    }
+}
+
+TEST_CASE("adaptive RTO recovers from losses faster than the RFC 7252 timeouts") {
+    const system_tick_t rttMillis = 200;
+    const double loss = 0.1;
+    const double fixed = averageDeliveryTime(rttMillis, loss, [](unsigned n, system_tick_t) {
+        return CoAPMessage::transmit_timeout(n);
+    });
+    CoAPRttEstimator rtt;
+    const double adaptive = averageDeliveryTime(rttMillis, loss, [&rtt](unsigned n, system_tick_t now) {
+        return rtt.transmit_timeout(n, now);
+    }, &rtt);
+    CHECK(adaptive < fixed * 2 / 3);
+}
+
+TEST_CASE("CoAPMessageStore in-flight window") {
+    TestChannel channel;
+    CoAPMessageStore store;
+    store.set_max_in_flight(2);
+
+    bool deferred = false;
+    sendConfirmable(store, 1, 0, &deferred);
+    CHECK_FALSE(deferred);
+    sendConfirmable(store, 2, 0, &deferred);
+    CHECK_FALSE(deferred);
+    sendConfirmable(store, 3, 0, &deferred);
+    CHECK(deferred);
+    deferred = false;
+    sendConfirmable(store, 4, 0, &deferred);
+    CHECK(deferred);
+
+    SECTION("queued messages are not sent while the window is full") {
+        store.process(10, channel);
+        CHECK(channel.sent.empty());
+    }
+
+    SECTION("queued messages are sent in order once acknowledgements are received") {
+        receiveAck(store, channel, 1, 100);
+        store.process(100, channel);
+        REQUIRE(channel.sent.size() == 1);
+        CHECK(channel.sent[0] == 3);
+        receiveAck(store, channel, 2, 150);
+        store.process(150, channel);
+        REQUIRE(channel.sent.size() == 2);
+        CHECK(channel.sent[1] == 4);
+    }
+
+    SECTION("acknowledgements update the RTT estimate") {
+        receiveAck(store, channel, 1, 100);
+        CHECK(store.rtt_estimator().has_samples());
+        CHECK(store.rtt_estimator().srtt() == 100);
+    }
+
+    SECTION("the RTT of a queued message is measured from its first transmission") {
+        receiveAck(store, channel, 1, 1000);
+        store.process(1000, channel);
+        receiveAck(store, channel, 3, 1200);
+        CHECK(store.rtt_estimator().srtt() < 1000);
+    }
+
+    store.clear();
+    CHECK(CoAPMessage::messages() == 0);
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lightssl_record_reader.h"
+
+#include <catch2/catch.hpp>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace particle::protocol;
+
+namespace {
+
+typedef LightSSLRecordReader<256> Reader;
+
+std::string record(size_t size, char fill) {
+    std::string s;
+    s += (char)(size >> 8);
+    s += (char)size;
+    s.append(size, fill);
+    return s;
+}
+
+// Transport that returns the scripted data in the specified portions
+class ScriptedReceive {
+public:
+    std::vector<std::string> portions;
+    size_t calls = 0;
+
+    int operator()(uint8_t* buf, size_t size) {
+        ++calls;
+        if (portions.empty()) {
+            return 0;
+        }
+        auto& p = portions.front();
+        const size_t n = std::min(size, p.size());
+        memcpy(buf, p.data(), n);
+        p.erase(0, n);
+        if (p.empty()) {
+            portions.erase(portions.begin());
+        }
+        return n;
+    }
+};
+
+std::string next(Reader* reader) {
+    uint8_t* body = nullptr;
+    size_t size = 0;
+    REQUIRE(reader->next(body, size) == NO_ERROR);
+    if (!size) {
+        return std::string();
+    }
+    std::string s((const char*)body, size);
+    reader->consume();
+    return s;
+}
+
+// Connected pair of TCP sockets on the loopback interface
+struct Connection {
+    int client = -1;
+    int server = -1;
+
+    Connection() {
+        const int listener = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(listener >= 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0);
+        socklen_t len = sizeof(addr);
+        REQUIRE(getsockname(listener, (sockaddr*)&addr, &len) == 0);
+        REQUIRE(listen(listener, 1) == 0);
+        client = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(connect(client, (sockaddr*)&addr, sizeof(addr)) == 0);
+        server = accept(listener, nullptr, nullptr);
+        REQUIRE(server >= 0);
+        close(listener);
+        const int one = 1;
+        setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+    }
+
+    ~Connection() {
+        close(client);
+        close(server);
+    }
+};
+
+// Non-blocking receive callback, as provided by the system layer
+int receive(int sock, uint8_t* buf, size_t size) {
+    const ssize_t n = recv(sock, buf, size, 0);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    return n;
+}
+
+const size_t RECORD_COUNT = 20000;
+const size_t SPLIT_INTERVAL = 100; // Every Nth record is delivered in two TCP segments
+const auto SPLIT_DELAY = std::chrono::milliseconds(2);
+
+// Sends records of different sizes, some of them split across segments that arrive later
+void sendRecords(int sock) {
+    for (size_t i = 0; i < RECORD_COUNT; ++i) {
+        const auto r = record(16 * (1 + i % 16), (char)i);
+        if (i % SPLIT_INTERVAL == 0) {
+            const size_t half = r.size() / 2;
+            send(sock, r.data(), half, 0);
+            std::this_thread::sleep_for(SPLIT_DELAY);
+            send(sock, r.data() + half, r.size() - half, 0);
+        } else {
+            send(sock, r.data(), r.size(), 0);
+        }
+    }
+}
+
+struct BenchmarkResult {
+    size_t received = 0;
+    size_t errors = 0;
+    double messagesPerSec = 0;
+    double maxStallMs = 0;
+    size_t stalls = 0; // Calls that took longer than 1 ms
+};
+
+// Calls `receiveOne` until all records are received and measures the longest call
+template<typename F>
+BenchmarkResult runBenchmark(F receiveOne) {
+    Connection conn;
+    std::thread sender(sendRecords, conn.server);
+    BenchmarkResult res;
+    const auto start = std::chrono::steady_clock::now();
+    std::string body;
+    while (res.received < RECORD_COUNT) {
+        const auto t1 = std::chrono::steady_clock::now();
+        body.clear();
+        const int ret = receiveOne(conn.client, &body);
+        const auto t2 = std::chrono::steady_clock::now();
+        if (ret < 0) {
+            break;
+        }
+        const double ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        res.maxStallMs = std::max(res.maxStallMs, ms);
+        if (ms > 1) {
+            ++res.stalls;
+        }
+        if (body.empty()) {
+            std::this_thread::yield(); // The system thread has other things to do
+        } else {
+            const size_t i = res.received++;
+            if (body != std::string(16 * (1 + i % 16), (char)i)) {
+                ++res.errors;
+            }
+        }
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    res.messagesPerSec = res.received / sec;
+    sender.join();
+    return res;
+}
+
+} // namespace
+
+TEST_CASE("LightSSLRecordReader") {
+    Reader reader;
+    ScriptedReceive transport;
+
+    SECTION("accumulates a record received in parts") {
+        const auto r = record(32, 'a');
+        transport.portions = { r.substr(0, 1), r.substr(1, 10), r.substr(11) };
+        CHECK(reader.read(std::ref(transport)) == 1);
+        CHECK(next(&reader).empty());
+        CHECK(reader.read(std::ref(transport)) == 10);
+        CHECK(next(&reader).empty());
+        CHECK(reader.available() == 11);
+        CHECK(reader.read(std::ref(transport)) == 23);
+        CHECK(next(&reader) == std::string(32, 'a'));
+        CHECK(reader.available() == 0);
+    }
+
+    SECTION("serves several records from a single read") {
+        transport.portions = { record(16, 'a') + record(48, 'b') + record(32, 'c').substr(0, 20) };
+        CHECK(reader.read(std::ref(transport)) == 18 + 50 + 20);
+        CHECK(next(&reader) == std::string(16, 'a'));
+        CHECK(next(&reader) == std::string(48, 'b'));
+        CHECK(next(&reader).empty());
+        CHECK(transport.calls == 1);
+        transport.portions = { record(32, 'c').substr(20) };
+        CHECK(reader.read(std::ref(transport)) == 14);
+        CHECK(next(&reader) == std::string(32, 'c'));
+    }
+
+    SECTION("makes room for the rest of a record") {
+        transport.portions = { record(144, 'a') + record(256, 'b') };
+        CHECK(reader.read(std::ref(transport)) == 258);
+        CHECK(next(&reader) == std::string(144, 'a'));
+        CHECK(next(&reader).empty());
+        CHECK(reader.read(std::ref(transport)) == 146);
+        CHECK(next(&reader) == std::string(256, 'b'));
+    }
+
+    SECTION("rejects invalid record sizes") {
+        uint8_t* body = nullptr;
+        size_t size = 0;
+        transport.portions = { record(272, 'a') };
+        reader.read(std::ref(transport));
+        CHECK(reader.next(body, size) == INSUFFICIENT_STORAGE);
+        reader.reset();
+        transport.portions = { record(17, 'a') };
+        reader.read(std::ref(transport));
+        CHECK(reader.next(body, size) == DECRYPTION_ERROR);
+        reader.reset();
+        transport.portions = { record(0, 'a') };
+        reader.read(std::ref(transport));
+        CHECK(reader.next(body, size) == DECRYPTION_ERROR);
+    }
+
+    SECTION("passes the errors of the transport through") {
+        CHECK(reader.read([](uint8_t* buf, size_t size) { return -5; }) == -5);
+        CHECK(reader.available() == 0);
+    }
+}
+
+TEST_CASE("LightSSLRecordReader loopback benchmark") {
+    // Previous implementation: the length is read without blocking, and then the receive loop
+    // spins until the entire body is received
+    const auto blocking = runBenchmark([](int sock, std::string* body) {
+        uint8_t header[2];
+        const int n = receive(sock, header, sizeof(header));
+        if (n != 2) {
+            return n;
+        }
+        const size_t size = header[0] << 8 | header[1];
+        body->resize(size);
+        size_t offs = 0;
+        while (offs < size) {
+            const int r = receive(sock, (uint8_t*)&(*body)[offs], size - offs);
+            if (r < 0) {
+                return r;
+            }
+            offs += r;
+        }
+        return 0;
+    });
+    CHECK(blocking.received == RECORD_COUNT);
+    CHECK(blocking.errors == 0);
+
+    Reader reader;
+    const auto incremental = runBenchmark([&reader](int sock, std::string* body) {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        if (reader.next(data, size) != NO_ERROR) {
+            return -1;
+        }
+        if (!size) {
+            const int n = reader.read([sock](uint8_t* buf, size_t len) {
+                return receive(sock, buf, len);
+            });
+            if (n < 0 || reader.next(data, size) != NO_ERROR) {
+                return -1;
+            }
+        }
+        if (size) {
+            body->assign((const char*)data, size);
+            reader.consume();
+        }
+        return 0;
+    });
+    CHECK(incremental.received == RECORD_COUNT);
+    CHECK(incremental.errors == 0);
+
+    WARN("LightSSL records over loopback TCP: blocking receive " << (int)blocking.messagesPerSec << " msg/s, " <<
+            blocking.stalls << " calls over 1 ms, max " << blocking.maxStallMs << " ms; incremental reader " <<
+            (int)incremental.messagesPerSec << " msg/s, " << incremental.stalls << " calls over 1 ms, max " <<
+            incremental.maxStallMs << " ms");
+}
@@ -238,3 +238,28 @@ SCENARIO("Events are non-confirmable over an unreliable channel with the NO_ACK
 {
 	verify_event_type_with_flags(EventType::NO_ACK, CoAPType::NON);
 }
+
+SCENARIO("Time sync quality only fills the fields that fit into the caller's structure")
+{
+	ProtocolBuilder builder;
+	builder.callbacks.millis = &fake_millis;
+	MessageChannel* channel = nullptr;
+	AbstractProtocol p(*channel);	// channel is not used
+	builder.build(p);
+
+	time_sync_quality quality;
+	memset(&quality, 0xff, sizeof(quality));
+	quality.size = offsetof(time_sync_quality, accuracy);
+	REQUIRE(p.get_time_sync_quality(&quality) == 0);
+	REQUIRE(quality.synced == 0);
+	REQUIRE(quality.drift_known == 0);
+	REQUIRE(quality.accuracy == 0xffffffff);
+	REQUIRE(quality.next_sync == 0xffffffff);
+
+	quality.size = sizeof(quality);
+	REQUIRE(p.get_time_sync_quality(&quality) == 0);
+	REQUIRE(quality.accuracy != 0xffffffff);
+
+	quality.size = offsetof(time_sync_quality, synced);
+	REQUIRE(p.get_time_sync_quality(&quality) == SYSTEM_ERROR_INVALID_ARGUMENT);
+}
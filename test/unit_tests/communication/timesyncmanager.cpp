@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timesyncmanager.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace particle::protocol;
+
+namespace {
+
+const int64_t EPOCH = 1546300800000LL; // 2019-01-01, in milliseconds
+const double HOUR = 60 * 60 * 1000;
+
+// Local millisecond counter that runs at a different rate than the server clock. Network delays
+// are random and asymmetric
+class SimulatedClock {
+public:
+    SimulatedClock(double skewPpm, double minDelay, double maxDelay, bool wholeSeconds) :
+            rand(12345),
+            delay(minDelay, maxDelay),
+            t(0),
+            skew(skewPpm / 1e6),
+            wholeSeconds(wholeSeconds),
+            setTime(0),
+            setMillis(0) {
+    }
+
+    // Local time
+    system_tick_t millis() const {
+        // Start close to the wraparound of the counter
+        return (system_tick_t)(0xffffffffu - 3600000u + (uint64_t)std::llround(t * (1 + skew)));
+    }
+
+    // True server time
+    int64_t server() const {
+        return EPOCH + (int64_t)std::llround(t);
+    }
+
+    // Performs a request and returns the round-trip time
+    double sync(TimeSyncManager* mgr) {
+        const double start = t;
+        mgr->send_request(millis(), []() {
+            return true;
+        });
+        respond(mgr);
+        return t - start;
+    }
+
+    // Delivers a response to a pending request
+    void respond(TimeSyncManager* mgr) {
+        t += delay(rand);
+        const int64_t s = server();
+        t += delay(rand);
+        mgr->handle_time_response(s / 1000, wholeSeconds ? -1 : (int)(s % 1000), millis(), [this](time_t tm, unsigned ms, void*) {
+            setTime = tm;
+            setMillis = ms;
+        });
+    }
+
+    // Error of the estimated server time, in milliseconds
+    double error(const TimeSyncManager& mgr) const {
+        return std::fabs((double)(mgr.server_time(millis()) - server()));
+    }
+
+    std::mt19937 rand;
+    std::uniform_real_distribution<double> delay;
+    double t; // Elapsed true time
+    double skew;
+    bool wholeSeconds;
+    time_t setTime;
+    unsigned setMillis;
+};
+
+} // namespace
+
+TEST_CASE("TimeSyncManager") {
+    TimeSyncManager mgr;
+    const system_tick_t minInterval = TimeSyncManager::MIN_SYNC_INTERVAL;
+    const system_tick_t maxInterval = TimeSyncManager::MAX_SYNC_INTERVAL;
+
+    SECTION("compensates the round-trip time") {
+        SimulatedClock clock(0, 400, 400, false);
+        clock.sync(&mgr);
+        const int64_t t = (int64_t)clock.setTime * 1000 + clock.setMillis;
+        CHECK(std::abs(t - clock.server()) <= 1);
+        CHECK(mgr.accuracy(clock.millis()) <= 402);
+        CHECK_FALSE(mgr.is_request_pending());
+        time_t tm = 0;
+        CHECK(mgr.last_sync(tm) == clock.millis());
+        CHECK(tm == clock.server() / 1000);
+    }
+
+    SECTION("centers a time with a resolution of one second") {
+        SimulatedClock clock(0, 10, 10, true);
+        double maxError = 0;
+        for (int i = 0; i < 100; ++i) {
+            TimeSyncManager m;
+            clock.t += 137; // Different phases of the server second
+            clock.sync(&m);
+            maxError = std::max(maxError, clock.error(m));
+        }
+        CHECK(maxError <= 500);
+    }
+
+    SECTION("estimates the drift with jittery round-trip times") {
+        SimulatedClock clock(40, 20, 800, false);
+        for (int i = 0; i < 8; ++i) {
+            clock.sync(&mgr);
+            clock.t += HOUR;
+        }
+        CHECK(mgr.sample_count() == 8);
+        CHECK(mgr.is_drift_known());
+        CHECK(mgr.drift_ppm() == Approx(-40).margin(5));
+        // The error stays within the estimated accuracy
+        CHECK(clock.error(mgr) <= mgr.accuracy(clock.millis()));
+    }
+
+    SECTION("estimates the drift from whole seconds over a longer period") {
+        SimulatedClock clock(-25, 50, 300, true);
+        for (int i = 0; i < 8; ++i) {
+            clock.sync(&mgr);
+            clock.t += 6 * HOUR;
+        }
+        CHECK(mgr.is_drift_known());
+        CHECK(mgr.drift_ppm() == Approx(25).margin(10));
+        CHECK(clock.error(mgr) <= mgr.accuracy(clock.millis()));
+    }
+
+    SECTION("schedules the next synchronization according to the drift") {
+        SimulatedClock clock(40, 20, 800, false);
+        clock.sync(&mgr);
+        // Until the drift is measured, the default drift is assumed
+        const system_tick_t first = mgr.next_sync(clock.millis());
+        CHECK(first >= minInterval);
+        CHECK(first < 2 * HOUR);
+        for (int i = 0; i < 8; ++i) {
+            clock.t += HOUR;
+            clock.sync(&mgr);
+        }
+        const system_tick_t next = mgr.next_sync(clock.millis());
+        CHECK(next > 3 * HOUR);
+        CHECK(next < maxInterval);
+        mgr.target_accuracy(100);
+        CHECK(mgr.next_sync(clock.millis()) < next);
+    }
+
+    SECTION("requests the time when the next synchronization is due") {
+        SimulatedClock clock(0, 10, 10, false);
+        int requests = 0;
+        const auto send = [&requests]() {
+            ++requests;
+            return true;
+        };
+        mgr.process(clock.millis(), send);
+        CHECK(requests == 0); // Not synchronized yet
+        clock.sync(&mgr);
+        clock.t += mgr.next_sync(clock.millis()) - 1;
+        mgr.process(clock.millis(), send);
+        CHECK(requests == 0);
+        clock.t += 1;
+        mgr.process(clock.millis(), send);
+        CHECK(requests == 1);
+        CHECK(mgr.is_request_pending());
+        // The response is lost
+        clock.t += TimeSyncManager::RESPONSE_TIMEOUT / 2;
+        mgr.process(clock.millis(), send);
+        CHECK(requests == 1);
+        clock.t += TimeSyncManager::RESPONSE_TIMEOUT / 2;
+        mgr.process(clock.millis(), send);
+        CHECK(requests == 2);
+        clock.respond(&mgr);
+        CHECK_FALSE(mgr.is_request_pending());
+        CHECK(mgr.sample_count() == 2);
+    }
+
+    SECTION("measures the round-trip time of a response to a request that timed out") {
+        SimulatedClock clock(0, 0, 0, false);
+        int requests = 0;
+        const auto send = [&requests]() {
+            ++requests;
+            return true;
+        };
+        mgr.send_request(clock.millis(), send);
+        clock.t += 35000;
+        const int64_t s = clock.server();
+        clock.t += TimeSyncManager::RESPONSE_TIMEOUT - 35000;
+        mgr.process(clock.millis(), send);
+        CHECK_FALSE(mgr.is_request_pending());
+        clock.t += 10000;
+        mgr.handle_time_response(s / 1000, s % 1000, clock.millis(), [](time_t, unsigned, void*) {});
+        CHECK(clock.error(mgr) <= 1);
+        CHECK(mgr.accuracy(clock.millis()) >= (TimeSyncManager::RESPONSE_TIMEOUT + 10000) / 2);
+        // A late response to the first of two requests
+        clock.t += mgr.next_sync(clock.millis());
+        mgr.process(clock.millis(), send);
+        clock.t += 35000;
+        const int64_t s2 = clock.server();
+        clock.t += TimeSyncManager::RESPONSE_TIMEOUT - 35000;
+        mgr.process(clock.millis(), send);
+        CHECK(requests == 3);
+        clock.t += 10000;
+        mgr.handle_time_response(s2 / 1000, s2 % 1000, clock.millis(), [](time_t, unsigned, void*) {});
+        CHECK(clock.error(mgr) <= mgr.accuracy(clock.millis()));
+    }
+
+    SECTION("discards the samples that don't agree with a new response") {
+        SimulatedClock clock(40, 20, 100, false);
+        for (int i = 0; i < 4; ++i) {
+            clock.sync(&mgr);
+            clock.t += HOUR;
+        }
+        CHECK(mgr.sample_count() == 4);
+        clock.skew = 0.1; // The local clock stopped for a while
+        clock.sync(&mgr);
+        CHECK(mgr.sample_count() == 1);
+        CHECK(clock.error(mgr) <= 100);
+    }
+}
+
+TEST_CASE("TimeSyncManager keeps the clock within the target accuracy") {
+    // One week of a device with a 35 ppm crystal on a cellular link. The fixed schedule syncs every
+    // hour to hold +/-1 s, and uses the time as received, truncated to whole seconds
+    const double duration = 7 * 24 * HOUR;
+    const auto run = [duration](bool wholeSeconds, double* maxError, int* syncs) {
+        TimeSyncManager mgr;
+        SimulatedClock clock(35, 50, 600, wholeSeconds);
+        *maxError = 0;
+        *syncs = 0;
+        clock.sync(&mgr);
+        while (clock.t < duration) {
+            clock.t += mgr.next_sync(clock.millis());
+            // Worst case: right before the synchronization
+            *maxError = std::max(*maxError, clock.error(mgr));
+            mgr.process(clock.millis(), []() {
+                return true;
+            });
+            clock.respond(&mgr);
+            ++*syncs;
+        }
+    };
+    double msError = 0, secError = 0;
+    int msSyncs = 0, secSyncs = 0;
+    run(false, &msError, &msSyncs);
+    run(true, &secError, &secSyncs);
+    const int fixedSyncs = duration / HOUR;
+    const double target = TimeSyncManager::DEFAULT_TARGET_ACCURACY;
+
+    // Previous implementation: whole seconds and no compensation of the round-trip time
+    double fixedError = 0;
+    {
+        SimulatedClock clock(35, 50, 600, true);
+        for (int i = 0; i < fixedSyncs; ++i) {
+            clock.t += clock.delay(clock.rand);
+            const int64_t s = clock.server() / 1000 * 1000;
+            clock.t += clock.delay(clock.rand);
+            const double drift = HOUR * 35e-6;
+            fixedError = std::max(fixedError, std::fabs((double)(s - clock.server())) + drift);
+            clock.t += HOUR;
+        }
+    }
+
+    CHECK(msError <= target);
+    CHECK(secError <= target * 1.5);
+    CHECK(msSyncs < fixedSyncs / 4);
+    CHECK(secSyncs < fixedSyncs / 2);
+    WARN("Time sync over 7 days: fixed hourly schedule " << fixedSyncs << " syncs, max error " << (int)fixedError <<
+            " ms; adaptive with milliseconds " << msSyncs << " syncs, max error " << (int)msError << " ms; adaptive " <<
+            "with whole seconds " << secSyncs << " syncs, max error " << (int)secError << " ms");
+}
@@ -0,0 +1,180 @@
+#include "dct_mirror.h"
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace particle;
+
+const size_t DCT_SIZE = 1024;
+
+// In-memory replacement of the DCT file. Every access costs as much time as a littlefs
+// open/close sequence
+class Storage {
+public:
+    Storage() :
+            data(DCT_SIZE, (char)0xff),
+            loads(0),
+            time(0),
+            failStore(false) {
+    }
+
+    std::string data;
+    std::vector<std::pair<size_t, size_t>> commits;
+    int loads;
+    system_tick_t time;
+    bool failStore;
+};
+
+class Backend {
+public:
+    explicit Backend(Storage* storage) :
+            storage_(storage) {
+    }
+
+    int load(uint8_t* data, size_t size) {
+        ++storage_->loads;
+        storage_->time += 5;
+        memcpy(data, storage_->data.data(), size);
+        return 0;
+    }
+
+    int store(size_t offset, const uint8_t* data, size_t size) {
+        storage_->time += 20;
+        if (storage_->failStore) {
+            return SYSTEM_ERROR_FILE;
+        }
+        storage_->data.replace(offset, size, (const char*)data, size);
+        storage_->commits.push_back(std::make_pair(offset, size));
+        return 0;
+    }
+
+    system_tick_t millis() {
+        return storage_->time;
+    }
+
+private:
+    Storage* storage_;
+};
+
+typedef detail::DctMirror<Backend, DCT_SIZE> Mirror;
+
+int write(Mirror* dct, size_t offset, const std::string& data) {
+    return dct->write(offset, (const uint8_t*)data.data(), data.size());
+}
+
+std::string read(Mirror* dct, size_t offset, size_t size) {
+    std::string s(size, '\0');
+    REQUIRE(dct->read(offset, (uint8_t*)&s[0], size) == 0);
+    return s;
+}
+
+} // namespace
+
+TEST_CASE("DctMirror") {
+    Storage storage;
+    Mirror dct(&storage);
+
+    SECTION("loads the data once and serves reads from RAM") {
+        storage.data.replace(100, 5, "hello");
+        CHECK(read(&dct, 100, 5) == "hello");
+        CHECK(read(&dct, 0, 1) == "\xff");
+        CHECK(read(&dct, DCT_SIZE - 2, 2) == "\xff\xff");
+        CHECK(storage.loads == 1);
+        const auto st = dct.stats();
+        CHECK(st.reads == 3);
+        CHECK(st.loads == 1);
+        CHECK(st.loadTime == 5);
+    }
+
+    SECTION("commits every write immediately") {
+        REQUIRE(write(&dct, 10, "abc") == 0);
+        CHECK(storage.data.substr(10, 3) == "abc");
+        REQUIRE(write(&dct, 20, "de") == 0);
+        CHECK(storage.commits == std::vector<std::pair<size_t, size_t>>({ { 10, 3 }, { 20, 2 } }));
+        CHECK_FALSE(dct.dirty());
+        const auto st = dct.stats();
+        CHECK(st.writes == 2);
+        CHECK(st.commits == 2);
+        CHECK(st.committedBytes == 5);
+        CHECK(st.lastCommitTime == 20);
+        CHECK(st.totalCommitTime == 40);
+    }
+
+    SECTION("doesn't commit writes that don't change the data") {
+        REQUIRE(write(&dct, 10, "abc") == 0);
+        REQUIRE(write(&dct, 10, "abc") == 0);
+        REQUIRE(write(&dct, 11, "b") == 0);
+        REQUIRE(write(&dct, 0, "\xff\xff") == 0);
+        CHECK(storage.commits.size() == 1);
+        CHECK(dct.stats().unchangedWrites == 3);
+    }
+
+    SECTION("coalesces the writes of an update into a single commit") {
+        dct.beginUpdate();
+        REQUIRE(write(&dct, 30, "xyz") == 0);
+        dct.beginUpdate();
+        REQUIRE(write(&dct, 10, "ab") == 0);
+        REQUIRE(dct.endUpdate() == 0);
+        CHECK(storage.commits.empty());
+        CHECK(read(&dct, 10, 2) == "ab"); // Pending changes are visible to the readers
+        REQUIRE(write(&dct, 20, "c") == 0);
+        CHECK(dct.dirty());
+        REQUIRE(dct.endUpdate() == 0);
+        CHECK(storage.commits == std::vector<std::pair<size_t, size_t>>({ { 10, 23 } }));
+        CHECK(storage.data.substr(10, 23) == read(&dct, 10, 23));
+        CHECK(storage.data.substr(30, 3) == "xyz");
+    }
+
+    SECTION("fills the entire DCT") {
+        REQUIRE(write(&dct, 10, "abc") == 0);
+        REQUIRE(dct.fill(0xff) == 0);
+        CHECK(storage.data == std::string(DCT_SIZE, (char)0xff));
+        CHECK(storage.commits.back() == std::make_pair((size_t)0, DCT_SIZE));
+    }
+
+    SECTION("reloads the data after a failed commit") {
+        REQUIRE(write(&dct, 10, "abc") == 0);
+        storage.failStore = true;
+        CHECK(write(&dct, 10, "def") == SYSTEM_ERROR_FILE);
+        storage.failStore = false;
+        CHECK(read(&dct, 10, 3) == "abc");
+        CHECK(storage.loads == 2);
+        CHECK_FALSE(dct.dirty());
+    }
+
+    SECTION("rejects accesses out of range") {
+        uint8_t b = 0;
+        CHECK(dct.read(DCT_SIZE, &b, 1) == SYSTEM_ERROR_OUT_OF_RANGE);
+        CHECK(dct.read(DCT_SIZE - 1, &b, 2) == SYSTEM_ERROR_OUT_OF_RANGE);
+        CHECK(dct.write(DCT_SIZE + 1, &b, 0) == SYSTEM_ERROR_OUT_OF_RANGE);
+        CHECK(dct.read(DCT_SIZE, &b, 0) == 0);
+        CHECK(storage.commits.empty());
+    }
+
+    SECTION("reduces the storage accesses during startup") {
+        // Typical sequence of a boot and a cloud connection: the system flags, keys, server
+        // address and feature flags are read several times, and a few flags are written back
+        const std::vector<std::pair<size_t, size_t>> reads = {
+            { 0, 32 }, { 34, 512 }, { 900, 4 }, { 904, 63 }, { 0, 32 }, { 500, 384 },
+            { 900, 4 }, { 967, 1 }, { 0, 32 }, { 500, 384 }, { 34, 512 }, { 900, 4 }
+        };
+        for (const auto& r: reads) {
+            read(&dct, r.first, r.second);
+        }
+        REQUIRE(write(&dct, 967, "\x01") == 0);
+        REQUIRE(write(&dct, 967, "\x01") == 0);
+        REQUIRE(write(&dct, 900, "\x01\x00\x00\x00") == 0);
+        const auto st = dct.stats();
+        const size_t accesses = st.loads + st.commits;
+        const size_t uncached = reads.size() + 3;
+        CHECK(accesses == 3);
+        const system_tick_t time = st.loadTime + st.totalCommitTime;
+        WARN("DCT mirror: " << st.reads << " reads and " << st.writes + st.unchangedWrites << " writes in " <<
+                accesses << " storage accesses (" << time << " ms), " << uncached << " accesses without the mirror");
+    }
+}
@@ -0,0 +1,337 @@
+#include "ota_flash_pipeline.h"
+
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+namespace {
+
+using namespace particle;
+
+const size_t SECTOR_SIZE = 4096;
+const size_t FLASH_SIZE = 64 * SECTOR_SIZE;
+
+// NOR flash with erase and program latencies of an external SPI flash, scaled down 10 times
+class SimulatedFlash {
+public:
+    SimulatedFlash() :
+            data(FLASH_SIZE, (char)0xff),
+            eraseTime(std::chrono::microseconds(4000)),
+            pageWriteTime(std::chrono::microseconds(70)),
+            failErase(false),
+            violations(0) {
+    }
+
+    int erase(uintptr_t addr) {
+        std::this_thread::sleep_for(eraseTime);
+        if (failErase) {
+            return SYSTEM_ERROR_IO;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        data.replace(addr - addr % SECTOR_SIZE, SECTOR_SIZE, SECTOR_SIZE, (char)0xff);
+        erased.push_back(addr);
+        return 0;
+    }
+
+    int write(uintptr_t addr, const uint8_t* buf, size_t size) {
+        std::this_thread::sleep_for(pageWriteTime * ((size + 255) / 256));
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < size; ++i) {
+            if ((uint8_t)data[addr + i] != 0xff && (uint8_t)data[addr + i] != buf[i]) {
+                ++violations; // Programming a byte that is not erased
+            }
+            data[addr + i] &= buf[i];
+        }
+        return 0;
+    }
+
+    std::mutex mutex;
+    std::string data;
+    std::vector<uintptr_t> erased;
+    std::chrono::microseconds eraseTime;
+    std::chrono::microseconds pageWriteTime;
+    std::atomic<bool> failErase;
+    int violations;
+};
+
+class Semaphore {
+public:
+    Semaphore() :
+            given_(false) {
+    }
+
+    void give() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            given_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    void take(system_tick_t timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout), [this]() { return given_; });
+        given_ = false;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool given_;
+};
+
+class Backend {
+public:
+    explicit Backend(SimulatedFlash* flash) :
+            flash_(flash) {
+    }
+
+    int erase(uintptr_t addr) {
+        return flash_->erase(addr);
+    }
+
+    int write(uintptr_t addr, const uint8_t* data, size_t size) {
+        return flash_->write(addr, data, size);
+    }
+
+    size_t sectorSize() {
+        return SECTOR_SIZE;
+    }
+
+    void lock() {
+        mutex_.lock();
+    }
+
+    void unlock() {
+        mutex_.unlock();
+    }
+
+    void notifyWorker() {
+        worker_.give();
+    }
+
+    void waitWorker(system_tick_t timeout) {
+        worker_.take(timeout);
+    }
+
+    void notifyProducer() {
+        producer_.give();
+    }
+
+    void waitProducer(system_tick_t timeout) {
+        producer_.take(timeout);
+    }
+
+    system_tick_t millis() {
+        static const auto start = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    SimulatedFlash* flash_;
+    std::mutex mutex_;
+    Semaphore worker_;
+    Semaphore producer_;
+};
+
+typedef detail::OtaFlashPipeline<Backend, 512, 8> Pipeline;
+
+// Runs the worker thread of a pipeline
+class Worker {
+public:
+    explicit Worker(Pipeline* pipeline) :
+            pipeline_(pipeline),
+            stop_(false),
+            thread_([this]() {
+                while (!stop_) {
+                    if (!pipeline_->process()) {
+                        pipeline_->backend()->waitWorker(10);
+                    }
+                }
+            }) {
+    }
+
+    ~Worker() {
+        stop_ = true;
+        pipeline_->backend()->notifyWorker();
+        thread_.join();
+    }
+
+private:
+    Pipeline* pipeline_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+std::string image(size_t size) {
+    std::string s;
+    uint32_t x = 12345;
+    for (size_t i = 0; i < size; ++i) {
+        x = x * 1103515245 + 12345;
+        s += (char)(x >> 16);
+    }
+    return s;
+}
+
+uint32_t crc32(const std::string& data) {
+    uint32_t crc = 0xffffffff;
+    for (char c: data) {
+        crc ^= (uint8_t)c;
+        for (unsigned j = 0; j < 8; ++j) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+int update(Pipeline* p, uintptr_t addr, const std::string& data) {
+    return p->update(addr, (const uint8_t*)data.data(), data.size());
+}
+
+} // namespace
+
+TEST_CASE("OtaFlashPipeline") {
+    SimulatedFlash flash;
+    Pipeline pipeline(&flash);
+    const uintptr_t base = 2 * SECTOR_SIZE;
+
+    SECTION("programs the chunks in the background and computes the CRC") {
+        Worker worker(&pipeline);
+        const auto img = image(10000);
+        REQUIRE(pipeline.begin(base, img.size()) == 0);
+        for (size_t offs = 0; offs < img.size(); offs += 512) {
+            REQUIRE(update(&pipeline, base + offs, img.substr(offs, 512)) == 0);
+        }
+        REQUIRE(pipeline.end() == 0);
+        CHECK(flash.data.substr(base, img.size()) == img);
+        CHECK(flash.violations == 0);
+        uint32_t crc = 0;
+        size_t size = 0;
+        REQUIRE(pipeline.crc32(&crc, &size) == 0);
+        CHECK(crc == crc32(img));
+        CHECK(size == img.size());
+        // The sectors are erased in order and only once
+        CHECK(flash.erased == std::vector<uintptr_t>({ base, base + SECTOR_SIZE, base + 2 * SECTOR_SIZE }));
+        const auto st = pipeline.stats();
+        CHECK(st.chunks == 20);
+        CHECK(st.bytes == 10000);
+        CHECK(st.writes == 20);
+        CHECK(st.erases == 3);
+    }
+
+    SECTION("erases the sectors ahead of the write pointer") {
+        pipeline.eraseAhead(2);
+        REQUIRE(pipeline.begin(base, 16 * SECTOR_SIZE) == 0);
+        while (pipeline.process()) {
+        }
+        CHECK(flash.erased == std::vector<uintptr_t>({ base, base + SECTOR_SIZE }));
+        REQUIRE(update(&pipeline, base, std::string(SECTOR_SIZE, 'a')) == 0);
+        while (pipeline.process()) {
+        }
+        CHECK(flash.erased.size() == 3);
+        CHECK(pipeline.stats().erasesAhead == 3);
+        REQUIRE(pipeline.end() == 0);
+        CHECK_FALSE(pipeline.process());
+    }
+
+    SECTION("splits large chunks and blocks the producer while the queue is full") {
+        Worker worker(&pipeline);
+        const auto img = image(16 * 1024);
+        REQUIRE(pipeline.begin(base, img.size()) == 0);
+        REQUIRE(update(&pipeline, base, img) == 0);
+        REQUIRE(pipeline.end() == 0);
+        CHECK(flash.data.substr(base, img.size()) == img);
+        const auto st = pipeline.stats();
+        CHECK(st.writes == 32);
+        CHECK(st.waits > 0);
+    }
+
+    SECTION("handles the chunks that arrive out of order") {
+        const auto img = image(3 * 512);
+        REQUIRE(pipeline.begin(base, img.size()) == 0);
+        REQUIRE(update(&pipeline, base + 1024, img.substr(1024)) == 0);
+        REQUIRE(update(&pipeline, base, img.substr(0, 512)) == 0);
+        REQUIRE(update(&pipeline, base + 512, img.substr(512, 512)) == 0);
+        while (pipeline.process()) {
+        }
+        REQUIRE(pipeline.end() == 0);
+        CHECK(flash.data.substr(base, img.size()) == img);
+        uint32_t crc = 0;
+        CHECK(pipeline.crc32(&crc) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("reports the errors of the worker") {
+        flash.failErase = true;
+        REQUIRE(pipeline.begin(base, 1024) == 0);
+        REQUIRE(update(&pipeline, base, std::string(512, 'a')) == 0);
+        CHECK(pipeline.process());
+        CHECK(update(&pipeline, base + 512, std::string(512, 'b')) == SYSTEM_ERROR_IO);
+        CHECK(pipeline.end() == SYSTEM_ERROR_IO);
+        CHECK(update(&pipeline, base, std::string(512, 'a')) == SYSTEM_ERROR_INVALID_STATE);
+    }
+
+    SECTION("rejects the chunks outside of the image") {
+        REQUIRE(pipeline.begin(base, 1024) == 0);
+        CHECK(update(&pipeline, base - 1, "a") == SYSTEM_ERROR_OUT_OF_RANGE);
+        CHECK(update(&pipeline, base + 1000, std::string(25, 'a')) == SYSTEM_ERROR_OUT_OF_RANGE);
+        CHECK(update(&pipeline, base + 1000, std::string(24, 'a')) == 0);
+        pipeline.cancel();
+        CHECK_FALSE(pipeline.active());
+        CHECK_FALSE(pipeline.process());
+    }
+}
+
+TEST_CASE("OtaFlashPipeline benchmark") {
+    const size_t chunkSize = 512;
+    const size_t imageSize = 128 * 1024;
+    const auto chunkInterval = std::chrono::microseconds(1000); // Time between two chunks on the network, scaled down 10 times
+    const auto img = image(imageSize);
+    const uintptr_t base = 0;
+
+    // Previous implementation: the entire region is erased up front and every chunk is programmed
+    // before it is acknowledged
+    double syncMs = 0;
+    {
+        SimulatedFlash flash;
+        const auto t1 = std::chrono::steady_clock::now();
+        for (size_t offs = 0; offs < imageSize; offs += SECTOR_SIZE) {
+            flash.erase(base + offs);
+        }
+        for (size_t offs = 0; offs < imageSize; offs += chunkSize) {
+            std::this_thread::sleep_for(chunkInterval);
+            flash.write(base + offs, (const uint8_t*)img.data() + offs, chunkSize);
+        }
+        syncMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+        REQUIRE(flash.data.substr(base, imageSize) == img);
+    }
+
+    double pipelineMs = 0;
+    OtaFlashPipelineStats st = {};
+    {
+        SimulatedFlash flash;
+        Pipeline pipeline(&flash);
+        Worker worker(&pipeline);
+        const auto t1 = std::chrono::steady_clock::now();
+        REQUIRE(pipeline.begin(base, imageSize) == 0);
+        for (size_t offs = 0; offs < imageSize; offs += chunkSize) {
+            std::this_thread::sleep_for(chunkInterval);
+            REQUIRE(update(&pipeline, base + offs, img.substr(offs, chunkSize)) == 0);
+        }
+        REQUIRE(pipeline.end() == 0);
+        pipelineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+        st = pipeline.stats();
+        REQUIRE(flash.data.substr(base, imageSize) == img);
+        CHECK(flash.violations == 0);
+    }
+
+    const double kb = imageSize / 1024.0;
+    WARN("OTA staging of " << kb << " KB: synchronous " << syncMs << " ms (" << kb * 1000 / syncMs << " KB/s), " <<
+            "pipeline " << pipelineMs << " ms (" << kb * 1000 / pipelineMs << " KB/s), " << st.erasesAhead << " of " <<
+            st.erases << " sectors erased ahead, producer waited " << st.waitTime << " ms");
+}
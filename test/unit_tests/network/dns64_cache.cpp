@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "dns64_cache.h"
+
+using namespace particle;
+using namespace particle::net;
+
+namespace {
+
+typedef Dns64Cache<uint32_t, int> Cache;
+
+const uint16_t AAAA = 28;
+const uint16_t A = 1;
+
+} // namespace
+
+TEST_CASE("Dns64Cache") {
+    Cache cache(2 /* maxEntries */, 1000 /* ttl */, 100 /* negativeTtl */);
+    uint32_t addr = 0;
+    int error = 0;
+    system_tick_t ttl = 0;
+    spark::Vector<int> waiters;
+
+    SECTION("coalesces queries for a name that is being resolved") {
+        CHECK(cache.lookup("example.com", AAAA, 1, 0, &addr, &error, &ttl) == Cache::STARTED);
+        CHECK(cache.lookup("EXAMPLE.com", AAAA, 2, 10, &addr, &error, &ttl) == Cache::QUEUED);
+        CHECK(cache.lookup("example.com", A, 3, 10, &addr, &error, &ttl) == Cache::STARTED);
+        REQUIRE(cache.complete("example.com", AAAA, 0x01020304, 0, 20, &waiters) == 0);
+        REQUIRE(waiters.size() == 2);
+        CHECK(waiters.at(0) == 1);
+        CHECK(waiters.at(1) == 2);
+        CHECK(cache.stats().misses == 2);
+        CHECK(cache.stats().coalesced == 1);
+    }
+    SECTION("answers from the cache until the entry expires") {
+        REQUIRE(cache.lookup("example.com", AAAA, 1, 0, &addr, &error, &ttl) == Cache::STARTED);
+        REQUIRE(cache.complete("example.com", AAAA, 0x01020304, 0, 100, &waiters) == 0);
+        CHECK(cache.lookup("example.com", AAAA, 2, 600, &addr, &error, &ttl) == Cache::CACHED);
+        CHECK(addr == 0x01020304);
+        CHECK(error == 0);
+        CHECK(ttl == 500);
+        CHECK(cache.stats().hits == 1);
+        CHECK(cache.lookup("example.com", AAAA, 3, 1100, &addr, &error, &ttl) == Cache::STARTED);
+    }
+    SECTION("caches NXDOMAIN errors for a shorter time") {
+        REQUIRE(cache.lookup("example.com", AAAA, 1, 0, &addr, &error, &ttl) == Cache::STARTED);
+        REQUIRE(cache.complete("example.com", AAAA, 0, SYSTEM_ERROR_NOT_FOUND, 0, &waiters) == 0);
+        CHECK(cache.lookup("example.com", AAAA, 2, 50, &addr, &error, &ttl) == Cache::CACHED);
+        CHECK(error == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(cache.lookup("example.com", AAAA, 3, 100, &addr, &error, &ttl) == Cache::STARTED);
+    }
+    SECTION("doesn't cache other errors") {
+        REQUIRE(cache.lookup("example.com", AAAA, 1, 0, &addr, &error, &ttl) == Cache::STARTED);
+        REQUIRE(cache.complete("example.com", AAAA, 0, SYSTEM_ERROR_NETWORK, 0, &waiters) == 0);
+        CHECK(waiters.size() == 1);
+        CHECK(cache.lookup("example.com", AAAA, 2, 0, &addr, &error, &ttl) == Cache::STARTED);
+        CHECK(cache.complete("example.org", AAAA, 0, 0, 0, &waiters) == SYSTEM_ERROR_NOT_FOUND);
+    }
+    SECTION("evicts the oldest entry but keeps pending lookups") {
+        REQUIRE(cache.lookup("a.com", A, 1, 0, &addr, &error, &ttl) == Cache::STARTED);
+        REQUIRE(cache.complete("a.com", A, 1, 0, 0, &waiters) == 0);
+        REQUIRE(cache.lookup("b.com", A, 2, 10, &addr, &error, &ttl) == Cache::STARTED);
+        REQUIRE(cache.complete("b.com", A, 2, 0, 10, &waiters) == 0);
+        REQUIRE(cache.lookup("c.com", A, 3, 20, &addr, &error, &ttl) == Cache::STARTED);
+        REQUIRE(cache.lookup("d.com", A, 4, 30, &addr, &error, &ttl) == Cache::STARTED);
+        CHECK(cache.stats().evictions == 1);
+        CHECK(cache.lookup("a.com", A, 5, 40, &addr, &error, &ttl) == Cache::STARTED);
+        CHECK(cache.lookup("b.com", A, 6, 40, &addr, &error, &ttl) == Cache::CACHED);
+        CHECK(cache.complete("c.com", A, 3, 0, 50, &waiters) == 0);
+        CHECK(cache.complete("d.com", A, 4, 0, 50, &waiters) == 0);
+    }
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/types.h> // ssize_t
+
+#include "channel_stream.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#undef WARN
+#undef INFO
+#include "catch2/catch.hpp"
+
+using namespace particle;
+
+namespace {
+
+const uint8_t CHANNEL = 1;
+const size_t MAX_FRAME_SIZE = 1509;
+const size_t TEST_FRAME_SIZE = 40; // Used with the small test buffers
+
+class FakeMuxer {
+public:
+    FakeMuxer() :
+            suspends(0),
+            resumes(0),
+            suspended(false) {
+    }
+
+    int writeChannel(uint8_t channel, const uint8_t* data, size_t size) {
+        written.append((const char*)data, size);
+        return 0;
+    }
+
+    int suspendChannel(uint8_t channel) {
+        std::unique_lock<std::recursive_timed_mutex> lock(lockMuxer());
+        ++suspends;
+        suspended = true;
+        return 0;
+    }
+
+    int resumeChannel(uint8_t channel) {
+        if (onResume) {
+            auto fn = std::move(onResume);
+            onResume = nullptr;
+            fn();
+        }
+        std::unique_lock<std::recursive_timed_mutex> lock(lockMuxer());
+        ++resumes;
+        suspended = false;
+        return 0;
+    }
+
+    std::unique_lock<std::recursive_timed_mutex> lockMuxer() {
+        std::unique_lock<std::recursive_timed_mutex> lock(mutex, std::defer_lock);
+        if (!lock.try_lock_for(std::chrono::seconds(2))) {
+            // Carry on without the lock so that a deadlocked test can finish
+            ++lockTimeouts;
+        }
+        return lock;
+    }
+
+    size_t getMaxFrameSize() const {
+        return MAX_FRAME_SIZE;
+    }
+
+    std::string written;
+    std::atomic<int> suspends;
+    std::atomic<int> resumes;
+    std::atomic<bool> suspended;
+    // Held by the muxer thread while it delivers data, like the lock of the real muxer
+    std::recursive_timed_mutex mutex;
+    std::atomic<int> lockTimeouts{0};
+    std::function<void()> onResume;
+};
+
+typedef MuxerChannelStream<FakeMuxer> ChannelStream;
+
+struct Semaphore {
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned count;
+    unsigned maxCount;
+};
+
+std::string pattern(size_t offs, size_t size) {
+    std::string s;
+    for (size_t i = 0; i < size; ++i) {
+        s += (char)('a' + (offs + i) % 26);
+    }
+    return s;
+}
+
+void deliver(ChannelStream* strm, const std::string& data) {
+    ChannelStream::channelDataCb((const uint8_t*)data.data(), data.size(), strm);
+}
+
+std::string readAll(ChannelStream* strm, size_t chunk = 1024) {
+    std::string s;
+    std::vector<char> buf(chunk);
+    int n = 0;
+    while ((n = strm->read(buf.data(), buf.size())) > 0) {
+        s.append(buf.data(), n);
+    }
+    return s;
+}
+
+} // unnamed
+
+extern "C" {
+
+system_tick_t HAL_Timer_Get_Milli_Seconds() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int os_semaphore_create(os_semaphore_t* semaphore, unsigned max_count, unsigned initial_count) {
+    *semaphore = new Semaphore{ {}, {}, initial_count, max_count };
+    return 0;
+}
+
+int os_semaphore_destroy(os_semaphore_t semaphore) {
+    delete (Semaphore*)semaphore;
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool reserved) {
+    const auto sem = (Semaphore*)semaphore;
+    std::unique_lock<std::mutex> lock(sem->mutex);
+    if (!sem->cond.wait_for(lock, std::chrono::milliseconds(timeout), [sem]() { return sem->count > 0; })) {
+        return 1;
+    }
+    --sem->count;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t semaphore, bool reserved) {
+    const auto sem = (Semaphore*)semaphore;
+    {
+        std::lock_guard<std::mutex> lock(sem->mutex);
+        if (sem->count < sem->maxCount) {
+            ++sem->count;
+        }
+    }
+    sem->cond.notify_one();
+    return 0;
+}
+
+} // extern "C"
+
+TEST_CASE("MuxerChannelStream") {
+    FakeMuxer muxer;
+    ChannelStream strm(&muxer, CHANNEL);
+
+    SECTION("validates the watermarks") {
+        CHECK(strm.init(256, TEST_FRAME_SIZE, 100, 100) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(strm.init(256, TEST_FRAME_SIZE, 300, 10) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(strm.init(256, TEST_FRAME_SIZE, 200, 50) == 0);
+    }
+
+    SECTION("suspends the channel above the high watermark and resumes it below the low one") {
+        REQUIRE(strm.init(256, TEST_FRAME_SIZE) == 0); // High: 176, low: 88
+        deliver(&strm, pattern(0, 100));
+        CHECK_FALSE(muxer.suspended);
+        deliver(&strm, pattern(100, 100));
+        CHECK(muxer.suspended);
+        CHECK(strm.suspended());
+        deliver(&strm, pattern(200, 50));
+        char buf[32];
+        size_t offs = 0;
+        // Small reads don't cause flow control exchanges until the buffer is drained enough
+        while (strm.availForRead() > 88) {
+            const int n = strm.read(buf, sizeof(buf));
+            REQUIRE(n > 0);
+            CHECK(std::string(buf, n) == pattern(offs, n));
+            offs += n;
+            CHECK(muxer.suspended == (strm.availForRead() > 88));
+        }
+        CHECK(muxer.suspends == 1);
+        CHECK(muxer.resumes == 1);
+        CHECK(readAll(&strm) == pattern(offs, 250 - offs));
+        deliver(&strm, pattern(0, 10));
+        readAll(&strm);
+        CHECK(muxer.suspends == 1);
+        CHECK(muxer.resumes == 1);
+        const auto st = strm.stats();
+        CHECK(st.suspends == 1);
+        CHECK(st.rxBytes == 260);
+        CHECK(st.dropped == 0);
+    }
+
+    SECTION("buffers the frames received after suspending the channel in the headroom") {
+        REQUIRE(strm.init(256, TEST_FRAME_SIZE) == 0); // High: 176
+        deliver(&strm, pattern(0, 200));
+        CHECK(muxer.suspended);
+        // The other end hasn't processed the flow control request yet
+        deliver(&strm, pattern(200, 50));
+        CHECK(readAll(&strm) == pattern(0, 250));
+        CHECK_FALSE(muxer.suspended);
+        const auto st = strm.stats();
+        CHECK(st.dropped == 0);
+        CHECK(st.overflows == 0);
+    }
+
+    SECTION("holds the data that doesn't fit into the buffer without blocking the muxer") {
+        REQUIRE(strm.init(256, TEST_FRAME_SIZE) == 0); // High: 176, low: 88
+        deliver(&strm, pattern(0, 200));
+        // No reader is running, so this would never return if the muxer waited for buffer space
+        deliver(&strm, pattern(200, 100));
+        deliver(&strm, pattern(300, 10));
+        CHECK(strm.availForRead() == 310);
+        CHECK(muxer.suspended);
+        // The channel stays suspended until the held data is drained below the low watermark
+        char buf[100];
+        CHECK(strm.read(buf, sizeof(buf)) == 100);
+        CHECK(std::string(buf, 100) == pattern(0, 100));
+        CHECK(muxer.suspended);
+        CHECK(strm.read(buf, sizeof(buf)) == 100);
+        CHECK(muxer.suspended);
+        CHECK(strm.peek(buf, 10) == 10);
+        CHECK(std::string(buf, 10) == pattern(200, 10));
+        CHECK(readAll(&strm, 7) == pattern(200, 110));
+        CHECK_FALSE(muxer.suspended);
+        const auto st = strm.stats();
+        CHECK(st.rxBytes == 310);
+        CHECK(st.dropped == 0);
+        CHECK(st.overflows == 2);
+        CHECK(st.maxHeld == 54);
+    }
+
+    SECTION("limits the amount of held data") {
+        REQUIRE(strm.init(256, TEST_FRAME_SIZE) == 0); // Headroom: 80, held data limit: 160
+        deliver(&strm, pattern(0, 256));
+        // The other end ignores the flow control request
+        for (size_t offs = 256; offs < 456; offs += TEST_FRAME_SIZE) {
+            deliver(&strm, pattern(offs, TEST_FRAME_SIZE));
+        }
+        CHECK(strm.availForRead() == 416);
+        CHECK(readAll(&strm) == pattern(0, 416));
+        auto st = strm.stats();
+        CHECK(st.maxHeld == 160);
+        CHECK(st.dropped == 40);
+        // The limit applies again once the held data is drained
+        deliver(&strm, pattern(0, 256 + 160));
+        CHECK(readAll(&strm) == pattern(0, 256 + 160));
+        st = strm.stats();
+        CHECK(st.dropped == 40);
+    }
+
+    SECTION("doesn't pass the data to the handler while some data is held") {
+        REQUIRE(strm.init(256, TEST_FRAME_SIZE) == 0);
+        deliver(&strm, pattern(0, 300));
+        std::string received;
+        strm.dataHandler([](const uint8_t* data, size_t size, void* ctx) -> int {
+            ((std::string*)ctx)->append((const char*)data, size);
+            return size;
+        }, &received);
+        CHECK(strm.skip(256) == 256);
+        deliver(&strm, pattern(300, 20));
+        CHECK(received.empty());
+        CHECK(readAll(&strm) == pattern(256, 64));
+        deliver(&strm, pattern(320, 10));
+        CHECK(received == pattern(320, 10));
+    }
+
+    SECTION("passes the data to the handler without buffering it") {
+        REQUIRE(strm.init(256, TEST_FRAME_SIZE) == 0);
+        std::string received;
+        size_t limit = 1000;
+        struct Ctx {
+            std::string* received;
+            size_t* limit;
+        } ctx = { &received, &limit };
+        strm.dataHandler([](const uint8_t* data, size_t size, void* ctx) -> int {
+            const auto c = (Ctx*)ctx;
+            const size_t n = std::min(size, *c->limit);
+            c->received->append((const char*)data, n);
+            return n;
+        }, &ctx);
+        deliver(&strm, pattern(0, 100));
+        CHECK(received == pattern(0, 100));
+        CHECK(strm.availForRead() == 0);
+        // Keep the rest of the frame if the handler doesn't consume all of it
+        limit = 30;
+        deliver(&strm, pattern(100, 100));
+        CHECK(received == pattern(0, 130));
+        CHECK(strm.availForRead() == 70);
+        // The handler is not called while there's buffered data
+        deliver(&strm, pattern(200, 10));
+        CHECK(received.size() == 130);
+        CHECK(readAll(&strm) == pattern(130, 80));
+        const auto st = strm.stats();
+        CHECK(st.directBytes == 130);
+        CHECK(st.rxBytes == 210);
+    }
+}
+
+TEST_CASE("MuxerChannelStream flow control with a locking muxer") {
+    // The muxer thread delivers data with the muxer lock held, and the reader thread resumes the
+    // channel. The stream must not hold its own locks while calling the muxer, or the two threads
+    // deadlock
+    FakeMuxer muxer;
+    ChannelStream strm(&muxer, CHANNEL);
+    REQUIRE(strm.init(256, TEST_FRAME_SIZE) == 0);
+    deliver(&strm, pattern(0, 200));
+    REQUIRE(muxer.suspended);
+    std::atomic<bool> delivered(false);
+    std::thread producer;
+    muxer.onResume = [&]() {
+        // Data arrives while the reader is resuming the channel
+        producer = std::thread([&]() {
+            auto lock = muxer.lockMuxer();
+            deliver(&strm, pattern(200, 10));
+            delivered = true;
+        });
+        const auto t = std::chrono::steady_clock::now();
+        while (!delivered && std::chrono::steady_clock::now() - t < std::chrono::seconds(1)) {
+            std::this_thread::yield();
+        }
+    };
+    auto data = readAll(&strm);
+    producer.join();
+    CHECK(delivered);
+    CHECK(muxer.lockTimeouts == 0);
+    CHECK_FALSE(muxer.suspended);
+    data += readAll(&strm);
+    CHECK(data == pattern(0, 210));
+}
+
+TEST_CASE("MuxerChannelStream benchmark") {
+    const size_t bufSize = 4096;
+    const size_t total = 4 * 1024 * 1024;
+    const auto run = [=](size_t highWatermark, size_t lowWatermark, const char* name) {
+        FakeMuxer muxer;
+        ChannelStream strm(&muxer, CHANNEL);
+        REQUIRE(strm.init(bufSize, MAX_FRAME_SIZE, highWatermark, lowWatermark) == 0);
+        std::thread producer([&strm, &muxer, total]() {
+            const auto frame = pattern(0, 26 * 50); // Keeps the pattern continuous across frames
+            for (size_t n = 0; n < total; n += frame.size()) {
+                // The other end stops sending while the channel is suspended
+                while (muxer.suspended) {
+                    std::this_thread::yield();
+                }
+                deliver(&strm, frame);
+            }
+        });
+        const auto t1 = std::chrono::steady_clock::now();
+        size_t received = 0;
+        size_t errors = 0;
+        char buf[256];
+        while (received < total) {
+            if (strm.waitEvent(Stream::READABLE, 1000) != Stream::READABLE) {
+                break;
+            }
+            int n = 0;
+            while ((n = strm.read(buf, sizeof(buf))) > 0) {
+                for (int i = 0; i < n; ++i) {
+                    if (buf[i] != (char)('a' + (received + i) % 26)) {
+                        ++errors;
+                    }
+                }
+                received += n;
+            }
+        }
+        const auto t2 = std::chrono::steady_clock::now();
+        producer.join();
+        const auto st = strm.stats();
+        CHECK(received >= total);
+        CHECK(errors == 0);
+        CHECK(st.dropped == 0);
+        CHECK(muxer.suspends == muxer.resumes);
+        const double ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        WARN("Muxer channel stream (" << name << "): " << received / 1024 << " KB in " << ms << " ms, " <<
+                st.suspends << " suspends (max " << st.maxSuspendTime << " ms)");
+    };
+    // Thresholds used previously: suspend when 1/3 of the buffer is free, resume when 1/2 is free
+    run(bufSize - bufSize / 3, bufSize / 2, "narrow hysteresis");
+    // Leaves room for two maximum-sized frames when the channel is suspended
+    run(0, 0, "default watermarks");
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "network_impairment.h"
+
+#include "catch2/catch.hpp"
+
+#include <thread>
+#include <atomic>
+
+using namespace particle::simulation;
+
+namespace {
+
+const int SOCK = 1;
+const uint32_t ADDR = 0x7f000001;
+const uint16_t PORT = 5684;
+
+// Sends datagrams with a single byte payload containing their index
+void sendAll(NetworkImpairment* n, unsigned count, uint64_t now) {
+    for (unsigned i = 0; i < count; ++i) {
+        const uint8_t b = i;
+        n->send(SOCK, &b, 1, ADDR, PORT, now);
+    }
+}
+
+std::vector<uint8_t> receiveAll(NetworkImpairment* n, uint64_t now) {
+    std::vector<uint8_t> v;
+    Datagram d;
+    while (n->nextOutgoing(SOCK, now, &d)) {
+        REQUIRE(d.data.size() == 1);
+        CHECK(d.addr == ADDR);
+        CHECK(d.port == PORT);
+        v.push_back(d.data[0]);
+    }
+    return v;
+}
+
+} // namespace
+
+TEST_CASE("NetworkImpairment") {
+    ImpairmentConfig conf;
+    conf.seed = 1;
+
+    SECTION("is disabled by default") {
+        CHECK(!NetworkImpairment(conf).isEnabled());
+    }
+    SECTION("delays datagrams") {
+        conf.latency = 100;
+        NetworkImpairment n(conf);
+        REQUIRE(n.isEnabled());
+        sendAll(&n, 3, 1000);
+        CHECK(receiveAll(&n, 100999).empty());
+        CHECK(receiveAll(&n, 101000) == std::vector<uint8_t>({ 0, 1, 2 }));
+    }
+    SECTION("limits bandwidth") {
+        conf.bandwidth = 10; // 100ms per byte
+        NetworkImpairment n(conf);
+        sendAll(&n, 3, 0);
+        CHECK(receiveAll(&n, 100000) == std::vector<uint8_t>({ 0 }));
+        CHECK(receiveAll(&n, 250000) == std::vector<uint8_t>({ 1 }));
+        CHECK(receiveAll(&n, 300000) == std::vector<uint8_t>({ 2 }));
+    }
+    SECTION("drops all datagrams") {
+        conf.loss = 1.0;
+        NetworkImpairment n(conf);
+        sendAll(&n, 10, 0);
+        CHECK(receiveAll(&n, 1000000).empty());
+    }
+    SECTION("duplicates all datagrams") {
+        conf.duplication = 1.0;
+        NetworkImpairment n(conf);
+        sendAll(&n, 2, 0);
+        CHECK(receiveAll(&n, 0) == std::vector<uint8_t>({ 0, 0, 1, 1 }));
+    }
+    SECTION("reorders datagrams") {
+        conf.latency = 100;
+        conf.reordering = 0.5;
+        NetworkImpairment n(conf);
+        sendAll(&n, 100, 0);
+        const auto early = receiveAll(&n, 0);
+        CHECK(!early.empty());
+        CHECK(early.size() + receiveAll(&n, 100000).size() == 100);
+    }
+    SECTION("is deterministic for a given seed") {
+        conf.loss = 0.3;
+        conf.jitter = 50;
+        conf.latency = 50;
+        NetworkImpairment n1(conf), n2(conf);
+        sendAll(&n1, 50, 0);
+        sendAll(&n2, 50, 0);
+        CHECK(receiveAll(&n1, 1000000) == receiveAll(&n2, 1000000));
+    }
+    SECTION("requests rebinding periodically") {
+        conf.natRebinding = 30;
+        NetworkImpairment n(conf);
+        CHECK(!n.checkRebinding(SOCK, 0));
+        CHECK(!n.checkRebinding(SOCK, 29999999));
+        CHECK(n.checkRebinding(SOCK, 30000000));
+        CHECK(!n.checkRebinding(SOCK, 30000001));
+    }
+    SECTION("lists the sockets in use") {
+        conf.latency = 100;
+        NetworkImpairment n(conf);
+        sendAll(&n, 1, 0);
+        n.send(SOCK + 1, "a", 1, ADDR, PORT, 0);
+        CHECK(n.sockets() == std::vector<int>({ SOCK, SOCK + 1 }));
+        n.reset(SOCK);
+        CHECK(n.sockets() == std::vector<int>({ SOCK + 1 }));
+    }
+    SECTION("can be used from several threads") {
+        conf.loss = 0.1;
+        conf.jitter = 10;
+        const unsigned count = 10000;
+        NetworkImpairment n(conf);
+        std::atomic<bool> done(false);
+        size_t received = 0;
+        std::thread receiver([&n, &done, &received]() {
+            while (!done) {
+                received += receiveAll(&n, 1000000).size();
+            }
+        });
+        sendAll(&n, count, 0);
+        done = true;
+        receiver.join();
+        received += receiveAll(&n, 1000000).size();
+        // The same datagrams are dropped as when the emulator is used from a single thread
+        NetworkImpairment n2(conf);
+        sendAll(&n2, count, 0);
+        CHECK(received == receiveAll(&n2, 1000000).size());
+    }
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "virtual_clock.h"
+
+#include "catch2/catch.hpp"
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+using namespace particle::simulation;
+
+namespace {
+
+// Waits until the specified number of threads have called this function
+void barrier(std::atomic<int>* count, int threads) {
+    ++*count;
+    while (*count < threads) {
+        std::this_thread::yield();
+    }
+}
+
+} // unnamed
+
+TEST_CASE("VirtualClock") {
+    VirtualClock clock;
+
+    SECTION("advances to the end of the sleep when the only thread sleeps") {
+        clock.addThread();
+        CHECK(clock.sleep(1000));
+        CHECK(clock.peek() == 1000);
+        CHECK(clock.sleep(0));
+        CHECK(clock.peek() == 1000);
+        clock.removeThread();
+    }
+
+    SECTION("overlaps the sleeps of concurrent threads") {
+        std::atomic<int> ready(0);
+        uint64_t t1 = 0, t2 = 0;
+        std::thread thread1([&]() {
+            clock.addThread();
+            barrier(&ready, 2);
+            clock.sleep(10000);
+            t1 = clock.peek();
+            clock.sleep(10000);
+            clock.removeThread();
+        });
+        std::thread thread2([&]() {
+            clock.addThread();
+            barrier(&ready, 2);
+            clock.sleep(30000);
+            t2 = clock.peek();
+            clock.removeThread();
+        });
+        thread1.join();
+        thread2.join();
+        // The clock doesn't advance by the sum of the sleeps
+        CHECK(t1 == 10000);
+        CHECK(t2 == 30000);
+        CHECK(clock.peek() == 30000);
+    }
+
+    SECTION("doesn't advance while a registered thread is running") {
+        clock.idleTimeout(60000);
+        clock.addThread();
+        std::atomic<bool> done(false);
+        std::thread thread([&]() {
+            clock.sleep(1000);
+            done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK_FALSE(done);
+        CHECK(clock.peek() == 0);
+        // Sleeping lets the other thread run first
+        CHECK(clock.sleep(5000));
+        thread.join();
+        CHECK(done);
+        clock.removeThread();
+    }
+
+    SECTION("advances when a registered thread stops participating") {
+        clock.idleTimeout(60000);
+        std::atomic<int> ready(0);
+        std::thread thread([&]() {
+            clock.addThread();
+            barrier(&ready, 2);
+            clock.sleep(1000);
+            clock.removeThread();
+        });
+        clock.addThread();
+        barrier(&ready, 2);
+        const auto t = std::chrono::steady_clock::now();
+        clock.removeThread();
+        thread.join();
+        CHECK(std::chrono::steady_clock::now() - t < std::chrono::seconds(30));
+        CHECK(clock.peek() == 1000);
+    }
+
+    SECTION("advances after the idle timeout if a registered thread is blocked") {
+        clock.idleTimeout(10);
+        clock.addThread();
+        std::thread thread([&]() {
+            clock.sleep(1000);
+        });
+        thread.join();
+        CHECK(clock.peek() == 1000);
+        CHECK(clock.idleAdvances() == 1);
+        clock.removeThread();
+    }
+
+    SECTION("doesn't advance while a thread is blocked outside of the clock") {
+        clock.idleTimeout(10);
+        clock.addThread();
+        std::atomic<bool> done(false);
+        std::thread thread([&]() {
+            clock.sleep(1000);
+            done = true;
+        });
+        clock.beginExternalWait();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK_FALSE(done);
+        CHECK(clock.peek() == 0);
+        clock.endExternalWait();
+        CHECK(clock.sleep(5000));
+        thread.join();
+        CHECK(clock.peek() == 5000);
+        CHECK(clock.idleAdvances() == 0);
+        clock.removeThread();
+    }
+
+    SECTION("puts a thread that busy-waits on the clock to sleep") {
+        clock.addThread();
+        unsigned reads = 0;
+        while (clock.now() < 1000) {
+            ++reads;
+        }
+        CHECK(reads == 10 * VirtualClock::POLL_LIMIT - 1);
+        clock.removeThread();
+    }
+
+    SECTION("stops at the limit") {
+        clock.addThread();
+        clock.limit(5000);
+        CHECK(clock.sleep(3000));
+        CHECK_FALSE(clock.limitReached());
+        CHECK_FALSE(clock.sleep(3000));
+        CHECK(clock.limitReached());
+        CHECK(clock.peek() == 5000);
+        clock.removeThread();
+    }
+}
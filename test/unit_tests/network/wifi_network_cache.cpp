@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch2/catch.hpp"
+
+#include "wifi_network_cache.h"
+
+#include <string>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+// In-memory replacement of the configuration file
+class Storage {
+public:
+    Storage() :
+            loads(0),
+            saves(0),
+            time(0),
+            failSave(false) {
+    }
+
+    spark::Vector<WifiNetworkConfig> networks;
+    int loads;
+    int saves;
+    system_tick_t time;
+    bool failSave;
+};
+
+class Backend {
+public:
+    explicit Backend(Storage* storage) :
+            storage_(storage) {
+    }
+
+    int load(spark::Vector<WifiNetworkConfig>* networks) {
+        ++storage_->loads;
+        *networks = storage_->networks;
+        return 0;
+    }
+
+    int save(const spark::Vector<WifiNetworkConfig>& networks) {
+        if (storage_->failSave) {
+            return SYSTEM_ERROR_FILE;
+        }
+        ++storage_->saves;
+        storage_->networks = networks;
+        return 0;
+    }
+
+    system_tick_t millis() {
+        return storage_->time;
+    }
+
+    void lock() {
+    }
+
+    void unlock() {
+    }
+
+private:
+    Storage* storage_;
+};
+
+struct AccessPoint {
+    std::string ssid;
+    MacAddress bssid;
+    int channel;
+    int rssi;
+    bool reachable;
+};
+
+// Mock of the methods of WifiNcpClient used by the cache
+class MockClient {
+public:
+    MockClient(Storage* storage) :
+            scans(0),
+            storage_(storage),
+            connected_(nullptr) {
+    }
+
+    int connect(const char* ssid, const MacAddress& bssid, WifiSecurity sec, const WifiCredentials& cred) {
+        attempts.push_back(std::string(ssid) + '/' + std::to_string(bssid.data[5]));
+        storage_->time += 100;
+        for (const auto& ap: aps) {
+            if (ap.ssid == ssid && (bssid == INVALID_MAC_ADDRESS || ap.bssid == bssid) && ap.reachable) {
+                connected_ = &ap;
+                return 0;
+            }
+        }
+        storage_->time += 5000; // Connection timeout
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+
+    int getNetworkInfo(WifiNetworkInfo* info) {
+        if (!connected_) {
+            return SYSTEM_ERROR_INVALID_STATE;
+        }
+        info->ssid(connected_->ssid.c_str()).bssid(connected_->bssid).channel(connected_->channel).rssi(connected_->rssi);
+        return 0;
+    }
+
+    int scan(WifiScanCallback callback, void* data) {
+        ++scans;
+        storage_->time += 2500;
+        for (const auto& ap: aps) {
+            auto r = WifiScanResult().ssid(ap.ssid.c_str()).bssid(ap.bssid).security(WifiSecurity::WPA2_PSK)
+                    .channel(ap.channel).rssi(ap.rssi);
+            const int ret = callback(std::move(r), data);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    std::vector<AccessPoint> aps;
+    std::vector<std::string> attempts;
+    int scans;
+
+private:
+    Storage* storage_;
+    const AccessPoint* connected_;
+};
+
+typedef detail::WifiNetworkCache<Backend> Cache;
+
+MacAddress mac(uint8_t id) {
+    MacAddress addr = {};
+    addr.data[0] = 0x02;
+    addr.data[5] = id;
+    return addr;
+}
+
+WifiNetworkConfig network(const char* ssid) {
+    return WifiNetworkConfig().ssid(ssid).security(WifiSecurity::WPA2_PSK)
+            .credentials(WifiCredentials().type(WifiCredentials::PASSWORD).password("secret"));
+}
+
+std::vector<std::string> ssids(const spark::Vector<WifiNetworkConfig>& networks) {
+    std::vector<std::string> v;
+    for (const auto& n: networks) {
+        v.push_back(n.ssid());
+    }
+    return v;
+}
+
+} // unnamed
+
+TEST_CASE("WifiNetworkCache") {
+    Storage storage;
+    MockClient client(&storage);
+    Cache cache(&storage);
+
+    SECTION("loads the settings once and writes changes through") {
+        storage.networks.append(network("home"));
+        CHECK(cache.hasNetworkConfig());
+        WifiNetworkConfig conf;
+        CHECK(cache.getNetworkConfig("home", &conf) == 0);
+        CHECK(std::string(conf.credentials().password()) == "secret");
+        CHECK(cache.getNetworkConfig("office", &conf) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(storage.loads == 1);
+        REQUIRE(cache.setNetworkConfig(network("office")) == 0);
+        CHECK(storage.saves == 1);
+        CHECK(ssids(storage.networks) == std::vector<std::string>({ "home", "office" }));
+        cache.removeNetworkConfig("home");
+        CHECK(ssids(storage.networks) == std::vector<std::string>({ "office" }));
+        int count = 0;
+        REQUIRE(cache.getNetworkConfig([](WifiNetworkConfig conf, void* data) {
+            ++*(int*)data;
+            return 0;
+        }, &count) == 0);
+        CHECK(count == 1);
+        cache.clearNetworkConfig();
+        CHECK_FALSE(cache.hasNetworkConfig());
+        CHECK(storage.networks.isEmpty());
+        CHECK(storage.loads == 1);
+    }
+
+    SECTION("replaces the last network when the list is full") {
+        for (unsigned i = 0; i < MAX_CONFIGURED_WIFI_NETWORK_COUNT + 1; ++i) {
+            REQUIRE(cache.setNetworkConfig(network(std::to_string(i).c_str())) == 0);
+        }
+        REQUIRE(storage.networks.size() == (int)MAX_CONFIGURED_WIFI_NETWORK_COUNT);
+        CHECK(std::string(storage.networks.last().ssid()) == std::to_string(MAX_CONFIGURED_WIFI_NETWORK_COUNT));
+    }
+
+    SECTION("reloads the settings after a failed write") {
+        REQUIRE(cache.setNetworkConfig(network("home")) == 0);
+        storage.failSave = true;
+        CHECK(cache.setNetworkConfig(network("office")) == SYSTEM_ERROR_FILE);
+        storage.failSave = false;
+        CHECK_FALSE(cache.getNetworkConfig("office", nullptr) == 0);
+        WifiNetworkConfig conf;
+        CHECK(cache.getNetworkConfig("office", &conf) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(storage.loads == 2);
+    }
+
+    SECTION("scans when the access point of a network is not known") {
+        storage.networks.append(network("home"));
+        client.aps.push_back({ "home", mac(1), 6, -70, true });
+        client.aps.push_back({ "home", mac(2), 11, -50, true });
+        REQUIRE(cache.connect(&client, nullptr) == 0);
+        CHECK(client.scans == 1);
+        CHECK(client.attempts == std::vector<std::string>({ "home/2" }));
+        // The access point is persisted
+        CHECK(storage.networks.first().bssid() == mac(2));
+        WifiNetworkStats st = {};
+        REQUIRE(cache.getNetworkStats("home", &st) == 0);
+        CHECK(st.connections == 1);
+        CHECK(st.directConnections == 0);
+        CHECK(st.channel == 11);
+        CHECK(st.lastLatency == 100);
+    }
+
+    SECTION("connects to the last used access point without a scan") {
+        auto n = network("home");
+        n.bssid(mac(2));
+        storage.networks.append(std::move(n));
+        client.aps.push_back({ "home", mac(2), 11, -50, true });
+        REQUIRE(cache.connect(&client, nullptr) == 0);
+        CHECK(client.scans == 0);
+        CHECK(storage.saves == 0);
+        WifiNetworkStats st = {};
+        REQUIRE(cache.getNetworkStats("home", &st) == 0);
+        CHECK(st.directConnections == 1);
+        CHECK(st.channel == 11);
+        CHECK(st.rssi == -50);
+    }
+
+    SECTION("falls back to a scan when the last used access point is gone") {
+        auto n = network("home");
+        n.bssid(mac(2));
+        storage.networks.append(std::move(n));
+        client.aps.push_back({ "home", mac(3), 1, -60, true });
+        REQUIRE(cache.connect(&client, "home") == 0);
+        CHECK(client.attempts == std::vector<std::string>({ "home/2", "home/3" }));
+        CHECK(storage.networks.first().bssid() == mac(3));
+        WifiNetworkStats st = {};
+        REQUIRE(cache.getNetworkStats("home", &st) == 0);
+        CHECK(st.directFailures == 1);
+        CHECK(st.failures == 0);
+        CHECK(st.connections == 1);
+    }
+
+    SECTION("moves the connected network to the beginning of the list") {
+        storage.networks.append(network("home"));
+        storage.networks.append(network("office"));
+        client.aps.push_back({ "office", mac(4), 1, -40, true });
+        REQUIRE(cache.connect(&client, nullptr) == 0);
+        CHECK(ssids(storage.networks) == std::vector<std::string>({ "office", "home" }));
+        WifiNetworkStats st = {};
+        REQUIRE(cache.getNetworkStats("office", &st) == 0);
+        CHECK(st.connections == 1);
+    }
+
+    SECTION("ranks access points of networks that keep failing lower") {
+        storage.networks.append(network("home"));
+        storage.networks.append(network("office"));
+        client.aps.push_back({ "home", mac(1), 1, -50, false });
+        client.aps.push_back({ "office", mac(2), 6, -60, true });
+        REQUIRE(cache.connect(&client, nullptr) == 0);
+        CHECK(client.attempts == std::vector<std::string>({ "home/1", "office/2" }));
+        WifiNetworkStats st = {};
+        REQUIRE(cache.getNetworkStats("home", &st) == 0);
+        CHECK(st.failures == 1);
+        CHECK(st.consecutiveFailures == 1);
+        // Forget the access point, so that the next attempt scans again
+        auto n = network("office");
+        REQUIRE(cache.setNetworkConfig(std::move(n)) == 0);
+        client.attempts.clear();
+        REQUIRE(cache.connect(&client, nullptr) == 0);
+        CHECK(client.attempts == std::vector<std::string>({ "office/2" }));
+    }
+
+    SECTION("prefers the network that connects faster when the signal is equally strong") {
+        storage.networks.append(network("home"));
+        storage.networks.append(network("office"));
+        client.aps.push_back({ "home", mac(1), 1, -50, true });
+        client.aps.push_back({ "office", mac(2), 6, -50, true });
+        REQUIRE(cache.connect(&client, "office") == 0);
+        client.aps[0].bssid = mac(5); // Make the fast path fail for both networks
+        client.aps[1].bssid = mac(6);
+        client.attempts.clear();
+        REQUIRE(cache.connect(&client, nullptr) == 0);
+        CHECK(client.attempts == std::vector<std::string>({ "office/2", "office/6" }));
+    }
+
+    SECTION("fails when no configured network is available") {
+        storage.networks.append(network("home"));
+        client.aps.push_back({ "cafe", mac(1), 1, -50, true });
+        CHECK(cache.connect(&client, nullptr) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(cache.connect(&client, "office") == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(client.attempts.empty());
+    }
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "time_util.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+using namespace particle;
+
+namespace {
+
+const int64_t MAX_TIME = 0xffffffffLL; // 2106-02-07T06:28:15Z
+
+bool equal(const struct tm& a, const struct tm& b) {
+    return a.tm_sec == b.tm_sec && a.tm_min == b.tm_min && a.tm_hour == b.tm_hour && a.tm_mday == b.tm_mday &&
+            a.tm_mon == b.tm_mon && a.tm_year == b.tm_year && a.tm_wday == b.tm_wday && a.tm_yday == b.tm_yday;
+}
+
+std::string format(int64_t t, int utcOffset, const char* fmt) {
+    struct tm tm = {};
+    unixTimeToCalendar(t, &tm);
+    char buf[128] = {};
+    formatTime(tm, utcOffset, fmt, buf, sizeof(buf));
+    return buf;
+}
+
+std::string libcFormat(int64_t t, const char* fmt) {
+    const time_t tt = t;
+    struct tm tm = {};
+    gmtime_r(&tt, &tm);
+    char buf[128] = {};
+    strftime(buf, sizeof(buf), fmt, &tm);
+    return buf;
+}
+
+} // namespace
+
+TEST_CASE("unixTimeToCalendar()") {
+    SECTION("matches gmtime_r() for every hour between 1970 and 2106") {
+        std::mt19937 rand(1);
+        std::uniform_int_distribution<int> sec(0, 3599);
+        unsigned mismatches = 0;
+        unsigned roundTripErrors = 0;
+        unsigned count = 0;
+        for (int64_t t = 0; t <= MAX_TIME; t += 3600) {
+            const int64_t tt = std::min(t + sec(rand), MAX_TIME);
+            struct tm expected = {};
+            const time_t libcTime = tt;
+            gmtime_r(&libcTime, &expected);
+            struct tm actual = {};
+            unixTimeToCalendar(tt, &actual);
+            if (!equal(actual, expected)) {
+                ++mismatches;
+            }
+            if (calendarToUnixTime(actual) != tt || calendarToUnixTime(actual) != timegm(&expected)) {
+                ++roundTripErrors;
+            }
+            ++count;
+        }
+        CHECK(count > 1190000);
+        CHECK(mismatches == 0);
+        CHECK(roundTripErrors == 0);
+    }
+
+    SECTION("handles the boundaries of the range") {
+        struct tm tm = {};
+        unixTimeToCalendar(0, &tm);
+        CHECK(tm.tm_year == 70);
+        CHECK(tm.tm_mon == 0);
+        CHECK(tm.tm_mday == 1);
+        CHECK(tm.tm_wday == 4);
+        unixTimeToCalendar(MAX_TIME, &tm);
+        CHECK(tm.tm_year == 206);
+        CHECK(tm.tm_mon == 1);
+        CHECK(tm.tm_mday == 7);
+        CHECK(tm.tm_hour == 6);
+        CHECK(tm.tm_min == 28);
+        CHECK(tm.tm_sec == 15);
+        unixTimeToCalendar(-1, &tm);
+        CHECK(tm.tm_year == 69);
+        CHECK(tm.tm_mon == 11);
+        CHECK(tm.tm_mday == 31);
+        CHECK(tm.tm_hour == 23);
+        CHECK(tm.tm_wday == 3);
+        CHECK(tm.tm_yday == 364);
+    }
+}
+
+TEST_CASE("calendarToUnixTime()") {
+    SECTION("normalizes the fields that are out of range") {
+        struct tm tm = {};
+        tm.tm_year = 119;
+        tm.tm_mon = 13; // February 2020
+        tm.tm_mday = 30; // March 1st
+        tm.tm_hour = -1;
+        CHECK(calendarToUnixTime(tm) == timegm(&tm));
+        tm.tm_mon = -1; // December 2018
+        tm.tm_mday = 0;
+        tm.tm_sec = 86400;
+        CHECK(calendarToUnixTime(tm) == timegm(&tm));
+    }
+
+    SECTION("agrees with the day count of the calendar") {
+        for (int32_t y = 1970; y <= 2106; ++y) {
+            CHECK(daysFromCivil(y + 1, 1, 1) - daysFromCivil(y, 1, 1) == (isLeapYear(y) ? 366 : 365));
+        }
+    }
+}
+
+TEST_CASE("formatTime()") {
+    SECTION("matches strftime() for the supported specifiers") {
+        const char* const formats[] = { "%Y-%m-%d %H:%M:%S", "%y%j %I%p %e", "%a %A %b %h %B", "%F %T %%",
+                "%c", "%D %R", "%U %W %u" };
+        std::mt19937 rand(2);
+        std::uniform_int_distribution<int64_t> time(0, MAX_TIME);
+        unsigned mismatches = 0;
+        for (int i = 0; i < 10000; ++i) {
+            const int64_t t = time(rand);
+            for (const char* fmt: formats) {
+                if (format(t, 0, fmt) != libcFormat(t, fmt)) {
+                    ++mismatches;
+                }
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+
+    SECTION("formats the time in ISO 8601 format with the UTC offset") {
+        CHECK(format(1546345800, 0, "%Y-%m-%dT%H:%M:%S%z") == "2019-01-01T12:30:00Z");
+        CHECK(format(1546345800, 5 * 3600 + 1800, "%Y-%m-%dT%H:%M:%S%z") == "2019-01-01T12:30:00+05:30");
+        CHECK(format(1546345800, -1800, "%Y-%m-%dT%H:%M:%S%z") == "2019-01-01T12:30:00-00:30");
+        CHECK(format(MAX_TIME, -8 * 3600, "%z %H") == "-08:00 06");
+        struct tm tm = {};
+        unixTimeToCalendar(1546345800, &tm);
+        char buf[32] = {};
+        CHECK(formatTimeIso8601(tm, 3600, buf, sizeof(buf)) == 25);
+        CHECK(std::string(buf) == "2019-01-01T12:30:00+01:00");
+    }
+
+    SECTION("formats the time in the format of asctime()") {
+        std::mt19937 rand(3);
+        std::uniform_int_distribution<int64_t> time(0, MAX_TIME);
+        unsigned mismatches = 0;
+        for (int i = 0; i < 10000; ++i) {
+            const time_t t = time(rand);
+            struct tm tm = {};
+            gmtime_r(&t, &tm);
+            char expected[32] = {};
+            asctime_r(&tm, expected);
+            expected[strlen(expected) - 1] = '\0'; // Remove the newline
+            char actual[32] = {};
+            formatTimeAsctime(tm, actual, sizeof(actual));
+            if (strcmp(actual, expected) != 0) {
+                ++mismatches;
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+
+    SECTION("doesn't overflow the buffer") {
+        struct tm tm = {};
+        unixTimeToCalendar(1546345800, &tm);
+        char buf[10];
+        memset(buf, 'x', sizeof(buf));
+        CHECK(formatTimeIso8601(tm, 0, buf, 9) == 0);
+        CHECK(buf[0] == '\0');
+        CHECK(buf[9] == 'x');
+        CHECK(formatTime(tm, 0, "%Y-%m", buf, 8) == 7);
+        CHECK(std::string(buf) == "2019-01");
+        CHECK(formatTime(tm, 0, "%Y-%m", buf, 7) == 0);
+        CHECK(formatTime(tm, 0, "%c", buf, sizeof(buf)) == 0);
+        CHECK(formatTime(tm, 0, "%Y", buf, 0) == 0);
+    }
+}
+
+TEST_CASE("Time formatting benchmark") {
+    const int count = 200000;
+    const char* const fmt = "%Y-%m-%dT%H:%M:%S%z";
+    std::mt19937 rand(4);
+    std::uniform_int_distribution<int64_t> time(0, 0x7fffffff);
+    std::vector<time_t> times(count);
+    for (auto& t: times) {
+        t = time(rand);
+    }
+    size_t sum1 = 0, sum2 = 0;
+
+    // Previous implementation: localtime() and strftime() with the offset substituted for %z
+    const auto t1 = std::chrono::steady_clock::now();
+    for (const time_t t: times) {
+        struct tm tm = {};
+        localtime_r(&t, &tm);
+        char buf[50];
+        sum1 += strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    for (const time_t t: times) {
+        struct tm tm = {};
+        unixTimeToCalendar(t, &tm);
+        char buf[50];
+        sum2 += formatTime(tm, 0, fmt, buf, sizeof(buf));
+    }
+    const auto t3 = std::chrono::steady_clock::now();
+    CHECK(sum1 == sum2);
+    const double libcNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / count;
+    const double ns = std::chrono::duration<double, std::nano>(t3 - t2).count() / count;
+    WARN("ISO 8601 formatting: localtime_r() and strftime() " << libcNs << " ns, unixTimeToCalendar() and " <<
+            "formatTime() " << ns << " ns");
+}
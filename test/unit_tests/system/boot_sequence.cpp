@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_boot.h"
+
+#include "concurrent_hal.h"
+#include "timer_hal.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstring>
+
+using particle::system::BootSequence;
+using particle::system::BootStage;
+using particle::system::bootDep;
+
+// Concurrency HAL implemented on top of the standard library
+
+namespace {
+
+struct Queue {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::vector<char>> items;
+    size_t itemSize;
+};
+
+std::atomic<int> g_threadCount(0);
+
+} // namespace
+
+os_result_t os_thread_create(os_thread_t* result, const char* name, os_thread_prio_t priority, os_thread_fn_t fun,
+        void* thread_param, size_t stack_size) {
+    *result = new std::thread(fun, thread_param);
+    ++g_threadCount;
+    return 0;
+}
+
+os_result_t os_thread_join(os_thread_t thread) {
+    static_cast<std::thread*>(thread)->join();
+    return 0;
+}
+
+os_result_t os_thread_exit(os_thread_t thread) {
+    return 0; // The thread function returns right after this call
+}
+
+os_result_t os_thread_cleanup(os_thread_t thread) {
+    delete static_cast<std::thread*>(thread);
+    return 0;
+}
+
+int os_queue_create(os_queue_t* queue, size_t item_size, size_t item_count, void* reserved) {
+    const auto q = new Queue();
+    q->itemSize = item_size;
+    *queue = q;
+    return 0;
+}
+
+int os_queue_put(os_queue_t queue, const void* item, system_tick_t delay, void* reserved) {
+    const auto q = static_cast<Queue*>(queue);
+    std::lock_guard<std::mutex> lock(q->mutex);
+    q->items.emplace_back((const char*)item, (const char*)item + q->itemSize);
+    q->cond.notify_all();
+    return 0;
+}
+
+int os_queue_take(os_queue_t queue, void* item, system_tick_t delay, void* reserved) {
+    const auto q = static_cast<Queue*>(queue);
+    std::unique_lock<std::mutex> lock(q->mutex);
+    if (delay == CONCURRENT_WAIT_FOREVER) {
+        q->cond.wait(lock, [q]() { return !q->items.empty(); });
+    } else if (!q->cond.wait_for(lock, std::chrono::milliseconds(delay), [q]() { return !q->items.empty(); })) {
+        return 1;
+    }
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    return 0;
+}
+
+int os_queue_destroy(os_queue_t queue, void* reserved) {
+    delete static_cast<Queue*>(queue);
+    return 0;
+}
+
+system_tick_t HAL_Timer_Get_Micro_Seconds() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+namespace {
+
+// State shared by the stages
+std::mutex g_mutex;
+std::condition_variable g_cond;
+std::string g_order;
+std::vector<std::thread::id> g_threads;
+std::thread::id g_mainThread;
+unsigned g_running = 0;
+unsigned g_maxRunning = 0;
+unsigned g_workersRunning = 0;
+unsigned g_maxWorkersRunning = 0;
+bool g_released = false;
+unsigned g_waitTime = 0; // Milliseconds a stage waits for another stage to start
+
+void reset() {
+    g_order.clear();
+    g_threads.assign(8, std::thread::id());
+    g_mainThread = std::this_thread::get_id();
+    g_running = 0;
+    g_maxRunning = 0;
+    g_workersRunning = 0;
+    g_maxWorkersRunning = 0;
+    g_released = false;
+    g_waitTime = 5000; // Long enough for the workers to start on a loaded machine
+    g_threadCount = 0;
+}
+
+// Records the stage and waits until another stage runs at the same time, or the wait time expires.
+// Once two stages have overlapped, the stages don't wait anymore
+template<int index>
+void stage() {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    g_order += 'A' + index;
+    g_threads[index] = std::this_thread::get_id();
+    g_maxRunning = std::max(g_maxRunning, ++g_running);
+    const bool worker = std::this_thread::get_id() != g_mainThread;
+    if (worker) {
+        g_maxWorkersRunning = std::max(g_maxWorkersRunning, ++g_workersRunning);
+    }
+    if (g_running > 1) {
+        g_released = true;
+        g_cond.notify_all();
+    }
+    g_cond.wait_for(lock, std::chrono::milliseconds(g_waitTime), []() { return g_released; });
+    --g_running;
+    if (worker) {
+        --g_workersRunning;
+    }
+}
+
+void sleepingStage() {
+    g_order += 'S';
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+} // namespace
+
+TEST_CASE("BootSequence::run() without workers") {
+    reset();
+    g_waitTime = 0;
+
+    SECTION("runs the stages in the order of the table when there are no dependencies") {
+        const BootStage stages[] = {
+            { "c", stage<2>, 0, 0 },
+            { "a", stage<0>, 0, 0 },
+            { "b", stage<1>, 0, 0 }
+        };
+        BootSequence boot(stages, 3);
+        REQUIRE(boot.run(0) == 0);
+        CHECK(g_order == "CAB");
+        CHECK(g_threadCount == 0);
+    }
+
+    SECTION("runs the stages after their dependencies") {
+        const BootStage stages[] = {
+            { "a", stage<0>, bootDep(2), 0 },
+            { "b", stage<1>, bootDep(0), 0 },
+            { "c", stage<2>, 0, BootStage::MAIN_THREAD }
+        };
+        BootSequence boot(stages, 3);
+        REQUIRE(boot.run(0) == 0);
+        CHECK(g_order == "CAB");
+    }
+
+    SECTION("records the timestamps of the stages") {
+        const BootStage stages[] = {
+            { "a", stage<0>, 0, 0 },
+            { "s", sleepingStage, bootDep(0), 0 },
+            { "c", stage<2>, bootDep(1), 0 }
+        };
+        BootSequence boot(stages, 3);
+        REQUIRE(boot.run(0) == 0);
+        CHECK(g_order == "ASC");
+        CHECK(boot.timing(1).end - boot.timing(1).start >= 1000);
+        CHECK(boot.timing(1).start >= boot.timing(0).end);
+        CHECK(boot.timing(2).start >= boot.timing(1).end);
+        CHECK(boot.endTime() >= boot.timing(2).end);
+    }
+
+    SECTION("reports circular dependencies") {
+        const BootStage stages[] = {
+            { "a", stage<0>, bootDep(1), 0 },
+            { "b", stage<1>, bootDep(0), 0 },
+            { "c", stage<2>, 0, 0 }
+        };
+        BootSequence boot(stages, 3);
+        CHECK(boot.run(0) != 0);
+        CHECK(g_order == "C");
+    }
+
+    SECTION("rejects too many stages") {
+        BootStage stages[BootSequence::MAX_STAGES + 1] = {};
+        BootSequence boot(stages, BootSequence::MAX_STAGES + 1);
+        CHECK(boot.run(0) != 0);
+    }
+}
+
+TEST_CASE("BootSequence::run() with workers") {
+    reset();
+
+    SECTION("runs independent stages concurrently on worker threads") {
+        const BootStage stages[] = {
+            { "a", stage<0>, 0, 0 },
+            { "b", stage<1>, 0, 0 },
+            { "c", stage<2>, bootDep(0) | bootDep(1), BootStage::MAIN_THREAD }
+        };
+        BootSequence boot(stages, 3);
+        REQUIRE(boot.run(2) == 0);
+        CHECK(g_maxRunning == 2);
+        CHECK(g_threadCount == 2);
+        CHECK(g_threads[0] != std::this_thread::get_id());
+        CHECK(g_threads[1] != std::this_thread::get_id());
+        CHECK(g_threads[0] != g_threads[1]);
+        // The main thread stage waits for the workers
+        CHECK(g_threads[2] == std::this_thread::get_id());
+        CHECK(g_order.back() == 'C');
+        CHECK(boot.timing(2).start >= boot.timing(0).end);
+        CHECK(boot.timing(2).start >= boot.timing(1).end);
+        CHECK(boot.endTime() >= boot.timing(2).end);
+    }
+
+    SECTION("runs main thread stages alongside the workers") {
+        const BootStage stages[] = {
+            { "a", stage<0>, 0, 0 },
+            { "b", stage<1>, 0, BootStage::MAIN_THREAD }
+        };
+        BootSequence boot(stages, 2);
+        REQUIRE(boot.run(2) == 0);
+        CHECK(g_maxRunning == 2);
+        CHECK(g_threads[0] != std::this_thread::get_id());
+        CHECK(g_threads[1] == std::this_thread::get_id());
+    }
+
+    SECTION("runs the remaining stages on the main thread when the workers are busy") {
+        const BootStage stages[] = {
+            { "a", stage<0>, 0, 0 },
+            { "b", stage<1>, 0, 0 },
+            { "c", stage<2>, 0, 0 },
+            { "d", stage<3>, 0, 0 }
+        };
+        BootSequence boot(stages, 4);
+        REQUIRE(boot.run(1) == 0);
+        CHECK(g_maxWorkersRunning == 1);
+        CHECK(g_maxRunning == 2);
+        CHECK(g_order.size() == 4);
+    }
+
+    SECTION("keeps the order of a chain of stages") {
+        const BootStage stages[] = {
+            { "a", stage<0>, 0, BootStage::MAIN_THREAD },
+            { "b", stage<1>, bootDep(0), 0 },
+            { "c", stage<2>, bootDep(1), BootStage::MAIN_THREAD },
+            { "d", stage<3>, bootDep(2), 0 }
+        };
+        g_waitTime = 10;
+        BootSequence boot(stages, 4);
+        REQUIRE(boot.run(2) == 0);
+        CHECK(g_order == "ABCD");
+        CHECK(g_maxRunning == 1);
+        for (size_t i = 1; i < 4; ++i) {
+            CHECK(boot.timing(i).start >= boot.timing(i - 1).end);
+        }
+    }
+
+    SECTION("reports circular dependencies") {
+        const BootStage stages[] = {
+            { "a", stage<0>, bootDep(1), 0 },
+            { "b", stage<1>, bootDep(0), 0 },
+            { "c", stage<2>, 0, 0 }
+        };
+        g_waitTime = 10;
+        BootSequence boot(stages, 3);
+        CHECK(boot.run(2) != 0);
+        CHECK(g_order == "C");
+    }
+}
@@ -0,0 +1,160 @@
+#include "spark_wiring_adc_stream.h"
+
+#include "catch2/catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace particle;
+using detail::AdcBlockPipeline;
+
+// Produces a synthetic signal the way the ADC DMA does: two buffers are owned by the producer,
+// and a full buffer is exchanged for a free one
+class SyntheticSource {
+public:
+    SyntheticSource(AdcBlockPipeline* pipeline, size_t channels) :
+            pipeline_(pipeline),
+            channels_(channels),
+            tick_(0),
+            time_(0) {
+        current_ = pipeline->acquire();
+        next_ = pipeline->acquire();
+    }
+
+    // Fills the current buffer and hands it over to the pipeline
+    void fill() {
+        const size_t samples = pipeline_->blockSamples();
+        for (size_t i = 0; i < samples; i += channels_) {
+            for (size_t ch = 0; ch < channels_; ++ch) {
+                current_[i + ch] = sample(tick_, ch);
+            }
+            ++tick_;
+        }
+        time_ += 1000;
+        int16_t* const buf = pipeline_->bufferFilled(current_, time_);
+        current_ = next_;
+        next_ = buf;
+    }
+
+    static int16_t sample(uint32_t tick, size_t channel) {
+        return (int16_t)(2048 + 2000 * std::sin(tick * 0.01 * (channel + 1)));
+    }
+
+private:
+    AdcBlockPipeline* pipeline_;
+    size_t channels_;
+    int16_t* current_;
+    int16_t* next_;
+    uint32_t tick_;
+    uint32_t time_;
+};
+
+} // namespace
+
+TEST_CASE("AdcBlockPipeline") {
+    AdcBlockPipeline pipeline;
+
+    SECTION("validates the configuration") {
+        CHECK(pipeline.init(0, 16, 4) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(pipeline.init(2, 16, 2) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(pipeline.init(2, 16, AdcBlockPipeline::MAX_BLOCKS + 1) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(pipeline.init(2, 16, 4) == 0);
+    }
+
+    SECTION("delivers interleaved samples in order") {
+        REQUIRE(pipeline.init(3, 16, 4) == 0);
+        SyntheticSource src(&pipeline, 3);
+        uint32_t tick = 0;
+        for (uint32_t n = 0; n < 10; ++n) {
+            src.fill();
+            AdcBlock block;
+            REQUIRE(pipeline.take(&block));
+            CHECK(block.sequence == n);
+            CHECK(block.timestamp == (n + 1) * 1000);
+            CHECK(block.frames == 16);
+            CHECK(block.channels == 3);
+            for (size_t i = 0; i < block.frames; ++i, ++tick) {
+                for (size_t ch = 0; ch < 3; ++ch) {
+                    REQUIRE(block.samples[i * 3 + ch] == SyntheticSource::sample(tick, ch));
+                }
+            }
+            pipeline.release(block);
+            CHECK(!pipeline.take(&block));
+        }
+        CHECK(pipeline.stats().blocks == 10);
+        CHECK(pipeline.stats().overruns == 0);
+    }
+
+    SECTION("drops blocks when the consumer doesn't release buffers") {
+        REQUIRE(pipeline.init(1, 8, 4) == 0);
+        SyntheticSource src(&pipeline, 1);
+        // Two spare buffers can be queued
+        src.fill();
+        src.fill();
+        CHECK(pipeline.queued() == 2);
+        src.fill();
+        src.fill();
+        CHECK(pipeline.stats().overruns == 2);
+        CHECK(pipeline.stats().maxQueued == 2);
+        AdcBlock a;
+        AdcBlock b;
+        REQUIRE(pipeline.take(&a));
+        REQUIRE(pipeline.take(&b));
+        CHECK(a.sequence == 0);
+        CHECK(b.sequence == 1);
+        pipeline.release(a);
+        pipeline.release(b);
+        // The gap in the sequence numbers reveals the dropped blocks
+        src.fill();
+        AdcBlock c;
+        REQUIRE(pipeline.take(&c));
+        CHECK(c.sequence == 4);
+        pipeline.release(c);
+    }
+}
+
+TEST_CASE("AdcBlockPipeline benchmark") {
+    using namespace std::chrono;
+    const size_t channels = 4;
+    const size_t frames = 256;
+    const uint32_t blocks = 20000;
+    AdcBlockPipeline pipeline;
+    REQUIRE(pipeline.init(channels, frames, 6) == 0);
+    std::atomic<bool> done(false);
+    int64_t sum = 0;
+    uint32_t received = 0;
+    std::thread consumer([&]() {
+        AdcBlock block;
+        while (!done.load() || pipeline.queued()) {
+            if (!pipeline.take(&block)) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < block.frames * block.channels; ++i) {
+                sum += block.samples[i];
+            }
+            ++received;
+            pipeline.release(block);
+        }
+    });
+    const auto t1 = high_resolution_clock::now();
+    SyntheticSource src(&pipeline, channels);
+    for (uint32_t i = 0; i < blocks; ++i) {
+        src.fill();
+    }
+    done = true;
+    consumer.join();
+    const auto t2 = high_resolution_clock::now();
+    const double sec = duration_cast<duration<double>>(t2 - t1).count();
+    const AdcStreamStats st = pipeline.stats();
+    CHECK(received + st.overruns == blocks);
+    CHECK(sum != 0);
+    // The producer is not paced, so it outruns the consumer and the excess blocks are dropped
+    WARN("Unpaced synthetic acquisition: " << (uint64_t)(blocks * frames * channels / sec) << " samples/s, "
+            << received << " blocks consumed, " << st.overruns << " dropped");
+}
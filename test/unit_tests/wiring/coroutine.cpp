@@ -0,0 +1,465 @@
+#include "spark_wiring_coroutine.h"
+
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+
+using namespace particle;
+
+// Application event queue and clock
+class Context {
+public:
+    typedef std::function<void()> Event;
+
+    static void processApplicationEvents() {
+        auto& q = instance()->events_;
+        while (!q.empty()) {
+            Event event = q.front();
+            q.pop_front();
+            event();
+        }
+    }
+
+    static bool invokeApplicationCallback(void (*callback)(void* data), void* data) {
+        instance()->events_.push_back([=]() {
+            callback(data);
+        });
+        return true;
+    }
+
+    static bool isApplicationThreadCurrent() {
+        return true;
+    }
+
+    static system_tick_t now() {
+        return instance()->now_;
+    }
+
+    static void advance(system_tick_t ms) {
+        instance()->now_ += ms;
+    }
+
+    static size_t pendingEvents() {
+        return instance()->events_.size();
+    }
+
+    static void reset() {
+        instance()->events_.clear();
+    }
+
+    static Context* instance() {
+        static Context ctx;
+        return &ctx;
+    }
+
+private:
+    std::deque<Event> events_;
+    system_tick_t now_ = 1000;
+};
+
+template<typename ResultT>
+using TestFuture = Future<ResultT, Context>;
+
+template<typename ResultT>
+using TestPromise = Promise<ResultT, Context>;
+
+class Log {
+public:
+    void add(const std::string& s) {
+        log_ += s;
+    }
+
+    std::string take() {
+        std::string s;
+        s.swap(log_);
+        return s;
+    }
+
+private:
+    std::string log_;
+};
+
+class YieldTask: public CoTask {
+public:
+    YieldTask(Log& log, const char* name, int count) :
+            log_(log),
+            name_(name),
+            count_(count),
+            i_(0) {
+    }
+
+protected:
+    void run() override {
+        CO_BEGIN();
+        for (i_ = 0; i_ < count_; ++i_) {
+            log_.add(name_);
+            CO_YIELD();
+        }
+        CO_END();
+    }
+
+private:
+    Log& log_;
+    const char* name_;
+    int count_;
+    int i_;
+};
+
+class SleepTask: public CoTask {
+public:
+    explicit SleepTask(Log& log) :
+            log_(log) {
+    }
+
+protected:
+    void run() override {
+        CO_BEGIN();
+        log_.add("a");
+        CO_SLEEP(100);
+        log_.add("b");
+        CO_END();
+    }
+
+private:
+    Log& log_;
+};
+
+class FutureTask: public CoTask {
+public:
+    FutureTask(Log& log, TestFuture<int> f) :
+            log_(log),
+            f_(std::move(f)) {
+    }
+
+protected:
+    void run() override {
+        CO_BEGIN();
+        log_.add("wait");
+        CO_AWAIT(f_);
+        log_.add(f_.isSucceeded() ? std::to_string(f_.result()) : "error");
+        CO_END();
+    }
+
+private:
+    Log& log_;
+    TestFuture<int> f_;
+};
+
+class TwoFuturesTask: public CoTask {
+public:
+    TwoFuturesTask(Log& log, TestFuture<int> f1, TestFuture<int> f2) :
+            log_(log),
+            f1_(std::move(f1)),
+            f2_(std::move(f2)) {
+    }
+
+protected:
+    void run() override {
+        CO_BEGIN();
+        CO_AWAIT(f1_);
+        log_.add(std::to_string(f1_.result()));
+        CO_AWAIT(f2_);
+        log_.add(std::to_string(f2_.result()));
+        CO_END();
+    }
+
+private:
+    Log& log_;
+    TestFuture<int> f1_;
+    TestFuture<int> f2_;
+};
+
+class ConditionTask: public CoTask {
+public:
+    explicit ConditionTask(const bool& flag) :
+            flag_(flag) {
+    }
+
+protected:
+    void run() override {
+        CO_BEGIN();
+        CO_AWAIT(flag_);
+        CO_END();
+    }
+
+private:
+    const bool& flag_;
+};
+
+class PinTask: public CoTask {
+public:
+    explicit PinTask(CoPinEvent& event) :
+            event_(event),
+            edges_(0) {
+    }
+
+    int edges() const {
+        return edges_;
+    }
+
+protected:
+    void run() override {
+        CO_BEGIN();
+        for (;;) {
+            CO_AWAIT(event_);
+            ++edges_;
+        }
+        CO_END();
+    }
+
+private:
+    CoPinEvent& event_;
+    int edges_;
+};
+
+class Client {
+public:
+    int available() {
+        return avail;
+    }
+
+    bool connected() {
+        return conn;
+    }
+
+    int avail = 0;
+    bool conn = true;
+};
+
+class ReadTask: public CoTask {
+public:
+    explicit ReadTask(Client& client) :
+            client_(client) {
+    }
+
+protected:
+    void run() override {
+        CO_BEGIN();
+        CO_AWAIT(coReadable(client_));
+        CO_END();
+    }
+
+private:
+    Client& client_;
+};
+
+class PingPong {
+public:
+    explicit PingPong(int count) :
+            count_(count) {
+    }
+
+    void run() {
+        std::thread t([this]() {
+            for (int i = 0; i < count_; ++i) {
+                std::unique_lock<std::mutex> lock(m_);
+                cv_.wait(lock, [this]() { return turn_ == 1; });
+                turn_ = 0;
+                cv_.notify_one();
+            }
+        });
+        for (int i = 0; i < count_; ++i) {
+            std::unique_lock<std::mutex> lock(m_);
+            turn_ = 1;
+            cv_.notify_one();
+            cv_.wait(lock, [this]() { return turn_ == 0; });
+        }
+        t.join();
+    }
+
+private:
+    std::mutex m_;
+    std::condition_variable cv_;
+    int count_;
+    int turn_ = 0;
+};
+
+} // namespace
+
+TEST_CASE("CoScheduler") {
+    Log log;
+    CoScheduler sched(Context::invokeApplicationCallback, Context::now);
+    Context::reset();
+
+    SECTION("runs tasks until they complete") {
+        YieldTask t1(log, "1", 3);
+        YieldTask t2(log, "2", 2);
+        sched.start(&t1);
+        sched.start(&t2);
+        CHECK(sched.taskCount() == 2);
+        while (sched.taskCount() > 0) {
+            sched.process();
+        }
+        CHECK(log.take() == "21211");
+        CHECK(t1.isDone());
+        CHECK(t2.isDone());
+        CHECK(!t1.isStarted());
+    }
+
+    SECTION("resumes a sleeping task when its deadline expires") {
+        SleepTask t(log);
+        sched.start(&t);
+        sched.process();
+        CHECK(log.take() == "a");
+        Context::advance(99);
+        CHECK(sched.process() == 0);
+        Context::advance(1);
+        CHECK(sched.process() == 1);
+        CHECK(log.take() == "b");
+        CHECK(t.isDone());
+    }
+
+    SECTION("resumes a task waiting on a future via the application event queue") {
+        TestPromise<int> p;
+        FutureTask t(log, p.future());
+        sched.start(&t);
+        sched.process();
+        CHECK(log.take() == "wait");
+        CHECK(sched.process() == 0); // The task is not polled
+        p.setResult(42);
+        CHECK(Context::pendingEvents() == 1);
+        Context::processApplicationEvents();
+        CHECK(log.take() == "42");
+        CHECK(t.isDone());
+    }
+
+    SECTION("resumes a task when a future fails") {
+        TestPromise<int> p;
+        FutureTask t(log, p.future());
+        sched.start(&t);
+        sched.process();
+        p.setError(Error::TIMEOUT);
+        Context::processApplicationEvents();
+        CHECK(log.take() == "waiterror");
+    }
+
+    SECTION("subscribes to each awaited future once") {
+        TestPromise<int> p1, p2;
+        TwoFuturesTask t(log, p1.future(), p2.future());
+        sched.start(&t);
+        sched.process();
+        // Waking up the task for another reason doesn't subscribe to the future again
+        t.wake();
+        CHECK(sched.process() == 1);
+        p1.setResult(1);
+        Context::processApplicationEvents();
+        CHECK(log.take() == "1");
+        t.wake();
+        CHECK(sched.process() == 1);
+        p2.setResult(2);
+        Context::processApplicationEvents();
+        CHECK(log.take() == "2");
+        CHECK(t.isDone());
+    }
+
+    SECTION("subscribes to the future again when a stopped task is restarted") {
+        TestPromise<int> p1, p2;
+        TwoFuturesTask t(log, p1.future(), p2.future());
+        sched.start(&t);
+        sched.process();
+        sched.stop(&t);
+        sched.start(&t);
+        sched.process();
+        p1.setResult(1);
+        Context::processApplicationEvents();
+        CHECK(log.take() == "1");
+        p2.setResult(2);
+        Context::processApplicationEvents();
+        CHECK(log.take() == "2");
+        CHECK(t.isDone());
+    }
+
+    SECTION("doesn't wake a task that was destroyed while awaiting a future") {
+        TestPromise<int> p;
+        {
+            FutureTask t(log, p.future());
+            sched.start(&t);
+            sched.process();
+        }
+        CHECK(log.take() == "wait");
+        p.setResult(1);
+        Context::processApplicationEvents();
+        CHECK(sched.taskCount() == 0);
+        CHECK(sched.process() == 0);
+    }
+
+    SECTION("polls a task waiting on a condition") {
+        bool flag = false;
+        ConditionTask t(flag);
+        sched.start(&t);
+        CHECK(sched.process() == 1);
+        CHECK(sched.process() == 1);
+        flag = true;
+        sched.process();
+        CHECK(t.isDone());
+    }
+
+    SECTION("resumes a task waiting on a pin event once per edge") {
+        CoPinEvent event;
+        PinTask t(event);
+        sched.start(&t);
+        sched.process();
+        CHECK(sched.process() == 0);
+        event.notify();
+        event.notify();
+        Context::processApplicationEvents();
+        CHECK(t.edges() == 2);
+        CHECK(sched.process() == 0);
+        sched.stop(&t);
+    }
+
+    SECTION("polls a task waiting for socket data") {
+        Client c;
+        ReadTask t(c);
+        sched.start(&t);
+        sched.process();
+        CHECK(!t.isDone());
+        c.avail = 10;
+        sched.process();
+        CHECK(t.isDone());
+    }
+
+    SECTION("removes a destroyed task") {
+        {
+            YieldTask t(log, "1", 10);
+            sched.start(&t);
+            sched.process();
+        }
+        CHECK(sched.taskCount() == 0);
+        CHECK(sched.process() == 0);
+    }
+}
+
+TEST_CASE("CoTask benchmark") {
+    using namespace std::chrono;
+    const int switches = 100000;
+    Log log;
+    CoScheduler sched(Context::invokeApplicationCallback, Context::now);
+    YieldTask t1(log, "", switches / 2);
+    YieldTask t2(log, "", switches / 2);
+    sched.start(&t1);
+    sched.start(&t2);
+    auto t = steady_clock::now();
+    while (sched.taskCount() > 0) {
+        sched.process();
+    }
+    const auto taskTime = duration_cast<nanoseconds>(steady_clock::now() - t).count();
+    PingPong pp(switches / 2);
+    t = steady_clock::now();
+    pp.run();
+    const auto threadTime = duration_cast<nanoseconds>(steady_clock::now() - t).count();
+    WARN("Task switch: " << taskTime / switches << " ns, thread switch: " << threadTime / switches << " ns");
+    // The smallest thread stack used by the system on Gen 3 devices is 1 KB
+    WARN("Task size: " << sizeof(YieldTask) << " bytes");
+    if (taskTime >= threadTime) {
+        WARN("Task switch is not faster than thread switch");
+    }
+    CHECK(sizeof(YieldTask) < 128);
+}
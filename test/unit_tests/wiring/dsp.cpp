@@ -0,0 +1,377 @@
+#include "spark_wiring_dsp.h"
+
+#include "system_error.h"
+
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+using namespace particle;
+using namespace particle::dsp;
+
+const double PI = 3.14159265358979323846;
+
+std::vector<int16_t> randomQ15(size_t count, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> dist(INT16_MIN, INT16_MAX);
+    std::vector<int16_t> v(count);
+    for (auto& x: v) {
+        x = (int16_t)dist(gen);
+    }
+    return v;
+}
+
+std::vector<float> sine(size_t count, double cyclesPerSample, double amplitude = 1.0) {
+    std::vector<float> v(count);
+    for (size_t i = 0; i < count; ++i) {
+        v[i] = (float)(amplitude * std::sin(2 * PI * cyclesPerSample * i));
+    }
+    return v;
+}
+
+// Reference DFT of a real signal
+void dft(const std::vector<float>& src, std::vector<double>* re, std::vector<double>* im) {
+    const size_t n = src.size();
+    re->assign(n / 2 + 1, 0.0);
+    im->assign(n / 2 + 1, 0.0);
+    for (size_t k = 0; k <= n / 2; ++k) {
+        for (size_t i = 0; i < n; ++i) {
+            const double a = -2 * PI * k * i / n;
+            (*re)[k] += src[i] * std::cos(a);
+            (*im)[k] += src[i] * std::sin(a);
+        }
+    }
+}
+
+template<typename F>
+double measure(F fn, unsigned iterations) {
+    const auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i) {
+        fn();
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t2 - t1).count() / iterations;
+}
+
+} // namespace
+
+TEST_CASE("DSP kernels") {
+    SECTION("backend kernels match the scalar implementations") {
+        // Odd sizes exercise the tail handling of the vectorized loops
+        for (size_t n: { 0, 1, 7, 8, 9, 63, 256, 1001 }) {
+            const auto a = randomQ15(n, 1);
+            const auto b = randomQ15(n, 2);
+            CHECK(detail::dot(a.data(), b.data(), n) == detail::dotScalar(a.data(), b.data(), n));
+            CHECK(detail::sumSquares(a.data(), n) == detail::sumSquaresScalar(a.data(), n));
+            CHECK(detail::peak(a.data(), n) == detail::peakScalar(a.data(), n));
+            std::vector<float> fa(n), fb(n);
+            for (size_t i = 0; i < n; ++i) {
+                fa[i] = a[i] / 32768.0f;
+                fb[i] = b[i] / 32768.0f;
+            }
+            CHECK(detail::dot(fa.data(), fb.data(), n) == Approx(detail::dotScalar(fa.data(), fb.data(), n)).margin(1e-3));
+        }
+    }
+
+    SECTION("dot product of the most negative values doesn't overflow") {
+        // Adjacent (-1.0 * -1.0) products make a pairwise sum of 2^31
+        const std::vector<int16_t> a(19, INT16_MIN);
+        std::vector<int16_t> b(a);
+        b[5] = 1000;
+        const int64_t square = (int64_t)INT16_MIN * INT16_MIN;
+        CHECK(detail::dot(a.data(), a.data(), a.size()) == 19 * square);
+        CHECK(detail::dot(a.data(), b.data(), a.size()) == 18 * square + 1000 * INT16_MIN);
+        CHECK(detail::sumSquares(a.data(), a.size()) == 19 * square);
+    }
+
+    SECTION("peak saturates the most negative value") {
+        const int16_t v[] = { 100, -200, INT16_MIN, 300, 0, 0, 0, 0, 5 };
+        CHECK(detail::peak(v, 9) == INT16_MAX);
+        CHECK(detail::peakScalar(v, 9) == INT16_MAX);
+    }
+}
+
+TEST_CASE("DSP conversions and statistics") {
+    SECTION("conversions saturate") {
+        CHECK(toQ15(0.5f).value() == 16384);
+        CHECK(toQ15(1.0f).value() == INT16_MAX);
+        CHECK(toQ15(-1.0f).value() == INT16_MIN);
+        CHECK(toQ15(-3.0f).value() == INT16_MIN);
+        CHECK(toQ31(0.25f).value() == (1 << 29));
+        CHECK(toQ31(2.0f).value() == INT32_MAX);
+        const float src[] = { -0.5f, 0.0f, 0.75f };
+        Q31 q[3];
+        float f[3];
+        toQ31(src, q, 3);
+        toFloat(q, f, 3);
+        for (size_t i = 0; i < 3; ++i) {
+            CHECK(f[i] == Approx(src[i]));
+        }
+    }
+
+    SECTION("rms of a sine wave") {
+        const auto s = sine(1000, 0.01, 0.5);
+        const float expected = 0.5f / std::sqrt(2.0f);
+        CHECK(rms(s.data(), s.size()) == Approx(expected).epsilon(1e-3));
+        std::vector<Q15> q15(s.size());
+        std::vector<Q31> q31(s.size());
+        toQ15(s.data(), q15.data(), s.size());
+        toQ31(s.data(), q31.data(), s.size());
+        CHECK(rms(q15.data(), q15.size()).toFloat() == Approx(expected).epsilon(1e-3));
+        CHECK(rms(q31.data(), q31.size()).value() / 2147483648.0 == Approx(expected).epsilon(1e-3));
+    }
+
+    SECTION("peak and its index") {
+        const float src[] = { 0.1f, -0.7f, 0.3f, 0.7f };
+        size_t index = 0;
+        CHECK(peak(src, 4, &index) == Approx(0.7f));
+        CHECK(index == 1);
+        Q15 q[4];
+        toQ15(src, q, 4);
+        CHECK(peak(q, 4, &index).value() == toQ15(0.7f).value());
+        CHECK(index == 1);
+        Q31 q31[4];
+        toQ31(src, q31, 4);
+        CHECK(peak(q31, 4, &index).value() == toQ31(0.7f).value());
+        CHECK(index == 1);
+    }
+}
+
+TEST_CASE("FirFilter") {
+    const float coeffs[] = { 0.5f, 0.25f, -0.125f, 0.0625f, 0.03125f };
+
+    SECTION("validates arguments") {
+        FirFilter<float> fir;
+        CHECK(fir.init(nullptr, 5) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(fir.init(coeffs, 0) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+
+    SECTION("impulse response equals the coefficients") {
+        FirFilter<float> fir;
+        REQUIRE(fir.init(coeffs, 5) == 0);
+        float in[8] = { 1.0f };
+        float out[8];
+        fir.process(in, out, 8);
+        for (size_t i = 0; i < 5; ++i) {
+            CHECK(out[i] == Approx(coeffs[i]));
+        }
+        CHECK(out[5] == 0.0f);
+        CHECK(out[7] == 0.0f);
+    }
+
+    SECTION("fixed point filters follow the floating point one") {
+        const auto in = sine(300, 0.02, 0.8);
+        std::vector<float> ref(in.size());
+        FirFilter<float> fir;
+        REQUIRE(fir.init(coeffs, 5) == 0);
+        // Process in chunks to check that the state is carried over
+        fir.process(in.data(), ref.data(), 100);
+        fir.process(in.data() + 100, ref.data() + 100, 200);
+
+        Q15 c15[5];
+        toQ15(coeffs, c15, 5);
+        std::vector<Q15> in15(in.size()), out15(in.size());
+        toQ15(in.data(), in15.data(), in.size());
+        FirFilter<Q15> fir15;
+        REQUIRE(fir15.init(c15, 5) == 0);
+        fir15.process(in15.data(), out15.data(), in15.size());
+
+        Q31 c31[5];
+        toQ31(coeffs, c31, 5);
+        std::vector<Q31> in31(in.size()), out31(in.size());
+        toQ31(in.data(), in31.data(), in.size());
+        FirFilter<Q31> fir31;
+        REQUIRE(fir31.init(c31, 5) == 0);
+        fir31.process(in31.data(), out31.data(), in31.size());
+
+        std::vector<float> f31(in.size());
+        toFloat(out31.data(), f31.data(), f31.size());
+        for (size_t i = 0; i < in.size(); ++i) {
+            CHECK(out15[i].toFloat() == Approx(ref[i]).margin(5e-4));
+            CHECK(f31[i] == Approx(ref[i]).margin(1e-6));
+        }
+    }
+
+    SECTION("output saturates") {
+        Q15 c[2] = { toQ15(0.9f), toQ15(0.9f) };
+        Q15 in[2] = { toQ15(0.9f), toQ15(0.9f) };
+        Q15 out[2];
+        FirFilter<Q15> fir;
+        REQUIRE(fir.init(c, 2) == 0);
+        fir.process(in, out, 2);
+        CHECK(out[1].value() == INT16_MAX);
+    }
+}
+
+TEST_CASE("FirDecimator") {
+    const float coeffs[] = { 0.25f, 0.25f, 0.25f, 0.25f };
+    FirDecimator<float> dec;
+    CHECK(dec.init(coeffs, 4, 0) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    REQUIRE(dec.init(coeffs, 4, 4) == 0);
+    std::vector<float> in(22);
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i] = (float)i;
+    }
+    float out[8];
+    size_t n = dec.process(in.data(), out, 10);
+    REQUIRE(n == 2);
+    CHECK(out[0] == Approx((0 + 1 + 2 + 3) / 4.0));
+    CHECK(out[1] == Approx((4 + 5 + 6 + 7) / 4.0));
+    // The decimation phase is carried over between calls
+    n = dec.process(in.data() + 10, out, 12);
+    REQUIRE(n == 3);
+    CHECK(out[0] == Approx((8 + 9 + 10 + 11) / 4.0));
+    CHECK(out[2] == Approx((16 + 17 + 18 + 19) / 4.0));
+}
+
+TEST_CASE("BiquadCascade") {
+    // Two low-pass sections, fs = 1000 Hz, fc = 50 Hz, Q = 0.707. The a1 coefficient is larger
+    // than 1.0, so the fixed point versions use a post shift
+    const float coeffs[] = {
+        0.020083f, 0.040167f, 0.020083f, -1.561018f, 0.641352f,
+        0.020083f, 0.040167f, 0.020083f, -1.561018f, 0.641352f
+    };
+    const unsigned postShift = 1;
+
+    SECTION("validates arguments") {
+        BiquadCascade<Q15> iir;
+        CHECK(iir.init(nullptr, 2) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        Q15 c[5];
+        CHECK(iir.init(c, 0) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(iir.init(c, 1, 15) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+
+    SECTION("matches a double precision reference") {
+        const auto in = sine(500, 0.01, 0.5);
+        // Direct form I reference
+        std::vector<double> ref(in.begin(), in.end());
+        for (size_t s = 0; s < 2; ++s) {
+            const float* c = coeffs + s * 5;
+            double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+            for (auto& v: ref) {
+                const double y = c[0] * v + c[1] * x1 + c[2] * x2 - c[3] * y1 - c[4] * y2;
+                x2 = x1;
+                x1 = v;
+                y2 = y1;
+                y1 = y;
+                v = y;
+            }
+        }
+
+        BiquadCascade<float> iir;
+        REQUIRE(iir.init(coeffs, 2) == 0);
+        CHECK(iir.stages() == 2);
+        std::vector<float> out(in.size());
+        iir.process(in.data(), out.data(), in.size());
+
+        float scaled[10];
+        for (size_t i = 0; i < 10; ++i) {
+            scaled[i] = coeffs[i] / (1 << postShift);
+        }
+        Q15 c15[10];
+        toQ15(scaled, c15, 10);
+        std::vector<Q15> in15(in.size()), out15(in.size());
+        toQ15(in.data(), in15.data(), in.size());
+        BiquadCascade<Q15> iir15;
+        REQUIRE(iir15.init(c15, 2, postShift) == 0);
+        iir15.process(in15.data(), out15.data(), in15.size());
+
+        Q31 c31[10];
+        toQ31(scaled, c31, 10);
+        std::vector<Q31> in31(in.size()), out31(in.size());
+        toQ31(in.data(), in31.data(), in.size());
+        BiquadCascade<Q31> iir31;
+        REQUIRE(iir31.init(c31, 2, postShift) == 0);
+        iir31.process(in31.data(), out31.data(), in31.size());
+        std::vector<float> f31(in.size());
+        toFloat(out31.data(), f31.data(), f31.size());
+
+        for (size_t i = 0; i < in.size(); ++i) {
+            CHECK(out[i] == Approx(ref[i]).margin(1e-5));
+            CHECK(out15[i].toFloat() == Approx(ref[i]).margin(5e-3));
+            CHECK(f31[i] == Approx(ref[i]).margin(1e-5));
+        }
+    }
+}
+
+TEST_CASE("RealFft") {
+    RealFft fft;
+
+    SECTION("validates the size") {
+        CHECK(fft.init(2) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(fft.init(100) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(fft.init(8192) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(fft.init(4) == 0);
+        CHECK(fft.size() == 4);
+    }
+
+    SECTION("matches a reference DFT") {
+        for (size_t n: { 4, 8, 16, 64, 256 }) {
+            REQUIRE(fft.init(n) == 0);
+            std::mt19937 gen(n);
+            std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+            std::vector<float> in(n);
+            for (auto& v: in) {
+                v = dist(gen);
+            }
+            std::vector<float> out(n);
+            fft.forward(in.data(), out.data());
+            std::vector<double> re, im;
+            dft(in, &re, &im);
+            CHECK(out[0] == Approx(re[0]).margin(1e-4));
+            CHECK(out[1] == Approx(re[n / 2]).margin(1e-4));
+            for (size_t k = 1; k < n / 2; ++k) {
+                CHECK(out[2 * k] == Approx(re[k]).margin(1e-4));
+                CHECK(out[2 * k + 1] == Approx(im[k]).margin(1e-4));
+            }
+        }
+    }
+
+    SECTION("finds the frequency of a sine wave") {
+        const size_t n = 1024;
+        REQUIRE(fft.init(n) == 0);
+        const auto in = sine(n, 37.0 / n);
+        std::vector<float> spectrum(n), mag(n / 2 + 1);
+        fft.forward(in.data(), spectrum.data());
+        fft.magnitude(spectrum.data(), mag.data());
+        size_t bin = 0;
+        peak(mag.data(), mag.size(), &bin);
+        CHECK(bin == 37);
+        CHECK(mag[37] == Approx(n / 2.0).epsilon(1e-3));
+    }
+
+    SECTION("DC and Nyquist bins") {
+        REQUIRE(fft.init(8) == 0);
+        const float in[8] = { 1.5f, 0.5f, 1.5f, 0.5f, 1.5f, 0.5f, 1.5f, 0.5f };
+        float out[8];
+        float mag[5];
+        fft.forward(in, out);
+        fft.magnitude(out, mag);
+        CHECK(out[0] == Approx(8.0f));
+        CHECK(out[1] == Approx(4.0f));
+        CHECK(mag[0] == Approx(8.0f));
+        CHECK(mag[4] == Approx(4.0f));
+        CHECK(mag[2] == Approx(0.0f).margin(1e-5));
+    }
+}
+
+TEST_CASE("DSP benchmark") {
+    const size_t n = 4096;
+    const unsigned iterations = 2000;
+    const auto a = randomQ15(n, 3);
+    const auto b = randomQ15(n, 4);
+    volatile int64_t sink = 0;
+    const double scalarDot = measure([&]() { sink = detail::dotScalar(a.data(), b.data(), n); }, iterations);
+    const double dot = measure([&]() { sink = detail::dot(a.data(), b.data(), n); }, iterations);
+    const double scalarSquares = measure([&]() { sink = detail::sumSquaresScalar(a.data(), n); }, iterations);
+    const double squares = measure([&]() { sink = detail::sumSquares(a.data(), n); }, iterations);
+    (void)sink;
+    WARN("DSP backend: " << backendName() << "; Q15 dot product of " << n << " samples: " << dot << " us (scalar: " <<
+            scalarDot << " us); sum of squares: " << squares << " us (scalar: " << scalarSquares << " us)");
+    CHECK(detail::dot(a.data(), b.data(), n) == detail::dotScalar(a.data(), b.data(), n));
+}
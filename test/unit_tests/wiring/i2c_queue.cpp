@@ -0,0 +1,286 @@
+#include "spark_wiring_i2c_queue.h"
+
+#include "catch2/catch.hpp"
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace particle;
+
+// Simulated bus with register-based devices
+class SimulatedBus {
+public:
+    SimulatedBus() :
+            time(0),
+            busy(false),
+            aborts(0),
+            startError(0) {
+    }
+
+    void addDevice(uint8_t address) {
+        devices[address].resize(256);
+    }
+
+    // Performs the current transfer
+    int perform() {
+        REQUIRE(busy);
+        busy = false;
+        const auto it = devices.find(current.address);
+        if (it == devices.end()) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        auto& regs = it->second;
+        size_t reg = 0;
+        if (current.txLength) {
+            reg = current.tx[0];
+            for (size_t i = 1; i < current.txLength; ++i) {
+                regs[(reg + i - 1) & 0xff] = current.tx[i];
+            }
+        }
+        for (size_t i = 0; i < current.rxLength; ++i) {
+            current.rx[i] = regs[(reg + i) & 0xff];
+        }
+        return 0;
+    }
+
+    std::map<uint8_t, std::vector<uint8_t>> devices;
+    std::string log;
+    I2cTransaction current;
+    uint32_t time;
+    bool busy;
+    int aborts;
+    int startError;
+};
+
+class SimulatedBackend {
+public:
+    explicit SimulatedBackend(SimulatedBus* bus) :
+            bus_(bus) {
+    }
+
+    int start(const I2cTransaction& t) {
+        if (bus_->startError) {
+            return bus_->startError;
+        }
+        REQUIRE(!bus_->busy);
+        bus_->busy = true;
+        bus_->current = t;
+        bus_->log += std::to_string(t.address) + ' ';
+        return 0;
+    }
+
+    void abort() {
+        bus_->busy = false;
+        ++bus_->aborts;
+    }
+
+    uint32_t millis() {
+        return bus_->time;
+    }
+
+    int lock() {
+        return 0;
+    }
+
+    void unlock(int state) {
+    }
+
+private:
+    SimulatedBus* bus_;
+};
+
+typedef detail::I2cTransactionEngine<SimulatedBackend> Engine;
+
+std::vector<int> g_results;
+
+void onComplete(int error, void* data) {
+    g_results.push_back(error ? error : (int)(intptr_t)data);
+}
+
+I2cTransaction transaction(uint8_t address, const uint8_t* tx, size_t txLength, uint8_t* rx, size_t rxLength, int id,
+        uint32_t timeout = 0) {
+    I2cTransaction t = {};
+    t.address = address;
+    t.tx = tx;
+    t.txLength = txLength;
+    t.rx = rx;
+    t.rxLength = rxLength;
+    t.timeout = timeout;
+    t.callback = onComplete;
+    t.data = (void*)(intptr_t)id;
+    return t;
+}
+
+// Completes transfers until the engine is idle
+void run(SimulatedBus& bus, Engine& engine) {
+    while (engine.isBusy()) {
+        engine.transferComplete(bus.perform());
+    }
+}
+
+} // namespace
+
+TEST_CASE("I2cTransactionEngine") {
+    SimulatedBus bus;
+    bus.addDevice(0x10);
+    bus.addDevice(0x20);
+    Engine engine(&bus);
+    g_results.clear();
+
+    SECTION("performs a write-then-read transaction") {
+        bus.devices[0x10][5] = 0xab;
+        bus.devices[0x10][6] = 0xcd;
+        const uint8_t reg = 5;
+        uint8_t rx[2] = {};
+        I2cTransaction t = transaction(0x10, &reg, 1, rx, 2, 1);
+        REQUIRE(engine.submit(&t) == 0);
+        CHECK(engine.isBusy());
+        run(bus, engine);
+        CHECK(rx[0] == 0xab);
+        CHECK(rx[1] == 0xcd);
+        CHECK(g_results == std::vector<int>{ 1 });
+        const I2cBusStats st = engine.stats();
+        CHECK(st.transactions == 1);
+        CHECK(st.bytesWritten == 1);
+        CHECK(st.bytesRead == 2);
+        CHECK(st.errors == 0);
+    }
+
+    SECTION("runs transactions to several devices in submission order") {
+        const uint8_t w1[] = { 0, 0x11 };
+        const uint8_t w2[] = { 0, 0x22 };
+        const uint8_t reg = 0;
+        uint8_t r1 = 0;
+        uint8_t r2 = 0;
+        I2cTransaction a = transaction(0x10, w1, 2, nullptr, 0, 1);
+        I2cTransaction b = transaction(0x20, w2, 2, nullptr, 0, 2);
+        I2cTransaction c = transaction(0x10, &reg, 1, &r1, 1, 3);
+        I2cTransaction d = transaction(0x20, &reg, 1, &r2, 1, 4);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        REQUIRE(engine.submit(&c) == 0);
+        REQUIRE(engine.submit(&d) == 0);
+        CHECK(engine.pending() == 3);
+        run(bus, engine);
+        CHECK(bus.log == "16 32 16 32 ");
+        CHECK(r1 == 0x11);
+        CHECK(r2 == 0x22);
+        CHECK(g_results == (std::vector<int>{ 1, 2, 3, 4 }));
+        CHECK(engine.stats().maxQueueDepth == 3);
+    }
+
+    SECTION("reports an address error and continues with the next transaction") {
+        uint8_t rx = 0;
+        I2cTransaction a = transaction(0x30, nullptr, 0, &rx, 1, 1);
+        I2cTransaction b = transaction(0x10, nullptr, 0, &rx, 1, 2);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        run(bus, engine);
+        CHECK(g_results == (std::vector<int>{ SYSTEM_ERROR_NOT_FOUND, 2 }));
+        CHECK(engine.stats().errors == 1);
+        CHECK(engine.stats().transactions == 2);
+    }
+
+    SECTION("fails a transaction that the bus refuses to start") {
+        uint8_t rx = 0;
+        I2cTransaction t = transaction(0x10, nullptr, 0, &rx, 1, 1);
+        bus.startError = SYSTEM_ERROR_BUSY;
+        REQUIRE(engine.submit(&t) == 0);
+        CHECK(!engine.isBusy());
+        CHECK(g_results == std::vector<int>{ SYSTEM_ERROR_BUSY });
+    }
+
+    SECTION("aborts the active transaction when its timeout expires") {
+        uint8_t rx = 0;
+        I2cTransaction a = transaction(0x10, nullptr, 0, &rx, 1, 1, 50);
+        I2cTransaction b = transaction(0x20, nullptr, 0, &rx, 1, 2, 100);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        bus.time = 49;
+        engine.checkTimeouts();
+        CHECK(g_results.empty());
+        bus.time = 50;
+        engine.checkTimeouts();
+        CHECK(bus.aborts == 1);
+        CHECK(g_results == std::vector<int>{ SYSTEM_ERROR_TIMEOUT });
+        // The next transaction has been started
+        CHECK(bus.log == "16 32 ");
+        // Late completion of the aborted transfer is ignored
+        run(bus, engine);
+        CHECK(g_results == (std::vector<int>{ SYSTEM_ERROR_TIMEOUT, 2 }));
+        CHECK(engine.stats().timeouts == 1);
+    }
+
+    SECTION("fails a pending transaction whose timeout expires before it starts") {
+        uint8_t rx = 0;
+        I2cTransaction a = transaction(0x10, nullptr, 0, &rx, 1, 1);
+        I2cTransaction b = transaction(0x20, nullptr, 0, &rx, 1, 2, 10);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        bus.time = 20;
+        engine.checkTimeouts();
+        CHECK(bus.aborts == 0);
+        CHECK(engine.pending() == 0);
+        CHECK(g_results == std::vector<int>{ SYSTEM_ERROR_TIMEOUT });
+        run(bus, engine);
+        CHECK(g_results == (std::vector<int>{ SYSTEM_ERROR_TIMEOUT, 1 }));
+        CHECK(bus.log == "16 ");
+    }
+
+    SECTION("cancels a pending transaction") {
+        uint8_t rx = 0;
+        I2cTransaction a = transaction(0x10, nullptr, 0, &rx, 1, 1);
+        I2cTransaction b = transaction(0x20, nullptr, 0, &rx, 1, 2);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        CHECK(engine.cancel(&a) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(engine.cancel(&b) == 0);
+        run(bus, engine);
+        CHECK(g_results == (std::vector<int>{ SYSTEM_ERROR_CANCELLED, 1 }));
+    }
+
+    SECTION("cancels the active and the pending transactions at once") {
+        uint8_t rx = 0;
+        I2cTransaction a = transaction(0x10, nullptr, 0, &rx, 1, 1);
+        I2cTransaction b = transaction(0x20, nullptr, 0, &rx, 1, 2);
+        I2cTransaction c = transaction(0x20, nullptr, 0, &rx, 1, 3);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        REQUIRE(engine.submit(&c) == 0);
+        engine.cancelAll();
+        CHECK(bus.aborts == 1);
+        CHECK(!engine.isBusy());
+        CHECK(engine.pending() == 0);
+        CHECK(g_results == (std::vector<int>{ SYSTEM_ERROR_CANCELLED, SYSTEM_ERROR_CANCELLED, SYSTEM_ERROR_CANCELLED }));
+        CHECK(bus.log == "16 ");
+        // The engine can be used again
+        REQUIRE(engine.submit(&a) == 0);
+        run(bus, engine);
+        CHECK(g_results.back() == 1);
+    }
+
+    SECTION("rejects invalid transactions") {
+        I2cTransaction t = transaction(0x10, nullptr, 0, nullptr, 0, 1);
+        CHECK(engine.submit(&t) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        t.txLength = 1;
+        CHECK(engine.submit(&t) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(engine.submit(nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+
+    SECTION("records the time transactions wait for the bus") {
+        uint8_t rx = 0;
+        I2cTransaction a = transaction(0x10, nullptr, 0, &rx, 1, 1);
+        I2cTransaction b = transaction(0x20, nullptr, 0, &rx, 1, 2);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        bus.time = 7;
+        run(bus, engine);
+        CHECK(engine.stats().maxWaitTime == 7);
+        engine.resetStats();
+        CHECK(engine.stats().transactions == 0);
+    }
+}
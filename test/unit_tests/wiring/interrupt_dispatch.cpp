@@ -0,0 +1,288 @@
+#include "spark_wiring_interrupt_dispatch.h"
+
+#include "catch2/catch.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace particle;
+
+class Counter {
+public:
+    Counter() :
+            count(0) {
+    }
+
+    void increment() {
+        ++count;
+    }
+
+    int count;
+};
+
+} // namespace
+
+TEST_CASE("InterruptHandler") {
+    SECTION("can be empty") {
+        InterruptHandler h;
+        CHECK(!h);
+    }
+
+    SECTION("calls a handler that takes no arguments") {
+        int n = 0;
+        InterruptHandler h([&n]() { ++n; });
+        REQUIRE(h);
+        h(InterruptEvent{ 1, 2 });
+        CHECK(n == 1);
+    }
+
+    SECTION("passes the event to a handler that takes it") {
+        InterruptEvent ev = {};
+        InterruptHandler h([&ev](const InterruptEvent& e) { ev = e; });
+        h(InterruptEvent{ 3, 1234 });
+        CHECK(ev.pin == 3);
+        CHECK(ev.timestamp == 1234);
+    }
+
+    SECTION("can store a std::function and a bound member function") {
+        int n = 0;
+        InterruptHandler h1(std::function<void()>([&n]() { ++n; }));
+        h1(InterruptEvent{});
+        CHECK(n == 1);
+        Counter c;
+        void (Counter::*fn)() = &Counter::increment;
+        Counter* obj = &c;
+        InterruptHandler h2([fn, obj]() { (obj->*fn)(); });
+        h2(InterruptEvent{});
+        CHECK(c.count == 1);
+    }
+
+    SECTION("is movable and destroys the stored callable") {
+        auto p = std::make_shared<int>(0);
+        {
+            InterruptHandler h1([p]() { ++*p; });
+            CHECK(p.use_count() == 2);
+            InterruptHandler h2(std::move(h1));
+            CHECK(!h1);
+            h2(InterruptEvent{});
+            InterruptHandler h3;
+            h3 = std::move(h2);
+            h3(InterruptEvent{});
+            CHECK(p.use_count() == 2);
+            h3.reset();
+            CHECK(!h3);
+            CHECK(p.use_count() == 1);
+            h3 = InterruptHandler([p]() {});
+        }
+        CHECK(*p == 2);
+        CHECK(p.use_count() == 1);
+    }
+}
+
+TEST_CASE("InterruptEventQueue") {
+    SECTION("returns items in FIFO order and reports when it is full") {
+        InterruptEventQueue<int, 4> q;
+        CHECK(q.capacity() == 4);
+        for (int i = 0; i < 4; ++i) {
+            CHECK(q.push(i));
+        }
+        CHECK(!q.push(4));
+        CHECK(q.size() == 4);
+        int v = -1;
+        for (int i = 0; i < 4; ++i) {
+            REQUIRE(q.pop(&v));
+            CHECK(v == i);
+        }
+        CHECK(!q.pop(&v));
+        CHECK(q.size() == 0);
+    }
+
+    SECTION("accepts items from several producers") {
+        const int PRODUCERS = 4;
+        const int ITEMS = 10000;
+        InterruptEventQueue<int, 64> q;
+        std::vector<std::thread> threads;
+        for (int p = 0; p < PRODUCERS; ++p) {
+            threads.emplace_back([&q, p]() {
+                for (int i = 0; i < ITEMS; ++i) {
+                    while (!q.push(p * ITEMS + i)) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        std::vector<int> last(PRODUCERS, -1);
+        int received = 0;
+        bool ordered = true;
+        while (received < PRODUCERS * ITEMS) {
+            int v = 0;
+            if (!q.pop(&v)) {
+                std::this_thread::yield();
+                continue;
+            }
+            const int p = v / ITEMS;
+            // Items of each producer arrive in the order they were pushed
+            if (v % ITEMS <= last[p]) {
+                ordered = false;
+            }
+            last[p] = v % ITEMS;
+            ++received;
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        CHECK(ordered);
+        CHECK(q.size() == 0);
+    }
+}
+
+TEST_CASE("InterruptDispatcher") {
+    InterruptDispatcher<4, 4> d;
+    std::vector<InterruptEvent> events;
+
+    SECTION("calls an immediate handler in the interrupt context") {
+        REQUIRE(d.attach(1, InterruptHandler([&events](const InterruptEvent& e) { events.push_back(e); }), false) == 0);
+        CHECK(!d.handleInterrupt(1, 100));
+        REQUIRE(events.size() == 1);
+        CHECK(events[0].pin == 1);
+        CHECK(events[0].timestamp == 100);
+        CHECK(d.pending() == 0);
+        CHECK(d.stats(1).edges == 1);
+    }
+
+    SECTION("queues edges for a deferred handler") {
+        REQUIRE(d.attach(2, InterruptHandler([&events](const InterruptEvent& e) { events.push_back(e); }), true) == 0);
+        CHECK(d.handleInterrupt(2, 10));
+        CHECK(d.handleInterrupt(2, 20));
+        CHECK(events.empty());
+        CHECK(d.pending() == 2);
+        CHECK(d.process() == 2);
+        REQUIRE(events.size() == 2);
+        CHECK(events[0].timestamp == 10);
+        CHECK(events[1].timestamp == 20);
+        CHECK(d.maxPending() == 2);
+    }
+
+    SECTION("processes events of different pins in arrival order") {
+        for (uint16_t pin = 0; pin < 3; ++pin) {
+            d.attach(pin, InterruptHandler([&events](const InterruptEvent& e) { events.push_back(e); }), true);
+        }
+        d.handleInterrupt(2, 1);
+        d.handleInterrupt(0, 2);
+        d.handleInterrupt(1, 3);
+        CHECK(d.process(2) == 2);
+        CHECK(d.process() == 1);
+        REQUIRE(events.size() == 3);
+        CHECK(events[0].pin == 2);
+        CHECK(events[1].pin == 0);
+        CHECK(events[2].pin == 1);
+    }
+
+    SECTION("counts edges dropped when the queue is full") {
+        d.attach(3, InterruptHandler([&events](const InterruptEvent& e) { events.push_back(e); }), true);
+        for (int i = 0; i < 6; ++i) {
+            d.handleInterrupt(3, i);
+        }
+        CHECK(d.stats(3).edges == 6);
+        CHECK(d.stats(3).overflows == 2);
+        CHECK(d.overflows() == 2);
+        CHECK(d.process() == 4);
+        CHECK(events.size() == 4);
+    }
+
+    SECTION("drops events queued for a detached or replaced handler") {
+        int oldCount = 0;
+        int newCount = 0;
+        d.attach(0, InterruptHandler([&oldCount]() { ++oldCount; }), true);
+        d.handleInterrupt(0, 1);
+        d.attach(0, InterruptHandler([&newCount]() { ++newCount; }), true);
+        d.handleInterrupt(0, 2);
+        d.process();
+        CHECK(oldCount == 0);
+        CHECK(newCount == 1);
+        d.handleInterrupt(0, 3);
+        d.detach(0);
+        CHECK(d.process() == 1);
+        CHECK(newCount == 1);
+        // Edges are still counted without a handler
+        CHECK(!d.handleInterrupt(0, 4));
+        CHECK(d.stats(0).edges == 4);
+    }
+
+    SECTION("lets a deferred handler detach itself") {
+        auto p = std::make_shared<int>(0);
+        d.attach(1, InterruptHandler([&d, p]() {
+            ++*p;
+            d.detach(1);
+            // The handler is still alive until it returns
+            ++*p;
+        }), true);
+        d.handleInterrupt(1, 1);
+        d.handleInterrupt(1, 2);
+        CHECK(p.use_count() == 2);
+        CHECK(d.process() == 2);
+        CHECK(*p == 2);
+        CHECK(p.use_count() == 1);
+        CHECK(!d.handleInterrupt(1, 3));
+    }
+
+    SECTION("lets a deferred handler replace itself and attach other handlers") {
+        int oldCount = 0;
+        int newCount = 0;
+        d.attach(0, InterruptHandler([&]() {
+            ++oldCount;
+            d.attach(0, InterruptHandler([&newCount]() { ++newCount; }), true);
+            d.attach(2, InterruptHandler([&events](const InterruptEvent& e) { events.push_back(e); }), true);
+        }), true);
+        d.handleInterrupt(0, 1);
+        d.handleInterrupt(0, 2);
+        d.process();
+        // The second edge was queued for the old handler
+        CHECK(oldCount == 1);
+        CHECK(newCount == 0);
+        d.handleInterrupt(0, 3);
+        d.handleInterrupt(2, 4);
+        d.process();
+        CHECK(newCount == 1);
+        REQUIRE(events.size() == 1);
+        CHECK(events[0].timestamp == 4);
+    }
+
+    SECTION("lets an immediate handler detach itself in the interrupt context") {
+        auto p = std::make_shared<int>(0);
+        d.attach(3, InterruptHandler([&d, p]() {
+            d.detachFromIsr(3);
+            ++*p;
+        }), false);
+        d.handleInterrupt(3, 1);
+        d.handleInterrupt(3, 2);
+        CHECK(*p == 1);
+        // The handler is destroyed in the thread context
+        CHECK(p.use_count() == 2);
+        d.detach(3);
+        CHECK(p.use_count() == 1);
+    }
+
+    SECTION("drops queued events of a handler detached in the interrupt context") {
+        int n = 0;
+        d.attach(2, InterruptHandler([&n]() { ++n; }), true);
+        d.handleInterrupt(2, 1);
+        d.detachFromIsr(2);
+        CHECK(!d.handleInterrupt(2, 2));
+        d.process();
+        CHECK(n == 0);
+        // Attaching a handler again enables the slot
+        d.attach(2, InterruptHandler([&n]() { ++n; }), true);
+        d.handleInterrupt(2, 3);
+        d.process();
+        CHECK(n == 1);
+    }
+
+    SECTION("rejects invalid slots and empty handlers") {
+        CHECK(d.attach(4, InterruptHandler([]() {}), false) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(d.attach(0, InterruptHandler(), false) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(!d.handleInterrupt(4, 0));
+    }
+}
@@ -0,0 +1,283 @@
+#include "spark_wiring_spi_queue.h"
+
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace particle;
+
+// Bus arbitration state shared by the mock backends
+struct MockBus {
+    bool available = true; // The bus is granted right away
+    int requests = 0;
+    int idle = 0;
+};
+
+MockBus g_bus;
+
+class MockBackend {
+public:
+    MockBackend(std::string* log, uint32_t* time) :
+            log_(log),
+            time_(time) {
+    }
+
+    void configure(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {
+        *log_ += "C" + std::to_string(clock) + ' ';
+    }
+
+    void select(uint16_t pin, bool selected) {
+        *log_ += (selected ? "S" : "D") + std::to_string(pin) + ' ';
+    }
+
+    void transfer(const void* tx, void* rx, size_t length) {
+        *log_ += "T" + std::to_string(length) + ' ';
+    }
+
+    uint32_t micros() {
+        return *time_;
+    }
+
+    int lock() {
+        return 0;
+    }
+
+    void unlock(int state) {
+    }
+
+    bool requestBus() {
+        ++g_bus.requests;
+        return g_bus.available;
+    }
+
+    void busIdle() {
+        ++g_bus.idle;
+    }
+
+private:
+    std::string* log_;
+    uint32_t* time_;
+};
+
+typedef detail::SpiTransactionEngine<MockBackend> Engine;
+
+std::vector<int> g_results;
+
+void onComplete(int error, void* data) {
+    g_results.push_back(error ? error : (int)(intptr_t)data);
+}
+
+SpiSegment segment(size_t length, uint16_t cs, uint32_t clock = 0, uint8_t flags = 0) {
+    return SpiSegment{ nullptr, nullptr, length, cs, clock, 1, 0, flags };
+}
+
+SpiTransaction transaction(const SpiSegment* segs, size_t count, int id) {
+    return SpiTransaction{ segs, count, onComplete, (void*)(intptr_t)id, nullptr, 0 };
+}
+
+// Completes transfers until the engine is idle
+void drain(Engine& engine) {
+    while (engine.isBusy()) {
+        engine.transferComplete();
+    }
+}
+
+} // namespace
+
+TEST_CASE("SpiTransactionEngine") {
+    std::string log;
+    uint32_t time = 0;
+    Engine engine(&log, &time);
+    g_results.clear();
+    g_bus = MockBus();
+
+    SECTION("starts a transaction immediately when the bus is idle") {
+        const SpiSegment segs[] = { segment(4, 10) };
+        SpiTransaction t = transaction(segs, 1, 1);
+        REQUIRE(engine.submit(&t) == 0);
+        CHECK(engine.isBusy());
+        CHECK(log == "S10 T4 ");
+        engine.transferComplete();
+        CHECK(!engine.isBusy());
+        CHECK(log == "S10 T4 D10 ");
+        CHECK(g_results == std::vector<int>{ 1 });
+    }
+
+    SECTION("keeps the chip select asserted across chained segments") {
+        const SpiSegment segs[] = {
+            segment(1, 10, 0, SpiSegment::KEEP_SELECTED),
+            segment(16, 10, 0, SpiSegment::KEEP_SELECTED),
+            segment(2, 10)
+        };
+        SpiTransaction t = transaction(segs, 3, 1);
+        REQUIRE(engine.submit(&t) == 0);
+        drain(engine);
+        CHECK(log == "S10 T1 T16 T2 D10 ");
+        const SpiBusStats st = engine.stats();
+        CHECK(st.selects == 1);
+        CHECK(st.chainedSegments == 2);
+        CHECK(st.segments == 3);
+        CHECK(st.bytes == 19);
+        CHECK(st.transactions == 1);
+    }
+
+    SECTION("toggles the chip select between devices and segments that don't keep it") {
+        const SpiSegment segs[] = {
+            segment(1, 10, 0, SpiSegment::KEEP_SELECTED),
+            segment(2, 11),
+            segment(3, 11),
+            segment(4, SpiSegment::NO_CS)
+        };
+        SpiTransaction t = transaction(segs, 4, 1);
+        REQUIRE(engine.submit(&t) == 0);
+        drain(engine);
+        CHECK(log == "S10 T1 D10 S11 T2 D11 S11 T3 D11 T4 ");
+        CHECK(engine.stats().selects == 3);
+        CHECK(engine.stats().chainedSegments == 0);
+    }
+
+    SECTION("reconfigures the bus only when the settings change") {
+        const SpiSegment segs[] = {
+            segment(1, 10, 1000000),
+            segment(1, 10, 1000000),
+            segment(1, 10),
+            segment(1, 11, 8000000)
+        };
+        SpiTransaction t = transaction(segs, 4, 1);
+        REQUIRE(engine.submit(&t) == 0);
+        drain(engine);
+        CHECK(log == "C1000000 S10 T1 D10 S10 T1 D10 S10 T1 D10 C8000000 S11 T1 D11 ");
+        CHECK(engine.stats().reconfigurations == 2);
+    }
+
+    SECTION("runs queued transactions back to back in order") {
+        const SpiSegment segsA[] = { segment(1, 10) };
+        const SpiSegment segsB[] = { segment(2, 11) };
+        const SpiSegment segsC[] = { segment(3, 12) };
+        SpiTransaction a = transaction(segsA, 1, 1);
+        SpiTransaction b = transaction(segsB, 1, 2);
+        SpiTransaction c = transaction(segsC, 1, 3);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        REQUIRE(engine.submit(&c) == 0);
+        CHECK(engine.pending() == 2);
+        CHECK(log == "S10 T1 ");
+        engine.transferComplete();
+        // The next transaction is started before the previous one is reported as complete
+        CHECK(log == "S10 T1 D10 S11 T2 ");
+        CHECK(g_results == std::vector<int>{ 1 });
+        drain(engine);
+        CHECK(g_results == (std::vector<int>{ 1, 2, 3 }));
+        CHECK(engine.stats().maxQueueDepth == 2);
+        CHECK(engine.pending() == 0);
+    }
+
+    SECTION("cancels a pending transaction") {
+        const SpiSegment segs[] = { segment(1, 10) };
+        SpiTransaction a = transaction(segs, 1, 1);
+        SpiTransaction b = transaction(segs, 1, 2);
+        SpiTransaction c = transaction(segs, 1, 3);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        REQUIRE(engine.submit(&c) == 0);
+        CHECK(engine.cancel(&c) == 0);
+        CHECK(g_results == std::vector<int>{ SYSTEM_ERROR_CANCELLED });
+        // The active transaction can't be cancelled
+        CHECK(engine.cancel(&a) == SYSTEM_ERROR_NOT_FOUND);
+        drain(engine);
+        CHECK(g_results == (std::vector<int>{ SYSTEM_ERROR_CANCELLED, 1, 2 }));
+        CHECK(engine.stats().transactions == 2);
+    }
+
+    SECTION("rejects empty transactions") {
+        SpiTransaction t = transaction(nullptr, 0, 1);
+        CHECK(engine.submit(&t) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(engine.submit(nullptr) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(!engine.isBusy());
+    }
+
+    SECTION("rejects transactions with empty segments") {
+        const SpiSegment segs[] = { segment(4, 10, 0, SpiSegment::KEEP_SELECTED), segment(0, 10) };
+        SpiTransaction t = transaction(segs, 2, 1);
+        CHECK(engine.submit(&t) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(!engine.isBusy());
+        CHECK(engine.pending() == 0);
+        CHECK(log.empty());
+        CHECK(g_results.empty());
+    }
+
+    SECTION("measures the time transactions wait for the bus") {
+        const SpiSegment segs[] = { segment(1, 10) };
+        SpiTransaction a = transaction(segs, 1, 1);
+        SpiTransaction b = transaction(segs, 1, 2);
+        time = 100;
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        time = 350;
+        engine.transferComplete();
+        engine.transferComplete();
+        SpiBusStats st = engine.stats();
+        CHECK(st.maxWaitTime == 250);
+        CHECK(st.totalWaitTime == 250);
+        engine.resetStats();
+        st = engine.stats();
+        CHECK(st.transactions == 0);
+        CHECK(st.maxWaitTime == 0);
+    }
+
+    SECTION("requests the bus once per batch of transactions") {
+        g_bus.available = false;
+        const SpiSegment segs[] = { segment(1, 10) };
+        SpiTransaction a = transaction(segs, 1, 1);
+        SpiTransaction b = transaction(segs, 1, 2);
+        REQUIRE(engine.submit(&a) == 0);
+        REQUIRE(engine.submit(&b) == 0);
+        // Nothing is transferred until the bus is granted
+        CHECK(g_bus.requests == 1);
+        CHECK(engine.isBusRequested());
+        CHECK(!engine.isBusy());
+        CHECK(log.empty());
+        engine.grant();
+        CHECK(engine.isBusGranted());
+        CHECK(log == "S10 T1 ");
+        // The bus can't be released while there are transactions to run
+        CHECK(!engine.release());
+        engine.transferComplete();
+        CHECK(g_bus.idle == 0);
+        engine.transferComplete();
+        CHECK(g_bus.idle == 1);
+        CHECK(g_results == (std::vector<int>{ 1, 2 }));
+        CHECK(engine.release());
+        CHECK(!engine.isBusGranted());
+        // The next batch requests the bus again
+        REQUIRE(engine.submit(&a) == 0);
+        CHECK(g_bus.requests == 2);
+        CHECK(!engine.isBusy());
+    }
+
+    SECTION("reports an idle bus if all transactions were cancelled while waiting for it") {
+        g_bus.available = false;
+        const SpiSegment segs[] = { segment(1, 10) };
+        SpiTransaction a = transaction(segs, 1, 1);
+        REQUIRE(engine.submit(&a) == 0);
+        CHECK(engine.cancel(&a) == 0);
+        engine.grant();
+        CHECK(g_bus.idle == 1);
+        CHECK(engine.release());
+        CHECK(log.empty());
+    }
+
+    SECTION("keeps a bus that is always available") {
+        const SpiSegment segs[] = { segment(1, 10) };
+        SpiTransaction a = transaction(segs, 1, 1);
+        REQUIRE(engine.submit(&a) == 0);
+        drain(engine);
+        REQUIRE(engine.submit(&a) == 0);
+        drain(engine);
+        CHECK(g_bus.requests == 1);
+        CHECK(engine.isBusGranted());
+    }
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spark_wiring_stream.h"
+
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <string>
+
+namespace {
+
+// Stream that supports byte access only
+class ByteStream: public Stream {
+public:
+    explicit ByteStream(const std::string& data, size_t chunkSize = 0) :
+            data_(data),
+            pos_(0),
+            chunkSize_(chunkSize) {
+        setTimeout(0);
+    }
+
+    int available() override {
+        return data_.size() - pos_;
+    }
+
+    int read() override {
+        return (pos_ < data_.size()) ? (uint8_t)data_[pos_++] : -1;
+    }
+
+    int peek() override {
+        return (pos_ < data_.size()) ? (uint8_t)data_[pos_] : -1;
+    }
+
+    void flush() override {
+    }
+
+    size_t write(uint8_t b) override {
+        return 0;
+    }
+
+    std::string remaining() const {
+        return data_.substr(pos_);
+    }
+
+protected:
+    std::string data_;
+    size_t pos_;
+    size_t chunkSize_;
+};
+
+// Stream that exposes its data in chunks of a given size
+class BufferedStream: public ByteStream {
+public:
+    using ByteStream::ByteStream;
+
+    int peekBuffer(const char** data) override {
+        *data = data_.data() + pos_;
+        const size_t n = data_.size() - pos_;
+        return (chunkSize_ && n > chunkSize_) ? chunkSize_ : n;
+    }
+
+    void consume(size_t size) override {
+        pos_ += size;
+    }
+};
+
+template<typename T>
+void checkParsing(size_t chunkSize) {
+    SECTION("readBytes()") {
+        T s("abcdefgh", chunkSize);
+        char buf[16] = {};
+        CHECK(s.readBytes(buf, 5) == 5);
+        CHECK(std::string(buf) == "abcde");
+        CHECK(s.readBytes(buf, sizeof(buf)) == 3);
+        CHECK(s.remaining() == "");
+    }
+    SECTION("readBytesUntil()") {
+        T s("abc,defgh", chunkSize);
+        char buf[16] = {};
+        CHECK(s.readBytesUntil(',', buf, sizeof(buf)) == 3);
+        CHECK(std::string(buf, 3) == "abc");
+        CHECK(s.remaining() == "defgh");
+        CHECK(s.readBytesUntil(',', buf, 2) == 2);
+        CHECK(s.remaining() == "fgh");
+    }
+    SECTION("readString() and readStringUntil()") {
+        T s("line 1\nline 2\nrest", chunkSize);
+        CHECK(std::string(s.readStringUntil('\n').c_str()) == "line 1");
+        CHECK(std::string(s.readStringUntil('\n').c_str()) == "line 2");
+        CHECK(std::string(s.readString().c_str()) == "rest");
+    }
+    SECTION("find() and findUntil()") {
+        T s("HTTP/1.1 200 OK\r\nContent-Length: 42\r\n\r\nbody", chunkSize);
+        CHECK(s.find((char*)"Content-Length:"));
+        CHECK(s.parseInt() == 42);
+        CHECK(s.find((char*)"\r\n\r\n"));
+        CHECK(s.remaining() == "body");
+        T s2("abc;xyz", chunkSize);
+        CHECK_FALSE(s2.findUntil((char*)"xyz", (char*)";"));
+        CHECK(s2.remaining() == "xyz");
+        T s3("aaab", chunkSize);
+        CHECK_FALSE(s3.find((char*)"aab")); // The matching algorithm doesn't backtrack
+        T s4("abc", chunkSize);
+        CHECK_FALSE(s4.find((char*)"x"));
+        CHECK(s4.remaining() == "");
+    }
+    SECTION("parseInt()") {
+        T s("x=-1234567890123, y=42;7", chunkSize);
+        CHECK(s.parseInt() == (long)-1234567890123LL);
+        CHECK(s.parseInt() == 42);
+        CHECK(s.remaining() == ";7");
+        CHECK(s.parseInt() == 7);
+        CHECK(s.parseInt() == 0);
+    }
+    SECTION("parseFloat()") {
+        T s("t=-12.25 h=0.5", chunkSize);
+        CHECK(s.parseFloat() == Approx(-12.25));
+        CHECK(s.parseFloat() == Approx(0.5));
+        CHECK(s.remaining() == "");
+    }
+}
+
+std::string makeResponse() {
+    std::string s;
+    for (int i = 0; i < 200; ++i) {
+        s += "value_" + std::to_string(i) + ": " + std::to_string(i * 1234567) + "\r\n";
+    }
+    return s;
+}
+
+template<typename T>
+long long parseResponse(const std::string& data) {
+    T s(data, 128);
+    long long sum = 0;
+    while (s.find((char*)": ")) {
+        sum += s.parseInt();
+    }
+    return sum;
+}
+
+} // namespace
+
+TEST_CASE("Stream parsing with byte access") {
+    checkParsing<ByteStream>(0);
+}
+
+TEST_CASE("Stream parsing with bulk access") {
+    checkParsing<BufferedStream>(0);
+}
+
+TEST_CASE("Stream parsing with bulk access across chunk boundaries") {
+    const size_t chunkSize = GENERATE(1, 2, 3, 4);
+    INFO("Chunk size: " << chunkSize);
+    checkParsing<BufferedStream>(chunkSize);
+}
+
+TEST_CASE("Stream bulk access benchmark") {
+    using namespace std::chrono;
+    const auto data = makeResponse();
+    const int runs = 100;
+    long long byteSum = 0;
+    long long bulkSum = 0;
+    auto t1 = steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+        byteSum += parseResponse<ByteStream>(data);
+    }
+    auto t2 = steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+        bulkSum += parseResponse<BufferedStream>(data);
+    }
+    auto t3 = steady_clock::now();
+    CHECK(byteSum == bulkSum);
+    const auto byteTime = duration_cast<microseconds>(t2 - t1).count();
+    const auto bulkTime = duration_cast<microseconds>(t3 - t2).count();
+    // Wall-clock timings are only reported, as they depend on the load of the machine
+    WARN("Per-byte parsing: " << byteTime << " us, bulk parsing: " << bulkTime << " us");
+}
@@ -0,0 +1,479 @@
+#include "usb_cdc_buffer.h"
+
+#include "catch2/catch.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace particle;
+
+const size_t PACKET_SIZE = 64;
+
+struct Transfer {
+    const uint8_t* data;
+    size_t size;
+};
+
+struct RxTransfer {
+    uint8_t* data;
+    size_t size;
+};
+
+// Simulated CDC data endpoints and the host side of the port
+class SimulatedPort {
+public:
+    SimulatedPort() :
+            rxArmed{},
+            locked(false),
+            txError(0) {
+    }
+
+    // Data received by the host, split into packets
+    std::vector<std::string> packets;
+    std::string received;
+    std::deque<Transfer> txPending;
+    RxTransfer rxArmed;
+    std::string immediateData;
+    bool locked;
+    int txError;
+};
+
+class SimulatedEndpoint {
+public:
+    explicit SimulatedEndpoint(SimulatedPort* port) :
+            port_(port) {
+    }
+
+    int transmit(const uint8_t* data, size_t size) {
+        if (port_->txError) {
+            return port_->txError;
+        }
+        REQUIRE(port_->txPending.empty());
+        port_->txPending.push_back({ data, size });
+        return 0;
+    }
+
+    int receive(uint8_t* data, size_t size) {
+        REQUIRE(size > 0);
+        REQUIRE(size % PACKET_SIZE == 0);
+        REQUIRE(port_->rxArmed.data == nullptr);
+        if (!port_->immediateData.empty()) {
+            // The driver has the data buffered already
+            const size_t n = std::min(size, port_->immediateData.size());
+            memcpy(data, port_->immediateData.data(), n);
+            port_->immediateData.erase(0, n);
+            return n;
+        }
+        port_->rxArmed = { data, size };
+        return 0;
+    }
+
+    int lock() {
+        REQUIRE_FALSE(port_->locked);
+        port_->locked = true;
+        return 1;
+    }
+
+    void unlock(int state) {
+        REQUIRE(state == 1);
+        port_->locked = false;
+    }
+
+private:
+    SimulatedPort* port_;
+};
+
+typedef detail::UsbCdcBuffer<SimulatedEndpoint, PACKET_SIZE> Buffer;
+
+// Completes the pending IN transfer. Returns false if there's no transfer
+bool completeTx(SimulatedPort& port, Buffer& buf) {
+    if (port.txPending.empty()) {
+        return false;
+    }
+    const Transfer t = port.txPending.front();
+    port.txPending.pop_front();
+    if (t.size == 0) {
+        port.packets.push_back(std::string());
+    }
+    for (size_t offs = 0; offs < t.size; offs += PACKET_SIZE) {
+        const size_t n = std::min(PACKET_SIZE, t.size - offs);
+        port.packets.push_back(std::string((const char*)t.data + offs, n));
+        port.received.append((const char*)t.data + offs, n);
+    }
+    buf.txDone();
+    return true;
+}
+
+void drainTx(SimulatedPort& port, Buffer& buf) {
+    while (completeTx(port, buf)) {
+    }
+}
+
+// Sends a packet from the host. Returns false if the OUT endpoint is not armed
+bool sendPacket(SimulatedPort& port, Buffer& buf, const std::string& data) {
+    if (!port.rxArmed.data) {
+        return false;
+    }
+    REQUIRE(data.size() <= port.rxArmed.size);
+    memcpy(port.rxArmed.data, data.data(), data.size());
+    port.rxArmed = {};
+    buf.rxDone(data.size());
+    return true;
+}
+
+std::string pattern(size_t size, unsigned seed = 0) {
+    std::string s;
+    for (size_t i = 0; i < size; ++i) {
+        s += (char)('a' + (i * 7 + seed) % 26);
+    }
+    return s;
+}
+
+std::string readAll(Buffer& buf) {
+    std::string s;
+    uint8_t data[100];
+    size_t n = 0;
+    while ((n = buf.read(data, sizeof(data))) > 0) {
+        s.append((const char*)data, n);
+    }
+    return s;
+}
+
+// Model of the previous driver: bytes are moved one at a time between the FIFOs and the
+// packet buffer
+class PerByteCdc {
+public:
+    explicit PerByteCdc(size_t size) :
+            fifo_(size),
+            head_(0),
+            tail_(0),
+            busy_(false) {
+    }
+
+    void send(const uint8_t* data, size_t size, std::string* out) {
+        for (size_t i = 0; i < size; ++i) {
+            while (head_ - tail_ == fifo_.size()) {
+                txDone(out);
+            }
+            fifo_[head_++ & (fifo_.size() - 1)] = data[i];
+        }
+        if (!busy_) {
+            fillPacket();
+        }
+    }
+
+    void txDone(std::string* out) {
+        out->append((const char*)packet_, packetSize_);
+        busy_ = false;
+        fillPacket();
+    }
+
+    void flush(std::string* out) {
+        while (busy_) {
+            txDone(out);
+        }
+    }
+
+private:
+    std::vector<uint8_t> fifo_;
+    uint8_t packet_[PACKET_SIZE];
+    size_t packetSize_;
+    size_t head_;
+    size_t tail_;
+    bool busy_;
+
+    void fillPacket() {
+        packetSize_ = 0;
+        while (packetSize_ < PACKET_SIZE && tail_ != head_) {
+            packet_[packetSize_++] = fifo_[tail_++ & (fifo_.size() - 1)];
+        }
+        busy_ = packetSize_ > 0;
+    }
+};
+
+template<typename F>
+double measure(F fn, unsigned iterations) {
+    const auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i) {
+        fn();
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t2 - t1).count() / iterations;
+}
+
+} // unnamed
+
+TEST_CASE("UsbCdcBuffer") {
+    SimulatedPort port;
+    Buffer buf(&port);
+    std::vector<uint8_t> rxRing(256);
+    std::vector<uint8_t> txRing(1024);
+    REQUIRE(buf.init(rxRing.data(), rxRing.size(), txRing.data(), txRing.size()) == 0);
+
+    SECTION("rejects rings that are not powers of two or are too small") {
+        Buffer b(&port);
+        CHECK(b.init(rxRing.data(), 200, txRing.data(), 1024) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(b.init(rxRing.data(), 256, txRing.data(), 64) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(b.init(nullptr, 256, txRing.data(), 1024) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(b.init(rxRing.data(), Buffer::MIN_BUFFER_SIZE / 2, txRing.data(), 1024) == SYSTEM_ERROR_INVALID_ARGUMENT);
+        CHECK(b.init(rxRing.data(), Buffer::MIN_BUFFER_SIZE, txRing.data(), Buffer::MIN_BUFFER_SIZE) == 0);
+    }
+
+    SECTION("discards written data while the port is closed") {
+        const auto data = pattern(10);
+        CHECK(buf.write((const uint8_t*)data.data(), data.size()) == 0);
+        CHECK(port.txPending.empty());
+        CHECK_FALSE(port.rxArmed.data);
+    }
+
+    buf.open();
+    REQUIRE(port.rxArmed.data == rxRing.data());
+    REQUIRE(port.rxArmed.size == 128);
+
+    SECTION("transmits written data directly from the ring") {
+        const auto data = pattern(10);
+        REQUIRE(buf.write((const uint8_t*)data.data(), data.size()) == 10);
+        REQUIRE(port.txPending.size() == 1);
+        CHECK(port.txPending.front().data == txRing.data());
+        CHECK(port.txPending.front().size == 10);
+        CHECK(buf.isTransmitting());
+        drainTx(port, buf);
+        CHECK(port.received == data);
+        CHECK_FALSE(buf.isTransmitting());
+        CHECK(buf.availableForWrite() == 1024);
+    }
+
+    SECTION("coalesces data written during a transfer into full-size packets") {
+        const auto data = pattern(1000);
+        REQUIRE(buf.write((const uint8_t*)data.data(), 1) == 1);
+        for (size_t offs = 1; offs < data.size(); offs += 50) {
+            REQUIRE(buf.write((const uint8_t*)data.data() + offs, std::min<size_t>(50, data.size() - offs)) > 0);
+        }
+        // The first byte is in flight, the rest is sent in transfers of up to half the ring
+        completeTx(port, buf);
+        REQUIRE(port.txPending.size() == 1);
+        CHECK(port.txPending.front().size == 512);
+        drainTx(port, buf);
+        CHECK(port.received == data);
+        for (size_t i = 1; i < port.packets.size() - 1; ++i) {
+            CHECK(port.packets[i].size() == PACKET_SIZE);
+        }
+        const auto st = buf.stats();
+        CHECK(st.txBytes == 1000);
+        CHECK(st.txPackets == port.packets.size());
+        CHECK(st.txTransfers < 6);
+    }
+
+    SECTION("sends a zero-length packet after a transfer that ends with a full-size packet") {
+        const auto data = pattern(128);
+        REQUIRE(buf.write((const uint8_t*)data.data(), data.size()) == 128);
+        drainTx(port, buf);
+        REQUIRE(port.packets.size() == 3);
+        CHECK(port.packets[2].empty());
+        CHECK(port.received == data);
+        CHECK(buf.stats().txPackets == 3);
+    }
+
+    SECTION("sends packets that cross the end of the ring through the bounce buffer") {
+        std::string expected;
+        for (unsigned i = 0; i < 20; ++i) {
+            const auto data = pattern(100, i);
+            REQUIRE(buf.write((const uint8_t*)data.data(), data.size()) == 100);
+            expected += data;
+            drainTx(port, buf);
+        }
+        CHECK(port.received == expected);
+        CHECK(buf.stats().txBounced > 0);
+        for (const auto& p: port.packets) {
+            CHECK(p.size() <= PACKET_SIZE);
+        }
+    }
+
+    SECTION("accepts only as much data as fits into the ring") {
+        const auto data = pattern(2000);
+        CHECK(buf.write((const uint8_t*)data.data(), data.size()) == 1024);
+        CHECK(buf.availableForWrite() == 0);
+        completeTx(port, buf);
+        CHECK(buf.availableForWrite() == 512);
+        CHECK(buf.write((const uint8_t*)data.data() + 1024, 976) == 512);
+        drainTx(port, buf);
+        CHECK(port.received == data.substr(0, 1536));
+    }
+
+    SECTION("discards the data that is not in flight on flushTx()") {
+        const auto data = pattern(100);
+        REQUIRE(buf.write((const uint8_t*)data.data(), 10) == 10);
+        REQUIRE(buf.write((const uint8_t*)data.data() + 10, 90) == 90);
+        buf.flushTx();
+        drainTx(port, buf);
+        CHECK(port.received == data.substr(0, 10));
+        CHECK(buf.availableForWrite() == 1024);
+    }
+
+    SECTION("keeps the ring intact when a transfer can't be started") {
+        port.txError = SYSTEM_ERROR_IO;
+        const auto data = pattern(10);
+        REQUIRE(buf.write((const uint8_t*)data.data(), data.size()) == 10);
+        CHECK_FALSE(buf.isTransmitting());
+        port.txError = 0;
+        REQUIRE(buf.write((const uint8_t*)data.data(), data.size()) == 10);
+        drainTx(port, buf);
+        CHECK(port.received == data + data);
+    }
+
+    SECTION("stops transmitting when the port is closed") {
+        const auto data = pattern(300);
+        REQUIRE(buf.write((const uint8_t*)data.data(), data.size()) == 300);
+        buf.close();
+        drainTx(port, buf);
+        CHECK(port.received.size() == 256);
+        CHECK(buf.write((const uint8_t*)data.data(), data.size()) == 0);
+    }
+
+    SECTION("receives packets directly into the ring") {
+        const auto data = pattern(64);
+        REQUIRE(sendPacket(port, buf, data));
+        CHECK(port.rxArmed.data == rxRing.data() + 64);
+        CHECK(buf.available() == 64);
+        CHECK(buf.peek() == 'a');
+        CHECK(readAll(buf) == data);
+        CHECK(buf.peek() == -1);
+    }
+
+    SECTION("stalls the OUT endpoint while the ring is full") {
+        std::string expected;
+        unsigned seed = 0;
+        while (sendPacket(port, buf, pattern(64, seed))) {
+            expected += pattern(64, seed++);
+        }
+        CHECK(buf.available() == 256);
+        CHECK(buf.stats().rxStalls == 1);
+        uint8_t data[10];
+        REQUIRE(buf.read(data, sizeof(data)) == 10);
+        CHECK_FALSE(port.rxArmed.data);
+        REQUIRE(buf.read(data, sizeof(data)) == 10);
+        REQUIRE(buf.read(data, sizeof(data)) == 10);
+        REQUIRE(buf.read(data, sizeof(data)) == 10);
+        REQUIRE(buf.read(data, sizeof(data)) == 10);
+        REQUIRE(buf.read(data, sizeof(data)) == 10);
+        REQUIRE(buf.read(data, sizeof(data)) == 10);
+        CHECK(port.rxArmed.data);
+        CHECK(readAll(buf) == expected.substr(70));
+    }
+
+    SECTION("receives packets that cross the end of the ring through the bounce buffer") {
+        std::string expected;
+        std::string received;
+        for (unsigned i = 0; i < 20; ++i) {
+            const auto data = pattern(50, i);
+            REQUIRE(sendPacket(port, buf, data));
+            expected += data;
+            received += readAll(buf);
+        }
+        CHECK(received == expected);
+        CHECK(buf.stats().rxBounced > 0);
+        CHECK(buf.stats().rxBytes == 1000);
+    }
+
+    SECTION("handles data that is received immediately when the OUT endpoint is armed") {
+        const auto data = pattern(100);
+        port.immediateData = data;
+        buf.flushRx();
+        REQUIRE(sendPacket(port, buf, "x"));
+        CHECK(readAll(buf) == "x" + data);
+        CHECK(port.rxArmed.data);
+    }
+
+    SECTION("exposes the received data in place until it is consumed") {
+        std::string expected;
+        unsigned seed = 0;
+        while (sendPacket(port, buf, pattern(64, seed))) {
+            expected += pattern(64, seed++);
+        }
+        const uint8_t* data = nullptr;
+        REQUIRE(buf.peekBuffer(&data) == 256);
+        CHECK(data == rxRing.data());
+        CHECK(std::string((const char*)data, 256) == expected);
+        CHECK(buf.consume(70) == 70);
+        // The OUT endpoint is rearmed once a packet fits into the ring again
+        CHECK(port.rxArmed.data);
+        REQUIRE(sendPacket(port, buf, pattern(64, seed)));
+        expected += pattern(64, seed);
+        // Only the data up to the end of the ring is contiguous
+        REQUIRE(buf.peekBuffer(&data) == 186);
+        CHECK(data == rxRing.data() + 70);
+        CHECK(buf.consume(186) == 186);
+        REQUIRE(buf.peekBuffer(&data) == 64);
+        CHECK(data == rxRing.data());
+        CHECK(std::string((const char*)data, 64) == expected.substr(256));
+        CHECK(buf.consume(1000) == 64);
+        CHECK(buf.peekBuffer(&data) == 0);
+        CHECK(buf.consume(1) == 0);
+    }
+
+    SECTION("discards the received data on flushRx()") {
+        REQUIRE(sendPacket(port, buf, pattern(30)));
+        buf.flushRx();
+        CHECK(buf.available() == 0);
+        REQUIRE(sendPacket(port, buf, "abc"));
+        CHECK(readAll(buf) == "abc");
+    }
+
+    SECTION("discards the buffered data when the port is reopened") {
+        const auto data = pattern(100);
+        REQUIRE(buf.write((const uint8_t*)data.data(), data.size()) == 100);
+        REQUIRE(sendPacket(port, buf, "abc"));
+        port.txPending.clear();
+        port.rxArmed = {};
+        buf.close();
+        buf.open();
+        CHECK(buf.available() == 0);
+        CHECK(buf.availableForWrite() == 1024);
+        CHECK(port.rxArmed.data == rxRing.data());
+    }
+}
+
+TEST_CASE("UsbCdcBuffer benchmark") {
+    const size_t total = 64 * 1024;
+    const size_t chunk = 100; // Typical length of a log line
+    const auto line = pattern(chunk);
+
+    const double perByte = measure([&]() {
+        PerByteCdc cdc(256);
+        std::string out;
+        for (size_t n = 0; n + chunk <= total; n += chunk) {
+            cdc.send((const uint8_t*)line.data(), chunk, &out);
+        }
+        cdc.flush(&out);
+        REQUIRE(out.size() == total / chunk * chunk);
+    }, 20);
+
+    const double bulk = measure([&]() {
+        SimulatedPort port;
+        Buffer buf(&port);
+        std::vector<uint8_t> rxRing(256);
+        std::vector<uint8_t> txRing(1024);
+        buf.init(rxRing.data(), rxRing.size(), txRing.data(), txRing.size());
+        buf.open();
+        for (size_t n = 0; n + chunk <= total; n += chunk) {
+            size_t offs = 0;
+            while ((offs += buf.write((const uint8_t*)line.data() + offs, chunk - offs)) < chunk) {
+                port.txPending.pop_front();
+                buf.txDone();
+            }
+        }
+        while (!port.txPending.empty()) {
+            port.txPending.pop_front();
+            buf.txDone();
+        }
+        REQUIRE(buf.stats().txBytes == total / chunk * chunk);
+    }, 20);
+
+    WARN("USB CDC: " << total / 1024 << " KB in " << chunk << "-byte writes: " << bulk << " us (per-byte: " <<
+            perByte << " us)");
+}
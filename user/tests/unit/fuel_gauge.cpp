@@ -41,3 +41,13 @@ SCENARIO("Fuel Gauge SOC_REGISTER conversion should return MSB.(LSB/256)%%", "[f
     REQUIRE(_getSoC(0x64, 0x00) == (float)100.0);
     REQUIRE(_getSoC(0xFF, 0xFF) == (float)255.99609375);
 }
+
+SCENARIO("Fuel Gauge normalized SoC is scaled to the capacity available at the charge voltage", "[fuel_gauge]") {
+    // At the default charge voltage of 4.112V the cell is considered full at 85% of the reported SoC
+    REQUIRE(_getNormalizedSoC(0.0f, 4112) == 0.0f);
+    REQUIRE(_getNormalizedSoC(42.5f, 4112) == Approx(50.0f));
+    REQUIRE(_getNormalizedSoC(85.0f, 4112) == Approx(100.0f));
+    REQUIRE(_getNormalizedSoC(99.0f, 4112) == 100.0f);
+    // Higher charge voltages make more capacity available
+    REQUIRE(_getNormalizedSoC(85.8f, 4208) == Approx(100.0f));
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_power_telemetry.h"
+
+#undef WARN
+#undef INFO
+#include "catch.hpp"
+
+#include <map>
+#include <cstddef>
+
+using particle::power::detail::PowerTelemetryCache;
+
+namespace {
+
+const uint8_t MAX17043_ADDRESS = 0x36;
+const uint8_t BQ24195_ADDRESS = 0x6b;
+
+// Simulated I2C bus with the fuel gauge and PMIC register maps
+class MockI2cBus {
+public:
+    MockI2cBus() :
+            transactions(0),
+            fail(false) {
+        registers[MAX17043_ADDRESS][0x02] = 0xd2; // VCELL: 3.936V
+        registers[MAX17043_ADDRESS][0x03] = 0x00;
+        registers[MAX17043_ADDRESS][0x04] = 0x50; // SOC: 80.5%
+        registers[MAX17043_ADDRESS][0x05] = 0x80;
+        registers[BQ24195_ADDRESS][0x04] = 0xb2; // Charge voltage: 4208mV
+        registers[BQ24195_ADDRESS][0x08] = 0x64; // Power good, fast charging
+        registers[BQ24195_ADDRESS][0x09] = 0x00;
+    }
+
+    int read(uint8_t address, uint8_t reg, uint8_t* data, size_t size) {
+        ++transactions;
+        ++reads[address][reg];
+        if (fail) {
+            return SYSTEM_ERROR_IO;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = registers[address][reg + i];
+        }
+        return 0;
+    }
+
+    std::map<uint8_t, std::map<uint8_t, uint8_t>> registers;
+    std::map<uint8_t, std::map<uint8_t, unsigned>> reads;
+    unsigned transactions;
+    bool fail;
+};
+
+class MockBackend {
+public:
+    MockBackend(MockI2cBus* bus, system_tick_t* time) :
+            bus_(bus),
+            time_(time) {
+    }
+
+    int readFuelGauge(uint8_t reg, uint16_t* value) {
+        uint8_t data[2] = {};
+        const int r = bus_->read(MAX17043_ADDRESS, reg, data, 2);
+        if (r < 0) {
+            return r;
+        }
+        *value = ((uint16_t)data[0] << 8) | data[1];
+        return 0;
+    }
+
+    int readPmic(uint8_t reg, uint8_t* value) {
+        return bus_->read(BQ24195_ADDRESS, reg, value, 1);
+    }
+
+    system_tick_t millis() {
+        return *time_;
+    }
+
+    void lock() {
+    }
+
+    void unlock() {
+    }
+
+private:
+    MockI2cBus* bus_;
+    system_tick_t* time_;
+};
+
+} // unnamed
+
+SCENARIO("Power telemetry is sampled on the first request", "[power_telemetry]") {
+    MockI2cBus bus;
+    system_tick_t time = 1000;
+    PowerTelemetryCache<MockBackend> cache(&bus, &time);
+    system_power_telemetry t = {};
+    t.size = sizeof(t);
+    REQUIRE(cache.get(&t, 1000) == 0);
+    CHECK(t.timestamp == 1000);
+    CHECK(t.vcell == 0xd200);
+    CHECK(t.soc == 0x5080);
+    CHECK(t.charge_voltage == 4208);
+    CHECK(t.pmic_status == 0x64);
+    CHECK(bus.transactions == 4);
+    CHECK(cache.stats().samples == 1);
+}
+
+SCENARIO("Power telemetry requests are served from the cache within the staleness bound", "[power_telemetry]") {
+    MockI2cBus bus;
+    system_tick_t time = 0;
+    PowerTelemetryCache<MockBackend> cache(&bus, &time);
+    system_power_telemetry t = {};
+    REQUIRE(cache.sample() == 0);
+    for (int i = 0; i < 10; ++i) {
+        time += 100;
+        REQUIRE(cache.get(&t, 1000) == 0);
+    }
+    CHECK(bus.transactions == 4);
+    CHECK(cache.stats().hits == 10);
+
+    // The readings are refreshed once they get too old for the consumer
+    bus.registers[MAX17043_ADDRESS][0x04] = 0x4f;
+    time += 1;
+    REQUIRE(cache.get(&t, 1000) == 0);
+    CHECK(t.soc == 0x4f80);
+    CHECK(t.timestamp == time);
+    CHECK(bus.transactions == 8);
+
+    // A stricter consumer causes a refresh while the others use the cached readings
+    time += 50;
+    REQUIRE(cache.get(&t, 10) == 0);
+    CHECK(bus.transactions == 12);
+    REQUIRE(cache.get(&t, 1000) == 0);
+    CHECK(bus.transactions == 12);
+}
+
+SCENARIO("Power telemetry is polled at the configured period", "[power_telemetry]") {
+    MockI2cBus bus;
+    system_tick_t time = 0;
+    PowerTelemetryCache<MockBackend> cache(&bus, &time);
+    // Polling is disabled by default
+    CHECK_FALSE(cache.poll());
+    cache.period(5000);
+    CHECK(cache.poll());
+    time += 4999;
+    CHECK_FALSE(cache.poll());
+    time += 1;
+    CHECK(cache.poll());
+    CHECK(cache.stats().samples == 2);
+    // On-demand samples restart the period
+    time += 3000;
+    system_power_telemetry t = {};
+    REQUIRE(cache.get(&t, 0) == 0);
+    time += 4000;
+    CHECK_FALSE(cache.poll());
+}
+
+SCENARIO("PMIC fault register is never read by the telemetry cache", "[power_telemetry]") {
+    MockI2cBus bus;
+    system_tick_t time = 0;
+    PowerTelemetryCache<MockBackend> cache(&bus, &time);
+    cache.period(1000);
+    for (int i = 0; i < 5; ++i) {
+        cache.poll();
+        time += 1000;
+    }
+    CHECK(bus.reads[BQ24195_ADDRESS][0x09] == 0);
+    // The fault register read by the power manager is stored instead
+    cache.updatePmic(0x60, 0x08);
+    system_power_telemetry t = {};
+    REQUIRE(cache.get(&t, 10000) == 0);
+    CHECK(t.pmic_status == 0x60);
+    CHECK(t.pmic_fault == 0x08);
+}
+
+SCENARIO("Failed power telemetry samples keep the cache invalid", "[power_telemetry]") {
+    MockI2cBus bus;
+    system_tick_t time = 0;
+    PowerTelemetryCache<MockBackend> cache(&bus, &time);
+    system_power_telemetry t = {};
+    bus.fail = true;
+    CHECK(cache.get(&t, 1000) == SYSTEM_ERROR_IO);
+    CHECK(cache.stats().errors == 1);
+    bus.fail = false;
+    REQUIRE(cache.get(&t, 1000) == 0);
+    CHECK(cache.stats().samples == 1);
+    // Invalidated readings are sampled again regardless of their age
+    cache.invalidate();
+    REQUIRE(cache.get(&t, 1000) == 0);
+    CHECK(cache.stats().samples == 2);
+    CHECK(cache.stats().hits == 0);
+}
+
+SCENARIO("Power telemetry is truncated to the size of the caller's structure", "[power_telemetry]") {
+    MockI2cBus bus;
+    system_tick_t time = 0;
+    PowerTelemetryCache<MockBackend> cache(&bus, &time);
+    system_power_telemetry t = {};
+    t.size = offsetof(system_power_telemetry, soc);
+    t.soc = 0x1234;
+    REQUIRE(cache.get(&t, 1000) == 0);
+    CHECK(t.size == offsetof(system_power_telemetry, soc));
+    CHECK(t.vcell == 0xd200);
+    CHECK(t.soc == 0x1234);
+}
@@ -3,6 +3,8 @@
 #include "tools/catch.h"
 #include "tools/alloc.h"
 
+#include <chrono>
+#include <functional>
 #include <type_traits>
 
 namespace {
@@ -153,6 +155,38 @@ inline Checker<spark::Vector<T, AllocatorT>> check(const spark::Vector<T, Alloca
     return Checker<spark::Vector<T, AllocatorT>>(vector);
 }
 
+// Allocator that counts the allocations
+class CountingAllocator {
+public:
+    static void* malloc(size_t size) {
+        ++s_count;
+        return test::DefaultAllocator::malloc(size);
+    }
+
+    static void* realloc(void* ptr, size_t size) {
+        ++s_count;
+        return test::DefaultAllocator::realloc(ptr, size);
+    }
+
+    static void free(void* ptr) {
+        test::DefaultAllocator::free(ptr);
+    }
+
+    static int count() {
+        return s_count;
+    }
+
+    static void reset() {
+        s_count = 0;
+        test::DefaultAllocator::reset();
+    }
+
+private:
+    static int s_count;
+};
+
+int CountingAllocator::s_count = 0;
+
 template<typename VectorT>
 void testVector() {
     using Vector = VectorT;
@@ -314,7 +348,7 @@ void testVector() {
             REQUIRE(a.insert(0, 1)); // i = 0
             check(a).values(1, 2, 4, 5).capacity(4);
             REQUIRE(a.insert(4, 6)); // i = size()
-            check(a).values(1, 2, 4, 5, 6).capacity(5);
+            check(a).values(1, 2, 4, 5, 6).capacity(6); // capacity grows by 50%
             REQUIRE(a.insert(2, 3)); // i = size() / 2
             check(a).values(1, 2, 3, 4, 5, 6).capacity(6);
             Vector b;
@@ -648,6 +682,158 @@ void testVector() {
         REQUIRE(a.append(4));
         check(a).values(1, 2, 3, 4).capacity(5);
     }
+
+    SECTION("trimToSize()") {
+        Vector a;
+        for (int i = 0; i < 10; ++i) {
+            REQUIRE(a.append(i));
+        }
+        check(a).values(0, 1, 2, 3, 4, 5, 6, 7, 8, 9).capacity(13);
+        REQUIRE(a.trimToSize());
+        check(a).values(0, 1, 2, 3, 4, 5, 6, 7, 8, 9).capacity(10);
+        a.clear();
+        REQUIRE(a.trimToSize());
+        check(a).size(0).capacity(0);
+    }
+}
+
+template<typename T>
+void testVectorGrowth() {
+    using Vector = spark::Vector<T, CountingAllocator>;
+
+    SECTION("append() allocates memory a logarithmic number of times") {
+        Vector a;
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(a.append(i));
+        }
+        REQUIRE(a.size() == 1000);
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(a.at(i) == i);
+        }
+        CHECK(CountingAllocator::count() <= 20);
+    }
+    SECTION("insert() allocates memory a logarithmic number of times") {
+        Vector a;
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(a.insert(a.size() / 2, 2, i));
+        }
+        REQUIRE(a.size() == 2000);
+        CHECK(CountingAllocator::count() <= 20);
+    }
+    SECTION("resize() by one element allocates memory a logarithmic number of times") {
+        Vector a;
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(a.resize(a.size() + 1));
+        }
+        CHECK(CountingAllocator::count() <= 20);
+    }
+}
+
+template<typename T>
+void testSmallVector() {
+    using SmallVector = spark::SmallVector<T, 4, CountingAllocator>;
+    using Vector = spark::Vector<T, CountingAllocator>;
+
+    SECTION("stores up to N elements without allocating memory") {
+        SmallVector a;
+        check(a).size(0).capacity(4);
+        REQUIRE(a.append(1));
+        REQUIRE(a.prepend(0));
+        REQUIRE(a.append(3));
+        REQUIRE(a.insert(2, 2));
+        check(a).values(0, 1, 2, 3).capacity(4);
+        a.removeAt(1);
+        REQUIRE(a.takeFirst() == 0);
+        check(a).values(2, 3).capacity(4);
+        REQUIRE(a.trimToSize()); // the inline storage can't be shrunk
+        check(a).values(2, 3).capacity(4);
+        const SmallVector b({ 1, 2, 3, 4 });
+        const SmallVector c(b);
+        const SmallVector d(3, 5);
+        check(c).values(1, 2, 3, 4).capacity(4);
+        check(d).values(5, 5, 5).capacity(4);
+        CHECK(CountingAllocator::count() == 0);
+    }
+    SECTION("doesn't add members to Vector") {
+        CHECK(sizeof(Vector) == sizeof(T*) + 2 * sizeof(int));
+    }
+    SECTION("moves the elements to the heap when it grows beyond N elements") {
+        SmallVector a({ 1, 2, 3, 4 });
+        const T* const inlineData = a.data();
+        REQUIRE(a.append(5));
+        check(a).values(1, 2, 3, 4, 5).capacity(6);
+        CHECK(a.data() != inlineData);
+        CHECK(CountingAllocator::count() == 1);
+        REQUIRE(a.reserve(10));
+        check(a).values(1, 2, 3, 4, 5).capacity(10);
+        a.removeAt(2, 3);
+        REQUIRE(a.trimToSize());
+        check(a).values(1, 2).capacity(2);
+        const SmallVector b(10);
+        check(b).size(10).capacity(10);
+    }
+    SECTION("can be used as Vector") {
+        SmallVector a({ 1, 2 });
+        Vector& v = a;
+        REQUIRE(v.append(3));
+        check(a).values(1, 2, 3).capacity(4);
+        const Vector b(a); // copy to the heap
+        check(b).values(1, 2, 3).capacity(3);
+        const Vector c(std::move(v)); // move from the inline storage
+        check(c).values(1, 2, 3).capacity(3);
+        check(a).size(0).capacity(4);
+        REQUIRE(a.append(4)); // the inline storage is still used
+        check(a).values(4).capacity(4);
+        Vector d({ 5, 6, 7, 8, 9 });
+        a = std::move(d); // take over the heap storage
+        check(a).values(5, 6, 7, 8, 9).capacity(5);
+        check(d).size(0).capacity(0);
+        a = c;
+        check(a).values(1, 2, 3).capacity(5);
+    }
+    SECTION("copy and move") {
+        SmallVector a({ 1, 2, 3 });
+        SmallVector b(std::move(a));
+        check(b).values(1, 2, 3).capacity(4);
+        check(a).size(0).capacity(4);
+        a = b;
+        check(a).values(1, 2, 3).capacity(4);
+        SmallVector c({ 4 });
+        c = std::move(a);
+        check(c).values(1, 2, 3).capacity(4);
+        check(a).size(0).capacity(4);
+        const SmallVector& ra = a;
+        a = ra; // self-assignment
+        SmallVector& rc = c;
+        c = std::move(rc);
+        check(c).values(1, 2, 3).capacity(4);
+        CHECK(CountingAllocator::count() == 0);
+        SmallVector d({ 1, 2, 3, 4, 5, 6 });
+        const T* const data = d.data();
+        SmallVector e(std::move(d)); // take over the heap storage
+        check(e).values(1, 2, 3, 4, 5, 6);
+        CHECK(e.data() == data);
+        check(d).size(0).capacity(0);
+    }
+    SECTION("swap()") {
+        SmallVector a({ 1, 2 });
+        SmallVector b({ 3, 4, 5 });
+        swap(a, b); // inline <-> inline
+        check(a).values(3, 4, 5).capacity(4);
+        check(b).values(1, 2).capacity(4);
+        Vector c({ 6, 7, 8, 9, 10 });
+        Vector& va = a;
+        swap(va, c); // inline <-> heap
+        check(a).values(6, 7, 8, 9, 10).capacity(5);
+        check(c).values(3, 4, 5).capacity(3);
+        Vector& vb = b;
+        swap(c, vb); // heap <-> inline
+        check(c).values(1, 2).capacity(2);
+        check(b).values(3, 4, 5).capacity(4); // the elements fit in the inline storage
+        swap(va, vb); // heap <-> inline
+        check(a).values(3, 4, 5);
+        check(b).values(6, 7, 8, 9, 10);
+    }
 }
 
 } // namespace
@@ -670,3 +856,107 @@ TEST_CASE("Vector<NonTrivialInt>") {
     test::DefaultAllocator::check();
     CHECK(NonTrivialInt::instanceCount() == 0);
 }
+
+TEST_CASE("Vector growth") {
+    SECTION("Vector<int>") {
+        CountingAllocator::reset();
+        testVectorGrowth<int>();
+        test::DefaultAllocator::check();
+    }
+    SECTION("Vector<NonTrivialInt>") {
+        CountingAllocator::reset();
+        testVectorGrowth<NonTrivialInt>();
+        test::DefaultAllocator::check();
+        CHECK(NonTrivialInt::instanceCount() == 0);
+    }
+}
+
+TEST_CASE("Vector benchmark") {
+    // Previous implementation: the capacity grows by the number of inserted elements
+    const auto exactGrowth = [](spark::Vector<NonTrivialInt>& v, int n) {
+        return v.reserve(v.size() + n);
+    };
+    const auto geometricGrowth = [](spark::Vector<NonTrivialInt>&, int) {
+        return true;
+    };
+    const auto measure = [](const char* name, int count, std::function<void(bool)> run) {
+        const auto t1 = std::chrono::steady_clock::now();
+        run(true);
+        const auto t2 = std::chrono::steady_clock::now();
+        run(false);
+        const auto t3 = std::chrono::steady_clock::now();
+        const double exactNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / count;
+        const double ns = std::chrono::duration<double, std::nano>(t3 - t2).count() / count;
+        CATCH_WARN(name << ": exact growth " << exactNs << " ns, geometric growth " << ns << " ns per element");
+    };
+    const int count = 5000;
+    measure("append()", count, [&](bool exact) {
+        const auto grow = exact ? exactGrowth : geometricGrowth;
+        spark::Vector<NonTrivialInt> v;
+        bool ok = true;
+        for (int i = 0; i < count; ++i) {
+            ok = ok && grow(v, 1) && v.append(i);
+        }
+        REQUIRE(ok);
+        REQUIRE(v.size() == count);
+    });
+    measure("insert() in the middle", count, [&](bool exact) {
+        const auto grow = exact ? exactGrowth : geometricGrowth;
+        spark::Vector<NonTrivialInt> v;
+        bool ok = true;
+        for (int i = 0; i < count; ++i) {
+            ok = ok && grow(v, 1) && v.insert(v.size() / 2, i);
+        }
+        REQUIRE(ok);
+        REQUIRE(v.size() == count);
+    });
+    measure("append() and removeAt() from the front", count, [&](bool exact) {
+        const auto grow = exact ? exactGrowth : geometricGrowth;
+        spark::Vector<NonTrivialInt> v;
+        bool ok = true;
+        for (int i = 0; i < count; ++i) {
+            ok = ok && grow(v, 1) && v.append(i);
+            if (v.size() > 16) {
+                v.removeAt(0);
+            }
+        }
+        REQUIRE(ok);
+        REQUIRE(v.size() == 16);
+    });
+    const int smallCount = 100000;
+    bool ok = true;
+    const auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < smallCount; ++i) {
+        spark::Vector<int> v;
+        ok = ok && v.reserve(8);
+        for (int j = 0; j < 8; ++j) {
+            ok = ok && v.append(j);
+        }
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    for (int i = 0; i < smallCount; ++i) {
+        spark::SmallVector<int, 8> v;
+        for (int j = 0; j < 8; ++j) {
+            ok = ok && v.append(j);
+        }
+    }
+    const auto t3 = std::chrono::steady_clock::now();
+    REQUIRE(ok);
+    const double vectorNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / smallCount;
+    const double smallVectorNs = std::chrono::duration<double, std::nano>(t3 - t2).count() / smallCount;
+    CATCH_WARN("8 elements in a temporary vector: Vector " << vectorNs << " ns, SmallVector " << smallVectorNs << " ns");
+    CHECK(NonTrivialInt::instanceCount() == 0);
+}
+
+TEST_CASE("SmallVector<int>") {
+    CountingAllocator::reset();
+    testSmallVector<int>();
+    test::DefaultAllocator::check();
+}
+
+TEST_CASE("SmallVector<NonTrivialInt>") {
+    CountingAllocator::reset();
+    testSmallVector<NonTrivialInt>();
+    test::DefaultAllocator::check();
+    CHECK(NonTrivialInt::instanceCount() == 0);
+}
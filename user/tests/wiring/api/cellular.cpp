@@ -148,4 +148,9 @@ test(api_cellular_registration_timeout_set) {
     API_COMPILE(cellular_registration_timeout_set(60 * 60 * 1000, nullptr)); // 60 minutes
 }
 
+test(api_cellular_network_provider_apn_get) {
+    char apn[64] = {};
+    API_COMPILE(cellular_network_provider_apn_get(apn, sizeof(apn), nullptr));
+}
+
 #endif
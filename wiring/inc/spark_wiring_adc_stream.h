@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "spark_wiring_interrupt_dispatch.h"
+#include "adc_hal.h"
+#include "concurrent_hal.h"
+#include "system_error.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Block of samples acquired by an `AdcStream`.
+ */
+struct AdcBlock {
+    const int16_t* samples; // Samples of all channels, interleaved
+    size_t frames; // Number of samples per channel
+    size_t channels;
+    uint32_t sequence; // Sequence number of the block, including dropped blocks
+    uint32_t timestamp; // Time the block was completed, in microseconds
+    uint8_t index; // Index of the block's buffer
+};
+
+/**
+ * Acquisition statistics.
+ */
+struct AdcStreamStats {
+    uint32_t blocks; // Blocks delivered to the consumer
+    uint32_t overruns; // Blocks dropped because the consumer didn't release buffers in time
+    uint32_t maxQueued; // Maximum number of blocks waiting for the consumer
+};
+
+namespace detail {
+
+/**
+ * Pool of sample buffers passed between the acquisition interrupt and a consumer.
+ *
+ * The producer fills a buffer, hands it over with `bufferFilled()` and gets a free buffer in
+ * exchange. The consumer takes filled blocks and releases them back to the pool. Both directions
+ * use lock-free queues, so neither side ever blocks the other.
+ */
+class AdcBlockPipeline {
+public:
+    static const size_t MAX_BLOCKS = 8;
+
+    AdcBlockPipeline() :
+            channels_(0),
+            frames_(0),
+            count_(0),
+            sequence_(0),
+            queued_(0),
+            delivered_(0),
+            overruns_(0),
+            maxQueued_(0) {
+    }
+
+    /**
+     * Allocates `count` buffers of `frames` samples per channel.
+     */
+    int init(size_t channels, size_t frames, size_t count) {
+        if (!channels || !frames || count < 3 || count > MAX_BLOCKS) {
+            // Two buffers are owned by the producer at any time
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        reset();
+        buf_.reset(new(std::nothrow) int16_t[channels * frames * count]);
+        if (!buf_) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        channels_ = channels;
+        frames_ = frames;
+        count_ = count;
+        for (size_t i = 0; i < count; ++i) {
+            free_.push((uint8_t)i);
+        }
+        return 0;
+    }
+
+    void reset() {
+        uint8_t index = 0;
+        while (free_.pop(&index)) {
+        }
+        while (filled_.pop(&index)) {
+        }
+        buf_.reset();
+        count_ = 0;
+        sequence_ = 0;
+        queued_.store(0, std::memory_order_relaxed);
+        delivered_.store(0, std::memory_order_relaxed);
+        overruns_.store(0, std::memory_order_relaxed);
+        maxQueued_.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Takes a free buffer for the producer. Returns `nullptr` if no buffers are available.
+     */
+    int16_t* acquire() {
+        uint8_t index = 0;
+        if (!free_.pop(&index)) {
+            return nullptr;
+        }
+        return buffer(index);
+    }
+
+    /**
+     * Hands a filled buffer over to the consumer and returns the next buffer to fill. If the
+     * consumer hasn't released any buffers, the samples are dropped and the same buffer is
+     * returned. This method is called in the interrupt context.
+     */
+    int16_t* bufferFilled(int16_t* buf, uint32_t timestamp) {
+        const uint8_t index = indexOf(buf);
+        const uint32_t seq = sequence_++;
+        uint8_t next = 0;
+        if (!free_.pop(&next)) {
+            overruns_.fetch_add(1, std::memory_order_relaxed);
+            return buf;
+        }
+        Header& h = headers_[index];
+        h.sequence = seq;
+        h.timestamp = timestamp;
+        filled_.push(index);
+        const uint32_t queued = queued_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (queued > maxQueued_.load(std::memory_order_relaxed)) {
+            maxQueued_.store(queued, std::memory_order_relaxed);
+        }
+        return buffer(next);
+    }
+
+    /**
+     * Takes the oldest filled block. The block must be released with `release()`.
+     */
+    bool take(AdcBlock* block) {
+        uint8_t index = 0;
+        if (!filled_.pop(&index)) {
+            return false;
+        }
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        block->samples = buffer(index);
+        block->frames = frames_;
+        block->channels = channels_;
+        block->sequence = headers_[index].sequence;
+        block->timestamp = headers_[index].timestamp;
+        block->index = index;
+        return true;
+    }
+
+    void release(const AdcBlock& block) {
+        delivered_.fetch_add(1, std::memory_order_relaxed);
+        free_.push(block.index);
+    }
+
+    size_t queued() const {
+        return queued_.load(std::memory_order_relaxed);
+    }
+
+    size_t blockSamples() const {
+        return channels_ * frames_;
+    }
+
+    AdcStreamStats stats() const {
+        AdcStreamStats st = {};
+        st.blocks = delivered_.load(std::memory_order_relaxed);
+        st.overruns = overruns_.load(std::memory_order_relaxed);
+        st.maxQueued = maxQueued_.load(std::memory_order_relaxed);
+        return st;
+    }
+
+private:
+    struct Header {
+        uint32_t sequence;
+        uint32_t timestamp;
+    };
+
+    std::unique_ptr<int16_t[]> buf_;
+    Header headers_[MAX_BLOCKS];
+    InterruptEventQueue<uint8_t, MAX_BLOCKS> free_;
+    InterruptEventQueue<uint8_t, MAX_BLOCKS> filled_;
+    size_t channels_;
+    size_t frames_;
+    size_t count_;
+    uint32_t sequence_; // Accessed by the producer only
+    std::atomic<uint32_t> queued_;
+    std::atomic<uint32_t> delivered_;
+    std::atomic<uint32_t> overruns_;
+    std::atomic<uint32_t> maxQueued_;
+
+    int16_t* buffer(uint8_t index) const {
+        return buf_.get() + index * blockSamples();
+    }
+
+    uint8_t indexOf(const int16_t* buf) const {
+        return (uint8_t)((buf - buf_.get()) / blockSamples());
+    }
+};
+
+} // particle::detail
+
+/**
+ * Continuous timer-triggered sampling of several analog channels.
+ *
+ * Samples are written by DMA into a pool of buffers. Completed blocks are passed to the handler,
+ * which runs in a dedicated thread on threaded platforms. Otherwise `process()` has to be called
+ * from the application loop. If the handler doesn't keep up, blocks are dropped and counted as
+ * overruns instead of stalling the acquisition.
+ *
+ * `analogRead()` returns 0 while the stream is running.
+ *
+ * @code
+ * const pin_t pins[] = { A0, A1, A2 };
+ * AdcStream stream;
+ * stream.begin(pins, 3, 4000, 256, 4, [](const AdcBlock& block) {
+ *     // block.samples holds 256 frames of 3 interleaved samples
+ * });
+ * @endcode
+ */
+class AdcStream {
+public:
+    typedef std::function<void(const AdcBlock&)> Handler;
+
+    AdcStream();
+    ~AdcStream();
+
+    /**
+     * Starts sampling.
+     *
+     * @param pins Pins to sample on each tick.
+     * @param pinCount Number of pins.
+     * @param sampleRate Ticks per second.
+     * @param frames Number of ticks per block.
+     * @param blocks Number of buffers in the pool, including the two owned by the DMA.
+     * @param handler Block handler.
+     */
+    int begin(const pin_t* pins, size_t pinCount, uint32_t sampleRate, size_t frames, size_t blocks, Handler handler);
+    void end();
+
+    /**
+     * Passes the completed blocks to the handler.
+     *
+     * @return Number of handled blocks.
+     */
+    size_t process();
+
+    bool isRunning() const {
+        return running_;
+    }
+
+    AdcStreamStats stats() const {
+        return pipeline_.stats();
+    }
+
+private:
+    detail::AdcBlockPipeline pipeline_;
+    Handler handler_;
+#if PLATFORM_THREADING
+    os_thread_t thread_;
+    os_semaphore_t sem_;
+    volatile bool exit_;
+#endif
+    volatile bool running_;
+
+    static int16_t* bufferFilled(int16_t* buf, size_t samples, void* data);
+#if PLATFORM_THREADING
+    static os_thread_return_t run(void* data);
+#endif
+};
+
+} // particle
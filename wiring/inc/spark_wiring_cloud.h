@@ -335,6 +335,19 @@ public:
         return spark_sync_time_last(&tm, nullptr);
     }
 
+    /**
+     * Returns the quality of the time received from the cloud: the estimated error of the current
+     * time, the measured drift of the local clock and the time until the next automatic
+     * synchronization.
+     */
+    time_sync_quality timeSyncedQuality(void)
+    {
+        time_sync_quality quality = {};
+        quality.size = sizeof(quality);
+        spark_sync_time_quality(&quality, nullptr);
+        return quality;
+    }
+
     static void sleep(long seconds) __attribute__ ((deprecated("Please use System.sleep() instead.")))
     { SystemClass::sleep(seconds); }
     static void sleep(Spark_Sleep_TypeDef sleepMode, long seconds=0) __attribute__ ((deprecated("Please use System.sleep() instead.")))
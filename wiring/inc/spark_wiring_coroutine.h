@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "spark_wiring_async.h"
+#include "spark_wiring_interrupts.h"
+#include "timer_hal.h"
+
+#include <type_traits>
+#include <atomic>
+#include <memory>
+
+/**
+ * Starts the body of `CoTask::run()`.
+ *
+ * Tasks are stackless: local variables are not preserved across the suspension points, so the
+ * state of a task has to be kept in its member variables. The suspension macros can't be used
+ * inside a `switch` statement of the task's own.
+ *
+ * Suspension points are identified by their line numbers, so there can be at most one
+ * `CO_YIELD()`, `CO_SLEEP()` or `CO_AWAIT()` per line.
+ */
+#define CO_BEGIN() \
+        switch (this->coLine_) { \
+        case 0:
+
+/**
+ * Ends the body of `CoTask::run()`. The task completes when it reaches this point.
+ */
+#define CO_END() \
+        } \
+        this->coFinish(); \
+        return
+
+/**
+ * Suspends the task until the next call to `CoScheduler::process()`.
+ */
+#define CO_YIELD() \
+        CO_YIELD_IMPL(__LINE__)
+
+/**
+ * Suspends the task for the given number of milliseconds.
+ */
+#define CO_SLEEP(ms) \
+        CO_SLEEP_IMPL(ms, __LINE__)
+
+/**
+ * Suspends the task until an awaitable object is ready.
+ *
+ * The argument can be a boolean condition, which is re-evaluated every time the scheduler runs,
+ * a `Future`, or an object providing a `bool ready()` method and, optionally, a
+ * `void subscribe(CoTask&)` method arranging for `CoTask::wake()` to be called once the object
+ * may be ready. The argument is evaluated every time the task is resumed, so futures and other
+ * stateful awaitables need to be stored in member variables of the task.
+ *
+ * Awaiting a `Future` sets its `onSuccess()` and `onError()` callbacks once per suspension,
+ * replacing any callbacks set on the future before. Callbacks set on the future while the task is
+ * waiting on it prevent the task from being woken up. The callbacks stop waking the task once it
+ * is stopped or destroyed, so a future may outlive the task awaiting it.
+ */
+#define CO_AWAIT(awaitable) \
+        CO_AWAIT_IMPL(awaitable, __LINE__)
+
+// Each suspension point is identified by its line number. Unlike __COUNTER__, __LINE__ expands to
+// the same value in every translation unit, so run() can be defined inline in a header
+#define CO_YIELD_IMPL(point) \
+        do { \
+            this->coLine_ = point; \
+            this->coYield(); \
+            return; \
+        case point: ; \
+        } while (false)
+
+#define CO_SLEEP_IMPL(ms, point) \
+        do { \
+            this->coSleep(ms); \
+            this->coLine_ = point; \
+        case point: \
+            if (!this->coSleepDone()) { \
+                return; \
+            } \
+        } while (false)
+
+#define CO_AWAIT_IMPL(awaitable, point) \
+        do { \
+            this->coLine_ = point; \
+        case point: \
+            if (!::particle::detail::coAwait(*this, awaitable)) { \
+                return; \
+            } \
+        } while (false)
+
+namespace particle {
+
+class CoScheduler;
+
+/**
+ * Cooperative task.
+ *
+ * Subclasses implement `run()` using the `CO_BEGIN()`, `CO_END()` and suspension macros. A task
+ * takes a few dozen bytes of RAM and runs on the stack of the thread that calls
+ * `CoScheduler::process()`.
+ */
+class CoTask {
+public:
+    CoTask() :
+            coLine_(0),
+            sched_(nullptr),
+            next_(nullptr),
+            deadline_(0),
+            state_(RUNNABLE),
+            woken_(false),
+            subscribed_(false) {
+    }
+
+    virtual ~CoTask();
+
+    /**
+     * Makes the task runnable. This method can be called from any thread or an interrupt handler.
+     */
+    void wake();
+
+    bool isDone() const {
+        return state_ == DONE;
+    }
+
+    bool isStarted() const {
+        return sched_ != nullptr;
+    }
+
+    // Methods used by awaitables
+    void coPoll() {
+        state_ = POLLING;
+    }
+
+    void coWait() {
+        state_ = WAITING;
+    }
+
+    // Set while the task is subscribed to the awaitable it is waiting on
+    bool coSubscribed() const {
+        return subscribed_;
+    }
+
+    void coSubscribed(bool subscribed) {
+        subscribed_ = subscribed;
+    }
+
+    // Returns a reference to the task that is cleared when the task is stopped or destroyed. Used by
+    // callbacks that may be invoked after that
+    std::shared_ptr<CoTask*> coWakeRef();
+
+protected:
+    int coLine_; // Suspension point, managed by the macros
+
+    /**
+     * Runs the task until its next suspension point.
+     */
+    virtual void run() = 0;
+
+    // Methods used by the macros
+    void coYield() {
+        state_ = RUNNABLE;
+    }
+
+    void coSleep(system_tick_t ms);
+    bool coSleepDone();
+
+    void coFinish() {
+        coLine_ = 0;
+        state_ = DONE;
+    }
+
+private:
+    enum State {
+        RUNNABLE, // Runs on the next iteration of the scheduler
+        POLLING, // Runs on every iteration of the scheduler
+        SLEEPING, // Runs when the deadline expires
+        WAITING, // Runs when woken up
+        DONE
+    };
+
+    CoScheduler* sched_;
+    CoTask* next_;
+    system_tick_t deadline_;
+    volatile State state_;
+    std::atomic<bool> woken_;
+    bool subscribed_;
+    std::shared_ptr<CoTask*> wakeRef_;
+
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+
+    void coUnsubscribe();
+
+    friend class CoScheduler;
+};
+
+/**
+ * Runs cooperative tasks.
+ *
+ * `process()` resumes the tasks that are ready to run and is normally called from `loop()`.
+ * When a waiting task is woken up, the scheduler posts a call to `process()` to the application
+ * thread's event queue, so that the task is resumed while the application is waiting in `delay()`
+ * or a blocking call that pumps events. Events can't be posted from an interrupt handler, so a
+ * wakeup in the interrupt context is only picked up by the next call to `process()`.
+ */
+class CoScheduler {
+public:
+    typedef bool (*InvokeCallbackFn)(void (*callback)(void* data), void* data);
+    typedef system_tick_t (*ClockFn)();
+
+    explicit CoScheduler(InvokeCallbackFn invoke = detail::FutureContext::invokeApplicationCallback,
+            ClockFn clock = HAL_Timer_Get_Milli_Seconds) :
+            invoke_(invoke),
+            clock_(clock),
+            tasks_(nullptr),
+            iterNext_(nullptr),
+            running_(false),
+            rerun_(false),
+            posted_(false) {
+    }
+
+    ~CoScheduler();
+
+    /**
+     * Adds a task to the scheduler. The task runs on the next call to `process()`.
+     */
+    void start(CoTask* task);
+
+    /**
+     * Removes a task from the scheduler.
+     */
+    void stop(CoTask* task);
+
+    /**
+     * Resumes the tasks that are ready to run. Completed tasks are removed from the scheduler.
+     *
+     * @return Number of resumed tasks.
+     */
+    size_t process();
+
+    /**
+     * Returns the number of tasks that haven't completed.
+     */
+    size_t taskCount() const;
+
+    system_tick_t now() const {
+        return clock_();
+    }
+
+    static CoScheduler* instance();
+
+private:
+    InvokeCallbackFn invoke_;
+    ClockFn clock_;
+    CoTask* tasks_;
+    CoTask* iterNext_;
+    bool running_;
+    bool rerun_;
+    std::atomic<bool> posted_;
+
+    void notify();
+    void unlink(CoTask* task);
+
+    static void processCallback(void* data);
+
+    friend class CoTask;
+};
+
+/**
+ * Awaitable counting the edges on a pin.
+ *
+ * Each edge completes one `CO_AWAIT()`. `notify()` is meant to be attached as an interrupt
+ * handler. A task woken up in the interrupt context is only resumed by the next call to
+ * `CoScheduler::process()`, e.g. in `loop()`. A deferred handler wakes up the task without that
+ * delay, even while the application is waiting in `delay()`:
+ *
+ * ```
+ * attachInterruptDeferred(D2, [&event]() { event.notify(); }, FALLING);
+ * ```
+ */
+class CoPinEvent {
+public:
+    CoPinEvent() :
+            task_(nullptr),
+            count_(0) {
+    }
+
+    // Called for each edge
+    void notify() {
+        count_.fetch_add(1, std::memory_order_relaxed);
+        CoTask* const task = task_;
+        if (task) {
+            task->wake();
+        }
+    }
+
+    bool ready() {
+        unsigned n = count_.load(std::memory_order_relaxed);
+        while (n > 0) {
+            if (count_.compare_exchange_weak(n, n - 1, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void subscribe(CoTask& task) {
+        task_ = &task;
+    }
+
+private:
+    CoTask* volatile task_;
+    std::atomic<unsigned> count_;
+};
+
+/**
+ * Awaitable that is ready when a client has data to read or is disconnected.
+ *
+ * There is no readiness notification for sockets, so the task is polled.
+ */
+template<typename ClientT>
+class CoReadable {
+public:
+    explicit CoReadable(ClientT& client) :
+            client_(client) {
+    }
+
+    bool ready() {
+        return client_.available() > 0 || !client_.connected();
+    }
+
+private:
+    ClientT& client_;
+};
+
+template<typename ClientT>
+inline CoReadable<ClientT> coReadable(ClientT& client) {
+    return CoReadable<ClientT>(client);
+}
+
+namespace detail {
+
+template<typename T>
+inline auto coSubscribe(CoTask& task, T& awaitable, int) -> decltype(awaitable.subscribe(task), bool()) {
+    awaitable.subscribe(task);
+    return true;
+}
+
+template<typename T>
+inline bool coSubscribe(CoTask& task, T& awaitable, long) {
+    return false;
+}
+
+template<typename T>
+inline auto coAwaitImpl(CoTask& task, T& awaitable, int) -> decltype(awaitable.ready(), bool()) {
+    if (awaitable.ready()) {
+        return true;
+    }
+    if (coSubscribe(task, awaitable, 0)) {
+        task.coWait();
+        // The awaitable may have become ready before the subscription
+        return awaitable.ready();
+    }
+    task.coPoll();
+    return false;
+}
+
+template<typename ResultT, typename ContextT>
+inline bool coAwaitImpl(CoTask& task, Future<ResultT, ContextT>& future, int) {
+    if (future.isDone()) {
+        task.coSubscribed(false);
+        return true;
+    }
+    task.coWait();
+    if (!task.coSubscribed()) {
+        // Setting a callback replaces the previous one, so this is done only once, and not every
+        // time the task is woken up for another reason
+        const auto wake = [ref = task.coWakeRef()](const auto&... args) {
+            CoTask* const task = *ref;
+            if (task) {
+                task->wake();
+            }
+        };
+        future.onSuccess(wake);
+        future.onError(wake);
+        task.coSubscribed(true);
+    }
+    return false;
+}
+
+inline bool coAwaitImpl(CoTask& task, bool ready, long) {
+    if (!ready) {
+        task.coPoll();
+    }
+    return ready;
+}
+
+template<typename T>
+inline bool coAwait(CoTask& task, T&& awaitable) {
+    return coAwaitImpl(task, awaitable, 0);
+}
+
+} // particle::detail
+
+inline CoTask::~CoTask() {
+    if (sched_) {
+        sched_->stop(this);
+    }
+    coUnsubscribe();
+}
+
+inline std::shared_ptr<CoTask*> CoTask::coWakeRef() {
+    if (!wakeRef_) {
+        wakeRef_ = std::make_shared<CoTask*>(this);
+    }
+    return wakeRef_;
+}
+
+inline void CoTask::coUnsubscribe() {
+    // Callbacks of the awaitables the task was subscribed to may still be invoked
+    if (wakeRef_) {
+        *wakeRef_ = nullptr;
+        wakeRef_.reset();
+    }
+    subscribed_ = false;
+}
+
+inline void CoTask::wake() {
+    woken_.store(true, std::memory_order_release);
+    CoScheduler* const sched = sched_;
+    if (sched) {
+        sched->notify();
+    }
+}
+
+inline void CoTask::coSleep(system_tick_t ms) {
+    deadline_ = sched_->now() + ms;
+}
+
+inline bool CoTask::coSleepDone() {
+    if ((int32_t)(sched_->now() - deadline_) >= 0) {
+        return true;
+    }
+    state_ = SLEEPING;
+    return false;
+}
+
+inline CoScheduler::~CoScheduler() {
+    while (tasks_) {
+        stop(tasks_);
+    }
+}
+
+inline void CoScheduler::start(CoTask* task) {
+    if (task->sched_) {
+        task->sched_->stop(task);
+    }
+    task->coLine_ = 0;
+    task->state_ = CoTask::RUNNABLE;
+    task->woken_.store(false, std::memory_order_relaxed);
+    task->coUnsubscribe();
+    task->next_ = tasks_;
+    task->sched_ = this;
+    tasks_ = task;
+    if (running_) {
+        rerun_ = true;
+    }
+}
+
+inline void CoScheduler::stop(CoTask* task) {
+    if (task->sched_ == this) {
+        unlink(task);
+        task->sched_ = nullptr;
+        task->coUnsubscribe();
+    }
+}
+
+inline size_t CoScheduler::process() {
+    if (running_) {
+        // Called from a task, e.g. via a synchronously invoked completion callback
+        rerun_ = true;
+        return 0;
+    }
+    running_ = true;
+    size_t count = 0;
+    do {
+        rerun_ = false;
+        posted_.store(false, std::memory_order_relaxed);
+        const system_tick_t now = clock_();
+        for (CoTask* task = tasks_; task; task = iterNext_) {
+            iterNext_ = task->next_;
+            const bool woken = task->woken_.exchange(false, std::memory_order_acq_rel);
+            switch (task->state_) {
+            case CoTask::SLEEPING:
+                if (!woken && (int32_t)(now - task->deadline_) < 0) {
+                    continue;
+                }
+                break;
+            case CoTask::WAITING:
+                if (!woken) {
+                    continue;
+                }
+                break;
+            default:
+                break;
+            }
+            task->coWait();
+            task->run();
+            ++count;
+            if (task->isDone() && task->sched_ == this) {
+                unlink(task);
+                task->sched_ = nullptr;
+            }
+        }
+        iterNext_ = nullptr;
+    } while (rerun_);
+    running_ = false;
+    return count;
+}
+
+inline size_t CoScheduler::taskCount() const {
+    size_t n = 0;
+    for (CoTask* task = tasks_; task; task = task->next_) {
+        ++n;
+    }
+    return n;
+}
+
+inline CoScheduler* CoScheduler::instance() {
+    static CoScheduler sched;
+    return &sched;
+}
+
+inline void CoScheduler::notify() {
+    // Events can't be posted from an interrupt handler, the next iteration of the application
+    // loop will pick up the task
+    if (!HAL_IsISR() && !posted_.exchange(true, std::memory_order_acq_rel)) {
+        if (!invoke_(processCallback, this)) {
+            posted_.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+inline void CoScheduler::unlink(CoTask* task) {
+    if (iterNext_ == task) {
+        iterNext_ = task->next_;
+    }
+    for (CoTask** t = &tasks_; *t; t = &(*t)->next_) {
+        if (*t == task) {
+            *t = task->next_;
+            break;
+        }
+    }
+    task->next_ = nullptr;
+}
+
+inline void CoScheduler::processCallback(void* data) {
+    static_cast<CoScheduler*>(data)->process();
+}
+
+} // particle
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "spark_wiring_fixed_point.h"
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+namespace dsp {
+
+/**
+ * Returns the name of the backend the kernels were compiled for: "arm-dsp" on Cortex-M cores with
+ * the DSP extension, "sse2" on x86 hosts, or "scalar".
+ */
+const char* backendName();
+
+// Conversion between floating point and fractional values. Out of range values are saturated
+Q15 toQ15(float value);
+Q31 toQ31(float value);
+void toQ15(const float* src, Q15* dest, size_t count);
+void toQ31(const float* src, Q31* dest, size_t count);
+void toFloat(const Q15* src, float* dest, size_t count);
+void toFloat(const Q31* src, float* dest, size_t count);
+
+// Root mean square of a signal
+float rms(const float* src, size_t count);
+Q15 rms(const Q15* src, size_t count);
+Q31 rms(const Q31* src, size_t count);
+
+// Maximum absolute value of a signal. The index of the first peak sample is stored in `index`
+float peak(const float* src, size_t count, size_t* index = nullptr);
+Q15 peak(const Q15* src, size_t count, size_t* index = nullptr);
+Q31 peak(const Q31* src, size_t count, size_t* index = nullptr);
+
+/**
+ * Finite impulse response filter.
+ *
+ * `T` is `float`, `Q15` or `Q31`. Fixed point filters accumulate the products in 64 bits and
+ * saturate the output.
+ */
+template<typename T>
+class FirFilter {
+public:
+    FirFilter();
+
+    /**
+     * Sets the filter coefficients `b[0]...b[taps - 1]` and clears the state.
+     */
+    int init(const T* coeffs, size_t taps);
+
+    void process(const T* src, T* dest, size_t count);
+    void reset();
+
+    // Building blocks of `process()`: adds a sample to the delay line and computes the output
+    void push(T sample);
+    T compute() const;
+
+    size_t taps() const {
+        return taps_;
+    }
+
+private:
+    // Coefficients are stored in reverse order, and the delay line is stored twice, so that every
+    // output is a dot product of two contiguous arrays
+    std::unique_ptr<T[]> coeffs_;
+    std::unique_ptr<T[]> state_;
+    size_t taps_;
+    size_t pos_;
+};
+
+/**
+ * FIR filter followed by downsampling. Only the retained outputs are computed.
+ */
+template<typename T>
+class FirDecimator {
+public:
+    FirDecimator();
+
+    int init(const T* coeffs, size_t taps, size_t factor);
+
+    /**
+     * Filters and downsamples a block of samples.
+     *
+     * @return Number of output samples.
+     */
+    size_t process(const T* src, T* dest, size_t count);
+    void reset();
+
+private:
+    FirFilter<T> fir_;
+    size_t factor_;
+    size_t phase_;
+};
+
+/**
+ * Cascade of second order IIR sections.
+ *
+ * Each stage has 5 coefficients `{ b0, b1, b2, a1, a2 }`, and computes
+ * `y[n] = b0 * x[n] + b1 * x[n - 1] + b2 * x[n - 2] - a1 * y[n - 1] - a2 * y[n - 2]`.
+ *
+ * Fixed point coefficients are scaled by `2^-postShift` so that coefficients larger than 1.0 can
+ * be represented, and the output of each stage is scaled back by `2^postShift`.
+ */
+template<typename T>
+class BiquadCascade {
+public:
+    BiquadCascade();
+
+    int init(const T* coeffs, size_t stages, unsigned postShift = 0);
+    void process(const T* src, T* dest, size_t count);
+    void reset();
+
+    size_t stages() const {
+        return stages_;
+    }
+
+private:
+    std::unique_ptr<T[]> coeffs_;
+    std::unique_ptr<T[]> state_; // 4 values per stage
+    size_t stages_;
+    unsigned postShift_;
+};
+
+/**
+ * Fast Fourier transform of a real signal.
+ *
+ * The spectrum is stored in the packed format: `out[0]` and `out[1]` hold the real parts of
+ * the DC and Nyquist bins, and `out[2 * k]` and `out[2 * k + 1]` hold the real and imaginary parts
+ * of the bin `k`, for `0 < k < size / 2`.
+ */
+class RealFft {
+public:
+    RealFft();
+
+    /**
+     * Prepares the tables for a transform of `size` points. `size` must be a power of two
+     * between 4 and 4096.
+     */
+    int init(size_t size);
+
+    /**
+     * Computes the spectrum of `size` samples.
+     */
+    void forward(const float* src, float* dest) const;
+
+    /**
+     * Computes the magnitudes of the `size / 2 + 1` bins of a packed spectrum.
+     */
+    void magnitude(const float* spectrum, float* dest) const;
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    std::unique_ptr<float[]> twiddles_; // exp(-2 * pi * i * k / size), for 0 <= k < size / 2
+    std::unique_ptr<uint16_t[]> bitrev_;
+    size_t size_;
+};
+
+namespace detail {
+
+// Dot products and reductions used by the filters. The `Scalar` variants are portable reference
+// implementations of the backend-specific ones
+float dot(const float* a, const float* b, size_t count);
+float dotScalar(const float* a, const float* b, size_t count);
+int64_t dot(const int16_t* a, const int16_t* b, size_t count);
+int64_t dotScalar(const int16_t* a, const int16_t* b, size_t count);
+int64_t dot(const int32_t* a, const int32_t* b, size_t count);
+int64_t sumSquares(const int16_t* src, size_t count);
+int64_t sumSquaresScalar(const int16_t* src, size_t count);
+int16_t peak(const int16_t* src, size_t count);
+int16_t peakScalar(const int16_t* src, size_t count);
+
+} // particle::dsp::detail
+
+} // particle::dsp
+
+} // particle
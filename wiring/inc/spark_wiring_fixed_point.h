@@ -89,4 +89,11 @@ using FixedPointSQ = FixedPointQ<true, M - 1, N>;
 template <size_t M, size_t N>
 using FixedPointUQ = FixedPointQ<false, M, N>;
 
+// Fractional formats used by the DSP functions. Arrays of these types have the same layout as
+// arrays of their storage type
+using Q15 = FixedPointSQ<1, 15>;
+using Q31 = FixedPointSQ<1, 31>;
+
+static_assert(sizeof(Q15) == sizeof(int16_t) && sizeof(Q31) == sizeof(int32_t), "Unexpected size of a fixed point type");
+
 } // particle
\ No newline at end of file
@@ -47,10 +47,16 @@
 namespace detail {
     float _getVCell(byte MSB, byte LSB);
     float _getSoC(byte MSB, byte LSB);
+    float _getNormalizedSoC(float soc, uint16_t chargeVoltage);
 }
 
+struct system_power_telemetry;
+
 class FuelGauge {
 public:
+    // Maximum age of the readings cached by the system power manager, in milliseconds
+    static const system_tick_t DEFAULT_MAX_AGE = 1000;
+
     FuelGauge(bool _lock = false);
     FuelGauge(TwoWire& i2c, bool _lock = false);
     ~FuelGauge();
@@ -74,7 +80,14 @@ public:
     bool lock();
     bool unlock();
 
+    /**
+     * Sets the maximum age of the cached readings returned by `getVCell()`, `getSoC()` and
+     * `getNormalizedSoC()`. If the age is 0, the fuel gauge is always read directly.
+     */
+    void setMaxAge(system_tick_t maxAge);
+
 private:
+    bool readTelemetry(system_power_telemetry* telemetry);
 
     void readConfigRegister(byte &MSB, byte &LSB);
     void readRegister(byte startAddress, byte &MSB, byte &LSB);
@@ -82,6 +95,7 @@ private:
 
     TwoWire& i2c_;
     bool lock_;
+    system_tick_t maxAge_;
 };
 
 #endif // __SPARK_WIRING_FUEL_H
@@ -30,6 +30,8 @@
 #include "spark_wiring_stream.h"
 #include "spark_wiring_platform.h"
 #include "i2c_hal.h"
+#include "concurrent_hal.h"
+#include "spark_wiring_i2c_queue.h"
 #include <chrono>
 
 class WireTransmission {
@@ -134,6 +136,75 @@ public:
   void reset();
 };
 
+namespace particle {
+
+/**
+ * Queue of I2C transactions executed back to back without blocking the caller.
+ *
+ * Transactions to different devices share the bus in the order they were submitted. The bus has
+ * to be initialized in master mode with `TwoWire::begin()` first. Blocking `TwoWire` calls wait
+ * for the current queued transfer to complete.
+ */
+class I2cTransactionQueue {
+public:
+    // Resolution of the transaction timeouts, in milliseconds
+    static const unsigned TIMEOUT_CHECK_INTERVAL = 10;
+    // Maximum time end() waits for the queued transactions before cancelling them, in milliseconds
+    static const unsigned END_TIMEOUT = 1000;
+
+    explicit I2cTransactionQueue(HAL_I2C_Interface i2c);
+    ~I2cTransactionQueue();
+
+    int begin();
+    /**
+     * Waits for the queued transactions to complete, for at most `END_TIMEOUT` milliseconds, and
+     * cancels the remaining ones.
+     */
+    void end();
+
+    /**
+     * Adds a transaction to the queue. The completion callback is invoked in the interrupt context.
+     */
+    int submit(I2cTransaction* t);
+
+    /**
+     * Removes a transaction that hasn't started yet from the queue.
+     */
+    int cancel(I2cTransaction* t);
+
+    bool isBusy() const;
+    size_t pending() const;
+    I2cBusStats stats() const;
+    void resetStats();
+
+private:
+    class Backend {
+    public:
+        Backend(HAL_I2C_Interface i2c, I2cTransactionQueue* queue);
+
+        int start(const I2cTransaction& t);
+        void abort();
+        uint32_t millis();
+        int lock();
+        void unlock(int state);
+
+    private:
+        HAL_I2C_Interface i2c_;
+        I2cTransactionQueue* queue_;
+
+        friend class I2cTransactionQueue;
+    };
+
+    detail::I2cTransactionEngine<Backend> engine_;
+    os_timer_t timer_;
+    bool started_;
+
+    static void transferComplete(int error, void* data);
+    static void timerCallback(os_timer_t timer);
+};
+
+} // namespace particle
+
 /**
  * This global instance cannot be gc-ed by the linker because of the virtual functions.
  * So we provide a conditional compile to exclude it.
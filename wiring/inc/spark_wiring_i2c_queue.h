@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Completion callback of an I2C transaction.
+ *
+ * The callback is invoked in the interrupt context, or in the context of the queue's timer if the
+ * transaction has timed out.
+ */
+typedef void (*I2cTransactionCallback)(int error, void* data);
+
+/**
+ * I2C master transaction. When both buffers are set, the data is written and then read back after
+ * a repeated start condition.
+ *
+ * The transaction and its buffers must remain valid until the completion callback is invoked.
+ */
+struct I2cTransaction {
+    enum Flag {
+        NO_STOP = 0x01 // Don't generate a stop condition after a write-only transaction
+    };
+
+    uint8_t address;
+    uint8_t flags;
+    const uint8_t* tx;
+    size_t txLength;
+    uint8_t* rx;
+    size_t rxLength;
+    uint32_t timeout; // Time in milliseconds the transaction may take since it was submitted, or 0
+    I2cTransactionCallback callback;
+    void* data; // Callback data
+
+    // Fields managed by the queue
+    I2cTransaction* next;
+    uint32_t submitTime;
+    int result;
+};
+
+/**
+ * Bus statistics.
+ */
+struct I2cBusStats {
+    uint32_t transactions; // Completed transactions
+    uint32_t errors; // Transactions that failed, including timeouts
+    uint32_t timeouts; // Transactions that timed out
+    uint32_t bytesWritten;
+    uint32_t bytesRead;
+    uint32_t maxQueueDepth; // Maximum number of transactions waiting for the bus
+    uint32_t maxWaitTime; // Maximum time a transaction waited for the bus, in milliseconds
+};
+
+namespace detail {
+
+/**
+ * I2C transaction queue.
+ *
+ * The backend provides the following methods:
+ *
+ * - `int start(const I2cTransaction& t)`: starts an asynchronous transfer. The backend calls
+ *   `transferComplete()` when the transfer completes
+ * - `void abort()`: aborts the current transfer. `transferComplete()` may be called while
+ *   the transfer is being aborted, but not after this method returns
+ * - `uint32_t millis()`
+ * - `int lock()` and `void unlock(int state)`: protect the queue from the completion interrupt
+ */
+template<typename BackendT>
+class I2cTransactionEngine {
+public:
+    template<typename... ArgsT>
+    explicit I2cTransactionEngine(ArgsT&&... args) :
+            backend_(std::forward<ArgsT>(args)...),
+            head_(nullptr),
+            tail_(nullptr),
+            active_(nullptr),
+            depth_(0),
+            aborting_(false),
+            stats_() {
+    }
+
+    /**
+     * Adds a transaction to the queue. The transaction starts immediately if the bus is idle.
+     */
+    int submit(I2cTransaction* t) {
+        if (!t || (!t->txLength && !t->rxLength) || (t->txLength && !t->tx) || (t->rxLength && !t->rx)) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        t->next = nullptr;
+        t->submitTime = backend_.millis();
+        int state = backend_.lock();
+        append(t);
+        if (++depth_ > stats_.maxQueueDepth) {
+            stats_.maxQueueDepth = depth_;
+        }
+        I2cTransaction* failed = nullptr;
+        if (!active_) {
+            failed = startNext();
+        }
+        backend_.unlock(state);
+        notify(failed);
+        return 0;
+    }
+
+    /**
+     * Removes a transaction that hasn't started yet from the queue. The transaction's callback is
+     * invoked with `SYSTEM_ERROR_CANCELLED`.
+     */
+    int cancel(I2cTransaction* t) {
+        const int state = backend_.lock();
+        const bool found = remove(t);
+        backend_.unlock(state);
+        if (!found) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        if (t->callback) {
+            t->callback(SYSTEM_ERROR_CANCELLED, t->data);
+        }
+        return 0;
+    }
+
+    /**
+     * Handles completion of the current transfer. This method is called in the interrupt context.
+     */
+    void transferComplete(int error) {
+        const int state = backend_.lock();
+        I2cTransaction* const done = active_;
+        if (!done || aborting_) {
+            backend_.unlock(state);
+            return;
+        }
+        active_ = nullptr;
+        finished(done, error);
+        // Start the next transaction before notifying the owner of the completed one
+        I2cTransaction* const failed = startNext();
+        backend_.unlock(state);
+        complete(done, error);
+        notify(failed);
+    }
+
+    /**
+     * Fails the transactions whose timeout has expired.
+     */
+    void checkTimeouts() {
+        const uint32_t now = backend_.millis();
+        int state = backend_.lock();
+        I2cTransaction* expired = nullptr;
+        I2cTransaction* it = head_;
+        while (it) {
+            I2cTransaction* const next = it->next;
+            if (isExpired(it, now)) {
+                remove(it);
+                timedOut(it);
+                it->next = expired;
+                expired = it;
+            }
+            it = next;
+        }
+        I2cTransaction* const active = active_;
+        const bool abort = active && !aborting_ && isExpired(active, now);
+        if (abort) {
+            aborting_ = true;
+        }
+        backend_.unlock(state);
+        I2cTransaction* failed = nullptr;
+        if (abort) {
+            backend_.abort();
+            state = backend_.lock();
+            aborting_ = false;
+            active_ = nullptr;
+            timedOut(active);
+            failed = startNext();
+            backend_.unlock(state);
+            complete(active, SYSTEM_ERROR_TIMEOUT);
+        }
+        notify(expired);
+        notify(failed);
+    }
+
+    /**
+     * Aborts the current transaction and removes the queued ones. The callbacks of the
+     * transactions are invoked with `SYSTEM_ERROR_CANCELLED`.
+     */
+    void cancelAll() {
+        int state = backend_.lock();
+        I2cTransaction* queued = head_;
+        head_ = nullptr;
+        tail_ = nullptr;
+        depth_ = 0;
+        for (I2cTransaction* it = queued; it; it = it->next) {
+            it->result = SYSTEM_ERROR_CANCELLED;
+        }
+        I2cTransaction* const active = active_;
+        const bool abort = active && !aborting_;
+        if (abort) {
+            aborting_ = true;
+        }
+        backend_.unlock(state);
+        if (abort) {
+            backend_.abort();
+            state = backend_.lock();
+            aborting_ = false;
+            active_ = nullptr;
+            finished(active, SYSTEM_ERROR_CANCELLED);
+            backend_.unlock(state);
+            complete(active, SYSTEM_ERROR_CANCELLED);
+        }
+        notify(queued);
+    }
+
+    bool isBusy() const {
+        return active_ != nullptr;
+    }
+
+    size_t pending() const {
+        return depth_;
+    }
+
+    I2cBusStats stats() const {
+        const int state = backend_.lock();
+        const I2cBusStats st = stats_;
+        backend_.unlock(state);
+        return st;
+    }
+
+    void resetStats() {
+        const int state = backend_.lock();
+        stats_ = I2cBusStats();
+        backend_.unlock(state);
+    }
+
+    BackendT& backend() {
+        return backend_;
+    }
+
+private:
+    mutable BackendT backend_;
+    I2cTransaction* head_;
+    I2cTransaction* tail_;
+    I2cTransaction* volatile active_;
+    size_t depth_;
+    bool aborting_;
+    I2cBusStats stats_;
+
+    void append(I2cTransaction* t) {
+        if (tail_) {
+            tail_->next = t;
+        } else {
+            head_ = t;
+        }
+        tail_ = t;
+    }
+
+    bool remove(I2cTransaction* t) {
+        I2cTransaction* prev = nullptr;
+        I2cTransaction* it = head_;
+        while (it && it != t) {
+            prev = it;
+            it = it->next;
+        }
+        if (!it) {
+            return false;
+        }
+        if (prev) {
+            prev->next = it->next;
+        } else {
+            head_ = it->next;
+        }
+        if (tail_ == it) {
+            tail_ = prev;
+        }
+        --depth_;
+        return true;
+    }
+
+    // Starts the first transaction in the queue that the backend accepts. Returns the list of
+    // transactions that failed to start
+    I2cTransaction* startNext() {
+        I2cTransaction* failed = nullptr;
+        while (head_) {
+            I2cTransaction* const t = head_;
+            remove(t);
+            const uint32_t wait = backend_.millis() - t->submitTime;
+            if (wait > stats_.maxWaitTime) {
+                stats_.maxWaitTime = wait;
+            }
+            active_ = t;
+            const int r = backend_.start(*t);
+            if (r == 0) {
+                break;
+            }
+            active_ = nullptr;
+            finished(t, r);
+            t->result = r;
+            t->next = failed;
+            failed = t;
+        }
+        return failed;
+    }
+
+    void finished(I2cTransaction* t, int error) {
+        ++stats_.transactions;
+        if (error) {
+            ++stats_.errors;
+        } else {
+            stats_.bytesWritten += t->txLength;
+            stats_.bytesRead += t->rxLength;
+        }
+    }
+
+    void timedOut(I2cTransaction* t) {
+        finished(t, SYSTEM_ERROR_TIMEOUT);
+        ++stats_.timeouts;
+        t->result = SYSTEM_ERROR_TIMEOUT;
+    }
+
+    static bool isExpired(const I2cTransaction* t, uint32_t now) {
+        return t->timeout && now - t->submitTime >= t->timeout;
+    }
+
+    static void complete(I2cTransaction* t, int error) {
+        if (t->callback) {
+            t->callback(error, t->data);
+        }
+    }
+
+    static void notify(I2cTransaction* list) {
+        while (list) {
+            I2cTransaction* const next = list->next;
+            complete(list, list->result);
+            list = next;
+        }
+    }
+};
+
+} // particle::detail
+
+} // particle
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <atomic>
+#include <new>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * GPIO edge delivered to a deferred interrupt handler.
+ */
+struct InterruptEvent {
+    uint16_t pin;
+    uint32_t timestamp; // Time of the edge, in microseconds
+};
+
+/**
+ * Callable invoked on a GPIO edge.
+ *
+ * The callable is stored in an inline buffer, so that setting up a handler doesn't allocate
+ * memory. The buffer is large enough for a `std::function`, which the legacy `attachInterrupt()`
+ * overload stores as is, a function pointer, or a lambda capturing a member function pointer and
+ * an object pointer. The callable may either take no arguments or take a `const InterruptEvent&`.
+ */
+class InterruptHandler {
+public:
+    static const size_t BUFFER_SIZE = sizeof(std::function<void()>) + sizeof(void*);
+
+    InterruptHandler() :
+            invoke_(nullptr),
+            manage_(nullptr) {
+    }
+
+    template<typename F, typename FnT = typename std::decay<F>::type,
+            typename = typename std::enable_if<!std::is_same<FnT, InterruptHandler>::value>::type>
+    InterruptHandler(F&& fn) :
+            InterruptHandler() {
+        static_assert(sizeof(FnT) <= BUFFER_SIZE, "Interrupt handler is too large");
+        static_assert(alignof(FnT) <= alignof(std::max_align_t), "Unsupported alignment of the interrupt handler");
+        new(buf_) FnT(std::forward<F>(fn));
+        invoke_ = invoke<FnT>;
+        manage_ = manage<FnT>;
+    }
+
+    InterruptHandler(InterruptHandler&& h) :
+            InterruptHandler() {
+        moveFrom(h);
+    }
+
+    ~InterruptHandler() {
+        reset();
+    }
+
+    InterruptHandler& operator=(InterruptHandler&& h) {
+        reset();
+        moveFrom(h);
+        return *this;
+    }
+
+    void reset() {
+        if (manage_) {
+            manage_(DESTROY, buf_, nullptr);
+            invoke_ = nullptr;
+            manage_ = nullptr;
+        }
+    }
+
+    void operator()(const InterruptEvent& event) {
+        invoke_(buf_, event);
+    }
+
+    explicit operator bool() const {
+        return invoke_;
+    }
+
+private:
+    enum Operation {
+        MOVE,
+        DESTROY
+    };
+
+    alignas(std::max_align_t) char buf_[BUFFER_SIZE];
+    void (*invoke_)(void* fn, const InterruptEvent& event);
+    void (*manage_)(Operation op, void* dest, void* src);
+
+    InterruptHandler(const InterruptHandler&) = delete;
+    InterruptHandler& operator=(const InterruptHandler&) = delete;
+
+    void moveFrom(InterruptHandler& h) {
+        // The target is always empty here: callables can't be moved bytewise
+        if (h.manage_) {
+            h.manage_(MOVE, buf_, h.buf_);
+            invoke_ = h.invoke_;
+            manage_ = h.manage_;
+            h.reset();
+        }
+    }
+
+    template<typename FnT>
+    static auto call(FnT& fn, const InterruptEvent& event, int) -> decltype(fn(event), void()) {
+        fn(event);
+    }
+
+    template<typename FnT>
+    static void call(FnT& fn, const InterruptEvent& event, long) {
+        fn();
+    }
+
+    template<typename FnT>
+    static void invoke(void* fn, const InterruptEvent& event) {
+        call(*static_cast<FnT*>(fn), event, 0);
+    }
+
+    template<typename FnT>
+    static void manage(Operation op, void* dest, void* src) {
+        if (op == MOVE) {
+            new(dest) FnT(std::move(*static_cast<FnT*>(src)));
+        } else {
+            static_cast<FnT*>(dest)->~FnT();
+        }
+    }
+};
+
+/**
+ * Bounded lock-free queue of interrupt events.
+ *
+ * Events can be pushed from several interrupt handlers, including ones that preempt each other,
+ * and are popped by a single consumer thread. `N` must be a power of two.
+ */
+template<typename T, size_t N>
+class InterruptEventQueue {
+public:
+    static_assert(N > 1 && (N & (N - 1)) == 0, "Queue size must be a power of two");
+
+    InterruptEventQueue() :
+            head_(0),
+            tail_(0) {
+        for (size_t i = 0; i < N; ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Adds an event to the queue. Returns `false` if the queue is full.
+     */
+    bool push(const T& item) {
+        uint32_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& c = cells_[pos & (N - 1)];
+            const uint32_t seq = c.seq.load(std::memory_order_acquire);
+            const int32_t diff = (int32_t)(seq - pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.item = item;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Removes the oldest event from the queue. Returns `false` if there are no complete events.
+     */
+    bool pop(T* item) {
+        const uint32_t pos = tail_.load(std::memory_order_relaxed);
+        Cell& c = cells_[pos & (N - 1)];
+        const uint32_t seq = c.seq.load(std::memory_order_acquire);
+        if ((int32_t)(seq - (pos + 1)) < 0) {
+            return false;
+        }
+        *item = c.item;
+        c.seq.store(pos + N, std::memory_order_release);
+        tail_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t size() const {
+        return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity() {
+        return N;
+    }
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> seq;
+        T item;
+    };
+
+    Cell cells_[N];
+    std::atomic<uint32_t> head_;
+    std::atomic<uint32_t> tail_;
+};
+
+/**
+ * Interrupt counters of a pin.
+ */
+struct InterruptStats {
+    uint32_t edges; // Number of edges seen by the interrupt handler
+    uint32_t overflows; // Number of edges dropped because the event queue was full
+};
+
+/**
+ * Dispatches GPIO interrupts to statically allocated handlers.
+ *
+ * A handler is either called directly in the interrupt context or, in the deferred mode, the
+ * edge is timestamped and queued, and the handler is called later by `process()`.
+ *
+ * `attach()` and `detach()` are called in the thread context and may be called by a deferred
+ * handler from within `process()`. If they target the handler that is currently running, the
+ * change is recorded and applied once that handler returns. In the interrupt context, handlers
+ * can only be detached, using `detachFromIsr()`.
+ */
+template<size_t Slots, size_t QueueSize>
+class InterruptDispatcher {
+public:
+    InterruptDispatcher() :
+            overflows_(0),
+            maxPending_(0) {
+    }
+
+    int attach(size_t slot, InterruptHandler&& handler, bool deferred) {
+        if (slot >= Slots || !handler) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        Slot& s = slots_[slot];
+        if (s.running) {
+            // The current handler can't be destroyed while it's running
+            s.pending = std::move(handler);
+            s.pendingDeferred = deferred;
+            s.pendingOp = PENDING_ATTACH;
+            return 0;
+        }
+        setHandler(s, std::move(handler), deferred);
+        return 0;
+    }
+
+    void detach(size_t slot) {
+        if (slot < Slots) {
+            Slot& s = slots_[slot];
+            if (s.running) {
+                s.pending.reset();
+                s.pendingOp = PENDING_DETACH;
+                return;
+            }
+            setHandler(s, InterruptHandler(), false);
+        }
+    }
+
+    /**
+     * Detaches a handler in the interrupt context.
+     *
+     * The handler stops receiving events right away but it is only destroyed by the next call to
+     * `attach()` or `detach()` for the same slot.
+     */
+    void detachFromIsr(size_t slot) {
+        if (slot < Slots) {
+            slots_[slot].disabled.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Handles an edge. This method is called in the interrupt context.
+     *
+     * @return `true` if the event was queued for deferred processing.
+     */
+    bool handleInterrupt(size_t slot, uint32_t timestamp) {
+        if (slot >= Slots) {
+            return false;
+        }
+        Slot& s = slots_[slot];
+        s.edges.fetch_add(1, std::memory_order_relaxed);
+        if (!s.handler || s.disabled.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (!s.deferred) {
+            const InterruptEvent event = { (uint16_t)slot, timestamp };
+            s.handler(event);
+            return false;
+        }
+        const Entry entry = { (uint16_t)slot, s.generation, timestamp };
+        if (!queue_.push(entry)) {
+            s.overflows.fetch_add(1, std::memory_order_relaxed);
+            overflows_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        const size_t n = queue_.size();
+        if (n > maxPending_.load(std::memory_order_relaxed)) {
+            maxPending_.store(n, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * Calls the deferred handlers of the queued events.
+     *
+     * @return Number of handled events.
+     */
+    size_t process(size_t maxEvents = (size_t)-1) {
+        size_t count = 0;
+        Entry entry;
+        while (count < maxEvents && queue_.pop(&entry)) {
+            Slot& s = slots_[entry.slot];
+            if (s.handler && s.generation == entry.generation && !s.disabled.load(std::memory_order_relaxed)) {
+                const InterruptEvent event = { entry.slot, entry.timestamp };
+                s.running = true;
+                s.handler(event);
+                s.running = false;
+                if (s.pendingOp == PENDING_ATTACH) {
+                    setHandler(s, std::move(s.pending), s.pendingDeferred);
+                } else if (s.pendingOp == PENDING_DETACH) {
+                    setHandler(s, InterruptHandler(), false);
+                }
+                s.pendingOp = PENDING_NONE;
+            }
+            ++count;
+        }
+        return count;
+    }
+
+    InterruptStats stats(size_t slot) const {
+        InterruptStats st = {};
+        if (slot < Slots) {
+            st.edges = slots_[slot].edges.load(std::memory_order_relaxed);
+            st.overflows = slots_[slot].overflows.load(std::memory_order_relaxed);
+        }
+        return st;
+    }
+
+    /**
+     * Returns the total number of events dropped because the queue was full.
+     */
+    uint32_t overflows() const {
+        return overflows_.load(std::memory_order_relaxed);
+    }
+
+    size_t pending() const {
+        return queue_.size();
+    }
+
+    /**
+     * Returns the maximum number of events that were queued at the same time.
+     */
+    size_t maxPending() const {
+        return maxPending_.load(std::memory_order_relaxed);
+    }
+
+private:
+    enum PendingOp {
+        PENDING_NONE,
+        PENDING_ATTACH,
+        PENDING_DETACH
+    };
+
+    struct Slot {
+        InterruptHandler handler;
+        InterruptHandler pending; // Handler attached while the current one was running
+        volatile bool deferred = false;
+        bool pendingDeferred = false;
+        bool running = false; // Set while `process()` is calling the handler
+        uint8_t pendingOp = PENDING_NONE;
+        uint16_t generation = 0;
+        std::atomic<bool> disabled; // Set by `detachFromIsr()`
+        std::atomic<uint32_t> edges;
+        std::atomic<uint32_t> overflows;
+
+        Slot() :
+                disabled(false),
+                edges(0),
+                overflows(0) {
+        }
+    };
+
+    struct Entry {
+        uint16_t slot;
+        uint16_t generation;
+        uint32_t timestamp;
+    };
+
+    static void setHandler(Slot& s, InterruptHandler&& handler, bool deferred) {
+        s.handler = std::move(handler);
+        s.deferred = deferred;
+        s.disabled.store(false, std::memory_order_relaxed);
+        // Events queued for the previous handler are discarded
+        ++s.generation;
+    }
+
+    Slot slots_[Slots];
+    InterruptEventQueue<Entry, QueueSize> queue_;
+    std::atomic<uint32_t> overflows_;
+    std::atomic<size_t> maxPending_;
+};
+
+} // particle
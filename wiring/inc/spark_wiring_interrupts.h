@@ -29,22 +29,86 @@
 #define __SPARK_WIRING_INTERRUPTS_H
 
 #include "interrupts_hal.h"
+#include "spark_wiring_interrupt_dispatch.h"
 #include <functional>
+#include <type_traits>
 
 typedef std::function<void()> wiring_interrupt_handler_t;
 typedef void (*raw_interrupt_handler_t)(void);
+typedef std::function<void(const particle::InterruptEvent&)> wiring_deferred_interrupt_handler_t;
+
+namespace particle {
+
+// Internal entry point used by the attachInterrupt() overloads
+bool attachInterruptHandler(uint16_t pin, InterruptHandler&& handler, InterruptMode mode, int8_t priority,
+        uint8_t subpriority, bool deferred);
+
+namespace detail {
+
+// Enables the attachInterrupt() overload for lambdas and other callables that fit into the
+// handler's inline buffer. Function pointers and std::function objects use the non-template overloads
+template<typename F, typename LegacyT, typename FnT = typename std::decay<F>::type>
+using EnableIfInlineHandler = typename std::enable_if<!std::is_same<FnT, LegacyT>::value &&
+        !std::is_pointer<FnT>::value && !std::is_function<typename std::remove_reference<F>::type>::value &&
+        sizeof(FnT) <= InterruptHandler::BUFFER_SIZE>::type;
+
+} // namespace detail
+
+} // namespace particle
 
 /*
  * GPIO Interrupts
  */
 bool attachInterrupt(uint16_t pin, wiring_interrupt_handler_t handler, InterruptMode mode, int8_t priority = -1, uint8_t subpriority = 0);
 bool attachInterrupt(uint16_t pin, raw_interrupt_handler_t handler, InterruptMode mode, int8_t priority = -1, uint8_t subpriority = 0);
+
+/**
+ * Attaches a lambda or another callable object without wrapping it into a `std::function`.
+ *
+ * The callable is stored in the pin's handler and called from the interrupt handler directly.
+ */
+template <typename F, typename = particle::detail::EnableIfInlineHandler<F, wiring_interrupt_handler_t>>
+bool attachInterrupt(uint16_t pin, F&& handler, InterruptMode mode, int8_t priority = -1, uint8_t subpriority = 0) {
+    return particle::attachInterruptHandler(pin, std::forward<F>(handler), mode, priority, subpriority, false /* deferred */);
+}
 template <typename T>
 bool attachInterrupt(uint16_t pin, void (T::*handler)(), T *instance, InterruptMode mode, int8_t priority = -1, uint8_t subpriority = 0) {
-    using namespace std::placeholders;
-    return attachInterrupt(pin, std::bind(handler, instance), mode, priority, subpriority);
+    return particle::attachInterruptHandler(pin, [handler, instance]() {
+        (instance->*handler)();
+    }, mode, priority, subpriority, false /* deferred */);
 }
+
+/**
+ * Attaches a handler that runs on a dedicated thread rather than in the interrupt context.
+ *
+ * The interrupt handler only timestamps the edge and queues it. If the queue is full, the edge
+ * is dropped and counted in the pin's statistics. Not supported on platforms without threading.
+ */
+bool attachInterruptDeferred(uint16_t pin, wiring_deferred_interrupt_handler_t handler, InterruptMode mode, int8_t priority = -1, uint8_t subpriority = 0);
+template <typename F, typename = particle::detail::EnableIfInlineHandler<F, wiring_deferred_interrupt_handler_t>>
+bool attachInterruptDeferred(uint16_t pin, F&& handler, InterruptMode mode, int8_t priority = -1, uint8_t subpriority = 0) {
+    return particle::attachInterruptHandler(pin, std::forward<F>(handler), mode, priority, subpriority, true /* deferred */);
+}
+template <typename T>
+bool attachInterruptDeferred(uint16_t pin, void (T::*handler)(const particle::InterruptEvent&), T *instance, InterruptMode mode, int8_t priority = -1, uint8_t subpriority = 0) {
+    return particle::attachInterruptHandler(pin, [handler, instance](const particle::InterruptEvent& event) {
+        (instance->*handler)(event);
+    }, mode, priority, subpriority, true /* deferred */);
+}
+
+/**
+ * Detaches the handler of a pin.
+ *
+ * Handlers can detach themselves, and deferred handlers can also attach other handlers. A change
+ * to the handler that is currently running takes effect once it returns. Handlers can't be
+ * attached in the interrupt context.
+ */
 bool detachInterrupt(uint16_t pin);
+
+/**
+ * Returns the number of edges seen and dropped on a pin since the device started.
+ */
+particle::InterruptStats interruptStats(uint16_t pin);
 void interrupts(void);
 void noInterrupts(void);
 
@@ -30,6 +30,7 @@
 #include "spark_wiring.h"
 #include "spark_wiring_platform.h"
 #include "spi_hal.h"
+#include "spark_wiring_spi_queue.h"
 
 class SPIClass;
 
@@ -260,6 +261,87 @@ public:
   }
 };
 
+namespace particle {
+
+/**
+ * Queue of SPI transactions executed back to back from the DMA completion interrupt.
+ *
+ * Each segment of a transaction may select a different device and use different settings. The
+ * bus has to be initialized with `SPIClass::begin()` first.
+ *
+ * Transactions are started from the DMA completion interrupt, where the bus lock can't be taken,
+ * so the lock is acquired per batch rather than per transaction: when transactions are submitted
+ * to an idle queue, a thread shared by all queues acquires the bus, and it releases the bus once
+ * the queue drains. Other users of the bus, such as system drivers, get the bus in between the
+ * batches. On platforms where the bus lock is implemented by `SPIClass` rather than the HAL, the
+ * application must not use the `SPIClass` instance while the queue is started.
+ */
+class SpiTransactionQueue {
+public:
+    explicit SpiTransactionQueue(HAL_SPI_Interface spi);
+    ~SpiTransactionQueue();
+
+    int begin();
+
+    /**
+     * Waits for the queued transactions to complete and for the bus to be released.
+     */
+    void end();
+
+    /**
+     * Adds a transaction to the queue. The completion callback is invoked in the interrupt context.
+     */
+    int submit(SpiTransaction* t);
+
+    /**
+     * Removes a transaction that hasn't started yet from the queue. The completion callback is
+     * invoked by this method with `SYSTEM_ERROR_CANCELLED`.
+     */
+    int cancel(SpiTransaction* t);
+
+    bool isBusy() const;
+    SpiBusStats stats() const;
+    void resetStats();
+
+private:
+    class Backend {
+    public:
+        explicit Backend(HAL_SPI_Interface spi);
+
+        void configure(uint32_t clock, uint8_t bitOrder, uint8_t dataMode);
+        void select(uint16_t pin, bool selected);
+        void transfer(const void* tx, void* rx, size_t length);
+        uint32_t micros();
+        int lock();
+        void unlock(int state);
+        bool requestBus();
+        void busIdle();
+
+    private:
+        HAL_SPI_Interface spi_;
+        uint32_t systemClock_;
+
+        friend class SpiTransactionQueue;
+    };
+
+    detail::SpiTransactionEngine<Backend> engine_;
+    bool started_;
+
+    void arbitrate();
+
+    static void transferComplete(HAL_SPI_Interface spi);
+    static void busThread(void* data);
+
+    // The DMA completion callback doesn't take a context argument, so a callback is generated for
+    // each of the interfaces
+    template<size_t spi>
+    static void transferComplete();
+    template<size_t... spi>
+    static HAL_SPI_DMA_UserCallback completeCallback(HAL_SPI_Interface i, std::index_sequence<spi...>);
+};
+
+} // namespace particle
+
 #ifndef SPARK_WIRING_NO_SPI
 
 namespace particle {
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * Part of an SPI transaction transferred with a single DMA request.
+ */
+struct SpiSegment {
+    enum Flag {
+        KEEP_SELECTED = 0x01 // Keep the chip select asserted and chain the next segment to this one
+    };
+
+    static const uint16_t NO_CS = 0xffff; // The segment doesn't control a chip select pin
+
+    const void* tx; // Data to send, or `nullptr` to send dummy bytes
+    void* rx; // Buffer for the received data, or `nullptr`
+    size_t length;
+    uint16_t csPin; // Chip select pin, asserted low
+    uint32_t clock; // Clock speed in Hz, or 0 to keep the current settings
+    uint8_t bitOrder;
+    uint8_t dataMode;
+    uint8_t flags;
+};
+
+/**
+ * Completion callback of an SPI transaction.
+ *
+ * The callback is invoked in the interrupt context when the transaction completes, or by
+ * `cancel()` in the calling thread when the transaction is cancelled.
+ */
+typedef void (*SpiTransactionCallback)(int error, void* data);
+
+/**
+ * Sequence of segments executed back to back without releasing the bus.
+ *
+ * The transaction and its segments must remain valid until the completion callback is invoked.
+ */
+struct SpiTransaction {
+    const SpiSegment* segments;
+    size_t count;
+    SpiTransactionCallback callback;
+    void* data; // Callback data
+
+    // Fields managed by the queue
+    SpiTransaction* next;
+    uint32_t submitTime;
+};
+
+/**
+ * Bus arbitration statistics.
+ */
+struct SpiBusStats {
+    uint32_t transactions; // Completed transactions
+    uint32_t segments; // Completed segments
+    uint32_t bytes; // Transferred bytes
+    uint32_t selects; // Chip select assertions
+    uint32_t chainedSegments; // Segments that reused the chip select asserted by the previous segment
+    uint32_t reconfigurations; // Changes of the clock and mode settings
+    uint32_t maxQueueDepth; // Maximum number of transactions waiting for the bus
+    uint32_t maxWaitTime; // Maximum time a transaction waited for the bus, in microseconds
+    uint32_t totalWaitTime; // Total time transactions waited for the bus, in microseconds
+};
+
+namespace detail {
+
+/**
+ * SPI transaction queue.
+ *
+ * The backend provides the following methods:
+ *
+ * - `void configure(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)`
+ * - `void select(uint16_t pin, bool selected)`
+ * - `void transfer(const void* tx, void* rx, size_t length)`: starts an asynchronous transfer.
+ *   The backend calls `transferComplete()` when the transfer completes
+ * - `uint32_t micros()`
+ * - `int lock()` and `void unlock(int state)`: protect the queue from the completion interrupt
+ * - `bool requestBus()`: called in the thread context when there are transactions to run and the
+ *   queue doesn't own the bus. Returns `true` if the bus is available right away, otherwise the
+ *   backend calls `grant()` once it has acquired the bus
+ * - `void busIdle()`: called when the queue drains while owning the bus, possibly in the interrupt
+ *   context. The backend calls `release()` to give up the bus
+ */
+template<typename BackendT>
+class SpiTransactionEngine {
+public:
+    template<typename... ArgsT>
+    explicit SpiTransactionEngine(ArgsT&&... args) :
+            backend_(std::forward<ArgsT>(args)...),
+            head_(nullptr),
+            tail_(nullptr),
+            active_(nullptr),
+            segment_(0),
+            depth_(0),
+            selected_(SpiSegment::NO_CS),
+            clock_(0),
+            bitOrder_(0),
+            dataMode_(0),
+            granted_(false),
+            requested_(false),
+            stats_() {
+    }
+
+    /**
+     * Adds a transaction to the queue. The transaction starts immediately if the bus is idle.
+     *
+     * Segments must not be empty: the HAL doesn't report completion of a zero-length transfer.
+     */
+    int submit(SpiTransaction* t) {
+        if (!t || !t->segments || !t->count) {
+            return SYSTEM_ERROR_INVALID_ARGUMENT;
+        }
+        for (size_t i = 0; i < t->count; ++i) {
+            if (!t->segments[i].length) {
+                return SYSTEM_ERROR_INVALID_ARGUMENT;
+            }
+        }
+        t->next = nullptr;
+        t->submitTime = backend_.micros();
+        bool request = false;
+        const int state = backend_.lock();
+        if (tail_) {
+            tail_->next = t;
+        } else {
+            head_ = t;
+        }
+        tail_ = t;
+        if (++depth_ > stats_.maxQueueDepth) {
+            stats_.maxQueueDepth = depth_;
+        }
+        if (!granted_) {
+            request = !requested_;
+            requested_ = true;
+        } else if (!active_) {
+            startNext();
+        }
+        backend_.unlock(state);
+        if (request && backend_.requestBus()) {
+            grant();
+        }
+        return 0;
+    }
+
+    /**
+     * Gives the bus to the queue and starts the queued transactions.
+     */
+    void grant() {
+        const int state = backend_.lock();
+        requested_ = false;
+        granted_ = true;
+        if (!active_) {
+            startNext();
+        }
+        // All transactions may have been cancelled while the queue was waiting for the bus
+        const bool idle = !active_;
+        backend_.unlock(state);
+        if (idle) {
+            backend_.busIdle();
+        }
+    }
+
+    /**
+     * Gives up the bus if there are no transactions to run.
+     *
+     * @return `true` if the bus was released.
+     */
+    bool release() {
+        const int state = backend_.lock();
+        const bool idle = granted_ && !active_ && !head_;
+        if (idle) {
+            granted_ = false;
+        }
+        backend_.unlock(state);
+        return idle;
+    }
+
+    /**
+     * Removes a transaction that hasn't started yet from the queue. The transaction's callback is
+     * invoked with `SYSTEM_ERROR_CANCELLED`.
+     */
+    int cancel(SpiTransaction* t) {
+        const int state = backend_.lock();
+        SpiTransaction* prev = nullptr;
+        SpiTransaction* it = head_;
+        while (it && it != t) {
+            prev = it;
+            it = it->next;
+        }
+        if (it) {
+            if (prev) {
+                prev->next = it->next;
+            } else {
+                head_ = it->next;
+            }
+            if (tail_ == it) {
+                tail_ = prev;
+            }
+            --depth_;
+        }
+        backend_.unlock(state);
+        if (!it) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        if (t->callback) {
+            t->callback(SYSTEM_ERROR_CANCELLED, t->data);
+        }
+        return 0;
+    }
+
+    /**
+     * Handles completion of the current segment. This method is called in the interrupt context.
+     */
+    void transferComplete() {
+        if (!active_) {
+            return;
+        }
+        const SpiSegment& seg = active_->segments[segment_];
+        ++stats_.segments;
+        stats_.bytes += seg.length;
+        if (!(seg.flags & SpiSegment::KEEP_SELECTED)) {
+            deselect();
+        }
+        if (++segment_ < active_->count) {
+            startSegment();
+            return;
+        }
+        // The chip select is never kept across transactions
+        deselect();
+        ++stats_.transactions;
+        SpiTransaction* const done = active_;
+        active_ = nullptr;
+        // Start the next transaction before notifying the owner of the completed one
+        startNext();
+        if (!active_) {
+            backend_.busIdle();
+        }
+        if (done->callback) {
+            done->callback(0, done->data);
+        }
+    }
+
+    bool isBusy() const {
+        return active_ != nullptr;
+    }
+
+    /**
+     * Returns `true` if the queue is waiting for the bus.
+     */
+    bool isBusRequested() const {
+        return requested_;
+    }
+
+    /**
+     * Returns `true` if the queue owns the bus.
+     */
+    bool isBusGranted() const {
+        return granted_;
+    }
+
+    size_t pending() const {
+        return depth_;
+    }
+
+    SpiBusStats stats() const {
+        const int state = backend_.lock();
+        const SpiBusStats st = stats_;
+        backend_.unlock(state);
+        return st;
+    }
+
+    void resetStats() {
+        const int state = backend_.lock();
+        stats_ = SpiBusStats();
+        backend_.unlock(state);
+    }
+
+    BackendT& backend() {
+        return backend_;
+    }
+
+private:
+    mutable BackendT backend_;
+    SpiTransaction* head_;
+    SpiTransaction* tail_;
+    SpiTransaction* volatile active_;
+    size_t segment_;
+    size_t depth_;
+    uint16_t selected_;
+    uint32_t clock_;
+    uint8_t bitOrder_;
+    uint8_t dataMode_;
+    volatile bool granted_; // The queue owns the bus
+    volatile bool requested_; // The queue is waiting for the bus
+    SpiBusStats stats_;
+
+    void startNext() {
+        if (!head_) {
+            return;
+        }
+        active_ = head_;
+        head_ = head_->next;
+        if (!head_) {
+            tail_ = nullptr;
+        }
+        --depth_;
+        const uint32_t wait = backend_.micros() - active_->submitTime;
+        stats_.totalWaitTime += wait;
+        if (wait > stats_.maxWaitTime) {
+            stats_.maxWaitTime = wait;
+        }
+        segment_ = 0;
+        startSegment();
+    }
+
+    void startSegment() {
+        const SpiSegment& seg = active_->segments[segment_];
+        const bool reselect = (seg.csPin != selected_);
+        if (reselect) {
+            deselect();
+        } else if (selected_ != SpiSegment::NO_CS) {
+            ++stats_.chainedSegments;
+        }
+        if (seg.clock && (seg.clock != clock_ || seg.bitOrder != bitOrder_ || seg.dataMode != dataMode_)) {
+            backend_.configure(seg.clock, seg.bitOrder, seg.dataMode);
+            clock_ = seg.clock;
+            bitOrder_ = seg.bitOrder;
+            dataMode_ = seg.dataMode;
+            ++stats_.reconfigurations;
+        }
+        if (reselect && seg.csPin != SpiSegment::NO_CS) {
+            backend_.select(seg.csPin, true);
+            selected_ = seg.csPin;
+            ++stats_.selects;
+        }
+        backend_.transfer(seg.tx, seg.rx, seg.length);
+    }
+
+    void deselect() {
+        if (selected_ != SpiSegment::NO_CS) {
+            backend_.select(selected_, false);
+            selected_ = SpiSegment::NO_CS;
+        }
+    }
+};
+
+} // particle::detail
+
+} // particle
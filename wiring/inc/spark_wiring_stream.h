@@ -49,6 +49,7 @@ class Stream : public Print
     int timedRead();    // private method to read stream with timeout
     int timedPeek();    // private method to peek stream with timeout
     int peekNextDigit(); // returns the next numeric digit in the stream or -1 if timeout
+    int timedPeekBuffer(const char** data); // waits for buffered data, see peekBuffer()
 
   public:
     virtual int available() = 0;
@@ -56,6 +57,23 @@ class Stream : public Print
     virtual int peek() = 0;
     virtual void flush() = 0;
 
+    /**
+     * Provides direct access to the data buffered by the stream.
+     *
+     * Buffered streams override this method and `consume()` so that the parsing methods can scan
+     * the data in bulk rather than byte by byte. This method doesn't block.
+     *
+     * @param data Pointer to the buffered data.
+     * @return Number of contiguous bytes available at `data`, or a negative value if the stream
+     *         doesn't support bulk access.
+     */
+    virtual int peekBuffer(const char** data) { return -1; }
+
+    /**
+     * Removes `size` bytes previously returned by `peekBuffer()` from the stream.
+     */
+    virtual void consume(size_t size) {}
+
     Stream() {_timeout=1000;}
 
 // parsing methods
@@ -56,6 +56,8 @@ public:
     virtual int read();
     virtual int read(uint8_t *buffer, size_t size);
     virtual int peek();
+    virtual int peekBuffer(const char** data);
+    virtual void consume(size_t size);
     virtual void flush();
     void flush_buffer();
     virtual void stop();
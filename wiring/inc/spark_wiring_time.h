@@ -89,10 +89,8 @@ public:
         static String timeStr(time_t t);
 
         /**
-         * Return a string representation of the given time using strftime().
-         * This function takes several kilobytes of flash memory so it's kept separate
-         * from `timeStr()` to reduce memory footprint for applications that don't use
-         * alternative time formats.
+         * Return a string representation of the given time using the conversion
+         * specifiers of strftime(). `%z` is replaced with the UTC offset.
          *
          * @param t
          * @param format_spec
@@ -105,6 +103,20 @@ public:
             return format(now(), format_spec);
         }
 
+        /**
+         * Format the given time into a buffer without allocating memory.
+         *
+         * The ISO 8601 format (`TIME_FORMAT_ISO8601_FULL`), the default format and the most
+         * common conversion specifiers are formatted without calling strftime().
+         *
+         * @param t The time.
+         * @param format_spec The format, or NULL to use the format set with `setFormat()`.
+         * @param buf The destination buffer.
+         * @param size The size of the buffer.
+         * @return The length of the formatted string, or 0 if the buffer is too small.
+         */
+        size_t format(time_t t, const char* format_spec, char* buf, size_t size);
+
         void setFormat(const char* format)
         {
             this->format_spec = format;
@@ -114,7 +126,6 @@ public:
 
 private:
     static const char* format_spec;
-    static String timeFormatImpl(tm* calendar_time, const char* format, int time_zone);
 
 };
 
@@ -201,6 +201,12 @@ public:
     virtual int read(char* buffer, size_t len) { return read((unsigned char*)buffer, len); };
     virtual int peek();
 
+    /**
+     * Provides direct access to the unread data of the current packet.
+     */
+    virtual int peekBuffer(const char** data) { *data = (const char*)_buffer + _offset; return available(); }
+    virtual void consume(size_t size) { _offset += size; }
+
     /**
      * Blocks until all data has been sent out
      */
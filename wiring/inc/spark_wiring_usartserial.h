@@ -51,6 +51,8 @@ public:
   virtual int peek(void);
   virtual int read(void);
   virtual void flush(void);
+  virtual int peekBuffer(const char** data);
+  virtual void consume(size_t size);
   size_t write(uint16_t);
   virtual size_t write(uint8_t);
 
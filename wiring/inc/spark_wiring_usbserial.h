@@ -52,10 +52,15 @@ public:
 	int peek();
 
 	virtual size_t write(uint8_t byte);
+	virtual size_t write(const uint8_t* buffer, size_t size);
 	virtual int read();
+	// Reads up to `size` bytes without blocking. Returns the number of bytes read
+	int read(uint8_t* buffer, size_t size);
 	virtual int availableForWrite(void);
 	virtual int available();
 	virtual void flush();
+	virtual int peekBuffer(const char** data);
+	virtual void consume(size_t size);
 
 	virtual void blockOnOverrun(bool);
 
@@ -127,12 +127,53 @@ public:
 
     Vector<T, AllocatorT>& operator=(Vector<T, AllocatorT> vector);
 
+protected:
+    // Constructs an empty vector that uses the provided storage until it needs to grow
+    Vector(T* data, int capacity);
+
+    // Replaces the contents of this vector with the elements of another vector, leaving that vector
+    // empty. This vector is left empty if the memory allocation fails
+    bool moveFrom(Vector<T, AllocatorT>& vector);
+
 private:
     T* data_;
-    int size_, capacity_;
+    int size_, capacity_; // Capacity is negative if the elements are stored in the inline storage of SmallVector
+
+    bool isInline() const {
+        return capacity_ < 0;
+    }
+
+    // Allocates the storage for at least `n` elements, growing the capacity geometrically so that
+    // repeated insertions take amortized constant time
+    bool grow(int n) {
+        const int cap = capacity();
+        if (n <= cap) {
+            return true;
+        }
+        const int c = cap + cap / 2;
+        return realloc((c > n) ? c : n);
+    }
+
+    // Moves the elements from the inline storage to the heap
+    bool reallocInline(int n) {
+        if (n <= capacity()) {
+            return true; // The inline storage can't be shrunk
+        }
+        T* const d = (T*)AllocatorT::malloc(n * sizeof(T));
+        if (!d) {
+            return false;
+        }
+        move(d, data_, data_ + size_);
+        data_ = d;
+        capacity_ = n;
+        return true;
+    }
 
     template<PARTICLE_VECTOR_ENABLE_IF_TRIVIALLY_COPYABLE(T)>
     bool realloc(int n) {
+        if (isInline()) {
+            return reallocInline(n);
+        }
         T* d = nullptr;
         if (n > 0) {
             d = (T*)AllocatorT::realloc(data_, n * sizeof(T));
@@ -149,6 +190,9 @@ private:
 
     template<PARTICLE_VECTOR_ENABLE_IF_NOT_TRIVIALLY_COPYABLE(T)>
     bool realloc(int n) {
+        if (isInline()) {
+            return reallocInline(n);
+        }
         T* d = nullptr;
         if (n > 0) {
             d = (T*)AllocatorT::malloc(n * sizeof(T));
@@ -246,11 +290,44 @@ private:
 template<typename T, typename AllocatorT>
 void swap(Vector<T, AllocatorT>& vector, Vector<T, AllocatorT>& vector2);
 
+/**
+ * A vector that stores up to `N` elements inside the object and only allocates memory on the heap
+ * when it grows beyond that capacity.
+ *
+ * Once the elements have been moved to the heap, they stay there until the vector is destroyed.
+ * `SmallVector` can be passed to any code that expects a reference to `Vector`.
+ */
+template<typename T, int N, typename AllocatorT = DefaultAllocator>
+class SmallVector: public Vector<T, AllocatorT> {
+public:
+    static_assert(N > 0, "Inline capacity must be positive");
+
+    SmallVector();
+    explicit SmallVector(int n);
+    SmallVector(int n, const T& value);
+    SmallVector(const T* values, int n);
+    SmallVector(std::initializer_list<T> values);
+    SmallVector(const Vector<T, AllocatorT>& vector);
+    SmallVector(const SmallVector<T, N, AllocatorT>& vector);
+    SmallVector(Vector<T, AllocatorT>&& vector);
+    SmallVector(SmallVector<T, N, AllocatorT>&& vector);
+    ~SmallVector();
+
+    SmallVector<T, N, AllocatorT>& operator=(const Vector<T, AllocatorT>& vector);
+    SmallVector<T, N, AllocatorT>& operator=(const SmallVector<T, N, AllocatorT>& vector);
+    SmallVector<T, N, AllocatorT>& operator=(Vector<T, AllocatorT>&& vector);
+    SmallVector<T, N, AllocatorT>& operator=(SmallVector<T, N, AllocatorT>&& vector);
+
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_[N];
+};
+
 } // spark
 
 namespace particle {
 
 using ::spark::Vector;
+using ::spark::SmallVector;
 
 } // particle
 
@@ -275,6 +352,13 @@ inline spark::Vector<T, AllocatorT>::Vector() :
         capacity_(0) {
 }
 
+template<typename T, typename AllocatorT>
+inline spark::Vector<T, AllocatorT>::Vector(T* data, int capacity) :
+        data_(data),
+        size_(0),
+        capacity_(-capacity) {
+}
+
 template<typename T, typename AllocatorT>
 inline spark::Vector<T, AllocatorT>::Vector(int n) : Vector() {
     if (n > 0 && realloc(n)) {
@@ -323,8 +407,11 @@ inline spark::Vector<T, AllocatorT>::Vector(Vector<T, AllocatorT>&& vector) : Ve
 
 template<typename T, typename AllocatorT>
 inline spark::Vector<T, AllocatorT>::~Vector() {
-    destruct(data_, data_ + size_);
-    AllocatorT::free(data_);
+    // Elements in the inline storage are destroyed by ~SmallVector(), while the storage still exists
+    if (!isInline()) {
+        destruct(data_, data_ + size_);
+        AllocatorT::free(data_);
+    }
 }
 
 template<typename T, typename AllocatorT>
@@ -369,7 +456,7 @@ inline bool spark::Vector<T, AllocatorT>::prepend(const Vector<T, AllocatorT> &v
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::insert(int i, T value) {
-    if (size_ + 1 > capacity_ && !realloc(size_ + 1)) {
+    if (!grow(size_ + 1)) {
         return false;
     }
     T* const p = data_ + i;
@@ -381,7 +468,7 @@ inline bool spark::Vector<T, AllocatorT>::insert(int i, T value) {
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::insert(int i, int n, const T& value) {
-    if (size_ + n > capacity_ && !realloc(size_ + n)) {
+    if (!grow(size_ + n)) {
         return false;
     }
     T* const p = data_ + i;
@@ -393,7 +480,7 @@ inline bool spark::Vector<T, AllocatorT>::insert(int i, int n, const T& value) {
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::insert(int i, const T* values, int n) {
-    if (size_ + n > capacity_ && !realloc(size_ + n)) {
+    if (!grow(size_ + n)) {
         return false;
     }
     T* const p = data_ + i;
@@ -547,7 +634,7 @@ inline spark::Vector<T, AllocatorT>& spark::Vector<T, AllocatorT>::fill(const T&
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::resize(int n) {
     if (n > size_) {
-        if (n > capacity_ && !realloc(n)) {
+        if (!grow(n)) {
             return false;
         }
         construct(data_ + size_, data_ + n);
@@ -571,7 +658,7 @@ inline bool spark::Vector<T, AllocatorT>::isEmpty() const {
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::reserve(int n) {
-    if (n > capacity_ && !realloc(n)) {
+    if (n > capacity() && !realloc(n)) {
         return false;
     }
     return true;
@@ -579,12 +666,12 @@ inline bool spark::Vector<T, AllocatorT>::reserve(int n) {
 
 template<typename T, typename AllocatorT>
 inline int spark::Vector<T, AllocatorT>::capacity() const {
-    return capacity_;
+    return isInline() ? -capacity_ : capacity_;
 }
 
 template<typename T, typename AllocatorT>
 inline bool spark::Vector<T, AllocatorT>::trimToSize() {
-    if (capacity_ > size_ && !realloc(size_)) {
+    if (capacity() > size_ && !realloc(size_)) {
         return false;
     }
     return true;
@@ -663,13 +750,137 @@ inline spark::Vector<T, AllocatorT>& spark::Vector<T, AllocatorT>::operator=(Vec
     return *this;
 }
 
+template<typename T, typename AllocatorT>
+inline bool spark::Vector<T, AllocatorT>::moveFrom(Vector<T, AllocatorT>& vector) {
+    if (&vector == this) {
+        return true;
+    }
+    clear();
+    if (!vector.isInline() && (!isInline() || vector.size_ > capacity())) {
+        // Take over the heap storage
+        if (!isInline()) {
+            AllocatorT::free(data_);
+        }
+        data_ = vector.data_;
+        capacity_ = vector.capacity_;
+        vector.data_ = nullptr;
+        vector.capacity_ = 0;
+    } else {
+        // Move the elements if either vector uses the inline storage, unless they don't fit in it
+        if (vector.size_ > capacity() && !realloc(vector.size_)) {
+            return false;
+        }
+        move(data_, vector.data_, vector.data_ + vector.size_);
+    }
+    size_ = vector.size_;
+    vector.size_ = 0;
+    return true;
+}
+
+// spark::SmallVector
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector() :
+        Vector<T, AllocatorT>((T*)storage_, N) {
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(int n) : SmallVector() {
+    this->resize(n);
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(int n, const T& value) : SmallVector() {
+    if (n > 0) {
+        this->append(n, value);
+    }
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(const T* values, int n) : SmallVector() {
+    if (n > 0) {
+        this->append(values, n);
+    }
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(std::initializer_list<T> values) : SmallVector() {
+    if (values.size() > 0) {
+        this->append(values.begin(), values.size());
+    }
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(const Vector<T, AllocatorT>& vector) : SmallVector() {
+    this->append(vector);
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(const SmallVector<T, N, AllocatorT>& vector) : SmallVector() {
+    this->append(vector);
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(Vector<T, AllocatorT>&& vector) : SmallVector() {
+    this->moveFrom(vector);
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::SmallVector(SmallVector<T, N, AllocatorT>&& vector) : SmallVector() {
+    this->moveFrom(vector);
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>::~SmallVector() {
+    this->clear();
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>& spark::SmallVector<T, N, AllocatorT>::operator=(const Vector<T, AllocatorT>& vector) {
+    if (&vector != this) {
+        this->clear();
+        this->append(vector);
+    }
+    return *this;
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>& spark::SmallVector<T, N, AllocatorT>::operator=(const SmallVector<T, N, AllocatorT>& vector) {
+    return *this = static_cast<const Vector<T, AllocatorT>&>(vector);
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>& spark::SmallVector<T, N, AllocatorT>::operator=(Vector<T, AllocatorT>&& vector) {
+    this->moveFrom(vector);
+    return *this;
+}
+
+template<typename T, int N, typename AllocatorT>
+inline spark::SmallVector<T, N, AllocatorT>& spark::SmallVector<T, N, AllocatorT>::operator=(SmallVector<T, N, AllocatorT>&& vector) {
+    this->moveFrom(vector);
+    return *this;
+}
+
 // spark::
 template<typename T, typename AllocatorT>
 inline void spark::swap(Vector<T, AllocatorT>& vector, Vector<T, AllocatorT>& vector2) {
     using std::swap;
-    swap(vector.data_, vector2.data_);
-    swap(vector.size_, vector2.size_);
-    swap(vector.capacity_, vector2.capacity_);
+    if (!vector.isInline() && !vector2.isInline()) {
+        swap(vector.data_, vector2.data_);
+        swap(vector.size_, vector2.size_);
+        swap(vector.capacity_, vector2.capacity_);
+        return;
+    }
+    // The inline storage can't be exchanged, move the elements through a temporary vector instead.
+    // Moving from a vector that uses the heap storage doesn't allocate memory
+    Vector<T, AllocatorT> tmp;
+    if (!tmp.moveFrom(vector)) {
+        return;
+    }
+    if (!vector.moveFrom(vector2)) {
+        vector.moveFrom(tmp);
+        return;
+    }
+    vector2.moveFrom(tmp);
 }
 
 #endif // SPARK_WIRING_VECTOR_H
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spark_wiring_adc_stream.h"
+
+#include "timer_hal.h"
+#include "check.h"
+
+namespace particle {
+
+namespace {
+
+const size_t ADC_THREAD_STACK_SIZE = 2048;
+
+} // unnamed
+
+AdcStream::AdcStream() :
+#if PLATFORM_THREADING
+        thread_(OS_THREAD_INVALID_HANDLE),
+        sem_(nullptr),
+        exit_(false),
+#endif
+        running_(false) {
+}
+
+AdcStream::~AdcStream() {
+    end();
+}
+
+int AdcStream::begin(const pin_t* pins, size_t pinCount, uint32_t sampleRate, size_t frames, size_t blocks, Handler handler) {
+    if (running_) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    if (!handler || pinCount > 0xff) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    CHECK(pipeline_.init(pinCount, frames, blocks));
+    handler_ = std::move(handler);
+    HAL_ADC_Stream_Config conf = {};
+    conf.size = sizeof(conf);
+    conf.version = 0;
+    conf.pins = pins;
+    conf.pin_count = pinCount;
+    conf.sample_rate = sampleRate;
+    conf.buffers[0] = pipeline_.acquire();
+    conf.buffers[1] = pipeline_.acquire();
+    conf.buffer_samples = pipeline_.blockSamples();
+    conf.callback = bufferFilled;
+    conf.context = this;
+#if PLATFORM_THREADING
+    exit_ = false;
+    if (os_semaphore_create(&sem_, blocks, 0) != 0) {
+        sem_ = nullptr;
+        pipeline_.reset();
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (os_thread_create(&thread_, "adc", OS_THREAD_PRIORITY_DEFAULT + 1, run, this, ADC_THREAD_STACK_SIZE) != 0) {
+        thread_ = OS_THREAD_INVALID_HANDLE;
+        os_semaphore_destroy(sem_);
+        sem_ = nullptr;
+        pipeline_.reset();
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+#endif
+    running_ = true;
+    const int r = HAL_ADC_Stream_Start(&conf, nullptr);
+    if (r < 0) {
+        end();
+        return r;
+    }
+    return 0;
+}
+
+void AdcStream::end() {
+    if (!running_) {
+        return;
+    }
+    HAL_ADC_Stream_Stop(nullptr);
+    running_ = false;
+#if PLATFORM_THREADING
+    exit_ = true;
+    os_semaphore_give(sem_, false);
+    os_thread_join(thread_);
+    os_thread_cleanup(thread_);
+    thread_ = OS_THREAD_INVALID_HANDLE;
+    os_semaphore_destroy(sem_);
+    sem_ = nullptr;
+#endif
+    pipeline_.reset();
+}
+
+size_t AdcStream::process() {
+    size_t count = 0;
+    AdcBlock block;
+    while (pipeline_.take(&block)) {
+        handler_(block);
+        pipeline_.release(block);
+        ++count;
+    }
+    return count;
+}
+
+int16_t* AdcStream::bufferFilled(int16_t* buf, size_t samples, void* data) {
+    const auto s = static_cast<AdcStream*>(data);
+    int16_t* const next = s->pipeline_.bufferFilled(buf, HAL_Timer_Get_Micro_Seconds());
+#if PLATFORM_THREADING
+    if (next != buf) {
+        os_semaphore_give(s->sem_, false);
+    }
+#endif
+    return next;
+}
+
+#if PLATFORM_THREADING
+
+os_thread_return_t AdcStream::run(void* data) {
+    const auto s = static_cast<AdcStream*>(data);
+    while (!s->exit_) {
+        os_semaphore_take(s->sem_, CONCURRENT_WAIT_FOREVER, false);
+        s->process();
+    }
+    os_thread_exit(nullptr);
+}
+
+#endif // PLATFORM_THREADING
+
+} // particle
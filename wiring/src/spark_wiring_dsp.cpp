@@ -0,0 +1,718 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spark_wiring_dsp.h"
+
+#include "system_error.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <new>
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#define DSP_BACKEND_ARM 1
+#elif defined(__SSE2__)
+#define DSP_BACKEND_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace particle {
+
+namespace dsp {
+
+namespace {
+
+const size_t MAX_FFT_SIZE = 4096;
+
+inline int16_t saturate16(int64_t v) {
+    return (v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : (int16_t)v);
+}
+
+inline int32_t saturate32(int64_t v) {
+    return (v > INT32_MAX) ? INT32_MAX : ((v < INT32_MIN) ? INT32_MIN : (int32_t)v);
+}
+
+inline const int16_t* raw(const Q15* p) {
+    return reinterpret_cast<const int16_t*>(p);
+}
+
+inline const int32_t* raw(const Q31* p) {
+    return reinterpret_cast<const int32_t*>(p);
+}
+
+uint32_t isqrt(uint64_t v) {
+    uint64_t r = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+#if DSP_BACKEND_ARM
+
+inline uint32_t read32(const int16_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Two 16x16 multiplications added to a 64-bit accumulator
+inline int64_t smlald(uint32_t a, uint32_t b, int64_t acc) {
+    union {
+        uint32_t w32[2];
+        int64_t w64;
+    } r;
+    r.w64 = acc;
+    asm volatile ("smlald %0, %1, %2, %3" : "=r" (r.w32[0]), "=r" (r.w32[1]) : "r" (a), "r" (b), "0" (r.w32[0]), "1" (r.w32[1]));
+    return r.w64;
+}
+
+#endif // DSP_BACKEND_ARM
+
+#if DSP_BACKEND_SSE2
+
+// Adds signed 32-bit lanes to 64-bit accumulators
+inline __m128i addWidened(__m128i acc, __m128i v, __m128i sign) {
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+    return _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+}
+
+inline __m128i addWidened(__m128i acc, __m128i v) {
+    return addWidened(acc, v, _mm_srai_epi32(v, 31));
+}
+
+inline int64_t horizontalSum(__m128i acc) {
+    int64_t v[2];
+    _mm_storeu_si128((__m128i*)v, acc);
+    return v[0] + v[1];
+}
+
+#endif // DSP_BACKEND_SSE2
+
+template<typename T>
+struct Traits;
+
+template<>
+struct Traits<float> {
+    static float dot(const float* a, const float* b, size_t n) {
+        return detail::dot(a, b, n);
+    }
+};
+
+template<>
+struct Traits<Q15> {
+    static Q15 dot(const Q15* a, const Q15* b, size_t n) {
+        // Q30 to Q15
+        return Q15(saturate16(detail::dot(raw(a), raw(b), n) >> 15));
+    }
+};
+
+template<>
+struct Traits<Q31> {
+    static Q31 dot(const Q31* a, const Q31* b, size_t n) {
+        // Q62 to Q31
+        return Q31(saturate32(detail::dot(raw(a), raw(b), n) >> 31));
+    }
+};
+
+template<typename T>
+T biquadStage(const T* c, T* s, T x, unsigned postShift);
+
+// Direct form II transposed
+template<>
+float biquadStage(const float* c, float* s, float x, unsigned /* postShift */) {
+    const float y = c[0] * x + s[0];
+    s[0] = c[1] * x - c[3] * y + s[1];
+    s[1] = c[2] * x - c[4] * y;
+    return y;
+}
+
+// Direct form I with a 64-bit accumulator. The state is { x[n - 1], x[n - 2], y[n - 1], y[n - 2] }
+template<typename T, typename RawT, int Frac>
+T biquadStageFixed(const T* c, T* s, T x, unsigned postShift) {
+    const RawT* rc = reinterpret_cast<const RawT*>(c);
+    RawT* rs = reinterpret_cast<RawT*>(s);
+    const RawT rx = x;
+    int64_t acc = (int64_t)rc[0] * rx + (int64_t)rc[1] * rs[0] + (int64_t)rc[2] * rs[1] -
+            (int64_t)rc[3] * rs[2] - (int64_t)rc[4] * rs[3];
+    const int64_t y64 = acc >> (Frac - postShift);
+    const RawT y = (Frac == 15) ? (RawT)saturate16(y64) : (RawT)saturate32(y64);
+    rs[1] = rs[0];
+    rs[0] = rx;
+    rs[3] = rs[2];
+    rs[2] = y;
+    return T(y);
+}
+
+template<>
+Q15 biquadStage(const Q15* c, Q15* s, Q15 x, unsigned postShift) {
+    return biquadStageFixed<Q15, int16_t, 15>(c, s, x, postShift);
+}
+
+template<>
+Q31 biquadStage(const Q31* c, Q31* s, Q31 x, unsigned postShift) {
+    return biquadStageFixed<Q31, int32_t, 31>(c, s, x, postShift);
+}
+
+template<typename T>
+unsigned maxPostShift();
+
+template<>
+unsigned maxPostShift<float>() {
+    return 0;
+}
+
+template<>
+unsigned maxPostShift<Q15>() {
+    return 14;
+}
+
+template<>
+unsigned maxPostShift<Q31>() {
+    return 30;
+}
+
+} // unnamed
+
+const char* backendName() {
+#if DSP_BACKEND_ARM
+    return "arm-dsp";
+#elif DSP_BACKEND_SSE2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+Q15 toQ15(float value) {
+    return Q15(saturate16((int64_t)std::lround(value * 32768.0f)));
+}
+
+Q31 toQ31(float value) {
+    return Q31(saturate32((int64_t)std::llround((double)value * 2147483648.0)));
+}
+
+void toQ15(const float* src, Q15* dest, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dest[i] = toQ15(src[i]);
+    }
+}
+
+void toQ31(const float* src, Q31* dest, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dest[i] = toQ31(src[i]);
+    }
+}
+
+void toFloat(const Q15* src, float* dest, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dest[i] = src[i].toFloat();
+    }
+}
+
+void toFloat(const Q31* src, float* dest, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dest[i] = (float)((double)src[i].value() / 2147483648.0);
+    }
+}
+
+float rms(const float* src, size_t count) {
+    if (!count) {
+        return 0.0f;
+    }
+    return std::sqrt(detail::dot(src, src, count) / count);
+}
+
+Q15 rms(const Q15* src, size_t count) {
+    if (!count) {
+        return Q15((int16_t)0);
+    }
+    // Mean of the squares is in Q30, its square root is in Q15
+    const uint64_t mean = detail::sumSquares(raw(src), count) / count;
+    return Q15(saturate16(isqrt(mean)));
+}
+
+Q31 rms(const Q31* src, size_t count) {
+    if (!count) {
+        return Q31((int32_t)0);
+    }
+    // Squares are accumulated in Q31 to leave room for long signals
+    const int32_t* s = raw(src);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += (uint64_t)(((int64_t)s[i] * s[i]) >> 31);
+    }
+    const uint64_t mean = sum / count;
+    return Q31(saturate32(isqrt(mean << 31)));
+}
+
+float peak(const float* src, size_t count, size_t* index) {
+    float max = 0.0f;
+    size_t idx = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const float v = std::fabs(src[i]);
+        if (v > max) {
+            max = v;
+            idx = i;
+        }
+    }
+    if (index) {
+        *index = idx;
+    }
+    return max;
+}
+
+Q15 peak(const Q15* src, size_t count, size_t* index) {
+    const int16_t max = detail::peak(raw(src), count);
+    if (index) {
+        // The vectorized search doesn't track positions, so the index is looked up afterwards
+        size_t i = 0;
+        while (i < count && std::min<int32_t>(std::abs((int32_t)src[i].value()), INT16_MAX) != max) {
+            ++i;
+        }
+        *index = (i < count) ? i : 0;
+    }
+    return Q15(max);
+}
+
+Q31 peak(const Q31* src, size_t count, size_t* index) {
+    int64_t max = 0;
+    size_t idx = 0;
+    const int32_t* s = raw(src);
+    for (size_t i = 0; i < count; ++i) {
+        const int64_t v = std::abs((int64_t)s[i]);
+        if (v > max) {
+            max = v;
+            idx = i;
+        }
+    }
+    if (index) {
+        *index = idx;
+    }
+    return Q31(saturate32(max));
+}
+
+template<typename T>
+FirFilter<T>::FirFilter() :
+        taps_(0),
+        pos_(0) {
+}
+
+template<typename T>
+int FirFilter<T>::init(const T* coeffs, size_t taps) {
+    if (!coeffs || !taps) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    coeffs_.reset(new(std::nothrow) T[taps]);
+    state_.reset(new(std::nothrow) T[taps * 2]);
+    if (!coeffs_ || !state_) {
+        coeffs_.reset();
+        state_.reset();
+        taps_ = 0;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    std::reverse_copy(coeffs, coeffs + taps, coeffs_.get());
+    taps_ = taps;
+    reset();
+    return 0;
+}
+
+template<typename T>
+void FirFilter<T>::process(const T* src, T* dest, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        push(src[i]);
+        dest[i] = compute();
+    }
+}
+
+template<typename T>
+void FirFilter<T>::reset() {
+    std::fill(state_.get(), state_.get() + taps_ * 2, T());
+    pos_ = 0;
+}
+
+template<typename T>
+void FirFilter<T>::push(T sample) {
+    // The oldest sample is overwritten in both copies of the delay line
+    state_[pos_] = sample;
+    state_[pos_ + taps_] = sample;
+    if (++pos_ == taps_) {
+        pos_ = 0;
+    }
+}
+
+template<typename T>
+T FirFilter<T>::compute() const {
+    // state_[pos_] is the oldest sample, which is multiplied by the last coefficient
+    return Traits<T>::dot(coeffs_.get(), state_.get() + pos_, taps_);
+}
+
+template<typename T>
+FirDecimator<T>::FirDecimator() :
+        factor_(1),
+        phase_(0) {
+}
+
+template<typename T>
+int FirDecimator<T>::init(const T* coeffs, size_t taps, size_t factor) {
+    if (!factor) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    const int r = fir_.init(coeffs, taps);
+    if (r < 0) {
+        return r;
+    }
+    factor_ = factor;
+    phase_ = 0;
+    return 0;
+}
+
+template<typename T>
+size_t FirDecimator<T>::process(const T* src, T* dest, size_t count) {
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i) {
+        fir_.push(src[i]);
+        if (++phase_ == factor_) {
+            dest[n++] = fir_.compute();
+            phase_ = 0;
+        }
+    }
+    return n;
+}
+
+template<typename T>
+void FirDecimator<T>::reset() {
+    fir_.reset();
+    phase_ = 0;
+}
+
+template<typename T>
+BiquadCascade<T>::BiquadCascade() :
+        stages_(0),
+        postShift_(0) {
+}
+
+template<typename T>
+int BiquadCascade<T>::init(const T* coeffs, size_t stages, unsigned postShift) {
+    if (!coeffs || !stages || postShift > maxPostShift<T>()) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    coeffs_.reset(new(std::nothrow) T[stages * 5]);
+    state_.reset(new(std::nothrow) T[stages * 4]);
+    if (!coeffs_ || !state_) {
+        coeffs_.reset();
+        state_.reset();
+        stages_ = 0;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    std::copy(coeffs, coeffs + stages * 5, coeffs_.get());
+    stages_ = stages;
+    postShift_ = postShift;
+    reset();
+    return 0;
+}
+
+template<typename T>
+void BiquadCascade<T>::process(const T* src, T* dest, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        T v = src[i];
+        for (size_t j = 0; j < stages_; ++j) {
+            v = biquadStage<T>(coeffs_.get() + j * 5, state_.get() + j * 4, v, postShift_);
+        }
+        dest[i] = v;
+    }
+}
+
+template<typename T>
+void BiquadCascade<T>::reset() {
+    std::fill(state_.get(), state_.get() + stages_ * 4, T());
+}
+
+template class FirFilter<float>;
+template class FirFilter<Q15>;
+template class FirFilter<Q31>;
+template class FirDecimator<float>;
+template class FirDecimator<Q15>;
+template class FirDecimator<Q31>;
+template class BiquadCascade<float>;
+template class BiquadCascade<Q15>;
+template class BiquadCascade<Q31>;
+
+RealFft::RealFft() :
+        size_(0) {
+}
+
+int RealFft::init(size_t size) {
+    if (size < 4 || size > MAX_FFT_SIZE || (size & (size - 1))) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    const size_t half = size / 2;
+    twiddles_.reset(new(std::nothrow) float[size]);
+    bitrev_.reset(new(std::nothrow) uint16_t[half]);
+    if (!twiddles_ || !bitrev_) {
+        twiddles_.reset();
+        bitrev_.reset();
+        size_ = 0;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    for (size_t k = 0; k < half; ++k) {
+        const double a = -2.0 * M_PI * k / size;
+        twiddles_[k * 2] = (float)std::cos(a);
+        twiddles_[k * 2 + 1] = (float)std::sin(a);
+    }
+    unsigned bits = 0;
+    while (((size_t)1 << bits) < half) {
+        ++bits;
+    }
+    for (size_t i = 0; i < half; ++i) {
+        size_t r = 0;
+        for (unsigned b = 0; b < bits; ++b) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bitrev_[i] = (uint16_t)r;
+    }
+    size_ = size;
+    return 0;
+}
+
+void RealFft::forward(const float* src, float* dest) const {
+    // The real signal of N points is transformed as a complex signal of N/2 points, with even
+    // samples as the real parts and odd samples as the imaginary parts
+    const size_t half = size_ / 2;
+    for (size_t i = 0; i < half; ++i) {
+        const size_t j = bitrev_[i];
+        dest[j * 2] = src[i * 2];
+        dest[j * 2 + 1] = src[i * 2 + 1];
+    }
+    const float* const tw = twiddles_.get();
+    // Radix-2 butterflies. The twiddles of the N/2-point transform are every other entry of the table
+    for (size_t len = 2; len <= half; len <<= 1) {
+        const size_t step = (half / len) * 2;
+        for (size_t i = 0; i < half; i += len) {
+            for (size_t k = 0; k < len / 2; ++k) {
+                const float wr = tw[k * step * 2];
+                const float wi = tw[k * step * 2 + 1];
+                float* const a = dest + (i + k) * 2;
+                float* const b = dest + (i + k + len / 2) * 2;
+                const float tr = b[0] * wr - b[1] * wi;
+                const float ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+    // Split the result into the spectrum of the real signal:
+    // X[k] = E + W^k * O, X[N/2 - k] = conj(E - W^k * O), where
+    // E = (Z[k] + conj(Z[N/2 - k])) / 2 and O = -i * (Z[k] - conj(Z[N/2 - k])) / 2
+    const float z0r = dest[0];
+    const float z0i = dest[1];
+    dest[0] = z0r + z0i;
+    dest[1] = z0r - z0i;
+    for (size_t k = 1; k <= half / 2; ++k) {
+        float* const zk = dest + k * 2;
+        float* const zn = dest + (half - k) * 2;
+        const float er = (zk[0] + zn[0]) * 0.5f;
+        const float ei = (zk[1] - zn[1]) * 0.5f;
+        const float or_ = (zk[1] + zn[1]) * 0.5f;
+        const float oi = (zn[0] - zk[0]) * 0.5f;
+        const float wr = tw[k * 2];
+        const float wi = tw[k * 2 + 1];
+        const float tr = wr * or_ - wi * oi;
+        const float ti = wr * oi + wi * or_;
+        zn[0] = er - tr;
+        zn[1] = -(ei - ti);
+        zk[0] = er + tr;
+        zk[1] = ei + ti;
+    }
+}
+
+void RealFft::magnitude(const float* spectrum, float* dest) const {
+    const size_t half = size_ / 2;
+    dest[0] = std::fabs(spectrum[0]);
+    dest[half] = std::fabs(spectrum[1]);
+    for (size_t k = 1; k < half; ++k) {
+        const float re = spectrum[k * 2];
+        const float im = spectrum[k * 2 + 1];
+        dest[k] = std::sqrt(re * re + im * im);
+    }
+}
+
+namespace detail {
+
+float dotScalar(const float* a, const float* b, size_t count) {
+    float acc = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        acc += a[i] * b[i];
+    }
+    return acc;
+}
+
+float dot(const float* a, const float* b, size_t count) {
+#if DSP_BACKEND_SSE2
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float v[4];
+    _mm_storeu_ps(v, acc);
+    float sum = (v[0] + v[1]) + (v[2] + v[3]);
+    for (; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#else
+    // Cortex-M4F and M33 have no SIMD floating point instructions. Independent accumulators let
+    // the FPU pipeline overlap the multiply-accumulate operations
+    float acc0 = 0.0f;
+    float acc1 = 0.0f;
+    float acc2 = 0.0f;
+    float acc3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        acc0 += a[i] * b[i];
+        acc1 += a[i + 1] * b[i + 1];
+        acc2 += a[i + 2] * b[i + 2];
+        acc3 += a[i + 3] * b[i + 3];
+    }
+    float sum = (acc0 + acc1) + (acc2 + acc3);
+    for (; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+int64_t dotScalar(const int16_t* a, const int16_t* b, size_t count) {
+    int64_t acc = 0;
+    for (size_t i = 0; i < count; ++i) {
+        acc += (int32_t)a[i] * b[i];
+    }
+    return acc;
+}
+
+int64_t dot(const int16_t* a, const int16_t* b, size_t count) {
+#if DSP_BACKEND_ARM
+    int64_t acc = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        acc = smlald(read32(a + i), read32(b + i), acc);
+        acc = smlald(read32(a + i + 2), read32(b + i + 2), acc);
+    }
+    for (; i < count; ++i) {
+        acc += (int32_t)a[i] * b[i];
+    }
+    return acc;
+#elif DSP_BACKEND_SSE2
+    // A pairwise sum of _mm_madd_epi16 overflows only if both products are (-1.0 * -1.0), in which
+    // case it wraps to INT32_MIN. No other pair of Q15 products sums to INT32_MIN, so that value is
+    // widened as 2^31
+    const __m128i wrapped = _mm_set1_epi32(INT32_MIN);
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        const __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        const __m128i v = _mm_madd_epi16(va, vb);
+        const __m128i sign = _mm_andnot_si128(_mm_cmpeq_epi32(v, wrapped), _mm_srai_epi32(v, 31));
+        acc = addWidened(acc, v, sign);
+    }
+    int64_t sum = horizontalSum(acc);
+    for (; i < count; ++i) {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+#else
+    return dotScalar(a, b, count);
+#endif
+}
+
+int64_t dot(const int32_t* a, const int32_t* b, size_t count) {
+    // Cortex-M4 computes each product with a single SMLAL instruction
+    int64_t acc = 0;
+    for (size_t i = 0; i < count; ++i) {
+        acc += (int64_t)a[i] * b[i];
+    }
+    return acc;
+}
+
+int64_t sumSquaresScalar(const int16_t* src, size_t count) {
+    int64_t acc = 0;
+    for (size_t i = 0; i < count; ++i) {
+        acc += (int32_t)src[i] * src[i];
+    }
+    return acc;
+}
+
+int64_t sumSquares(const int16_t* src, size_t count) {
+#if DSP_BACKEND_ARM || DSP_BACKEND_SSE2
+    return dot(src, src, count);
+#else
+    return sumSquaresScalar(src, count);
+#endif
+}
+
+int16_t peakScalar(const int16_t* src, size_t count) {
+    int32_t max = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const int32_t v = std::abs((int32_t)src[i]);
+        if (v > max) {
+            max = v;
+        }
+    }
+    return (int16_t)std::min<int32_t>(max, INT16_MAX);
+}
+
+int16_t peak(const int16_t* src, size_t count) {
+#if DSP_BACKEND_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i max = zero;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        // Saturating negation maps -32768 to 32767
+        const __m128i abs = _mm_max_epi16(v, _mm_subs_epi16(zero, v));
+        max = _mm_max_epi16(max, abs);
+    }
+    int16_t lanes[8];
+    _mm_storeu_si128((__m128i*)lanes, max);
+    int16_t result = *std::max_element(lanes, lanes + 8);
+    const int16_t tail = peakScalar(src + i, count - i);
+    return std::max(result, tail);
+#else
+    return peakScalar(src, count);
+#endif
+}
+
+} // particle::dsp::detail
+
+} // particle::dsp
+
+} // particle
@@ -28,6 +28,7 @@
 
 #include <mutex>
 #include "spark_wiring_power.h"
+#include "system_power.h"
 
 namespace {
 
@@ -63,7 +64,8 @@ FuelGauge::FuelGauge(bool _lock)
 
 FuelGauge::FuelGauge(TwoWire& i2c, bool _lock)
     : i2c_(i2c),
-      lock_(_lock) {
+      lock_(_lock),
+      maxAge_(DEFAULT_MAX_AGE) {
 
     if (lock_) {
         lock();
@@ -100,11 +102,39 @@ namespace detail {
 		float decimal = LSB / 256.0;
 		return MSB + decimal;
 	}
+
+	// Scales the state of charge to the capacity available at the charge voltage
+	float _getNormalizedSoC(float soc, uint16_t chargeVoltage) {
+		soc /= 100.0f;
+		const float termV = ((float)chargeVoltage) / 1000.0f;
+		const float magicVoltageDiff = 0.1f;
+		const float reference100PercentV = 4.2f;
+		const float referenceMaxV = std::max(reference100PercentV, termV) - magicVoltageDiff;
+
+		const float magicError = 0.05f;
+		const float maxCharge = (1.0f - (reference100PercentV - referenceMaxV)) - magicError;
+		const float minCharge = 0.0f; // 0%
+
+		float normalized = (soc - minCharge) * (1.0f / (maxCharge - minCharge)) + 0.0f;
+		// Clamp at [0.0, 1.0]
+		if (normalized < 0.0f) {
+			normalized = 0.0f;
+		} else if (normalized > 1.0f) {
+			normalized = 1.0f;
+		}
+
+		return normalized * 100.0f;
+	}
 } // namespace detail
 
 // Read and return the cell voltage
 float FuelGauge::getVCell() {
 
+	system_power_telemetry telemetry = {};
+	if (readTelemetry(&telemetry)) {
+		return detail::_getVCell(telemetry.vcell >> 8, telemetry.vcell & 0xff);
+	}
+
 	byte MSB = 0;
 	byte LSB = 0;
 
@@ -115,6 +145,11 @@ float FuelGauge::getVCell() {
 // Read and return the state of charge of the cell
 float FuelGauge::getSoC() {
 
+	system_power_telemetry telemetry = {};
+	if (readTelemetry(&telemetry)) {
+		return detail::_getSoC(telemetry.soc >> 8, telemetry.soc & 0xff);
+	}
+
 	byte MSB = 0;
 	byte LSB = 0;
 
@@ -124,28 +159,16 @@ float FuelGauge::getSoC() {
 
 float FuelGauge::getNormalizedSoC() {
 #if HAL_PLATFORM_PMIC_BQ24195
+    system_power_telemetry telemetry = {};
+    if (readTelemetry(&telemetry)) {
+        return detail::_getNormalizedSoC(detail::_getSoC(telemetry.soc >> 8, telemetry.soc & 0xff),
+                telemetry.charge_voltage);
+    }
+
     std::lock_guard<FuelGauge> l(*this);
     PMIC power(true);
 
-    const float soc = getSoC() / 100.0f;
-    const float termV = ((float)power.getChargeVoltageValue()) / 1000.0f;
-    const float magicVoltageDiff = 0.1f;
-    const float reference100PercentV = 4.2f;
-    const float referenceMaxV = std::max(reference100PercentV, termV) - magicVoltageDiff;
-
-    const float magicError = 0.05f;
-    const float maxCharge = (1.0f - (reference100PercentV - referenceMaxV)) - magicError;
-    const float minCharge = 0.0f; // 0%
-
-    float normalized = (soc - minCharge) * (1.0f / (maxCharge - minCharge)) + 0.0f;
-    // Clamp at [0.0, 1.0]
-    if (normalized < 0.0f) {
-        normalized = 0.0f;
-    } else if (normalized > 1.0f) {
-        normalized = 1.0f;
-    }
-
-    return normalized * 100.0f;
+    return detail::_getNormalizedSoC(getSoC(), power.getChargeVoltageValue());
 #else
     return 0.0f;
 #endif // HAL_PLATFORM_PMIC_BQ24195
@@ -271,6 +294,23 @@ void FuelGauge::writeRegister(byte address, byte MSB, byte LSB) {
     i2c_.endTransmission(true);
 }
 
+void FuelGauge::setMaxAge(system_tick_t maxAge) {
+    maxAge_ = maxAge;
+}
+
+bool FuelGauge::readTelemetry(system_power_telemetry* telemetry) {
+#if HAL_PLATFORM_POWER_MANAGEMENT
+    // Only the fuel gauge managed by the system is cached
+    if (!maxAge_ || &i2c_ != fuelWireInstance()) {
+        return false;
+    }
+    telemetry->size = sizeof(*telemetry);
+    return system_power_management_get_telemetry(telemetry, maxAge_, nullptr) == 0;
+#else
+    return false;
+#endif // HAL_PLATFORM_POWER_MANAGEMENT
+}
+
 bool FuelGauge::lock() {
     return i2c_.lock();
 }
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spark_wiring_i2c.h"
+
+#include "timer_hal.h"
+#include "delay_hal.h"
+#include "interrupts_hal.h"
+#include "check.h"
+
+namespace particle {
+
+I2cTransactionQueue::Backend::Backend(HAL_I2C_Interface i2c, I2cTransactionQueue* queue) :
+        i2c_(i2c),
+        queue_(queue) {
+}
+
+int I2cTransactionQueue::Backend::start(const I2cTransaction& t) {
+    HAL_I2C_Transfer_Config conf = {};
+    conf.size = sizeof(conf);
+    conf.version = 0;
+    conf.address = t.address;
+    conf.tx_buffer = t.tx;
+    conf.tx_length = t.txLength;
+    conf.rx_buffer = t.rx;
+    conf.rx_length = t.rxLength;
+    conf.flags = (t.flags & I2cTransaction::NO_STOP) ? HAL_I2C_TRANSMISSION_FLAG_NONE : HAL_I2C_TRANSMISSION_FLAG_STOP;
+    conf.callback = transferComplete;
+    conf.context = queue_;
+    return HAL_I2C_Transfer_Async(i2c_, &conf, nullptr);
+}
+
+void I2cTransactionQueue::Backend::abort() {
+    HAL_I2C_Transfer_Cancel(i2c_, nullptr);
+}
+
+uint32_t I2cTransactionQueue::Backend::millis() {
+    return HAL_Timer_Get_Milli_Seconds();
+}
+
+int I2cTransactionQueue::Backend::lock() {
+    return HAL_disable_irq();
+}
+
+void I2cTransactionQueue::Backend::unlock(int state) {
+    HAL_enable_irq(state);
+}
+
+I2cTransactionQueue::I2cTransactionQueue(HAL_I2C_Interface i2c) :
+        engine_(i2c, this),
+        timer_(nullptr),
+        started_(false) {
+}
+
+I2cTransactionQueue::~I2cTransactionQueue() {
+    end();
+}
+
+int I2cTransactionQueue::begin() {
+    if (started_) {
+        return 0;
+    }
+    if (!HAL_I2C_Is_Enabled(engine_.backend().i2c_, nullptr)) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+#if PLATFORM_THREADING
+    if (!timer_) {
+        CHECK(os_timer_create(&timer_, TIMEOUT_CHECK_INTERVAL, timerCallback, this, false /* one_shot */, nullptr));
+    }
+    CHECK(os_timer_change(timer_, OS_TIMER_CHANGE_START, false, 0, 0, nullptr));
+#endif
+    started_ = true;
+    return 0;
+}
+
+void I2cTransactionQueue::end() {
+    if (!started_) {
+        return;
+    }
+    // Let the queued transactions complete or time out, and cancel the ones that are still
+    // running after a while
+    const system_tick_t start = HAL_Timer_Get_Milli_Seconds();
+    while ((engine_.isBusy() || engine_.pending()) && HAL_Timer_Get_Milli_Seconds() - start < END_TIMEOUT) {
+        engine_.checkTimeouts();
+        HAL_Delay_Milliseconds(1);
+    }
+    engine_.cancelAll();
+#if PLATFORM_THREADING
+    if (timer_) {
+        os_timer_destroy(timer_, nullptr);
+        timer_ = nullptr;
+    }
+#endif
+    started_ = false;
+}
+
+int I2cTransactionQueue::submit(I2cTransaction* t) {
+    if (!started_) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+#if !PLATFORM_THREADING
+    // There's no timer thread to check the timeouts
+    engine_.checkTimeouts();
+#endif
+    return engine_.submit(t);
+}
+
+int I2cTransactionQueue::cancel(I2cTransaction* t) {
+    return engine_.cancel(t);
+}
+
+bool I2cTransactionQueue::isBusy() const {
+    return engine_.isBusy();
+}
+
+size_t I2cTransactionQueue::pending() const {
+    return engine_.pending();
+}
+
+I2cBusStats I2cTransactionQueue::stats() const {
+    return engine_.stats();
+}
+
+void I2cTransactionQueue::resetStats() {
+    engine_.resetStats();
+}
+
+void I2cTransactionQueue::transferComplete(int error, void* data) {
+    const auto q = static_cast<I2cTransactionQueue*>(data);
+    q->engine_.transferComplete(error);
+}
+
+void I2cTransactionQueue::timerCallback(os_timer_t timer) {
+    void* data = nullptr;
+    os_timer_get_id(timer, &data);
+    const auto q = static_cast<I2cTransactionQueue*>(data);
+    if (q) {
+        q->engine_.checkTimeouts();
+    }
+}
+
+} // particle
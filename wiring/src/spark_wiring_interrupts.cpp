@@ -28,15 +28,102 @@
 #include "spark_wiring_interrupts.h"
 #include "spark_wiring_platform.h"
 #include "system_error.h"
+#include "timer_hal.h"
+#include "concurrent_hal.h"
+#include "spark_wiring_thread.h"
 
-static wiring_interrupt_handler_t* handlers[TOTAL_PINS];
+namespace {
 
-wiring_interrupt_handler_t* allocate_handler(uint16_t pin, wiring_interrupt_handler_t& fn)
+using namespace particle;
+
+const size_t INTERRUPT_QUEUE_SIZE = 32;
+
+InterruptDispatcher<TOTAL_PINS, INTERRUPT_QUEUE_SIZE> g_dispatcher;
+
+#if PLATFORM_THREADING
+
+const size_t INTERRUPT_THREAD_STACK_SIZE = 3 * 1024;
+
+os_thread_t g_thread = OS_THREAD_INVALID_HANDLE;
+os_semaphore_t g_semaphore = nullptr;
+// Serializes deferred handlers and changes to the handlers. The mutex is recursive so that
+// deferred handlers can attach and detach interrupts
+os_mutex_recursive_t g_mutex = nullptr;
+
+void interrupt_thread(void* data)
+{
+    for (;;) {
+        os_semaphore_take(g_semaphore, CONCURRENT_WAIT_FOREVER, false);
+        os_mutex_recursive_lock(g_mutex);
+        g_dispatcher.process();
+        os_mutex_recursive_unlock(g_mutex);
+    }
+}
+
+int create_interrupt_thread()
+{
+    if (g_thread != OS_THREAD_INVALID_HANDLE) {
+        return 0;
+    }
+    os_mutex_recursive_t mutex = nullptr;
+    if (os_mutex_recursive_create(&mutex) != 0) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (os_semaphore_create(&g_semaphore, INTERRUPT_QUEUE_SIZE, 0) != 0) {
+        os_mutex_recursive_destroy(mutex);
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    // The mutex has to exist before the thread can process any interrupt
+    g_mutex = mutex;
+    if (os_thread_create(&g_thread, "isr", OS_THREAD_PRIORITY_DEFAULT + 1, interrupt_thread, nullptr,
+            INTERRUPT_THREAD_STACK_SIZE) != 0) {
+        os_semaphore_destroy(g_semaphore);
+        g_semaphore = nullptr;
+        os_mutex_recursive_destroy(g_mutex);
+        g_mutex = nullptr;
+        g_thread = OS_THREAD_INVALID_HANDLE;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    return 0;
+}
+
+int start_interrupt_thread()
 {
-    delete handlers[pin];
-    return handlers[pin] = new wiring_interrupt_handler_t(fn);
+    int ret = 0;
+    SINGLE_THREADED_BLOCK() {
+        ret = create_interrupt_thread();
+    }
+    return ret;
 }
 
+struct HandlerLock {
+    // Until the interrupt thread is started, there are no deferred handlers to synchronize with.
+    // The lock must not be taken in the interrupt context
+    HandlerLock() :
+            mutex_(g_mutex) {
+        if (mutex_) {
+            os_mutex_recursive_lock(mutex_);
+        }
+    }
+
+    ~HandlerLock() {
+        if (mutex_) {
+            os_mutex_recursive_unlock(mutex_);
+        }
+    }
+
+    os_mutex_recursive_t mutex_;
+};
+
+#else
+
+struct HandlerLock {
+};
+
+#endif // PLATFORM_THREADING
+
+} // unnamed
+
 void call_wiring_interrupt_handler(void* data)
 {
     wiring_interrupt_handler_t* handler = (wiring_interrupt_handler_t*)data;
@@ -49,6 +136,27 @@ void call_raw_interrupt_handler(void* data)
     handler();
 }
 
+void detach_dispatched_handler(uint16_t pin)
+{
+    if (HAL_IsISR()) {
+        // The handler may be running right now, it is destroyed later in the thread context
+        g_dispatcher.detachFromIsr(pin);
+    } else {
+        HandlerLock lock;
+        g_dispatcher.detach(pin);
+    }
+}
+
+void call_dispatched_interrupt_handler(void* data)
+{
+    const uint16_t pin = (uintptr_t)data;
+    if (g_dispatcher.handleInterrupt(pin, HAL_Timer_Get_Micro_Seconds())) {
+#if PLATFORM_THREADING
+        os_semaphore_give(g_semaphore, false);
+#endif
+    }
+}
+
 /*******************************************************************************
  * Function Name  : attachInterrupt
  * Description    : Arduino compatible function to attach hardware interrupts to
@@ -69,22 +177,51 @@ HAL_InterruptExtraConfiguration* configure_interrupt(HAL_InterruptExtraConfigura
   return nullptr;
 }
 
-bool attachInterrupt(uint16_t pin, wiring_interrupt_handler_t fn, InterruptMode mode, int8_t priority, uint8_t subpriority)
+bool particle::attachInterruptHandler(uint16_t pin, InterruptHandler&& handler, InterruptMode mode, int8_t priority, uint8_t subpriority, bool deferred)
 {
+    // Handlers can't be set up in the interrupt context
+    if (pin >= TOTAL_PINS || HAL_IsISR()) {
+        return false;
+    }
+#if PLATFORM_THREADING
+    if (deferred && start_interrupt_thread() != 0) {
+        return false;
+    }
+#else
+    if (deferred) {
+        return false;
+    }
+#endif
     HAL_Interrupts_Detach(pin);
-    wiring_interrupt_handler_t* handler = allocate_handler(pin, fn);
-    if (handler) {
-        HAL_InterruptExtraConfiguration extra = {0};
-        if (SYSTEM_ERROR_NONE != HAL_Interrupts_Attach(pin, call_wiring_interrupt_handler, handler, mode, configure_interrupt(extra, priority, subpriority))) {
+    {
+        HandlerLock lock;
+        if (g_dispatcher.attach(pin, std::move(handler), deferred) != 0) {
             return false;
         }
     }
-    return handler!=NULL;
+    HAL_InterruptExtraConfiguration extra = {0};
+    if (SYSTEM_ERROR_NONE != HAL_Interrupts_Attach(pin, call_dispatched_interrupt_handler, (void*)(uintptr_t)pin, mode, configure_interrupt(extra, priority, subpriority))) {
+        HandlerLock lock;
+        g_dispatcher.detach(pin);
+        return false;
+    }
+    return true;
+}
+
+bool attachInterrupt(uint16_t pin, wiring_interrupt_handler_t fn, InterruptMode mode, int8_t priority, uint8_t subpriority)
+{
+    return attachInterruptHandler(pin, std::move(fn), mode, priority, subpriority, false /* deferred */);
+}
+
+bool attachInterruptDeferred(uint16_t pin, wiring_deferred_interrupt_handler_t fn, InterruptMode mode, int8_t priority, uint8_t subpriority)
+{
+    return attachInterruptHandler(pin, std::move(fn), mode, priority, subpriority, true /* deferred */);
 }
 
 bool attachInterrupt(uint16_t pin, raw_interrupt_handler_t handler, InterruptMode mode, int8_t priority, uint8_t subpriority)
 {
     HAL_Interrupts_Detach(pin);
+    detach_dispatched_handler(pin);
     HAL_InterruptExtraConfiguration extra = {0};
     if (SYSTEM_ERROR_NONE != HAL_Interrupts_Attach(pin, call_raw_interrupt_handler, (void*)handler, mode, configure_interrupt(extra, priority, subpriority))) {
         return false;
@@ -105,13 +242,15 @@ bool detachInterrupt(uint16_t pin)
     if (SYSTEM_ERROR_NONE != HAL_Interrupts_Detach(pin)) {
         return false;
     }
-    if (handlers[pin]) {
-        delete handlers[pin];
-        handlers[pin] = nullptr;
-    }
+    detach_dispatched_handler(pin);
     return true;
 }
 
+particle::InterruptStats interruptStats(uint16_t pin)
+{
+    return g_dispatcher.stats(pin);
+}
+
 /*******************************************************************************
  * Function Name  : noInterrupts
  * Description    : Disable all external interrupts
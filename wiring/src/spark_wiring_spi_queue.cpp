@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spark_wiring_spi.h"
+
+#include "gpio_hal.h"
+#include "timer_hal.h"
+#include "interrupts_hal.h"
+#include "delay_hal.h"
+#include "concurrent_hal.h"
+#include "spark_wiring_thread.h"
+#include "check.h"
+
+#include <cstring>
+
+namespace particle {
+
+namespace {
+
+// The DMA completion callback doesn't take a context argument, so the queues are looked up by
+// the interface number
+SpiTransactionQueue* volatile g_queues[TOTAL_SPI] = {};
+
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+
+const size_t BUS_THREAD_STACK_SIZE = 1024;
+const size_t BUS_SEMAPHORE_MAX_COUNT = 16;
+
+// The bus lock is a mutex, which can only be released by the thread that acquired it, and not in
+// the interrupt context. The queues acquire and release their buses on a thread shared by all of
+// them
+os_thread_t g_busThread = OS_THREAD_INVALID_HANDLE;
+os_semaphore_t g_busSemaphore = nullptr;
+os_mutex_t g_busMutex = nullptr; // Protects g_queues from being changed while the thread uses them
+
+int createBusThread(os_thread_fn_t threadFn) {
+    if (g_busThread != OS_THREAD_INVALID_HANDLE) {
+        return 0;
+    }
+    if (os_mutex_create(&g_busMutex) != 0) {
+        g_busMutex = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (os_semaphore_create(&g_busSemaphore, BUS_SEMAPHORE_MAX_COUNT, 0) != 0) {
+        os_mutex_destroy(g_busMutex);
+        g_busMutex = nullptr;
+        g_busSemaphore = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (os_thread_create(&g_busThread, "spiq", OS_THREAD_PRIORITY_DEFAULT + 1, threadFn, nullptr,
+            BUS_THREAD_STACK_SIZE) != 0) {
+        os_semaphore_destroy(g_busSemaphore);
+        g_busSemaphore = nullptr;
+        os_mutex_destroy(g_busMutex);
+        g_busMutex = nullptr;
+        g_busThread = OS_THREAD_INVALID_HANDLE;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    return 0;
+}
+
+int startBusThread(os_thread_fn_t threadFn) {
+    int ret = 0;
+    SINGLE_THREADED_BLOCK() {
+        ret = createBusThread(threadFn);
+    }
+    return ret;
+}
+
+void notifyBusThread() {
+    os_semaphore_give(g_busSemaphore, false);
+}
+
+#endif // HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+
+} // unnamed
+
+template<size_t spi>
+void SpiTransactionQueue::transferComplete() {
+    transferComplete((HAL_SPI_Interface)spi);
+}
+
+template<size_t... spi>
+HAL_SPI_DMA_UserCallback SpiTransactionQueue::completeCallback(HAL_SPI_Interface i, std::index_sequence<spi...>) {
+    static const HAL_SPI_DMA_UserCallback callbacks[] = { transferComplete<spi>... };
+    return callbacks[i];
+}
+
+SpiTransactionQueue::Backend::Backend(HAL_SPI_Interface spi) :
+        spi_(spi),
+        systemClock_(0) {
+}
+
+// Called from the DMA completion interrupt when consecutive segments use different settings. The
+// HAL only rewrites the clock and mode registers of the peripheral in this case
+void SpiTransactionQueue::Backend::configure(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {
+    uint8_t divider = 0;
+    unsigned actual = 0;
+    SPIClass::computeClockDivider(systemClock_, clock, divider, actual);
+    HAL_SPI_Set_Settings(spi_, 0, divider, bitOrder, dataMode, nullptr);
+}
+
+void SpiTransactionQueue::Backend::select(uint16_t pin, bool selected) {
+    HAL_GPIO_Write(pin, selected ? 0 : 1);
+}
+
+void SpiTransactionQueue::Backend::transfer(const void* tx, void* rx, size_t length) {
+    HAL_SPI_DMA_Transfer(spi_, const_cast<void*>(tx), rx, length, completeCallback(spi_, std::make_index_sequence<TOTAL_SPI>()));
+}
+
+uint32_t SpiTransactionQueue::Backend::micros() {
+    return HAL_Timer_Get_Micro_Seconds();
+}
+
+int SpiTransactionQueue::Backend::lock() {
+    return HAL_disable_irq();
+}
+
+void SpiTransactionQueue::Backend::unlock(int state) {
+    HAL_enable_irq(state);
+}
+
+bool SpiTransactionQueue::Backend::requestBus() {
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+    notifyBusThread();
+    return false;
+#else
+    return true;
+#endif
+}
+
+void SpiTransactionQueue::Backend::busIdle() {
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+    notifyBusThread();
+#endif
+}
+
+SpiTransactionQueue::SpiTransactionQueue(HAL_SPI_Interface spi) :
+        engine_(spi),
+        started_(false) {
+}
+
+SpiTransactionQueue::~SpiTransactionQueue() {
+    end();
+}
+
+int SpiTransactionQueue::begin() {
+    if (started_) {
+        return 0;
+    }
+    const HAL_SPI_Interface spi = engine_.backend().spi_;
+    if (spi >= TOTAL_SPI || !HAL_SPI_Is_Enabled(spi)) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+    CHECK(startBusThread(busThread));
+    os_mutex_lock(g_busMutex);
+#endif
+    const bool busy = g_queues[spi];
+    if (!busy) {
+        hal_spi_info_t info;
+        memset(&info, 0, sizeof(info));
+        info.version = HAL_SPI_INFO_VERSION_1;
+        HAL_SPI_Info(spi, &info, nullptr);
+        engine_.backend().systemClock_ = info.system_clock;
+        g_queues[spi] = this;
+        started_ = true;
+    }
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+    os_mutex_unlock(g_busMutex);
+#endif
+    return busy ? SYSTEM_ERROR_BUSY : 0;
+}
+
+void SpiTransactionQueue::end() {
+    if (!started_) {
+        return;
+    }
+    // Let the queued transactions complete
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+    // The bus thread releases the bus once the queue drains
+    while (engine_.isBusy() || engine_.isBusRequested() || engine_.isBusGranted()) {
+        HAL_Delay_Milliseconds(1);
+    }
+    os_mutex_lock(g_busMutex);
+    g_queues[engine_.backend().spi_] = nullptr;
+    os_mutex_unlock(g_busMutex);
+#else
+    while (engine_.isBusy()) {
+        HAL_Delay_Milliseconds(1);
+    }
+    g_queues[engine_.backend().spi_] = nullptr;
+#endif
+    started_ = false;
+}
+
+int SpiTransactionQueue::submit(SpiTransaction* t) {
+    if (!started_) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    return engine_.submit(t);
+}
+
+int SpiTransactionQueue::cancel(SpiTransaction* t) {
+    return engine_.cancel(t);
+}
+
+bool SpiTransactionQueue::isBusy() const {
+    return engine_.isBusy();
+}
+
+SpiBusStats SpiTransactionQueue::stats() const {
+    return engine_.stats();
+}
+
+void SpiTransactionQueue::resetStats() {
+    engine_.resetStats();
+}
+
+#if HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+
+void SpiTransactionQueue::busThread(void* data) {
+    for (;;) {
+        os_semaphore_take(g_busSemaphore, CONCURRENT_WAIT_FOREVER, false);
+        os_mutex_lock(g_busMutex);
+        for (size_t i = 0; i < TOTAL_SPI; ++i) {
+            SpiTransactionQueue* const q = g_queues[i];
+            if (q) {
+                q->arbitrate();
+            }
+        }
+        os_mutex_unlock(g_busMutex);
+    }
+}
+
+// Called on the bus thread
+void SpiTransactionQueue::arbitrate() {
+    const HAL_SPI_Interface spi = engine_.backend().spi_;
+    if (engine_.isBusRequested()) {
+        // Other users of the bus, e.g. system drivers, get it back between the batches of
+        // transactions
+        if (HAL_SPI_Acquire(spi, nullptr) != 0) {
+            return;
+        }
+        engine_.grant();
+    }
+    if (engine_.release()) {
+        HAL_SPI_Release(spi, nullptr);
+    }
+}
+
+#endif // HAL_PLATFORM_SPI_HAL_THREAD_SAFETY
+
+void SpiTransactionQueue::transferComplete(HAL_SPI_Interface spi) {
+    SpiTransactionQueue* const q = g_queues[spi];
+    if (q) {
+        q->engine_.transferComplete();
+    }
+}
+
+} // particle
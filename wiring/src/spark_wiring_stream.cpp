@@ -25,11 +25,44 @@
  */
 
 #include "spark_wiring_stream.h"
-#include "spark_wiring.h"       // for millis())
+#include "spark_wiring_ticks.h" // for millis()
+
+#include <algorithm>
+#include <cstring>
 
 #define PARSE_TIMEOUT 1000  // default number of milli-seconds to wait
 #define NO_SKIP_CHAR  1  // a magic char not found in a valid ASCII numeric field
 
+namespace {
+
+inline bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+#define STREAM_PARSE_EIGHT_DIGITS 1
+
+// Returns true if all 8 characters loaded into a little-endian word are digits
+inline bool isEightDigits(uint64_t v) {
+  return ((v & 0xf0f0f0f0f0f0f0f0ULL) | (((v + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) ==
+      0x3333333333333333ULL;
+}
+
+// Converts 8 digits loaded into a little-endian word using a few multiplications
+inline uint32_t parseEightDigits(uint64_t v) {
+  const uint64_t mask = 0x000000ff000000ffULL;
+  const uint64_t mul1 = 100 + (1000000ULL << 32);
+  const uint64_t mul2 = 1 + (10000ULL << 32);
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  return (uint32_t)((((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32);
+}
+
+#endif // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+} // unnamed
+
 // private method to read stream with timeout
 int Stream::timedRead()
 {
@@ -54,6 +87,18 @@ int Stream::timedPeek()
   return -1;     // -1 indicates timeout
 }
 
+// waits for buffered data, returns its size, 0 if timeout, or a negative value if the stream
+// doesn't support bulk access
+int Stream::timedPeekBuffer(const char** data)
+{
+  _startMillis = millis();
+  do {
+    const int n = peekBuffer(data);
+    if (n != 0) return n;
+  } while(millis() - _startMillis < _timeout);
+  return 0;
+}
+
 // returns peek of the next digit in the stream or -1 if timeout
 // discards non-numeric characters
 int Stream::peekNextDigit()
@@ -82,7 +127,7 @@ void Stream::setTimeout(system_tick_t timeout)  // sets the maximum number of mi
  // find returns true if the target string is found
 bool  Stream::find(char *target)
 {
-  return findUntil(target, NULL);
+  return findUntil(target, strlen(target), NULL, 0);
 }
 
 // reads data from the stream until the target string of given length is found
@@ -109,6 +154,51 @@ bool Stream::findUntil(char *target, size_t targetLen, char *terminator, size_t
 
   if( *target == 0)
     return true;   // return true if target is a null string
+
+  const char* data = nullptr;
+  int n = timedPeekBuffer(&data);
+  if (n >= 0) {
+    while (n > 0) {
+      size_t i = 0;
+      while (i < (size_t)n) {
+        if (index == 0 && termLen == 0) {
+          // skip to the next candidate for the first target character
+          const char* p = (const char*)memchr(data + i, target[0], n - i);
+          const size_t end = p ? p - data : n;
+          const char* z = (const char*)memchr(data + i, 0, end - i);
+          if (z) {
+            consume(z - data + 1);
+            return false; // the search stops at a null character
+          }
+          i = end;
+          if (i == (size_t)n) break;
+        }
+        const char ch = data[i++];
+        if (ch == 0) {
+          consume(i);
+          return false;
+        }
+        if (ch != target[index])
+          index = 0;
+        if (ch == target[index] && ++index >= targetLen) {
+          consume(i);
+          return true;
+        }
+        if (termLen > 0 && ch == terminator[termIndex]) {
+          if (++termIndex >= termLen) {
+            consume(i);
+            return false;
+          }
+        }
+        else
+          termIndex = 0;
+      }
+      consume(n);
+      n = timedPeekBuffer(&data);
+    }
+    return false;
+  }
+
   while( (c = timedRead()) > 0){
 
     if(c != target[index])
@@ -148,6 +238,62 @@ long Stream::parseInt(char skipChar)
   long value = 0;
   int c;
 
+  const char* data = nullptr;
+  int n = timedPeekBuffer(&data);
+  if (n >= 0) {
+    size_t i = 0;
+    // ignore non numeric leading characters
+    for (;;) {
+      if (n <= 0)
+        return 0; // zero returned if timeout
+      while (i < (size_t)n && data[i] != '-' && !isDigit(data[i]))
+        ++i;
+      if (i < (size_t)n)
+        break;
+      consume(n);
+      i = 0;
+      n = timedPeekBuffer(&data);
+    }
+    if (data[i] == '-') {
+      isNegative = true;
+      ++i;
+    }
+    unsigned long v = 0; // wraps around like the per-byte version does
+    for (;;) {
+      while (i < (size_t)n) {
+        const char ch = data[i];
+        if (isDigit(ch)) {
+#if STREAM_PARSE_EIGHT_DIGITS
+          if (i + 8 <= (size_t)n) {
+            uint64_t w;
+            memcpy(&w, data + i, sizeof(w));
+            if (isEightDigits(w)) {
+              v = v * 100000000UL + parseEightDigits(w);
+              i += 8;
+              continue;
+            }
+          }
+#endif
+          v = v * 10 + ch - '0';
+        } else if (ch != skipChar) {
+          break;
+        }
+        ++i;
+      }
+      if (i < (size_t)n) {
+        consume(i);
+        break;
+      }
+      consume(n);
+      i = 0;
+      n = timedPeekBuffer(&data);
+      if (n <= 0)
+        break;
+    }
+    value = v;
+    return isNegative ? -value : value;
+  }
+
   c = peekNextDigit();
   // ignore non numeric leading characters
   if(c < 0)
@@ -187,27 +333,73 @@ float Stream::parseFloat(char skipChar){
   char c;
   float fraction = 1.0;
 
-  c = peekNextDigit();
+  const char* data = nullptr;
+  int n = timedPeekBuffer(&data);
+  if (n >= 0) {
+    size_t i = 0;
     // ignore non numeric leading characters
-  if(c < 0)
-    return 0; // zero returned if timeout
-
-  do{
-    if(c == skipChar) {
-      // ignore
-    } else if(c == '-') {
+    for (;;) {
+      if (n <= 0)
+        return 0; // zero returned if timeout
+      while (i < (size_t)n && data[i] != '-' && !isDigit(data[i]))
+        ++i;
+      if (i < (size_t)n)
+        break;
+      consume(n);
+      i = 0;
+      n = timedPeekBuffer(&data);
+    }
+    if (data[i] == '-') {
       isNegative = true;
-    } else if (c == '.') {
-      isFraction = true;
-    } else if(c >= '0' && c <= '9')  {      // is c a digit?
-      value = value * 10 + c - '0';
-      if(isFraction)
-         fraction *= 0.1;
+      ++i;
     }
-    read();  // consume the character we got with peek
-    c = timedPeek();
+    for (;;) {
+      while (i < (size_t)n) {
+        const char ch = data[i];
+        if (isDigit(ch)) {
+          value = value * 10 + ch - '0';
+          if(isFraction)
+            fraction *= 0.1;
+        } else if (ch == '.') {
+          isFraction = true;
+        } else if (ch != skipChar) {
+          break;
+        }
+        ++i;
+      }
+      if (i < (size_t)n) {
+        consume(i);
+        break;
+      }
+      consume(n);
+      i = 0;
+      n = timedPeekBuffer(&data);
+      if (n <= 0)
+        break;
+    }
+  } else {
+    c = peekNextDigit();
+      // ignore non numeric leading characters
+    if(c < 0)
+      return 0; // zero returned if timeout
+
+    do{
+      if(c == skipChar) {
+        // ignore
+      } else if(c == '-') {
+        isNegative = true;
+      } else if (c == '.') {
+        isFraction = true;
+      } else if(c >= '0' && c <= '9')  {      // is c a digit?
+        value = value * 10 + c - '0';
+        if(isFraction)
+           fraction *= 0.1;
+      }
+      read();  // consume the character we got with peek
+      c = timedPeek();
+    }
+    while( (c >= '0' && c <= '9')  || c == '.' || c == skipChar );
   }
-  while( (c >= '0' && c <= '9')  || c == '.' || c == skipChar );
 
   if(isNegative)
     value = -value;
@@ -225,6 +417,15 @@ float Stream::parseFloat(char skipChar){
 size_t Stream::readBytes(char *buffer, size_t length)
 {
   size_t count = 0;
+  const char* data = nullptr;
+  int n = 0;
+  while (count < length && (n = timedPeekBuffer(&data)) > 0) {
+    const size_t size = std::min((size_t)n, length - count);
+    memcpy(buffer + count, data, size);
+    consume(size);
+    count += size;
+  }
+  if (n >= 0) return count;
   while (count < length) {
     int c = timedRead();
     if (c < 0) break;
@@ -243,6 +444,21 @@ size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
 {
   if (length < 1) return 0;
   size_t index = 0;
+  const char* data = nullptr;
+  int n = 0;
+  while (index < length && (n = timedPeekBuffer(&data)) > 0) {
+    const size_t size = std::min((size_t)n, length - index);
+    const char* p = (const char*)memchr(data, terminator, size);
+    const size_t count = p ? p - data : size;
+    memcpy(buffer + index, data, count);
+    index += count;
+    if (p) {
+      consume(count + 1); // the terminator is discarded
+      return index;
+    }
+    consume(count);
+  }
+  if (n >= 0) return index;
   while (index < length) {
     int c = timedRead();
     if (c < 0 || c == terminator) break;
@@ -255,6 +471,13 @@ size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
 String Stream::readString()
 {
   String ret;
+  const char* data = nullptr;
+  int n = 0;
+  while ((n = timedPeekBuffer(&data)) > 0) {
+    ret += String(data, n);
+    consume(n);
+  }
+  if (n == 0) return ret;
   int c = timedRead();
   while (c >= 0)
   {
@@ -267,6 +490,19 @@ String Stream::readString()
 String Stream::readStringUntil(char terminator)
 {
   String ret;
+  const char* data = nullptr;
+  int n = 0;
+  while ((n = timedPeekBuffer(&data)) > 0) {
+    const char* p = (const char*)memchr(data, terminator, n);
+    const size_t count = p ? p - data : n;
+    ret += String(data, count);
+    if (p) {
+      consume(count + 1); // the terminator is discarded
+      return ret;
+    }
+    consume(count);
+  }
+  if (n == 0) return ret;
   int c = timedRead();
   while (c >= 0 && c != terminator)
   {
@@ -195,6 +195,18 @@ int TCPClient::peek()
   return  (bufferCount() || available()) ? d_->buffer[d_->offset] : -1;
 }
 
+int TCPClient::peekBuffer(const char** data)
+{
+  const int count = bufferCount() ? bufferCount() : available();
+  *data = (const char*)&d_->buffer[d_->offset];
+  return count;
+}
+
+void TCPClient::consume(size_t size)
+{
+  d_->offset += size;
+}
+
 void TCPClient::flush_buffer()
 {
   d_->offset = 0;
@@ -31,87 +31,28 @@
 #include "spark_wiring_cloud.h"
 #include "system_mode.h"
 #include "system_event.h"
+#include "time_util.h"
 
 const char* TIME_FORMAT_DEFAULT = "asctime";
 const char* TIME_FORMAT_ISO8601_FULL = "%Y-%m-%dT%H:%M:%S%z";
 
 
-/* The calendar "tm" structure from the standard libray "time.h" has the following definition: */
-//struct tm
-//{
-//	int tm_sec;         /* seconds,  range 0 to 59          */
-//	int tm_min;         /* minutes, range 0 to 59           */
-//	int tm_hour;        /* hours, range 0 to 23             */
-//	int tm_mday;        /* day of the month, range 1 to 31  */
-//	int tm_mon;         /* month, range 0 to 11             */
-//	int tm_year;        /* The number of years since 1900   */
-//	int tm_wday;        /* day of the week, range 0 to 6    */
-//	int tm_yday;        /* day in the year, range 0 to 365  */
-//	int tm_isdst;       /* daylight saving time             */
-//};
-
-struct tm calendar_time_cache;	// a cache of calendar time structure elements
-time_t unix_time_cache;  		// a cache of unix_time that was updated
 time_t time_zone_cache;			// a cache of the time zone that was set
 time_t dst_cache = 3600;        // a cache of the DST offset that was set (default 1hr)
 time_t dst_current_cache = 0;   // a cache of the DST offset currently being applied
 
-/* Time utility functions */
-static struct tm Convert_UnixTime_To_CalendarTime(time_t unix_time);
-//static time_t Convert_CalendarTime_To_UnixTime(struct tm calendar_time);
-//static struct tm Get_CalendarTime(void);
-//static void Set_CalendarTime(struct tm t);
-static void Refresh_UnixTime_Cache(time_t unix_time);
+namespace {
 
-/* Convert Unix/RTC time to Calendar time */
-static struct tm Convert_UnixTime_To_CalendarTime(time_t unix_time)
+/* Convert Unix/RTC time to local calendar time. The result is computed for every call, which is
+   cheap and keeps the accessors below safe to use from different threads */
+struct tm Convert_UnixTime_To_CalendarTime(time_t unix_time)
 {
-	struct tm *calendar_time;
-	calendar_time = localtime(&unix_time);
-	calendar_time->tm_year += 1900;
-	return *calendar_time;
-}
-
-/* Convert Calendar time to Unix/RTC time */
-/*
-static time_t Convert_CalendarTime_To_UnixTime(struct tm calendar_time)
-{
-	calendar_time.tm_year -= 1900;
-	time_t unix_time = mktime(&calendar_time);
-	return unix_time;
-}
-*/
-
-/* Get converted Calendar time */
-/*
- static struct tm Get_CalendarTime(void)
-{
-	time_t unix_time = HAL_RTC_Get_UnixTime();
-	unix_time += time_zone_cache;
-	struct tm calendar_time = Convert_UnixTime_To_CalendarTime(unix_time);
+	struct tm calendar_time;
+	particle::unixTimeToCalendar((int64_t)unix_time + time_zone_cache + dst_current_cache, &calendar_time);
 	return calendar_time;
 }
- */
 
-/* Set Calendar time as Unix/RTC time */
-/*
-static void Set_CalendarTime(struct tm calendar_time)
-{
-	HAL_RTC_Set_UnixTime(Convert_CalendarTime_To_UnixTime(calendar_time));
-}
-*/
-
-/* Refresh Unix/RTC time cache */
-static void Refresh_UnixTime_Cache(time_t unix_time)
-{
-    unix_time += time_zone_cache;
-    unix_time += dst_current_cache;
-    if(unix_time != unix_time_cache)
-    {
-            calendar_time_cache = Convert_UnixTime_To_CalendarTime(unix_time);
-            unix_time_cache = unix_time;
-    }
-}
+} // namespace
 
 const char* TimeClass::format_spec = TIME_FORMAT_DEFAULT;
 
@@ -124,8 +65,7 @@ int TimeClass::hour()
 /* the hour for the given time */
 int TimeClass::hour(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	return calendar_time_cache.tm_hour;
+	return Convert_UnixTime_To_CalendarTime(t).tm_hour;
 }
 
 /* current hour in 12 hour format */
@@ -137,13 +77,13 @@ int TimeClass::hourFormat12()
 /* the hour for the given time in 12 hour format */
 int TimeClass::hourFormat12(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	if(calendar_time_cache.tm_hour == 0)
+	const int hour = Convert_UnixTime_To_CalendarTime(t).tm_hour;
+	if(hour == 0)
 		return 12;	//midnight
-	else if( calendar_time_cache.tm_hour > 12)
-		return calendar_time_cache.tm_hour - 12 ;
+	else if(hour > 12)
+		return hour - 12;
 	else
-		return calendar_time_cache.tm_hour ;
+		return hour;
 }
 
 /* returns true if time now is AM */
@@ -179,8 +119,7 @@ int TimeClass::minute()
 /* the minute for the given time */
 int TimeClass::minute(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	return calendar_time_cache.tm_min;
+	return Convert_UnixTime_To_CalendarTime(t).tm_min;
 }
 
 /* current seconds */
@@ -192,8 +131,7 @@ int TimeClass::second()
 /* the second for the given time */
 int TimeClass::second(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	return calendar_time_cache.tm_sec;
+	return Convert_UnixTime_To_CalendarTime(t).tm_sec;
 }
 
 /* current day */
@@ -205,8 +143,7 @@ int TimeClass::day()
 /* the day for the given time */
 int TimeClass::day(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	return calendar_time_cache.tm_mday;
+	return Convert_UnixTime_To_CalendarTime(t).tm_mday;
 }
 
 /* the current weekday */
@@ -218,8 +155,7 @@ int TimeClass::weekday()
 /* the weekday for the given time */
 int TimeClass::weekday(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	return (calendar_time_cache.tm_wday + 1);//Arduino's weekday representation
+	return (Convert_UnixTime_To_CalendarTime(t).tm_wday + 1);//Arduino's weekday representation
 }
 
 /* current month */
@@ -231,8 +167,7 @@ int TimeClass::month()
 /* the month for the given time */
 int TimeClass::month(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	return (calendar_time_cache.tm_mon + 1);//Arduino's month representation
+	return (Convert_UnixTime_To_CalendarTime(t).tm_mon + 1);//Arduino's month representation
 }
 
 /* current four digit year */
@@ -244,8 +179,7 @@ int TimeClass::year()
 /* the year for the given time */
 int TimeClass::year(time_t t)
 {
-	Refresh_UnixTime_Cache(t);
-	return calendar_time_cache.tm_year;
+	return Convert_UnixTime_To_CalendarTime(t).tm_year + 1900;
 }
 
 /* return the current time as seconds since Jan 1 1970 */
@@ -314,61 +248,29 @@ void TimeClass::setTime(time_t t)
 /* return string representation for the given time */
 String TimeClass::timeStr(time_t t)
 {
-	t += time_zone_cache;
-    t += dst_current_cache;
-	tm* calendar_time = localtime(&t);
-        char* ascstr = asctime(calendar_time);
-        int len = strlen(ascstr);
-        ascstr[len-1] = 0; // remove final newline
-	return String(ascstr);
+	const struct tm calendar_time = Convert_UnixTime_To_CalendarTime(t);
+	char buf[32];
+	particle::formatTimeAsctime(calendar_time, buf, sizeof(buf));
+	return String(buf);
 }
 
 String TimeClass::format(time_t t, const char* format_spec)
 {
-    if (format_spec==NULL)
-        format_spec = this->format_spec;
-
-    if (!format_spec || !strcmp(format_spec,TIME_FORMAT_DEFAULT)) {
-        return timeStr(t);
-    }
-    t += time_zone_cache;
-    t += dst_current_cache;
-    tm* calendar_time = localtime(&t);
-    return timeFormatImpl(calendar_time, format_spec, time_zone_cache + dst_current_cache);
+    char buf[64];
+    format(t, format_spec, buf, sizeof(buf));
+    return String(buf);
 }
 
-String TimeClass::timeFormatImpl(tm* calendar_time, const char* format, int time_zone)
+size_t TimeClass::format(time_t t, const char* format_spec, char* buf, size_t size)
 {
-    char format_str[64];
-    // only copy up to n-1 to dest if no null terminator found
-    strncpy(format_str, format, sizeof(format_str) - 1); // Flawfinder: ignore (ch42318)
-    format_str[sizeof(format_str) - 1] = '\0'; // ensure null termination
-    size_t len = strlen(format_str); // Flawfinder: ignore (ch42318)
-
-    char time_zone_str[16];
-    // while we are not using stdlib for managing the timezone, we have to do this manually
-    if (!time_zone) {
-        strcpy(time_zone_str, "Z");
-    }
-    else {
-        snprintf(time_zone_str, sizeof(time_zone_str), "%+03d:%02u", time_zone/3600, abs(time_zone/60)%60);
-    }
+    if (format_spec==NULL)
+        format_spec = this->format_spec;
 
-    // replace %z with the timezone
-    for (size_t i=0; i<len-1; i++)
-    {
-        if (format_str[i]=='%' && format_str[i+1]=='z')
-        {
-            size_t tzlen = strlen(time_zone_str);
-            memcpy(format_str+i+tzlen, format_str+i+2, len-i-1);    // +1 include the 0 char
-            memcpy(format_str+i, time_zone_str, tzlen);
-            len = strlen(format_str);
-        }
+    const struct tm calendar_time = Convert_UnixTime_To_CalendarTime(t);
+    if (!format_spec || !strcmp(format_spec,TIME_FORMAT_DEFAULT)) {
+        return particle::formatTimeAsctime(calendar_time, buf, size);
     }
-
-    char buf[50];
-    strftime(buf, 50, format_str, calendar_time);
-    return String(buf);
+    return particle::formatTime(calendar_time, time_zone_cache + dst_current_cache, format_spec, buf, size);
 }
 
 bool TimeClass::isValid()
@@ -90,6 +90,17 @@ void USARTSerial::flush()
   HAL_USART_Flush_Data(_serial);
 }
 
+int USARTSerial::peekBuffer(const char** data)
+{
+  // Falls back to the per-byte parsing if the platform doesn't support direct access
+  return std::max(-1, (int)HAL_USART_Peek_Buffer(_serial, (const uint8_t**)data, nullptr));
+}
+
+void USARTSerial::consume(size_t size)
+{
+  HAL_USART_Consume_Buffer(_serial, size, nullptr);
+}
+
 size_t USARTSerial::write(uint8_t c)
 {
   // attempt a write if blocking, or for non-blocking if there is room.
@@ -26,6 +26,7 @@
 
 #include "spark_wiring_usbserial.h"
 #include "platform_headers.h"
+#include "system_error.h"
 
 //
 // Constructor
@@ -68,6 +69,23 @@ int USBSerial::read()
 	return std::max(-1, (int)HAL_USB_USART_Receive_Data(_serial, false));
 }
 
+int USBSerial::read(uint8_t* buffer, size_t size)
+{
+  const int32_t n = HAL_USB_USART_Receive_Buffer(_serial, buffer, size, nullptr);
+  if (n != SYSTEM_ERROR_NOT_SUPPORTED) {
+    return std::max(0, (int)n);
+  }
+  size_t count = 0;
+  for (; count < size; ++count) {
+    const int32_t c = HAL_USB_USART_Receive_Data(_serial, false);
+    if (c < 0) {
+      break;
+    }
+    buffer[count] = c;
+  }
+  return count;
+}
+
 int USBSerial::availableForWrite()
 {
   return std::max(0, (int)HAL_USB_USART_Available_Data_For_Write(_serial));
@@ -86,11 +104,39 @@ size_t USBSerial::write(uint8_t byte)
   return 0;
 }
 
+size_t USBSerial::write(const uint8_t* buffer, size_t size)
+{
+  size_t written = 0;
+  while (written < size) {
+    // The data is copied into the transmit ring in as few chunks as possible
+    const int32_t n = HAL_USB_USART_Send_Buffer(_serial, buffer + written, size - written, nullptr);
+    if (n == SYSTEM_ERROR_NOT_SUPPORTED) {
+      return written + Print::write(buffer + written, size - written);
+    }
+    if (n < 0 || (n == 0 && !_blocking)) {
+      break;
+    }
+    written += n;
+  }
+  return written;
+}
+
 void USBSerial::flush()
 {
   HAL_USB_USART_Flush_Data(_serial);
 }
 
+int USBSerial::peekBuffer(const char** data)
+{
+  // Falls back to the per-byte parsing if the platform doesn't support direct access
+  return std::max(-1, (int)HAL_USB_USART_Peek_Buffer(_serial, (const uint8_t**)data, nullptr));
+}
+
+void USBSerial::consume(size_t size)
+{
+  HAL_USB_USART_Consume_Buffer(_serial, size, nullptr);
+}
+
 void USBSerial::blockOnOverrun(bool block)
 {
   _blocking = block;